@@ -37,6 +37,7 @@
 #include <string.h>
 
 #include "gpm-common.h"
+#include "gpm-state-page.h"
 
 #define GPM_TYPE_BRIGHTNESS_APPLET (gpm_brightness_applet_get_type())
 #define GPM_BRIGHTNESS_APPLET(o)                               \
@@ -68,6 +69,8 @@ typedef struct {
   DBusGConnection *connection;
   guint bus_watch_id;
   guint level;
+  /* what the daemon publishes, read without asking it */
+  const GpmStatePage *state_page;
   /* a cache for panel size */
   gint size;
   /* the slider action delaying */
@@ -130,11 +133,33 @@ static void gpm_applet_destroy_cb(GtkWidget *widget);
  * too long one will seem unresponsive. */
 #define GPM_BRIGHTNESS_APPLET_SLIDER_FREQUENCY 100
 
+/**
+ * gpm_applet_read_state:
+ *
+ * Opens the state page again if it is missing or a new daemon replaced it.
+ **/
+static gboolean gpm_applet_read_state(GpmBrightnessApplet *applet,
+                                      GpmStatePage *snapshot) {
+  gchar *filename;
+
+  if (applet->state_page != NULL &&
+      gpm_state_page_read(applet->state_page, snapshot))
+    return TRUE;
+
+  gpm_state_page_close(applet->state_page);
+  filename = gpm_state_page_get_filename();
+  applet->state_page = gpm_state_page_open(filename, NULL);
+  g_free(filename);
+  return applet->state_page != NULL &&
+         gpm_state_page_read(applet->state_page, snapshot);
+}
+
 /**
  * gpm_applet_get_brightness:
  * Return value: Success value, or zero for failure
  **/
 static gboolean gpm_applet_get_brightness(GpmBrightnessApplet *applet) {
+  GpmStatePage snapshot;
   GError *error = NULL;
   gboolean ret;
   guint policy_brightness;
@@ -144,6 +169,13 @@ static gboolean gpm_applet_get_brightness(GpmBrightnessApplet *applet) {
     return FALSE;
   }
 
+  /* no round trip to the daemon if it has published the level */
+  if (gpm_applet_read_state(applet, &snapshot) &&
+      snapshot.fields[GPM_STATE_FIELD_BRIGHTNESS] != GPM_STATE_PAGE_UNKNOWN) {
+    applet->level = snapshot.fields[GPM_STATE_FIELD_BRIGHTNESS];
+    return TRUE;
+  }
+
   ret =
       dbus_g_proxy_call(applet->proxy, "GetBrightness", &error, G_TYPE_INVALID,
                         G_TYPE_UINT, &policy_brightness, G_TYPE_INVALID);
@@ -852,6 +884,7 @@ static void gpm_applet_destroy_cb(GtkWidget *widget) {
   }
 
   g_bus_unwatch_name(applet->bus_watch_id);
+  gpm_state_page_close(applet->state_page);
   if (applet->icon != NULL) g_object_unref(applet->icon);
 }
 
@@ -959,6 +992,7 @@ static void gpm_brightness_applet_init(GpmBrightnessApplet *applet) {
   applet->icon = NULL;
   applet->connection = NULL;
   applet->proxy = NULL;
+  applet->state_page = NULL;
   applet->slider_delay_id = 0;
 
   /* Add application specific icons to search path */
@@ -36,6 +36,7 @@
 #include <string.h>
 
 #include "gpm-common.h"
+#include "gpm-state-page.h"
 
 #define GPM_TYPE_INHIBIT_APPLET (gpm_inhibit_applet_get_type())
 #define GPM_INHIBIT_APPLET(o) \
@@ -61,6 +62,10 @@ typedef struct {
   DBusGConnection *connection;
   guint bus_watch_id;
   guint level;
+  /* what mate-power-manager publishes, and when it changes */
+  const GpmStatePage *state_page;
+  GDBusConnection *state_connection;
+  guint state_changed_id;
   /* a cache for panel size */
   gint size;
 } GpmInhibitApplet;
@@ -74,6 +79,9 @@ GType gpm_inhibit_applet_get_type(void);
 #define GS_DBUS_SERVICE "org.gnome.SessionManager"
 #define GS_DBUS_PATH "/org/gnome/SessionManager"
 #define GS_DBUS_INTERFACE "org.gnome.SessionManager"
+#define GPM_DBUS_SERVICE "org.mate.PowerManager"
+#define GPM_DBUS_PATH "/org/mate/PowerManager"
+#define GPM_DBUS_INTERFACE "org.mate.PowerManager"
 
 G_DEFINE_TYPE(GpmInhibitApplet, gpm_inhibit_applet, PANEL_TYPE_APPLET)
 
@@ -206,6 +214,33 @@ static void gpm_applet_size_allocate_cb(GtkWidget *widget,
   gtk_image_set_pixel_size(GTK_IMAGE(applet->image), size);
 }
 
+/**
+ * gpm_applet_get_inhibitors:
+ * @applet: Inhibit applet instance
+ *
+ * Return value: the number of session inhibitors mate-power-manager has
+ * published, or zero if it has not
+ **/
+static guint gpm_applet_get_inhibitors(GpmInhibitApplet *applet) {
+  GpmStatePage snapshot;
+  gchar *filename;
+
+  if (applet->state_page == NULL ||
+      !gpm_state_page_read(applet->state_page, &snapshot)) {
+    /* missing, or replaced by a new daemon */
+    gpm_state_page_close(applet->state_page);
+    filename = gpm_state_page_get_filename();
+    applet->state_page = gpm_state_page_open(filename, NULL);
+    g_free(filename);
+    if (applet->state_page == NULL ||
+        !gpm_state_page_read(applet->state_page, &snapshot))
+      return 0;
+  }
+  if (snapshot.fields[GPM_STATE_FIELD_INHIBITORS] == GPM_STATE_PAGE_UNKNOWN)
+    return 0;
+  return snapshot.fields[GPM_STATE_FIELD_INHIBITORS];
+}
+
 /**
  * gpm_applet_update_tooltip:
  * @applet: Inhibit applet instance
@@ -213,17 +248,38 @@ static void gpm_applet_size_allocate_cb(GtkWidget *widget,
  * sets tooltip's content (percentage or disabled)
  **/
 static void gpm_applet_update_tooltip(GpmInhibitApplet *applet) {
-  const gchar *buf;
+  gchar *buf;
+  guint inhibitors;
+
   if (applet->proxy == NULL) {
-    buf = _("Cannot connect to mate-power-manager");
+    buf = g_strdup(_("Cannot connect to mate-power-manager"));
+  } else if (applet->cookie > 0) {
+    buf = g_strdup(_("Automatic sleep inhibited"));
+  } else if ((inhibitors = gpm_applet_get_inhibitors(applet)) > 0) {
+    buf = g_strdup_printf(ngettext("Automatic sleep inhibited by %u program",
+                                   "Automatic sleep inhibited by %u programs",
+                                   inhibitors),
+                          inhibitors);
   } else {
-    if (applet->cookie > 0) {
-      buf = _("Automatic sleep inhibited");
-    } else {
-      buf = _("Automatic sleep enabled");
-    }
+    buf = g_strdup(_("Automatic sleep enabled"));
   }
   gtk_widget_set_tooltip_text(GTK_WIDGET(applet), buf);
+  g_free(buf);
+}
+
+/**
+ * gpm_applet_state_changed_cb:
+ *
+ * mate-power-manager changed its state page; reading it costs nothing.
+ **/
+static void gpm_applet_state_changed_cb(GDBusConnection *connection,
+                                        const gchar *sender_name,
+                                        const gchar *object_path,
+                                        const gchar *interface_name,
+                                        const gchar *signal_name,
+                                        GVariant *parameters,
+                                        GpmInhibitApplet *applet) {
+  gpm_applet_update_tooltip(applet);
 }
 
 /**
@@ -321,6 +377,12 @@ static void gpm_applet_destroy_cb(GtkWidget *widget) {
   GpmInhibitApplet *applet = GPM_INHIBIT_APPLET(widget);
 
   g_bus_unwatch_name(applet->bus_watch_id);
+  if (applet->state_connection != NULL) {
+    g_dbus_connection_signal_unsubscribe(applet->state_connection,
+                                         applet->state_changed_id);
+    g_object_unref(applet->state_connection);
+  }
+  gpm_state_page_close(applet->state_page);
 }
 
 /**
@@ -413,6 +475,8 @@ static void gpm_inhibit_applet_init(GpmInhibitApplet *applet) {
   applet->cookie = 0;
   applet->connection = NULL;
   applet->proxy = NULL;
+  applet->state_page = NULL;
+  applet->state_connection = NULL;
 
   /* Add application specific icons to search path */
   gtk_icon_theme_append_search_path(gtk_icon_theme_get_default(),
@@ -425,6 +489,14 @@ static void gpm_inhibit_applet_init(GpmInhibitApplet *applet) {
       (GBusNameVanishedCallback)gpm_inhibit_applet_name_vanished_cb, applet,
       NULL);
 
+  /* others inhibiting are shown too, as mate-power-manager publishes them */
+  applet->state_connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+  if (applet->state_connection != NULL)
+    applet->state_changed_id = g_dbus_connection_signal_subscribe(
+        applet->state_connection, GPM_DBUS_SERVICE, GPM_DBUS_INTERFACE,
+        "StateChanged", GPM_DBUS_PATH, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+        (GDBusSignalCallback)gpm_applet_state_changed_cb, applet, NULL);
+
   /* prepare */
   mate_panel_applet_set_flags(MATE_PANEL_APPLET(applet),
                               MATE_PANEL_APPLET_EXPAND_MINOR);
@@ -45,6 +45,69 @@ static gfloat egg_array_float_guassian_value(gfloat x, gfloat sigma) {
          (expf((-(powf(x, 2.0))) / (2.0 * powf(sigma, 2.0))));
 }
 
+/* number of independent accumulators used in the reductions */
+#define EGG_ARRAY_FLOAT_LANES 4
+
+struct EggArrayFloatIndex {
+  EggArrayFloat *array;
+  gdouble *prefix;
+  guint length;
+  gboolean valid;
+};
+
+/**
+ * egg_array_float_sum_data:
+ *
+ * @data: input data
+ * @length: number of elements
+ * Return value: the compensated sum, in double precision
+ *
+ * Kahan summation over several independent lanes. The lanes break the
+ * dependency on a single accumulator so the compiler can keep the adds in
+ * flight (or use vector registers), and the compensation stops long runs
+ * of small values being swallowed by a large running total.
+ **/
+static gdouble egg_array_float_sum_data(const gfloat *data, guint length) {
+  gdouble sum[EGG_ARRAY_FLOAT_LANES] = {0.0};
+  gdouble comp[EGG_ARRAY_FLOAT_LANES] = {0.0};
+  gdouble total = 0.0;
+  gdouble error = 0.0;
+  gdouble y;
+  gdouble t;
+  guint i;
+  guint j;
+
+  for (i = 0; i + EGG_ARRAY_FLOAT_LANES <= length;
+       i += EGG_ARRAY_FLOAT_LANES) {
+    for (j = 0; j < EGG_ARRAY_FLOAT_LANES; j++) {
+      y = (gdouble)data[i + j] - comp[j];
+      t = sum[j] + y;
+      comp[j] = (t - sum[j]) - y;
+      sum[j] = t;
+    }
+  }
+
+  /* the tail that does not fill a complete set of lanes */
+  for (j = 0; i < length; i++, j++) {
+    y = (gdouble)data[i] - comp[j];
+    t = sum[j] + y;
+    comp[j] = (t - sum[j]) - y;
+    sum[j] = t;
+  }
+
+  /* fold the lanes together, Neumaier style as they may differ in size */
+  for (j = 0; j < EGG_ARRAY_FLOAT_LANES; j++) {
+    t = total + sum[j];
+    if (fabs(total) >= fabs(sum[j]))
+      error += (total - t) + sum[j];
+    else
+      error += (sum[j] - t) + total;
+    total = t;
+    error -= comp[j];
+  }
+  return total + error;
+}
+
 /**
  * egg_array_float_new:
  *
@@ -54,13 +117,11 @@ static gfloat egg_array_float_guassian_value(gfloat x, gfloat sigma) {
  * Creates a new size array which is zeroed. Free with g_array_free();
  **/
 EggArrayFloat *egg_array_float_new(guint length) {
-  guint i;
   EggArrayFloat *array;
-  array = g_array_sized_new(TRUE, FALSE, sizeof(gfloat), length);
-  array->len = length;
 
-  /* clear to 0.0 */
-  for (i = 0; i < length; i++) g_array_index(array, gfloat, i) = 0.0;
+  /* all-bits-zero is 0.0 for IEEE floats, so let GArray clear it */
+  array = g_array_sized_new(TRUE, TRUE, sizeof(gfloat), length);
+  g_array_set_size(array, length);
   return array;
 }
 
@@ -101,13 +162,10 @@ void egg_array_float_free(EggArrayFloat *array) {
  * Gets the average value.
  **/
 gfloat egg_array_float_get_average(EggArrayFloat *array) {
-  guint i;
-  guint length;
-  gfloat average = 0;
+  gdouble total;
 
-  length = array->len;
-  for (i = 0; i < length; i++) average += g_array_index(array, gfloat, i);
-  return average / (gfloat)length;
+  total = egg_array_float_sum_data((const gfloat *)array->data, array->len);
+  return total / (gdouble)array->len;
 }
 
 /**
@@ -164,13 +222,7 @@ EggArrayFloat *egg_array_float_compute_gaussian(guint length, gfloat sigma) {
  * Sum the elements of the array
  **/
 gfloat egg_array_float_sum(EggArrayFloat *array) {
-  guint length;
-  guint i;
-  gfloat total = 0;
-
-  length = array->len;
-  for (i = 0; i < length; i++) total += g_array_index(array, gfloat, i);
-  return total;
+  return egg_array_float_sum_data((const gfloat *)array->data, array->len);
 }
 
 /**
@@ -191,6 +243,26 @@ gboolean egg_array_float_print(EggArrayFloat *array) {
   return TRUE;
 }
 
+/**
+ * egg_array_float_convolve_edge:
+ *
+ * Convolves a single point, clamping to the first and last data values.
+ **/
+static gfloat egg_array_float_convolve_edge(const gfloat *data,
+                                            gint length_data,
+                                            const gfloat *kernel,
+                                            gint length_kernel, gint i) {
+  gfloat value = 0;
+  gint idx;
+  gint j;
+
+  for (j = 0; j < length_kernel; j++) {
+    idx = CLAMP(i + j - (length_kernel / 2), 0, length_data - 1);
+    value += data[idx] * kernel[j];
+  }
+  return value;
+}
+
 /**
  * egg_array_float_convolve:
  *
@@ -199,37 +271,49 @@ gboolean egg_array_float_print(EggArrayFloat *array) {
  * Return value: Colvolved array, same length as data
  *
  * Convolves an array with a kernel, and returns an array the same size.
- * THIS FUNCTION IS REALLY SLOW...
+ * Points closer than half a kernel to either end reuse the first or last
+ * value of the data.
  **/
 EggArrayFloat *egg_array_float_convolve(EggArrayFloat *data,
                                         EggArrayFloat *kernel) {
   gint length_data;
   gint length_kernel;
+  gint half_kernel;
+  gint inner_start;
+  gint inner_end;
   EggArrayFloat *result;
+  const gfloat *d;
+  const gfloat *k;
+  gfloat *r;
   gfloat value;
   gint i;
   gint j;
-  gint idx;
 
   length_data = data->len;
   length_kernel = kernel->len;
+  half_kernel = length_kernel / 2;
 
   result = egg_array_float_new(length_data);
+  d = (const gfloat *)data->data;
+  k = (const gfloat *)kernel->data;
+  r = (gfloat *)result->data;
+
+  /* the kernel only fits entirely inside the data in [start,end) */
+  inner_start = MIN(half_kernel, length_data);
+  inner_end = MAX(length_data - (length_kernel - half_kernel - 1), inner_start);
 
-  /* convolve */
-  for (i = 0; i < length_data; i++) {
+  /* no clamping needed, so keep the inner loop free of branches */
+  for (i = inner_start; i < inner_end; i++) {
     value = 0;
-    for (j = 0; j < length_kernel; j++) {
-      idx = i + j - (length_kernel / 2);
-      if (idx < 0)
-        idx = 0;
-      else if (idx >= length_data)
-        idx = length_data - 1;
-      value +=
-          g_array_index(data, gfloat, idx) * g_array_index(kernel, gfloat, j);
-    }
-    g_array_index(result, gfloat, i) = value;
+    for (j = 0; j < length_kernel; j++) value += d[i - half_kernel + j] * k[j];
+    r[i] = value;
   }
+
+  /* the edges, where the kernel hangs off the end of the data */
+  for (i = 0; i < inner_start; i++)
+    r[i] = egg_array_float_convolve_edge(d, length_data, k, length_kernel, i);
+  for (i = inner_end; i < length_data; i++)
+    r[i] = egg_array_float_convolve_edge(d, length_data, k, length_kernel, i);
   return result;
 }
 
@@ -242,17 +326,125 @@ EggArrayFloat *egg_array_float_convolve(EggArrayFloat *data,
  **/
 gfloat egg_array_float_compute_integral(EggArrayFloat *array, guint x1,
                                         guint x2) {
-  gfloat value;
+  g_return_val_if_fail(x2 >= x1, 0.0);
+  g_return_val_if_fail(x2 < array->len, 0.0);
+
+  /* if the same point, then we have no area */
+  if (x1 == x2) return 0.0;
+
+  return egg_array_float_sum_data(&g_array_index(array, gfloat, x1),
+                                  x2 - x1 + 1);
+}
+
+/**
+ * egg_array_float_index_new:
+ *
+ * @array: input array, which has to outlive the index
+ * Return value: a new index, free with egg_array_float_index_free()
+ *
+ * Creates a prefix-sum index so that repeated integrals and averages over
+ * ranges of @array take constant time. Nothing is computed until the first
+ * query, and the index has to be invalidated if the values are changed.
+ **/
+EggArrayFloatIndex *egg_array_float_index_new(EggArrayFloat *array) {
+  EggArrayFloatIndex *index;
+
+  g_return_val_if_fail(array != NULL, NULL);
+
+  index = g_new0(EggArrayFloatIndex, 1);
+  index->array = array;
+  return index;
+}
+
+/**
+ * egg_array_float_index_free:
+ *
+ * @index: the index
+ **/
+void egg_array_float_index_free(EggArrayFloatIndex *index) {
+  if (index == NULL) return;
+  g_free(index->prefix);
+  g_free(index);
+}
+
+/**
+ * egg_array_float_index_invalidate:
+ *
+ * @index: the index
+ *
+ * Marks the index as stale after the array has been modified, it is
+ * rebuilt on the next query. Changing the length is noticed automatically.
+ **/
+void egg_array_float_index_invalidate(EggArrayFloatIndex *index) {
+  g_return_if_fail(index != NULL);
+  index->valid = FALSE;
+}
+
+/**
+ * egg_array_float_index_ensure:
+ **/
+static void egg_array_float_index_ensure(EggArrayFloatIndex *index) {
+  const gfloat *data;
+  gdouble comp = 0.0;
+  gdouble total = 0.0;
+  gdouble y;
+  gdouble t;
   guint i;
 
+  if (index->valid && index->length == index->array->len) return;
+
+  if (index->prefix == NULL || index->length != index->array->len) {
+    g_free(index->prefix);
+    index->length = index->array->len;
+    index->prefix = g_new(gdouble, index->length + 1);
+  }
+
+  /* prefix[i] is the compensated sum of the first i values */
+  data = (const gfloat *)index->array->data;
+  index->prefix[0] = 0.0;
+  for (i = 0; i < index->length; i++) {
+    y = (gdouble)data[i] - comp;
+    t = total + y;
+    comp = (t - total) - y;
+    total = t;
+    index->prefix[i + 1] = total;
+  }
+  index->valid = TRUE;
+}
+
+/**
+ * egg_array_float_index_get_integral:
+ *
+ * @index: the index
+ * Return value: the same as egg_array_float_compute_integral()
+ **/
+gfloat egg_array_float_index_get_integral(EggArrayFloatIndex *index, guint x1,
+                                          guint x2) {
+  g_return_val_if_fail(index != NULL, 0.0);
   g_return_val_if_fail(x2 >= x1, 0.0);
+  g_return_val_if_fail(x2 < index->array->len, 0.0);
 
   /* if the same point, then we have no area */
   if (x1 == x2) return 0.0;
 
-  value = 0.0;
-  for (i = x1; i <= x2; i++) value += g_array_index(array, gfloat, i);
-  return value;
+  egg_array_float_index_ensure(index);
+  return index->prefix[x2 + 1] - index->prefix[x1];
+}
+
+/**
+ * egg_array_float_index_get_average:
+ *
+ * @index: the index
+ * Return value: the average of the values from @x1 to @x2 inclusive
+ **/
+gfloat egg_array_float_index_get_average(EggArrayFloatIndex *index, guint x1,
+                                         guint x2) {
+  g_return_val_if_fail(index != NULL, 0.0);
+  g_return_val_if_fail(x2 >= x1, 0.0);
+  g_return_val_if_fail(x2 < index->array->len, 0.0);
+
+  egg_array_float_index_ensure(index);
+  return (index->prefix[x2 + 1] - index->prefix[x1]) / (gdouble)(x2 - x1 + 1);
 }
 
 /**
@@ -351,13 +543,73 @@ out:
 #ifdef EGG_TEST
 #include "egg-test.h"
 
+/* the straightforward versions, to check the fast paths against */
+static gdouble egg_array_float_test_sum_ref(EggArrayFloat *array, guint x1,
+                                            guint x2) {
+  long double total = 0;
+  guint i;
+  for (i = x1; i <= x2; i++) total += g_array_index(array, gfloat, i);
+  return total;
+}
+
+static EggArrayFloat *egg_array_float_test_convolve_ref(EggArrayFloat *data,
+                                                        EggArrayFloat *kernel) {
+  EggArrayFloat *result;
+  gfloat value;
+  gint i;
+  gint j;
+  gint idx;
+
+  result = egg_array_float_new(data->len);
+  for (i = 0; i < (gint)data->len; i++) {
+    value = 0;
+    for (j = 0; j < (gint)kernel->len; j++) {
+      idx = i + j - (kernel->len / 2);
+      if (idx < 0)
+        idx = 0;
+      else if (idx >= (gint)data->len)
+        idx = data->len - 1;
+      value +=
+          g_array_index(data, gfloat, idx) * g_array_index(kernel, gfloat, j);
+    }
+    g_array_index(result, gfloat, i) = value;
+  }
+  return result;
+}
+
+static gboolean egg_array_float_test_equal(EggArrayFloat *a,
+                                           EggArrayFloat *b) {
+  gfloat x;
+  gfloat y;
+  guint i;
+
+  if (a->len != b->len) return FALSE;
+  for (i = 0; i < a->len; i++) {
+    x = g_array_index(a, gfloat, i);
+    y = g_array_index(b, gfloat, i);
+    if (fabs(x - y) > 1e-4 * MAX(1.0, fabs(y))) return FALSE;
+  }
+  return TRUE;
+}
+
 void egg_array_float_test(gpointer data) {
   EggArrayFloat *array;
   EggArrayFloat *kernel;
   EggArrayFloat *result;
+  EggArrayFloat *big;
+  EggArrayFloat *expected;
+  EggArrayFloatIndex *index;
+  GRand *rand;
   gfloat value;
   gfloat sigma;
+  gdouble reference;
+  gdouble rate;
+  gboolean ret;
+  guint elapsed;
   guint size;
+  guint x1;
+  guint x2;
+  guint i;
   EggTest *test = (EggTest *)data;
 
   if (egg_test_start(test, "EggArrayFloat") == FALSE) return;
@@ -735,7 +987,157 @@ void egg_array_float_test(gpointer data) {
     egg_test_failed(test, "did not average okay (%i)", value);
 
   egg_array_float_free(result);
+
+  /*************** INDEX TEST ************************/
+  egg_test_title(test, "index integration matches");
+  index = egg_array_float_index_new(array);
+  ret = TRUE;
+  for (x1 = 0; x1 < 10; x1++) {
+    for (x2 = x1; x2 < 10; x2++) {
+      if (egg_array_float_index_get_integral(index, x1, x2) !=
+          egg_array_float_compute_integral(array, x1, x2))
+        ret = FALSE;
+    }
+  }
+  if (ret)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "index and integral disagree");
+
+  /************************************************************/
+  egg_test_title(test, "index average");
+  value = egg_array_float_index_get_average(index, 2, 6);
+  if (value == 4.0)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "did not average okay (%f)", value);
+
+  /************************************************************/
+  egg_test_title(test, "index rebuilt after invalidate");
+  egg_array_float_set(array, 3, 13.0);
+  egg_array_float_index_invalidate(index);
+  value = egg_array_float_index_get_integral(index, 0, 4);
+  if (value == 0 + 1 + 2 + 13 + 4)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "did not intergrated okay (%f)", value);
+
+  /************************************************************/
+  egg_test_title(test, "index rebuilt after resize");
+  g_array_set_size(array, 12);
+  egg_array_float_set(array, 10, 10.0);
+  egg_array_float_set(array, 11, 11.0);
+  value = egg_array_float_index_get_integral(index, 9, 11);
+  if (value == 9 + 10 + 11)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "did not intergrated okay (%f)", value);
+  egg_array_float_index_free(index);
   egg_array_float_free(array);
+
+  /*************** SCALAR COMPARISON TESTS ************************/
+  rand = g_rand_new_with_seed(0x5eed);
+  size = 1000003;
+  big = egg_array_float_new(size);
+  for (i = 0; i < size; i++)
+    egg_array_float_set(big, i, g_rand_double_range(rand, -10.0, 100.0));
+
+  /************************************************************/
+  egg_test_title(test, "sum matches scalar on odd length");
+  reference = egg_array_float_test_sum_ref(big, 0, size - 1);
+  value = egg_array_float_sum(big);
+  if (fabs(value - reference) <= 1e-6 * fabs(reference))
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %f, expected %f", value, reference);
+
+  /************************************************************/
+  egg_test_title(test, "sum is compensated");
+  for (i = 0; i < size; i++) egg_array_float_set(big, i, 0.1f);
+  egg_array_float_set(big, 0, 1e7f);
+  reference = egg_array_float_test_sum_ref(big, 0, size - 1);
+  value = egg_array_float_sum(big);
+  if (fabs(value - reference) <= 1.0)
+    egg_test_success(test, "got %f", value);
+  else
+    egg_test_failed(test, "got %f, expected %f", value, reference);
+
+  /************************************************************/
+  egg_test_title(test, "average matches scalar");
+  value = egg_array_float_get_average(big);
+  if (fabs(value - reference / size) <= 1e-3)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %f, expected %f", value, reference / size);
+
+  /************************************************************/
+  egg_test_title(test, "convolve matches scalar for all short lengths");
+  ret = TRUE;
+  for (size = 0; size < 20 && ret; size++) {
+    result = egg_array_float_new(size);
+    for (i = 0; i < size; i++)
+      egg_array_float_set(result, i, g_rand_double_range(rand, 0.0, 10.0));
+    expected = egg_array_float_test_convolve_ref(result, kernel);
+    array = egg_array_float_convolve(result, kernel);
+    ret = egg_array_float_test_equal(array, expected);
+    egg_array_float_free(array);
+    egg_array_float_free(expected);
+    egg_array_float_free(result);
+  }
+  if (ret)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "differs at length %i", size - 1);
+
+  /************************************************************/
+  egg_test_title(test, "index matches scalar on random ranges");
+  size = big->len;
+  for (i = 0; i < size; i++)
+    egg_array_float_set(big, i, g_rand_double_range(rand, 0.0, 100.0));
+  index = egg_array_float_index_new(big);
+  ret = TRUE;
+  for (i = 0; i < 1000 && ret; i++) {
+    x1 = g_rand_int_range(rand, 0, size);
+    x2 = g_rand_int_range(rand, x1, size);
+    reference = x1 == x2 ? 0.0 : egg_array_float_test_sum_ref(big, x1, x2);
+    value = egg_array_float_index_get_integral(index, x1, x2);
+    if (fabs(value - reference) > 1e-5 * MAX(1.0, reference)) ret = FALSE;
+  }
+  if (ret)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %f for %i-%i, expected %f", value, x1, x2,
+                    reference);
+
+  /************************************************************/
+  egg_test_title(test, "index range query timing");
+  reference = 0;
+  for (i = 0; i < 1000000; i++)
+    reference += egg_array_float_index_get_average(index, i % 1000, size - 1);
+  elapsed = egg_test_elapsed(test);
+  egg_test_success(test, "1000000 queries in %ims", elapsed);
+  egg_array_float_index_free(index);
+
+  /************************************************************/
+  egg_test_title(test, "sum throughput");
+  reference = 0;
+  for (i = 0; i < 32; i++) reference += egg_array_float_sum(big);
+  elapsed = egg_test_elapsed(test);
+  rate = (gdouble)size * sizeof(gfloat) * 32 / (MAX(elapsed, 1) * 1e6);
+  egg_test_success(test, "%ims (%.2f GB/s)", elapsed, rate);
+
+  /************************************************************/
+  egg_test_title(test, "convolve throughput");
+  for (i = 0; i < 8; i++) {
+    result = egg_array_float_convolve(big, kernel);
+    egg_array_float_free(result);
+  }
+  elapsed = egg_test_elapsed(test);
+  rate = (gdouble)size * sizeof(gfloat) * 8 / (MAX(elapsed, 1) * 1e6);
+  egg_test_success(test, "%ims (%.2f GB/s)", elapsed, rate);
+
+  egg_array_float_free(big);
+  g_rand_free(rand);
   egg_array_float_free(kernel);
 
   egg_test_end(test);
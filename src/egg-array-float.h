@@ -30,6 +30,9 @@ G_BEGIN_DECLS
 /* at the moment just use a GArray as it's quick */
 typedef GArray EggArrayFloat;
 
+/* a lazily built prefix-sum index over an EggArrayFloat */
+typedef struct EggArrayFloatIndex EggArrayFloatIndex;
+
 EggArrayFloat *egg_array_float_new(guint length);
 void egg_array_float_free(EggArrayFloat *array);
 gfloat egg_array_float_sum(EggArrayFloat *array);
@@ -44,6 +47,13 @@ gfloat egg_array_float_get(EggArrayFloat *array, guint i);
 void egg_array_float_set(EggArrayFloat *array, guint i, gfloat value);
 EggArrayFloat *egg_array_float_remove_outliers(EggArrayFloat *data,
                                                guint length, gfloat sigma);
+EggArrayFloatIndex *egg_array_float_index_new(EggArrayFloat *array);
+void egg_array_float_index_free(EggArrayFloatIndex *index);
+void egg_array_float_index_invalidate(EggArrayFloatIndex *index);
+gfloat egg_array_float_index_get_integral(EggArrayFloatIndex *index, guint x1,
+                                          guint x2);
+gfloat egg_array_float_index_get_average(EggArrayFloatIndex *index, guint x1,
+                                         guint x2);
 #ifdef EGG_TEST
 void egg_array_float_test(gpointer data);
 #endif
@@ -45,11 +45,11 @@
 #include "gpm-brightness.h"
 #include "gpm-button.h"
 #include "gpm-common.h"
-#include "gpm-control.h"
 #include "gpm-dpms.h"
 #include "gpm-icon-names.h"
 #include "gpm-idle.h"
 #include "gpm-marshal.h"
+#include "gpm-trace.h"
 #include "gsd-media-keys-window.h"
 
 struct GpmBacklightPrivate {
@@ -58,7 +58,6 @@ struct GpmBacklightPrivate {
   GpmButton *button;
   GSettings *settings;
   GtkWidget *popup;
-  GpmControl *control;
   GpmDpms *dpms;
   GpmIdle *idle;
   gboolean can_dim;
@@ -66,6 +65,10 @@ struct GpmBacklightPrivate {
   GTimer *idle_timer;
   guint idle_dim_timeout;
   guint master_percentage;
+  gboolean have_snapshot;
+  guint snapshot_percentage;
+  guint evaluate_id;
+  GpmTrace *trace;
 };
 
 enum { BRIGHTNESS_CHANGED, LAST_SIGNAL };
@@ -137,9 +140,10 @@ gboolean gpm_backlight_set_brightness(GpmBacklight *backlight, guint percentage,
   /* just set the master percentage for now, don't try to be clever */
   backlight->priv->master_percentage = percentage;
 
-  /* sets the current policy brightness */
-  ret =
-      gpm_brightness_set(backlight->priv->brightness, percentage, &hw_changed);
+  /* sets the current policy brightness; callers such as a dragged slider
+   * want it shown now rather than faded to */
+  ret = gpm_brightness_set_immediate(backlight->priv->brightness, percentage,
+                                     &hw_changed);
   if (!ret) {
     g_set_error_literal(error, gpm_backlight_error_quark(),
                         GPM_BACKLIGHT_ERROR_GENERAL,
@@ -198,6 +202,9 @@ static void gpm_backlight_dialog_show(GpmBacklight *backlight) {
   GdkSeat *seat;
   GdkDevice *device;
 
+  /* the popup would be shown over the real session */
+  if (gpm_trace_is_replaying(backlight->priv->trace)) return;
+
   /*
    * get the window size
    * if the window hasn't been mapped, it doesn't necessarily
@@ -342,6 +349,29 @@ static gboolean gpm_backlight_brightness_evaluate_and_set(
   return TRUE;
 }
 
+/**
+ * gpm_backlight_evaluate_idle_cb:
+ *
+ * Runs the normal policy once more urgent work is done.
+ **/
+static gboolean gpm_backlight_evaluate_idle_cb(GpmBacklight *backlight) {
+  backlight->priv->evaluate_id = 0;
+  gpm_backlight_brightness_evaluate_and_set(backlight, FALSE, TRUE);
+  return FALSE;
+}
+
+/**
+ * gpm_backlight_evaluate_later:
+ *
+ * Several requests made before the main loop is idle become one fade.
+ **/
+static void gpm_backlight_evaluate_later(GpmBacklight *backlight) {
+  if (backlight->priv->evaluate_id != 0) return;
+  backlight->priv->evaluate_id = g_idle_add_full(
+      G_PRIORITY_LOW, (GSourceFunc)gpm_backlight_evaluate_idle_cb, backlight,
+      NULL);
+}
+
 /**
  * gpm_settings_key_changed_cb:
  *
@@ -356,7 +386,7 @@ static void gpm_settings_key_changed_cb(GSettings *settings, const gchar *key,
 
   if (g_strcmp0(key, GPM_SETTINGS_BRIGHTNESS_AC) == 0) {
     backlight->priv->master_percentage = g_settings_get_double(settings, key);
-    gpm_backlight_brightness_evaluate_and_set(backlight, FALSE, TRUE);
+    gpm_backlight_evaluate_later(backlight);
 
   } else if (on_battery &&
              g_strcmp0(key, GPM_SETTINGS_BRIGHTNESS_DIM_BATT) == 0) {
@@ -422,7 +452,7 @@ static void gpm_backlight_button_pressed_cb(GpmButton *button,
       backlight->priv->master_percentage = percentage;
       /* if using AC power supply, save the new brightness settings */
       g_object_get(backlight->priv->client, "on-battery", &on_battery, NULL);
-      if (!on_battery) {
+      if (!on_battery && !gpm_trace_is_replaying(backlight->priv->trace)) {
         g_debug("saving brightness for ac supply: %i", percentage);
         g_settings_set_double(backlight->priv->settings,
                               GPM_SETTINGS_BRIGHTNESS_AC, percentage * 1.0);
@@ -448,7 +478,7 @@ static void gpm_backlight_button_pressed_cb(GpmButton *button,
       backlight->priv->master_percentage = percentage;
       /* if using AC power supply, save the new brightness settings */
       g_object_get(backlight->priv->client, "on-battery", &on_battery, NULL);
-      if (!on_battery) {
+      if (!on_battery && !gpm_trace_is_replaying(backlight->priv->trace)) {
         g_debug("saving brightness for ac supply: %i", percentage);
         g_settings_set_double(backlight->priv->settings,
                               GPM_SETTINGS_BRIGHTNESS_AC, percentage * 1.0);
@@ -622,23 +652,49 @@ static void brightness_changed_cb(GpmBrightness *brightness, guint percentage,
 }
 
 /**
- * control_resume_cb:
- * @control: The control class instance
- * @power: This power class instance
+ * gpm_backlight_sleep:
+ * @backlight: This class instance
  *
- * We have to update the caches on resume
+ * Remembers the panel state so that gpm_backlight_resume() can put it back
+ * without going through the policy first.
  **/
-static void control_resume_cb(GpmControl *control, GpmControlAction action,
-                              GpmBacklight *backlight) {
+void gpm_backlight_sleep(GpmBacklight *backlight) {
+  g_return_if_fail(GPM_IS_BACKLIGHT(backlight));
+
+  backlight->priv->have_snapshot = gpm_brightness_get(
+      backlight->priv->brightness, &backlight->priv->snapshot_percentage);
+  g_debug("saved brightness %u%% before sleep",
+          backlight->priv->snapshot_percentage);
+}
+
+/**
+ * gpm_backlight_resume:
+ * @backlight: This class instance
+ *
+ * Turns the panel back on and writes the level saved by gpm_backlight_sleep()
+ * without fading, as the firmware may have put the panel back to its own
+ * level. Re-evaluating the policy is left for when the main loop is idle.
+ **/
+void gpm_backlight_resume(GpmBacklight *backlight) {
   gboolean ret;
   GError *error = NULL;
 
+  g_return_if_fail(GPM_IS_BACKLIGHT(backlight));
+
   /* ensure backlight is on */
   ret = gpm_dpms_set_mode(backlight->priv->dpms, GPM_DPMS_MODE_ON, &error);
   if (!ret) {
     g_warning("failed to turn on DPMS: %s", error->message);
     g_error_free(error);
   }
+
+  gpm_brightness_invalidate(backlight->priv->brightness);
+  if (backlight->priv->have_snapshot)
+    gpm_brightness_set_immediate(backlight->priv->brightness,
+                                 backlight->priv->snapshot_percentage, NULL);
+  backlight->priv->have_snapshot = FALSE;
+
+  gpm_backlight_evaluate_later(backlight);
 }
 
 /**
@@ -651,15 +707,19 @@ static void gpm_backlight_finalize(GObject *object) {
   backlight = GPM_BACKLIGHT(object);
 
   g_timer_destroy(backlight->priv->idle_timer);
-  gtk_widget_destroy(backlight->priv->popup);
+  if (backlight->priv->popup != NULL)
+    gtk_widget_destroy(backlight->priv->popup);
+
+  if (backlight->priv->evaluate_id != 0)
+    g_source_remove(backlight->priv->evaluate_id);
 
   g_object_unref(backlight->priv->dpms);
-  g_object_unref(backlight->priv->control);
   g_object_unref(backlight->priv->settings);
   g_object_unref(backlight->priv->client);
   g_object_unref(backlight->priv->button);
   g_object_unref(backlight->priv->idle);
   g_object_unref(backlight->priv->brightness);
+  g_object_unref(backlight->priv->trace);
 
   g_return_if_fail(backlight->priv != NULL);
   G_OBJECT_CLASS(gpm_backlight_parent_class)->finalize(object);
@@ -691,6 +751,7 @@ static void gpm_backlight_init(GpmBacklight *backlight) {
 
   /* record our idle time */
   backlight->priv->idle_timer = g_timer_new();
+  backlight->priv->trace = gpm_trace_new();
 
   /* watch for manual brightness changes (for the popup widget) */
   backlight->priv->brightness = gpm_brightness_new();
@@ -732,23 +793,11 @@ static void gpm_backlight_init(GpmBacklight *backlight) {
   gpm_idle_set_timeout_dim(backlight->priv->idle,
                            backlight->priv->idle_dim_timeout);
 
-  /* use a visual widget */
-  backlight->priv->popup = msd_media_keys_window_new();
-  msd_media_keys_window_set_action_custom(
-      MSD_MEDIA_KEYS_WINDOW(backlight->priv->popup), "gpm-brightness-lcd",
-      TRUE);
-  gtk_window_set_position(GTK_WINDOW(backlight->priv->popup), GTK_WIN_POS_NONE);
-
   /* DPMS mode poll class */
   backlight->priv->dpms = gpm_dpms_new();
 
-  /* we refresh DPMS on resume */
-  backlight->priv->control = gpm_control_new();
-  g_signal_connect(backlight->priv->control, "resume",
-                   G_CALLBACK(control_resume_cb), backlight);
-
-  /* sync at startup */
-  gpm_backlight_brightness_evaluate_and_set(backlight, FALSE, TRUE);
+  /* sync at startup, which may need the helper, once we are up */
+  gpm_backlight_evaluate_later(backlight);
 }
 
 /**
@@ -66,6 +66,8 @@ gboolean gpm_backlight_get_brightness(GpmBacklight *backlight,
                                       guint *brightness, GError **error);
 gboolean gpm_backlight_set_brightness(GpmBacklight *backlight, guint brightness,
                                       GError **error);
+void gpm_backlight_sleep(GpmBacklight *backlight);
+void gpm_backlight_resume(GpmBacklight *backlight);
 
 G_END_DECLS
 
@@ -0,0 +1,686 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <cairo.h>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <libupower-glib/upower.h>
+#include <locale.h>
+#include <math.h>
+#include <string.h>
+
+#include "egg-array-float.h"
+#include "gpm-button.h"
+#include "gpm-common.h"
+#include "gpm-engine.h"
+#include "gpm-graph-widget.h"
+#include "gpm-load.h"
+#include "gpm-point-obj.h"
+#include "gpm-state-page.h"
+
+/* each sample runs the operation enough times to take at least this long,
+ * so that the clock resolution does not matter for fast operations */
+#define GPM_BENCH_SAMPLE_MIN_US 1000
+#define GPM_BENCH_ITERATIONS_MAX (1 << 20)
+#define GPM_BENCH_GRAPH_WIDTH 600
+#define GPM_BENCH_GRAPH_HEIGHT 300
+#define GPM_BENCH_SMOOTH_SIGMA 2.0f
+
+typedef void (*GpmBenchFunc)(gpointer data);
+
+typedef struct {
+  gint repetitions;
+  gint warmup;
+  const gchar *filter;
+  GString *json;
+  guint count;
+} GpmBench;
+
+typedef struct {
+  guint length;
+  EggArrayFloat *array;
+  EggArrayFloat *kernel;
+  EggArrayFloatIndex *index;
+  GPtrArray *points;
+  GtkWidget *graph;
+  cairo_t *cr;
+  GpmEngine *engine;
+  GpmButton *button;
+  guint keycode;
+  GpmLoad *load;
+  GpmStatePage *state_page;
+  const GpmStatePage *state_reader;
+  GDBusConnection *connection;
+} GpmBenchData;
+
+/**
+ * gpm_bench_json_append_string:
+ **/
+static void gpm_bench_json_append_string(GString *json, const gchar *text) {
+  const gchar *p;
+
+  g_string_append_c(json, '"');
+  for (p = text; *p != '\0'; p++) {
+    if (*p == '"' || *p == '\\')
+      g_string_append_printf(json, "\\%c", *p);
+    else if ((guchar)*p < 0x20)
+      g_string_append_printf(json, "\\u%04x", (guchar)*p);
+    else
+      g_string_append_c(json, *p);
+  }
+  g_string_append_c(json, '"');
+}
+
+/**
+ * gpm_bench_json_begin:
+ **/
+static void gpm_bench_json_begin(GpmBench *bench, const gchar *name,
+                                 guint size) {
+  if (bench->count++ > 0) g_string_append(bench->json, ",\n");
+  g_string_append(bench->json, "    {\"name\": ");
+  gpm_bench_json_append_string(bench->json, name);
+  g_string_append_printf(bench->json, ", \"size\": %u", size);
+}
+
+/**
+ * gpm_bench_is_filtered:
+ **/
+static gboolean gpm_bench_is_filtered(GpmBench *bench, const gchar *name) {
+  if (bench->filter == NULL) return FALSE;
+  return !g_pattern_match_simple(bench->filter, name);
+}
+
+/**
+ * gpm_bench_sample:
+ *
+ * Return value: the time taken for @iterations calls, in microseconds
+ **/
+static gint64 gpm_bench_sample(GpmBenchFunc func, gpointer data,
+                               guint iterations) {
+  gint64 start;
+  guint i;
+
+  start = g_get_monotonic_time();
+  for (i = 0; i < iterations; i++) func(data);
+  return g_get_monotonic_time() - start;
+}
+
+/**
+ * gpm_bench_percentile:
+ * @samples: The sorted samples
+ * @percentile: The percentile, from 0 to 100
+ *
+ * Return value: the nearest-rank percentile of the samples
+ **/
+static gdouble gpm_bench_percentile(GArray *samples, gdouble percentile) {
+  gint rank;
+
+  rank = (gint)ceil(percentile / 100.0 * samples->len) - 1;
+  rank = CLAMP(rank, 0, (gint)samples->len - 1);
+  return g_array_index(samples, gdouble, rank);
+}
+
+/**
+ * gpm_bench_compare_double:
+ **/
+static gint gpm_bench_compare_double(gconstpointer a, gconstpointer b) {
+  gdouble da = *(const gdouble *)a;
+  gdouble db = *(const gdouble *)b;
+  return (da > db) - (da < db);
+}
+
+/**
+ * gpm_bench_run:
+ * @bench: The benchmark run
+ * @name: The name of the benchmark, e.g. "egg-array-float/convolve"
+ * @size: The number of items the operation works on
+ * @func: The operation to time
+ * @data: The data passed to @func
+ *
+ * Times @func after calibrating how many calls make up one sample, and
+ * appends the distribution of the time taken for each call.
+ **/
+static void gpm_bench_run(GpmBench *bench, const gchar *name, guint size,
+                          GpmBenchFunc func, gpointer data) {
+  GArray *samples;
+  guint iterations = 1;
+  gdouble sample;
+  gdouble sum = 0.0;
+  gdouble sum_sq = 0.0;
+  gdouble mean;
+  gint i;
+
+  if (gpm_bench_is_filtered(bench, name)) return;
+
+  /* find how many calls make one sample */
+  while (iterations < GPM_BENCH_ITERATIONS_MAX &&
+         gpm_bench_sample(func, data, iterations) < GPM_BENCH_SAMPLE_MIN_US)
+    iterations *= 2;
+
+  /* let caches and lazily allocated state settle */
+  for (i = 0; i < bench->warmup; i++) gpm_bench_sample(func, data, iterations);
+
+  samples = g_array_sized_new(FALSE, FALSE, sizeof(gdouble),
+                              bench->repetitions);
+  for (i = 0; i < bench->repetitions; i++) {
+    sample = gpm_bench_sample(func, data, iterations) * 1000.0 / iterations;
+    g_array_append_val(samples, sample);
+    sum += sample;
+    sum_sq += sample * sample;
+  }
+  g_array_sort(samples, gpm_bench_compare_double);
+  mean = sum / samples->len;
+
+  g_debug("%s/%u: %.0fns over %u iterations", name, size, mean, iterations);
+  gpm_bench_json_begin(bench, name, size);
+  g_string_append_printf(
+      bench->json,
+      ", \"iterations\": %u, \"unit\": \"ns\", \"min\": %.1f, "
+      "\"mean\": %.1f, \"stddev\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+      "\"p99\": %.1f, \"max\": %.1f}",
+      iterations, g_array_index(samples, gdouble, 0), mean,
+      sqrt(MAX(sum_sq / samples->len - mean * mean, 0.0)),
+      gpm_bench_percentile(samples, 50), gpm_bench_percentile(samples, 90),
+      gpm_bench_percentile(samples, 99),
+      g_array_index(samples, gdouble, samples->len - 1));
+  g_array_unref(samples);
+}
+
+/**
+ * gpm_bench_skip:
+ *
+ * Records that a benchmark could not run here, so that a missing result is
+ * not mistaken for a regression.
+ **/
+static void gpm_bench_skip(GpmBench *bench, const gchar *name, guint size,
+                           const gchar *reason) {
+  if (gpm_bench_is_filtered(bench, name)) return;
+  g_debug("%s/%u: skipped: %s", name, size, reason);
+  gpm_bench_json_begin(bench, name, size);
+  g_string_append(bench->json, ", \"skipped\": ");
+  gpm_bench_json_append_string(bench->json, reason);
+  g_string_append_c(bench->json, '}');
+}
+
+/**
+ * gpm_bench_array_new:
+ *
+ * Makes a discharge curve with some noise and the odd outlier in it, which
+ * is what the statistics viewer normally has to smooth.
+ **/
+static EggArrayFloat *gpm_bench_array_new(GRand *rand, guint length) {
+  EggArrayFloat *array;
+  gfloat value;
+  guint i;
+
+  array = egg_array_float_new(length);
+  for (i = 0; i < length; i++) {
+    value = 100.0f - (100.0f * i / length);
+    value += g_rand_double_range(rand, -2.0, 2.0);
+    if (g_rand_int_range(rand, 0, 50) == 0) value += 40.0f;
+    egg_array_float_set(array, i, value);
+  }
+  return array;
+}
+
+/**
+ * gpm_bench_points_new:
+ **/
+static GPtrArray *gpm_bench_points_new(EggArrayFloat *array) {
+  GpmPointObj *point;
+  GPtrArray *points;
+  guint i;
+
+  points = g_ptr_array_new_with_free_func((GDestroyNotify)gpm_point_obj_free);
+  for (i = 0; i < array->len; i++) {
+    point = gpm_point_obj_new();
+    point->x = i * 30;
+    point->y = egg_array_float_get(array, i);
+    point->color = 0x0000ff;
+    g_ptr_array_add(points, point);
+  }
+  return points;
+}
+
+static void gpm_bench_remove_outliers(gpointer data) {
+  GpmBenchData *d = data;
+  egg_array_float_free(egg_array_float_remove_outliers(d->array, 3, 0.1));
+}
+
+static void gpm_bench_gaussian(gpointer data) {
+  GpmBenchData *d = data;
+  egg_array_float_free(
+      egg_array_float_compute_gaussian(d->length, GPM_BENCH_SMOOTH_SIGMA));
+}
+
+static void gpm_bench_convolve(gpointer data) {
+  GpmBenchData *d = data;
+  egg_array_float_free(egg_array_float_convolve(d->array, d->kernel));
+}
+
+static void gpm_bench_integral(gpointer data) {
+  GpmBenchData *d = data;
+  egg_array_float_compute_integral(d->array, 0, d->array->len - 1);
+}
+
+static void gpm_bench_index_integral(gpointer data) {
+  GpmBenchData *d = data;
+  egg_array_float_index_get_integral(d->index, 0, d->array->len - 1);
+}
+
+static void gpm_bench_smooth(gpointer data) {
+  GpmBenchData *d = data;
+  g_ptr_array_unref(
+      gpm_point_obj_array_smooth(d->points, GPM_BENCH_SMOOTH_SIGMA));
+}
+
+static void gpm_bench_graph_render(gpointer data) {
+  GpmBenchData *d = data;
+  gpm_graph_widget_data_clear(GPM_GRAPH_WIDGET(d->graph));
+  gpm_graph_widget_data_assign(GPM_GRAPH_WIDGET(d->graph),
+                               GPM_GRAPH_WIDGET_PLOT_LINE, d->points);
+  gtk_widget_draw(d->graph, d->cr);
+}
+
+static void gpm_bench_engine_recalculate(gpointer data) {
+  GpmBenchData *d = data;
+  g_free(gpm_engine_get_icon(d->engine));
+  g_free(gpm_engine_get_summary(d->engine));
+}
+
+static void gpm_bench_button_filter(gpointer data) {
+  GpmBenchData *d = data;
+  gpm_button_filter_keycode(d->button, d->keycode);
+  /* cycle through every keycode X can send, most of which are not ours */
+  d->keycode = d->keycode < 255 ? d->keycode + 1 : 8;
+}
+
+static void gpm_bench_load_sample(gpointer data) {
+  GpmBenchData *d = data;
+  gpm_load_get_current(d->load);
+}
+
+static void gpm_bench_state_page_set(gpointer data) {
+  GpmBenchData *d = data;
+  gpm_state_page_set(d->state_page, GPM_STATE_FIELD_BRIGHTNESS,
+                     d->state_page->fields[GPM_STATE_FIELD_BRIGHTNESS] ^ 1);
+}
+
+static void gpm_bench_state_page_read(gpointer data) {
+  GpmBenchData *d = data;
+  GpmStatePage snapshot;
+  gpm_state_page_read(d->state_reader, &snapshot);
+}
+
+static void gpm_bench_dbus_get_brightness(gpointer data) {
+  GpmBenchData *d = data;
+  GVariant *ret;
+  ret = g_dbus_connection_call_sync(
+      d->connection, GPM_DBUS_SERVICE, GPM_DBUS_PATH_BACKLIGHT,
+      GPM_DBUS_INTERFACE_BACKLIGHT, "GetBrightness", NULL, NULL,
+      G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL, NULL);
+  if (ret != NULL) g_variant_unref(ret);
+}
+
+/**
+ * gpm_bench_egg_array_float:
+ **/
+static void gpm_bench_egg_array_float(GpmBench *bench, GRand *rand) {
+  static const guint kernels[] = {15, 101};
+  static const guint sizes[] = {100, 1000, 10000};
+  GpmBenchData d = {0};
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(kernels); i++) {
+    d.length = kernels[i];
+    gpm_bench_run(bench, "egg-array-float/gaussian", d.length,
+                  gpm_bench_gaussian, &d);
+  }
+
+  d.kernel = egg_array_float_compute_gaussian(15, GPM_BENCH_SMOOTH_SIGMA);
+  for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+    d.array = gpm_bench_array_new(rand, sizes[i]);
+    d.index = egg_array_float_index_new(d.array);
+    d.points = gpm_bench_points_new(d.array);
+    gpm_bench_run(bench, "egg-array-float/remove-outliers", sizes[i],
+                  gpm_bench_remove_outliers, &d);
+    gpm_bench_run(bench, "egg-array-float/convolve", sizes[i],
+                  gpm_bench_convolve, &d);
+    gpm_bench_run(bench, "egg-array-float/integral", sizes[i],
+                  gpm_bench_integral, &d);
+    gpm_bench_run(bench, "egg-array-float/index-integral", sizes[i],
+                  gpm_bench_index_integral, &d);
+    gpm_bench_run(bench, "gpm-statistics/smooth-data", sizes[i],
+                  gpm_bench_smooth, &d);
+    g_ptr_array_unref(d.points);
+    egg_array_float_index_free(d.index);
+    egg_array_float_free(d.array);
+  }
+  egg_array_float_free(d.kernel);
+}
+
+/**
+ * gpm_bench_graph_widget:
+ *
+ * Draws the whole graph each time, as happens when new data is assigned.
+ **/
+static void gpm_bench_graph_widget(GpmBench *bench, GRand *rand,
+                                   gboolean has_display) {
+  static const guint sizes[] = {100, 1000, 10000};
+  GpmBenchData d = {0};
+  GtkWidget *window;
+  cairo_surface_t *surface;
+  guint i;
+
+  if (gpm_bench_is_filtered(bench, "gpm-graph-widget/render")) return;
+  if (!has_display) {
+    for (i = 0; i < G_N_ELEMENTS(sizes); i++)
+      gpm_bench_skip(bench, "gpm-graph-widget/render", sizes[i],
+                     "no display");
+    return;
+  }
+
+  window = gtk_offscreen_window_new();
+  d.graph = gpm_graph_widget_new();
+  g_object_set(d.graph, "type-x", GPM_GRAPH_WIDGET_TYPE_TIME, "type-y",
+               GPM_GRAPH_WIDGET_TYPE_PERCENTAGE, NULL);
+  gtk_widget_set_size_request(d.graph, GPM_BENCH_GRAPH_WIDTH,
+                              GPM_BENCH_GRAPH_HEIGHT);
+  gtk_container_add(GTK_CONTAINER(window), d.graph);
+  gtk_widget_show_all(window);
+  while (gtk_events_pending()) gtk_main_iteration();
+
+  surface = cairo_image_surface_create(
+      CAIRO_FORMAT_ARGB32, GPM_BENCH_GRAPH_WIDTH, GPM_BENCH_GRAPH_HEIGHT);
+  d.cr = cairo_create(surface);
+  for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+    d.array = gpm_bench_array_new(rand, sizes[i]);
+    d.points = gpm_bench_points_new(d.array);
+    gpm_bench_run(bench, "gpm-graph-widget/render", sizes[i],
+                  gpm_bench_graph_render, &d);
+    g_ptr_array_unref(d.points);
+    egg_array_float_free(d.array);
+  }
+  cairo_destroy(d.cr);
+  cairo_surface_destroy(surface);
+  gtk_widget_destroy(window);
+}
+
+/**
+ * gpm_bench_device_new:
+ **/
+static UpDevice *gpm_bench_device_new(GRand *rand, guint i) {
+  static const UpDeviceKind kinds[] = {
+      UP_DEVICE_KIND_BATTERY, UP_DEVICE_KIND_MOUSE, UP_DEVICE_KIND_KEYBOARD,
+      UP_DEVICE_KIND_UPS, UP_DEVICE_KIND_PHONE};
+  UpDevice *device;
+
+  device = up_device_new();
+  g_object_set(device, "kind", kinds[i % G_N_ELEMENTS(kinds)], "is-present",
+               TRUE, "state",
+               i % 2 == 0 ? UP_DEVICE_STATE_DISCHARGING
+                          : UP_DEVICE_STATE_CHARGING,
+               "percentage", g_rand_double_range(rand, 1.0, 100.0),
+               "time-to-empty", (gint64)g_rand_int_range(rand, 60, 36000),
+               "time-to-full", (gint64)g_rand_int_range(rand, 60, 36000),
+               "model", "Bench", "vendor", "MATE", NULL);
+  return device;
+}
+
+/**
+ * gpm_bench_engine:
+ *
+ * Works out the icon and summary the engine would show for N devices,
+ * which is what it does each time any of them changes.
+ **/
+static void gpm_bench_engine(GpmBench *bench, GRand *rand) {
+  static const guint sizes[] = {1, 4, 16, 64};
+  GpmBenchData d = {0};
+  GSettingsSchema *schema;
+  GPtrArray *devices;
+  UpClient *client;
+  GError *error = NULL;
+  const gchar *reason = NULL;
+  guint base;
+  guint i;
+
+  if (gpm_bench_is_filtered(bench, "gpm-engine/recalculate")) return;
+
+  /* the engine needs both its settings and a running UPower */
+  schema = g_settings_schema_source_lookup(
+      g_settings_schema_source_get_default(), GPM_SETTINGS_SCHEMA, TRUE);
+  if (schema == NULL) reason = "settings schema not installed";
+  g_clear_pointer(&schema, g_settings_schema_unref);
+  client = up_client_new_full(NULL, &error);
+  if (client == NULL && reason == NULL) reason = error->message;
+  if (reason != NULL) {
+    for (i = 0; i < G_N_ELEMENTS(sizes); i++)
+      gpm_bench_skip(bench, "gpm-engine/recalculate", sizes[i], reason);
+    goto out;
+  }
+
+  d.engine = gpm_engine_new();
+  devices = gpm_engine_get_devices(d.engine);
+  base = devices->len;
+  for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+    while (devices->len < base + sizes[i])
+      g_ptr_array_add(devices, gpm_bench_device_new(rand, devices->len));
+    gpm_bench_run(bench, "gpm-engine/recalculate", sizes[i],
+                  gpm_bench_engine_recalculate, &d);
+  }
+  g_ptr_array_set_size(devices, base);
+  g_ptr_array_unref(devices);
+  g_object_unref(d.engine);
+out:
+  g_clear_object(&client);
+  g_clear_error(&error);
+}
+
+/**
+ * gpm_bench_button:
+ **/
+static void gpm_bench_button(GpmBench *bench, gboolean has_display) {
+  GpmBenchData d = {0};
+  UpClient *client;
+  GError *error = NULL;
+
+  if (gpm_bench_is_filtered(bench, "gpm-button/filter-keycode")) return;
+  if (!has_display) {
+    gpm_bench_skip(bench, "gpm-button/filter-keycode", 1, "no display");
+    return;
+  }
+  client = up_client_new_full(NULL, &error);
+  if (client == NULL) {
+    gpm_bench_skip(bench, "gpm-button/filter-keycode", 1, error->message);
+    g_error_free(error);
+    return;
+  }
+
+  d.button = gpm_button_new();
+  d.keycode = 8;
+  gpm_bench_run(bench, "gpm-button/filter-keycode", 1,
+                gpm_bench_button_filter, &d);
+  g_object_unref(d.button);
+  g_object_unref(client);
+}
+
+/**
+ * gpm_bench_load:
+ **/
+static void gpm_bench_load(GpmBench *bench) {
+  GpmBenchData d = {0};
+
+  d.load = gpm_load_new();
+  gpm_bench_run(bench, "gpm-load/sample", 1, gpm_bench_load_sample, &d);
+  g_object_unref(d.load);
+}
+
+/**
+ * gpm_bench_state_page:
+ *
+ * Reads the brightness the way a client of the state page does, and the
+ * way every client had to before, from the daemon in this session.
+ **/
+static void gpm_bench_state_page(GpmBench *bench) {
+  GpmBenchData d = {0};
+  GError *error = NULL;
+  GVariant *ret;
+  gchar *dirname;
+  gchar *filename;
+
+  dirname = g_dir_make_tmp("gpm-bench-XXXXXX", NULL);
+  filename = g_build_filename(dirname, GPM_STATE_PAGE_NAME, NULL);
+  d.state_page = gpm_state_page_create(filename, &error);
+  if (d.state_page == NULL) {
+    gpm_bench_skip(bench, "gpm-state-page/set", 1, error->message);
+    gpm_bench_skip(bench, "gpm-state-page/read", 1, error->message);
+    g_clear_error(&error);
+  } else {
+    d.state_reader = gpm_state_page_open(filename, NULL);
+    gpm_bench_run(bench, "gpm-state-page/set", 1, gpm_bench_state_page_set,
+                  &d);
+    gpm_bench_run(bench, "gpm-state-page/read", 1, gpm_bench_state_page_read,
+                  &d);
+    gpm_state_page_close(d.state_reader);
+    gpm_state_page_close(d.state_page);
+    g_unlink(filename);
+  }
+  g_rmdir(dirname);
+  g_free(filename);
+  g_free(dirname);
+
+  if (gpm_bench_is_filtered(bench, "gpm-state-page/dbus-get-brightness"))
+    return;
+  d.connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+  ret = d.connection == NULL
+            ? NULL
+            : g_dbus_connection_call_sync(
+                  d.connection, GPM_DBUS_SERVICE, GPM_DBUS_PATH_BACKLIGHT,
+                  GPM_DBUS_INTERFACE_BACKLIGHT, "GetBrightness", NULL, NULL,
+                  G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL, &error);
+  if (ret == NULL) {
+    gpm_bench_skip(bench, "gpm-state-page/dbus-get-brightness", 1,
+                   error->message);
+    g_error_free(error);
+  } else {
+    g_variant_unref(ret);
+    gpm_bench_run(bench, "gpm-state-page/dbus-get-brightness", 1,
+                  gpm_bench_dbus_get_brightness, &d);
+  }
+  g_clear_object(&d.connection);
+}
+
+/**
+ * main:
+ **/
+int main(int argc, char **argv) {
+  GOptionContext *context;
+  GpmBench bench = {0};
+  GRand *rand;
+  GDateTime *now;
+  GError *error = NULL;
+  gchar *output = NULL;
+  gchar *filter = NULL;
+  gchar *timestamp;
+  gboolean has_display;
+  gint repetitions = 30;
+  gint warmup = 3;
+  gint retval = EXIT_SUCCESS;
+
+  const GOptionEntry options[] = {
+      {"repetitions", 'r', 0, G_OPTION_ARG_INT, &repetitions,
+       "Number of timed samples for each benchmark", "COUNT"},
+      {"warmup", 'w', 0, G_OPTION_ARG_INT, &warmup,
+       "Number of untimed samples before timing", "COUNT"},
+      {"filter", 'f', 0, G_OPTION_ARG_STRING, &filter,
+       "Only run the benchmarks matching a glob, e.g. \"egg-array-float/*\"",
+       "PATTERN"},
+      {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+       "Write the JSON results to a file rather than stdout", "FILE"},
+      {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
+
+  setlocale(LC_ALL, "");
+
+  context = g_option_context_new(NULL);
+  g_option_context_set_summary(context, "MATE Power Manager benchmarks");
+  g_option_context_add_main_entries(context, options, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    g_option_context_free(context);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  /* the numbers in the JSON must not use a locale decimal comma */
+  setlocale(LC_NUMERIC, "C");
+
+  /* the benchmarks that need X are skipped rather than failing */
+  has_display = gtk_init_check(&argc, &argv);
+
+  bench.repetitions = MAX(repetitions, 1);
+  bench.warmup = MAX(warmup, 0);
+  bench.filter = filter;
+  bench.json = g_string_new(NULL);
+
+  /* always make the same data so runs can be compared */
+  rand = g_rand_new_with_seed(0x6d617465);
+
+  now = g_date_time_new_now_utc();
+  timestamp = g_date_time_format(now, "%Y-%m-%dT%H:%M:%SZ");
+  g_date_time_unref(now);
+  g_string_append_printf(bench.json,
+                         "{\n  \"version\": \"%s\",\n  \"timestamp\": \"%s\",\n"
+                         "  \"repetitions\": %i,\n  \"warmup\": %i,\n"
+                         "  \"benchmarks\": [\n",
+                         VERSION, timestamp, bench.repetitions, bench.warmup);
+  g_free(timestamp);
+
+  gpm_bench_egg_array_float(&bench, rand);
+  gpm_bench_graph_widget(&bench, rand, has_display);
+  gpm_bench_engine(&bench, rand);
+  gpm_bench_button(&bench, has_display);
+  gpm_bench_load(&bench);
+  gpm_bench_state_page(&bench);
+
+  g_string_append(bench.json, "\n  ]\n}\n");
+
+  if (output == NULL) {
+    g_print("%s", bench.json->str);
+  } else if (!g_file_set_contents(output, bench.json->str, bench.json->len,
+                                  &error)) {
+    g_printerr("failed to write %s: %s\n", output, error->message);
+    g_error_free(error);
+    retval = EXIT_FAILURE;
+  }
+
+  g_string_free(bench.json, TRUE);
+  g_rand_free(rand);
+  g_free(output);
+  g_free(filter);
+  return retval;
+}
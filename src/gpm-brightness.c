@@ -44,8 +44,11 @@
 #include "gpm-brightness.h"
 #include "gpm-common.h"
 #include "gpm-marshal.h"
+#include "gpm-trace.h"
 
 #define GPM_SOLE_SETTER_USE_CACHE TRUE /* this may be insanity */
+/* the step up or down a replay pretends to take, as a percentage */
+#define GPM_BRIGHTNESS_REPLAY_STEP 5
 
 struct GpmBrightnessPrivate {
   gboolean has_changed_events;
@@ -58,11 +61,13 @@ struct GpmBrightnessPrivate {
   guint shared_value;
   gboolean has_extension;
   gboolean hw_changed;
+  gboolean immediate;
   /* A cache of XRRScreenResources is used as XRRGetScreenResources is expensive
    */
   GPtrArray *resources;
   gint extension_levels;
   gint extension_current;
+  GpmTrace *trace;
 };
 
 enum { BRIGHTNESS_CHANGED, LAST_SIGNAL };
@@ -104,6 +109,28 @@ static gboolean gpm_brightness_helper_strtoint(const gchar *text, gint *value) {
   return TRUE;
 }
 
+/**
+ * gpm_brightness_helper_get_program:
+ * @privileged: If the helper has to write to the hardware
+ *
+ * When built with --enable-test-hooks, the test harness can swap the helper
+ * for a stand-in with GPM_BACKLIGHT_HELPER, which is then run without
+ * pkexec.
+ *
+ * Return value: the command line of the helper, without arguments
+ **/
+static gchar *gpm_brightness_helper_get_program(gboolean privileged) {
+#ifdef GPM_TEST_HOOKS
+  const gchar *helper;
+
+  helper = g_getenv("GPM_BACKLIGHT_HELPER");
+  if (helper != NULL) return g_shell_quote(helper);
+#endif
+  if (privileged)
+    return g_strdup("pkexec " SBINDIR "/mate-power-backlight-helper");
+  return g_strdup(SBINDIR "/mate-power-backlight-helper");
+}
+
 /**
  * gpm_brightness_helper_get_value:
  **/
@@ -114,10 +141,12 @@ static gint gpm_brightness_helper_get_value(const gchar *argument) {
   gint exit_status = 0;
   gint value = -1;
   gchar *command = NULL;
+  gchar *helper;
 
   /* get the data */
-  command =
-      g_strdup_printf(SBINDIR "/mate-power-backlight-helper --%s", argument);
+  helper = gpm_brightness_helper_get_program(FALSE);
+  command = g_strdup_printf("%s --%s", helper, argument);
+  g_free(helper);
   ret = g_spawn_command_line_sync(command, &stdout_data, NULL, &exit_status,
                                   &error);
   if (!ret) {
@@ -145,11 +174,12 @@ static gboolean gpm_brightness_helper_set_value(const gchar *argument,
   GError *error = NULL;
   gint exit_status = 0;
   gchar *command = NULL;
+  gchar *helper;
 
   /* get the data */
-  command =
-      g_strdup_printf("pkexec " SBINDIR "/mate-power-backlight-helper --%s %i",
-                      argument, value);
+  helper = gpm_brightness_helper_get_program(TRUE);
+  command = g_strdup_printf("%s --%s %i", helper, argument, value);
+  g_free(helper);
   ret = g_spawn_command_line_sync(command, NULL, NULL, &exit_status, &error);
   if (!ret) {
     g_error("failed to get value: %s", error->message);
@@ -418,6 +448,11 @@ static gboolean gpm_brightness_output_set(GpmBrightness *brightness,
     return TRUE;
   }
 
+  /* no fade, e.g. when restoring the panel after a resume */
+  if (brightness->priv->immediate)
+    return gpm_brightness_output_set_internal(brightness, output,
+                                              shared_value_abs);
+
   /* step the correct way */
   if ((gint)cur < shared_value_abs) {
     /* some adaptors have a large number of steps */
@@ -560,6 +595,15 @@ gboolean gpm_brightness_set(GpmBrightness *brightness, guint percentage,
     return TRUE;
   }
 
+  /* a replay must not touch the real panel, so only remember the value */
+  if (gpm_trace_is_replaying(brightness->priv->trace)) {
+    gpm_trace_decision(brightness->priv->trace, "brightness %u", percentage);
+    brightness->priv->cache_percentage = percentage;
+    brightness->priv->cache_trusted = TRUE;
+    if (hw_changed != NULL) *hw_changed = TRUE;
+    return TRUE;
+  }
+
   /* set the value we want */
   brightness->priv->shared_value = percentage;
 
@@ -587,6 +631,28 @@ gboolean gpm_brightness_set(GpmBrightness *brightness, guint percentage,
   return ret;
 }
 
+/**
+ * gpm_brightness_set_immediate:
+ * @brightness: This brightness class instance
+ * @percentage: The percentage brightness
+ * @hw_changed: If the hardware was changed, i.e. the brightness changed
+ * Return value: %TRUE if success, %FALSE if there was an error
+ *
+ * Like gpm_brightness_set() but writes the final level in one go rather
+ * than fading towards it.
+ **/
+gboolean gpm_brightness_set_immediate(GpmBrightness *brightness,
+                                      guint percentage, gboolean *hw_changed) {
+  gboolean ret;
+
+  g_return_val_if_fail(GPM_IS_BRIGHTNESS(brightness), FALSE);
+
+  brightness->priv->immediate = TRUE;
+  ret = gpm_brightness_set(brightness, percentage, hw_changed);
+  brightness->priv->immediate = FALSE;
+  return ret;
+}
+
 /**
  * gpm_brightness_get:
  * @brightness: This brightness class instance
@@ -644,6 +710,21 @@ gboolean gpm_brightness_get(GpmBrightness *brightness, guint *percentage) {
   return ret;
 }
 
+/**
+ * gpm_brightness_replay_step:
+ *
+ * Moves the remembered value of a replay up or down, as there is no
+ * hardware to step.
+ **/
+static gboolean gpm_brightness_replay_step(GpmBrightness *brightness,
+                                           gint step, gboolean *hw_changed) {
+  guint percentage = 0;
+
+  gpm_brightness_get(brightness, &percentage);
+  return gpm_brightness_set(brightness, CLAMP((gint)percentage + step, 0, 100),
+                            hw_changed);
+}
+
 /**
  * gpm_brightness_up:
  * @brightness: This brightness class instance
@@ -658,6 +739,10 @@ gboolean gpm_brightness_up(GpmBrightness *brightness, gboolean *hw_changed) {
 
   g_return_val_if_fail(GPM_IS_BRIGHTNESS(brightness), FALSE);
 
+  if (gpm_trace_is_replaying(brightness->priv->trace))
+    return gpm_brightness_replay_step(brightness, GPM_BRIGHTNESS_REPLAY_STEP,
+                                      hw_changed);
+
   /* reset to not-changed */
   brightness->priv->hw_changed = FALSE;
   ret = gpm_brightness_foreach_screen(brightness, ACTION_BACKLIGHT_INC);
@@ -710,6 +795,10 @@ gboolean gpm_brightness_down(GpmBrightness *brightness, gboolean *hw_changed) {
 
   g_return_val_if_fail(GPM_IS_BRIGHTNESS(brightness), FALSE);
 
+  if (gpm_trace_is_replaying(brightness->priv->trace))
+    return gpm_brightness_replay_step(brightness, -GPM_BRIGHTNESS_REPLAY_STEP,
+                                      hw_changed);
+
   /* reset to not-changed */
   brightness->priv->hw_changed = FALSE;
   ret = gpm_brightness_foreach_screen(brightness, ACTION_BACKLIGHT_DEC);
@@ -745,6 +834,18 @@ out:
   return ret;
 }
 
+/**
+ * gpm_brightness_invalidate:
+ * @brightness: This brightness class instance
+ *
+ * Forgets the cached value, for when something other than us may have
+ * changed the hardware, e.g. the firmware across a suspend.
+ **/
+void gpm_brightness_invalidate(GpmBrightness *brightness) {
+  g_return_if_fail(GPM_IS_BRIGHTNESS(brightness));
+  brightness->priv->cache_trusted = FALSE;
+}
+
 /**
  * gpm_brightness_may_have_changed:
  **/
@@ -852,6 +953,7 @@ static void gpm_brightness_finalize(GObject *object) {
   g_return_if_fail(GPM_IS_BRIGHTNESS(object));
   brightness = GPM_BRIGHTNESS(object);
   g_ptr_array_unref(brightness->priv->resources);
+  g_object_unref(brightness->priv->trace);
   gdk_window_remove_filter(brightness->priv->root_window,
                            gpm_brightness_filter_xevents, brightness);
   G_OBJECT_CLASS(gpm_brightness_parent_class)->finalize(object);
@@ -887,6 +989,7 @@ static void gpm_brightness_init(GpmBrightness *brightness) {
   brightness->priv->cache_percentage = 0;
   brightness->priv->hw_changed = FALSE;
   brightness->priv->extension_levels = -1;
+  brightness->priv->trace = gpm_trace_new();
   brightness->priv->resources =
       g_ptr_array_new_with_free_func((GDestroyNotify)XRRFreeScreenResources);
 
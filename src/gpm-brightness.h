@@ -62,6 +62,9 @@ gboolean gpm_brightness_down(GpmBrightness *brightness, gboolean *hw_changed);
 gboolean gpm_brightness_get(GpmBrightness *brightness, guint *percentage);
 gboolean gpm_brightness_set(GpmBrightness *brightness, guint percentage,
                             gboolean *hw_changed);
+gboolean gpm_brightness_set_immediate(GpmBrightness *brightness,
+                                      guint percentage, gboolean *hw_changed);
+void gpm_brightness_invalidate(GpmBrightness *brightness);
 
 G_END_DECLS
 
@@ -0,0 +1,453 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <pwd.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gpm-broker-page.h"
+#include "gpm-seqlock-page.h"
+
+G_STATIC_ASSERT(G_STRUCT_OFFSET(GpmBrokerPage, sequence) ==
+                G_STRUCT_OFFSET(GpmSeqlockPage, sequence));
+
+/**
+ * gpm_broker_page_get_filename:
+ *
+ * Return value: where the broker publishes, free with g_free()
+ **/
+gchar *gpm_broker_page_get_filename(void) {
+#ifdef GPM_TEST_HOOKS
+  const gchar *path;
+
+  path = g_getenv("GPM_BROKER_PATH");
+  if (path != NULL) return g_strdup(path);
+#endif
+  return g_strdup(GPM_BROKER_PAGE_PATH);
+}
+
+/**
+ * gpm_broker_page_begin:
+ **/
+static void gpm_broker_page_begin(GpmBrokerPage *page) {
+  gpm_seqlock_page_begin(page);
+}
+
+/**
+ * gpm_broker_page_end:
+ **/
+static void gpm_broker_page_end(GpmBrokerPage *page) {
+  page->updated = g_get_monotonic_time();
+  gpm_seqlock_page_end(page);
+}
+
+/**
+ * gpm_broker_page_retire:
+ * @page: A page from gpm_broker_page_create()
+ *
+ * Tells the sessions still mapping @page that it will not change again, so
+ * that they open the file afresh.
+ **/
+void gpm_broker_page_retire(GpmBrokerPage *page) {
+  gpm_seqlock_page_retire(page);
+}
+
+/**
+ * gpm_broker_page_create:
+ * @filename: Where to publish the page
+ *
+ * Creates an empty page that every user can read, retiring any page that
+ * was there before.
+ *
+ * Return value: the writable page, or %NULL
+ **/
+GpmBrokerPage *gpm_broker_page_create(const gchar *filename, GError **error) {
+  GpmBrokerPage *header;
+  GpmBrokerPage *page;
+
+  /* only the fields before the devices are copied, which start out free */
+  header = g_new0(GpmBrokerPage, 1);
+  header->magic = GPM_BROKER_PAGE_MAGIC;
+  header->version = GPM_BROKER_PAGE_VERSION;
+  header->updated = g_get_monotonic_time();
+  page = gpm_seqlock_page_create(filename, sizeof(GpmBrokerPage), header,
+                                 G_STRUCT_OFFSET(GpmBrokerPage, devices),
+                                 error);
+  g_free(header);
+  return page;
+}
+
+/**
+ * gpm_broker_page_find:
+ *
+ * Return value: the slot holding @name, or -1
+ **/
+static gint gpm_broker_page_find(const GpmBrokerPage *page,
+                                 const gchar *name) {
+  guint i;
+
+  for (i = 0; i < page->n_devices; i++) {
+    if (page->devices[i].serial != 0 &&
+        g_strcmp0(page->devices[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+/**
+ * gpm_broker_page_set_device:
+ * @page: A page from gpm_broker_page_create()
+ * @name: The object path, or "" for the display device
+ * @data: The properties, which is sunk if floating
+ *
+ * Return value: %TRUE if the sessions have something new to read
+ **/
+gboolean gpm_broker_page_set_device(GpmBrokerPage *page, const gchar *name,
+                                    GVariant *data) {
+  GpmBrokerDevice *device;
+  gboolean ret = FALSE;
+  gsize size;
+  gint i;
+
+  g_return_val_if_fail(page != NULL, FALSE);
+  g_return_val_if_fail(name != NULL, FALSE);
+  g_return_val_if_fail(data != NULL, FALSE);
+
+  g_variant_ref_sink(data);
+  size = g_variant_get_size(data);
+  if (size > GPM_BROKER_DATA_MAX || strlen(name) >= GPM_BROKER_NAME_MAX) {
+    g_warning("%s does not fit in the page", name);
+    goto out;
+  }
+
+  i = gpm_broker_page_find(page, name);
+  if (i >= 0) {
+    device = &page->devices[i];
+    if (device->size == size &&
+        memcmp(device->data, g_variant_get_data(data), size) == 0)
+      goto out;
+  } else {
+    /* reuse a free slot, so the page does not fill up with churn */
+    for (i = 0; i < (gint)page->n_devices; i++) {
+      if (page->devices[i].serial == 0) break;
+    }
+    if (i == GPM_BROKER_DEVICES_MAX) {
+      g_warning("no room for %s in the page", name);
+      goto out;
+    }
+    device = &page->devices[i];
+  }
+
+  gpm_broker_page_begin(page);
+  g_strlcpy(device->name, name, GPM_BROKER_NAME_MAX);
+  memcpy(device->data, g_variant_get_data(data), size);
+  device->size = size;
+  device->serial = ++page->serial;
+  if (page->serial == 0) device->serial = ++page->serial;
+  page->n_devices = MAX(page->n_devices, (guint32)i + 1);
+  gpm_broker_page_end(page);
+  ret = TRUE;
+out:
+  g_variant_unref(data);
+  return ret;
+}
+
+/**
+ * gpm_broker_page_remove_device:
+ *
+ * Return value: %TRUE if the device was in the page
+ **/
+gboolean gpm_broker_page_remove_device(GpmBrokerPage *page,
+                                       const gchar *name) {
+  gint i;
+
+  g_return_val_if_fail(page != NULL, FALSE);
+
+  i = gpm_broker_page_find(page, name);
+  if (i < 0) return FALSE;
+  gpm_broker_page_begin(page);
+  page->devices[i].serial = 0;
+  page->devices[i].size = 0;
+  gpm_broker_page_end(page);
+  return TRUE;
+}
+
+/**
+ * gpm_broker_page_is_trusted:
+ *
+ * Only root or the broker user may have written what the sessions read,
+ * and nobody else may be able to swap it.
+ **/
+static gboolean gpm_broker_page_is_trusted(gint fd, const gchar *filename,
+                                           GError **error) {
+  struct passwd *pw;
+  struct stat buf;
+
+  if (fstat(fd, &buf) < 0) {
+    gint saved_errno = errno;
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                "failed to stat %s: %s", filename, g_strerror(saved_errno));
+    return FALSE;
+  }
+  if ((buf.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_PERM,
+                "%s can be written by others", filename);
+    return FALSE;
+  }
+  if (buf.st_uid == 0) return TRUE;
+#if defined(EGG_TEST) || defined(GPM_TEST_HOOKS)
+  if (buf.st_uid == getuid()) return TRUE;
+#endif
+  pw = getpwnam(GPM_BROKER_USER);
+  if (pw != NULL && pw->pw_uid == buf.st_uid) return TRUE;
+  g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_PERM,
+              "%s is not owned by root or %s", filename, GPM_BROKER_USER);
+  return FALSE;
+}
+
+/**
+ * gpm_broker_page_open:
+ * @filename: The file from gpm_broker_page_get_filename()
+ *
+ * Return value: the page mapped read-only, or %NULL if there is no broker
+ *               that can be trusted
+ **/
+const GpmBrokerPage *gpm_broker_page_open(const gchar *filename,
+                                          GError **error) {
+  gchar *basename;
+  gchar *dirname;
+  gint dirfd;
+  gint fd = -1;
+
+  /* the file is opened through the directory that was checked */
+  dirname = g_path_get_dirname(filename);
+  basename = g_path_get_basename(filename);
+  dirfd = g_open(dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0);
+  if (dirfd < 0) {
+    gint saved_errno = errno;
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                "failed to open %s: %s", dirname, g_strerror(saved_errno));
+    goto out;
+  }
+  if (!gpm_broker_page_is_trusted(dirfd, dirname, error)) goto out;
+  fd = openat(dirfd, basename, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) {
+    gint saved_errno = errno;
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                "failed to open %s: %s", filename, g_strerror(saved_errno));
+    goto out;
+  }
+  if (!gpm_broker_page_is_trusted(fd, filename, error)) {
+    close(fd);
+    fd = -1;
+  }
+out:
+  if (dirfd >= 0) close(dirfd);
+  g_free(basename);
+  g_free(dirname);
+  if (fd < 0) return NULL;
+  return gpm_seqlock_page_map(fd, filename, sizeof(GpmBrokerPage),
+                              GPM_BROKER_PAGE_MAGIC, GPM_BROKER_PAGE_VERSION,
+                              "broker", error);
+}
+
+/**
+ * gpm_broker_page_read:
+ * @page: A mapped page
+ * @snapshot: Where to copy it
+ *
+ * Takes a consistent copy of the page, retrying if the broker was part way
+ * through a change.
+ *
+ * Return value: %FALSE if no consistent copy could be had, or the page was
+ * retired and should be opened again
+ **/
+gboolean gpm_broker_page_read(const GpmBrokerPage *page,
+                              GpmBrokerPage *snapshot) {
+  if (!gpm_seqlock_page_read(page, snapshot, sizeof(GpmBrokerPage)))
+    return FALSE;
+  snapshot->n_devices = MIN(snapshot->n_devices, GPM_BROKER_DEVICES_MAX);
+  return TRUE;
+}
+
+/**
+ * gpm_broker_device_get_data:
+ * @device: A device from a snapshot
+ *
+ * Return value: the properties for gpm_trace_set_properties(), or %NULL
+ *               if they do not make sense
+ **/
+GVariant *gpm_broker_device_get_data(const GpmBrokerDevice *device) {
+  GVariant *data;
+  GBytes *bytes;
+
+  g_return_val_if_fail(device != NULL, NULL);
+
+  bytes = g_bytes_new(device->data, MIN(device->size, GPM_BROKER_DATA_MAX));
+  data = g_variant_new_from_bytes(G_VARIANT_TYPE_VARDICT, bytes, FALSE);
+  g_bytes_unref(bytes);
+  g_variant_ref_sink(data);
+  if (!g_variant_is_normal_form(data)) {
+    g_variant_unref(data);
+    return NULL;
+  }
+  return data;
+}
+
+/**
+ * gpm_broker_page_close:
+ * @page: A page from gpm_broker_page_create() or gpm_broker_page_open()
+ **/
+void gpm_broker_page_close(const GpmBrokerPage *page) {
+  gpm_seqlock_page_close(page, sizeof(GpmBrokerPage));
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+/**
+ * gpm_broker_page_test_data:
+ **/
+static GVariant *gpm_broker_page_test_data(gdouble percentage) {
+  GVariantBuilder builder;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&builder, "{sv}", "percentage",
+                        g_variant_new_double(percentage));
+  g_variant_builder_add(&builder, "{sv}", "model",
+                        g_variant_new_string("Bench"));
+  return g_variant_builder_end(&builder);
+}
+
+void gpm_broker_page_test(gpointer data) {
+  GpmBrokerPage *page;
+  GpmBrokerPage *snapshot;
+  const GpmBrokerPage *reader;
+  GVariant *expected;
+  GVariant *actual;
+  gchar *dirname;
+  gchar *filename;
+  gchar *name;
+  gboolean ret;
+  guint serial;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmBrokerPage")) return;
+
+  dirname = g_dir_make_tmp("gpm-broker-page-XXXXXX", NULL);
+  filename = g_build_filename(dirname, "devices", NULL);
+  snapshot = g_new0(GpmBrokerPage, 1);
+
+  /************************************************************/
+  egg_test_title(test, "create a page and open it");
+  page = gpm_broker_page_create(filename, NULL);
+  reader = gpm_broker_page_open(filename, NULL);
+  egg_test_assert(test, page != NULL && reader != NULL);
+
+  /************************************************************/
+  egg_test_title(test, "a page others can write is refused");
+  g_chmod(filename, 0666);
+  ret = gpm_broker_page_open(filename, NULL) == NULL;
+  g_chmod(filename, 0644);
+  egg_test_assert(test, ret);
+
+  /************************************************************/
+  egg_test_title(test, "a device is read back as it was set");
+  gpm_broker_page_set_device(page, "/bat0", gpm_broker_page_test_data(42));
+  ret = gpm_broker_page_read(reader, snapshot);
+  actual = ret ? gpm_broker_device_get_data(&snapshot->devices[0]) : NULL;
+  expected = g_variant_ref_sink(gpm_broker_page_test_data(42));
+  egg_test_assert(test, actual != NULL && snapshot->n_devices == 1 &&
+                            g_strcmp0(snapshot->devices[0].name, "/bat0") ==
+                                0 &&
+                            g_variant_equal(actual, expected));
+  if (actual != NULL) g_variant_unref(actual);
+  g_variant_unref(expected);
+
+  /************************************************************/
+  egg_test_title(test, "the same properties are not published again");
+  serial = page->devices[0].serial;
+  ret = gpm_broker_page_set_device(page, "/bat0",
+                                   gpm_broker_page_test_data(42));
+  egg_test_assert(test, !ret && page->devices[0].serial == serial);
+
+  /************************************************************/
+  egg_test_title(test, "a change gets a new serial");
+  ret = gpm_broker_page_set_device(page, "/bat0",
+                                   gpm_broker_page_test_data(41));
+  egg_test_assert(test, ret && page->devices[0].serial != serial);
+
+  /************************************************************/
+  egg_test_title(test, "a removed device frees its slot for the next");
+  gpm_broker_page_set_device(page, "", gpm_broker_page_test_data(41));
+  gpm_broker_page_remove_device(page, "/bat0");
+  gpm_broker_page_set_device(page, "/mouse", gpm_broker_page_test_data(9));
+  egg_test_assert(test, page->n_devices == 2 &&
+                            g_strcmp0(page->devices[0].name, "/mouse") == 0);
+
+  /************************************************************/
+  egg_test_title(test, "a full page refuses more devices");
+  for (i = page->n_devices; i < GPM_BROKER_DEVICES_MAX; i++) {
+    name = g_strdup_printf("/dev%u", i);
+    gpm_broker_page_set_device(page, name, gpm_broker_page_test_data(i));
+    g_free(name);
+  }
+  ret = gpm_broker_page_set_device(page, "/one-more",
+                                   gpm_broker_page_test_data(1));
+  egg_test_assert(test, !ret && page->n_devices == GPM_BROKER_DEVICES_MAX);
+
+  /************************************************************/
+  egg_test_title(test, "a page being written is not read");
+  page->sequence++;
+  ret = gpm_broker_page_read(reader, snapshot);
+  page->sequence++;
+  egg_test_assert(test, !ret);
+
+  /************************************************************/
+  egg_test_title(test, "a retired page is not read");
+  gpm_broker_page_retire(page);
+  egg_test_assert(test, !gpm_broker_page_read(reader, snapshot));
+
+  gpm_broker_page_close(reader);
+  gpm_broker_page_close(page);
+  g_unlink(filename);
+  g_rmdir(dirname);
+  g_free(snapshot);
+  g_free(filename);
+  g_free(dirname);
+
+  egg_test_end(test);
+}
+
+#endif
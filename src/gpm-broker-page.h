@@ -0,0 +1,77 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_BROKER_PAGE_H
+#define __GPM_BROKER_PAGE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* where mate-power-broker publishes the devices for every session on the
+ * host, unless GPM_BROKER_PATH says otherwise with --enable-test-hooks */
+#define GPM_BROKER_PAGE_PATH "/run/mate-power-manager/devices"
+#define GPM_BROKER_PAGE_MAGIC 0x4250474d /* "MGPB" */
+#define GPM_BROKER_PAGE_VERSION 1
+#define GPM_BROKER_DEVICES_MAX 32
+#define GPM_BROKER_NAME_MAX 128
+#define GPM_BROKER_DATA_MAX 3072
+
+/* one UPower device; the name is the object path, or "" for the display
+ * device, and the data is an a{sv} from gpm_trace_get_properties() */
+typedef struct {
+  gchar name[GPM_BROKER_NAME_MAX];
+  guint32 serial; /* changes with the device, 0 if the slot is free */
+  guint32 size;   /* of data */
+  guint8 data[GPM_BROKER_DATA_MAX];
+} GpmBrokerDevice;
+
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  gint32 sequence;   /* odd while the broker is writing */
+  guint32 n_devices; /* slots used, some of which may be free again */
+  gint64 updated;    /* monotonic time of the last change, in us */
+  guint32 serial;    /* the last serial handed out */
+  guint32 reserved;
+  GpmBrokerDevice devices[GPM_BROKER_DEVICES_MAX];
+} GpmBrokerPage;
+
+gchar *gpm_broker_page_get_filename(void);
+GpmBrokerPage *gpm_broker_page_create(const gchar *filename, GError **error);
+gboolean gpm_broker_page_set_device(GpmBrokerPage *page, const gchar *name,
+                                    GVariant *data);
+gboolean gpm_broker_page_remove_device(GpmBrokerPage *page,
+                                       const gchar *name);
+void gpm_broker_page_retire(GpmBrokerPage *page);
+const GpmBrokerPage *gpm_broker_page_open(const gchar *filename,
+                                          GError **error);
+gboolean gpm_broker_page_read(const GpmBrokerPage *page,
+                              GpmBrokerPage *snapshot);
+GVariant *gpm_broker_device_get_data(const GpmBrokerDevice *device);
+void gpm_broker_page_close(const GpmBrokerPage *page);
+#ifdef EGG_TEST
+void gpm_broker_page_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_BROKER_PAGE_H */
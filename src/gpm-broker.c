@@ -0,0 +1,247 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * mate-power-broker watches UPower once for the whole host and publishes
+ * every device in a page that the session daemons map, so a terminal
+ * server with hundreds of sessions does not have hundreds of UPower
+ * clients. The sessions are woken by the modification time of the page
+ * changing, which inotify hands to all of them without a bus message.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <glib-unix.h>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <libupower-glib/upower.h>
+#include <locale.h>
+#include <signal.h>
+#include <stdlib.h>
+
+#include "gpm-broker-page.h"
+#include "gpm-trace.h"
+
+typedef struct {
+  GMainLoop *loop;
+  UpClient *client;
+  UpDevice *display;
+  GPtrArray *devices;
+  GpmBrokerPage *page;
+  gchar *filename;
+  guint publish_id;
+} GpmBroker;
+
+/**
+ * gpm_broker_publish_cb:
+ *
+ * Copies every device into the page in one go, so a burst of property
+ * changes from UPower becomes a single wakeup for the sessions.
+ **/
+static gboolean gpm_broker_publish_cb(GpmBroker *broker) {
+  gboolean changed;
+  UpDevice *device;
+  guint i;
+
+  broker->publish_id = 0;
+  changed = gpm_broker_page_set_device(
+      broker->page, "",
+      gpm_trace_get_properties(G_OBJECT(broker->display), NULL));
+  for (i = 0; i < broker->devices->len; i++) {
+    device = g_ptr_array_index(broker->devices, i);
+    if (gpm_broker_page_set_device(
+            broker->page, up_device_get_object_path(device),
+            gpm_trace_get_properties(G_OBJECT(device), NULL)))
+      changed = TRUE;
+  }
+
+  /* an mmap write is invisible to inotify, the new mtime is not */
+  if (changed && g_utime(broker->filename, NULL) < 0)
+    g_warning("failed to touch %s", broker->filename);
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gpm_broker_publish:
+ **/
+static void gpm_broker_publish(GpmBroker *broker) {
+  if (broker->publish_id != 0) return;
+  broker->publish_id =
+      g_idle_add((GSourceFunc)gpm_broker_publish_cb, broker);
+  g_source_set_name_by_id(broker->publish_id, "[GpmBroker] publish");
+}
+
+/**
+ * gpm_broker_device_changed_cb:
+ **/
+static void gpm_broker_device_changed_cb(UpDevice *device, GParamSpec *pspec,
+                                         GpmBroker *broker) {
+  gpm_broker_publish(broker);
+}
+
+/**
+ * gpm_broker_device_added_cb:
+ **/
+static void gpm_broker_device_added_cb(UpClient *client, UpDevice *device,
+                                       GpmBroker *broker) {
+  g_debug("adding %s", up_device_get_object_path(device));
+  g_signal_connect(device, "notify",
+                   G_CALLBACK(gpm_broker_device_changed_cb), broker);
+  g_ptr_array_add(broker->devices, g_object_ref(device));
+  gpm_broker_publish(broker);
+}
+
+/**
+ * gpm_broker_device_removed_cb:
+ **/
+static void gpm_broker_device_removed_cb(UpClient *client,
+                                         const gchar *object_path,
+                                         GpmBroker *broker) {
+  UpDevice *device;
+  guint i;
+
+  g_debug("removing %s", object_path);
+  for (i = 0; i < broker->devices->len; i++) {
+    device = g_ptr_array_index(broker->devices, i);
+    if (g_strcmp0(object_path, up_device_get_object_path(device)) != 0)
+      continue;
+    g_signal_handlers_disconnect_by_data(device, broker);
+    g_ptr_array_remove_index(broker->devices, i);
+    break;
+  }
+  if (gpm_broker_page_remove_device(broker->page, object_path) &&
+      g_utime(broker->filename, NULL) < 0)
+    g_warning("failed to touch %s", broker->filename);
+}
+
+/**
+ * gpm_broker_quit_cb:
+ **/
+static gboolean gpm_broker_quit_cb(GpmBroker *broker) {
+  g_main_loop_quit(broker->loop);
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * main:
+ **/
+gint main(gint argc, gchar *argv[]) {
+  GOptionContext *context;
+  GpmBroker broker = {0};
+  GPtrArray *array;
+  GError *error = NULL;
+  gchar *dirname;
+  gchar *path = NULL;
+  gint retval = EXIT_FAILURE;
+  guint i;
+
+  const GOptionEntry options[] = {
+      {"path", '\0', 0, G_OPTION_ARG_FILENAME, &path,
+       /* command line argument */
+       _("Where to publish the devices"), NULL},
+      {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
+
+  setlocale(LC_ALL, "");
+  bindtextdomain(GETTEXT_PACKAGE, MATELOCALEDIR);
+  bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
+  textdomain(GETTEXT_PACKAGE);
+
+  context = g_option_context_new(NULL);
+  g_option_context_set_summary(context, _("MATE Power Manager Broker"));
+  g_option_context_add_main_entries(context, options, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_print("%s\n", error->message);
+    g_error_free(error);
+    g_option_context_free(context);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  broker.filename = path != NULL ? path : gpm_broker_page_get_filename();
+  dirname = g_path_get_dirname(broker.filename);
+  if (g_mkdir_with_parents(dirname, 0755) < 0) {
+    g_warning("failed to create %s: %s", dirname, g_strerror(errno));
+    g_free(dirname);
+    goto out;
+  }
+  g_free(dirname);
+
+  broker.client = up_client_new_full(NULL, &error);
+  if (broker.client == NULL) {
+    g_warning("failed to connect to UPower: %s", error->message);
+    g_error_free(error);
+    goto out;
+  }
+  broker.page = gpm_broker_page_create(broker.filename, &error);
+  if (broker.page == NULL) {
+    g_warning("%s", error->message);
+    g_error_free(error);
+    goto out;
+  }
+
+  broker.loop = g_main_loop_new(NULL, FALSE);
+  broker.devices = g_ptr_array_new_with_free_func(g_object_unref);
+  broker.display = up_client_get_display_device(broker.client);
+  g_signal_connect(broker.display, "notify",
+                   G_CALLBACK(gpm_broker_device_changed_cb), &broker);
+  g_signal_connect(broker.client, "device-added",
+                   G_CALLBACK(gpm_broker_device_added_cb), &broker);
+  g_signal_connect(broker.client, "device-removed",
+                   G_CALLBACK(gpm_broker_device_removed_cb), &broker);
+  array = up_client_get_devices2(broker.client);
+  if (array != NULL) {
+    for (i = 0; i < array->len; i++)
+      gpm_broker_device_added_cb(broker.client, g_ptr_array_index(array, i),
+                                 &broker);
+    g_ptr_array_unref(array);
+  }
+  gpm_broker_publish(&broker);
+
+  g_unix_signal_add(SIGINT, (GSourceFunc)gpm_broker_quit_cb, &broker);
+  g_unix_signal_add(SIGTERM, (GSourceFunc)gpm_broker_quit_cb, &broker);
+  g_main_loop_run(broker.loop);
+
+  /* the sessions go back to their own UPower clients */
+  if (broker.publish_id != 0) g_source_remove(broker.publish_id);
+  gpm_broker_page_retire(broker.page);
+  g_unlink(broker.filename);
+  retval = EXIT_SUCCESS;
+out:
+  if (broker.devices != NULL) {
+    for (i = 0; i < broker.devices->len; i++)
+      g_signal_handlers_disconnect_by_data(
+          g_ptr_array_index(broker.devices, i), &broker);
+    g_ptr_array_unref(broker.devices);
+  }
+  if (broker.display != NULL) {
+    g_signal_handlers_disconnect_by_data(broker.display, &broker);
+    g_object_unref(broker.display);
+  }
+  if (broker.client != NULL) g_object_unref(broker.client);
+  if (broker.loop != NULL) g_main_loop_unref(broker.loop);
+  gpm_broker_page_close(broker.page);
+  g_free(broker.filename);
+  return retval;
+}
@@ -36,6 +36,7 @@
 #include <string.h>
 
 #include "gpm-common.h"
+#include "gpm-trace.h"
 
 static void gpm_button_finalize(GObject *object);
 
@@ -47,6 +48,7 @@ struct GpmButtonPrivate {
   GTimer *timer;
   gboolean lid_is_closed;
   UpClient *client;
+  GpmTrace *trace;
 };
 
 enum { BUTTON_PRESSED, LAST_SIGNAL };
@@ -64,6 +66,9 @@ G_DEFINE_TYPE_WITH_PRIVATE(GpmButton, gpm_button, G_TYPE_OBJECT)
 static gboolean gpm_button_emit_type(GpmButton *button, const gchar *type) {
   g_return_val_if_fail(GPM_IS_BUTTON(button), FALSE);
 
+  /* the buttons come from the trace instead */
+  if (gpm_trace_is_replaying(button->priv->trace)) return FALSE;
+
   /* did we just have this button before the timeout? */
   if (g_strcmp0(type, button->priv->last_button) == 0 &&
       g_timer_elapsed(button->priv->timer, NULL) <
@@ -73,6 +78,7 @@ static gboolean gpm_button_emit_type(GpmButton *button, const gchar *type) {
   }
 
   g_debug("emitting button-pressed : %s", type);
+  gpm_trace_add(button->priv->trace, GPM_TRACE_KIND_BUTTON, 0, type, NULL);
   g_signal_emit(button, signals[BUTTON_PRESSED], 0, type);
 
   /* save type and last size */
@@ -84,20 +90,19 @@ static gboolean gpm_button_emit_type(GpmButton *button, const gchar *type) {
 }
 
 /**
- * gpm_button_filter_x_events:
+ * gpm_button_filter_keycode:
+ * @button: This button class instance
+ * @keycode: The hardware keycode of the key that was pressed
+ *
+ * Emits the button that @keycode has been grabbed for, if any.
+ *
+ * Return value: %TRUE if the key is one of ours
  **/
-static GdkFilterReturn gpm_button_filter_x_events(GdkXEvent *xevent,
-                                                  GdkEvent *event,
-                                                  gpointer data) {
-  GpmButton *button = (GpmButton *)data;
-  XEvent *xev = (XEvent *)xevent;
-  guint keycode;
+gboolean gpm_button_filter_keycode(GpmButton *button, guint keycode) {
   const gchar *key;
   gchar *keycode_str;
 
-  if (xev->type != KeyPress) return GDK_FILTER_CONTINUE;
-
-  keycode = xev->xkey.keycode;
+  g_return_val_if_fail(GPM_IS_BUTTON(button), FALSE);
 
   /* is the key string already in our DB? */
   keycode_str = g_strdup_printf("0x%x", keycode);
@@ -108,12 +113,28 @@ static GdkFilterReturn gpm_button_filter_x_events(GdkXEvent *xevent,
   /* found anything? */
   if (key == NULL) {
     g_debug("Key %i not found in hash", keycode);
-    /* pass normal keypresses on, which might help with accessibility access */
-    return GDK_FILTER_CONTINUE;
+    return FALSE;
   }
 
   g_debug("Key %i mapped to key %s", keycode, key);
   gpm_button_emit_type(button, key);
+  return TRUE;
+}
+
+/**
+ * gpm_button_filter_x_events:
+ **/
+static GdkFilterReturn gpm_button_filter_x_events(GdkXEvent *xevent,
+                                                  GdkEvent *event,
+                                                  gpointer data) {
+  GpmButton *button = (GpmButton *)data;
+  XEvent *xev = (XEvent *)xevent;
+
+  if (xev->type != KeyPress) return GDK_FILTER_CONTINUE;
+
+  /* pass normal keypresses on, which might help with accessibility access */
+  if (!gpm_button_filter_keycode(button, xev->xkey.keycode))
+    return GDK_FILTER_CONTINUE;
 
   return GDK_FILTER_REMOVE;
 }
@@ -249,6 +270,10 @@ gboolean gpm_button_is_lid_closed(GpmButton *button) {
 
   g_return_val_if_fail(GPM_IS_BUTTON(button), FALSE);
 
+  /* the lid is wherever the trace last left it */
+  if (gpm_trace_is_replaying(button->priv->trace))
+    return button->priv->lid_is_closed;
+
   if (LOGIND_RUNNING()) {
     proxy = g_dbus_proxy_new_for_bus_sync(
         G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
@@ -301,6 +326,8 @@ static void gpm_button_client_changed_cb(UpClient *client, GParamSpec *pspec,
                                          GpmButton *button) {
   gboolean lid_is_closed;
 
+  if (gpm_trace_is_replaying(button->priv->trace)) return;
+
   /* get new state */
   lid_is_closed = gpm_button_is_lid_closed(button);
 
@@ -317,6 +344,30 @@ static void gpm_button_client_changed_cb(UpClient *client, GParamSpec *pspec,
     gpm_button_emit_type(button, GPM_BUTTON_LID_OPEN);
 }
 
+/**
+ * gpm_button_trace_replay_cb:
+ *
+ * Duplicates were already dropped when the trace was recorded
+ **/
+static void gpm_button_trace_replay_cb(GpmTrace *trace,
+                                       const GpmTraceEvent *event,
+                                       GpmButton *button) {
+  /* the state the lid was in when recording started */
+  if (event->kind == GPM_TRACE_KIND_CLIENT) {
+    button->priv->lid_is_closed =
+        (event->value & GPM_TRACE_CLIENT_LID_IS_CLOSED) > 0;
+    return;
+  }
+  if (event->kind != GPM_TRACE_KIND_BUTTON || event->name == NULL) return;
+
+  if (g_strcmp0(event->name, GPM_BUTTON_LID_CLOSED) == 0)
+    button->priv->lid_is_closed = TRUE;
+  else if (g_strcmp0(event->name, GPM_BUTTON_LID_OPEN) == 0)
+    button->priv->lid_is_closed = FALSE;
+  g_debug("replaying button-pressed : %s", event->name);
+  g_signal_emit(button, signals[BUTTON_PRESSED], 0, event->name);
+}
+
 /**
  * gpm_button_init:
  * @button: This class instance
@@ -337,6 +388,9 @@ static void gpm_button_init(GpmButton *button) {
       up_client_get_lid_is_closed(button->priv->client);
   g_signal_connect(button->priv->client, "notify",
                    G_CALLBACK(gpm_button_client_changed_cb), button);
+  button->priv->trace = gpm_trace_new();
+  g_signal_connect(button->priv->trace, "replay",
+                   G_CALLBACK(gpm_button_trace_replay_cb), button);
   /* register the brightness keys */
   gpm_button_xevent_key(button, XF86XK_PowerOff, GPM_BUTTON_POWER);
 
@@ -378,6 +432,7 @@ static void gpm_button_finalize(GObject *object) {
   button->priv = gpm_button_get_instance_private(button);
 
   g_object_unref(button->priv->client);
+  g_object_unref(button->priv->trace);
   g_free(button->priv->last_button);
   g_timer_destroy(button->priv->timer);
 
@@ -68,6 +68,7 @@ GType gpm_button_get_type(void);
 GpmButton *gpm_button_new(void);
 gboolean gpm_button_is_lid_closed(GpmButton *button);
 gboolean gpm_button_reset_time(GpmButton *button);
+gboolean gpm_button_filter_keycode(GpmButton *button, guint keycode);
 
 G_END_DECLS
 
@@ -38,6 +38,9 @@ G_BEGIN_DECLS
 #define GPM_DBUS_PATH "/org/mate/PowerManager"
 #define GPM_DBUS_PATH_BACKLIGHT "/org/mate/PowerManager/Backlight"
 #define GPM_DBUS_PATH_KBD_BACKLIGHT "/org/mate/PowerManager/KbdBacklight"
+#define GPM_DBUS_SERVICE_POWER_PROFILES "org.mate.PowerManager.PowerProfiles"
+#define GPM_DBUS_INTERFACE_POWER_PROFILES "org.mate.PowerManager.PowerProfiles"
+#define GPM_DBUS_PATH_POWER_PROFILES "/org/mate/PowerManager/PowerProfiles"
 
 /* common descriptions of this program */
 #define GPM_NAME _("Power Manager")
@@ -74,6 +77,22 @@ G_BEGIN_DECLS
 #define GPM_SETTINGS_KBD_BRIGHTNESS_DIM_BY_ON_IDLE \
   "kbd-brightness-dim-by-on-idle"
 
+/* cpu */
+#define GPM_SETTINGS_CPU_GOVERNOR_AC "cpu-governor-ac"
+#define GPM_SETTINGS_CPU_GOVERNOR_BATT "cpu-governor-battery"
+#define GPM_SETTINGS_CPU_GOVERNOR_PERFORMANCE "cpu-governor-performance"
+#define GPM_SETTINGS_CPU_EPP_AC "cpu-epp-ac"
+#define GPM_SETTINGS_CPU_EPP_BATT "cpu-epp-battery"
+#define GPM_SETTINGS_CPU_EPP_PERFORMANCE "cpu-epp-performance"
+#define GPM_SETTINGS_CPU_BOOST_AC "cpu-boost-ac"
+#define GPM_SETTINGS_CPU_BOOST_BATT "cpu-boost-battery"
+#define GPM_SETTINGS_CPU_BOOST_PERFORMANCE "cpu-boost-performance"
+
+/* platform profile */
+#define GPM_SETTINGS_PLATFORM_PROFILE_AC "platform-profile-ac"
+#define GPM_SETTINGS_PLATFORM_PROFILE_BATT "platform-profile-battery"
+#define GPM_SETTINGS_PLATFORM_PROFILE_IDLE "platform-profile-idle"
+
 /* buttons */
 #define GPM_SETTINGS_BUTTON_LID_AC "button-lid-ac"
 #define GPM_SETTINGS_BUTTON_LID_BATT "button-lid-battery"
@@ -119,6 +138,10 @@ G_BEGIN_DECLS
 #define GPM_SETTINGS_ICON_POLICY "icon-policy"
 #define GPM_SETTINGS_ENABLE_SOUND "enable-sound"
 #define GPM_SETTINGS_SHOW_ACTIONS "show-actions"
+#define GPM_SETTINGS_SHOW_ENERGY_USED "show-energy-used"
+
+/* metrics */
+#define GPM_SETTINGS_METRICS_FILE "metrics-file"
 
 /* statistics */
 #define GPM_SETTINGS_INFO_HISTORY_TIME "info-history-time"
@@ -49,9 +49,11 @@
 #include "gpm-common.h"
 #include "gpm-control.h"
 #include "gpm-networkmanager.h"
+#include "gpm-trace.h"
 
 struct GpmControlPrivate {
   GSettings *settings;
+  GpmTrace *trace;
 };
 
 enum { RESUME, SLEEP, LAST_SIGNAL };
@@ -116,6 +118,10 @@ static gboolean gpm_control_systemd_shutdown(void) {
 gboolean gpm_control_shutdown(GpmControl *control, GError **error) {
   gboolean ret = FALSE;
 
+  if (gpm_trace_is_replaying(control->priv->trace)) {
+    gpm_trace_decision(control->priv->trace, "shutdown");
+    return TRUE;
+  }
   if (LOGIND_RUNNING()) {
     ret = gpm_control_systemd_shutdown();
   }
@@ -144,6 +150,14 @@ gboolean gpm_control_suspend(GpmControl *control, GError **error) {
   GDBusProxy *proxy;
   GVariant *res = NULL;
 
+  /* the handlers still see the sleep, but the machine stays up */
+  if (gpm_trace_is_replaying(control->priv->trace)) {
+    gpm_trace_decision(control->priv->trace, "suspend");
+    g_signal_emit(control, signals[SLEEP], 0, GPM_CONTROL_ACTION_SUSPEND);
+    g_signal_emit(control, signals[RESUME], 0, GPM_CONTROL_ACTION_SUSPEND);
+    return TRUE;
+  }
+
   if (!LOGIND_RUNNING()) {
     goto out;
   }
@@ -251,6 +265,13 @@ gboolean gpm_control_hibernate(GpmControl *control, GError **error) {
   GDBusProxy *proxy;
   GVariant *res = NULL;
 
+  if (gpm_trace_is_replaying(control->priv->trace)) {
+    gpm_trace_decision(control->priv->trace, "hibernate");
+    g_signal_emit(control, signals[SLEEP], 0, GPM_CONTROL_ACTION_HIBERNATE);
+    g_signal_emit(control, signals[RESUME], 0, GPM_CONTROL_ACTION_HIBERNATE);
+    return TRUE;
+  }
+
   if (!LOGIND_RUNNING()) {
     goto out;
   }
@@ -348,6 +369,7 @@ static void gpm_control_finalize(GObject *object) {
   control = GPM_CONTROL(object);
 
   g_object_unref(control->priv->settings);
+  g_object_unref(control->priv->trace);
 
   g_return_if_fail(control->priv != NULL);
   G_OBJECT_CLASS(gpm_control_parent_class)->finalize(object);
@@ -378,6 +400,7 @@ static void gpm_control_init(GpmControl *control) {
   control->priv = gpm_control_get_instance_private(control);
 
   control->priv->settings = g_settings_new(GPM_SETTINGS_SCHEMA);
+  control->priv->trace = gpm_trace_new();
 }
 
 /**
@@ -0,0 +1,99 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <locale.h>
+
+#include "gpm-cpu-sysfs.h"
+#include "gpm-helper.h"
+
+/**
+ * main:
+ **/
+gint main(gint argc, gchar *argv[]) {
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar *values[GPM_CPU_KNOB_LAST] = {NULL};
+  gchar *root = NULL;
+  gint retval = GPM_HELPER_EXIT_CODE_SUCCESS;
+  guint i;
+
+  const GOptionEntry options[] = {
+      {"governor", '\0', 0, G_OPTION_ARG_STRING,
+       &values[GPM_CPU_KNOB_GOVERNOR],
+       /* command line argument */
+       _("Set the CPU frequency governor"), NULL},
+      {"epp", '\0', 0, G_OPTION_ARG_STRING, &values[GPM_CPU_KNOB_EPP],
+       /* command line argument */
+       _("Set the CPU energy performance preference"), NULL},
+      {"boost", '\0', 0, G_OPTION_ARG_STRING, &values[GPM_CPU_KNOB_BOOST],
+       /* command line argument */
+       _("Turn CPU boost on or off"), NULL},
+      {"root", '\0', 0, G_OPTION_ARG_FILENAME, &root,
+       /* command line argument */
+       _("Use a copy of the CPU sysfs directory, for testing"), NULL},
+      {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
+
+  /* setup translations */
+  setlocale(LC_ALL, "");
+  bindtextdomain(GETTEXT_PACKAGE, MATELOCALEDIR);
+  bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
+  textdomain(GETTEXT_PACKAGE);
+
+  context = g_option_context_new(NULL);
+  g_option_context_set_summary(context, _("MATE Power Manager CPU Helper"));
+  g_option_context_add_main_entries(context, options, NULL);
+  g_option_context_parse(context, &argc, &argv, NULL);
+  g_option_context_free(context);
+
+  /* no input */
+  if (values[GPM_CPU_KNOB_GOVERNOR] == NULL &&
+      values[GPM_CPU_KNOB_EPP] == NULL && values[GPM_CPU_KNOB_BOOST] == NULL) {
+    /* TRANSLATORS: user did not specify valid options */
+    g_print("%s\n", _("No valid option was specified"));
+    retval = GPM_HELPER_EXIT_CODE_ARGUMENTS_INVALID;
+    goto out;
+  }
+
+  retval = gpm_helper_check_caller(root != NULL);
+  if (retval != GPM_HELPER_EXIT_CODE_SUCCESS) goto out;
+  if (root == NULL) root = g_strdup(GPM_CPU_SYSFS_ROOT);
+
+  /* the governor first, as intel_pstate ties the preference to it */
+  for (i = 0; i < GPM_CPU_KNOB_LAST; i++) {
+    if (values[i] == NULL) continue;
+    if (!gpm_cpu_sysfs_set(root, i, values[i], &error)) {
+      /* TRANSLATORS: failed to change the CPUs */
+      g_print("%s: %s\n", _("Could not change the CPUs"), error->message);
+      g_clear_error(&error);
+      retval = GPM_HELPER_EXIT_CODE_FAILED;
+    }
+  }
+out:
+  for (i = 0; i < GPM_CPU_KNOB_LAST; i++) g_free(values[i]);
+  g_free(root);
+  return retval;
+}
@@ -0,0 +1,546 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gpm-cpu-policy.h"
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gpm-common.h"
+#include "gpm-cpu-sysfs.h"
+#include "gpm-policy.h"
+
+typedef enum {
+  GPM_CPU_POLICY_MODE_AC,
+  GPM_CPU_POLICY_MODE_BATTERY,
+  GPM_CPU_POLICY_MODE_PERFORMANCE,
+  GPM_CPU_POLICY_MODE_LAST
+} GpmCpuPolicyMode;
+
+/* the key for each knob in each mode, an empty value meaning the knob is
+ * left as the session found it */
+static const gchar *gpm_cpu_policy_keys[GPM_CPU_POLICY_MODE_LAST]
+                                       [GPM_CPU_KNOB_LAST] = {
+    {GPM_SETTINGS_CPU_GOVERNOR_AC, GPM_SETTINGS_CPU_EPP_AC,
+     GPM_SETTINGS_CPU_BOOST_AC},
+    {GPM_SETTINGS_CPU_GOVERNOR_BATT, GPM_SETTINGS_CPU_EPP_BATT,
+     GPM_SETTINGS_CPU_BOOST_BATT},
+    {GPM_SETTINGS_CPU_GOVERNOR_PERFORMANCE, GPM_SETTINGS_CPU_EPP_PERFORMANCE,
+     GPM_SETTINGS_CPU_BOOST_PERFORMANCE},
+};
+
+struct GpmCpuPolicyPrivate {
+  GSettings *settings;
+  gchar *root;
+  gchar *original[GPM_CPU_KNOB_LAST]; /* NULL if the CPUs lack the knob */
+  gchar *applied[GPM_CPU_KNOB_LAST];
+  gboolean on_battery;
+  GpmPolicyHolds holds;
+  GpmPolicyHelper helper;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE(GpmCpuPolicy, gpm_cpu_policy, G_TYPE_OBJECT)
+
+/**
+ * gpm_cpu_policy_get_mode:
+ **/
+static GpmCpuPolicyMode gpm_cpu_policy_get_mode(GpmCpuPolicy *policy) {
+  if (gpm_policy_holds_size(&policy->priv->holds) > 0)
+    return GPM_CPU_POLICY_MODE_PERFORMANCE;
+  if (policy->priv->on_battery) return GPM_CPU_POLICY_MODE_BATTERY;
+  return GPM_CPU_POLICY_MODE_AC;
+}
+
+/**
+ * gpm_cpu_policy_helper_failed:
+ *
+ * Goes with what is there, so the next change tries again.
+ **/
+static void gpm_cpu_policy_helper_failed(GpmCpuPolicy *policy) {
+  guint i;
+
+  for (i = 0; i < GPM_CPU_KNOB_LAST; i++) {
+    if (policy->priv->original[i] == NULL) continue;
+    g_free(policy->priv->applied[i]);
+    policy->priv->applied[i] = gpm_cpu_sysfs_get(policy->priv->root, i);
+  }
+}
+
+/**
+ * gpm_cpu_policy_get_argv:
+ *
+ * When built with --enable-test-hooks, the test harness can also point the
+ * helper at a copy of sysfs with GPM_CPU_SYSFS_ROOT.
+ **/
+static GPtrArray *gpm_cpu_policy_get_argv(GpmCpuPolicy *policy) {
+  GPtrArray *argv;
+
+  argv = gpm_policy_helper_get_argv(&policy->priv->helper);
+  if (g_strcmp0(policy->priv->root, GPM_CPU_SYSFS_ROOT) != 0)
+    g_ptr_array_add(argv,
+                    g_strdup_printf("--root=%s", policy->priv->root));
+  return argv;
+}
+
+/**
+ * gpm_cpu_policy_evaluate:
+ *
+ * Works out what the CPUs should have now, and runs the helper once for
+ * whatever differs from what was last asked for. Nothing is done while the
+ * session is in the background, and it catches up once it is active.
+ **/
+static void gpm_cpu_policy_evaluate(GpmCpuPolicy *policy) {
+  GpmCpuPolicyPrivate *priv = policy->priv;
+  GpmCpuPolicyMode mode;
+  GPtrArray *argv;
+  gchar *value;
+  gboolean changed = FALSE;
+  guint i;
+
+  if (!gpm_policy_helper_is_active(&priv->helper)) return;
+  if (gpm_policy_helper_is_busy(&priv->helper)) return;
+
+  mode = gpm_cpu_policy_get_mode(policy);
+  argv = gpm_cpu_policy_get_argv(policy);
+  for (i = 0; i < GPM_CPU_KNOB_LAST; i++) {
+    if (priv->original[i] == NULL) continue;
+    value = g_settings_get_string(priv->settings,
+                                  gpm_cpu_policy_keys[mode][i]);
+    if (value[0] == '\0') {
+      g_free(value);
+      value = g_strdup(priv->original[i]);
+    }
+    if (g_strcmp0(value, priv->applied[i]) == 0) {
+      g_free(value);
+      continue;
+    }
+    g_ptr_array_add(argv, g_strdup_printf(
+                              "--%s=%s", gpm_cpu_knob_to_string(i), value));
+    g_free(priv->applied[i]);
+    priv->applied[i] = value;
+    changed = TRUE;
+  }
+
+  if (changed) {
+    g_debug("setting the CPUs for mode %i", mode);
+    gpm_policy_helper_run(&priv->helper, argv);
+  }
+  g_ptr_array_unref(argv);
+}
+
+/**
+ * gpm_cpu_policy_set_on_battery:
+ **/
+void gpm_cpu_policy_set_on_battery(GpmCpuPolicy *policy, gboolean on_battery) {
+  g_return_if_fail(GPM_IS_CPU_POLICY(policy));
+
+  if (policy->priv->on_battery == on_battery) return;
+  policy->priv->on_battery = on_battery;
+  gpm_cpu_policy_evaluate(policy);
+}
+
+/**
+ * gpm_cpu_policy_hold:
+ * @sender: The unique bus name of the program, or %NULL
+ * @reason: Why it wants the CPUs at full speed
+ *
+ * Runs the CPUs with the performance settings until the hold is released,
+ * or @sender leaves the session bus.
+ *
+ * Return value: the cookie for gpm_cpu_policy_release()
+ **/
+guint gpm_cpu_policy_hold(GpmCpuPolicy *policy, const gchar *sender,
+                          const gchar *reason) {
+  GpmPolicyHold *hold;
+
+  g_return_val_if_fail(GPM_IS_CPU_POLICY(policy), 0);
+
+  g_debug("%s holds performance for %s", sender, reason);
+  hold = gpm_policy_holds_add(&policy->priv->holds, NULL, sender, NULL,
+                              reason, NULL);
+  gpm_cpu_policy_evaluate(policy);
+  return hold->cookie;
+}
+
+/**
+ * gpm_cpu_policy_release:
+ * @sender: The unique bus name of the caller, or %NULL for any hold
+ *
+ * Return value: %FALSE if there was no such hold, or @sender did not take it
+ **/
+gboolean gpm_cpu_policy_release(GpmCpuPolicy *policy, guint cookie,
+                                const gchar *sender) {
+  GpmPolicyHold *hold;
+
+  g_return_val_if_fail(GPM_IS_CPU_POLICY(policy), FALSE);
+
+  hold = gpm_policy_holds_lookup(&policy->priv->holds, cookie);
+  if (hold == NULL) return FALSE;
+  if (sender != NULL && g_strcmp0(hold->sender, sender) != 0) return FALSE;
+  gpm_policy_holds_remove(&policy->priv->holds, cookie);
+  gpm_cpu_policy_evaluate(policy);
+  return TRUE;
+}
+
+/**
+ * gpm_cpu_policy_vanished:
+ **/
+static void gpm_cpu_policy_vanished(guint cookie, GpmCpuPolicy *policy) {
+  gpm_cpu_policy_release(policy, cookie, NULL);
+}
+
+/**
+ * gpm_cpu_policy_restore:
+ *
+ * Puts back what the CPUs had when the session started, waiting for the
+ * helper as the session is about to go. A session in the background
+ * leaves them to the one in front.
+ **/
+static void gpm_cpu_policy_restore(GpmCpuPolicy *policy) {
+  GpmCpuPolicyPrivate *priv = policy->priv;
+  GPtrArray *argv;
+  GError *error = NULL;
+  gboolean changed = FALSE;
+  guint i;
+
+  argv = gpm_cpu_policy_get_argv(policy);
+  for (i = 0; i < GPM_CPU_KNOB_LAST; i++) {
+    if (priv->original[i] == NULL) continue;
+    if (g_strcmp0(priv->original[i], priv->applied[i]) == 0) continue;
+    g_ptr_array_add(argv,
+                    g_strdup_printf("--%s=%s", gpm_cpu_knob_to_string(i),
+                                    priv->original[i]));
+    changed = TRUE;
+  }
+  if (changed && gpm_policy_helper_is_active(&priv->helper)) {
+    g_debug("putting the CPUs back as they were");
+    if (!gpm_policy_helper_run_sync(&priv->helper, argv, &error)) {
+      g_warning("failed to put the CPUs back: %s", error->message);
+      g_error_free(error);
+    }
+  }
+  g_ptr_array_unref(argv);
+}
+
+/**
+ * gpm_cpu_policy_settings_changed_cb:
+ **/
+static void gpm_cpu_policy_settings_changed_cb(GSettings *settings,
+                                               const gchar *key,
+                                               GpmCpuPolicy *policy) {
+  if (g_str_has_prefix(key, "cpu-")) gpm_cpu_policy_evaluate(policy);
+}
+
+/**
+ * gpm_cpu_policy_finalize:
+ **/
+static void gpm_cpu_policy_finalize(GObject *object) {
+  GpmCpuPolicy *policy;
+  guint i;
+
+  g_return_if_fail(GPM_IS_CPU_POLICY(object));
+  policy = GPM_CPU_POLICY(object);
+
+  gpm_cpu_policy_restore(policy);
+  gpm_policy_helper_clear(&policy->priv->helper);
+  gpm_policy_holds_clear(&policy->priv->holds);
+  g_object_unref(policy->priv->settings);
+  for (i = 0; i < GPM_CPU_KNOB_LAST; i++) {
+    g_free(policy->priv->original[i]);
+    g_free(policy->priv->applied[i]);
+  }
+  g_free(policy->priv->root);
+
+  G_OBJECT_CLASS(gpm_cpu_policy_parent_class)->finalize(object);
+}
+
+/**
+ * gpm_cpu_policy_class_init:
+ **/
+static void gpm_cpu_policy_class_init(GpmCpuPolicyClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->finalize = gpm_cpu_policy_finalize;
+}
+
+/**
+ * gpm_cpu_policy_init:
+ *
+ * Remembers what the CPUs had when the session started, which is what an
+ * empty setting goes back to.
+ **/
+static void gpm_cpu_policy_init(GpmCpuPolicy *policy) {
+  const gchar *root = NULL;
+  guint i;
+
+  policy->priv = gpm_cpu_policy_get_instance_private(policy);
+#if defined(EGG_TEST) || defined(GPM_TEST_HOOKS)
+  root = g_getenv("GPM_CPU_SYSFS_ROOT");
+#endif
+  policy->priv->root = g_strdup(root != NULL ? root : GPM_CPU_SYSFS_ROOT);
+  for (i = 0; i < GPM_CPU_KNOB_LAST; i++) {
+    policy->priv->original[i] = gpm_cpu_sysfs_get(policy->priv->root, i);
+    policy->priv->applied[i] = g_strdup(policy->priv->original[i]);
+  }
+  gpm_policy_holds_init(&policy->priv->holds,
+                        (GpmPolicyVanishedFunc)gpm_cpu_policy_vanished, policy);
+  gpm_policy_helper_init(
+      &policy->priv->helper, "mate-power-cpu-helper", "GPM_CPU_HELPER",
+      (GpmPolicyHelperFunc)gpm_cpu_policy_evaluate,
+      (GpmPolicyHelperFunc)gpm_cpu_policy_helper_failed, policy);
+  policy->priv->settings = g_settings_new(GPM_SETTINGS_SCHEMA);
+  g_signal_connect(policy->priv->settings, "changed",
+                   G_CALLBACK(gpm_cpu_policy_settings_changed_cb), policy);
+  gpm_cpu_policy_evaluate(policy);
+}
+
+/**
+ * gpm_cpu_policy_new:
+ *
+ * Return value: A new GpmCpuPolicy, starting out on AC
+ **/
+GpmCpuPolicy *gpm_cpu_policy_new(void) {
+  return g_object_new(GPM_TYPE_CPU_POLICY, NULL);
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+/* what the test waits for, as egg_test_loop_quit() only has the test */
+static const gchar *gpm_cpu_policy_test_root = NULL;
+static GpmCpuKnob gpm_cpu_policy_test_knob = GPM_CPU_KNOB_GOVERNOR;
+static const gchar *gpm_cpu_policy_test_goal = NULL;
+static guint gpm_cpu_policy_test_poll_id = 0;
+
+/**
+ * gpm_cpu_policy_test_file:
+ **/
+static void gpm_cpu_policy_test_file(const gchar *root, const gchar *path,
+                                     const gchar *contents) {
+  gchar *filename;
+  gchar *dirname;
+
+  filename = g_build_filename(root, path, NULL);
+  dirname = g_path_get_dirname(filename);
+  g_mkdir_with_parents(dirname, 0755);
+  g_file_set_contents(filename, contents, -1, NULL);
+  g_free(dirname);
+  g_free(filename);
+}
+
+/**
+ * gpm_cpu_policy_test_remove:
+ **/
+static void gpm_cpu_policy_test_remove(const gchar *path) {
+  const gchar *name;
+  gchar *child;
+  GDir *dir;
+
+  dir = g_dir_open(path, 0, NULL);
+  if (dir != NULL) {
+    while ((name = g_dir_read_name(dir)) != NULL) {
+      child = g_build_filename(path, name, NULL);
+      gpm_cpu_policy_test_remove(child);
+      g_free(child);
+    }
+    g_dir_close(dir);
+    g_rmdir(path);
+  } else {
+    g_unlink(path);
+  }
+}
+
+/**
+ * gpm_cpu_policy_test_poll_cb:
+ **/
+static gboolean gpm_cpu_policy_test_poll_cb(EggTest *test) {
+  gchar *value;
+  gboolean ret;
+
+  value = gpm_cpu_sysfs_get(gpm_cpu_policy_test_root,
+                            gpm_cpu_policy_test_knob);
+  ret = g_strcmp0(value, gpm_cpu_policy_test_goal) == 0;
+  g_free(value);
+  if (!ret) return TRUE;
+  gpm_cpu_policy_test_poll_id = 0;
+  egg_test_loop_quit(test);
+  return FALSE;
+}
+
+/**
+ * gpm_cpu_policy_test_wait:
+ *
+ * Return value: %TRUE if the helper wrote @goal for @knob in time
+ **/
+static gboolean gpm_cpu_policy_test_wait(EggTest *test, GpmCpuKnob knob,
+                                         const gchar *goal) {
+  gpm_cpu_policy_test_knob = knob;
+  gpm_cpu_policy_test_goal = goal;
+  gpm_cpu_policy_test_poll_id =
+      g_timeout_add(20, (GSourceFunc)gpm_cpu_policy_test_poll_cb, test);
+  egg_test_loop_wait(test, 5000);
+  if (gpm_cpu_policy_test_poll_id == 0) return TRUE;
+  g_source_remove(gpm_cpu_policy_test_poll_id);
+  gpm_cpu_policy_test_poll_id = 0;
+  return FALSE;
+}
+
+void gpm_cpu_policy_test(gpointer data) {
+  GpmCpuPolicy *policy;
+  GSettingsSchema *schema;
+  GSettings *settings;
+  gchar *root;
+  gchar *value;
+  guint cookie;
+  gboolean ret;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmCpuPolicy")) return;
+
+  /* the check target sets these up, so other runs do without the test */
+  schema = g_settings_schema_source_lookup(
+      g_settings_schema_source_get_default(), GPM_SETTINGS_SCHEMA, TRUE);
+  if (schema == NULL || g_getenv("GPM_CPU_HELPER") == NULL) {
+    g_print("no schema or helper to test with...");
+    if (schema != NULL) g_settings_schema_unref(schema);
+    egg_test_end(test);
+    return;
+  }
+  g_settings_schema_unref(schema);
+
+  /* a laptop with intel_pstate, and settings for each mode */
+  root = g_dir_make_tmp("gpm-cpu-policy-XXXXXX", NULL);
+  gpm_cpu_policy_test_file(root, "cpufreq/policy0/scaling_governor",
+                           "powersave\n");
+  gpm_cpu_policy_test_file(root,
+                           "cpufreq/policy0/scaling_available_governors",
+                           "performance powersave\n");
+  gpm_cpu_policy_test_file(root,
+                           "cpufreq/policy0/energy_performance_preference",
+                           "balance_performance\n");
+  gpm_cpu_policy_test_file(
+      root, "cpufreq/policy0/energy_performance_available_preferences",
+      "default performance balance_performance balance_power power\n");
+  gpm_cpu_policy_test_file(root, "intel_pstate/no_turbo", "0\n");
+  gpm_cpu_policy_test_root = root;
+  g_setenv("GPM_CPU_SYSFS_ROOT", root, TRUE);
+  settings = g_settings_new(GPM_SETTINGS_SCHEMA);
+  for (i = 0; i < GPM_CPU_KNOB_LAST; i++)
+    g_settings_set_string(
+        settings, gpm_cpu_policy_keys[GPM_CPU_POLICY_MODE_AC][i], "");
+  g_settings_set_string(settings, GPM_SETTINGS_CPU_GOVERNOR_BATT, "");
+  g_settings_set_string(settings, GPM_SETTINGS_CPU_EPP_BATT, "power");
+  g_settings_set_string(settings, GPM_SETTINGS_CPU_BOOST_BATT, "off");
+  g_settings_set_string(settings, GPM_SETTINGS_CPU_GOVERNOR_PERFORMANCE,
+                        "performance");
+  g_settings_set_string(settings, GPM_SETTINGS_CPU_EPP_PERFORMANCE,
+                        "performance");
+  g_settings_set_string(settings, GPM_SETTINGS_CPU_BOOST_PERFORMANCE, "on");
+
+  /************************************************************/
+  egg_test_title(test, "the CPUs are left alone on AC");
+  policy = gpm_cpu_policy_new();
+  egg_test_assert(test, policy->priv->helper.process == NULL);
+
+  /* the fake tree is not shared with other sessions, so what logind says
+   * about the one running the test does not matter */
+  g_clear_object(&policy->priv->helper.session);
+
+  /************************************************************/
+  egg_test_title(test, "the battery settings are set when unplugged");
+  gpm_cpu_policy_set_on_battery(policy, TRUE);
+  ret = gpm_cpu_policy_test_wait(test, GPM_CPU_KNOB_EPP, "power");
+  egg_test_assert(
+      test, ret && gpm_cpu_policy_test_wait(test, GPM_CPU_KNOB_BOOST, "off"));
+
+  /************************************************************/
+  egg_test_title(test, "a hold wins over the power source");
+  cookie = gpm_cpu_policy_hold(policy, NULL, "testing");
+  ret = gpm_cpu_policy_test_wait(test, GPM_CPU_KNOB_GOVERNOR, "performance");
+  egg_test_assert(test, ret && gpm_cpu_policy_test_wait(
+                                   test, GPM_CPU_KNOB_EPP, "performance"));
+
+  /************************************************************/
+  egg_test_title(test, "releasing the hold goes back to the battery settings");
+  ret = gpm_cpu_policy_release(policy, cookie, NULL);
+  egg_test_assert(test, ret && gpm_cpu_policy_test_wait(
+                                   test, GPM_CPU_KNOB_GOVERNOR, "powersave"));
+
+  /************************************************************/
+  egg_test_title(test, "a hold cannot be released twice");
+  egg_test_assert(test, !gpm_cpu_policy_release(policy, cookie, NULL));
+
+  /************************************************************/
+  egg_test_title(test, "an empty setting puts back what the session found");
+  g_settings_set_string(settings, GPM_SETTINGS_CPU_EPP_BATT, "");
+  egg_test_assert(test, gpm_cpu_policy_test_wait(test, GPM_CPU_KNOB_EPP,
+                                                 "balance_performance"));
+
+  /************************************************************/
+  egg_test_title(test, "a hold is only released by the program that took it");
+  cookie = gpm_cpu_policy_hold(policy, ":1.1", "testing");
+  ret = !gpm_cpu_policy_release(policy, cookie, ":1.2");
+  egg_test_assert(test, ret && gpm_cpu_policy_release(policy, cookie, ":1.1"));
+
+  /************************************************************/
+  egg_test_title(test, "changes made while the helper runs end in the last");
+  gpm_cpu_policy_set_on_battery(policy, FALSE);
+  cookie = gpm_cpu_policy_hold(policy, NULL, "testing");
+  gpm_cpu_policy_release(policy, cookie, NULL);
+  g_settings_set_string(settings, GPM_SETTINGS_CPU_EPP_BATT, "balance_power");
+  gpm_cpu_policy_set_on_battery(policy, TRUE);
+  ret = gpm_cpu_policy_test_wait(test, GPM_CPU_KNOB_EPP, "balance_power");
+  value = gpm_cpu_sysfs_get(root, GPM_CPU_KNOB_GOVERNOR);
+  egg_test_assert(test, ret && g_strcmp0(value, "powersave") == 0);
+  g_free(value);
+
+  /************************************************************/
+  egg_test_title(test, "the CPUs are put back when the policy goes away");
+  g_object_unref(policy);
+  value = gpm_cpu_sysfs_get(root, GPM_CPU_KNOB_EPP);
+  egg_test_assert(test, g_strcmp0(value, "balance_performance") == 0);
+  g_free(value);
+
+  for (i = 0; i < GPM_CPU_KNOB_LAST; i++) {
+    g_settings_reset(settings,
+                     gpm_cpu_policy_keys[GPM_CPU_POLICY_MODE_AC][i]);
+    g_settings_reset(settings,
+                     gpm_cpu_policy_keys[GPM_CPU_POLICY_MODE_BATTERY][i]);
+    g_settings_reset(
+        settings, gpm_cpu_policy_keys[GPM_CPU_POLICY_MODE_PERFORMANCE][i]);
+  }
+  g_object_unref(settings);
+  g_unsetenv("GPM_CPU_SYSFS_ROOT");
+  gpm_cpu_policy_test_remove(root);
+  g_free(root);
+
+  egg_test_end(test);
+}
+
+#endif
@@ -0,0 +1,61 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_CPU_POLICY_H
+#define __GPM_CPU_POLICY_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GPM_TYPE_CPU_POLICY (gpm_cpu_policy_get_type())
+#define GPM_CPU_POLICY(o) \
+  (G_TYPE_CHECK_INSTANCE_CAST((o), GPM_TYPE_CPU_POLICY, GpmCpuPolicy))
+#define GPM_CPU_POLICY_CLASS(k) \
+  (G_TYPE_CHECK_CLASS_CAST((k), GPM_TYPE_CPU_POLICY, GpmCpuPolicyClass))
+#define GPM_IS_CPU_POLICY(o) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((o), GPM_TYPE_CPU_POLICY))
+
+typedef struct GpmCpuPolicyPrivate GpmCpuPolicyPrivate;
+
+typedef struct {
+  GObject parent;
+  GpmCpuPolicyPrivate *priv;
+} GpmCpuPolicy;
+
+typedef struct {
+  GObjectClass parent_class;
+} GpmCpuPolicyClass;
+
+GType gpm_cpu_policy_get_type(void);
+GpmCpuPolicy *gpm_cpu_policy_new(void);
+void gpm_cpu_policy_set_on_battery(GpmCpuPolicy *policy, gboolean on_battery);
+guint gpm_cpu_policy_hold(GpmCpuPolicy *policy, const gchar *sender,
+                          const gchar *reason);
+gboolean gpm_cpu_policy_release(GpmCpuPolicy *policy, guint cookie,
+                                const gchar *sender);
+#ifdef EGG_TEST
+void gpm_cpu_policy_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_CPU_POLICY_H */
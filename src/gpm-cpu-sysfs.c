@@ -0,0 +1,444 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gpm-cpu-sysfs.h"
+
+/* the file every cpufreq policy has for a knob, and what it may be set to */
+static const struct {
+  const gchar *name;
+  const gchar *file;
+  const gchar *available;
+} gpm_cpu_knobs[] = {
+    {"governor", "scaling_governor", "scaling_available_governors"},
+    {"epp", "energy_performance_preference",
+     "energy_performance_available_preferences"},
+    {"boost", NULL, NULL},
+};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(gpm_cpu_knobs) == GPM_CPU_KNOB_LAST);
+
+/**
+ * gpm_cpu_knob_to_string:
+ *
+ * Return value: the name mate-power-cpu-helper takes the knob by
+ **/
+const gchar *gpm_cpu_knob_to_string(GpmCpuKnob knob) {
+  g_return_val_if_fail(knob < GPM_CPU_KNOB_LAST, NULL);
+  return gpm_cpu_knobs[knob].name;
+}
+
+/**
+ * gpm_cpu_sysfs_compare:
+ **/
+static gint gpm_cpu_sysfs_compare(const gchar **a, const gchar **b) {
+  return g_strcmp0(*a, *b);
+}
+
+/**
+ * gpm_cpu_sysfs_get_policies:
+ *
+ * Return value: the cpufreq policy directories in order, or %NULL if there
+ *               are none
+ **/
+static GPtrArray *gpm_cpu_sysfs_get_policies(const gchar *root) {
+  GPtrArray *policies;
+  const gchar *name;
+  gchar *dirname;
+  GDir *dir;
+
+  dirname = g_build_filename(root, "cpufreq", NULL);
+  dir = g_dir_open(dirname, 0, NULL);
+  if (dir == NULL) {
+    g_free(dirname);
+    return NULL;
+  }
+  policies = g_ptr_array_new_with_free_func(g_free);
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    if (g_str_has_prefix(name, "policy"))
+      g_ptr_array_add(policies, g_build_filename(dirname, name, NULL));
+  }
+  g_dir_close(dir);
+  g_free(dirname);
+  if (policies->len == 0) {
+    g_ptr_array_unref(policies);
+    return NULL;
+  }
+  g_ptr_array_sort(policies, (GCompareFunc)gpm_cpu_sysfs_compare);
+  return policies;
+}
+
+/**
+ * gpm_cpu_sysfs_read:
+ *
+ * Return value: the first line of @filename, or %NULL
+ **/
+static gchar *gpm_cpu_sysfs_read(const gchar *filename) {
+  gchar *contents = NULL;
+
+  if (!g_file_get_contents(filename, &contents, NULL, NULL)) return NULL;
+  return g_strstrip(contents);
+}
+
+/**
+ * gpm_cpu_sysfs_write:
+ *
+ * Attributes are written in place, as sysfs does not allow the rename that
+ * g_file_set_contents() does.
+ **/
+static gboolean gpm_cpu_sysfs_write(const gchar *filename, const gchar *value,
+                                    GError **error) {
+  gssize len = strlen(value);
+  gint saved_errno;
+  gint fd;
+
+  fd = g_open(filename, O_WRONLY | O_TRUNC | O_CLOEXEC, 0);
+  if (fd >= 0 && write(fd, value, len) == len) {
+    close(fd);
+    return TRUE;
+  }
+  saved_errno = errno;
+  if (fd >= 0) close(fd);
+  g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+              "failed to write %s to %s: %s", value, filename,
+              g_strerror(saved_errno));
+  return FALSE;
+}
+
+/**
+ * gpm_cpu_sysfs_get_boost_file:
+ * @inverted: Set if the file says whether boost is off
+ *
+ * Return value: the file that switches boost, or %NULL if there is none
+ **/
+static gchar *gpm_cpu_sysfs_get_boost_file(const gchar *root,
+                                           gboolean *inverted) {
+  gchar *filename;
+
+  filename = g_build_filename(root, "intel_pstate", "no_turbo", NULL);
+  *inverted = TRUE;
+  if (g_file_test(filename, G_FILE_TEST_EXISTS)) return filename;
+  g_free(filename);
+  filename = g_build_filename(root, "cpufreq", "boost", NULL);
+  *inverted = FALSE;
+  if (g_file_test(filename, G_FILE_TEST_EXISTS)) return filename;
+  g_free(filename);
+  return NULL;
+}
+
+/**
+ * gpm_cpu_sysfs_get:
+ * @root: %GPM_CPU_SYSFS_ROOT, or a copy of it
+ *
+ * Reads what the first policy has, which is what this module left on all
+ * of them.
+ *
+ * Return value: the value, or %NULL if the CPUs do not have @knob
+ **/
+gchar *gpm_cpu_sysfs_get(const gchar *root, GpmCpuKnob knob) {
+  GPtrArray *policies;
+  gboolean inverted;
+  gchar *filename;
+  gchar *value;
+
+  g_return_val_if_fail(root != NULL, NULL);
+  g_return_val_if_fail(knob < GPM_CPU_KNOB_LAST, NULL);
+
+  if (knob == GPM_CPU_KNOB_BOOST) {
+    filename = gpm_cpu_sysfs_get_boost_file(root, &inverted);
+    if (filename == NULL) return NULL;
+    value = gpm_cpu_sysfs_read(filename);
+    g_free(filename);
+    if (value == NULL) return NULL;
+    inverted ^= g_strcmp0(value, "1") == 0;
+    g_free(value);
+    return g_strdup(inverted ? "on" : "off");
+  }
+
+  policies = gpm_cpu_sysfs_get_policies(root);
+  if (policies == NULL) return NULL;
+  filename = g_build_filename(g_ptr_array_index(policies, 0),
+                              gpm_cpu_knobs[knob].file, NULL);
+  value = gpm_cpu_sysfs_read(filename);
+  g_free(filename);
+  g_ptr_array_unref(policies);
+  return value;
+}
+
+/**
+ * gpm_cpu_sysfs_is_available:
+ *
+ * Return value: %TRUE if @value is one of the words in @filename
+ **/
+static gboolean gpm_cpu_sysfs_is_available(const gchar *filename,
+                                           const gchar *value) {
+  gchar *contents;
+  gchar **words;
+  gboolean ret;
+
+  contents = gpm_cpu_sysfs_read(filename);
+  if (contents == NULL) return FALSE;
+  words = g_strsplit_set(contents, " \t\n", -1);
+  ret = g_strv_contains((const gchar *const *)words, value);
+  g_strfreev(words);
+  g_free(contents);
+  return ret;
+}
+
+/**
+ * gpm_cpu_sysfs_set:
+ * @root: %GPM_CPU_SYSFS_ROOT, or a copy of it
+ * @value: Something the CPUs say they can do, or "on" or "off" for boost
+ *
+ * Sets @knob on every policy. A value that a policy does not offer is
+ * refused before anything is written, as the kernel would only fail part
+ * way through.
+ *
+ * Return value: %TRUE for success
+ **/
+gboolean gpm_cpu_sysfs_set(const gchar *root, GpmCpuKnob knob,
+                           const gchar *value, GError **error) {
+  GPtrArray *policies;
+  gboolean inverted;
+  gboolean ret = FALSE;
+  gchar *filename;
+  guint i;
+
+  g_return_val_if_fail(root != NULL, FALSE);
+  g_return_val_if_fail(knob < GPM_CPU_KNOB_LAST, FALSE);
+  g_return_val_if_fail(value != NULL, FALSE);
+
+  if (knob == GPM_CPU_KNOB_BOOST) {
+    if (g_strcmp0(value, "on") != 0 && g_strcmp0(value, "off") != 0) {
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                  "boost can only be on or off, not %s", value);
+      return FALSE;
+    }
+    filename = gpm_cpu_sysfs_get_boost_file(root, &inverted);
+    if (filename == NULL) {
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
+                  "the CPUs cannot switch boost");
+      return FALSE;
+    }
+    inverted ^= g_strcmp0(value, "on") == 0;
+    ret = gpm_cpu_sysfs_write(filename, inverted ? "1" : "0", error);
+    g_free(filename);
+    return ret;
+  }
+
+  policies = gpm_cpu_sysfs_get_policies(root);
+  if (policies == NULL) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
+                "no cpufreq policies in %s", root);
+    return FALSE;
+  }
+
+  for (i = 0; i < policies->len; i++) {
+    filename = g_build_filename(g_ptr_array_index(policies, i),
+                                gpm_cpu_knobs[knob].available, NULL);
+    ret = gpm_cpu_sysfs_is_available(filename, value);
+    g_free(filename);
+    if (!ret) {
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                  "%s cannot have %s %s",
+                  (const gchar *)g_ptr_array_index(policies, i),
+                  gpm_cpu_knobs[knob].name, value);
+      goto out;
+    }
+  }
+  for (i = 0; i < policies->len; i++) {
+    filename = g_build_filename(g_ptr_array_index(policies, i),
+                                gpm_cpu_knobs[knob].file, NULL);
+    ret = gpm_cpu_sysfs_write(filename, value, error);
+    g_free(filename);
+    if (!ret) goto out;
+  }
+out:
+  g_ptr_array_unref(policies);
+  return ret;
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+/**
+ * gpm_cpu_sysfs_test_file:
+ **/
+static void gpm_cpu_sysfs_test_file(const gchar *root, const gchar *path,
+                                    const gchar *contents) {
+  gchar *filename;
+  gchar *dirname;
+
+  filename = g_build_filename(root, path, NULL);
+  dirname = g_path_get_dirname(filename);
+  g_mkdir_with_parents(dirname, 0755);
+  g_file_set_contents(filename, contents, -1, NULL);
+  g_free(dirname);
+  g_free(filename);
+}
+
+/**
+ * gpm_cpu_sysfs_test_remove:
+ **/
+static void gpm_cpu_sysfs_test_remove(const gchar *path) {
+  const gchar *name;
+  gchar *child;
+  GDir *dir;
+
+  dir = g_dir_open(path, 0, NULL);
+  if (dir != NULL) {
+    while ((name = g_dir_read_name(dir)) != NULL) {
+      child = g_build_filename(path, name, NULL);
+      gpm_cpu_sysfs_test_remove(child);
+      g_free(child);
+    }
+    g_dir_close(dir);
+    g_rmdir(path);
+  } else {
+    g_unlink(path);
+  }
+}
+
+/**
+ * gpm_cpu_sysfs_test_read:
+ **/
+static gchar *gpm_cpu_sysfs_test_read(const gchar *root, const gchar *path) {
+  gchar *filename;
+  gchar *value;
+
+  filename = g_build_filename(root, path, NULL);
+  value = gpm_cpu_sysfs_read(filename);
+  g_free(filename);
+  return value;
+}
+
+void gpm_cpu_sysfs_test(gpointer data) {
+  const gchar *policies[] = {"policy0", "policy4", NULL};
+  gchar *root;
+  gchar *path;
+  gchar *value;
+  gchar *other;
+  gboolean ret;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmCpuSysfs")) return;
+
+  /* a laptop with intel_pstate and two policies */
+  root = g_dir_make_tmp("gpm-cpu-sysfs-XXXXXX", NULL);
+  for (i = 0; policies[i] != NULL; i++) {
+    path = g_build_filename("cpufreq", policies[i], "scaling_governor", NULL);
+    gpm_cpu_sysfs_test_file(root, path, "powersave\n");
+    g_free(path);
+    path = g_build_filename("cpufreq", policies[i],
+                            "scaling_available_governors", NULL);
+    gpm_cpu_sysfs_test_file(root, path, "performance powersave\n");
+    g_free(path);
+    path = g_build_filename("cpufreq", policies[i],
+                            "energy_performance_preference", NULL);
+    gpm_cpu_sysfs_test_file(root, path, "balance_performance\n");
+    g_free(path);
+    path = g_build_filename("cpufreq", policies[i],
+                            "energy_performance_available_preferences", NULL);
+    gpm_cpu_sysfs_test_file(root, path,
+                            "default performance balance_performance "
+                            "balance_power power\n");
+    g_free(path);
+  }
+  gpm_cpu_sysfs_test_file(root, "intel_pstate/no_turbo", "0\n");
+
+  /************************************************************/
+  egg_test_title(test, "the governor is read from the first policy");
+  value = gpm_cpu_sysfs_get(root, GPM_CPU_KNOB_GOVERNOR);
+  egg_test_assert(test, g_strcmp0(value, "powersave") == 0);
+  g_free(value);
+
+  /************************************************************/
+  egg_test_title(test, "the preference is set on every policy");
+  ret = gpm_cpu_sysfs_set(root, GPM_CPU_KNOB_EPP, "power", NULL);
+  value = gpm_cpu_sysfs_test_read(
+      root, "cpufreq/policy0/energy_performance_preference");
+  other = gpm_cpu_sysfs_test_read(
+      root, "cpufreq/policy4/energy_performance_preference");
+  egg_test_assert(test, ret && g_strcmp0(value, "power") == 0 &&
+                            g_strcmp0(other, "power") == 0);
+  g_free(value);
+  g_free(other);
+
+  /************************************************************/
+  egg_test_title(test, "a value a policy does not offer is not written");
+  gpm_cpu_sysfs_test_file(root, "cpufreq/policy4/scaling_available_governors",
+                          "powersave\n");
+  ret = gpm_cpu_sysfs_set(root, GPM_CPU_KNOB_GOVERNOR, "performance", NULL);
+  value = gpm_cpu_sysfs_test_read(root, "cpufreq/policy0/scaling_governor");
+  egg_test_assert(test, !ret && g_strcmp0(value, "powersave") == 0);
+  g_free(value);
+
+  /************************************************************/
+  egg_test_title(test, "intel_pstate turns boost off with no_turbo");
+  ret = gpm_cpu_sysfs_set(root, GPM_CPU_KNOB_BOOST, "off", NULL);
+  value = gpm_cpu_sysfs_test_read(root, "intel_pstate/no_turbo");
+  other = gpm_cpu_sysfs_get(root, GPM_CPU_KNOB_BOOST);
+  egg_test_assert(test, ret && g_strcmp0(value, "1") == 0 &&
+                            g_strcmp0(other, "off") == 0);
+  g_free(value);
+  g_free(other);
+
+  /************************************************************/
+  egg_test_title(test, "other drivers turn boost on with cpufreq/boost");
+  path = g_build_filename(root, "intel_pstate", NULL);
+  gpm_cpu_sysfs_test_remove(path);
+  g_free(path);
+  gpm_cpu_sysfs_test_file(root, "cpufreq/boost", "0\n");
+  ret = gpm_cpu_sysfs_set(root, GPM_CPU_KNOB_BOOST, "on", NULL);
+  value = gpm_cpu_sysfs_test_read(root, "cpufreq/boost");
+  egg_test_assert(test, ret && g_strcmp0(value, "1") == 0);
+  g_free(value);
+
+  /************************************************************/
+  egg_test_title(test, "CPUs without cpufreq cannot be set");
+  path = g_build_filename(root, "cpufreq", NULL);
+  gpm_cpu_sysfs_test_remove(path);
+  g_free(path);
+  value = gpm_cpu_sysfs_get(root, GPM_CPU_KNOB_EPP);
+  ret = gpm_cpu_sysfs_set(root, GPM_CPU_KNOB_EPP, "power", NULL);
+  egg_test_assert(test, value == NULL && !ret);
+
+  gpm_cpu_sysfs_test_remove(root);
+  g_free(root);
+
+  egg_test_end(test);
+}
+
+#endif
@@ -0,0 +1,49 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_CPU_SYSFS_H
+#define __GPM_CPU_SYSFS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* the tests and mate-power-cpu-helper --root use a copy of this */
+#define GPM_CPU_SYSFS_ROOT "/sys/devices/system/cpu"
+
+typedef enum {
+  GPM_CPU_KNOB_GOVERNOR, /* scaling_governor of every policy */
+  GPM_CPU_KNOB_EPP,      /* energy_performance_preference of every policy */
+  GPM_CPU_KNOB_BOOST,    /* "on" or "off", for intel_pstate or cpufreq */
+  GPM_CPU_KNOB_LAST
+} GpmCpuKnob;
+
+const gchar *gpm_cpu_knob_to_string(GpmCpuKnob knob);
+gchar *gpm_cpu_sysfs_get(const gchar *root, GpmCpuKnob knob);
+gboolean gpm_cpu_sysfs_set(const gchar *root, GpmCpuKnob knob,
+                           const gchar *value, GError **error);
+#ifdef EGG_TEST
+void gpm_cpu_sysfs_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_CPU_SYSFS_H */
@@ -0,0 +1,299 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "gpm-dim-learner.h"
+
+/* a dim the user undoes quicker than this was not wanted */
+#define GPM_DIM_LEARNER_FALSE_DIM 5 /* s */
+/* the counts are halved this often, so old behaviour is forgotten */
+#define GPM_DIM_LEARNER_HALF_LIFE 600 /* s */
+/* the timeout is doubled at most this many times */
+#define GPM_DIM_LEARNER_MAX_LEVEL 3
+/* and never made longer than this on top of what the user asked for */
+#define GPM_DIM_LEARNER_MAX_EXTRA 300 /* s */
+
+/* upper edges of all but the last bucket, in seconds */
+static const guint gpm_dim_learner_edges[GPM_DIM_LEARNER_BUCKETS - 1] = {
+    2, GPM_DIM_LEARNER_FALSE_DIM, 10, 30, 60};
+
+struct GpmDimLearner {
+  guint counts[GPM_DIM_LEARNER_BUCKETS];
+  gint64 decay_time; /* when the counts were last halved, in us */
+  gint64 dim_time;   /* when the current dim started, or 0 */
+  guint avoided;
+};
+
+/**
+ * gpm_dim_learner_decay:
+ *
+ * Halves the counts once for every half-life since the last time.
+ **/
+static void gpm_dim_learner_decay(GpmDimLearner *learner, gint64 time) {
+  const gint64 half_life = (gint64)GPM_DIM_LEARNER_HALF_LIFE * G_USEC_PER_SEC;
+  guint halvings = 0;
+  guint i;
+
+  if (learner->decay_time == 0 || time < learner->decay_time) {
+    learner->decay_time = time;
+    return;
+  }
+  while (time - learner->decay_time >= half_life && halvings < 32) {
+    learner->decay_time += half_life;
+    halvings++;
+  }
+  if (halvings == 32) learner->decay_time = time;
+  for (i = 0; i < GPM_DIM_LEARNER_BUCKETS && halvings > 0; i++)
+    learner->counts[i] = halvings < 32 ? learner->counts[i] >> halvings : 0;
+}
+
+/**
+ * gpm_dim_learner_get_level:
+ *
+ * Return value: how many times to double the timeout, which is how many
+ * more dims were undone straight away than were not
+ **/
+static guint gpm_dim_learner_get_level(GpmDimLearner *learner) {
+  gint level = 0;
+  guint i;
+
+  for (i = 0; i < GPM_DIM_LEARNER_BUCKETS; i++) {
+    if (i < GPM_DIM_LEARNER_BUCKETS - 1 &&
+        gpm_dim_learner_edges[i] <= GPM_DIM_LEARNER_FALSE_DIM)
+      level += learner->counts[i];
+    else
+      level -= learner->counts[i];
+  }
+  return CLAMP(level, 0, GPM_DIM_LEARNER_MAX_LEVEL);
+}
+
+/**
+ * gpm_dim_learner_add:
+ **/
+static void gpm_dim_learner_add(GpmDimLearner *learner, gint64 time,
+                                guint bucket) {
+  gpm_dim_learner_decay(learner, time);
+  if (learner->counts[bucket] < G_MAXUINT) learner->counts[bucket]++;
+  learner->dim_time = 0;
+}
+
+/**
+ * gpm_dim_learner_new:
+ *
+ * Return value: a learner that has seen nothing, free with
+ * gpm_dim_learner_free()
+ **/
+GpmDimLearner *gpm_dim_learner_new(void) { return g_new0(GpmDimLearner, 1); }
+
+/**
+ * gpm_dim_learner_free:
+ **/
+void gpm_dim_learner_free(GpmDimLearner *learner) { g_free(learner); }
+
+/**
+ * gpm_dim_learner_dimmed:
+ * @time: the monotonic time in us
+ **/
+void gpm_dim_learner_dimmed(GpmDimLearner *learner, gint64 time) {
+  g_return_if_fail(learner != NULL);
+  learner->dim_time = MAX(time, 1);
+}
+
+/**
+ * gpm_dim_learner_undimmed:
+ * @time: the monotonic time in us
+ *
+ * The user came back while the screen was dimmed.
+ *
+ * Return value: %TRUE if the dim was undone so quickly it was not wanted
+ **/
+gboolean gpm_dim_learner_undimmed(GpmDimLearner *learner, gint64 time) {
+  gint64 elapsed;
+  guint i;
+
+  g_return_val_if_fail(learner != NULL, FALSE);
+
+  if (learner->dim_time == 0) return FALSE;
+  elapsed = MAX(time - learner->dim_time, 0) / G_USEC_PER_SEC;
+  for (i = 0; i < GPM_DIM_LEARNER_BUCKETS - 1; i++)
+    if (elapsed < gpm_dim_learner_edges[i]) break;
+  gpm_dim_learner_add(learner, time, i);
+  return elapsed < GPM_DIM_LEARNER_FALSE_DIM;
+}
+
+/**
+ * gpm_dim_learner_settled:
+ * @time: the monotonic time in us
+ *
+ * The dim went on to blank or sleep, so it was the right thing to do.
+ **/
+void gpm_dim_learner_settled(GpmDimLearner *learner, gint64 time) {
+  g_return_if_fail(learner != NULL);
+  if (learner->dim_time == 0) return;
+  gpm_dim_learner_add(learner, time, GPM_DIM_LEARNER_BUCKETS - 1);
+}
+
+/**
+ * gpm_dim_learner_get_timeout:
+ * @time: the monotonic time in us
+ * @timeout: the dim timeout the user asked for, in seconds
+ *
+ * Return value: the timeout to use for the next dim, in seconds
+ **/
+guint gpm_dim_learner_get_timeout(GpmDimLearner *learner, gint64 time,
+                                  guint timeout) {
+  guint64 extra;
+
+  g_return_val_if_fail(learner != NULL, timeout);
+
+  gpm_dim_learner_decay(learner, time);
+  extra = (guint64)timeout * ((1u << gpm_dim_learner_get_level(learner)) - 1);
+  extra = MIN(extra, GPM_DIM_LEARNER_MAX_EXTRA);
+  return MIN((guint64)timeout + extra, G_MAXUINT);
+}
+
+/**
+ * gpm_dim_learner_add_avoided:
+ *
+ * The user came back after the timeout they asked for but before the
+ * longer one, so a fade down and back up was saved.
+ **/
+void gpm_dim_learner_add_avoided(GpmDimLearner *learner) {
+  g_return_if_fail(learner != NULL);
+  learner->avoided++;
+}
+
+/**
+ * gpm_dim_learner_get_avoided:
+ **/
+guint gpm_dim_learner_get_avoided(GpmDimLearner *learner) {
+  g_return_val_if_fail(learner != NULL, 0);
+  return learner->avoided;
+}
+
+/**
+ * gpm_dim_learner_get_histogram:
+ * @time: the monotonic time in us
+ * @counts: %GPM_DIM_LEARNER_BUCKETS counts to fill in
+ **/
+void gpm_dim_learner_get_histogram(GpmDimLearner *learner, gint64 time,
+                                   guint *counts) {
+  guint i;
+
+  g_return_if_fail(learner != NULL);
+  gpm_dim_learner_decay(learner, time);
+  for (i = 0; i < GPM_DIM_LEARNER_BUCKETS; i++) counts[i] = learner->counts[i];
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+#define S ((gint64)G_USEC_PER_SEC)
+
+void gpm_dim_learner_test(gpointer data) {
+  GpmDimLearner *learner;
+  guint counts[GPM_DIM_LEARNER_BUCKETS];
+  gint64 now = 1000 * S;
+  gboolean ret;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmDimLearner")) return;
+
+  learner = gpm_dim_learner_new();
+
+  /************************************************************/
+  egg_test_title(test, "nothing seen keeps the timeout");
+  egg_test_assert(test, gpm_dim_learner_get_timeout(learner, now, 30) == 30);
+
+  /************************************************************/
+  egg_test_title(test, "a quick undim is a false dim");
+  gpm_dim_learner_dimmed(learner, now);
+  now += 3 * S;
+  ret = gpm_dim_learner_undimmed(learner, now);
+  gpm_dim_learner_get_histogram(learner, now, counts);
+  egg_test_assert(test, ret && counts[1] == 1);
+
+  /************************************************************/
+  egg_test_title(test, "a false dim doubles the next timeout");
+  egg_test_assert(test, gpm_dim_learner_get_timeout(learner, now, 30) == 60);
+
+  /************************************************************/
+  egg_test_title(test, "an undim without a dim is ignored");
+  egg_test_assert(test, !gpm_dim_learner_undimmed(learner, now + S) &&
+                            gpm_dim_learner_get_timeout(learner, now, 30) ==
+                                60);
+
+  /************************************************************/
+  egg_test_title(test, "the extension is bounded");
+  for (i = 0; i < 10; i++) {
+    now += 60 * S;
+    gpm_dim_learner_dimmed(learner, now);
+    gpm_dim_learner_undimmed(learner, now + S);
+  }
+  egg_test_assert(test, gpm_dim_learner_get_timeout(learner, now, 30) == 240 &&
+                            gpm_dim_learner_get_timeout(learner, now, 600) ==
+                                600 + 300);
+
+  /************************************************************/
+  egg_test_title(test, "wanted dims shrink the extension");
+  for (i = 0; i < 4; i++) {
+    gpm_dim_learner_dimmed(learner, now);
+    now += 40 * S;
+    gpm_dim_learner_settled(learner, now);
+  }
+  egg_test_assert(test, gpm_dim_learner_get_timeout(learner, now, 30) == 60);
+
+  /************************************************************/
+  egg_test_title(test, "old dims are forgotten");
+  now += 2 * GPM_DIM_LEARNER_HALF_LIFE * S;
+  gpm_dim_learner_get_histogram(learner, now, counts);
+  egg_test_assert(test, gpm_dim_learner_get_timeout(learner, now, 30) == 30 &&
+                            counts[0] == 1 &&
+                            counts[GPM_DIM_LEARNER_BUCKETS - 1] == 1);
+
+  /************************************************************/
+  egg_test_title(test, "a long gap clears everything");
+  now += 100 * GPM_DIM_LEARNER_HALF_LIFE * S;
+  gpm_dim_learner_get_histogram(learner, now, counts);
+  for (i = 0; i < GPM_DIM_LEARNER_BUCKETS; i++)
+    if (counts[i] != 0) break;
+  egg_test_assert(test, i == GPM_DIM_LEARNER_BUCKETS);
+
+  /************************************************************/
+  egg_test_title(test, "avoided fades are counted");
+  gpm_dim_learner_add_avoided(learner);
+  gpm_dim_learner_add_avoided(learner);
+  egg_test_assert(test, gpm_dim_learner_get_avoided(learner) == 2);
+
+  gpm_dim_learner_free(learner);
+  egg_test_end(test);
+}
+
+#endif
@@ -0,0 +1,52 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_DIM_LEARNER_H
+#define __GPM_DIM_LEARNER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* buckets of how long a dim lasted before the user came back, the last
+ * one also holds the dims that went on to blank */
+#define GPM_DIM_LEARNER_BUCKETS 6
+
+typedef struct GpmDimLearner GpmDimLearner;
+
+GpmDimLearner *gpm_dim_learner_new(void);
+void gpm_dim_learner_free(GpmDimLearner *learner);
+void gpm_dim_learner_dimmed(GpmDimLearner *learner, gint64 time);
+gboolean gpm_dim_learner_undimmed(GpmDimLearner *learner, gint64 time);
+void gpm_dim_learner_settled(GpmDimLearner *learner, gint64 time);
+guint gpm_dim_learner_get_timeout(GpmDimLearner *learner, gint64 time,
+                                  guint timeout);
+void gpm_dim_learner_add_avoided(GpmDimLearner *learner);
+guint gpm_dim_learner_get_avoided(GpmDimLearner *learner);
+void gpm_dim_learner_get_histogram(GpmDimLearner *learner, gint64 time,
+                                   guint *counts);
+#ifdef EGG_TEST
+void gpm_dim_learner_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_DIM_LEARNER_H */
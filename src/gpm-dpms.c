@@ -44,6 +44,7 @@
 #include <X11/extensions/dpms.h>
 
 #include "gpm-dpms.h"
+#include "gpm-trace.h"
 
 static void gpm_dpms_finalize(GObject *object);
 
@@ -55,6 +56,7 @@ struct GpmDpmsPrivate {
   GpmDpmsMode mode;
   guint timer_id;
   Display *display;
+  GpmTrace *trace;
 };
 
 enum { MODE_CHANGED, LAST_SIGNAL };
@@ -62,6 +64,10 @@ enum { MODE_CHANGED, LAST_SIGNAL };
 static guint signals[LAST_SIGNAL] = {0};
 static gpointer gpm_dpms_object = NULL;
 
+/* for the replay decisions, in the order of GpmDpmsMode */
+static const gchar *gpm_dpms_mode_names[] = {"on", "standby", "suspend",
+                                             "off"};
+
 G_DEFINE_TYPE_WITH_PRIVATE(GpmDpms, gpm_dpms, G_TYPE_OBJECT)
 
 /**
@@ -194,6 +200,16 @@ gboolean gpm_dpms_set_mode(GpmDpms *dpms, GpmDpmsMode mode, GError **error) {
     return FALSE;
   }
 
+  /* a replay must not touch the real display, so pretend it changed */
+  if (gpm_trace_is_replaying(dpms->priv->trace)) {
+    if (mode == dpms->priv->mode) return TRUE;
+    gpm_trace_decision(dpms->priv->trace, "dpms %s",
+                       gpm_dpms_mode_names[mode]);
+    dpms->priv->mode = mode;
+    g_signal_emit(dpms, signals[MODE_CHANGED], 0, mode);
+    return TRUE;
+  }
+
   ret = gpm_dpms_x11_set_mode(dpms, mode, error);
   return ret;
 }
@@ -204,6 +220,10 @@ gboolean gpm_dpms_set_mode(GpmDpms *dpms, GpmDpmsMode mode, GError **error) {
 gboolean gpm_dpms_get_mode(GpmDpms *dpms, GpmDpmsMode *mode, GError **error) {
   gboolean ret;
   if (mode) *mode = GPM_DPMS_MODE_UNKNOWN;
+  if (gpm_trace_is_replaying(dpms->priv->trace)) {
+    if (mode) *mode = dpms->priv->mode;
+    return TRUE;
+  }
   ret = gpm_dpms_x11_get_mode(dpms, mode, error);
   return ret;
 }
@@ -273,6 +293,14 @@ static void gpm_dpms_init(GpmDpms *dpms) {
   /* DPMSCapable() can never change for a given display */
   dpms->priv->display = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
   dpms->priv->dpms_capable = DPMSCapable(dpms->priv->display);
+
+  /* a replay starts with the display on, and never looks at the real one */
+  dpms->priv->trace = gpm_trace_new();
+  if (gpm_trace_is_replaying(dpms->priv->trace)) {
+    dpms->priv->mode = GPM_DPMS_MODE_ON;
+    return;
+  }
+
   dpms->priv->timer_id = g_timeout_add_seconds(
       GPM_DPMS_POLL_TIME, (GSourceFunc)gpm_dpms_poll_mode_cb, dpms);
   g_source_set_name_by_id(dpms->priv->timer_id, "[GpmDpms] poll");
@@ -299,6 +327,7 @@ static void gpm_dpms_finalize(GObject *object) {
     g_source_remove(dpms->priv->timer_id);
     dpms->priv->timer_id = 0;
   }
+  g_object_unref(dpms->priv->trace);
 
   G_OBJECT_CLASS(gpm_dpms_parent_class)->finalize(object);
 }
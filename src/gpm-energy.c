@@ -0,0 +1,333 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <math.h>
+
+#include "gpm-energy.h"
+
+/* a longer gap than this is the machine being asleep or off, and is not
+ * counted as using anything */
+#define GPM_ENERGY_MAX_GAP (30 * 60)
+
+typedef struct {
+  guint32 time;
+  gdouble rate;  /* W */
+  gdouble total; /* Wh used from the first sample to this one */
+} GpmEnergySample;
+
+struct GpmEnergy {
+  GArray *samples;
+  guint head; /* samples before this have been forgotten */
+};
+
+/**
+ * gpm_energy_get_segment:
+ * @time: somewhere between @a and @b
+ *
+ * Return value: the Wh used between @a and @time, assuming the rate changes
+ * linearly between the samples
+ **/
+static gdouble gpm_energy_get_segment(const GpmEnergySample *a,
+                                      const GpmEnergySample *b, guint32 time) {
+  gdouble rate;
+  guint32 span = b->time - a->time;
+
+  if (span == 0 || span > GPM_ENERGY_MAX_GAP || time <= a->time) return 0.0f;
+  if (time >= b->time) return (a->rate + b->rate) / 2.0f * span / 3600.0f;
+  rate = a->rate + (b->rate - a->rate) * (time - a->time) / span;
+  return (a->rate + rate) / 2.0f * (time - a->time) / 3600.0f;
+}
+
+/**
+ * gpm_energy_new:
+ *
+ * Return value: an empty integrator, free with gpm_energy_free()
+ **/
+GpmEnergy *gpm_energy_new(void) {
+  GpmEnergy *energy;
+  energy = g_new0(GpmEnergy, 1);
+  energy->samples = g_array_new(FALSE, FALSE, sizeof(GpmEnergySample));
+  return energy;
+}
+
+/**
+ * gpm_energy_free:
+ **/
+void gpm_energy_free(GpmEnergy *energy) {
+  if (energy == NULL) return;
+  g_array_unref(energy->samples);
+  g_free(energy);
+}
+
+/**
+ * gpm_energy_add:
+ * @energy: a #GpmEnergy
+ * @time: the time of the sample, which must not be before the last
+ * @rate: the power being used in W, or zero when not on battery
+ *
+ * A second sample at the same time replaces the rate of the first.
+ *
+ * Return value: %FALSE if @time is before the last sample
+ **/
+gboolean gpm_energy_add(GpmEnergy *energy, guint32 time, gdouble rate) {
+  GpmEnergySample *last = NULL;
+  GpmEnergySample sample;
+  guint len;
+
+  g_return_val_if_fail(energy != NULL, FALSE);
+
+  len = energy->samples->len;
+  if (len > energy->head)
+    last = &g_array_index(energy->samples, GpmEnergySample, len - 1);
+  if (last != NULL && time < last->time) return FALSE;
+
+  /* UPower can notify more than once a second */
+  if (last != NULL && time == last->time) {
+    last->rate = rate;
+    if (len - 1 > energy->head) {
+      sample = g_array_index(energy->samples, GpmEnergySample, len - 2);
+      last->total = sample.total + gpm_energy_get_segment(&sample, last, time);
+    }
+    return TRUE;
+  }
+
+  sample.time = time;
+  sample.rate = rate;
+  sample.total = 0.0f;
+  if (last != NULL)
+    sample.total = last->total + gpm_energy_get_segment(last, &sample, time);
+  g_array_append_val(energy->samples, sample);
+  return TRUE;
+}
+
+/**
+ * gpm_energy_find:
+ *
+ * Return value: the index of the last sample at or before @time, or the
+ * head if there is none
+ **/
+static guint gpm_energy_find(GpmEnergy *energy, guint32 time) {
+  guint lo = energy->head;
+  guint hi = energy->samples->len;
+  guint mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (g_array_index(energy->samples, GpmEnergySample, mid).time <= time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo > energy->head ? lo - 1 : energy->head;
+}
+
+/**
+ * gpm_energy_forget:
+ * @energy: a #GpmEnergy
+ * @time: the oldest time that will still be asked about
+ *
+ * Drops the samples that are no longer needed, keeping the memory used
+ * bounded when the daemon runs for weeks. The total is not changed.
+ **/
+void gpm_energy_forget(GpmEnergy *energy, guint32 time) {
+  g_return_if_fail(energy != NULL);
+
+  /* keep the sample before @time so it can still be interpolated */
+  energy->head = gpm_energy_find(energy, time);
+
+  /* only move the samples down when most of the array is unused */
+  if (energy->head * 2 >= energy->samples->len && energy->head > 64) {
+    g_array_remove_range(energy->samples, 0, energy->head);
+    energy->head = 0;
+  }
+}
+
+/**
+ * gpm_energy_get_length:
+ **/
+guint gpm_energy_get_length(GpmEnergy *energy) {
+  g_return_val_if_fail(energy != NULL, 0);
+  return energy->samples->len - energy->head;
+}
+
+/**
+ * gpm_energy_get_total:
+ *
+ * Return value: the Wh used since the first sample, even if forgotten
+ **/
+gdouble gpm_energy_get_total(GpmEnergy *energy) {
+  g_return_val_if_fail(energy != NULL, 0.0f);
+  if (energy->samples->len == energy->head) return 0.0f;
+  return g_array_index(energy->samples, GpmEnergySample,
+                       energy->samples->len - 1)
+      .total;
+}
+
+/**
+ * gpm_energy_get_total_at:
+ *
+ * Return value: the Wh used from the first sample up to @time
+ **/
+static gdouble gpm_energy_get_total_at(GpmEnergy *energy, guint32 time) {
+  const GpmEnergySample *a;
+  const GpmEnergySample *b;
+  guint i;
+
+  i = gpm_energy_find(energy, time);
+  a = &g_array_index(energy->samples, GpmEnergySample, i);
+  if (i + 1 == energy->samples->len) return a->total;
+  b = &g_array_index(energy->samples, GpmEnergySample, i + 1);
+  return a->total + gpm_energy_get_segment(a, b, time);
+}
+
+/**
+ * gpm_energy_get_used:
+ * @energy: a #GpmEnergy
+ * @start: the start of the range
+ * @stop: the end of the range
+ *
+ * Works out the energy used between two times in O(log n), however many
+ * samples there are between them.
+ *
+ * Return value: the Wh used, or zero if nothing is known
+ **/
+gdouble gpm_energy_get_used(GpmEnergy *energy, guint32 start, guint32 stop) {
+  g_return_val_if_fail(energy != NULL, 0.0f);
+
+  if (energy->samples->len == energy->head || stop <= start) return 0.0f;
+  return gpm_energy_get_total_at(energy, stop) -
+         gpm_energy_get_total_at(energy, start);
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+void gpm_energy_test(gpointer data) {
+  GpmEnergy *energy;
+  gdouble value;
+  gboolean ret;
+  guint elapsed;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmEnergy")) return;
+
+  /************************************************************/
+  egg_test_title(test, "nothing used when empty");
+  energy = gpm_energy_new();
+  egg_test_assert(test, gpm_energy_get_used(energy, 0, 1000) == 0.0f &&
+                            gpm_energy_get_total(energy) == 0.0f);
+
+  /************************************************************/
+  egg_test_title(test, "constant rate for an hour");
+  gpm_energy_add(energy, 1000, 10.0f);
+  gpm_energy_add(energy, 1000 + 1800, 10.0f);
+  gpm_energy_add(energy, 1000 + 3600, 10.0f);
+  value = gpm_energy_get_total(energy);
+  if (fabs(value - 10.0f) < 0.001f)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %f Wh", value);
+
+  /************************************************************/
+  egg_test_title(test, "part of a segment");
+  value = gpm_energy_get_used(energy, 1000 + 900, 1000 + 2700);
+  if (fabs(value - 5.0f) < 0.001f)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %f Wh", value);
+
+  /************************************************************/
+  egg_test_title(test, "range past either end");
+  value = gpm_energy_get_used(energy, 0, G_MAXUINT32);
+  egg_test_assert(test, fabs(value - 10.0f) < 0.001f);
+
+  /************************************************************/
+  egg_test_title(test, "refuse a sample from the past");
+  ret = gpm_energy_add(energy, 1000, 5.0f);
+  egg_test_assert(test, !ret && gpm_energy_get_length(energy) == 3);
+
+  /************************************************************/
+  egg_test_title(test, "a long gap is not counted");
+  gpm_energy_add(energy, 1000 + 3600 + 7200, 10.0f);
+  value = gpm_energy_get_total(energy);
+  egg_test_assert(test, fabs(value - 10.0f) < 0.001f);
+
+  /************************************************************/
+  egg_test_title(test, "a rising rate is a trapezoid");
+  gpm_energy_add(energy, 1000 + 3600 + 7200 + 1800, 20.0f);
+  value = gpm_energy_get_total(energy);
+  if (fabs(value - 17.5f) < 0.001f)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %f Wh", value);
+
+  /************************************************************/
+  egg_test_title(test, "a second sample at the same time replaces it");
+  gpm_energy_add(energy, 1000 + 3600 + 7200 + 1800, 10.0f);
+  value = gpm_energy_get_total(energy);
+  egg_test_assert(test, fabs(value - 15.0f) < 0.001f &&
+                            gpm_energy_get_length(energy) == 5);
+  gpm_energy_free(energy);
+
+  /************************************************************/
+  egg_test_title(test, "forgetting keeps the total");
+  energy = gpm_energy_new();
+  for (i = 0; i <= 1000; i++) gpm_energy_add(energy, i * 36, 10.0f);
+  gpm_energy_forget(energy, 900 * 36 + 10);
+  value = gpm_energy_get_used(energy, 950 * 36, 1000 * 36);
+  if (gpm_energy_get_length(energy) == 101 &&
+      fabs(gpm_energy_get_total(energy) - 100.0f) < 0.001f &&
+      fabs(value - 5.0f) < 0.001f)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "length %i, got %f Wh",
+                    gpm_energy_get_length(energy), value);
+  gpm_energy_free(energy);
+
+  /************************************************************/
+  egg_test_title(test, "query a week of samples 100000 times");
+  energy = gpm_energy_new();
+  for (i = 0; i < 7 * 24 * 120; i++)
+    gpm_energy_add(energy, i * 30 + i % 3, 8.0f + (i % 7) / 10.0f);
+  value = 0.0f;
+  for (i = 0; i < 100000; i++)
+    value += gpm_energy_get_used(energy, (i * 7919) % (7 * 86400),
+                                 (i * 7919) % (7 * 86400) + 86400);
+  elapsed = egg_test_elapsed(test);
+  if (value > 0.0f)
+    egg_test_success(test, "%ims", elapsed);
+  else
+    egg_test_failed(test, "no energy used in %ims", elapsed);
+  gpm_energy_free(energy);
+
+  egg_test_end(test);
+}
+
+#endif
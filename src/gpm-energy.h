@@ -0,0 +1,44 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_ENERGY_H
+#define __GPM_ENERGY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct GpmEnergy GpmEnergy;
+
+GpmEnergy *gpm_energy_new(void);
+void gpm_energy_free(GpmEnergy *energy);
+gboolean gpm_energy_add(GpmEnergy *energy, guint32 time, gdouble rate);
+void gpm_energy_forget(GpmEnergy *energy, guint32 time);
+guint gpm_energy_get_length(GpmEnergy *energy);
+gdouble gpm_energy_get_total(GpmEnergy *energy);
+gdouble gpm_energy_get_used(GpmEnergy *energy, guint32 start, guint32 stop);
+#ifdef EGG_TEST
+void gpm_energy_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_ENERGY_H */
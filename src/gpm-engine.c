@@ -26,21 +26,32 @@
 
 #include "gpm-engine.h"
 
+#include <gio/gio.h>
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <libupower-glib/upower.h>
+#include <math.h>
 #include <string.h>
 
+#include "gpm-broker-page.h"
 #include "gpm-common.h"
+#include "gpm-energy.h"
+#include "gpm-estimator.h"
 #include "gpm-icon-names.h"
 #include "gpm-marshal.h"
 #include "gpm-phone.h"
+#include "gpm-trace.h"
 #include "gpm-upower.h"
 
 static void gpm_engine_finalize(GObject *object);
 
 #define GPM_ENGINE_RESUME_DELAY 2 * 1000
 #define GPM_ENGINE_WARN_ACCURACY 20
+/* only today and yesterday are asked about, the session total is kept */
+#define GPM_ENGINE_ENERGY_KEEP (2 * 24 * 60 * 60)
+/* the warning timer is only moved if the crossing moves by more than this,
+ * or by more than a twentieth of the time left until it */
+#define GPM_ENGINE_ESTIMATOR_SLACK 30
 
 struct GpmEnginePrivate {
   GSettings *settings;
@@ -54,6 +65,22 @@ struct GpmEnginePrivate {
 
   gboolean use_time_primary;
   gboolean time_is_accurate;
+  gboolean show_energy_used;
+
+  GpmEnergy *energy;
+  GpmEstimator *estimator;
+  UpDeviceLevel estimator_level;
+  guint estimator_idle_id;
+  guint estimator_timer_id;
+  guint32 estimator_timer_due;
+
+  GpmTrace *trace;
+  GHashTable *trace_devices; /* object path to replayed UpDevice */
+
+  const GpmBrokerPage *broker_page;
+  GpmBrokerPage *broker_snapshot;
+  GFileMonitor *broker_monitor;
+  GHashTable *broker_devices; /* object path to brokered UpDevice */
 
   guint low_percentage;
   guint critical_percentage;
@@ -87,6 +114,9 @@ static UpDevice *gpm_engine_update_composite_device(GpmEngine *engine,
                                                     UpDevice *original_device);
 static void gpm_engine_device_changed_cb(UpDevice *device, GParamSpec *pspec,
                                          GpmEngine *engine);
+static void gpm_engine_check_warning(GpmEngine *engine, UpDevice *device);
+static void gpm_engine_estimator_schedule(GpmEngine *engine);
+static void gpm_engine_broker_sync(GpmEngine *engine);
 
 #define GPM_ENGINE_WARNING_NONE UP_DEVICE_LEVEL_NONE
 #define GPM_ENGINE_WARNING_DISCHARGING UP_DEVICE_LEVEL_DISCHARGING
@@ -105,10 +135,202 @@ static void gpm_engine_device_changed_cb(UpDevice *device, GParamSpec *pspec,
 static UpDeviceLevel gpm_engine_get_warning(GpmEngine *engine,
                                             UpDevice *device) {
   UpDeviceLevel warning;
-  g_object_get(device, "warning-level", &warning, NULL);
+  UpDeviceState state;
+
+  g_object_get(device, "warning-level", &warning, "state", &state, NULL);
+
+  /* the estimator can bring the warnings forward for the laptop battery */
+  if (device == engine->priv->battery_composite &&
+      state == UP_DEVICE_STATE_DISCHARGING &&
+      engine->priv->estimator_level > warning)
+    warning = engine->priv->estimator_level;
   return warning;
 }
 
+/**
+ * gpm_engine_estimator_get_threshold:
+ *
+ * Return value: the energy in Wh at which @level starts
+ **/
+static gdouble gpm_engine_estimator_get_threshold(GpmEngine *engine,
+                                                  UpDeviceLevel level,
+                                                  gdouble energy_full) {
+  gdouble rate;
+
+  /* the time left drops below the policy when the energy drops below the
+   * policy time at the current rate */
+  if (engine->priv->use_time_primary) {
+    rate = gpm_estimator_get_rate(engine->priv->estimator);
+    if (level == GPM_ENGINE_WARNING_LOW)
+      return rate * engine->priv->low_time / 3600.0f;
+    return rate * engine->priv->critical_time / 3600.0f;
+  }
+  if (level == GPM_ENGINE_WARNING_LOW)
+    return energy_full * engine->priv->low_percentage / 100.0f;
+  return energy_full * engine->priv->critical_percentage / 100.0f;
+}
+
+/**
+ * gpm_engine_estimator_get_level:
+ * @next: the returned number of seconds until the next level is reached,
+ * or 0 if there is nothing to wait for
+ *
+ * The action level is irreversible, so that is always left to UPower.
+ *
+ * Return value: the level the battery is predicted to be at @time
+ **/
+static UpDeviceLevel gpm_engine_estimator_get_level(GpmEngine *engine,
+                                                    guint32 time,
+                                                    guint *next) {
+  const UpDeviceLevel levels[] = {GPM_ENGINE_WARNING_LOW,
+                                  GPM_ENGINE_WARNING_CRITICAL};
+  UpDeviceLevel level = GPM_ENGINE_WARNING_NONE;
+  gdouble energy_full;
+  gdouble threshold;
+  gdouble energy;
+  gdouble seconds;
+  guint i;
+
+  *next = 0;
+  if (!gpm_estimator_get_energy(engine->priv->estimator, time, &energy))
+    return GPM_ENGINE_WARNING_NONE;
+
+  g_object_get(engine->priv->battery_composite, "energy-full", &energy_full,
+               NULL);
+  for (i = 0; i < G_N_ELEMENTS(levels); i++) {
+    threshold =
+        gpm_engine_estimator_get_threshold(engine, levels[i], energy_full);
+    if (energy <= threshold) {
+      level = levels[i];
+      continue;
+    }
+    if (gpm_estimator_get_time_until(engine->priv->estimator, time, threshold,
+                                     &seconds, NULL, NULL))
+      *next = MAX(ceil(seconds), 1);
+    break;
+  }
+  return level;
+}
+
+/**
+ * gpm_engine_estimator_timer_cb:
+ **/
+static gboolean gpm_engine_estimator_timer_cb(GpmEngine *engine) {
+  engine->priv->estimator_timer_id = 0;
+  gpm_engine_estimator_schedule(engine);
+  gpm_engine_check_warning(engine, engine->priv->battery_composite);
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gpm_engine_estimator_schedule_at:
+ * @now: the wall clock time in seconds
+ *
+ * Works out the level the battery is at @now, and arms a single timer for
+ * when the next one will be crossed rather than waiting for UPower to
+ * notice, which can be some time after the fact.
+ **/
+static void gpm_engine_estimator_schedule_at(GpmEngine *engine, guint32 now) {
+  GpmEnginePrivate *priv = engine->priv;
+  gdouble runtime;
+  gdouble lower;
+  gdouble upper;
+  guint32 due;
+  guint slack;
+  guint next;
+
+  priv->estimator_level = gpm_engine_estimator_get_level(engine, now, &next);
+  if (gpm_estimator_get_runtime(priv->estimator, now, &runtime, &lower,
+                                &upper))
+    g_debug("estimated runtime %.0fs (%.0f-%.0f), next level in %is", runtime,
+            lower, upper, next);
+
+  if (next == 0) {
+    if (priv->estimator_timer_id != 0) {
+      g_source_remove(priv->estimator_timer_id);
+      priv->estimator_timer_id = 0;
+    }
+    return;
+  }
+
+  /* not worth moving the timer for every bit of noise */
+  due = now + next;
+  slack = MAX(GPM_ENGINE_ESTIMATOR_SLACK, next / 20);
+  if (priv->estimator_timer_id != 0) {
+    if (due + slack >= priv->estimator_timer_due &&
+        due <= priv->estimator_timer_due + slack)
+      return;
+    g_source_remove(priv->estimator_timer_id);
+  }
+  priv->estimator_timer_due = due;
+  priv->estimator_timer_id = gpm_trace_timeout_add_seconds(
+      priv->trace, next, (GSourceFunc)gpm_engine_estimator_timer_cb, engine);
+  g_source_set_name_by_id(priv->estimator_timer_id,
+                          "[GpmEngine] warning level");
+}
+
+/**
+ * gpm_engine_estimator_schedule:
+ **/
+static void gpm_engine_estimator_schedule(GpmEngine *engine) {
+  gpm_engine_estimator_schedule_at(
+      engine, gpm_trace_get_real_time(engine->priv->trace) / G_USEC_PER_SEC);
+}
+
+/**
+ * gpm_engine_estimator_idle_cb:
+ *
+ * UPower notifies each property separately, so the estimator is fed once
+ * they have all arrived.
+ **/
+static gboolean gpm_engine_estimator_idle_cb(GpmEngine *engine) {
+  GpmEnginePrivate *priv = engine->priv;
+  UpDeviceState state;
+  gdouble energy;
+  gdouble rate;
+
+  priv->estimator_idle_id = 0;
+  g_object_get(priv->battery_composite, "state", &state, "energy", &energy,
+               "energy-rate", &rate, NULL);
+  if (state != UP_DEVICE_STATE_DISCHARGING)
+    gpm_estimator_reset(priv->estimator);
+  else if (!gpm_estimator_add(
+               priv->estimator,
+               gpm_trace_get_real_time(priv->trace) / G_USEC_PER_SEC, energy,
+               rate))
+    g_debug("clock went backwards, ignoring energy");
+  gpm_engine_estimator_schedule(engine);
+  gpm_engine_check_warning(engine, priv->battery_composite);
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gpm_engine_get_energy_used:
+ * @engine: This engine class instance
+ * @today: The returned Wh used on battery since midnight, or %NULL
+ * @session: The returned Wh used on battery since we started, or %NULL
+ **/
+void gpm_engine_get_energy_used(GpmEngine *engine, gdouble *today,
+                                gdouble *session) {
+  GDateTime *now;
+  GDateTime *midnight;
+
+  g_return_if_fail(GPM_IS_ENGINE(engine));
+
+  if (today != NULL) {
+    now = g_date_time_new_now_local();
+    midnight = g_date_time_new_local(
+        g_date_time_get_year(now), g_date_time_get_month(now),
+        g_date_time_get_day_of_month(now), 0, 0, 0);
+    *today = gpm_energy_get_used(engine->priv->energy,
+                                 g_date_time_to_unix(midnight),
+                                 g_date_time_to_unix(now));
+    g_date_time_unref(midnight);
+    g_date_time_unref(now);
+  }
+  if (session != NULL) *session = gpm_energy_get_total(engine->priv->energy);
+}
+
 /**
  * gpm_engine_get_summary:
  * @engine: This engine class instance
@@ -142,6 +364,18 @@ gchar *gpm_engine_get_summary(GpmEngine *engine) {
     g_free(part);
   }
 
+  if (engine->priv->show_energy_used &&
+      gpm_energy_get_length(engine->priv->energy) > 1) {
+    gdouble today;
+    gdouble session;
+    gpm_engine_get_energy_used(engine, &today, &session);
+    /* TRANSLATORS: the energy taken from the battery, in watt hours */
+    g_string_append_printf(
+        tooltip, _("Energy used: %.1f Wh today, %.1f Wh this session"), today,
+        session);
+    g_string_append_c(tooltip, '\n');
+  }
+
   /* remove the last \n */
   g_string_truncate(tooltip, tooltip->len - 1);
 
@@ -374,6 +608,27 @@ static void gpm_engine_recalculate_state(GpmEngine *engine) {
   g_signal_emit(engine, signals[DEVICES_CHANGED], 0);
 }
 
+/**
+ * gpm_engine_load_policy:
+ **/
+static void gpm_engine_load_policy(GpmEngine *engine) {
+  /* get percentage policy */
+  engine->priv->low_percentage =
+      g_settings_get_int(engine->priv->settings, GPM_SETTINGS_PERCENTAGE_LOW);
+  engine->priv->critical_percentage = g_settings_get_int(
+      engine->priv->settings, GPM_SETTINGS_PERCENTAGE_CRITICAL);
+  engine->priv->action_percentage = g_settings_get_int(
+      engine->priv->settings, GPM_SETTINGS_PERCENTAGE_ACTION);
+
+  /* get time policy */
+  engine->priv->low_time =
+      g_settings_get_int(engine->priv->settings, GPM_SETTINGS_TIME_LOW);
+  engine->priv->critical_time =
+      g_settings_get_int(engine->priv->settings, GPM_SETTINGS_TIME_CRITICAL);
+  engine->priv->action_time =
+      g_settings_get_int(engine->priv->settings, GPM_SETTINGS_TIME_ACTION);
+}
+
 /**
  * gpm_engine_settings_key_changed_cb:
  **/
@@ -382,6 +637,13 @@ static void gpm_engine_settings_key_changed_cb(GSettings *settings,
                                                GpmEngine *engine) {
   if (g_strcmp0(key, GPM_SETTINGS_USE_TIME_POLICY) == 0) {
     engine->priv->use_time_primary = g_settings_get_boolean(settings, key);
+    gpm_engine_estimator_schedule(engine);
+
+  } else if (g_str_has_prefix(key, "percentage-") ||
+             g_str_has_prefix(key, "time-")) {
+    /* the warning thresholds */
+    gpm_engine_load_policy(engine);
+    gpm_engine_estimator_schedule(engine);
 
   } else if (g_strcmp0(key, GPM_SETTINGS_ICON_POLICY) == 0) {
     /* do we want to display the icon in the tray */
@@ -389,6 +651,10 @@ static void gpm_engine_settings_key_changed_cb(GSettings *settings,
 
     /* perhaps change icon */
     gpm_engine_recalculate_state_icon(engine);
+
+  } else if (g_strcmp0(key, GPM_SETTINGS_SHOW_ENERGY_USED) == 0) {
+    engine->priv->show_energy_used = g_settings_get_boolean(settings, key);
+    gpm_engine_recalculate_state_summary(engine);
   }
 }
 
@@ -473,6 +739,10 @@ static void gpm_engine_device_add(GpmEngine *engine, UpDevice *device) {
           up_device_state_to_string(state));
   g_object_set_data(G_OBJECT(device), "engine-state-old",
                     GUINT_TO_POINTER(state));
+  if (gpm_trace_get_mode(engine->priv->trace) == GPM_TRACE_MODE_RECORD)
+    gpm_trace_add(engine->priv->trace, GPM_TRACE_KIND_DEVICE_ADDED, 0,
+                  up_device_get_object_path(device),
+                  gpm_trace_get_properties(G_OBJECT(device), NULL));
 
   if (kind == UP_DEVICE_KIND_BATTERY) {
     g_debug("updating because we added a device");
@@ -508,6 +778,15 @@ static gboolean gpm_engine_coldplug_idle_cb(GpmEngine *engine) {
 
   gpm_engine_recalculate_state(engine);
 
+  /* the devices come from the trace instead */
+  if (gpm_trace_is_replaying(engine->priv->trace)) return G_SOURCE_REMOVE;
+
+  /* or from the broker */
+  if (engine->priv->broker_page != NULL) {
+    gpm_engine_broker_sync(engine);
+    return G_SOURCE_REMOVE;
+  }
+
   /* add to database */
   array = up_client_get_devices2(engine->priv->client);
   if (array != NULL) {
@@ -526,6 +805,7 @@ static gboolean gpm_engine_coldplug_idle_cb(GpmEngine *engine) {
  **/
 static void gpm_engine_device_added_cb(UpClient *client, UpDevice *device,
                                        GpmEngine *engine) {
+  if (gpm_trace_is_replaying(engine->priv->trace)) return;
   gpm_engine_device_add(engine, device);
 }
 
@@ -537,6 +817,9 @@ static void gpm_engine_device_removed_cb(UpClient *client,
                                          GpmEngine *engine) {
   guint i;
 
+  if (gpm_trace_is_replaying(engine->priv->trace)) return;
+  gpm_trace_add(engine->priv->trace, GPM_TRACE_KIND_DEVICE_REMOVED, 0,
+                object_path, NULL);
   for (i = 0; i < engine->priv->array->len; i++) {
     UpDevice *device = g_ptr_array_index(engine->priv->array, i);
 
@@ -548,6 +831,301 @@ static void gpm_engine_device_removed_cb(UpClient *client,
   gpm_engine_recalculate_state(engine);
 }
 
+/**
+ * gpm_engine_trace_replay_cb:
+ *
+ * Replayed devices are made up locally from the properties that were
+ * recorded, and then go through the same paths as the real ones.
+ **/
+static void gpm_engine_trace_replay_cb(GpmTrace *trace,
+                                       const GpmTraceEvent *event,
+                                       GpmEngine *engine) {
+  UpDevice *device = NULL;
+
+  if (event->kind != GPM_TRACE_KIND_DEVICE_ADDED &&
+      event->kind != GPM_TRACE_KIND_DEVICE_CHANGED &&
+      event->kind != GPM_TRACE_KIND_DEVICE_REMOVED)
+    return;
+
+  if (event->name == NULL)
+    device = engine->priv->battery_composite;
+  else
+    device = g_hash_table_lookup(engine->priv->trace_devices, event->name);
+
+  switch (event->kind) {
+    case GPM_TRACE_KIND_DEVICE_ADDED:
+      if (device != NULL) {
+        gpm_trace_set_properties(G_OBJECT(device), event->data);
+        break;
+      }
+      device = up_device_new();
+      gpm_trace_set_properties(G_OBJECT(device), event->data);
+      g_hash_table_insert(engine->priv->trace_devices, g_strdup(event->name),
+                          device);
+      gpm_engine_device_add(engine, device);
+      break;
+    case GPM_TRACE_KIND_DEVICE_CHANGED:
+      if (device == NULL) {
+        g_debug("no replayed device %s", event->name);
+        break;
+      }
+      gpm_trace_set_properties(G_OBJECT(device), event->data);
+      break;
+    case GPM_TRACE_KIND_DEVICE_REMOVED:
+      if (device == NULL || device == engine->priv->battery_composite) break;
+      g_signal_handlers_disconnect_by_data(device, engine);
+      g_ptr_array_remove(engine->priv->array, device);
+      g_hash_table_remove(engine->priv->trace_devices, event->name);
+      gpm_engine_recalculate_state(engine);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * gpm_engine_broker_has_device:
+ **/
+static gboolean gpm_engine_broker_has_device(const GpmBrokerPage *snapshot,
+                                             const gchar *name) {
+  guint i;
+
+  for (i = 0; i < snapshot->n_devices; i++) {
+    if (snapshot->devices[i].serial != 0 &&
+        g_strcmp0(snapshot->devices[i].name, name) == 0)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * gpm_engine_broker_stop:
+ *
+ * The broker has gone away, so this session goes back to asking UPower
+ * itself rather than showing values that no longer change.
+ **/
+static void gpm_engine_broker_stop(GpmEngine *engine) {
+  GpmEnginePrivate *priv = engine->priv;
+  GHashTableIter iter;
+  GPtrArray *array;
+  UpDevice *device;
+  guint i;
+
+  g_debug("broker has gone, using UPower directly");
+  if (priv->broker_monitor != NULL) {
+    g_signal_handlers_disconnect_by_data(priv->broker_monitor, engine);
+    g_clear_object(&priv->broker_monitor);
+  }
+  gpm_broker_page_close(priv->broker_page);
+  priv->broker_page = NULL;
+
+  g_hash_table_iter_init(&iter, priv->broker_devices);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&device)) {
+    g_signal_handlers_disconnect_by_data(device, engine);
+    g_ptr_array_remove(priv->array, device);
+    g_hash_table_iter_remove(&iter);
+  }
+
+  g_signal_handlers_disconnect_by_data(priv->battery_composite, engine);
+  g_object_unref(priv->battery_composite);
+  priv->client = up_client_new();
+  g_signal_connect(priv->client, "device-added",
+                   G_CALLBACK(gpm_engine_device_added_cb), engine);
+  g_signal_connect(priv->client, "device-removed",
+                   G_CALLBACK(gpm_engine_device_removed_cb), engine);
+  priv->battery_composite = up_client_get_display_device(priv->client);
+  g_signal_connect(priv->battery_composite, "notify",
+                   G_CALLBACK(gpm_engine_device_changed_cb), engine);
+
+  array = up_client_get_devices2(priv->client);
+  if (array != NULL) {
+    for (i = 0; i < array->len; i++)
+      gpm_engine_device_add(engine, g_ptr_array_index(array, i));
+    g_ptr_array_unref(array);
+  }
+  gpm_engine_recalculate_state(engine);
+}
+
+/**
+ * gpm_engine_broker_sync:
+ *
+ * Brings the local devices up to date with the page, only touching the
+ * ones whose serial has moved on since the last time.
+ **/
+static void gpm_engine_broker_sync(GpmEngine *engine) {
+  GpmEnginePrivate *priv = engine->priv;
+  const GpmBrokerDevice *slot;
+  GHashTableIter iter;
+  UpDevice *device;
+  GVariant *data;
+  gchar *filename;
+  gchar *name;
+  guint serial;
+  guint i;
+
+  /* a retired page means a new broker, or none at all */
+  if (!gpm_broker_page_read(priv->broker_page, priv->broker_snapshot)) {
+    gpm_broker_page_close(priv->broker_page);
+    filename = gpm_broker_page_get_filename();
+    priv->broker_page = gpm_broker_page_open(filename, NULL);
+    g_free(filename);
+    if (priv->broker_page == NULL ||
+        !gpm_broker_page_read(priv->broker_page, priv->broker_snapshot)) {
+      gpm_engine_broker_stop(engine);
+      return;
+    }
+  }
+
+  for (i = 0; i < priv->broker_snapshot->n_devices; i++) {
+    slot = &priv->broker_snapshot->devices[i];
+    if (slot->serial == 0) continue;
+    if (slot->name[0] == '\0')
+      device = priv->battery_composite;
+    else
+      device = g_hash_table_lookup(priv->broker_devices, slot->name);
+    if (device != NULL) {
+      serial = GPOINTER_TO_UINT(
+          g_object_get_data(G_OBJECT(device), "engine-broker-serial"));
+      if (serial == slot->serial) continue;
+    }
+    data = gpm_broker_device_get_data(slot);
+    if (data == NULL) {
+      g_warning("broker published nonsense for %s", slot->name);
+      continue;
+    }
+    if (device == NULL) {
+      device = up_device_new();
+      gpm_trace_set_properties(G_OBJECT(device), data);
+      g_hash_table_insert(priv->broker_devices, g_strdup(slot->name), device);
+      gpm_engine_device_add(engine, device);
+    } else {
+      gpm_trace_set_properties(G_OBJECT(device), data);
+    }
+    g_object_set_data(G_OBJECT(device), "engine-broker-serial",
+                      GUINT_TO_POINTER(slot->serial));
+    g_variant_unref(data);
+  }
+
+  g_hash_table_iter_init(&iter, priv->broker_devices);
+  while (g_hash_table_iter_next(&iter, (gpointer *)&name,
+                                (gpointer *)&device)) {
+    if (gpm_engine_broker_has_device(priv->broker_snapshot, name)) continue;
+    g_signal_handlers_disconnect_by_data(device, engine);
+    g_ptr_array_remove(priv->array, device);
+    g_hash_table_iter_remove(&iter);
+    gpm_engine_recalculate_state(engine);
+  }
+}
+
+/**
+ * gpm_engine_broker_changed_cb:
+ **/
+static void gpm_engine_broker_changed_cb(GFileMonitor *monitor, GFile *file,
+                                         GFile *other_file,
+                                         GFileMonitorEvent event_type,
+                                         GpmEngine *engine) {
+  gpm_engine_broker_sync(engine);
+}
+
+/**
+ * gpm_engine_broker_start:
+ *
+ * Uses the devices from mate-power-broker if one is running for the
+ * host, rather than every session being its own UPower client.
+ *
+ * Return value: %TRUE if there is a broker
+ **/
+static gboolean gpm_engine_broker_start(GpmEngine *engine) {
+  GpmEnginePrivate *priv = engine->priv;
+  GError *error = NULL;
+  gchar *filename;
+  GFile *file;
+
+  filename = gpm_broker_page_get_filename();
+  priv->broker_page = gpm_broker_page_open(filename, &error);
+  if (priv->broker_page == NULL) {
+    if (g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_PERM))
+      g_warning("not using a broker: %s", error->message);
+    else
+      g_debug("not using a broker: %s", error->message);
+    g_error_free(error);
+    g_free(filename);
+    return FALSE;
+  }
+  g_debug("using the devices from %s", filename);
+  priv->broker_snapshot = g_new0(GpmBrokerPage, 1);
+  file = g_file_new_for_path(filename);
+  priv->broker_monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE,
+                                             NULL, NULL);
+  if (priv->broker_monitor != NULL)
+    g_signal_connect(priv->broker_monitor, "changed",
+                     G_CALLBACK(gpm_engine_broker_changed_cb), engine);
+  g_object_unref(file);
+  g_free(filename);
+  return TRUE;
+}
+
+/**
+ * gpm_engine_energy_add_sample:
+ *
+ * Integrates the rate of the composite battery, which only counts when
+ * the battery is being used.
+ **/
+static void gpm_engine_energy_add_sample(GpmEngine *engine) {
+  UpDeviceState state;
+  gdouble rate;
+  guint32 now;
+
+  g_object_get(engine->priv->battery_composite, "state", &state,
+               "energy-rate", &rate, NULL);
+  if (state != UP_DEVICE_STATE_DISCHARGING) rate = 0.0f;
+
+  now = gpm_trace_get_real_time(engine->priv->trace) / G_USEC_PER_SEC;
+  if (!gpm_energy_add(engine->priv->energy, now, rate))
+    g_debug("clock went backwards, ignoring rate");
+  if (now > GPM_ENGINE_ENERGY_KEEP)
+    gpm_energy_forget(engine->priv->energy, now - GPM_ENGINE_ENERGY_KEEP);
+}
+
+/**
+ * gpm_engine_check_warning:
+ *
+ * Emits a signal if the device has reached a more severe warning level.
+ **/
+static void gpm_engine_check_warning(GpmEngine *engine, UpDevice *device) {
+  UpDeviceState state;
+  UpDeviceLevel warning_old;
+  UpDeviceLevel warning;
+
+  warning_old = GPOINTER_TO_INT(
+      g_object_get_data(G_OBJECT(device), "engine-warning-old"));
+  warning = gpm_engine_get_warning(engine, device);
+  if (warning == warning_old) return;
+
+  /* the time remaining bounces around with the load, so do not drop back
+   * and warn all over again until the device stops discharging */
+  g_object_get(device, "state", &state, NULL);
+  if (warning < warning_old && warning_old >= GPM_ENGINE_WARNING_LOW &&
+      state == UP_DEVICE_STATE_DISCHARGING) {
+    g_debug("ignoring warning level dropping back while discharging");
+    return;
+  }
+
+  if (warning == GPM_ENGINE_WARNING_LOW) {
+    g_debug("** EMIT: charge-low");
+    g_signal_emit(engine, signals[CHARGE_LOW], 0, device);
+  } else if (warning == GPM_ENGINE_WARNING_CRITICAL) {
+    g_debug("** EMIT: charge-critical");
+    g_signal_emit(engine, signals[CHARGE_CRITICAL], 0, device);
+  } else if (warning == GPM_ENGINE_WARNING_ACTION) {
+    g_debug("** EMIT: charge-action");
+    g_signal_emit(engine, signals[CHARGE_ACTION], 0, device);
+  }
+  /* save new state */
+  g_object_set_data(G_OBJECT(device), "engine-warning-old",
+                    GUINT_TO_POINTER(warning));
+}
+
 /**
  * gpm_engine_device_changed_cb:
  **/
@@ -556,12 +1134,28 @@ static void gpm_engine_device_changed_cb(UpDevice *device, GParamSpec *pspec,
   UpDeviceKind kind;
   UpDeviceState state;
   UpDeviceState state_old;
-  UpDeviceLevel warning_old;
-  UpDeviceLevel warning;
+
+  /* the composite battery has no path of its own in the trace */
+  if (gpm_trace_get_mode(engine->priv->trace) == GPM_TRACE_MODE_RECORD)
+    gpm_trace_add(engine->priv->trace, GPM_TRACE_KIND_DEVICE_CHANGED, 0,
+                  device != engine->priv->battery_composite
+                      ? up_device_get_object_path(device)
+                      : NULL,
+                  gpm_trace_get_properties(G_OBJECT(device), pspec->name));
 
   /* get device properties */
   g_object_get(device, "kind", &kind, NULL);
 
+  if (device == engine->priv->battery_composite) {
+    gpm_engine_energy_add_sample(engine);
+    if (engine->priv->estimator_idle_id == 0) {
+      engine->priv->estimator_idle_id =
+          g_idle_add((GSourceFunc)gpm_engine_estimator_idle_cb, engine);
+      g_source_set_name_by_id(engine->priv->estimator_idle_id,
+                              "[GpmEngine] estimator");
+    }
+  }
+
   /* if battery then use composite device to cope with multiple batteries */
   if (kind == UP_DEVICE_KIND_BATTERY) {
     g_debug("updating because %s changed", up_device_get_object_path(device));
@@ -592,24 +1186,7 @@ static void gpm_engine_device_changed_cb(UpDevice *device, GParamSpec *pspec,
   }
 
   /* check the warning state has not changed */
-  warning_old = GPOINTER_TO_INT(
-      g_object_get_data(G_OBJECT(device), "engine-warning-old"));
-  warning = gpm_engine_get_warning(engine, device);
-  if (warning != warning_old) {
-    if (warning == GPM_ENGINE_WARNING_LOW) {
-      g_debug("** EMIT: charge-low");
-      g_signal_emit(engine, signals[CHARGE_LOW], 0, device);
-    } else if (warning == GPM_ENGINE_WARNING_CRITICAL) {
-      g_debug("** EMIT: charge-critical");
-      g_signal_emit(engine, signals[CHARGE_CRITICAL], 0, device);
-    } else if (warning == GPM_ENGINE_WARNING_ACTION) {
-      g_debug("** EMIT: charge-action");
-      g_signal_emit(engine, signals[CHARGE_ACTION], 0, device);
-    }
-    /* save new state */
-    g_object_set_data(G_OBJECT(device), "engine-warning-old",
-                      GUINT_TO_POINTER(warning));
-  }
+  gpm_engine_check_warning(engine, device);
 
   gpm_engine_recalculate_state(engine);
 }
@@ -750,11 +1327,21 @@ static void gpm_engine_init(GpmEngine *engine) {
   engine->priv = gpm_engine_get_instance_private(engine);
 
   engine->priv->array = g_ptr_array_new_with_free_func(g_object_unref);
-  engine->priv->client = up_client_new();
-  g_signal_connect(engine->priv->client, "device-added",
-                   G_CALLBACK(gpm_engine_device_added_cb), engine);
-  g_signal_connect(engine->priv->client, "device-removed",
-                   G_CALLBACK(gpm_engine_device_removed_cb), engine);
+  engine->priv->trace = gpm_trace_new();
+  engine->priv->trace_devices =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+  g_signal_connect(engine->priv->trace, "replay",
+                   G_CALLBACK(gpm_engine_trace_replay_cb), engine);
+  engine->priv->broker_devices =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+  if (gpm_trace_is_replaying(engine->priv->trace) ||
+      !gpm_engine_broker_start(engine)) {
+    engine->priv->client = up_client_new();
+    g_signal_connect(engine->priv->client, "device-added",
+                     G_CALLBACK(gpm_engine_device_added_cb), engine);
+    g_signal_connect(engine->priv->client, "device-removed",
+                     G_CALLBACK(gpm_engine_device_removed_cb), engine);
+  }
 
   engine->priv->settings = g_settings_new(GPM_SETTINGS_SCHEMA);
   g_signal_connect(engine->priv->settings, "changed",
@@ -769,33 +1356,33 @@ static void gpm_engine_init(GpmEngine *engine) {
                    G_CALLBACK(phone_device_refresh_cb), engine);
 
   /* create a fake virtual composite battery */
-  engine->priv->battery_composite =
-      up_client_get_display_device(engine->priv->client);
+  if (engine->priv->client == NULL ||
+      gpm_trace_is_replaying(engine->priv->trace))
+    engine->priv->battery_composite = up_device_new();
+  else
+    engine->priv->battery_composite =
+        up_client_get_display_device(engine->priv->client);
+  if (gpm_trace_get_mode(engine->priv->trace) == GPM_TRACE_MODE_RECORD)
+    gpm_trace_add(engine->priv->trace, GPM_TRACE_KIND_DEVICE_ADDED, 0, NULL,
+                  gpm_trace_get_properties(
+                      G_OBJECT(engine->priv->battery_composite), NULL));
   g_signal_connect(engine->priv->battery_composite, "notify",
                    G_CALLBACK(gpm_engine_device_changed_cb), engine);
 
   engine->priv->previous_icon = NULL;
   engine->priv->previous_summary = NULL;
 
+  engine->priv->energy = gpm_energy_new();
+  engine->priv->estimator = gpm_estimator_new();
+  engine->priv->estimator_level = GPM_ENGINE_WARNING_NONE;
+  engine->priv->show_energy_used = g_settings_get_boolean(
+      engine->priv->settings, GPM_SETTINGS_SHOW_ENERGY_USED);
+
   /* do we want to display the icon in the tray */
   engine->priv->icon_policy =
       g_settings_get_enum(engine->priv->settings, GPM_SETTINGS_ICON_POLICY);
 
-  /* get percentage policy */
-  engine->priv->low_percentage =
-      g_settings_get_int(engine->priv->settings, GPM_SETTINGS_PERCENTAGE_LOW);
-  engine->priv->critical_percentage = g_settings_get_int(
-      engine->priv->settings, GPM_SETTINGS_PERCENTAGE_CRITICAL);
-  engine->priv->action_percentage = g_settings_get_int(
-      engine->priv->settings, GPM_SETTINGS_PERCENTAGE_ACTION);
-
-  /* get time policy */
-  engine->priv->low_time =
-      g_settings_get_int(engine->priv->settings, GPM_SETTINGS_TIME_LOW);
-  engine->priv->critical_time =
-      g_settings_get_int(engine->priv->settings, GPM_SETTINGS_TIME_CRITICAL);
-  engine->priv->action_time =
-      g_settings_get_int(engine->priv->settings, GPM_SETTINGS_TIME_ACTION);
+  gpm_engine_load_policy(engine);
 
   /* we can disable this if the time remaining is inaccurate or just plain wrong
    */
@@ -870,12 +1457,27 @@ static void gpm_engine_finalize(GObject *object) {
   engine->priv = gpm_engine_get_instance_private(engine);
 
   g_ptr_array_unref(engine->priv->array);
-  g_object_unref(engine->priv->client);
+  g_clear_object(&engine->priv->client);
   g_object_unref(engine->priv->phone);
   g_object_unref(engine->priv->battery_composite);
+  g_hash_table_unref(engine->priv->trace_devices);
+  g_hash_table_unref(engine->priv->broker_devices);
+  if (engine->priv->broker_monitor != NULL) {
+    g_signal_handlers_disconnect_by_data(engine->priv->broker_monitor, engine);
+    g_object_unref(engine->priv->broker_monitor);
+  }
+  gpm_broker_page_close(engine->priv->broker_page);
+  g_free(engine->priv->broker_snapshot);
+  g_object_unref(engine->priv->trace);
 
   g_free(engine->priv->previous_icon);
   g_free(engine->priv->previous_summary);
+  gpm_energy_free(engine->priv->energy);
+  gpm_estimator_free(engine->priv->estimator);
+  if (engine->priv->estimator_idle_id != 0)
+    g_source_remove(engine->priv->estimator_idle_id);
+  if (engine->priv->estimator_timer_id != 0)
+    g_source_remove(engine->priv->estimator_timer_id);
 
   G_OBJECT_CLASS(gpm_engine_parent_class)->finalize(object);
 }
@@ -893,3 +1495,65 @@ GpmEngine *gpm_engine_new(void) {
   }
   return GPM_ENGINE(gpm_engine_object);
 }
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+void gpm_engine_test(gpointer data) {
+  GpmEngine engine;
+  GpmEnginePrivate priv;
+  GpmEstimatorTestSample *sample;
+  GArray *trace;
+  GRand *rand;
+  guint timer_id = 0;
+  guint rearmed = 0;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmEngine")) return;
+
+  /* only the estimator is used, so there is no need for UPower */
+  memset(&engine, 0, sizeof(engine));
+  memset(&priv, 0, sizeof(priv));
+  engine.priv = &priv;
+  priv.trace = gpm_trace_new();
+  priv.estimator = gpm_estimator_new();
+  priv.battery_composite = up_device_new();
+  g_object_set(priv.battery_composite, "energy-full", 50.0f, NULL);
+  priv.low_percentage = 10;
+  priv.critical_percentage = 3;
+
+  /************************************************************/
+  egg_test_title(test, "steady trace keeps a single timer");
+  rand = g_rand_new_with_seed(0xba77);
+  trace = gpm_estimator_test_trace(rand, TRUE);
+  for (i = 0; i < trace->len; i++) {
+    sample = &g_array_index(trace, GpmEstimatorTestSample, i);
+    gpm_estimator_add(priv.estimator, sample->time, sample->energy,
+                      sample->rate);
+    gpm_engine_estimator_schedule_at(&engine, sample->time);
+    if (priv.estimator_level >= GPM_ENGINE_WARNING_LOW) break;
+    if (priv.estimator_timer_id != timer_id) {
+      timer_id = priv.estimator_timer_id;
+      rearmed++;
+    }
+  }
+  if (i < trace->len && rearmed < i / 10)
+    egg_test_success(test, "re-armed %i times in %i samples", rearmed, i);
+  else
+    egg_test_failed(test, "re-armed %i times in %i samples", rearmed, i);
+
+  if (priv.estimator_timer_id != 0) g_source_remove(priv.estimator_timer_id);
+  g_array_unref(trace);
+  g_rand_free(rand);
+  g_object_unref(priv.battery_composite);
+  gpm_estimator_free(priv.estimator);
+  g_object_unref(priv.trace);
+
+  egg_test_end(test);
+}
+
+#endif
@@ -62,8 +62,13 @@ GType gpm_engine_get_type(void);
 GpmEngine *gpm_engine_new(void);
 gchar *gpm_engine_get_icon(GpmEngine *engine);
 gchar *gpm_engine_get_summary(GpmEngine *engine);
+void gpm_engine_get_energy_used(GpmEngine *engine, gdouble *today,
+                                gdouble *session);
 GPtrArray *gpm_engine_get_devices(GpmEngine *engine);
 UpDevice *gpm_engine_get_primary_device(GpmEngine *engine);
+#ifdef EGG_TEST
+void gpm_engine_test(gpointer data);
+#endif
 
 G_END_DECLS
 
@@ -0,0 +1,517 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <math.h>
+
+#include "gpm-estimator.h"
+
+/* how far apart the measurements are expected to be from the truth, the
+ * energy comes from a coulomb counter but the rate is instantaneous and
+ * moves around a lot with load */
+#define GPM_ESTIMATOR_ENERGY_NOISE 0.05f /* Wh */
+#define GPM_ESTIMATOR_RATE_NOISE 3.0f    /* W */
+
+/* how quickly the real rate is allowed to wander, in W^2 per second */
+#define GPM_ESTIMATOR_RATE_DRIFT 0.001f
+#define GPM_ESTIMATOR_ENERGY_DRIFT 0.000001f
+
+/* an energy reading this many standard deviations away is a recalibration
+ * or a battery being swapped, so start again from it */
+#define GPM_ESTIMATOR_ENERGY_JUMP 5.0f
+
+/* below this the battery is not really being discharged */
+#define GPM_ESTIMATOR_MIN_RATE 0.1f
+
+/* the filter has not settled until it has seen a few refreshes */
+#define GPM_ESTIMATOR_MIN_SAMPLES 3
+
+/* the confidence interval is this many standard deviations wide each way */
+#define GPM_ESTIMATOR_INTERVAL 2.0f
+
+/* a two state Kalman filter, tracking the energy left and the rate it is
+ * being used at, which is assumed constant between samples */
+struct GpmEstimator {
+  guint32 time; /* of the last sample */
+  guint samples;
+  gdouble energy; /* Wh */
+  gdouble rate;   /* W, positive when discharging */
+  gdouble cov[2][2];
+};
+
+/**
+ * gpm_estimator_predict:
+ *
+ * Moves the state @dt seconds forward, the uncertainty grows as we go.
+ **/
+static void gpm_estimator_predict(GpmEstimator *estimator, gdouble dt) {
+  gdouble h = dt / 3600.0f;
+  gdouble (*p)[2] = estimator->cov;
+
+  estimator->energy -= estimator->rate * h;
+  p[0][0] += -2.0f * h * p[0][1] + h * h * p[1][1] +
+             GPM_ESTIMATOR_ENERGY_DRIFT * dt;
+  p[0][1] -= h * p[1][1];
+  p[1][0] = p[0][1];
+  p[1][1] += GPM_ESTIMATOR_RATE_DRIFT * dt;
+}
+
+/**
+ * gpm_estimator_correct:
+ * @i: 0 for an energy measurement, 1 for a rate measurement
+ * @value: the measurement
+ * @noise: the variance of the measurement
+ *
+ * Return value: the normalised innovation, i.e. how surprising @value was
+ **/
+static gdouble gpm_estimator_correct(GpmEstimator *estimator, guint i,
+                                     gdouble value, gdouble noise) {
+  gdouble (*p)[2] = estimator->cov;
+  gdouble innovation;
+  gdouble gain[2];
+  gdouble row[2];
+  gdouble s;
+
+  innovation = value - (i == 0 ? estimator->energy : estimator->rate);
+  s = p[i][i] + noise;
+  gain[0] = p[0][i] / s;
+  gain[1] = p[1][i] / s;
+  estimator->energy += gain[0] * innovation;
+  estimator->rate += gain[1] * innovation;
+
+  row[0] = p[i][0];
+  row[1] = p[i][1];
+  p[0][0] -= gain[0] * row[0];
+  p[0][1] -= gain[0] * row[1];
+  p[1][1] -= gain[1] * row[1];
+  p[1][0] = p[0][1];
+  return innovation * innovation / s;
+}
+
+/**
+ * gpm_estimator_start:
+ **/
+static void gpm_estimator_start(GpmEstimator *estimator, guint32 time,
+                                gdouble energy, gdouble rate) {
+  estimator->time = time;
+  estimator->samples = 1;
+  estimator->energy = energy;
+  estimator->rate = MAX(rate, 0.0f);
+  estimator->cov[0][0] =
+      GPM_ESTIMATOR_ENERGY_NOISE * GPM_ESTIMATOR_ENERGY_NOISE;
+  estimator->cov[0][1] = 0.0f;
+  estimator->cov[1][0] = 0.0f;
+  estimator->cov[1][1] = GPM_ESTIMATOR_RATE_NOISE * GPM_ESTIMATOR_RATE_NOISE;
+  if (rate < 0.0f) estimator->cov[1][1] *= 100.0f;
+}
+
+/**
+ * gpm_estimator_new:
+ *
+ * Return value: an empty estimator, free with gpm_estimator_free()
+ **/
+GpmEstimator *gpm_estimator_new(void) { return g_new0(GpmEstimator, 1); }
+
+/**
+ * gpm_estimator_free:
+ **/
+void gpm_estimator_free(GpmEstimator *estimator) { g_free(estimator); }
+
+/**
+ * gpm_estimator_reset:
+ *
+ * Forgets everything, which should be done when the battery stops
+ * discharging as the rate will be completely different next time.
+ **/
+void gpm_estimator_reset(GpmEstimator *estimator) {
+  g_return_if_fail(estimator != NULL);
+  estimator->samples = 0;
+}
+
+/**
+ * gpm_estimator_add:
+ * @estimator: a #GpmEstimator
+ * @time: the time of the sample, which must not be before the last
+ * @energy: the energy left in the battery in Wh
+ * @rate: the reported discharge rate in W, or a negative value if unknown
+ *
+ * Return value: %FALSE if @time is before the last sample
+ **/
+gboolean gpm_estimator_add(GpmEstimator *estimator, guint32 time,
+                           gdouble energy, gdouble rate) {
+  gdouble surprise;
+
+  g_return_val_if_fail(estimator != NULL, FALSE);
+
+  if (estimator->samples == 0) {
+    gpm_estimator_start(estimator, time, energy, rate);
+    return TRUE;
+  }
+  if (time < estimator->time) return FALSE;
+
+  gpm_estimator_predict(estimator, time - estimator->time);
+  estimator->time = time;
+  surprise = gpm_estimator_correct(
+      estimator, 0, energy,
+      GPM_ESTIMATOR_ENERGY_NOISE * GPM_ESTIMATOR_ENERGY_NOISE);
+  if (surprise > GPM_ESTIMATOR_ENERGY_JUMP * GPM_ESTIMATOR_ENERGY_JUMP) {
+    g_debug("energy jumped to %.2fWh, restarting", energy);
+    gpm_estimator_start(estimator, time, energy, rate);
+    return TRUE;
+  }
+  if (rate >= 0.0f)
+    gpm_estimator_correct(estimator, 1, rate,
+                          GPM_ESTIMATOR_RATE_NOISE * GPM_ESTIMATOR_RATE_NOISE);
+  estimator->samples++;
+  return TRUE;
+}
+
+/**
+ * gpm_estimator_get_energy:
+ * @energy: the returned energy expected to be left at @time, in Wh
+ *
+ * Return value: %FALSE if there is not enough data yet
+ **/
+gboolean gpm_estimator_get_energy(GpmEstimator *estimator, guint32 time,
+                                  gdouble *energy) {
+  g_return_val_if_fail(estimator != NULL, FALSE);
+  g_return_val_if_fail(energy != NULL, FALSE);
+
+  if (estimator->samples < GPM_ESTIMATOR_MIN_SAMPLES) return FALSE;
+  *energy = estimator->energy;
+  if (time > estimator->time)
+    *energy -= estimator->rate * (time - estimator->time) / 3600.0f;
+  return TRUE;
+}
+
+/**
+ * gpm_estimator_get_rate:
+ *
+ * Return value: the smoothed discharge rate in W
+ **/
+gdouble gpm_estimator_get_rate(GpmEstimator *estimator) {
+  g_return_val_if_fail(estimator != NULL, 0.0f);
+  if (estimator->samples < GPM_ESTIMATOR_MIN_SAMPLES) return 0.0f;
+  return estimator->rate;
+}
+
+/**
+ * gpm_estimator_get_time_until:
+ * @estimator: a #GpmEstimator
+ * @time: the time now
+ * @energy: the energy level of interest, in Wh
+ * @seconds: the returned time from @time until the battery drops to @energy
+ * @lower: the returned early end of the confidence interval, or %NULL
+ * @upper: the returned late end of the confidence interval, or %NULL
+ *
+ * Return value: %FALSE if there is not enough data yet, or the battery is
+ * not being discharged
+ **/
+gboolean gpm_estimator_get_time_until(GpmEstimator *estimator, guint32 time,
+                                      gdouble energy, gdouble *seconds,
+                                      gdouble *lower, gdouble *upper) {
+  GpmEstimator now;
+  gdouble left;
+  gdouble d_energy;
+  gdouble d_rate;
+  gdouble variance;
+  gdouble spread;
+
+  g_return_val_if_fail(estimator != NULL, FALSE);
+  g_return_val_if_fail(seconds != NULL, FALSE);
+
+  if (estimator->samples < GPM_ESTIMATOR_MIN_SAMPLES) return FALSE;
+  if (estimator->rate < GPM_ESTIMATOR_MIN_RATE) return FALSE;
+
+  now = *estimator;
+  if (time > now.time) gpm_estimator_predict(&now, time - now.time);
+
+  left = now.energy - energy;
+  if (left <= 0.0f) {
+    *seconds = 0.0f;
+    spread = 0.0f;
+  } else {
+    /* first order propagation of the uncertainty in energy and rate */
+    *seconds = left / now.rate * 3600.0f;
+    d_energy = 3600.0f / now.rate;
+    d_rate = -*seconds / now.rate;
+    variance = d_energy * d_energy * now.cov[0][0] +
+               2.0f * d_energy * d_rate * now.cov[0][1] +
+               d_rate * d_rate * now.cov[1][1];
+    spread = GPM_ESTIMATOR_INTERVAL * sqrt(MAX(variance, 0.0f));
+  }
+  if (lower != NULL) *lower = MAX(*seconds - spread, 0.0f);
+  if (upper != NULL) *upper = *seconds + spread;
+  return TRUE;
+}
+
+/**
+ * gpm_estimator_get_runtime:
+ *
+ * The same as gpm_estimator_get_time_until() for a completely empty battery.
+ **/
+gboolean gpm_estimator_get_runtime(GpmEstimator *estimator, guint32 time,
+                                   gdouble *seconds, gdouble *lower,
+                                   gdouble *upper) {
+  return gpm_estimator_get_time_until(estimator, time, 0.0f, seconds, lower,
+                                      upper);
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+static gdouble gpm_estimator_test_gauss(GRand *rand) {
+  gdouble u = g_rand_double_range(rand, 1e-9, 1.0);
+  gdouble v = g_rand_double(rand);
+  return sqrt(-2.0f * log(u)) * cos(2.0f * G_PI * v);
+}
+
+/* replays a discharge the way UPower sees it: a refresh every 30 seconds,
+ * an energy reading from the fuel gauge in 10mWh steps and an instantaneous
+ * rate that jumps around with every burst of load */
+GArray *gpm_estimator_test_trace(GRand *rand, gboolean constant) {
+  const gdouble loads[] = {5.0f, 7.0f, 9.0f, 12.0f, 20.0f};
+  GpmEstimatorTestSample sample;
+  GArray *trace;
+  gdouble energy = 45.0f;
+  gdouble load = 10.0f;
+  guint32 next_load = 0;
+  guint32 time = 1000000;
+  guint i;
+
+  trace = g_array_new(FALSE, FALSE, sizeof(GpmEstimatorTestSample));
+  while (energy > 0.0f) {
+    if (!constant && time >= next_load) {
+      load = loads[g_rand_int_range(rand, 0, G_N_ELEMENTS(loads))];
+      next_load = time + g_rand_int_range(rand, 300, 900);
+    }
+    if (time % 30 == 0) {
+      sample.time = time;
+      sample.energy =
+          rint((energy + 0.02f * gpm_estimator_test_gauss(rand)) * 100.0f) /
+          100.0f;
+      sample.rate = load * (1.0f + 0.2f * gpm_estimator_test_gauss(rand));
+      if (g_rand_int_range(rand, 0, 20) == 0) sample.rate *= 2.0f;
+      sample.rate = MAX(sample.rate, 0.0f);
+      g_array_append_val(trace, sample);
+    }
+    energy -= load / 3600.0f;
+    time++;
+  }
+  for (i = 0; i < trace->len; i++)
+    g_array_index(trace, GpmEstimatorTestSample, i).truth =
+        time - g_array_index(trace, GpmEstimatorTestSample, i).time;
+  return trace;
+}
+
+void gpm_estimator_test(gpointer data) {
+  GpmEstimator *estimator;
+  GpmEstimatorTestSample *sample;
+  GArray *trace;
+  GRand *rand;
+  gdouble seconds;
+  gdouble lower;
+  gdouble upper;
+  gdouble value;
+  gdouble last;
+  gdouble last_raw;
+  gdouble moved;
+  gdouble moved_raw;
+  gdouble error;
+  gdouble error_raw;
+  gdouble raw;
+  gboolean ret;
+  gboolean below;
+  gboolean below_raw;
+  guint crossings;
+  guint crossings_raw;
+  guint covered;
+  guint counted;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmEstimator")) return;
+
+  rand = g_rand_new_with_seed(0xba77);
+
+  /************************************************************/
+  egg_test_title(test, "nothing known when empty");
+  estimator = gpm_estimator_new();
+  egg_test_assert(test,
+                  !gpm_estimator_get_energy(estimator, 1000, &value) &&
+                      !gpm_estimator_get_runtime(estimator, 1000, &seconds,
+                                                 NULL, NULL));
+
+  /************************************************************/
+  egg_test_title(test, "needs a few samples to settle");
+  gpm_estimator_add(estimator, 1000, 50.0f, 10.0f);
+  gpm_estimator_add(estimator, 1030, 49.92f, 10.0f);
+  ret = gpm_estimator_get_energy(estimator, 1030, &value);
+  gpm_estimator_add(estimator, 1060, 49.83f, 10.0f);
+  egg_test_assert(test,
+                  !ret && gpm_estimator_get_energy(estimator, 1060, &value));
+
+  /************************************************************/
+  egg_test_title(test, "refuses the clock going backwards");
+  egg_test_assert(test, !gpm_estimator_add(estimator, 1059, 49.8f, 10.0f));
+
+  /************************************************************/
+  egg_test_title(test, "runtime of a steady discharge");
+  ret = gpm_estimator_get_runtime(estimator, 1060, &seconds, &lower, &upper);
+  if (ret && fabs(seconds - 49.83f / 10.0f * 3600.0f) < 120.0f &&
+      lower <= seconds && seconds <= upper)
+    egg_test_success(test, "%.0fs (%.0f-%.0f)", seconds, lower, upper);
+  else
+    egg_test_failed(test, "got %.0fs (%.0f-%.0f)", seconds, lower, upper);
+
+  /************************************************************/
+  egg_test_title(test, "predicts forward in time");
+  gpm_estimator_get_energy(estimator, 1060 + 3600, &value);
+  if (fabs(value - 39.83f) < 0.5f)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %.2fWh", value);
+
+  /************************************************************/
+  egg_test_title(test, "restarts when the energy jumps");
+  gpm_estimator_add(estimator, 1090, 20.0f, 10.0f);
+  ret = gpm_estimator_get_energy(estimator, 1090, &value);
+  gpm_estimator_add(estimator, 1120, 19.92f, 10.0f);
+  gpm_estimator_add(estimator, 1150, 19.83f, 10.0f);
+  gpm_estimator_get_energy(estimator, 1150, &value);
+  egg_test_assert(test, !ret && fabs(value - 19.83f) < 0.1f);
+
+  /************************************************************/
+  egg_test_title(test, "no runtime when not discharging");
+  gpm_estimator_reset(estimator);
+  for (i = 0; i < 10; i++)
+    gpm_estimator_add(estimator, 1000 + i * 30, 40.0f, 0.0f);
+  egg_test_assert(test, !gpm_estimator_get_runtime(estimator, 1300, &seconds,
+                                                   NULL, NULL));
+  gpm_estimator_free(estimator);
+
+  /************************************************************/
+  egg_test_title(test, "steady trace converges and is covered");
+  trace = gpm_estimator_test_trace(rand, TRUE);
+  estimator = gpm_estimator_new();
+  covered = 0;
+  counted = 0;
+  for (i = 0; i < trace->len; i++) {
+    sample = &g_array_index(trace, GpmEstimatorTestSample, i);
+    gpm_estimator_add(estimator, sample->time, sample->energy, sample->rate);
+    if (i < 20) continue;
+    if (!gpm_estimator_get_runtime(estimator, sample->time, &seconds, &lower,
+                                   &upper))
+      continue;
+    counted++;
+    if (lower <= sample->truth && sample->truth <= upper) covered++;
+  }
+  if (counted > 0 && covered > counted * 9 / 10)
+    egg_test_success(test, "%i/%i within interval", covered, counted);
+  else
+    egg_test_failed(test, "only %i/%i within interval", covered, counted);
+
+  /************************************************************/
+  egg_test_title(test, "low warning crossed at the right time");
+  gpm_estimator_reset(estimator);
+  for (i = 0; i < trace->len; i++) {
+    sample = &g_array_index(trace, GpmEstimatorTestSample, i);
+    gpm_estimator_add(estimator, sample->time, sample->energy, sample->rate);
+    if (gpm_estimator_get_time_until(estimator, sample->time, 5.0f, &seconds,
+                                     NULL, NULL) &&
+        seconds == 0.0f)
+      break;
+  }
+  if (i == trace->len) {
+    egg_test_failed(test, "never crossed in %i samples", i);
+  } else {
+    value = sample->truth - 5.0f / 10.0f * 3600.0f;
+    if (fabs(value) < 120.0f)
+      egg_test_success(test, "%.0fs out", value);
+    else
+      egg_test_failed(test, "%.0fs out", value);
+  }
+  g_array_unref(trace);
+
+  /************************************************************/
+  egg_test_title(test, "varying trace is smoother and more accurate");
+  trace = gpm_estimator_test_trace(rand, FALSE);
+  gpm_estimator_reset(estimator);
+  last = last_raw = -1.0f;
+  moved = moved_raw = 0.0f;
+  error = error_raw = 0.0f;
+  below = below_raw = FALSE;
+  crossings = crossings_raw = 0;
+  counted = 0;
+  for (i = 0; i < trace->len; i++) {
+    sample = &g_array_index(trace, GpmEstimatorTestSample, i);
+    gpm_estimator_add(estimator, sample->time, sample->energy, sample->rate);
+    if (!gpm_estimator_get_runtime(estimator, sample->time, &seconds, NULL,
+                                   NULL))
+      continue;
+    raw = sample->rate > 0.0f ? sample->energy / sample->rate * 3600.0f : 0.0f;
+    if (last >= 0.0f) {
+      moved += fabs(seconds - last);
+      moved_raw += fabs(raw - last_raw);
+    }
+    last = seconds;
+    last_raw = raw;
+    error += fabs(seconds - sample->truth);
+    error_raw += fabs(raw - sample->truth);
+    counted++;
+
+    /* the default time-low policy of 20 minutes */
+    if (!below && seconds < 1200.0f) crossings++;
+    below = seconds < 1200.0f;
+    if (!below_raw && raw < 1200.0f) crossings_raw++;
+    below_raw = raw < 1200.0f;
+  }
+  if (moved * 4 < moved_raw && error < error_raw)
+    egg_test_success(test, "moved %.0fs vs %.0fs, error %.0fs vs %.0fs",
+                     moved / counted, moved_raw / counted, error / counted,
+                     error_raw / counted);
+  else
+    egg_test_failed(test, "moved %.0fs vs %.0fs, error %.0fs vs %.0fs",
+                    moved / counted, moved_raw / counted, error / counted,
+                    error_raw / counted);
+
+  /************************************************************/
+  egg_test_title(test, "varying trace flaps less");
+  if (crossings < crossings_raw)
+    egg_test_success(test, "crossed %i times vs %i", crossings, crossings_raw);
+  else
+    egg_test_failed(test, "crossed %i times vs %i", crossings, crossings_raw);
+  g_array_unref(trace);
+  gpm_estimator_free(estimator);
+
+  g_rand_free(rand);
+
+  egg_test_end(test);
+}
+
+#endif
@@ -0,0 +1,59 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_ESTIMATOR_H
+#define __GPM_ESTIMATOR_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct GpmEstimator GpmEstimator;
+
+GpmEstimator *gpm_estimator_new(void);
+void gpm_estimator_free(GpmEstimator *estimator);
+void gpm_estimator_reset(GpmEstimator *estimator);
+gboolean gpm_estimator_add(GpmEstimator *estimator, guint32 time,
+                           gdouble energy, gdouble rate);
+gboolean gpm_estimator_get_energy(GpmEstimator *estimator, guint32 time,
+                                  gdouble *energy);
+gdouble gpm_estimator_get_rate(GpmEstimator *estimator);
+gboolean gpm_estimator_get_time_until(GpmEstimator *estimator, guint32 time,
+                                      gdouble energy, gdouble *seconds,
+                                      gdouble *lower, gdouble *upper);
+gboolean gpm_estimator_get_runtime(GpmEstimator *estimator, guint32 time,
+                                   gdouble *seconds, gdouble *lower,
+                                   gdouble *upper);
+#ifdef EGG_TEST
+typedef struct {
+  guint32 time;
+  gdouble energy; /* as UPower would report it */
+  gdouble rate;   /* as UPower would report it */
+  gdouble truth;  /* seconds until the battery really was empty */
+} GpmEstimatorTestSample;
+
+GArray *gpm_estimator_test_trace(GRand *rand, gboolean constant);
+void gpm_estimator_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_ESTIMATOR_H */
@@ -0,0 +1,2244 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A stand-in for UPower and logind on the system bus and mate-session on
+ * the session bus, so that mate-power-manager can be driven end to end on
+ * private buses. It is only built for make check and must never be run
+ * against the real system bus.
+ *
+ * When the daemon is started from here it is also given this program as
+ * its backlight helper, so that the display brightness it sets can be
+ * timed without any panel or pkexec.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <glib-unix.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libupower-glib/upower.h>
+#include <locale.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gpm-common.h"
+
+#define GPM_FAKE_UPOWER_PATH "/org/freedesktop/UPower"
+#define GPM_FAKE_UPOWER_DEVICE_PREFIX "/org/freedesktop/UPower/devices/"
+#define GPM_FAKE_LOGIN1_PATH "/org/freedesktop/login1"
+#define GPM_FAKE_SESSION_PATH "/org/gnome/SessionManager"
+#define GPM_FAKE_CONTROL_SERVICE "org.mate.PowerManager.FakeServices"
+#define GPM_FAKE_CONTROL_PATH "/org/mate/PowerManager/FakeServices"
+
+/* how long to wait for the daemon to react before counting it as missed */
+#define GPM_FAKE_ACTION_TIMEOUT 5000 /* ms */
+/* how long the daemon gets to start and coldplug before measuring */
+#define GPM_FAKE_STARTUP_TIMEOUT 30000 /* ms */
+#define GPM_FAKE_STARTUP_SETTLE 2000   /* ms */
+/* the gap between iterations, so one does not bleed into the next */
+#define GPM_FAKE_ITERATION_SETTLE 100 /* ms */
+/* the daemon restores the backlights after a suspend that is not timed */
+#define GPM_FAKE_RESUME_SETTLE 500 /* ms */
+
+#define GPM_FAKE_SESSION_INHIBIT_SUSPEND 4
+#define GPM_FAKE_SESSION_STATUS_AVAILABLE 0
+#define GPM_FAKE_SESSION_STATUS_IDLE 3
+
+typedef enum {
+  GPM_FAKE_ACTION_SUSPEND = 1 << 0,
+  GPM_FAKE_ACTION_HIBERNATE = 1 << 1,
+  GPM_FAKE_ACTION_POWER_OFF = 1 << 2,
+  GPM_FAKE_ACTION_KBD_BRIGHTNESS = 1 << 3,
+  GPM_FAKE_ACTION_INHIBIT = 1 << 4,
+  GPM_FAKE_ACTION_BACKLIGHT = 1 << 5
+} GpmFakeAction;
+
+static const gchar gpm_fake_introspection[] =
+    "<node>"
+    "<interface name='org.freedesktop.UPower'>"
+    "<method name='EnumerateDevices'>"
+    "<arg name='devices' type='ao' direction='out'/></method>"
+    "<method name='GetDisplayDevice'>"
+    "<arg name='device' type='o' direction='out'/></method>"
+    "<method name='GetCriticalAction'>"
+    "<arg name='action' type='s' direction='out'/></method>"
+    "<signal name='DeviceAdded'><arg name='device' type='o'/></signal>"
+    "<signal name='DeviceRemoved'><arg name='device' type='o'/></signal>"
+    "<property name='DaemonVersion' type='s' access='read'/>"
+    "<property name='OnBattery' type='b' access='read'/>"
+    "<property name='LidIsClosed' type='b' access='read'/>"
+    "<property name='LidIsPresent' type='b' access='read'/>"
+    "</interface>"
+    "<interface name='org.freedesktop.UPower.Device'>"
+    "<method name='Refresh'/>"
+    "<method name='GetHistory'>"
+    "<arg name='type' type='s' direction='in'/>"
+    "<arg name='timespan' type='u' direction='in'/>"
+    "<arg name='resolution' type='u' direction='in'/>"
+    "<arg name='data' type='a(udu)' direction='out'/></method>"
+    "<method name='GetStatistics'>"
+    "<arg name='type' type='s' direction='in'/>"
+    "<arg name='data' type='a(dd)' direction='out'/></method>"
+    "<property name='NativePath' type='s' access='read'/>"
+    "<property name='Vendor' type='s' access='read'/>"
+    "<property name='Model' type='s' access='read'/>"
+    "<property name='Serial' type='s' access='read'/>"
+    "<property name='UpdateTime' type='t' access='read'/>"
+    "<property name='Type' type='u' access='read'/>"
+    "<property name='PowerSupply' type='b' access='read'/>"
+    "<property name='HasHistory' type='b' access='read'/>"
+    "<property name='HasStatistics' type='b' access='read'/>"
+    "<property name='Online' type='b' access='read'/>"
+    "<property name='Energy' type='d' access='read'/>"
+    "<property name='EnergyEmpty' type='d' access='read'/>"
+    "<property name='EnergyFull' type='d' access='read'/>"
+    "<property name='EnergyFullDesign' type='d' access='read'/>"
+    "<property name='EnergyRate' type='d' access='read'/>"
+    "<property name='Voltage' type='d' access='read'/>"
+    "<property name='TimeToEmpty' type='x' access='read'/>"
+    "<property name='TimeToFull' type='x' access='read'/>"
+    "<property name='Percentage' type='d' access='read'/>"
+    "<property name='IsPresent' type='b' access='read'/>"
+    "<property name='State' type='u' access='read'/>"
+    "<property name='IsRechargeable' type='b' access='read'/>"
+    "<property name='Capacity' type='d' access='read'/>"
+    "<property name='Technology' type='u' access='read'/>"
+    "<property name='WarningLevel' type='u' access='read'/>"
+    "<property name='BatteryLevel' type='u' access='read'/>"
+    "<property name='IconName' type='s' access='read'/>"
+    "</interface>"
+    "<interface name='org.freedesktop.UPower.KbdBacklight'>"
+    "<method name='GetMaxBrightness'>"
+    "<arg name='value' type='i' direction='out'/></method>"
+    "<method name='GetBrightness'>"
+    "<arg name='value' type='i' direction='out'/></method>"
+    "<method name='SetBrightness'>"
+    "<arg name='value' type='i' direction='in'/></method>"
+    "<signal name='BrightnessChanged'><arg name='value' type='i'/></signal>"
+    "<signal name='BrightnessChangedWithSource'>"
+    "<arg name='value' type='i'/><arg name='source' type='s'/></signal>"
+    "</interface>"
+    "<interface name='org.freedesktop.login1.Manager'>"
+    "<method name='Suspend'><arg name='interactive' type='b'/></method>"
+    "<method name='Hibernate'><arg name='interactive' type='b'/></method>"
+    "<method name='HybridSleep'><arg name='interactive' type='b'/></method>"
+    "<method name='PowerOff'><arg name='interactive' type='b'/></method>"
+    "<method name='Reboot'><arg name='interactive' type='b'/></method>"
+    "<method name='CanSuspend'>"
+    "<arg name='result' type='s' direction='out'/></method>"
+    "<method name='CanHibernate'>"
+    "<arg name='result' type='s' direction='out'/></method>"
+    "<method name='CanHybridSleep'>"
+    "<arg name='result' type='s' direction='out'/></method>"
+    "<method name='CanPowerOff'>"
+    "<arg name='result' type='s' direction='out'/></method>"
+    "<method name='Inhibit'>"
+    "<arg name='what' type='s' direction='in'/>"
+    "<arg name='who' type='s' direction='in'/>"
+    "<arg name='why' type='s' direction='in'/>"
+    "<arg name='mode' type='s' direction='in'/>"
+    "<arg name='fd' type='h' direction='out'/></method>"
+    "<signal name='PrepareForSleep'><arg name='start' type='b'/></signal>"
+    "</interface>"
+    "<interface name='org.gnome.SessionManager'>"
+    "<method name='RegisterClient'>"
+    "<arg name='app_id' type='s' direction='in'/>"
+    "<arg name='client_startup_id' type='s' direction='in'/>"
+    "<arg name='client_id' type='o' direction='out'/></method>"
+    "<method name='IsInhibited'>"
+    "<arg name='flags' type='u' direction='in'/>"
+    "<arg name='is_inhibited' type='b' direction='out'/></method>"
+    "<method name='GetInhibitors'>"
+    "<arg name='inhibitors' type='ao' direction='out'/></method>"
+    "<method name='Shutdown'/>"
+    "<method name='Logout'><arg name='mode' type='u' direction='in'/></method>"
+    "<signal name='InhibitorAdded'><arg name='id' type='o'/></signal>"
+    "<signal name='InhibitorRemoved'><arg name='id' type='o'/></signal>"
+    "</interface>"
+    "<interface name='org.gnome.SessionManager.Presence'>"
+    "<signal name='StatusChanged'><arg name='status' type='u'/></signal>"
+    "<property name='status' type='u' access='read'/>"
+    "</interface>"
+    "<interface name='org.gnome.SessionManager.Inhibitor'>"
+    "<method name='GetAppId'>"
+    "<arg name='app_id' type='s' direction='out'/></method>"
+    "<method name='GetReason'>"
+    "<arg name='reason' type='s' direction='out'/></method>"
+    "<method name='GetFlags'>"
+    "<arg name='flags' type='u' direction='out'/></method>"
+    "<method name='GetToplevelXid'>"
+    "<arg name='xid' type='u' direction='out'/></method>"
+    "</interface>"
+    "<interface name='org.gnome.SessionManager.ClientPrivate'>"
+    "<method name='EndSessionResponse'>"
+    "<arg name='is_ok' type='b' direction='in'/>"
+    "<arg name='reason' type='s' direction='in'/></method>"
+    "<signal name='Stop'/>"
+    "<signal name='QueryEndSession'><arg name='flags' type='u'/></signal>"
+    "<signal name='EndSession'><arg name='flags' type='u'/></signal>"
+    "<signal name='CancelEndSession'/>"
+    "</interface>"
+    "<interface name='org.mate.PowerManager.FakeServices'>"
+    "<method name='SetOnBattery'>"
+    "<arg name='on_battery' type='b' direction='in'/></method>"
+    "<method name='SetLidClosed'>"
+    "<arg name='lid_is_closed' type='b' direction='in'/></method>"
+    "<method name='SetDeviceProperty'>"
+    "<arg name='index' type='u' direction='in'/>"
+    "<arg name='name' type='s' direction='in'/>"
+    "<arg name='value' type='v' direction='in'/></method>"
+    "<method name='AddDevices'>"
+    "<arg name='kind' type='u' direction='in'/>"
+    "<arg name='count' type='u' direction='in'/></method>"
+    "<method name='RemoveDevices'>"
+    "<arg name='count' type='u' direction='in'/></method>"
+    "<method name='SetKbdBrightness'>"
+    "<arg name='value' type='i' direction='in'/></method>"
+    "<method name='AddInhibitor'>"
+    "<arg name='flags' type='u' direction='in'/>"
+    "<arg name='id' type='o' direction='out'/></method>"
+    "<method name='RemoveInhibitor'>"
+    "<arg name='id' type='o' direction='in'/></method>"
+    "<method name='SetPresence'>"
+    "<arg name='status' type='u' direction='in'/></method>"
+    "<method name='SetBacklight'>"
+    "<arg name='value' type='i' direction='in'/></method>"
+    "<method name='GetBacklight'>"
+    "<arg name='value' type='i' direction='out'/></method>"
+    "<method name='GetMaxBacklight'>"
+    "<arg name='value' type='i' direction='out'/></method>"
+    "<method name='GetCounters'>"
+    "<arg name='counters' type='a{su}' direction='out'/></method>"
+    "</interface>"
+    "</node>";
+
+typedef struct {
+  gchar *path;
+  const gchar *interface;
+  GHashTable *props; /* name → GVariant */
+  GDBusConnection *connection;
+  guint registration_id;
+  guint flags; /* inhibitors only */
+} GpmFakeObject;
+
+typedef struct {
+  GDBusNodeInfo *info;
+  GDBusConnection *system;
+  GDBusConnection *session;
+  GpmFakeObject *upower;
+  GpmFakeObject *display_device;
+  GpmFakeObject *line_power;
+  GPtrArray *devices;    /* of GpmFakeObject, not the above */
+  GPtrArray *inhibitors; /* of GpmFakeObject */
+  GPtrArray *objects;    /* of GpmFakeObject, which own the others */
+  GArray *inhibit_fds;   /* the ends logind would keep */
+  GpmFakeObject *presence;
+  GRand *rand;
+  guint device_next;
+  guint inhibitor_next;
+  guint client_next;
+  gint kbd_brightness;
+  gint kbd_max;
+  gint backlight; /* the display, through the helper */
+  gint backlight_max;
+  guint counters[6];
+  guint property_changes;
+  /* the harness waiting for the daemon to do something */
+  GMainLoop *loop;
+  guint waiting;
+  gboolean wait_all;
+  gint kbd_goal;       /* or -1 for any change */
+  gint backlight_goal; /* or -1 for any change */
+  gint64 action_time;
+  gint64 action_times[6];
+  gint64 resume_time;
+  /* what a monitor sees on the system bus, from its worker thread */
+  gint bus_messages;
+  gint upower_signals;
+  gint64 upower_deliveries;
+  GHashTable *upower_subscribers; /* unique name → itself */
+} GpmFakeServices;
+
+G_LOCK_DEFINE_STATIC(gpm_fake_monitor);
+
+static const gchar *gpm_fake_action_names[] = {
+    "suspend", "hibernate", "power-off", "kbd-brightness", "inhibit",
+    "backlight"};
+
+/**
+ * gpm_fake_object_free:
+ **/
+static void gpm_fake_object_free(GpmFakeObject *obj) {
+  if (obj->registration_id != 0)
+    g_dbus_connection_unregister_object(obj->connection, obj->registration_id);
+  g_hash_table_unref(obj->props);
+  g_free(obj->path);
+  g_free(obj);
+}
+
+/**
+ * gpm_fake_services_reached:
+ *
+ * Return value: %TRUE if a brightness the harness waits for has got to
+ *               the level it wants, or it wants any change at all
+ **/
+static gboolean gpm_fake_services_reached(GpmFakeServices *services,
+                                          GpmFakeAction action) {
+  if (action == GPM_FAKE_ACTION_KBD_BRIGHTNESS && services->kbd_goal >= 0)
+    return services->kbd_brightness == services->kbd_goal;
+  if (action == GPM_FAKE_ACTION_BACKLIGHT && services->backlight_goal >= 0)
+    return services->backlight == services->backlight_goal;
+  return TRUE;
+}
+
+/**
+ * gpm_fake_services_action:
+ *
+ * Counts an action the daemon asked for, and wakes the harness once it
+ * has seen what it was waiting for.
+ **/
+static void gpm_fake_services_action(GpmFakeServices *services,
+                                     GpmFakeAction action) {
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(services->counters); i++) {
+    if (action == (1u << i)) break;
+  }
+  if (i == G_N_ELEMENTS(services->counters)) return;
+  services->counters[i]++;
+  if ((services->waiting & action) == 0) return;
+  if (!gpm_fake_services_reached(services, action)) return;
+  services->action_times[i] = g_get_monotonic_time();
+  services->action_time = services->action_times[i];
+  services->waiting &= services->wait_all ? ~action : 0;
+  if (services->waiting == 0) g_main_loop_quit(services->loop);
+}
+
+/**
+ * gpm_fake_object_set:
+ * @obj: The object to change
+ * @name: The D-Bus property name
+ * @value: The new value, which is sunk
+ * @emit: If PropertiesChanged should be sent now
+ **/
+static void gpm_fake_object_set(GpmFakeServices *services, GpmFakeObject *obj,
+                                const gchar *name, GVariant *value,
+                                gboolean emit) {
+  GVariantBuilder builder;
+
+  g_variant_ref_sink(value);
+  g_hash_table_insert(obj->props, g_strdup(name), value);
+  if (!emit || obj->registration_id == 0) return;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&builder, "{sv}", name, value);
+  g_dbus_connection_emit_signal(
+      obj->connection, NULL, obj->path, "org.freedesktop.DBus.Properties",
+      "PropertiesChanged",
+      g_variant_new("(sa{sv}as)", obj->interface, &builder, NULL), NULL);
+  services->property_changes++;
+}
+
+/**
+ * gpm_fake_object_get_boolean:
+ **/
+static gboolean gpm_fake_object_get_boolean(GpmFakeObject *obj,
+                                            const gchar *name) {
+  GVariant *value = g_hash_table_lookup(obj->props, name);
+  return value != NULL && g_variant_get_boolean(value);
+}
+
+/**
+ * gpm_fake_object_get_double:
+ **/
+static gdouble gpm_fake_object_get_double(GpmFakeObject *obj,
+                                          const gchar *name) {
+  GVariant *value = g_hash_table_lookup(obj->props, name);
+  return value != NULL ? g_variant_get_double(value) : 0.0;
+}
+
+/**
+ * gpm_fake_services_method_call:
+ **/
+static void gpm_fake_services_method_call(
+    GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+    const gchar *interface_name, const gchar *method_name,
+    GVariant *parameters, GDBusMethodInvocation *invocation,
+    gpointer user_data);
+
+/**
+ * gpm_fake_services_get_property:
+ **/
+static GVariant *gpm_fake_services_get_property(
+    GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+    const gchar *interface_name, const gchar *property_name, GError **error,
+    gpointer user_data) {
+  GpmFakeObject *obj = user_data;
+  GVariant *value;
+
+  value = g_hash_table_lookup(obj->props, property_name);
+  if (value == NULL) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+                "no property %s on %s", property_name, object_path);
+    return NULL;
+  }
+  return g_variant_ref(value);
+}
+
+static const GDBusInterfaceVTable gpm_fake_services_vtable = {
+    gpm_fake_services_method_call, gpm_fake_services_get_property, NULL};
+
+/* the vtable only passes the object, so keep the services for it */
+static GpmFakeServices *gpm_fake_services = NULL;
+
+/**
+ * gpm_fake_services_export:
+ * @connection: The bus to export on
+ * @path: The object path
+ * @interface: The interface, which must be in the introspection data
+ *
+ * Return value: the new object, owned by @services
+ **/
+static GpmFakeObject *gpm_fake_services_export(GpmFakeServices *services,
+                                               GDBusConnection *connection,
+                                               const gchar *path,
+                                               const gchar *interface) {
+  GDBusInterfaceInfo *info;
+  GpmFakeObject *obj;
+  GError *error = NULL;
+
+  obj = g_new0(GpmFakeObject, 1);
+  obj->path = g_strdup(path);
+  obj->interface = interface;
+  obj->connection = connection;
+  obj->props = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                     (GDestroyNotify)g_variant_unref);
+  g_ptr_array_add(services->objects, obj);
+
+  info = g_dbus_node_info_lookup_interface(services->info, interface);
+  obj->registration_id = g_dbus_connection_register_object(
+      connection, path, info, &gpm_fake_services_vtable, obj, NULL, &error);
+  if (obj->registration_id == 0) {
+    g_warning("failed to export %s: %s", path, error->message);
+    g_error_free(error);
+  }
+  return obj;
+}
+
+/**
+ * gpm_fake_services_unexport:
+ **/
+static void gpm_fake_services_unexport(GpmFakeServices *services,
+                                       GpmFakeObject *obj) {
+  g_ptr_array_remove(services->objects, obj);
+}
+
+/**
+ * gpm_fake_services_device_set_defaults:
+ **/
+static void gpm_fake_services_device_set_defaults(GpmFakeServices *services,
+                                                  GpmFakeObject *obj,
+                                                  UpDeviceKind kind,
+                                                  const gchar *native_path) {
+  gboolean on_battery;
+  gboolean is_battery;
+  gdouble percentage;
+
+  on_battery = gpm_fake_object_get_boolean(services->upower, "OnBattery");
+  is_battery = (kind != UP_DEVICE_KIND_LINE_POWER);
+  percentage = is_battery ? g_rand_double_range(services->rand, 20, 100) : 0;
+
+  gpm_fake_object_set(services, obj, "NativePath",
+                      g_variant_new_string(native_path), FALSE);
+  gpm_fake_object_set(services, obj, "Vendor", g_variant_new_string("MATE"),
+                      FALSE);
+  gpm_fake_object_set(services, obj, "Model", g_variant_new_string("Fake"),
+                      FALSE);
+  gpm_fake_object_set(services, obj, "Serial", g_variant_new_string(obj->path),
+                      FALSE);
+  gpm_fake_object_set(services, obj, "UpdateTime",
+                      g_variant_new_uint64(g_get_real_time() / G_USEC_PER_SEC),
+                      FALSE);
+  gpm_fake_object_set(services, obj, "Type", g_variant_new_uint32(kind), FALSE);
+  gpm_fake_object_set(
+      services, obj, "PowerSupply",
+      g_variant_new_boolean(kind == UP_DEVICE_KIND_BATTERY ||
+                            kind == UP_DEVICE_KIND_LINE_POWER),
+      FALSE);
+  gpm_fake_object_set(services, obj, "HasHistory",
+                      g_variant_new_boolean(FALSE), FALSE);
+  gpm_fake_object_set(services, obj, "HasStatistics",
+                      g_variant_new_boolean(FALSE), FALSE);
+  gpm_fake_object_set(services, obj, "Online",
+                      g_variant_new_boolean(!on_battery), FALSE);
+  gpm_fake_object_set(services, obj, "Energy",
+                      g_variant_new_double(percentage / 2), FALSE);
+  gpm_fake_object_set(services, obj, "EnergyEmpty", g_variant_new_double(0),
+                      FALSE);
+  gpm_fake_object_set(services, obj, "EnergyFull",
+                      g_variant_new_double(is_battery ? 50 : 0), FALSE);
+  gpm_fake_object_set(services, obj, "EnergyFullDesign",
+                      g_variant_new_double(is_battery ? 55 : 0), FALSE);
+  gpm_fake_object_set(services, obj, "EnergyRate",
+                      g_variant_new_double(is_battery ? 10 : 0), FALSE);
+  gpm_fake_object_set(services, obj, "Voltage", g_variant_new_double(12),
+                      FALSE);
+  gpm_fake_object_set(services, obj, "TimeToEmpty",
+                      g_variant_new_int64(on_battery ? percentage * 180 : 0),
+                      FALSE);
+  gpm_fake_object_set(
+      services, obj, "TimeToFull",
+      g_variant_new_int64(on_battery ? 0 : (100 - percentage) * 180), FALSE);
+  gpm_fake_object_set(services, obj, "Percentage",
+                      g_variant_new_double(percentage), FALSE);
+  gpm_fake_object_set(services, obj, "IsPresent", g_variant_new_boolean(TRUE),
+                      FALSE);
+  gpm_fake_object_set(
+      services, obj, "State",
+      g_variant_new_uint32(!is_battery   ? UP_DEVICE_STATE_UNKNOWN
+                           : on_battery ? UP_DEVICE_STATE_DISCHARGING
+                                        : UP_DEVICE_STATE_CHARGING),
+      FALSE);
+  gpm_fake_object_set(services, obj, "IsRechargeable",
+                      g_variant_new_boolean(is_battery), FALSE);
+  gpm_fake_object_set(services, obj, "Capacity",
+                      g_variant_new_double(is_battery ? 90.9 : 0), FALSE);
+  gpm_fake_object_set(
+      services, obj, "Technology",
+      g_variant_new_uint32(is_battery ? UP_DEVICE_TECHNOLOGY_LITHIUM_ION
+                                      : UP_DEVICE_TECHNOLOGY_UNKNOWN),
+      FALSE);
+  gpm_fake_object_set(services, obj, "WarningLevel",
+                      g_variant_new_uint32(UP_DEVICE_LEVEL_NONE), FALSE);
+  gpm_fake_object_set(services, obj, "BatteryLevel",
+                      g_variant_new_uint32(UP_DEVICE_LEVEL_NONE), FALSE);
+  gpm_fake_object_set(services, obj, "IconName", g_variant_new_string(""),
+                      FALSE);
+}
+
+/**
+ * gpm_fake_services_add_device:
+ **/
+static GpmFakeObject *gpm_fake_services_add_device(GpmFakeServices *services,
+                                                   UpDeviceKind kind) {
+  GpmFakeObject *obj;
+  gchar *native_path;
+  gchar *path;
+
+  native_path =
+      g_strdup_printf("%s_%u", up_device_kind_to_string(kind),
+                      services->device_next++);
+  g_strdelimit(native_path, "-", '_');
+  path = g_strconcat(GPM_FAKE_UPOWER_DEVICE_PREFIX, native_path, NULL);
+  obj = gpm_fake_services_export(services, services->system, path,
+                                 "org.freedesktop.UPower.Device");
+  gpm_fake_services_device_set_defaults(services, obj, kind, native_path);
+  g_ptr_array_add(services->devices, obj);
+  g_dbus_connection_emit_signal(
+      services->system, NULL, GPM_FAKE_UPOWER_PATH, "org.freedesktop.UPower",
+      "DeviceAdded", g_variant_new("(o)", path), NULL);
+  g_free(native_path);
+  g_free(path);
+  return obj;
+}
+
+/**
+ * gpm_fake_services_remove_device:
+ **/
+static void gpm_fake_services_remove_device(GpmFakeServices *services) {
+  GpmFakeObject *obj;
+
+  if (services->devices->len == 0) return;
+  obj = g_ptr_array_steal_index(services->devices, services->devices->len - 1);
+  g_dbus_connection_emit_signal(
+      services->system, NULL, GPM_FAKE_UPOWER_PATH, "org.freedesktop.UPower",
+      "DeviceRemoved", g_variant_new("(o)", obj->path), NULL);
+  gpm_fake_services_unexport(services, obj);
+}
+
+/**
+ * gpm_fake_services_update_display_device:
+ *
+ * Makes the display device follow the first battery, which is all that the
+ * daemon needs for a single battery laptop.
+ **/
+static void gpm_fake_services_update_display_device(GpmFakeServices *services,
+                                                    GpmFakeObject *battery) {
+  static const gchar *names[] = {"Percentage", "Energy", "EnergyRate",
+                                 "TimeToEmpty", "TimeToFull", "State"};
+  GVariant *value;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(names); i++) {
+    value = g_hash_table_lookup(battery->props, names[i]);
+    if (value == NULL) continue;
+    gpm_fake_object_set(services, services->display_device, names[i],
+                        g_variant_ref(value), TRUE);
+    g_variant_unref(value);
+  }
+}
+
+/**
+ * gpm_fake_services_get_battery:
+ **/
+static GpmFakeObject *gpm_fake_services_get_battery(GpmFakeServices *services) {
+  GpmFakeObject *obj;
+  GVariant *kind;
+  guint i;
+
+  for (i = 0; i < services->devices->len; i++) {
+    obj = g_ptr_array_index(services->devices, i);
+    kind = g_hash_table_lookup(obj->props, "Type");
+    if (g_variant_get_uint32(kind) == UP_DEVICE_KIND_BATTERY) return obj;
+  }
+  return NULL;
+}
+
+/**
+ * gpm_fake_services_set_on_battery:
+ *
+ * Changes the devices first, then the daemon property, as UPower does.
+ **/
+static void gpm_fake_services_set_on_battery(GpmFakeServices *services,
+                                             gboolean on_battery) {
+  GpmFakeObject *obj;
+  GpmFakeObject *battery;
+  guint i;
+
+  gpm_fake_object_set(services, services->line_power, "Online",
+                      g_variant_new_boolean(!on_battery), TRUE);
+  for (i = 0; i < services->devices->len; i++) {
+    obj = g_ptr_array_index(services->devices, i);
+    if (!gpm_fake_object_get_boolean(obj, "PowerSupply")) continue;
+    gpm_fake_object_set(services, obj, "State",
+                        g_variant_new_uint32(on_battery
+                                                 ? UP_DEVICE_STATE_DISCHARGING
+                                                 : UP_DEVICE_STATE_CHARGING),
+                        TRUE);
+  }
+  battery = gpm_fake_services_get_battery(services);
+  if (battery != NULL)
+    gpm_fake_services_update_display_device(services, battery);
+  gpm_fake_object_set(services, services->upower, "OnBattery",
+                      g_variant_new_boolean(on_battery), TRUE);
+}
+
+/**
+ * gpm_fake_services_change_device:
+ *
+ * Moves one device along its discharge or charge curve.
+ **/
+static void gpm_fake_services_change_device(GpmFakeServices *services,
+                                            GpmFakeObject *obj) {
+  gboolean on_battery;
+  gdouble percentage;
+
+  on_battery = gpm_fake_object_get_boolean(services->upower, "OnBattery");
+  percentage = gpm_fake_object_get_double(obj, "Percentage");
+  percentage += on_battery ? -0.1 : 0.1;
+  if (percentage < 1) percentage = 100;
+  if (percentage > 100) percentage = 1;
+
+  gpm_fake_object_set(services, obj, "Percentage",
+                      g_variant_new_double(percentage), TRUE);
+  gpm_fake_object_set(services, obj, "Energy",
+                      g_variant_new_double(percentage / 2), TRUE);
+  gpm_fake_object_set(
+      services, obj, "EnergyRate",
+      g_variant_new_double(g_rand_double_range(services->rand, 5, 15)), TRUE);
+  gpm_fake_object_set(
+      services, obj, "TimeToEmpty",
+      g_variant_new_int64(on_battery ? percentage * 180 : 0), TRUE);
+  gpm_fake_object_set(
+      services, obj, "TimeToFull",
+      g_variant_new_int64(on_battery ? 0 : (100 - percentage) * 180), TRUE);
+  gpm_fake_object_set(services, obj, "UpdateTime",
+                      g_variant_new_uint64(g_get_real_time() / G_USEC_PER_SEC),
+                      TRUE);
+  if (obj == gpm_fake_services_get_battery(services))
+    gpm_fake_services_update_display_device(services, obj);
+}
+
+/**
+ * gpm_fake_services_change_cb:
+ **/
+static gboolean gpm_fake_services_change_cb(GpmFakeServices *services) {
+  guint i;
+
+  if (services->devices->len == 0) return G_SOURCE_CONTINUE;
+  i = g_rand_int_range(services->rand, 0, services->devices->len);
+  gpm_fake_services_change_device(services,
+                                  g_ptr_array_index(services->devices, i));
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * gpm_fake_services_add_inhibitor:
+ **/
+static GpmFakeObject *gpm_fake_services_add_inhibitor(
+    GpmFakeServices *services, guint flags) {
+  GpmFakeObject *obj;
+  gchar *path;
+
+  path = g_strdup_printf(GPM_FAKE_SESSION_PATH "/Inhibitor%u",
+                         ++services->inhibitor_next);
+  obj = gpm_fake_services_export(services, services->session, path,
+                                 "org.gnome.SessionManager.Inhibitor");
+  obj->flags = flags;
+  g_ptr_array_add(services->inhibitors, obj);
+  g_dbus_connection_emit_signal(
+      services->session, NULL, GPM_FAKE_SESSION_PATH,
+      "org.gnome.SessionManager", "InhibitorAdded", g_variant_new("(o)", path),
+      NULL);
+  g_free(path);
+  return obj;
+}
+
+/**
+ * gpm_fake_services_remove_inhibitor:
+ **/
+static gboolean gpm_fake_services_remove_inhibitor(GpmFakeServices *services,
+                                                   const gchar *path) {
+  GpmFakeObject *obj;
+  guint i;
+
+  for (i = 0; i < services->inhibitors->len; i++) {
+    obj = g_ptr_array_index(services->inhibitors, i);
+    if (g_strcmp0(obj->path, path) != 0) continue;
+    g_dbus_connection_emit_signal(
+        services->session, NULL, GPM_FAKE_SESSION_PATH,
+        "org.gnome.SessionManager", "InhibitorRemoved",
+        g_variant_new("(o)", obj->path), NULL);
+    g_ptr_array_remove_index(services->inhibitors, i);
+    gpm_fake_services_unexport(services, obj);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * gpm_fake_services_churn_cb:
+ *
+ * Keeps a handful of inhibitors coming and going, like a desktop playing
+ * media and copying files does.
+ **/
+static gboolean gpm_fake_services_churn_cb(GpmFakeServices *services) {
+  GpmFakeObject *obj;
+  gchar *path;
+  guint i;
+
+  if (services->inhibitors->len < 2 ||
+      (services->inhibitors->len < 8 && g_rand_boolean(services->rand))) {
+    /* anything but suspend, so the harness is never blocked */
+    gpm_fake_services_add_inhibitor(
+        services, g_rand_int_range(services->rand, 1, 16) &
+                      ~GPM_FAKE_SESSION_INHIBIT_SUSPEND);
+    return G_SOURCE_CONTINUE;
+  }
+  i = g_rand_int_range(services->rand, 0, services->inhibitors->len);
+  obj = g_ptr_array_index(services->inhibitors, i);
+  path = g_strdup(obj->path);
+  gpm_fake_services_remove_inhibitor(services, path);
+  g_free(path);
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * gpm_fake_services_set_kbd_brightness:
+ **/
+static void gpm_fake_services_set_kbd_brightness(GpmFakeServices *services,
+                                                 gint value,
+                                                 const gchar *source) {
+  services->kbd_brightness = CLAMP(value, 0, services->kbd_max);
+  g_dbus_connection_emit_signal(
+      services->system, NULL, GPM_FAKE_UPOWER_PATH "/KbdBacklight",
+      "org.freedesktop.UPower.KbdBacklight", "BrightnessChanged",
+      g_variant_new("(i)", services->kbd_brightness), NULL);
+  if (source == NULL) return;
+  g_dbus_connection_emit_signal(
+      services->system, NULL, GPM_FAKE_UPOWER_PATH "/KbdBacklight",
+      "org.freedesktop.UPower.KbdBacklight", "BrightnessChangedWithSource",
+      g_variant_new("(is)", services->kbd_brightness, source), NULL);
+}
+
+/**
+ * gpm_fake_services_set_presence:
+ **/
+static void gpm_fake_services_set_presence(GpmFakeServices *services,
+                                           guint status) {
+  gpm_fake_object_set(services, services->presence, "status",
+                      g_variant_new_uint32(status), FALSE);
+  g_dbus_connection_emit_signal(
+      services->session, NULL, GPM_FAKE_SESSION_PATH "/Presence",
+      "org.gnome.SessionManager.Presence", "StatusChanged",
+      g_variant_new("(u)", status), NULL);
+}
+
+/**
+ * gpm_fake_services_sleep:
+ *
+ * Pretends to suspend, telling everyone listening before and after.
+ **/
+static void gpm_fake_services_sleep(GpmFakeServices *services,
+                                    GpmFakeAction action) {
+  gpm_fake_services_action(services, action);
+  g_dbus_connection_emit_signal(
+      services->system, NULL, GPM_FAKE_LOGIN1_PATH,
+      "org.freedesktop.login1.Manager", "PrepareForSleep",
+      g_variant_new("(b)", TRUE), NULL);
+
+  /* like most firmware, lose both backlights without telling anyone */
+  services->backlight = services->backlight_max;
+  services->kbd_brightness = 0;
+  services->resume_time = g_get_monotonic_time();
+  g_dbus_connection_emit_signal(
+      services->system, NULL, GPM_FAKE_LOGIN1_PATH,
+      "org.freedesktop.login1.Manager", "PrepareForSleep",
+      g_variant_new("(b)", FALSE), NULL);
+}
+
+/**
+ * gpm_fake_services_inhibit:
+ *
+ * Hands out one end of a pipe, as logind does, keeping the other.
+ **/
+static void gpm_fake_services_inhibit(GpmFakeServices *services,
+                                      GDBusMethodInvocation *invocation) {
+  GUnixFDList *fd_list;
+  GError *error = NULL;
+  gint fds[2];
+
+  if (!g_unix_open_pipe(fds, FD_CLOEXEC, &error)) {
+    g_dbus_method_invocation_take_error(invocation, error);
+    return;
+  }
+  g_array_append_val(services->inhibit_fds, fds[0]);
+  fd_list = g_unix_fd_list_new_from_array(&fds[1], 1);
+  g_dbus_method_invocation_return_value_with_unix_fd_list(
+      invocation, g_variant_new("(h)", 0), fd_list);
+  g_object_unref(fd_list);
+  gpm_fake_services_action(services, GPM_FAKE_ACTION_INHIBIT);
+}
+
+/**
+ * gpm_fake_services_control:
+ *
+ * The interface tests use to script the other services.
+ **/
+static void gpm_fake_services_control(GpmFakeServices *services,
+                                      const gchar *method_name,
+                                      GVariant *parameters,
+                                      GDBusMethodInvocation *invocation) {
+  GDBusPropertyInfo *info;
+  GVariantBuilder builder;
+  GpmFakeObject *obj;
+  GVariant *value;
+  const gchar *name;
+  gboolean enabled;
+  guint index;
+  guint kind;
+  guint count;
+  guint i;
+  gint brightness;
+
+  if (g_strcmp0(method_name, "SetOnBattery") == 0) {
+    g_variant_get(parameters, "(b)", &enabled);
+    gpm_fake_services_set_on_battery(services, enabled);
+  } else if (g_strcmp0(method_name, "SetLidClosed") == 0) {
+    g_variant_get(parameters, "(b)", &enabled);
+    gpm_fake_object_set(services, services->upower, "LidIsClosed",
+                        g_variant_new_boolean(enabled), TRUE);
+  } else if (g_strcmp0(method_name, "SetDeviceProperty") == 0) {
+    g_variant_get(parameters, "(u&sv)", &index, &name, &value);
+    info = g_dbus_interface_info_lookup_property(
+        g_dbus_node_info_lookup_interface(services->info,
+                                          "org.freedesktop.UPower.Device"),
+        name);
+    if (index >= services->devices->len || info == NULL ||
+        !g_variant_is_of_type(value, G_VARIANT_TYPE(info->signature))) {
+      g_variant_unref(value);
+      g_dbus_method_invocation_return_error(
+          invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+          "no device %u or property %s of that type", index, name);
+      return;
+    }
+    obj = g_ptr_array_index(services->devices, index);
+    gpm_fake_object_set(services, obj, name, value, TRUE);
+    g_variant_unref(value);
+    if (obj == gpm_fake_services_get_battery(services))
+      gpm_fake_services_update_display_device(services, obj);
+  } else if (g_strcmp0(method_name, "AddDevices") == 0) {
+    g_variant_get(parameters, "(uu)", &kind, &count);
+    for (i = 0; i < count; i++) gpm_fake_services_add_device(services, kind);
+  } else if (g_strcmp0(method_name, "RemoveDevices") == 0) {
+    g_variant_get(parameters, "(u)", &count);
+    for (i = 0; i < count; i++) gpm_fake_services_remove_device(services);
+  } else if (g_strcmp0(method_name, "SetKbdBrightness") == 0) {
+    g_variant_get(parameters, "(i)", &brightness);
+    gpm_fake_services_set_kbd_brightness(services, brightness, "external");
+  } else if (g_strcmp0(method_name, "AddInhibitor") == 0) {
+    g_variant_get(parameters, "(u)", &count);
+    obj = gpm_fake_services_add_inhibitor(services, count);
+    g_dbus_method_invocation_return_value(invocation,
+                                          g_variant_new("(o)", obj->path));
+    return;
+  } else if (g_strcmp0(method_name, "RemoveInhibitor") == 0) {
+    g_variant_get(parameters, "(&o)", &name);
+    if (!gpm_fake_services_remove_inhibitor(services, name)) {
+      g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                            G_DBUS_ERROR_INVALID_ARGS,
+                                            "no inhibitor %s", name);
+      return;
+    }
+  } else if (g_strcmp0(method_name, "SetPresence") == 0) {
+    g_variant_get(parameters, "(u)", &count);
+    gpm_fake_services_set_presence(services, count);
+  } else if (g_strcmp0(method_name, "SetBacklight") == 0) {
+    g_variant_get(parameters, "(i)", &brightness);
+    services->backlight = CLAMP(brightness, 0, services->backlight_max);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+    gpm_fake_services_action(services, GPM_FAKE_ACTION_BACKLIGHT);
+    return;
+  } else if (g_strcmp0(method_name, "GetBacklight") == 0 ||
+             g_strcmp0(method_name, "GetMaxBacklight") == 0) {
+    g_dbus_method_invocation_return_value(
+        invocation,
+        g_variant_new("(i)", g_strcmp0(method_name, "GetBacklight") == 0
+                                 ? services->backlight
+                                 : services->backlight_max));
+    return;
+  } else if (g_strcmp0(method_name, "GetCounters") == 0) {
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{su}"));
+    for (i = 0; i < G_N_ELEMENTS(services->counters); i++)
+      g_variant_builder_add(&builder, "{su}", gpm_fake_action_names[i],
+                            services->counters[i]);
+    g_variant_builder_add(&builder, "{su}", "property-changes",
+                          services->property_changes);
+    g_variant_builder_add(&builder, "{su}", "devices",
+                          services->devices->len);
+    g_variant_builder_add(&builder, "{su}", "inhibitors",
+                          services->inhibitors->len);
+    g_dbus_method_invocation_return_value(invocation,
+                                          g_variant_new("(a{su})", &builder));
+    return;
+  }
+  g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+/**
+ * gpm_fake_services_method_call:
+ **/
+static void gpm_fake_services_method_call(
+    GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+    const gchar *interface_name, const gchar *method_name,
+    GVariant *parameters, GDBusMethodInvocation *invocation,
+    gpointer user_data) {
+  GpmFakeServices *services = gpm_fake_services;
+  GpmFakeObject *obj = user_data;
+  GVariantBuilder builder;
+  GpmFakeObject *tmp;
+  gchar *path;
+  guint flags;
+  guint i;
+  gint value;
+  gboolean ret = FALSE;
+
+  g_debug("%s.%s on %s", interface_name, method_name, object_path);
+
+  /* UPower */
+  if (g_strcmp0(interface_name, "org.freedesktop.UPower") == 0) {
+    if (g_strcmp0(method_name, "EnumerateDevices") == 0) {
+      g_variant_builder_init(&builder, G_VARIANT_TYPE("ao"));
+      g_variant_builder_add(&builder, "o", services->line_power->path);
+      for (i = 0; i < services->devices->len; i++) {
+        tmp = g_ptr_array_index(services->devices, i);
+        g_variant_builder_add(&builder, "o", tmp->path);
+      }
+      g_dbus_method_invocation_return_value(invocation,
+                                            g_variant_new("(ao)", &builder));
+    } else if (g_strcmp0(method_name, "GetDisplayDevice") == 0) {
+      g_dbus_method_invocation_return_value(
+          invocation, g_variant_new("(o)", services->display_device->path));
+    } else {
+      g_dbus_method_invocation_return_value(invocation,
+                                            g_variant_new("(s)", "PowerOff"));
+    }
+    return;
+  }
+  if (g_strcmp0(interface_name, "org.freedesktop.UPower.Device") == 0) {
+    if (g_strcmp0(method_name, "GetHistory") == 0) {
+      g_dbus_method_invocation_return_value(
+          invocation, g_variant_new_parsed("(@a(udu) [],)"));
+    } else if (g_strcmp0(method_name, "GetStatistics") == 0) {
+      g_dbus_method_invocation_return_value(
+          invocation, g_variant_new_parsed("(@a(dd) [],)"));
+    } else {
+      g_dbus_method_invocation_return_value(invocation, NULL);
+    }
+    return;
+  }
+  if (g_strcmp0(interface_name, "org.freedesktop.UPower.KbdBacklight") == 0) {
+    if (g_strcmp0(method_name, "SetBrightness") == 0) {
+      g_variant_get(parameters, "(i)", &value);
+      gpm_fake_services_set_kbd_brightness(services, value, NULL);
+      g_dbus_method_invocation_return_value(invocation, NULL);
+      gpm_fake_services_action(services, GPM_FAKE_ACTION_KBD_BRIGHTNESS);
+      return;
+    }
+    g_dbus_method_invocation_return_value(
+        invocation,
+        g_variant_new("(i)", g_strcmp0(method_name, "GetMaxBrightness") == 0
+                                 ? services->kbd_max
+                                 : services->kbd_brightness));
+    return;
+  }
+
+  /* logind */
+  if (g_strcmp0(interface_name, "org.freedesktop.login1.Manager") == 0) {
+    if (g_str_has_prefix(method_name, "Can")) {
+      g_dbus_method_invocation_return_value(invocation,
+                                            g_variant_new("(s)", "yes"));
+    } else if (g_strcmp0(method_name, "Inhibit") == 0) {
+      gpm_fake_services_inhibit(services, invocation);
+    } else {
+      /* the caller resumes once this returns, so sleep first */
+      if (g_strcmp0(method_name, "Suspend") == 0)
+        gpm_fake_services_sleep(services, GPM_FAKE_ACTION_SUSPEND);
+      else if (g_strcmp0(method_name, "Hibernate") == 0 ||
+               g_strcmp0(method_name, "HybridSleep") == 0)
+        gpm_fake_services_sleep(services, GPM_FAKE_ACTION_HIBERNATE);
+      else
+        gpm_fake_services_action(services, GPM_FAKE_ACTION_POWER_OFF);
+      g_dbus_method_invocation_return_value(invocation, NULL);
+    }
+    return;
+  }
+
+  /* mate-session */
+  if (g_strcmp0(interface_name, "org.gnome.SessionManager") == 0) {
+    if (g_strcmp0(method_name, "RegisterClient") == 0) {
+      path = g_strdup_printf(GPM_FAKE_SESSION_PATH "/Client%u",
+                             ++services->client_next);
+      gpm_fake_services_export(services, services->session, path,
+                               "org.gnome.SessionManager.ClientPrivate");
+      g_dbus_method_invocation_return_value(invocation,
+                                            g_variant_new("(o)", path));
+      g_free(path);
+    } else if (g_strcmp0(method_name, "IsInhibited") == 0) {
+      g_variant_get(parameters, "(u)", &flags);
+      for (i = 0; i < services->inhibitors->len; i++) {
+        tmp = g_ptr_array_index(services->inhibitors, i);
+        if ((tmp->flags & flags) != 0) ret = TRUE;
+      }
+      g_dbus_method_invocation_return_value(invocation,
+                                            g_variant_new("(b)", ret));
+    } else if (g_strcmp0(method_name, "GetInhibitors") == 0) {
+      g_variant_builder_init(&builder, G_VARIANT_TYPE("ao"));
+      for (i = 0; i < services->inhibitors->len; i++) {
+        tmp = g_ptr_array_index(services->inhibitors, i);
+        g_variant_builder_add(&builder, "o", tmp->path);
+      }
+      g_dbus_method_invocation_return_value(invocation,
+                                            g_variant_new("(ao)", &builder));
+    } else {
+      g_dbus_method_invocation_return_value(invocation, NULL);
+    }
+    return;
+  }
+  if (g_strcmp0(interface_name, "org.gnome.SessionManager.Inhibitor") == 0) {
+    if (g_strcmp0(method_name, "GetFlags") == 0)
+      g_dbus_method_invocation_return_value(invocation,
+                                            g_variant_new("(u)", obj->flags));
+    else if (g_strcmp0(method_name, "GetToplevelXid") == 0)
+      g_dbus_method_invocation_return_value(invocation,
+                                            g_variant_new("(u)", 0));
+    else
+      g_dbus_method_invocation_return_value(
+          invocation, g_variant_new("(s)", "mate-power-fake-services"));
+    return;
+  }
+
+  if (g_strcmp0(interface_name, GPM_FAKE_CONTROL_SERVICE) == 0) {
+    gpm_fake_services_control(services, method_name, parameters, invocation);
+    return;
+  }
+
+  g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+/**
+ * gpm_fake_services_own_name:
+ *
+ * Takes the name synchronously, so that the daemon can be started as soon
+ * as this returns.
+ **/
+static gboolean gpm_fake_services_own_name(GDBusConnection *connection,
+                                           const gchar *name, GError **error) {
+  GVariant *res;
+  guint reply;
+
+  res = g_dbus_connection_call_sync(
+      connection, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+      "org.freedesktop.DBus", "RequestName",
+      g_variant_new("(su)", name, 0x4 /* DO_NOT_QUEUE */),
+      G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, error);
+  if (res == NULL) return FALSE;
+  g_variant_get(res, "(u)", &reply);
+  g_variant_unref(res);
+  if (reply != 1 /* PRIMARY_OWNER */) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_ADDRESS_IN_USE,
+                "%s is already owned", name);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * gpm_fake_services_start:
+ **/
+static gboolean gpm_fake_services_start(GpmFakeServices *services,
+                                        guint devices, GError **error) {
+  static const UpDeviceKind kinds[] = {
+      UP_DEVICE_KIND_BATTERY, UP_DEVICE_KIND_MOUSE, UP_DEVICE_KIND_KEYBOARD,
+      UP_DEVICE_KIND_UPS, UP_DEVICE_KIND_PHONE};
+  GpmFakeObject *obj;
+  guint i;
+
+  services->system = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, error);
+  if (services->system == NULL) return FALSE;
+  services->session = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, error);
+  if (services->session == NULL) return FALSE;
+
+  /* UPower */
+  services->upower =
+      gpm_fake_services_export(services, services->system,
+                               GPM_FAKE_UPOWER_PATH, "org.freedesktop.UPower");
+  gpm_fake_object_set(services, services->upower, "DaemonVersion",
+                      g_variant_new_string("0.99.11"), FALSE);
+  gpm_fake_object_set(services, services->upower, "OnBattery",
+                      g_variant_new_boolean(FALSE), FALSE);
+  gpm_fake_object_set(services, services->upower, "LidIsClosed",
+                      g_variant_new_boolean(FALSE), FALSE);
+  gpm_fake_object_set(services, services->upower, "LidIsPresent",
+                      g_variant_new_boolean(TRUE), FALSE);
+  gpm_fake_services_export(services, services->system,
+                           GPM_FAKE_UPOWER_PATH "/KbdBacklight",
+                           "org.freedesktop.UPower.KbdBacklight");
+  services->line_power = gpm_fake_services_export(
+      services, services->system, GPM_FAKE_UPOWER_DEVICE_PREFIX "line_power_AC",
+      "org.freedesktop.UPower.Device");
+  gpm_fake_services_device_set_defaults(services, services->line_power,
+                                        UP_DEVICE_KIND_LINE_POWER, "AC");
+  services->display_device = gpm_fake_services_export(
+      services, services->system, GPM_FAKE_UPOWER_DEVICE_PREFIX "DisplayDevice",
+      "org.freedesktop.UPower.Device");
+  gpm_fake_services_device_set_defaults(services, services->display_device,
+                                        UP_DEVICE_KIND_BATTERY, "");
+  for (i = 0; i < devices; i++) {
+    obj = gpm_fake_services_add_device(services,
+                                       kinds[i % G_N_ELEMENTS(kinds)]);
+    if (i == 0) gpm_fake_services_update_display_device(services, obj);
+  }
+
+  /* logind */
+  gpm_fake_services_export(services, services->system, GPM_FAKE_LOGIN1_PATH,
+                           "org.freedesktop.login1.Manager");
+
+  /* mate-session */
+  gpm_fake_services_export(services, services->session, GPM_FAKE_SESSION_PATH,
+                           "org.gnome.SessionManager");
+  services->presence = gpm_fake_services_export(
+      services, services->session, GPM_FAKE_SESSION_PATH "/Presence",
+      "org.gnome.SessionManager.Presence");
+  gpm_fake_object_set(services, services->presence, "status",
+                      g_variant_new_uint32(GPM_FAKE_SESSION_STATUS_AVAILABLE),
+                      FALSE);
+
+  gpm_fake_services_export(services, services->session, GPM_FAKE_CONTROL_PATH,
+                           GPM_FAKE_CONTROL_SERVICE);
+
+  /* only take the names once everything is there to be called */
+  if (!gpm_fake_services_own_name(services->system, "org.freedesktop.UPower",
+                                  error))
+    return FALSE;
+  if (!gpm_fake_services_own_name(services->system, "org.freedesktop.login1",
+                                  error))
+    return FALSE;
+  if (!gpm_fake_services_own_name(services->session,
+                                  "org.gnome.SessionManager", error))
+    return FALSE;
+  return gpm_fake_services_own_name(services->session,
+                                    GPM_FAKE_CONTROL_SERVICE, error);
+}
+
+/**
+ * gpm_fake_services_timeout_cb:
+ **/
+static gboolean gpm_fake_services_timeout_cb(GpmFakeServices *services) {
+  g_main_loop_quit(services->loop);
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gpm_fake_services_settle:
+ *
+ * Keeps serving for a while, with nothing to wait for.
+ **/
+static void gpm_fake_services_settle(GpmFakeServices *services, guint ms) {
+  g_timeout_add(ms, (GSourceFunc)gpm_fake_services_timeout_cb, services);
+  g_main_loop_run(services->loop);
+}
+
+/**
+ * gpm_fake_services_wait_for:
+ * @actions: What the daemon should ask for
+ * @all: If every one of @actions is needed, rather than any of them
+ *
+ * Serves until the daemon has asked for @actions, or the time is up, noting
+ * when each of them came.
+ **/
+static void gpm_fake_services_wait_for(GpmFakeServices *services,
+                                       guint actions, gboolean all) {
+  guint id;
+
+  memset(services->action_times, 0, sizeof(services->action_times));
+  services->action_time = 0;
+  if (actions == 0) return;
+  services->waiting = actions;
+  services->wait_all = all;
+  id = g_timeout_add(GPM_FAKE_ACTION_TIMEOUT,
+                     (GSourceFunc)gpm_fake_services_timeout_cb, services);
+  g_main_loop_run(services->loop);
+  if (services->waiting == 0) g_source_remove(id);
+  services->waiting = 0;
+}
+
+/**
+ * gpm_fake_services_wait:
+ * @since: When the event that should cause the action was sent
+ *
+ * Return value: the latency in microseconds, or -1 if the daemon did not
+ *               ask for any of @actions in time
+ **/
+static gint64 gpm_fake_services_wait(GpmFakeServices *services, guint actions,
+                                     gint64 since) {
+  gpm_fake_services_wait_for(services, actions, FALSE);
+  if (services->action_time == 0) return -1;
+  return services->action_time - since;
+}
+
+/**
+ * gpm_fake_services_get_latency:
+ *
+ * Return value: how long after @since the last wait saw the last of
+ *               @actions, or -1 if it missed any of them
+ **/
+static gint64 gpm_fake_services_get_latency(GpmFakeServices *services,
+                                            guint actions, gint64 since) {
+  gint64 latest = since;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(services->action_times); i++) {
+    if ((actions & (1u << i)) == 0) continue;
+    if (services->action_times[i] == 0) return -1;
+    latest = MAX(latest, services->action_times[i]);
+  }
+  return latest - since;
+}
+
+typedef enum {
+  GPM_FAKE_LATENCY_AC_UNPLUG_KBD,
+  GPM_FAKE_LATENCY_AC_PLUG_KBD,
+  GPM_FAKE_LATENCY_AC_UNPLUG_BACKLIGHT,
+  GPM_FAKE_LATENCY_AC_PLUG_BACKLIGHT,
+  GPM_FAKE_LATENCY_IDLE_DIM,
+  GPM_FAKE_LATENCY_ACTIVE_UNDIM,
+  GPM_FAKE_LATENCY_LID_CLOSE_SUSPEND,
+  GPM_FAKE_LATENCY_RESUME_RESTORE,
+  GPM_FAKE_LATENCY_LID_CLOSED_UNPLUG_SUSPEND,
+  GPM_FAKE_LATENCY_LAST
+} GpmFakeLatencyId;
+
+typedef struct {
+  const gchar *name;
+  gdouble max_p50; /* in milliseconds, the objective */
+  gdouble max_p99;
+  const gchar *skipped;
+  GArray *samples; /* of gdouble, in microseconds */
+  guint missed;
+  gboolean passed;
+} GpmFakeLatency;
+
+/* the display backlight goes through a helper process each time, so it
+ * gets more room than the keyboard, which is a single D-Bus call */
+static GpmFakeLatency gpm_fake_latencies[] = {
+    {"ac-unplug-to-kbd-dim", 50, 250},
+    {"ac-plug-to-kbd-restore", 50, 250},
+    {"ac-unplug-to-brightness-reduce", 100, 500},
+    {"ac-plug-to-brightness-restore", 100, 500},
+    {"idle-to-dim", 100, 500},
+    {"active-to-undim", 100, 500},
+    {"lid-close-to-suspend", 100, 500},
+    {"resume-to-backlights-restored", 250, 1000},
+    {"lid-closed-unplug-to-suspend", 100, 500}};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(gpm_fake_latencies) == GPM_FAKE_LATENCY_LAST);
+
+/**
+ * gpm_fake_latency_set_objective:
+ * @spec: "NAME=P50,P99", both in milliseconds
+ **/
+static gboolean gpm_fake_latency_set_objective(const gchar *spec,
+                                               GError **error) {
+  gchar **split;
+  gchar *end;
+  gdouble p50;
+  gdouble p99;
+  gboolean ret = FALSE;
+  guint i;
+
+  split = g_strsplit_set(spec, "=,", 3);
+  if (g_strv_length(split) != 3) goto out;
+  p50 = g_ascii_strtod(split[1], &end);
+  if (end == split[1] || *end != '\0' || p50 <= 0) goto out;
+  p99 = g_ascii_strtod(split[2], &end);
+  if (end == split[2] || *end != '\0' || p99 < p50) goto out;
+  for (i = 0; i < GPM_FAKE_LATENCY_LAST; i++) {
+    if (g_strcmp0(gpm_fake_latencies[i].name, split[0]) != 0) continue;
+    gpm_fake_latencies[i].max_p50 = p50;
+    gpm_fake_latencies[i].max_p99 = p99;
+    ret = TRUE;
+  }
+out:
+  if (!ret)
+    g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                "invalid objective '%s', expected NAME=P50,P99 in ms", spec);
+  g_strfreev(split);
+  return ret;
+}
+
+/**
+ * gpm_fake_latency_add:
+ *
+ * A miss counts as the whole timeout, so that enough of them fail the p99
+ * even when the rest are quick.
+ **/
+static void gpm_fake_latency_add(GpmFakeLatency *latency, gint64 value) {
+  gdouble sample = value;
+  if (value < 0) {
+    latency->missed++;
+    sample = GPM_FAKE_ACTION_TIMEOUT * 1000.0;
+  }
+  g_array_append_val(latency->samples, sample);
+}
+
+/**
+ * gpm_fake_latency_percentile:
+ **/
+static gdouble gpm_fake_latency_percentile(GArray *samples,
+                                           gdouble percentile) {
+  gint rank;
+
+  rank = (gint)ceil(percentile / 100.0 * samples->len) - 1;
+  rank = CLAMP(rank, 0, (gint)samples->len - 1);
+  return g_array_index(samples, gdouble, rank);
+}
+
+/**
+ * gpm_fake_latency_compare:
+ **/
+static gint gpm_fake_latency_compare(gconstpointer a, gconstpointer b) {
+  gdouble da = *(const gdouble *)a;
+  gdouble db = *(const gdouble *)b;
+  return (da > db) - (da < db);
+}
+
+/**
+ * gpm_fake_latency_check:
+ *
+ * Return value: %TRUE if the latency was skipped or met its objective
+ **/
+static gboolean gpm_fake_latency_check(GpmFakeLatency *latency) {
+  GArray *samples = latency->samples;
+
+  if (latency->skipped != NULL) {
+    latency->passed = TRUE;
+    return TRUE;
+  }
+  latency->passed = FALSE;
+  if (samples->len == 0) return FALSE;
+  g_array_sort(samples, gpm_fake_latency_compare);
+  if (gpm_fake_latency_percentile(samples, 50) > latency->max_p50 * 1000)
+    return FALSE;
+  if (gpm_fake_latency_percentile(samples, 99) > latency->max_p99 * 1000)
+    return FALSE;
+  latency->passed = TRUE;
+  return TRUE;
+}
+
+/**
+ * gpm_fake_latency_to_json:
+ **/
+static void gpm_fake_latency_to_json(GpmFakeLatency *latency, GString *json) {
+  GArray *samples = latency->samples;
+
+  g_string_append_printf(json, "    {\"name\": \"%s\"", latency->name);
+  if (latency->skipped != NULL) {
+    g_string_append_printf(json, ", \"skipped\": \"%s\"}", latency->skipped);
+    return;
+  }
+  g_string_append_printf(json, ", \"count\": %u, \"missed\": %u", samples->len,
+                         latency->missed);
+  if (samples->len > 0) {
+    g_string_append_printf(
+        json,
+        ", \"unit\": \"us\", \"min\": %.0f, \"p50\": %.0f, \"p90\": %.0f, "
+        "\"p99\": %.0f, \"max\": %.0f",
+        g_array_index(samples, gdouble, 0),
+        gpm_fake_latency_percentile(samples, 50),
+        gpm_fake_latency_percentile(samples, 90),
+        gpm_fake_latency_percentile(samples, 99),
+        g_array_index(samples, gdouble, samples->len - 1));
+  }
+  g_string_append_printf(json,
+                         ", \"max-p50\": %.0f, \"max-p99\": %.0f, "
+                         "\"passed\": %s}",
+                         latency->max_p50 * 1000, latency->max_p99 * 1000,
+                         latency->passed ? "true" : "false");
+}
+
+/**
+ * gpm_fake_services_sample:
+ **/
+static void gpm_fake_services_sample(GpmFakeServices *services,
+                                     GpmFakeLatencyId id, guint actions,
+                                     gint64 since) {
+  GpmFakeLatency *latency = &gpm_fake_latencies[id];
+  if (latency->skipped != NULL) return;
+  gpm_fake_latency_add(latency,
+                       gpm_fake_services_get_latency(services, actions, since));
+}
+
+/**
+ * gpm_fake_services_skip:
+ **/
+static void gpm_fake_services_skip(GpmFakeLatencyId first,
+                                   GpmFakeLatencyId last, const gchar *why) {
+  guint i;
+  for (i = first; i <= last; i++) gpm_fake_latencies[i].skipped = why;
+}
+
+/**
+ * gpm_fake_services_measure:
+ * @passed: Set to %FALSE if any latency misses its objective
+ *
+ * Sends each event that should make the daemon do something visible, and
+ * times how long it takes to ask for it.
+ **/
+static GString *gpm_fake_services_measure(GpmFakeServices *services,
+                                          guint iterations, gboolean *passed) {
+  GpmFakeLatency *latencies = gpm_fake_latencies;
+  guint backlights = 0; /* what follows the power source */
+  GString *json;
+  gint64 since;
+  guint i;
+
+  for (i = 0; i < GPM_FAKE_LATENCY_LAST; i++)
+    latencies[i].samples = g_array_new(FALSE, FALSE, sizeof(gdouble));
+
+  if (services->kbd_max > 0)
+    backlights |= GPM_FAKE_ACTION_KBD_BRIGHTNESS;
+  else
+    gpm_fake_services_skip(GPM_FAKE_LATENCY_AC_UNPLUG_KBD,
+                           GPM_FAKE_LATENCY_AC_PLUG_KBD,
+                           "no keyboard backlight");
+  if (services->backlight_max > 0) {
+    backlights |= GPM_FAKE_ACTION_BACKLIGHT;
+  } else {
+    gpm_fake_services_skip(GPM_FAKE_LATENCY_AC_UNPLUG_BACKLIGHT,
+                           GPM_FAKE_LATENCY_ACTIVE_UNDIM,
+                           "no stand-in display backlight");
+  }
+  if (backlights == 0)
+    gpm_fake_services_skip(GPM_FAKE_LATENCY_RESUME_RESTORE,
+                           GPM_FAKE_LATENCY_RESUME_RESTORE, "no backlights");
+
+  /* the daemon only acts on idle and the lid when it thinks logind is
+   * running */
+  if (!LOGIND_RUNNING())
+    gpm_fake_services_skip(GPM_FAKE_LATENCY_IDLE_DIM,
+                           GPM_FAKE_LATENCY_LID_CLOSED_UNPLUG_SUSPEND,
+                           "logind is not running");
+
+  for (i = 0; i < iterations; i++) {
+    /* unplugged, both backlights go down to their battery levels */
+    since = g_get_monotonic_time();
+    gpm_fake_services_set_on_battery(services, TRUE);
+    gpm_fake_services_wait_for(services, backlights, TRUE);
+    gpm_fake_services_sample(services, GPM_FAKE_LATENCY_AC_UNPLUG_KBD,
+                             GPM_FAKE_ACTION_KBD_BRIGHTNESS, since);
+    gpm_fake_services_sample(services, GPM_FAKE_LATENCY_AC_UNPLUG_BACKLIGHT,
+                             GPM_FAKE_ACTION_BACKLIGHT, since);
+    gpm_fake_services_settle(services, GPM_FAKE_ITERATION_SETTLE);
+
+    /* idle on battery dims the panel, and activity brings it back */
+    if (latencies[GPM_FAKE_LATENCY_IDLE_DIM].skipped == NULL) {
+      since = g_get_monotonic_time();
+      gpm_fake_services_set_presence(services, GPM_FAKE_SESSION_STATUS_IDLE);
+      gpm_fake_services_wait_for(services, GPM_FAKE_ACTION_BACKLIGHT, TRUE);
+      gpm_fake_services_sample(services, GPM_FAKE_LATENCY_IDLE_DIM,
+                               GPM_FAKE_ACTION_BACKLIGHT, since);
+      gpm_fake_services_settle(services, GPM_FAKE_ITERATION_SETTLE);
+
+      since = g_get_monotonic_time();
+      gpm_fake_services_set_presence(services,
+                                     GPM_FAKE_SESSION_STATUS_AVAILABLE);
+      gpm_fake_services_wait_for(services, GPM_FAKE_ACTION_BACKLIGHT, TRUE);
+      gpm_fake_services_sample(services, GPM_FAKE_LATENCY_ACTIVE_UNDIM,
+                               GPM_FAKE_ACTION_BACKLIGHT, since);
+      gpm_fake_services_settle(services, GPM_FAKE_ITERATION_SETTLE);
+    }
+
+    /* closing the lid on battery suspends, and on resume both backlights
+     * have to get back to where they were */
+    if (latencies[GPM_FAKE_LATENCY_LID_CLOSE_SUSPEND].skipped == NULL) {
+      services->kbd_goal = services->kbd_brightness;
+      services->backlight_goal = services->backlight;
+      since = g_get_monotonic_time();
+      gpm_fake_object_set(services, services->upower, "LidIsClosed",
+                          g_variant_new_boolean(TRUE), TRUE);
+      gpm_fake_latency_add(
+          &latencies[GPM_FAKE_LATENCY_LID_CLOSE_SUSPEND],
+          gpm_fake_services_wait(
+              services, GPM_FAKE_ACTION_SUSPEND | GPM_FAKE_ACTION_HIBERNATE,
+              since));
+      if (services->action_time != 0 && backlights != 0) {
+        gpm_fake_services_wait_for(services, backlights, TRUE);
+        gpm_fake_services_sample(services, GPM_FAKE_LATENCY_RESUME_RESTORE,
+                                 backlights, services->resume_time);
+      }
+      services->kbd_goal = -1;
+      services->backlight_goal = -1;
+      gpm_fake_object_set(services, services->upower, "LidIsClosed",
+                          g_variant_new_boolean(FALSE), TRUE);
+      gpm_fake_services_settle(services, GPM_FAKE_ITERATION_SETTLE);
+    }
+
+    /* plugged back in, both go back up */
+    since = g_get_monotonic_time();
+    gpm_fake_services_set_on_battery(services, FALSE);
+    gpm_fake_services_wait_for(services, backlights, TRUE);
+    gpm_fake_services_sample(services, GPM_FAKE_LATENCY_AC_PLUG_KBD,
+                             GPM_FAKE_ACTION_KBD_BRIGHTNESS, since);
+    gpm_fake_services_sample(services, GPM_FAKE_LATENCY_AC_PLUG_BACKLIGHT,
+                             GPM_FAKE_ACTION_BACKLIGHT, since);
+    gpm_fake_services_settle(services, GPM_FAKE_ITERATION_SETTLE);
+
+    /* a lid closed on AC only suspends once unplugged */
+    if (latencies[GPM_FAKE_LATENCY_LID_CLOSED_UNPLUG_SUSPEND].skipped != NULL)
+      continue;
+    gpm_fake_object_set(services, services->upower, "LidIsClosed",
+                        g_variant_new_boolean(TRUE), TRUE);
+    gpm_fake_services_settle(services, GPM_FAKE_ITERATION_SETTLE);
+    since = g_get_monotonic_time();
+    gpm_fake_services_set_on_battery(services, TRUE);
+    gpm_fake_latency_add(
+        &latencies[GPM_FAKE_LATENCY_LID_CLOSED_UNPLUG_SUSPEND],
+        gpm_fake_services_wait(
+            services, GPM_FAKE_ACTION_SUSPEND | GPM_FAKE_ACTION_HIBERNATE,
+            since));
+    gpm_fake_services_set_on_battery(services, FALSE);
+    gpm_fake_object_set(services, services->upower, "LidIsClosed",
+                        g_variant_new_boolean(FALSE), TRUE);
+    gpm_fake_services_settle(services, GPM_FAKE_RESUME_SETTLE);
+  }
+
+  *passed = TRUE;
+  for (i = 0; i < GPM_FAKE_LATENCY_LAST; i++) {
+    if (!gpm_fake_latency_check(&latencies[i])) *passed = FALSE;
+  }
+
+  json = g_string_new(NULL);
+  g_string_append_printf(json,
+                         "{\n  \"iterations\": %u,\n  \"passed\": %s,\n"
+                         "  \"latencies\": [\n",
+                         iterations, *passed ? "true" : "false");
+  for (i = 0; i < GPM_FAKE_LATENCY_LAST; i++) {
+    if (i > 0) g_string_append(json, ",\n");
+    gpm_fake_latency_to_json(&latencies[i], json);
+    g_array_unref(latencies[i].samples);
+    latencies[i].samples = NULL;
+  }
+  g_string_append(json, "\n  ]\n}\n");
+  return json;
+}
+
+/**
+ * gpm_fake_services_start_xvfb:
+ *
+ * Starts a private X server and points DISPLAY at it.
+ *
+ * Return value: the X server process, or %NULL
+ **/
+static GSubprocess *gpm_fake_services_start_xvfb(GError **error) {
+  GSubprocessLauncher *launcher;
+  GSubprocess *xvfb;
+  gchar buf[16] = {0};
+  gchar *display;
+  gint fds[2];
+  gssize len;
+
+  if (!g_unix_open_pipe(fds, FD_CLOEXEC, error)) return NULL;
+  launcher = g_subprocess_launcher_new(G_SUBPROCESS_FLAGS_NONE);
+  g_subprocess_launcher_take_fd(launcher, fds[1], 3);
+  xvfb = g_subprocess_launcher_spawn(launcher, error, "Xvfb", "-displayfd",
+                                     "3", "-screen", "0", "1024x768x24",
+                                     "-nolisten", "tcp", NULL);
+  g_object_unref(launcher);
+  if (xvfb == NULL) {
+    close(fds[0]);
+    return NULL;
+  }
+
+  /* Xvfb writes the display number once it is ready for clients */
+  len = read(fds[0], buf, sizeof(buf) - 1);
+  close(fds[0]);
+  if (len <= 0) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Xvfb did not report a display");
+    g_subprocess_force_exit(xvfb);
+    g_object_unref(xvfb);
+    return NULL;
+  }
+  display = g_strdup_printf(":%s", g_strstrip(buf));
+  g_setenv("DISPLAY", display, TRUE);
+  g_free(display);
+  return xvfb;
+}
+
+/**
+ * gpm_fake_services_name_appeared_cb:
+ **/
+static void gpm_fake_services_name_appeared_cb(GDBusConnection *connection,
+                                               const gchar *name,
+                                               const gchar *name_owner,
+                                               GpmFakeServices *services) {
+  g_debug("%s appeared as %s", name, name_owner);
+  services->action_time = g_get_monotonic_time();
+  g_main_loop_quit(services->loop);
+}
+
+/**
+ * gpm_fake_services_run:
+ *
+ * Starts @argv with the private buses and display, and measures it once it
+ * has taken its name on the session bus.
+ **/
+static GString *gpm_fake_services_run(GpmFakeServices *services, gchar **argv,
+                                      guint iterations, gboolean *passed,
+                                      GError **error) {
+  GSubprocess *daemon;
+  GString *json = NULL;
+  guint id;
+  guint watch_id;
+
+  daemon = g_subprocess_newv((const gchar *const *)argv,
+                             G_SUBPROCESS_FLAGS_NONE, error);
+  if (daemon == NULL) return NULL;
+
+  services->action_time = 0;
+  watch_id = g_bus_watch_name_on_connection(
+      services->session, GPM_DBUS_SERVICE, G_BUS_NAME_WATCHER_FLAGS_NONE,
+      (GBusNameAppearedCallback)gpm_fake_services_name_appeared_cb, NULL,
+      services, NULL);
+  id = g_timeout_add(GPM_FAKE_STARTUP_TIMEOUT,
+                     (GSourceFunc)gpm_fake_services_timeout_cb, services);
+  g_main_loop_run(services->loop);
+  g_bus_unwatch_name(watch_id);
+  if (services->action_time == 0) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                "%s did not start", argv[0]);
+    goto out;
+  }
+  g_source_remove(id);
+
+  /* let it coldplug the devices and the keyboard backlight */
+  gpm_fake_services_settle(services, GPM_FAKE_STARTUP_SETTLE);
+  json = gpm_fake_services_measure(services, iterations, passed);
+out:
+  g_subprocess_send_signal(daemon, SIGTERM);
+  g_subprocess_wait(daemon, NULL, NULL);
+  g_object_unref(daemon);
+  return json;
+}
+
+/**
+ * gpm_fake_services_monitor_filter:
+ *
+ * Counts every message on the system bus, and estimates how many copies
+ * of the UPower signals the bus had to deliver from the connections that
+ * asked for them.
+ **/
+static GDBusMessage *gpm_fake_services_monitor_filter(
+    GDBusConnection *connection, GDBusMessage *message, gboolean incoming,
+    GpmFakeServices *services) {
+  const gchar *sender = g_dbus_message_get_sender(message);
+  const gchar *rule = NULL;
+  GVariant *body;
+
+  if (!incoming) return message;
+  g_atomic_int_inc(&services->bus_messages);
+
+  G_LOCK(gpm_fake_monitor);
+  switch (g_dbus_message_get_message_type(message)) {
+    case G_DBUS_MESSAGE_TYPE_SIGNAL:
+      if (g_strcmp0(sender, g_dbus_connection_get_unique_name(
+                                services->system)) != 0)
+        break;
+      services->upower_signals++;
+      services->upower_deliveries +=
+          g_hash_table_size(services->upower_subscribers);
+      break;
+    case G_DBUS_MESSAGE_TYPE_METHOD_CALL:
+      body = g_dbus_message_get_body(message);
+      if (g_strcmp0(g_dbus_message_get_member(message), "AddMatch") != 0 ||
+          body == NULL || !g_variant_is_of_type(body, G_VARIANT_TYPE("(s)")))
+        break;
+      g_variant_get(body, "(&s)", &rule);
+      if (sender != NULL && strstr(rule, "org.freedesktop.UPower") != NULL)
+        g_hash_table_add(services->upower_subscribers, g_strdup(sender));
+      break;
+    default:
+      break;
+  }
+  G_UNLOCK(gpm_fake_monitor);
+
+  /* a monitor must never answer, so nothing gets past here */
+  g_object_unref(message);
+  return NULL;
+}
+
+/**
+ * gpm_fake_services_monitor:
+ *
+ * Return value: a connection that sees everything on the system bus
+ **/
+static GDBusConnection *gpm_fake_services_monitor(GpmFakeServices *services,
+                                                  GError **error) {
+  const gchar *rules[] = {NULL}; /* everything */
+  GDBusConnection *monitor;
+  GVariant *res;
+
+  monitor = g_dbus_connection_new_for_address_sync(
+      g_getenv("DBUS_SYSTEM_BUS_ADDRESS"),
+      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+      NULL, NULL, error);
+  if (monitor == NULL) return NULL;
+  res = g_dbus_connection_call_sync(
+      monitor, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+      "org.freedesktop.DBus.Monitoring", "BecomeMonitor",
+      g_variant_new("(^asu)", rules, 0), NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+      error);
+  if (res == NULL) {
+    g_object_unref(monitor);
+    return NULL;
+  }
+  g_variant_unref(res);
+  g_dbus_connection_add_filter(
+      monitor, (GDBusMessageFilterFunction)gpm_fake_services_monitor_filter,
+      services, NULL);
+  return monitor;
+}
+
+/**
+ * gpm_fake_services_count_reset:
+ **/
+static void gpm_fake_services_count_reset(GpmFakeServices *services) {
+  G_LOCK(gpm_fake_monitor);
+  g_atomic_int_set(&services->bus_messages, 0);
+  services->upower_signals = 0;
+  services->upower_deliveries = 0;
+  G_UNLOCK(gpm_fake_monitor);
+}
+
+/**
+ * gpm_fake_services_count_to_json:
+ **/
+static void gpm_fake_services_count_to_json(GpmFakeServices *services,
+                                            const gchar *name, GString *json) {
+  G_LOCK(gpm_fake_monitor);
+  g_string_append_printf(json,
+                         "  \"%s\": {\"messages\": %i, \"upower_signals\": "
+                         "%i, \"upower_deliveries\": %" G_GINT64_FORMAT "}",
+                         name, g_atomic_int_get(&services->bus_messages),
+                         services->upower_signals,
+                         services->upower_deliveries);
+  G_UNLOCK(gpm_fake_monitor);
+}
+
+/**
+ * gpm_fake_services_count:
+ * @sessions: How many copies of @argv to start, each with its own session
+ * @broker: The mate-power-broker to start first, or %NULL
+ * @seconds: How long to count for once they have all started
+ *
+ * Counts the system bus traffic of a host with many sessions, to see how
+ * it grows with them with and without a broker.
+ **/
+static GString *gpm_fake_services_count(GpmFakeServices *services,
+                                        gchar **argv, guint sessions,
+                                        const gchar *broker, guint seconds,
+                                        GError **error) {
+  GSubprocessLauncher *launcher = NULL;
+  GDBusConnection *monitor = NULL;
+  GDBusConnection *connection;
+  GPtrArray *buses;
+  GPtrArray *daemons;
+  GSubprocess *daemon;
+  GTestDBus *bus;
+  GString *json = NULL;
+  gchar *filename;
+  gchar *tmpdir;
+  guint watch_id;
+  guint id;
+  guint i;
+
+  buses = g_ptr_array_new();
+  daemons = g_ptr_array_new();
+  tmpdir = g_dir_make_tmp("mate-power-broker-XXXXXX", error);
+  if (tmpdir == NULL) goto out;
+  services->upower_subscribers =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  monitor = gpm_fake_services_monitor(services, error);
+  if (monitor == NULL) goto out;
+
+  /* without a broker this names a page that is never there */
+  filename = g_build_filename(tmpdir, "devices", NULL);
+  launcher = g_subprocess_launcher_new(G_SUBPROCESS_FLAGS_NONE);
+  g_subprocess_launcher_setenv(launcher, "GPM_BROKER_PATH", filename, TRUE);
+  if (broker != NULL) {
+    daemon = g_subprocess_launcher_spawn(launcher, error, broker, NULL);
+    if (daemon == NULL) {
+      g_free(filename);
+      goto out;
+    }
+    g_ptr_array_add(daemons, daemon);
+    for (i = 0; i < GPM_FAKE_STARTUP_TIMEOUT / GPM_FAKE_ITERATION_SETTLE;
+         i++) {
+      if (g_file_test(filename, G_FILE_TEST_EXISTS)) break;
+      gpm_fake_services_settle(services, GPM_FAKE_ITERATION_SETTLE);
+    }
+    gpm_fake_services_settle(services, GPM_FAKE_STARTUP_SETTLE);
+  }
+  g_free(filename);
+
+  for (i = 0; i < sessions; i++) {
+    bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+    g_ptr_array_add(buses, bus);
+    g_subprocess_launcher_setenv(launcher, "DBUS_SESSION_BUS_ADDRESS",
+                                 g_test_dbus_get_bus_address(bus), TRUE);
+    daemon = g_subprocess_launcher_spawnv(
+        launcher, (const gchar *const *)argv, error);
+    if (daemon == NULL) goto out;
+    g_ptr_array_add(daemons, daemon);
+
+    /* one at a time, as sessions log in */
+    connection = g_dbus_connection_new_for_address_sync(
+        g_test_dbus_get_bus_address(bus),
+        G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+            G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+        NULL, NULL, error);
+    if (connection == NULL) goto out;
+    services->action_time = 0;
+    watch_id = g_bus_watch_name_on_connection(
+        connection, GPM_DBUS_SERVICE, G_BUS_NAME_WATCHER_FLAGS_NONE,
+        (GBusNameAppearedCallback)gpm_fake_services_name_appeared_cb, NULL,
+        services, NULL);
+    id = g_timeout_add(GPM_FAKE_STARTUP_TIMEOUT,
+                       (GSourceFunc)gpm_fake_services_timeout_cb, services);
+    g_main_loop_run(services->loop);
+    g_bus_unwatch_name(watch_id);
+    g_object_unref(connection);
+    if (services->action_time == 0) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                  "session %u of %s did not start", i, argv[0]);
+      goto out;
+    }
+    g_source_remove(id);
+  }
+
+  /* the startup is everything until they have all coldplugged */
+  gpm_fake_services_settle(services, GPM_FAKE_STARTUP_SETTLE);
+  json = g_string_new(NULL);
+  g_string_append_printf(json,
+                         "{\n  \"sessions\": %u,\n  \"broker\": %s,\n"
+                         "  \"seconds\": %u,\n",
+                         sessions, broker != NULL ? "true" : "false", seconds);
+  gpm_fake_services_count_to_json(services, "startup", json);
+  g_string_append(json, ",\n");
+
+  gpm_fake_services_count_reset(services);
+  gpm_fake_services_settle(services, seconds * 1000);
+  gpm_fake_services_count_to_json(services, "steady", json);
+  g_string_append(json, "\n}\n");
+out:
+  for (i = daemons->len; i > 0; i--) {
+    daemon = g_ptr_array_index(daemons, i - 1);
+    g_subprocess_send_signal(daemon, SIGTERM);
+    g_subprocess_wait(daemon, NULL, NULL);
+    g_object_unref(daemon);
+  }
+  g_ptr_array_unref(daemons);
+  for (i = 0; i < buses->len; i++) {
+    bus = g_ptr_array_index(buses, i);
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+  }
+  g_ptr_array_unref(buses);
+  if (monitor != NULL) {
+    g_dbus_connection_close_sync(monitor, NULL, NULL);
+    g_object_unref(monitor);
+  }
+  g_clear_pointer(&services->upower_subscribers, g_hash_table_unref);
+  g_clear_object(&launcher);
+  if (tmpdir != NULL) g_rmdir(tmpdir);
+  g_free(tmpdir);
+  return json;
+}
+
+/**
+ * gpm_fake_services_backlight_helper:
+ *
+ * Answers for mate-power-backlight-helper when the daemon runs us in its
+ * place, by asking the instance that started the daemon.
+ **/
+static gint gpm_fake_services_backlight_helper(const gchar *method_name,
+                                               gint value) {
+  GDBusConnection *connection;
+  GVariant *res = NULL;
+  GError *error = NULL;
+
+  connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+  if (connection != NULL) {
+    res = g_dbus_connection_call_sync(
+        connection, GPM_FAKE_CONTROL_SERVICE, GPM_FAKE_CONTROL_PATH,
+        GPM_FAKE_CONTROL_SERVICE, method_name,
+        value < 0 ? NULL : g_variant_new("(i)", value), NULL,
+        G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+    g_object_unref(connection);
+  }
+  if (res == NULL) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+  if (g_variant_is_of_type(res, G_VARIANT_TYPE("(i)"))) {
+    g_variant_get(res, "(i)", &value);
+    g_print("%i\n", value);
+  }
+  g_variant_unref(res);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * gpm_fake_services_quit_cb:
+ **/
+static gboolean gpm_fake_services_quit_cb(GpmFakeServices *services) {
+  g_main_loop_quit(services->loop);
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * main:
+ **/
+int main(int argc, char **argv) {
+  GOptionContext *context;
+  GpmFakeServices services = {0};
+  GTestDBus *bus_system = NULL;
+  GTestDBus *bus_session = NULL;
+  GSubprocess *xvfb = NULL;
+  GString *json = NULL;
+  GError *error = NULL;
+  gchar **run = NULL;
+  gchar **objectives = NULL;
+  gchar *output = NULL;
+  gchar *broker = NULL;
+  gchar *display;
+  gchar *helper;
+  gboolean private_bus = FALSE;
+  gboolean use_xvfb = FALSE;
+  gboolean get_brightness = FALSE;
+  gboolean get_max_brightness = FALSE;
+  gboolean passed = FALSE;
+  gdouble change_rate = 0;
+  gdouble inhibitor_rate = 0;
+  gint devices = 1;
+  gint kbd_max = 10;
+  gint backlight_max = 100;
+  gint set_brightness = -1;
+  gint iterations = 200;
+  gint sessions = 0;
+  gint count_seconds = 60;
+  gint retval = EXIT_FAILURE;
+  guint change_id = 0;
+  guint churn_id = 0;
+  guint i;
+
+  const GOptionEntry options[] = {
+      {"private-bus", '\0', 0, G_OPTION_ARG_NONE, &private_bus,
+       "Start private system and session buses, and print their addresses",
+       NULL},
+      {"xvfb", '\0', 0, G_OPTION_ARG_NONE, &use_xvfb,
+       "Start a private X server, and print its display", NULL},
+      {"devices", '\0', 0, G_OPTION_ARG_INT, &devices,
+       "Number of devices, the first of which is the laptop battery",
+       "COUNT"},
+      {"change-rate", '\0', 0, G_OPTION_ARG_DOUBLE, &change_rate,
+       "Device property changes per second", "HZ"},
+      {"inhibitor-rate", '\0', 0, G_OPTION_ARG_DOUBLE, &inhibitor_rate,
+       "Session inhibitors added or removed per second", "HZ"},
+      {"kbd-max", '\0', 0, G_OPTION_ARG_INT, &kbd_max,
+       "Keyboard backlight steps, or 0 for none", "COUNT"},
+      {"backlight-max", '\0', 0, G_OPTION_ARG_INT, &backlight_max,
+       "Stand-in display backlight levels, or 0 to leave the real helper",
+       "COUNT"},
+      {"iterations", '\0', 0, G_OPTION_ARG_INT, &iterations,
+       "Number of times to measure each latency with --run", "COUNT"},
+      {"objective", '\0', 0, G_OPTION_ARG_STRING_ARRAY, &objectives,
+       "Override the p50 and p99 a latency must meet", "NAME=P50,P99"},
+      {"get-brightness", '\0', 0, G_OPTION_ARG_NONE, &get_brightness,
+       "Print the stand-in display backlight level, as the helper does",
+       NULL},
+      {"get-max-brightness", '\0', 0, G_OPTION_ARG_NONE, &get_max_brightness,
+       "Print the stand-in display backlight levels, as the helper does",
+       NULL},
+      {"set-brightness", '\0', 0, G_OPTION_ARG_INT, &set_brightness,
+       "Set the stand-in display backlight level, as the helper does",
+       "LEVEL"},
+      {"sessions", '\0', 0, G_OPTION_ARG_INT, &sessions,
+       "Count the system bus messages of this many copies of the daemon "
+       "rather than timing one",
+       "COUNT"},
+      {"broker", '\0', 0, G_OPTION_ARG_FILENAME, &broker,
+       "Start mate-power-broker for the sessions to share", "PROGRAM"},
+      {"count-seconds", '\0', 0, G_OPTION_ARG_INT, &count_seconds,
+       "How long to count the messages for with --sessions", "SECONDS"},
+      {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+       "Write the JSON latencies to a file rather than stdout", "FILE"},
+      {G_OPTION_REMAINING, '\0', 0, G_OPTION_ARG_STRING_ARRAY, &run, NULL,
+       "[-- DAEMON [ARGS...]]"},
+      {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
+
+  setlocale(LC_ALL, "");
+
+  context = g_option_context_new(NULL);
+  g_option_context_set_summary(
+      context,
+      "Stand-in UPower, logind and mate-session services for testing.\n"
+      "Given a daemon to run, it is started on the private buses and the\n"
+      "latency of its reactions is printed as JSON, failing if any of\n"
+      "them misses its objective. With --sessions, that many copies are\n"
+      "started instead and the system bus messages they cause are\n"
+      "counted.");
+  g_option_context_add_main_entries(context, options, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    g_option_context_free(context);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+  setlocale(LC_NUMERIC, "C");
+
+  /* run by the daemon in place of mate-power-backlight-helper */
+  if (get_brightness) {
+    retval = gpm_fake_services_backlight_helper("GetBacklight", -1);
+    goto out;
+  }
+  if (get_max_brightness) {
+    retval = gpm_fake_services_backlight_helper("GetMaxBacklight", -1);
+    goto out;
+  }
+  if (set_brightness >= 0) {
+    retval = gpm_fake_services_backlight_helper("SetBacklight", set_brightness);
+    goto out;
+  }
+
+  for (i = 0; objectives != NULL && objectives[i] != NULL; i++) {
+    if (!gpm_fake_latency_set_objective(objectives[i], &error)) {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      goto out;
+    }
+  }
+
+  /* never take over the services of the real system */
+  if (!private_bus && g_getenv("DBUS_SYSTEM_BUS_ADDRESS") == NULL) {
+    g_printerr("use --private-bus, or set DBUS_SYSTEM_BUS_ADDRESS\n");
+    goto out;
+  }
+  if (private_bus) {
+    /* this unsets DISPLAY, which the daemon still needs */
+    display = g_strdup(g_getenv("DISPLAY"));
+    bus_system = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus_system);
+    bus_session = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus_session);
+    g_setenv("DBUS_SYSTEM_BUS_ADDRESS",
+             g_test_dbus_get_bus_address(bus_system), TRUE);
+    if (display != NULL) g_setenv("DISPLAY", display, TRUE);
+    g_free(display);
+
+    /* the daemon should not change the real settings either */
+    g_setenv("GSETTINGS_BACKEND", "memory", TRUE);
+  }
+  if (use_xvfb) {
+    xvfb = gpm_fake_services_start_xvfb(&error);
+    if (xvfb == NULL) {
+      g_printerr("failed to start Xvfb: %s\n", error->message);
+      g_error_free(error);
+      goto out;
+    }
+  }
+
+  services.info = g_dbus_node_info_new_for_xml(gpm_fake_introspection, NULL);
+  services.devices = g_ptr_array_new();
+  services.inhibitors = g_ptr_array_new();
+  services.objects =
+      g_ptr_array_new_with_free_func((GDestroyNotify)gpm_fake_object_free);
+  services.inhibit_fds = g_array_new(FALSE, FALSE, sizeof(gint));
+  services.rand = g_rand_new_with_seed(0x6d617465);
+  services.loop = g_main_loop_new(NULL, FALSE);
+  services.kbd_max = MAX(kbd_max, 0);
+  services.kbd_brightness = services.kbd_max;
+  services.kbd_goal = -1;
+  services.backlight_max = MAX(backlight_max, 0);
+  services.backlight = services.backlight_max;
+  services.backlight_goal = -1;
+  gpm_fake_services = &services;
+  if (!gpm_fake_services_start(&services, MAX(devices, 0), &error)) {
+    g_printerr("failed to start services: %s\n", error->message);
+    g_error_free(error);
+    goto out;
+  }
+
+  if (change_rate > 0)
+    change_id = g_timeout_add(MAX(1000 / change_rate, 1),
+                              (GSourceFunc)gpm_fake_services_change_cb,
+                              &services);
+  if (inhibitor_rate > 0)
+    churn_id = g_timeout_add(MAX(1000 / inhibitor_rate, 1),
+                             (GSourceFunc)gpm_fake_services_churn_cb,
+                             &services);
+
+  /* serve until killed, telling the caller where to find us */
+  if (run == NULL) {
+    g_print("DBUS_SYSTEM_BUS_ADDRESS=%s\n",
+            g_getenv("DBUS_SYSTEM_BUS_ADDRESS"));
+    g_print("DBUS_SESSION_BUS_ADDRESS=%s\n",
+            g_getenv("DBUS_SESSION_BUS_ADDRESS"));
+    if (g_getenv("DISPLAY") != NULL)
+      g_print("DISPLAY=%s\n", g_getenv("DISPLAY"));
+    g_unix_signal_add(SIGINT, (GSourceFunc)gpm_fake_services_quit_cb,
+                      &services);
+    g_unix_signal_add(SIGTERM, (GSourceFunc)gpm_fake_services_quit_cb,
+                      &services);
+    g_main_loop_run(services.loop);
+    retval = EXIT_SUCCESS;
+    goto out;
+  }
+
+  /* the daemon asks us for the display brightness, rather than pkexec */
+  if (services.backlight_max > 0) {
+    helper = g_find_program_in_path(argv[0]);
+    if (helper != NULL) g_setenv("GPM_BACKLIGHT_HELPER", helper, TRUE);
+    g_free(helper);
+  }
+  if (sessions > 0) {
+    json = gpm_fake_services_count(&services, run, sessions, broker,
+                                   MAX(count_seconds, 1), &error);
+    passed = TRUE;
+  } else {
+    json = gpm_fake_services_run(&services, run, MAX(iterations, 1), &passed,
+                                 &error);
+  }
+  if (json == NULL) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    goto out;
+  }
+  if (output == NULL) {
+    g_print("%s", json->str);
+  } else if (!g_file_set_contents(output, json->str, json->len, &error)) {
+    g_printerr("failed to write %s: %s\n", output, error->message);
+    g_error_free(error);
+    goto out;
+  }
+  if (passed)
+    retval = EXIT_SUCCESS;
+  else
+    g_printerr("latency objectives were not met\n");
+out:
+  if (change_id != 0) g_source_remove(change_id);
+  if (churn_id != 0) g_source_remove(churn_id);
+  if (json != NULL) g_string_free(json, TRUE);
+  if (services.objects != NULL) {
+    g_ptr_array_unref(services.devices);
+    g_ptr_array_unref(services.inhibitors);
+    g_ptr_array_unref(services.objects);
+    for (i = 0; i < services.inhibit_fds->len; i++)
+      close(g_array_index(services.inhibit_fds, gint, i));
+    g_array_unref(services.inhibit_fds);
+    g_rand_free(services.rand);
+    g_main_loop_unref(services.loop);
+    g_dbus_node_info_unref(services.info);
+  }
+  g_clear_object(&services.system);
+  g_clear_object(&services.session);
+  if (xvfb != NULL) {
+    g_subprocess_send_signal(xvfb, SIGTERM);
+    g_subprocess_wait(xvfb, NULL, NULL);
+    g_object_unref(xvfb);
+  }
+  if (bus_session != NULL) {
+    g_test_dbus_down(bus_session);
+    g_object_unref(bus_session);
+  }
+  if (bus_system != NULL) {
+    g_test_dbus_down(bus_system);
+    g_object_unref(bus_system);
+  }
+  g_strfreev(run);
+  g_strfreev(objectives);
+  g_free(output);
+  g_free(broker);
+  return retval;
+}
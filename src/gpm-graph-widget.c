@@ -51,6 +51,7 @@ struct GpmGraphWidgetPrivate {
   gint stop_y;
   gint start_x;
   gint start_y;
+  gint origin_x; /* subtracted from the data before it is drawn */
   gint box_x; /* size of the white box, not the widget */
   gint box_y;
   gint box_width;
@@ -63,17 +64,30 @@ struct GpmGraphWidgetPrivate {
   GpmGraphWidgetType type_y;
   gchar *title;
 
-  cairo_t *cr;
   PangoLayout *layout;
 
   GPtrArray *data_list;
   GPtrArray *plot_list;
+  GArray *head_list; /* points trimmed off the start of each line */
+
+  cairo_surface_t *surface; /* the graph without the hover read-out */
+  gint surface_width;
+  gint surface_height;
+
+  gboolean hover;
+  GpmPointObj hover_point; /* with the origin already taken off */
+  GdkRectangle hover_box;  /* the text */
+  GdkRectangle hover_area; /* everything drawn for the read-out */
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE(GpmGraphWidget, gpm_graph_widget,
                            GTK_TYPE_DRAWING_AREA);
 
 static gboolean gpm_graph_widget_draw(GtkWidget *graph, cairo_t *cr);
+static gboolean gpm_graph_widget_motion_notify_event(GtkWidget *widget,
+                                                     GdkEventMotion *event);
+static gboolean gpm_graph_widget_leave_notify_event(GtkWidget *widget,
+                                                    GdkEventCrossing *event);
 static void gpm_graph_widget_finalize(GObject *object);
 
 enum {
@@ -88,12 +102,29 @@ enum {
   PROP_START_Y,
   PROP_STOP_X,
   PROP_STOP_Y,
+  PROP_ORIGIN_X,
 };
 
+/**
+ * gpm_graph_widget_invalidate:
+ *
+ * Throws away the drawn graph so it is drawn again on the next expose.
+ **/
+static void gpm_graph_widget_invalidate(GpmGraphWidget *graph) {
+  graph->priv->hover = FALSE;
+  graph->priv->hover_area.width = 0;
+
+  /* not drawn since it last changed */
+  if (graph->priv->surface == NULL) return;
+
+  g_clear_pointer(&graph->priv->surface, cairo_surface_destroy);
+  gtk_widget_queue_draw(GTK_WIDGET(graph));
+}
+
 /**
  * gpm_graph_widget_key_data_clear:
  **/
-static gboolean gpm_graph_widget_key_data_clear(GpmGraphWidget *graph) {
+gboolean gpm_graph_widget_key_data_clear(GpmGraphWidget *graph) {
   GpmGraphWidgetKeyData *keyitem;
   guint i;
 
@@ -108,6 +139,7 @@ static gboolean gpm_graph_widget_key_data_clear(GpmGraphWidget *graph) {
   }
   g_slist_free(graph->priv->key_data);
   graph->priv->key_data = NULL;
+  gpm_graph_widget_invalidate(graph);
 
   return TRUE;
 }
@@ -129,6 +161,7 @@ gboolean gpm_graph_widget_key_data_add(GpmGraphWidget *graph, guint32 color,
 
   graph->priv->key_data =
       g_slist_append(graph->priv->key_data, (gpointer)keyitem);
+  gpm_graph_widget_invalidate(graph);
   return TRUE;
 }
 
@@ -169,6 +202,9 @@ static void up_graph_get_property(GObject *object, guint prop_id, GValue *value,
     case PROP_STOP_Y:
       g_value_set_int(value, graph->priv->stop_y);
       break;
+    case PROP_ORIGIN_X:
+      g_value_set_int(value, graph->priv->origin_x);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
       break;
@@ -213,12 +249,16 @@ static void up_graph_set_property(GObject *object, guint prop_id,
     case PROP_STOP_Y:
       graph->priv->stop_y = g_value_get_int(value);
       break;
+    case PROP_ORIGIN_X:
+      graph->priv->origin_x = g_value_get_int(value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
       break;
   }
 
   /* refresh widget */
+  gpm_graph_widget_invalidate(graph);
   gtk_widget_hide(GTK_WIDGET(graph));
   gtk_widget_show(GTK_WIDGET(graph));
 }
@@ -232,6 +272,8 @@ static void gpm_graph_widget_class_init(GpmGraphWidgetClass *class) {
   GObjectClass *object_class = G_OBJECT_CLASS(class);
 
   widget_class->draw = gpm_graph_widget_draw;
+  widget_class->motion_notify_event = gpm_graph_widget_motion_notify_event;
+  widget_class->leave_notify_event = gpm_graph_widget_leave_notify_event;
   object_class->get_property = up_graph_get_property;
   object_class->set_property = up_graph_set_property;
   object_class->finalize = gpm_graph_widget_finalize;
@@ -275,6 +317,10 @@ static void gpm_graph_widget_class_init(GpmGraphWidgetClass *class) {
       object_class, PROP_STOP_Y,
       g_param_spec_int("stop-y", NULL, NULL, G_MININT, G_MAXINT, 100,
                        G_PARAM_READWRITE));
+  g_object_class_install_property(
+      object_class, PROP_ORIGIN_X,
+      g_param_spec_int("origin-x", NULL, NULL, G_MININT, G_MAXINT, 0,
+                       G_PARAM_READWRITE));
 }
 
 /**
@@ -296,9 +342,12 @@ static void gpm_graph_widget_init(GpmGraphWidget *graph) {
   graph->priv->data_list =
       g_ptr_array_new_with_free_func((GDestroyNotify)g_ptr_array_unref);
   graph->priv->plot_list = g_ptr_array_new();
+  graph->priv->head_list = g_array_new(FALSE, TRUE, sizeof(guint));
   graph->priv->key_data = NULL;
   graph->priv->type_x = GPM_GRAPH_WIDGET_TYPE_TIME;
   graph->priv->type_y = GPM_GRAPH_WIDGET_TYPE_PERCENTAGE;
+  gtk_widget_add_events(GTK_WIDGET(graph),
+                        GDK_POINTER_MOTION_MASK | GDK_LEAVE_NOTIFY_MASK);
 
   /* do pango stuff */
   fontmap = pango_cairo_font_map_get_default();
@@ -319,6 +368,8 @@ gboolean gpm_graph_widget_data_clear(GpmGraphWidget *graph) {
 
   g_ptr_array_set_size(graph->priv->data_list, 0);
   g_ptr_array_set_size(graph->priv->plot_list, 0);
+  g_array_set_size(graph->priv->head_list, 0);
+  gpm_graph_widget_invalidate(graph);
 
   return TRUE;
 }
@@ -332,12 +383,14 @@ static void gpm_graph_widget_finalize(GObject *object) {
   GpmGraphWidget *graph = (GpmGraphWidget *)object;
 
   /* clear key and data */
+  g_clear_pointer(&graph->priv->surface, cairo_surface_destroy);
   gpm_graph_widget_key_data_clear(graph);
   gpm_graph_widget_data_clear(graph);
 
   /* free data */
   g_ptr_array_unref(graph->priv->data_list);
   g_ptr_array_unref(graph->priv->plot_list);
+  g_array_unref(graph->priv->head_list);
 
   context = pango_layout_get_context(graph->priv->layout);
   g_object_unref(graph->priv->layout);
@@ -372,10 +425,115 @@ gboolean gpm_graph_widget_data_assign(GpmGraphWidget *graph,
   /* get the new data */
   g_ptr_array_add(graph->priv->data_list, copy);
   g_ptr_array_add(graph->priv->plot_list, GUINT_TO_POINTER(plot));
+  g_array_set_size(graph->priv->head_list, graph->priv->head_list->len + 1);
 
   /* refresh */
-  gtk_widget_queue_draw(GTK_WIDGET(graph));
+  gpm_graph_widget_invalidate(graph);
+
+  return TRUE;
+}
+
+/**
+ * gpm_graph_widget_data_append:
+ * @graph: This class instance
+ * @line: The index of the line, in the order it was assigned
+ * @point: The point to copy, which must not be before the last point
+ *
+ * Adds one point to the end of an existing line.
+ **/
+gboolean gpm_graph_widget_data_append(GpmGraphWidget *graph, guint line,
+                                      const GpmPointObj *point) {
+  GPtrArray *data;
 
+  g_return_val_if_fail(GPM_IS_GRAPH_WIDGET(graph), FALSE);
+  g_return_val_if_fail(point != NULL, FALSE);
+
+  if (line >= graph->priv->data_list->len) return FALSE;
+  data = g_ptr_array_index(graph->priv->data_list, line);
+  g_ptr_array_add(data, gpm_point_obj_copy(point));
+
+  gpm_graph_widget_invalidate(graph);
+  return TRUE;
+}
+
+/**
+ * gpm_graph_widget_data_trim:
+ * @graph: This class instance
+ * @x: The data position of the left edge
+ *
+ * Drops the points that are no longer needed to draw from @x onwards,
+ * keeping one point before @x so the line still reaches the edge.
+ * The points are only freed once half of a line is unused, so trimming
+ * after every append costs O(1) on average.
+ **/
+gboolean gpm_graph_widget_data_trim(GpmGraphWidget *graph, gfloat x) {
+  GPtrArray *data;
+  GpmPointObj *point;
+  guint *head;
+  guint j;
+
+  g_return_val_if_fail(GPM_IS_GRAPH_WIDGET(graph), FALSE);
+
+  for (j = 0; j < graph->priv->data_list->len; j++) {
+    data = g_ptr_array_index(graph->priv->data_list, j);
+    head = &g_array_index(graph->priv->head_list, guint, j);
+    while (*head + 1 < data->len) {
+      point = (GpmPointObj *)g_ptr_array_index(data, *head + 1);
+      if (point->x > x) break;
+      (*head)++;
+    }
+    if (*head > 0 && *head * 2 >= data->len) {
+      g_ptr_array_remove_range(data, 0, *head);
+      *head = 0;
+    }
+  }
+
+  gpm_graph_widget_invalidate(graph);
+  return TRUE;
+}
+
+/**
+ * gpm_graph_widget_data_get_length:
+ * @graph: This class instance
+ * @line: The index of the line
+ *
+ * Return value: the number of points left in the line after trimming
+ **/
+guint gpm_graph_widget_data_get_length(GpmGraphWidget *graph, guint line) {
+  GPtrArray *data;
+
+  g_return_val_if_fail(GPM_IS_GRAPH_WIDGET(graph), 0);
+
+  if (line >= graph->priv->data_list->len) return 0;
+  data = g_ptr_array_index(graph->priv->data_list, line);
+  return data->len - g_array_index(graph->priv->head_list, guint, line);
+}
+
+/**
+ * gpm_graph_widget_data_set_y:
+ * @graph: This class instance
+ * @line: The index of the line
+ * @index: The point, where 0 is the first point left after trimming
+ * @y: The new value
+ *
+ * Changes one existing point, used to update the end of a smoothed line.
+ **/
+gboolean gpm_graph_widget_data_set_y(GpmGraphWidget *graph, guint line,
+                                     guint index, gfloat y) {
+  GPtrArray *data;
+  GpmPointObj *point;
+  guint head;
+
+  g_return_val_if_fail(GPM_IS_GRAPH_WIDGET(graph), FALSE);
+
+  if (line >= graph->priv->data_list->len) return FALSE;
+  data = g_ptr_array_index(graph->priv->data_list, line);
+  head = g_array_index(graph->priv->head_list, guint, line);
+  if (head + index >= data->len) return FALSE;
+  point = (GpmPointObj *)g_ptr_array_index(data, head + index);
+  point->y = y;
+
+  gpm_graph_widget_invalidate(graph);
   return TRUE;
 }
 
@@ -602,6 +760,7 @@ static guint gpm_graph_widget_get_y_label_max_width(GpmGraphWidget *graph,
 static void gpm_graph_widget_autorange_x(GpmGraphWidget *graph) {
   gfloat biggest_x = G_MINFLOAT;
   gfloat smallest_x = G_MAXFLOAT;
+  gfloat x;
   guint rounding_x = 1;
   GPtrArray *data;
   GpmPointObj *point;
@@ -614,7 +773,7 @@ static void gpm_graph_widget_autorange_x(GpmGraphWidget *graph) {
   /* find out if we have no data */
   for (j = 0; j < array->len; j++) {
     data = g_ptr_array_index(array, j);
-    len = data->len;
+    len = data->len - g_array_index(graph->priv->head_list, guint, j);
     if (len > 0) break;
   }
 
@@ -629,10 +788,12 @@ static void gpm_graph_widget_autorange_x(GpmGraphWidget *graph) {
   /* get the range for the graph */
   for (j = 0; j < array->len; j++) {
     data = g_ptr_array_index(array, j);
-    for (i = 0; i < data->len; i++) {
+    i = g_array_index(graph->priv->head_list, guint, j);
+    for (; i < data->len; i++) {
       point = (GpmPointObj *)g_ptr_array_index(data, i);
-      if (point->x > biggest_x) biggest_x = point->x;
-      if (point->x < smallest_x) smallest_x = point->x;
+      x = point->x - graph->priv->origin_x;
+      if (x > biggest_x) biggest_x = x;
+      if (x < smallest_x) smallest_x = x;
     }
   }
   g_debug("Data range is %f<x<%f", smallest_x, biggest_x);
@@ -702,7 +863,7 @@ static void gpm_graph_widget_autorange_y(GpmGraphWidget *graph) {
   /* find out if we have no data */
   for (j = 0; j < array->len; j++) {
     data = g_ptr_array_index(array, j);
-    len = data->len;
+    len = data->len - g_array_index(graph->priv->head_list, guint, j);
     if (len > 0) break;
   }
 
@@ -717,7 +878,8 @@ static void gpm_graph_widget_autorange_y(GpmGraphWidget *graph) {
   /* get the range for the graph */
   for (j = 0; j < array->len; j++) {
     data = g_ptr_array_index(array, j);
-    for (i = 0; i < data->len; i++) {
+    i = g_array_index(graph->priv->head_list, guint, j);
+    for (; i < data->len; i++) {
       point = (GpmPointObj *)g_ptr_array_index(data, i);
       if (point->y > biggest_y) biggest_y = point->y;
       if (point->y < smallest_y) smallest_y = point->y;
@@ -828,6 +990,31 @@ static void gpm_graph_widget_get_pos_on_graph(GpmGraphWidget *graph,
        (graph->priv->unit_y * (gfloat)(graph->priv->stop_y - data_y)) + 1.5;
 }
 
+/**
+ * gpm_graph_widget_get_data_x:
+ * @graph: This class instance
+ * @x: The X position on the widget
+ * @data_x: The returned data X-coordinate
+ *
+ * Converts a widget position back into graph units, using the layout from
+ * the last draw.
+ *
+ * Return value: %FALSE if the position is outside the plotted area
+ **/
+gboolean gpm_graph_widget_get_data_x(GpmGraphWidget *graph, gdouble x,
+                                     gfloat *data_x) {
+  g_return_val_if_fail(GPM_IS_GRAPH_WIDGET(graph), FALSE);
+  g_return_val_if_fail(data_x != NULL, FALSE);
+
+  if (graph->priv->unit_x <= 0.0f) return FALSE;
+  if (x < graph->priv->box_x ||
+      x > graph->priv->box_x + graph->priv->box_width)
+    return FALSE;
+  *data_x = ((x - graph->priv->box_x - 1) / graph->priv->unit_x) +
+            graph->priv->start_x;
+  return TRUE;
+}
+
 /**
  * gpm_graph_widget_draw_dot:
  **/
@@ -862,6 +1049,7 @@ static void gpm_graph_widget_draw_line(GpmGraphWidget *graph, cairo_t *cr) {
   GPtrArray *array;
   GpmGraphWidgetPlot plot;
   GpmPointObj *point;
+  guint head;
   guint i, j;
 
   if (graph->priv->data_list->len == 0) {
@@ -875,23 +1063,25 @@ static void gpm_graph_widget_draw_line(GpmGraphWidget *graph, cairo_t *cr) {
   /* do each line */
   for (j = 0; j < array->len; j++) {
     data = g_ptr_array_index(array, j);
-    if (data->len == 0) continue;
+    head = g_array_index(graph->priv->head_list, guint, j);
+    if (data->len <= head) continue;
     plot = GPOINTER_TO_UINT(g_ptr_array_index(graph->priv->plot_list, j));
 
     /* get the very first point so we can work out the old */
-    point = (GpmPointObj *)g_ptr_array_index(data, 0);
+    point = (GpmPointObj *)g_ptr_array_index(data, head);
     oldx = 0;
     oldy = 0;
-    gpm_graph_widget_get_pos_on_graph(graph, point->x, point->y, &oldx, &oldy);
+    gpm_graph_widget_get_pos_on_graph(graph, point->x - graph->priv->origin_x,
+                                      point->y, &oldx, &oldy);
     if (plot == GPM_GRAPH_WIDGET_PLOT_POINTS ||
         plot == GPM_GRAPH_WIDGET_PLOT_BOTH)
       gpm_graph_widget_draw_dot(cr, oldx, oldy, point->color);
 
-    for (i = 1; i < data->len; i++) {
+    for (i = head + 1; i < data->len; i++) {
       point = (GpmPointObj *)g_ptr_array_index(data, i);
 
-      gpm_graph_widget_get_pos_on_graph(graph, point->x, point->y, &newx,
-                                        &newy);
+      gpm_graph_widget_get_pos_on_graph(
+          graph, point->x - graph->priv->origin_x, point->y, &newx, &newy);
 
       /* ignore white lines */
       if (point->color == 0xffffff) {
@@ -947,15 +1137,16 @@ static void gpm_graph_widget_draw_bounding_box(cairo_t *cr, gint x, gint y,
 
 /**
  * gpm_graph_widget_draw_legend:
+ * @graph: This class instance
  * @cr: Cairo drawing context
  * @x: The X-coordinate for the top-left
  * @y: The Y-coordinate for the top-left
  * @width: The item width
  * @height: The item height
  **/
-static void gpm_graph_widget_draw_legend(GpmGraphWidget *graph, gint x, gint y,
-                                         gint width, gint height) {
-  cairo_t *cr = graph->priv->cr;
+static void gpm_graph_widget_draw_legend(GpmGraphWidget *graph, cairo_t *cr,
+                                         gint x, gint y, gint width,
+                                         gint height) {
   gint y_count;
   guint i;
   GpmGraphWidgetKeyData *keydataitem;
@@ -1027,13 +1218,13 @@ static gboolean gpm_graph_widget_legend_calculate_size(GpmGraphWidget *graph,
 }
 
 /**
- * gpm_graph_widget_draw:
+ * gpm_graph_widget_draw_graph:
  * @graph: This class instance
- * @event: The expose event
+ * @cr: Cairo drawing context
  *
- * Just repaint the entire graph widget on expose.
+ * Draws everything apart from the hover read-out.
  **/
-static gboolean gpm_graph_widget_draw(GtkWidget *widget, cairo_t *cr) {
+static void gpm_graph_widget_draw_graph(GtkWidget *widget, cairo_t *cr) {
   GtkAllocation allocation;
   gint legend_x = 0;
   gint legend_y = 0;
@@ -1043,8 +1234,6 @@ static gboolean gpm_graph_widget_draw(GtkWidget *widget, cairo_t *cr) {
   gfloat data_y;
 
   GpmGraphWidget *graph = (GpmGraphWidget *)widget;
-  g_return_val_if_fail(graph != NULL, FALSE);
-  g_return_val_if_fail(GPM_IS_GRAPH_WIDGET(graph), FALSE);
 
   gpm_graph_widget_legend_calculate_size(graph, cr, &legend_width,
                                          &legend_height);
@@ -1086,10 +1275,223 @@ static gboolean gpm_graph_widget_draw(GtkWidget *widget, cairo_t *cr) {
   gpm_graph_widget_draw_line(graph, cr);
 
   if (graph->priv->use_legend && legend_height > 0)
-    gpm_graph_widget_draw_legend(graph, legend_x, legend_y, legend_width,
+    gpm_graph_widget_draw_legend(graph, cr, legend_x, legend_y, legend_width,
                                  legend_height);
 
   cairo_restore(cr);
+}
+
+/**
+ * gpm_graph_widget_get_hover_text:
+ *
+ * Return value: the time, value and key description of the hovered point
+ **/
+static gchar *gpm_graph_widget_get_hover_text(GpmGraphWidget *graph) {
+  GpmGraphWidgetKeyData *keyitem;
+  GString *string;
+  GSList *l;
+  gchar *text;
+
+  string = g_string_new("");
+  text = gpm_get_axis_label(graph->priv->type_x, graph->priv->hover_point.x);
+  g_string_append(string, text);
+  g_free(text);
+
+  /* show the fraction the axis labels leave out */
+  if (graph->priv->type_y == GPM_GRAPH_WIDGET_TYPE_PERCENTAGE)
+    /*Translators: This is %.1f Percentage*/
+    text = g_strdup_printf(_("%.1f%%"), graph->priv->hover_point.y);
+  else
+    text = gpm_get_axis_label(graph->priv->type_y, graph->priv->hover_point.y);
+  g_string_append_printf(string, "\n%s", text);
+  g_free(text);
+
+  /* the key says what the color of the point means */
+  for (l = graph->priv->key_data; l != NULL; l = l->next) {
+    keyitem = (GpmGraphWidgetKeyData *)l->data;
+    if (keyitem->color != graph->priv->hover_point.color) continue;
+    g_string_append_printf(string, "\n%s", keyitem->desc);
+    break;
+  }
+  return g_string_free(string, FALSE);
+}
+
+/**
+ * gpm_graph_widget_update_hover_area:
+ *
+ * Works out where the read-out for the hovered point goes, and queues
+ * only that part of the widget to be drawn again.
+ **/
+static void gpm_graph_widget_update_hover_area(GpmGraphWidget *graph) {
+  PangoRectangle ink_rect, logical_rect;
+  GdkRectangle *area = &graph->priv->hover_area;
+  GdkRectangle *box = &graph->priv->hover_box;
+  gfloat x, y;
+  gchar *text;
+
+  /* remove the old read-out */
+  if (area->width > 0)
+    gtk_widget_queue_draw_area(GTK_WIDGET(graph), area->x, area->y,
+                               area->width, area->height);
+  area->width = 0;
+  if (!graph->priv->hover) return;
+
+  text = gpm_graph_widget_get_hover_text(graph);
+  pango_layout_set_text(graph->priv->layout, text, -1);
+  pango_layout_get_pixel_extents(graph->priv->layout, &ink_rect,
+                                 &logical_rect);
+  g_free(text);
+
+  /* keep the box inside the graph, to the right of the point if we can */
+  gpm_graph_widget_get_pos_on_graph(graph, graph->priv->hover_point.x,
+                                    graph->priv->hover_point.y, &x, &y);
+  box->width = logical_rect.width + 10;
+  box->height = logical_rect.height + 6;
+  box->x = x + 8;
+  if (box->x + box->width > graph->priv->box_x + graph->priv->box_width)
+    box->x = x - 8 - box->width;
+  box->y = y - box->height / 2;
+  box->y = CLAMP(box->y, graph->priv->box_y,
+                 graph->priv->box_y + graph->priv->box_height - box->height);
+
+  /* include the marker around the point */
+  area->x = x - 6;
+  area->y = y - 6;
+  area->width = 12;
+  area->height = 12;
+  gdk_rectangle_union(area, box, area);
+
+  gtk_widget_queue_draw_area(GTK_WIDGET(graph), area->x, area->y, area->width,
+                             area->height);
+}
+
+/**
+ * gpm_graph_widget_draw_hover:
+ * @graph: This class instance
+ * @cr: Cairo drawing context
+ **/
+static void gpm_graph_widget_draw_hover(GpmGraphWidget *graph, cairo_t *cr) {
+  GdkRectangle *box = &graph->priv->hover_box;
+  gfloat x, y;
+  gchar *text;
+
+  gpm_graph_widget_get_pos_on_graph(graph, graph->priv->hover_point.x,
+                                    graph->priv->hover_point.y, &x, &y);
+
+  /* ring around the point */
+  cairo_save(cr);
+  cairo_arc(cr, x, y, 4, 0, 2 * G_PI);
+  cairo_set_line_width(cr, 1.5);
+  cairo_set_source_rgb(cr, 0, 0, 0);
+  cairo_stroke(cr);
+
+  /* text box, placed by gpm_graph_widget_update_hover_area() */
+  text = gpm_graph_widget_get_hover_text(graph);
+  pango_layout_set_text(graph->priv->layout, text, -1);
+  g_free(text);
+  gpm_graph_widget_draw_bounding_box(cr, box->x, box->y, box->width,
+                                     box->height);
+  cairo_move_to(cr, box->x + 5, box->y + 3);
+  cairo_set_source_rgb(cr, 0, 0, 0);
+  pango_cairo_show_layout(cr, graph->priv->layout);
+  cairo_restore(cr);
+}
+
+/**
+ * gpm_graph_widget_motion_notify_event:
+ *
+ * Finds the point nearest to the pointer on any of the lines.
+ **/
+static gboolean gpm_graph_widget_motion_notify_event(GtkWidget *widget,
+                                                     GdkEventMotion *event) {
+  GpmGraphWidget *graph = (GpmGraphWidget *)widget;
+  const GpmPointObj *point;
+  GPtrArray *data;
+  gfloat data_x;
+  gfloat data_y;
+  gfloat distance;
+  gfloat best = G_MAXFLOAT;
+  gfloat x, y;
+  guint index;
+  guint j;
+
+  graph->priv->hover = FALSE;
+  if (graph->priv->unit_y > 0.0f &&
+      gpm_graph_widget_get_data_x(graph, event->x, &data_x)) {
+    data_y = graph->priv->stop_y -
+             (event->y - graph->priv->box_y - 1.5) / graph->priv->unit_y;
+    for (j = 0; j < graph->priv->data_list->len; j++) {
+      data = g_ptr_array_index(graph->priv->data_list, j);
+      if (!gpm_point_obj_array_find_nearest(
+              data, g_array_index(graph->priv->head_list, guint, j),
+              data_x + graph->priv->origin_x, data_y,
+              1.0f / graph->priv->unit_x, &index))
+        continue;
+      point = g_ptr_array_index(data, index);
+      gpm_graph_widget_get_pos_on_graph(
+          graph, point->x - graph->priv->origin_x, point->y, &x, &y);
+      distance =
+          (x - event->x) * (x - event->x) + (y - event->y) * (y - event->y);
+      if (distance >= best) continue;
+      best = distance;
+      graph->priv->hover = TRUE;
+      graph->priv->hover_point = *point;
+      graph->priv->hover_point.x -= graph->priv->origin_x;
+    }
+  }
+  gpm_graph_widget_update_hover_area(graph);
+  return FALSE;
+}
+
+/**
+ * gpm_graph_widget_leave_notify_event:
+ **/
+static gboolean gpm_graph_widget_leave_notify_event(GtkWidget *widget,
+                                                    GdkEventCrossing *event) {
+  GpmGraphWidget *graph = (GpmGraphWidget *)widget;
+  graph->priv->hover = FALSE;
+  gpm_graph_widget_update_hover_area(graph);
+  return FALSE;
+}
+
+/**
+ * gpm_graph_widget_draw:
+ * @graph: This class instance
+ * @cr: Cairo drawing context
+ *
+ * Repaints the graph from the last time it was drawn, so that moving the
+ * pointer only has to draw the read-out again.
+ **/
+static gboolean gpm_graph_widget_draw(GtkWidget *widget, cairo_t *cr) {
+  GpmGraphWidget *graph = (GpmGraphWidget *)widget;
+  cairo_t *cr_surface;
+  gint width;
+  gint height;
+
+  g_return_val_if_fail(graph != NULL, FALSE);
+  g_return_val_if_fail(GPM_IS_GRAPH_WIDGET(graph), FALSE);
+
+  width = gtk_widget_get_allocated_width(widget);
+  height = gtk_widget_get_allocated_height(widget);
+  if (graph->priv->surface == NULL || graph->priv->surface_width != width ||
+      graph->priv->surface_height != height) {
+    g_clear_pointer(&graph->priv->surface, cairo_surface_destroy);
+    graph->priv->surface = gdk_window_create_similar_surface(
+        gtk_widget_get_window(widget), CAIRO_CONTENT_COLOR_ALPHA, width,
+        height);
+    graph->priv->surface_width = width;
+    graph->priv->surface_height = height;
+    cr_surface = cairo_create(graph->priv->surface);
+    gpm_graph_widget_draw_graph(widget, cr_surface);
+    cairo_destroy(cr_surface);
+  }
+
+  cairo_save(cr);
+  cairo_set_source_surface(cr, graph->priv->surface, 0, 0);
+  cairo_paint(cr);
+  cairo_restore(cr);
+
+  if (graph->priv->hover) gpm_graph_widget_draw_hover(graph, cr);
   return FALSE;
 }
 
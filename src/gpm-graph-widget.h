@@ -85,8 +85,17 @@ gboolean gpm_graph_widget_data_clear(GpmGraphWidget *graph);
 gboolean gpm_graph_widget_data_assign(GpmGraphWidget *graph,
                                       GpmGraphWidgetPlot plot,
                                       GPtrArray *array);
+gboolean gpm_graph_widget_data_append(GpmGraphWidget *graph, guint line,
+                                      const GpmPointObj *point);
+gboolean gpm_graph_widget_data_trim(GpmGraphWidget *graph, gfloat x);
+guint gpm_graph_widget_data_get_length(GpmGraphWidget *graph, guint line);
+gboolean gpm_graph_widget_data_set_y(GpmGraphWidget *graph, guint line,
+                                     guint index, gfloat y);
+gboolean gpm_graph_widget_key_data_clear(GpmGraphWidget *graph);
 gboolean gpm_graph_widget_key_data_add(GpmGraphWidget *graph, guint32 color,
                                        const gchar *desc);
+gboolean gpm_graph_widget_get_data_x(GpmGraphWidget *graph, gdouble x,
+                                     gfloat *data_x);
 
 G_END_DECLS
 
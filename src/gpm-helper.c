@@ -0,0 +1,67 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gpm-helper.h"
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <unistd.h>
+
+/**
+ * gpm_helper_check_caller:
+ * @use_copy: If the helper was pointed at a copy of sysfs
+ *
+ * The real files are only written as root through pkexec, and a copy only
+ * with the rights of whoever runs the helper.
+ *
+ * Return value: %GPM_HELPER_EXIT_CODE_SUCCESS, or what to exit with
+ **/
+gint gpm_helper_check_caller(gboolean use_copy) {
+  const gchar *pkexec_uid_str;
+
+  pkexec_uid_str = g_getenv("PKEXEC_UID");
+  if (use_copy) {
+    if (getuid() == 0 || geteuid() == 0 || pkexec_uid_str != NULL) {
+      g_print("%s\n", _("A copy of sysfs cannot be used as root"));
+      return GPM_HELPER_EXIT_CODE_INVALID_USER;
+    }
+    return GPM_HELPER_EXIT_CODE_SUCCESS;
+  }
+
+  /* get calling process */
+  if (getuid() != 0 || geteuid() != 0) {
+    /* TRANSLATORS: only able to change the hardware as root */
+    g_print("%s\n", _("This program can only be used by the root user"));
+    return GPM_HELPER_EXIT_CODE_ARGUMENTS_INVALID;
+  }
+
+  /* check we're not being spoofed */
+  if (pkexec_uid_str == NULL) {
+    /* TRANSLATORS: the program must never be directly run */
+    g_print("%s\n", _("This program must only be run through pkexec"));
+    return GPM_HELPER_EXIT_CODE_INVALID_USER;
+  }
+  return GPM_HELPER_EXIT_CODE_SUCCESS;
+}
@@ -0,0 +1,39 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_HELPER_H
+#define __GPM_HELPER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* what the privileged helpers exit with */
+#define GPM_HELPER_EXIT_CODE_SUCCESS 0
+#define GPM_HELPER_EXIT_CODE_FAILED 1
+#define GPM_HELPER_EXIT_CODE_ARGUMENTS_INVALID 3
+#define GPM_HELPER_EXIT_CODE_INVALID_USER 4
+
+gint gpm_helper_check_caller(gboolean use_copy);
+
+G_END_DECLS
+
+#endif /* __GPM_HELPER_H */
@@ -0,0 +1,456 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "gpm-history-cache.h"
+
+/* "GPMH" in host byte order, a cache copied from another architecture
+ * fails the check and is simply rebuilt */
+#define GPM_HISTORY_CACHE_MAGIC 0x484d5047
+
+/* the header is padded so the records that follow are nicely aligned */
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  guint32 record_size;
+  guint32 capacity;
+  guint32 head; /* slot the next record is written to */
+  guint32 length;
+  guint32 last_time;
+  guint32 checksum;
+  guint32 reserved[8];
+} GpmHistoryCacheHeader;
+
+struct GpmHistoryCache {
+  gchar *filename;
+  gsize size;
+  gpointer map;
+  GpmHistoryCacheHeader *header;
+  GpmHistoryCacheItem *items;
+};
+
+/**
+ * gpm_history_cache_checksum:
+ *
+ * FNV-1a over the header fields, so a torn header write is detected.
+ **/
+static guint32 gpm_history_cache_checksum(const GpmHistoryCacheHeader *header) {
+  const guint32 *words = (const guint32 *)header;
+  guint32 hash = 2166136261u;
+  guint i;
+
+  for (i = 0; i < G_STRUCT_OFFSET(GpmHistoryCacheHeader, checksum) / 4; i++) {
+    hash ^= words[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * gpm_history_cache_header_is_valid:
+ **/
+static gboolean gpm_history_cache_header_is_valid(
+    const GpmHistoryCacheHeader *header, guint capacity) {
+  if (header->magic != GPM_HISTORY_CACHE_MAGIC) return FALSE;
+  if (header->version != GPM_HISTORY_CACHE_VERSION) return FALSE;
+  if (header->record_size != sizeof(GpmHistoryCacheItem)) return FALSE;
+  if (header->capacity != capacity) return FALSE;
+  if (header->head >= capacity) return FALSE;
+  if (header->length > capacity) return FALSE;
+  if (header->checksum != gpm_history_cache_checksum(header)) return FALSE;
+  return TRUE;
+}
+
+/**
+ * gpm_history_cache_get_filename:
+ * @device_id: The device object path or any other unique ID
+ * @type: The history type, e.g. "charge"
+ *
+ * Return value: the cache file to use for the device, free with g_free()
+ **/
+gchar *gpm_history_cache_get_filename(const gchar *device_id,
+                                      const gchar *type) {
+  gchar *id;
+  gchar *basename;
+  gchar *filename;
+
+  g_return_val_if_fail(device_id != NULL, NULL);
+  g_return_val_if_fail(type != NULL, NULL);
+
+  /* /org/freedesktop/UPower/devices/battery_BAT0 -> battery_BAT0 */
+  id = g_path_get_basename(device_id);
+  basename = g_strdup_printf("%s-%s.cache", id, type);
+  g_strcanon(basename, G_CSET_A_2_Z G_CSET_a_2_z G_CSET_DIGITS "-_.", '_');
+  filename = g_build_filename(g_get_user_cache_dir(), "mate-power-manager",
+                              "history", basename, NULL);
+  g_free(basename);
+  g_free(id);
+  return filename;
+}
+
+/**
+ * gpm_history_cache_open:
+ * @filename: The cache file, which is created if it does not exist
+ * @capacity: The number of records the ring can hold
+ * @error: a #GError, or %NULL
+ *
+ * Maps the cache file into memory. If the file was truncated, was written
+ * by a different version, or has a corrupt header then it is reset to an
+ * empty cache rather than failing.
+ *
+ * Return value: a new cache, or %NULL if the file could not be mapped
+ **/
+GpmHistoryCache *gpm_history_cache_open(const gchar *filename, guint capacity,
+                                        GError **error) {
+  GpmHistoryCache *cache;
+  struct stat st;
+  gchar *dirname;
+  gpointer map;
+  gsize size;
+  gint fd;
+
+  g_return_val_if_fail(filename != NULL, NULL);
+  g_return_val_if_fail(capacity > 0, NULL);
+
+  dirname = g_path_get_dirname(filename);
+  g_mkdir_with_parents(dirname, 0700);
+  g_free(dirname);
+
+  size = sizeof(GpmHistoryCacheHeader) + capacity * sizeof(GpmHistoryCacheItem);
+  fd = g_open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "failed to open %s: %s", filename, g_strerror(errno));
+    return NULL;
+  }
+
+  /* a short or oversized file cannot be trusted, start again */
+  if (fstat(fd, &st) < 0 || (gsize)st.st_size != size) {
+    if (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0) {
+      g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                  "failed to resize %s: %s", filename, g_strerror(errno));
+      close(fd);
+      return NULL;
+    }
+  }
+
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "failed to map %s: %s", filename, g_strerror(errno));
+    return NULL;
+  }
+
+  cache = g_new0(GpmHistoryCache, 1);
+  cache->filename = g_strdup(filename);
+  cache->size = size;
+  cache->map = map;
+  cache->header = (GpmHistoryCacheHeader *)map;
+  cache->items =
+      (GpmHistoryCacheItem *)((guint8 *)map + sizeof(GpmHistoryCacheHeader));
+
+  if (!gpm_history_cache_header_is_valid(cache->header, capacity)) {
+    g_debug("resetting invalid history cache %s", filename);
+    cache->header->capacity = capacity;
+    gpm_history_cache_clear(cache);
+  }
+  return cache;
+}
+
+/**
+ * gpm_history_cache_free:
+ **/
+void gpm_history_cache_free(GpmHistoryCache *cache) {
+  if (cache == NULL) return;
+  munmap(cache->map, cache->size);
+  g_free(cache->filename);
+  g_free(cache);
+}
+
+/**
+ * gpm_history_cache_clear:
+ *
+ * Drops all records, keeping the file mapped.
+ **/
+void gpm_history_cache_clear(GpmHistoryCache *cache) {
+  GpmHistoryCacheHeader *header;
+  guint32 capacity;
+
+  g_return_if_fail(cache != NULL);
+
+  header = cache->header;
+  capacity = header->capacity;
+  memset(header, 0, sizeof(GpmHistoryCacheHeader));
+  header->magic = GPM_HISTORY_CACHE_MAGIC;
+  header->version = GPM_HISTORY_CACHE_VERSION;
+  header->record_size = sizeof(GpmHistoryCacheItem);
+  header->capacity = capacity;
+  header->checksum = gpm_history_cache_checksum(header);
+}
+
+/**
+ * gpm_history_cache_append:
+ * @time: The UNIX time of the record, in seconds
+ * @value: The history value
+ * @state: The #UpDeviceState when the value was recorded
+ *
+ * Appends a record, overwriting the oldest one when the ring is full.
+ * The record is written before the header, so a crash part-way through
+ * loses at most the new record.
+ *
+ * Return value: %FALSE if the record is not newer than the last one
+ **/
+gboolean gpm_history_cache_append(GpmHistoryCache *cache, guint32 time,
+                                  gfloat value, guint32 state) {
+  GpmHistoryCacheHeader *header;
+  GpmHistoryCacheItem *item;
+
+  g_return_val_if_fail(cache != NULL, FALSE);
+
+  header = cache->header;
+  if (header->length > 0 && time <= header->last_time) return FALSE;
+
+  item = &cache->items[header->head];
+  item->time = time;
+  item->value = value;
+  item->state = state;
+
+  header->head = (header->head + 1) % header->capacity;
+  if (header->length < header->capacity) header->length++;
+  header->last_time = time;
+  header->checksum = gpm_history_cache_checksum(header);
+  return TRUE;
+}
+
+/**
+ * gpm_history_cache_get_length:
+ **/
+guint gpm_history_cache_get_length(GpmHistoryCache *cache) {
+  g_return_val_if_fail(cache != NULL, 0);
+  return cache->header->length;
+}
+
+/**
+ * gpm_history_cache_get_capacity:
+ **/
+guint gpm_history_cache_get_capacity(GpmHistoryCache *cache) {
+  g_return_val_if_fail(cache != NULL, 0);
+  return cache->header->capacity;
+}
+
+/**
+ * gpm_history_cache_get_last_time:
+ *
+ * Return value: the time of the newest record, or 0 if the cache is empty
+ **/
+guint32 gpm_history_cache_get_last_time(GpmHistoryCache *cache) {
+  g_return_val_if_fail(cache != NULL, 0);
+  if (cache->header->length == 0) return 0;
+  return cache->header->last_time;
+}
+
+/**
+ * gpm_history_cache_index:
+ * @i: The record index, where 0 is the oldest record
+ *
+ * Return value: the record, which points into the mapped file and is only
+ * valid until the next append
+ **/
+const GpmHistoryCacheItem *gpm_history_cache_index(GpmHistoryCache *cache,
+                                                   guint i) {
+  GpmHistoryCacheHeader *header;
+  guint slot;
+
+  g_return_val_if_fail(cache != NULL, NULL);
+  header = cache->header;
+  g_return_val_if_fail(i < header->length, NULL);
+
+  slot = (header->head + header->capacity - header->length + i) %
+         header->capacity;
+  return &cache->items[slot];
+}
+
+/**
+ * gpm_history_cache_find_time:
+ * @time: The UNIX time, in seconds
+ *
+ * Return value: the index of the first record at or after @time, or the
+ * cache length if there are none
+ **/
+guint gpm_history_cache_find_time(GpmHistoryCache *cache, guint32 time) {
+  guint low = 0;
+  guint high;
+  guint mid;
+
+  g_return_val_if_fail(cache != NULL, 0);
+
+  /* records are always appended in time order */
+  high = cache->header->length;
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    if (gpm_history_cache_index(cache, mid)->time < time)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+void gpm_history_cache_test(gpointer data) {
+  GpmHistoryCache *cache;
+  const GpmHistoryCacheItem *item;
+  gchar *filename;
+  gboolean ret;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmHistoryCache")) return;
+
+  filename = g_build_filename(g_get_tmp_dir(), "gpm-self-test-history.cache",
+                              NULL);
+  g_unlink(filename);
+
+  /************************************************************/
+  egg_test_title(test, "get filename for device");
+  {
+    gchar *tmp;
+    tmp = gpm_history_cache_get_filename(
+        "/org/freedesktop/UPower/devices/battery_BAT0", "charge");
+    if (g_str_has_suffix(tmp, "battery_BAT0-charge.cache"))
+      egg_test_success(test, NULL);
+    else
+      egg_test_failed(test, "got filename %s", tmp);
+    g_free(tmp);
+  }
+
+  /************************************************************/
+  egg_test_title(test, "open new cache");
+  cache = gpm_history_cache_open(filename, 4, NULL);
+  if (cache != NULL && gpm_history_cache_get_length(cache) == 0)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "failed to open empty cache");
+
+  /************************************************************/
+  egg_test_title(test, "append records");
+  gpm_history_cache_append(cache, 100, 1.0f, 1);
+  gpm_history_cache_append(cache, 200, 2.0f, 2);
+  gpm_history_cache_append(cache, 300, 3.0f, 1);
+  if (gpm_history_cache_get_length(cache) == 3 &&
+      gpm_history_cache_get_last_time(cache) == 300)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got length %i",
+                    gpm_history_cache_get_length(cache));
+
+  /************************************************************/
+  egg_test_title(test, "do not append older record");
+  ret = gpm_history_cache_append(cache, 300, 4.0f, 1);
+  egg_test_assert(test, !ret && gpm_history_cache_get_length(cache) == 3);
+
+  /************************************************************/
+  egg_test_title(test, "index records");
+  item = gpm_history_cache_index(cache, 1);
+  if (item->time == 200 && item->value == 2.0f && item->state == 2)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got time %i", item->time);
+
+  /************************************************************/
+  egg_test_title(test, "wrap the ring");
+  for (i = 4; i <= 6; i++) gpm_history_cache_append(cache, i * 100, i, 1);
+  item = gpm_history_cache_index(cache, 0);
+  if (gpm_history_cache_get_length(cache) == 4 && item->time == 300)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got oldest time %i", item->time);
+
+  /************************************************************/
+  egg_test_title(test, "find time");
+  egg_test_assert(test, gpm_history_cache_find_time(cache, 0) == 0 &&
+                            gpm_history_cache_find_time(cache, 401) == 2 &&
+                            gpm_history_cache_find_time(cache, 600) == 3 &&
+                            gpm_history_cache_find_time(cache, 601) == 4);
+
+  /************************************************************/
+  egg_test_title(test, "reopen keeps records");
+  gpm_history_cache_free(cache);
+  cache = gpm_history_cache_open(filename, 4, NULL);
+  item = gpm_history_cache_index(cache, 3);
+  if (gpm_history_cache_get_length(cache) == 4 && item->time == 600)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got length %i",
+                    gpm_history_cache_get_length(cache));
+  gpm_history_cache_free(cache);
+
+  /************************************************************/
+  egg_test_title(test, "reopen with other capacity resets");
+  cache = gpm_history_cache_open(filename, 8, NULL);
+  egg_test_assert(test, gpm_history_cache_get_length(cache) == 0 &&
+                            gpm_history_cache_get_capacity(cache) == 8);
+  gpm_history_cache_append(cache, 100, 1.0f, 1);
+  gpm_history_cache_free(cache);
+
+  /************************************************************/
+  egg_test_title(test, "corrupt header resets");
+  g_file_set_contents(filename, "corrupt", -1, NULL);
+  cache = gpm_history_cache_open(filename, 8, NULL);
+  egg_test_assert(test, cache != NULL &&
+                            gpm_history_cache_get_length(cache) == 0);
+  gpm_history_cache_append(cache, 100, 1.0f, 1);
+  gpm_history_cache_free(cache);
+
+  /************************************************************/
+  egg_test_title(test, "truncated file resets");
+  if (truncate(filename, 80) < 0) egg_test_failed(test, "failed to truncate");
+  cache = gpm_history_cache_open(filename, 8, NULL);
+  egg_test_assert(test, cache != NULL &&
+                            gpm_history_cache_get_length(cache) == 0);
+  gpm_history_cache_free(cache);
+
+  g_unlink(filename);
+  g_free(filename);
+
+  egg_test_end(test);
+}
+
+#endif
@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_HISTORY_CACHE_H
+#define __GPM_HISTORY_CACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* bump this if the on-disk layout changes, old files are then discarded */
+#define GPM_HISTORY_CACHE_VERSION 1
+
+typedef struct {
+  guint32 time;
+  gfloat value;
+  guint32 state;
+} GpmHistoryCacheItem;
+
+typedef struct GpmHistoryCache GpmHistoryCache;
+
+gchar *gpm_history_cache_get_filename(const gchar *device_id,
+                                      const gchar *type);
+GpmHistoryCache *gpm_history_cache_open(const gchar *filename, guint capacity,
+                                        GError **error);
+void gpm_history_cache_free(GpmHistoryCache *cache);
+void gpm_history_cache_clear(GpmHistoryCache *cache);
+gboolean gpm_history_cache_append(GpmHistoryCache *cache, guint32 time,
+                                  gfloat value, guint32 state);
+guint gpm_history_cache_get_length(GpmHistoryCache *cache);
+guint gpm_history_cache_get_capacity(GpmHistoryCache *cache);
+guint32 gpm_history_cache_get_last_time(GpmHistoryCache *cache);
+const GpmHistoryCacheItem *gpm_history_cache_index(GpmHistoryCache *cache,
+                                                   guint i);
+guint gpm_history_cache_find_time(GpmHistoryCache *cache, guint32 time);
+#ifdef EGG_TEST
+void gpm_history_cache_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_HISTORY_CACHE_H */
@@ -0,0 +1,446 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <string.h>
+
+#include "gpm-history-pyramid.h"
+
+struct GpmHistoryPyramid {
+  guint factor;
+  guint n_levels;
+  guint *intervals; /* bucket width of each level, in seconds */
+  GArray **levels;  /* of GpmHistoryBucket, oldest first */
+  guint32 last_time;
+  gboolean has_data;
+};
+
+/**
+ * gpm_history_pyramid_new:
+ * @interval: The bucket width of the finest level, in seconds
+ * @factor: How many buckets of one level make up a bucket of the next
+ * @levels: The number of levels to keep
+ *
+ * Creates an empty pyramid. Each added point updates the newest bucket of
+ * every level, so the pyramid is always complete and never rebuilt.
+ *
+ * Return value: a new pyramid, free with gpm_history_pyramid_free()
+ **/
+GpmHistoryPyramid *gpm_history_pyramid_new(guint interval, guint factor,
+                                           guint levels) {
+  GpmHistoryPyramid *pyramid;
+  guint64 width;
+  guint i;
+
+  g_return_val_if_fail(interval > 0, NULL);
+  g_return_val_if_fail(factor > 1, NULL);
+  g_return_val_if_fail(levels > 0, NULL);
+
+  pyramid = g_new0(GpmHistoryPyramid, 1);
+  pyramid->factor = factor;
+  pyramid->n_levels = levels;
+  pyramid->intervals = g_new0(guint, levels);
+  pyramid->levels = g_new0(GArray *, levels);
+  width = interval;
+  for (i = 0; i < levels; i++) {
+    pyramid->intervals[i] = (guint)MIN(width, G_MAXUINT32 / 2);
+    pyramid->levels[i] =
+        g_array_new(FALSE, FALSE, sizeof(GpmHistoryBucket));
+    width *= factor;
+  }
+  return pyramid;
+}
+
+/**
+ * gpm_history_pyramid_free:
+ **/
+void gpm_history_pyramid_free(GpmHistoryPyramid *pyramid) {
+  guint i;
+
+  if (pyramid == NULL) return;
+  for (i = 0; i < pyramid->n_levels; i++)
+    g_array_unref(pyramid->levels[i]);
+  g_free(pyramid->levels);
+  g_free(pyramid->intervals);
+  g_free(pyramid);
+}
+
+/**
+ * gpm_history_pyramid_clear:
+ **/
+void gpm_history_pyramid_clear(GpmHistoryPyramid *pyramid) {
+  guint i;
+
+  g_return_if_fail(pyramid != NULL);
+  for (i = 0; i < pyramid->n_levels; i++)
+    g_array_set_size(pyramid->levels[i], 0);
+  pyramid->last_time = 0;
+  pyramid->has_data = FALSE;
+}
+
+/**
+ * gpm_history_pyramid_add:
+ * @time: The UNIX time of the point, in seconds
+ * @value: The history value
+ * @state: The #UpDeviceState when the value was recorded
+ *
+ * Folds the point into every level. This is O(levels).
+ *
+ * Return value: %FALSE if the point is older than the last one added
+ **/
+gboolean gpm_history_pyramid_add(GpmHistoryPyramid *pyramid, guint32 time,
+                                 gfloat value, guint32 state) {
+  GpmHistoryBucket *bucket;
+  GpmHistoryBucket new;
+  GArray *array;
+  guint32 start;
+  guint i;
+
+  g_return_val_if_fail(pyramid != NULL, FALSE);
+
+  if (pyramid->has_data && time < pyramid->last_time) return FALSE;
+  pyramid->last_time = time;
+  pyramid->has_data = TRUE;
+
+  for (i = 0; i < pyramid->n_levels; i++) {
+    array = pyramid->levels[i];
+    start = time - (time % pyramid->intervals[i]);
+
+    /* still inside the newest bucket */
+    if (array->len > 0) {
+      bucket = &g_array_index(array, GpmHistoryBucket, array->len - 1);
+      if (bucket->start == start) {
+        if (value < bucket->min) {
+          bucket->min = value;
+          bucket->min_time = time;
+        }
+        if (value > bucket->max) {
+          bucket->max = value;
+          bucket->max_time = time;
+        }
+        bucket->sum += value;
+        bucket->count++;
+        bucket->state_last = state;
+        continue;
+      }
+    }
+
+    /* gaps in the history simply have no buckets */
+    new.start = start;
+    new.min_time = time;
+    new.max_time = time;
+    new.min = value;
+    new.max = value;
+    new.sum = value;
+    new.count = 1;
+    new.state_first = state;
+    new.state_last = state;
+    g_array_append_val(array, new);
+  }
+  return TRUE;
+}
+
+/**
+ * gpm_history_pyramid_get_last_time:
+ *
+ * Return value: the time of the newest point, or 0 if there are none
+ **/
+guint32 gpm_history_pyramid_get_last_time(GpmHistoryPyramid *pyramid) {
+  g_return_val_if_fail(pyramid != NULL, 0);
+  return pyramid->last_time;
+}
+
+/**
+ * gpm_history_pyramid_get_levels:
+ **/
+guint gpm_history_pyramid_get_levels(GpmHistoryPyramid *pyramid) {
+  g_return_val_if_fail(pyramid != NULL, 0);
+  return pyramid->n_levels;
+}
+
+/**
+ * gpm_history_pyramid_get_interval:
+ *
+ * Return value: the bucket width of @level, in seconds
+ **/
+guint gpm_history_pyramid_get_interval(GpmHistoryPyramid *pyramid,
+                                       guint level) {
+  g_return_val_if_fail(pyramid != NULL, 0);
+  g_return_val_if_fail(level < pyramid->n_levels, 0);
+  return pyramid->intervals[level];
+}
+
+/**
+ * gpm_history_pyramid_select_level:
+ * @start: The first time shown, in seconds
+ * @stop: The last time shown, in seconds
+ * @pixels: The width available to draw the timespan
+ *
+ * Picks the coarsest level that still has at least one bucket per pixel.
+ *
+ * Return value: the level to query
+ **/
+guint gpm_history_pyramid_select_level(GpmHistoryPyramid *pyramid,
+                                       guint32 start, guint32 stop,
+                                       guint pixels) {
+  guint32 target;
+  guint level = 0;
+  guint i;
+
+  g_return_val_if_fail(pyramid != NULL, 0);
+
+  if (stop <= start) return 0;
+  target = (stop - start) / MAX(pixels, 1);
+  for (i = 1; i < pyramid->n_levels; i++) {
+    if (pyramid->intervals[i] > target) break;
+    level = i;
+  }
+  return level;
+}
+
+/**
+ * gpm_history_pyramid_bisect:
+ *
+ * Return value: the index of the first bucket that ends after @time
+ **/
+static guint gpm_history_pyramid_bisect(GArray *array, guint interval,
+                                        guint32 time) {
+  GpmHistoryBucket *bucket;
+  guint low = 0;
+  guint high = array->len;
+  guint mid;
+
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    bucket = &g_array_index(array, GpmHistoryBucket, mid);
+    if ((guint64)bucket->start + interval <= time)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+/**
+ * gpm_history_pyramid_query:
+ * @level: The level, usually from gpm_history_pyramid_select_level()
+ * @start: The first time wanted, in seconds
+ * @stop: The last time wanted, in seconds
+ * @length: The returned number of buckets
+ *
+ * Finds the buckets that overlap the timespan without copying them.
+ *
+ * Return value: the first bucket, valid until the next add, or %NULL
+ **/
+const GpmHistoryBucket *gpm_history_pyramid_query(GpmHistoryPyramid *pyramid,
+                                                  guint level, guint32 start,
+                                                  guint32 stop, guint *length) {
+  GArray *array;
+  guint interval;
+  guint first;
+  guint last;
+
+  g_return_val_if_fail(pyramid != NULL, NULL);
+  g_return_val_if_fail(level < pyramid->n_levels, NULL);
+  g_return_val_if_fail(length != NULL, NULL);
+
+  array = pyramid->levels[level];
+  interval = pyramid->intervals[level];
+  first = gpm_history_pyramid_bisect(array, interval, start);
+  last = gpm_history_pyramid_bisect(array, interval, stop);
+
+  /* include the bucket that @stop falls inside */
+  if (last < array->len &&
+      g_array_index(array, GpmHistoryBucket, last).start <= stop)
+    last++;
+
+  *length = last - first;
+  if (*length == 0) return NULL;
+  return &g_array_index(array, GpmHistoryBucket, first);
+}
+
+/**
+ * gpm_history_bucket_get_mean:
+ **/
+gfloat gpm_history_bucket_get_mean(const GpmHistoryBucket *bucket) {
+  g_return_val_if_fail(bucket != NULL, 0.0f);
+  if (bucket->count == 0) return 0.0f;
+  return (gfloat)(bucket->sum / bucket->count);
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+void gpm_history_pyramid_test(gpointer data) {
+  GpmHistoryPyramid *pyramid;
+  const GpmHistoryBucket *buckets;
+  guint32 start;
+  guint32 time;
+  guint elapsed;
+  guint length;
+  guint level;
+  guint i;
+  guint j;
+  gfloat value;
+  gfloat min;
+  gfloat max;
+  gboolean ret;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmHistoryPyramid")) return;
+
+  /************************************************************/
+  egg_test_title(test, "make a new pyramid");
+  pyramid = gpm_history_pyramid_new(30, 4, 8);
+  if (pyramid != NULL && gpm_history_pyramid_get_levels(pyramid) == 8 &&
+      gpm_history_pyramid_get_interval(pyramid, 2) == 480)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "failed to make pyramid");
+
+  /************************************************************/
+  egg_test_title(test, "add points with a spike and a dip");
+  start = 1000 * 30 * 4 * 4 * 4 * 4;
+  for (i = 0; i < 1000; i++) {
+    value = 50.0f + (i % 7);
+    if (i == 123) value = 99.5f;
+    if (i == 789) value = 0.25f;
+    gpm_history_pyramid_add(pyramid, start + i * 30, value, i < 500 ? 1 : 2);
+  }
+  egg_test_assert(test,
+                  gpm_history_pyramid_get_last_time(pyramid) == start + 999 * 30);
+
+  /************************************************************/
+  egg_test_title(test, "do not add older points");
+  ret = gpm_history_pyramid_add(pyramid, start, 1.0f, 1);
+  egg_test_assert(test, !ret);
+
+  /************************************************************/
+  egg_test_title(test, "coarse level preserves exact min and max");
+  buckets = gpm_history_pyramid_query(pyramid, 7, 0, G_MAXUINT32, &length);
+  min = G_MAXFLOAT;
+  max = -G_MAXFLOAT;
+  for (i = 0; i < length; i++) {
+    if (buckets[i].min < min) min = buckets[i].min;
+    if (buckets[i].max > max) max = buckets[i].max;
+  }
+  if (length > 0 && min == 0.25f && max == 99.5f)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got min %f, max %f over %i buckets", min, max,
+                    length);
+
+  /************************************************************/
+  egg_test_title(test, "extremes keep their timestamps");
+  for (i = 0; i < length; i++) {
+    if (buckets[i].max == 99.5f && buckets[i].max_time != start + 123 * 30)
+      egg_test_failed(test, "max at %i", buckets[i].max_time);
+    if (buckets[i].min == 0.25f && buckets[i].min_time != start + 789 * 30)
+      egg_test_failed(test, "min at %i", buckets[i].min_time);
+  }
+  egg_test_success(test, NULL);
+
+  /************************************************************/
+  egg_test_title(test, "every level covers every point");
+  for (level = 0; level < 8; level++) {
+    buckets =
+        gpm_history_pyramid_query(pyramid, level, 0, G_MAXUINT32, &length);
+    j = 0;
+    for (i = 0; i < length; i++) j += buckets[i].count;
+    if (j != 1000) egg_test_failed(test, "level %i has %i points", level, j);
+  }
+  egg_test_success(test, NULL);
+
+  /************************************************************/
+  egg_test_title(test, "state transition is kept in the bucket");
+  buckets = gpm_history_pyramid_query(pyramid, 2, start + 499 * 30,
+                                      start + 500 * 30, &length);
+  if (length == 1 && buckets[0].state_first == 1 && buckets[0].state_last == 2)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %i buckets", length);
+
+  /************************************************************/
+  egg_test_title(test, "select level for timespan");
+  level = gpm_history_pyramid_select_level(pyramid, 0, 7 * 24 * 60 * 60, 400);
+  if (level == 2)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got level %i", level);
+
+  /************************************************************/
+  egg_test_title(test, "query partial range");
+  buckets =
+      gpm_history_pyramid_query(pyramid, 0, start + 30, start + 90, &length);
+  if (length == 3 && buckets[0].start == start + 30)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %i buckets", length);
+
+  /************************************************************/
+  egg_test_title(test, "query empty range");
+  buckets = gpm_history_pyramid_query(pyramid, 0, 0, 100, &length);
+  egg_test_assert(test, buckets == NULL && length == 0);
+
+  gpm_history_pyramid_free(pyramid);
+
+  /************************************************************/
+  egg_test_title(test, "build a year of 30 second samples");
+  pyramid = gpm_history_pyramid_new(30, 4, 8);
+  start = 1500000000;
+  time = start;
+  for (i = 0; i < 365 * 24 * 120; i++) {
+    value = 50.0f + 40.0f * ((i / 97) % 2 ? 1.0f : -1.0f) + (i % 13);
+    gpm_history_pyramid_add(pyramid, time, value, (i / 2000) % 2 + 1);
+    time += 30;
+  }
+  elapsed = egg_test_elapsed(test);
+  egg_test_success(test, "%i points in %ims", i, elapsed);
+
+  /************************************************************/
+  egg_test_title(test, "query random timespans at 600 pixels");
+  j = 0;
+  for (i = 0; i < 10000; i++) {
+    guint32 span = 600 << (i % 14);
+    guint32 stop = time - (i * 7919) % (time - start - span);
+    level = gpm_history_pyramid_select_level(pyramid, stop - span, stop, 600);
+    buckets = gpm_history_pyramid_query(pyramid, level, stop - span, stop,
+                                        &length);
+    if (length > 600 * 4 + 2)
+      egg_test_failed(test, "got %i buckets for %is", length, span);
+    j += length;
+  }
+  elapsed = egg_test_elapsed(test);
+  egg_test_success(test, "10000 queries, %i buckets in %ims", j, elapsed);
+
+  gpm_history_pyramid_free(pyramid);
+
+  egg_test_end(test);
+}
+
+#endif
@@ -0,0 +1,68 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_HISTORY_PYRAMID_H
+#define __GPM_HISTORY_PYRAMID_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* one downsampled bucket, the extremes keep their own timestamps so that
+ * spikes are drawn where they happened */
+typedef struct {
+  guint32 start;
+  guint32 min_time;
+  guint32 max_time;
+  gfloat min;
+  gfloat max;
+  gdouble sum;
+  guint32 count;
+  guint32 state_first;
+  guint32 state_last;
+} GpmHistoryBucket;
+
+typedef struct GpmHistoryPyramid GpmHistoryPyramid;
+
+GpmHistoryPyramid *gpm_history_pyramid_new(guint interval, guint factor,
+                                           guint levels);
+void gpm_history_pyramid_free(GpmHistoryPyramid *pyramid);
+void gpm_history_pyramid_clear(GpmHistoryPyramid *pyramid);
+gboolean gpm_history_pyramid_add(GpmHistoryPyramid *pyramid, guint32 time,
+                                 gfloat value, guint32 state);
+guint32 gpm_history_pyramid_get_last_time(GpmHistoryPyramid *pyramid);
+guint gpm_history_pyramid_get_levels(GpmHistoryPyramid *pyramid);
+guint gpm_history_pyramid_get_interval(GpmHistoryPyramid *pyramid,
+                                       guint level);
+guint gpm_history_pyramid_select_level(GpmHistoryPyramid *pyramid,
+                                       guint32 start, guint32 stop,
+                                       guint pixels);
+const GpmHistoryBucket *gpm_history_pyramid_query(GpmHistoryPyramid *pyramid,
+                                                  guint level, guint32 start,
+                                                  guint32 stop, guint *length);
+gfloat gpm_history_bucket_get_mean(const GpmHistoryBucket *bucket);
+#ifdef EGG_TEST
+void gpm_history_pyramid_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_HISTORY_PYRAMID_H */
@@ -41,21 +41,29 @@
 #include <glib/gi18n.h>
 
 #include "egg-idletime.h"
+#include "gpm-dim-learner.h"
 #include "gpm-idle.h"
 #include "gpm-load.h"
 #include "gpm-session.h"
+#include "gpm-trace.h"
 
 /* Sets the idle percent limit, i.e. how hard the computer can work
    while considered "at idle" */
 #define GPM_IDLE_CPU_LIMIT 5
 #define GPM_IDLE_IDLETIME_ID 1
+/* fires at the dim timeout the user asked for while it is being extended */
+#define GPM_IDLE_IDLETIME_HOLD_ID 2
 
 struct GpmIdlePrivate {
   EggIdletime *idletime;
   GpmLoad *load;
   GpmSession *session;
+  GpmTrace *trace;
   GpmIdleMode mode;
-  guint timeout_dim;   /* in seconds */
+  GpmDimLearner *learner;
+  gboolean held_back;      /* the hold alarm went off and we did not dim */
+  guint timeout_dim_alarm; /* in seconds, after learning */
+  guint timeout_dim;       /* in seconds */
   guint timeout_blank; /* in seconds */
   guint timeout_sleep; /* in seconds */
   guint timeout_blank_id;
@@ -64,7 +72,7 @@ struct GpmIdlePrivate {
   gboolean check_type_cpu;
 };
 
-enum { IDLE_CHANGED, LAST_SIGNAL };
+enum { IDLE_CHANGED, DIM_AVOIDED, LAST_SIGNAL };
 
 static guint signals[LAST_SIGNAL] = {0};
 static gpointer gpm_idle_object = NULL;
@@ -82,15 +90,75 @@ static const gchar *gpm_idle_mode_to_string(GpmIdleMode mode) {
   return "unknown";
 }
 
+/**
+ * gpm_idle_sync_alarm_dim:
+ *
+ * Sets the dim alarm to the timeout the user asked for, extended for as
+ * long as dims keep being undone straight away.
+ **/
+static void gpm_idle_sync_alarm_dim(GpmIdle *idle) {
+  guint timeout;
+
+  /* not set up yet */
+  if (idle->priv->timeout_dim == G_MAXUINT) return;
+
+  timeout = gpm_dim_learner_get_timeout(idle->priv->learner,
+                                        gpm_trace_get_time(idle->priv->trace),
+                                        idle->priv->timeout_dim);
+  if (timeout != idle->priv->timeout_dim_alarm) {
+    if (timeout != idle->priv->timeout_dim)
+      g_debug("dim timeout extended to %us after false dims", timeout);
+    idle->priv->timeout_dim_alarm = timeout;
+
+    if (timeout > 0)
+      egg_idletime_alarm_set(idle->priv->idletime, GPM_IDLE_IDLETIME_ID,
+                             timeout * 1000);
+    else
+      egg_idletime_alarm_remove(idle->priv->idletime, GPM_IDLE_IDLETIME_ID);
+  }
+
+  /* so we know when a dim was held back */
+  if (timeout > idle->priv->timeout_dim && idle->priv->timeout_dim > 0)
+    egg_idletime_alarm_set(idle->priv->idletime, GPM_IDLE_IDLETIME_HOLD_ID,
+                           idle->priv->timeout_dim * 1000);
+  else
+    egg_idletime_alarm_remove(idle->priv->idletime, GPM_IDLE_IDLETIME_HOLD_ID);
+}
+
+/**
+ * gpm_idle_learn:
+ *
+ * Tells the learner how long the dim lasted, if this ends one.
+ **/
+static void gpm_idle_learn(GpmIdle *idle, GpmIdleMode old, GpmIdleMode mode) {
+  gint64 now;
+
+  now = gpm_trace_get_time(idle->priv->trace);
+  if (mode == GPM_IDLE_MODE_DIM) {
+    gpm_dim_learner_dimmed(idle->priv->learner, now);
+    idle->priv->held_back = FALSE;
+  } else if (old == GPM_IDLE_MODE_DIM && mode == GPM_IDLE_MODE_NORMAL) {
+    if (gpm_dim_learner_undimmed(idle->priv->learner, now))
+      g_debug("dim was undone straight away");
+  } else if (old == GPM_IDLE_MODE_DIM) {
+    gpm_dim_learner_settled(idle->priv->learner, now);
+  }
+  gpm_idle_sync_alarm_dim(idle);
+}
+
 /**
  * gpm_idle_set_mode:
  * @mode: The new mode, e.g. GPM_IDLE_MODE_SLEEP
  **/
 static void gpm_idle_set_mode(GpmIdle *idle, GpmIdleMode mode) {
+  GpmIdleMode old;
+
   g_return_if_fail(GPM_IS_IDLE(idle));
 
   if (mode != idle->priv->mode) {
+    old = idle->priv->mode;
     idle->priv->mode = mode;
+    gpm_idle_learn(idle, old, mode);
     g_debug("Doing a state transition: %s", gpm_idle_mode_to_string(mode));
     g_signal_emit(idle, signals[IDLE_CHANGED], 0, mode);
   }
@@ -133,8 +201,9 @@ static gboolean gpm_idle_sleep_cb(GpmIdle *idle) {
   gdouble load;
   gboolean ret = FALSE;
 
-  /* get our computed load value */
-  if (idle->priv->check_type_cpu) {
+  /* get our computed load value, which a trace knows nothing about */
+  if (idle->priv->check_type_cpu &&
+      !gpm_trace_is_replaying(idle->priv->trace)) {
     load = gpm_load_get_current(idle->priv->load);
     if (load > GPM_IDLE_CPU_LIMIT) {
       /* check if system is "idle" enough */
@@ -202,8 +271,9 @@ static void gpm_idle_evaluate(GpmIdle *idle) {
    * but only if we actually want to blank. */
   if (idle->priv->timeout_blank_id == 0 && idle->priv->timeout_blank != 0) {
     g_debug("setting up blank callback for %is", idle->priv->timeout_blank);
-    idle->priv->timeout_blank_id = g_timeout_add_seconds(
-        idle->priv->timeout_blank, (GSourceFunc)gpm_idle_blank_cb, idle);
+    idle->priv->timeout_blank_id = gpm_trace_timeout_add_seconds(
+        idle->priv->trace, idle->priv->timeout_blank,
+        (GSourceFunc)gpm_idle_blank_cb, idle);
     g_source_set_name_by_id(idle->priv->timeout_blank_id, "[GpmIdle] blank");
   }
 
@@ -219,8 +289,9 @@ static void gpm_idle_evaluate(GpmIdle *idle) {
      * inhibited from sleeping */
     if (idle->priv->timeout_sleep_id == 0 && idle->priv->timeout_sleep != 0) {
       g_debug("setting up sleep callback %is", idle->priv->timeout_sleep);
-      idle->priv->timeout_sleep_id = g_timeout_add_seconds(
-          idle->priv->timeout_sleep, (GSourceFunc)gpm_idle_sleep_cb, idle);
+      idle->priv->timeout_sleep_id = gpm_trace_timeout_add_seconds(
+          idle->priv->trace, idle->priv->timeout_sleep,
+          (GSourceFunc)gpm_idle_sleep_cb, idle);
       g_source_set_name_by_id(idle->priv->timeout_sleep_id, "[GpmIdle] sleep");
     }
   }
@@ -276,12 +347,7 @@ gboolean gpm_idle_set_timeout_dim(GpmIdle *idle, guint timeout) {
   g_debug("Setting dim idle timeout: %ds", timeout);
   if (idle->priv->timeout_dim != timeout) {
     idle->priv->timeout_dim = timeout;
-
-    if (timeout > 0)
-      egg_idletime_alarm_set(idle->priv->idletime, GPM_IDLE_IDLETIME_ID,
-                             timeout * 1000);
-    else
-      egg_idletime_alarm_remove(idle->priv->idletime, GPM_IDLE_IDLETIME_ID);
+    gpm_idle_sync_alarm_dim(idle);
   }
   return TRUE;
 }
@@ -349,12 +415,36 @@ static void gpm_idle_session_inhibited_changed_cb(GpmSession *session,
 static void gpm_idle_idletime_alarm_expired_cb(EggIdletime *idletime,
                                                guint alarm_id, GpmIdle *idle) {
   g_debug("idletime alarm: %i", alarm_id);
+  if (gpm_trace_is_replaying(idle->priv->trace)) return;
+  gpm_trace_add(idle->priv->trace, GPM_TRACE_KIND_IDLE_ALARM, alarm_id, NULL,
+                NULL);
+
+  /* we would have dimmed by now if it were not for the learner */
+  if (alarm_id == GPM_IDLE_IDLETIME_HOLD_ID) {
+    idle->priv->held_back = TRUE;
+    return;
+  }
 
   /* set again */
   idle->priv->x_idle = TRUE;
   gpm_idle_evaluate(idle);
 }
 
+/**
+ * gpm_idle_check_held_back:
+ *
+ * The user came back in time, so the extended timeout saved a fade.
+ **/
+static void gpm_idle_check_held_back(GpmIdle *idle) {
+  if (!idle->priv->held_back) return;
+  idle->priv->held_back = FALSE;
+  if (idle->priv->mode != GPM_IDLE_MODE_NORMAL) return;
+  gpm_dim_learner_add_avoided(idle->priv->learner);
+  g_debug("avoided a dim, %u so far",
+          gpm_dim_learner_get_avoided(idle->priv->learner));
+  g_signal_emit(idle, signals[DIM_AVOIDED], 0);
+}
+
 /**
  * gpm_idle_idletime_reset_cb:
  *
@@ -362,11 +452,35 @@ static void gpm_idle_idletime_alarm_expired_cb(EggIdletime *idletime,
  **/
 static void gpm_idle_idletime_reset_cb(EggIdletime *idletime, GpmIdle *idle) {
   g_debug("idletime reset");
+  if (gpm_trace_is_replaying(idle->priv->trace)) return;
+  gpm_trace_add(idle->priv->trace, GPM_TRACE_KIND_IDLE_RESET, 0, NULL, NULL);
+  gpm_idle_check_held_back(idle);
 
   idle->priv->x_idle = FALSE;
   gpm_idle_evaluate(idle);
 }
 
+/**
+ * gpm_idle_trace_replay_cb:
+ *
+ * The user moved or stopped moving when the trace was recorded
+ **/
+static void gpm_idle_trace_replay_cb(GpmTrace *trace,
+                                     const GpmTraceEvent *event,
+                                     GpmIdle *idle) {
+  if (event->kind == GPM_TRACE_KIND_IDLE_ALARM &&
+      event->value == GPM_IDLE_IDLETIME_HOLD_ID) {
+    idle->priv->held_back = TRUE;
+  } else if (event->kind == GPM_TRACE_KIND_IDLE_ALARM) {
+    idle->priv->x_idle = TRUE;
+    gpm_idle_evaluate(idle);
+  } else if (event->kind == GPM_TRACE_KIND_IDLE_RESET) {
+    gpm_idle_check_held_back(idle);
+    idle->priv->x_idle = FALSE;
+    gpm_idle_evaluate(idle);
+  }
+}
+
 /**
  * gpm_idle_finalize:
  * @object: This class instance
@@ -395,7 +509,10 @@ static void gpm_idle_finalize(GObject *object) {
   g_object_unref(idle->priv->session);
 
   egg_idletime_alarm_remove(idle->priv->idletime, GPM_IDLE_IDLETIME_ID);
+  egg_idletime_alarm_remove(idle->priv->idletime, GPM_IDLE_IDLETIME_HOLD_ID);
   g_object_unref(idle->priv->idletime);
+  gpm_dim_learner_free(idle->priv->learner);
+  g_object_unref(idle->priv->trace);
 
   G_OBJECT_CLASS(gpm_idle_parent_class)->finalize(object);
 }
@@ -413,6 +530,10 @@ static void gpm_idle_class_init(GpmIdleClass *klass) {
       "idle-changed", G_TYPE_FROM_CLASS(object_class), G_SIGNAL_RUN_LAST,
       G_STRUCT_OFFSET(GpmIdleClass, idle_changed), NULL, NULL,
       g_cclosure_marshal_VOID__INT, G_TYPE_NONE, 1, G_TYPE_INT);
+  signals[DIM_AVOIDED] = g_signal_new(
+      "dim-avoided", G_TYPE_FROM_CLASS(object_class), G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET(GpmIdleClass, dim_avoided), NULL, NULL,
+      g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
 }
 
 /**
@@ -426,6 +547,8 @@ static void gpm_idle_init(GpmIdle *idle) {
   idle->priv = gpm_idle_get_instance_private(idle);
 
   idle->priv->timeout_dim = G_MAXUINT;
+  idle->priv->timeout_dim_alarm = G_MAXUINT;
+  idle->priv->learner = gpm_dim_learner_new();
   idle->priv->timeout_blank = G_MAXUINT;
   idle->priv->timeout_sleep = G_MAXUINT;
   idle->priv->timeout_blank_id = 0;
@@ -444,6 +567,10 @@ static void gpm_idle_init(GpmIdle *idle) {
   g_signal_connect(idle->priv->idletime, "alarm-expired",
                    G_CALLBACK(gpm_idle_idletime_alarm_expired_cb), idle);
 
+  idle->priv->trace = gpm_trace_new();
+  g_signal_connect(idle->priv->trace, "replay",
+                   G_CALLBACK(gpm_idle_trace_replay_cb), idle);
+
   gpm_idle_evaluate(idle);
 }
 
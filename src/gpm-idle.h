@@ -54,6 +54,7 @@ typedef struct {
 typedef struct {
   GObjectClass parent_class;
   void (*idle_changed)(GpmIdle *idle, GpmIdleMode mode);
+  void (*dim_avoided)(GpmIdle *idle);
 } GpmIdleClass;
 
 GType gpm_idle_get_type(void);
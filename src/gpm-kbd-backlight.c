@@ -29,15 +29,14 @@
 
 #include "gpm-button.h"
 #include "gpm-common.h"
-#include "gpm-control.h"
 #include "gpm-idle.h"
+#include "gpm-trace.h"
 #include "gsd-media-keys-window.h"
 
 struct GpmKbdBacklightPrivate {
   UpClient *client;
   GpmButton *button;
   GSettings *settings;
-  GpmControl *control;
   GpmIdle *idle;
   gboolean can_dim;
   gboolean system_is_idle;
@@ -51,6 +50,10 @@ struct GpmKbdBacklightPrivate {
   GDBusConnection *bus_connection;
   guint bus_object_id;
   GtkWidget *popup;
+  gboolean have_snapshot;
+  guint snapshot_brightness;
+  guint resume_id;
+  GpmTrace *trace;
 };
 
 enum { BRIGHTNESS_CHANGED, LAST_SIGNAL };
@@ -114,6 +117,16 @@ static gboolean gpm_kbd_backlight_set(GpmKbdBacklight *backlight,
     goal += percentage == backlight->priv->brightness_percent ? 0 : scale;
   }
 
+  /* a replay must not touch the real keyboard, so jump to the goal */
+  if (gpm_trace_is_replaying(backlight->priv->trace)) {
+    backlight->priv->brightness = goal;
+    backlight->priv->brightness_percent = gpm_discrete_to_percent(
+        backlight->priv->brightness, backlight->priv->max_brightness);
+    gpm_trace_decision(backlight->priv->trace, "keyboard brightness %u",
+                       backlight->priv->brightness_percent);
+    return TRUE;
+  }
+
   /* step loop down by 1 for a dimming effect */
   while (backlight->priv->brightness != goal) {
     backlight->priv->brightness += scale;
@@ -169,6 +182,9 @@ static void gpm_kbd_backlight_dialog_show(GpmKbdBacklight *backlight) {
   GdkSeat *seat;
   GdkDevice *device;
 
+  /* the popup would be shown over the real session */
+  if (gpm_trace_is_replaying(backlight->priv->trace)) return;
+
   /*
    * get the window size
    * if the window hasn't been mapped, it doesn't necessarily
@@ -343,19 +359,62 @@ static gboolean gpm_kbd_backlight_evaluate_power_source_and_set(
 }
 
 /**
- * gpm_kbd_backlight_control_resume_cb:
- * @control: The control class instance
+ * gpm_kbd_backlight_sleep:
  * @backlight: This backlight class instance
  *
- * Just make sure that the backlight is back on
+ * Remembers the keyboard level so that gpm_kbd_backlight_resume() can put
+ * it back in one write.
  **/
-static void gpm_kbd_backlight_control_resume_cb(GpmControl *control,
-                                                GpmControlAction action,
-                                                GpmKbdBacklight *backlight) {
+void gpm_kbd_backlight_sleep(GpmKbdBacklight *backlight) {
+  g_return_if_fail(GPM_IS_KBD_BACKLIGHT(backlight));
+
+  backlight->priv->have_snapshot = backlight->priv->max_brightness > 0;
+  backlight->priv->snapshot_brightness = backlight->priv->brightness;
+}
+
+/**
+ * gpm_kbd_backlight_resume_idle_cb:
+ *
+ * Runs the normal policy once the rest of the resume work is done.
+ **/
+static gboolean gpm_kbd_backlight_resume_idle_cb(GpmKbdBacklight *backlight) {
   gboolean ret;
 
+  backlight->priv->resume_id = 0;
   ret = gpm_kbd_backlight_evaluate_power_source_and_set(backlight);
   if (!ret) g_warning("Failed to turn kbd brightness back on after resuming");
+  return FALSE;
+}
+
+/**
+ * gpm_kbd_backlight_resume:
+ * @backlight: This backlight class instance
+ *
+ * The firmware may have turned the keyboard off without telling UPower, so
+ * write the level saved by gpm_kbd_backlight_sleep() straight away rather
+ * than stepping towards it, and re-evaluate the policy when idle.
+ **/
+void gpm_kbd_backlight_resume(GpmKbdBacklight *backlight) {
+  g_return_if_fail(GPM_IS_KBD_BACKLIGHT(backlight));
+
+  if (backlight->priv->have_snapshot) {
+    backlight->priv->brightness = backlight->priv->snapshot_brightness;
+    backlight->priv->brightness_percent = gpm_discrete_to_percent(
+        backlight->priv->brightness, backlight->priv->max_brightness);
+    if (gpm_trace_is_replaying(backlight->priv->trace))
+      gpm_trace_decision(backlight->priv->trace, "keyboard brightness %u",
+                         backlight->priv->brightness_percent);
+    else
+      g_dbus_proxy_call(backlight->priv->upower_proxy, "SetBrightness",
+                        g_variant_new("(i)", (gint)backlight->priv->brightness),
+                        G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+    backlight->priv->have_snapshot = FALSE;
+  }
+
+  if (backlight->priv->resume_id == 0)
+    backlight->priv->resume_id = g_idle_add_full(
+        G_PRIORITY_LOW, (GSourceFunc)gpm_kbd_backlight_resume_idle_cb,
+        backlight, NULL);
 }
 
 /**
@@ -509,8 +568,11 @@ static void gpm_kbd_backlight_finalize(GObject *object) {
   }
 
   g_timer_destroy(backlight->priv->idle_timer);
+  g_object_unref(backlight->priv->trace);
+
+  if (backlight->priv->resume_id != 0)
+    g_source_remove(backlight->priv->resume_id);
 
-  g_object_unref(backlight->priv->control);
   g_object_unref(backlight->priv->settings);
   g_object_unref(backlight->priv->client);
   g_object_unref(backlight->priv->button);
@@ -546,6 +608,7 @@ static void gpm_kbd_backlight_init(GpmKbdBacklight *backlight) {
   GError *error = NULL;
 
   backlight->priv = gpm_kbd_backlight_get_instance_private(backlight);
+  backlight->priv->trace = gpm_trace_new();
 
   backlight->priv->upower_proxy = g_dbus_proxy_new_for_bus_sync(
       G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
@@ -620,13 +683,6 @@ noerr:
   g_signal_connect(backlight->priv->idle, "idle-changed",
                    G_CALLBACK(gpm_kbd_backlight_idle_changed_cb), backlight);
 
-  /* use a visual widget */
-  backlight->priv->popup = msd_media_keys_window_new();
-  msd_media_keys_window_set_action_custom(
-      MSD_MEDIA_KEYS_WINDOW(backlight->priv->popup), "gpm-brightness-kbd",
-      TRUE);
-  gtk_window_set_position(GTK_WINDOW(backlight->priv->popup), GTK_WIN_POS_NONE);
-
   /* since gpm is just starting we can pretty safely assume that we're not idle
    */
   backlight->priv->system_is_idle = FALSE;
@@ -635,11 +691,6 @@ noerr:
   gpm_idle_set_timeout_dim(backlight->priv->idle,
                            backlight->priv->idle_dim_timeout);
 
-  /* make sure we turn the keyboard backlight back on after resuming */
-  backlight->priv->control = gpm_control_new();
-  g_signal_connect(backlight->priv->control, "resume",
-                   G_CALLBACK(gpm_kbd_backlight_control_resume_cb), backlight);
-
   /* set initial values for whether we're on AC or battery*/
   gpm_kbd_backlight_evaluate_power_source_and_set(backlight);
 }
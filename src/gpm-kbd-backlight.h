@@ -72,6 +72,8 @@ gboolean gpm_kbd_backlight_set_brightness(GpmKbdBacklight *backlight,
 void gpm_kbd_backlight_register_dbus(GpmKbdBacklight *backlight,
                                      GDBusConnection *connection,
                                      GError **error);
+void gpm_kbd_backlight_sleep(GpmKbdBacklight *backlight);
+void gpm_kbd_backlight_resume(GpmKbdBacklight *backlight);
 
 G_END_DECLS
 
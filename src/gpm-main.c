@@ -42,7 +42,9 @@
 #include "gpm-common.h"
 #include "gpm-icon-names.h"
 #include "gpm-manager.h"
+#include "gpm-profile.h"
 #include "gpm-session.h"
+#include "gpm-trace.h"
 #include "org.mate.PowerManager.h"
 
 /**
@@ -135,6 +137,29 @@ static void gpm_main_end_session_cb(GpmSession *session, guint flags,
   g_main_loop_quit(loop);
 }
 
+/**
+ * gpm_main_replay_finished_cb:
+ **/
+static void gpm_main_replay_finished_cb(GpmTrace *trace, GMainLoop *loop) {
+  g_main_loop_quit(loop);
+}
+
+/**
+ * gpm_main_startup_profile_cb:
+ *
+ * Runs after the work the manager deferred at startup, so prints the profile.
+ **/
+static gboolean gpm_main_startup_profile_cb(gpointer user_data) {
+  gchar *text;
+
+  gpm_profile_mark("deferred");
+  text = gpm_profile_to_string();
+  g_print("%s", text);
+  g_free(text);
+  gpm_profile_stop();
+  return FALSE;
+}
+
 /**
  * main:
  **/
@@ -145,8 +170,14 @@ int main(int argc, char *argv[]) {
   gboolean version = FALSE;
   gboolean timed_exit = FALSE;
   gboolean immediate_exit = FALSE;
+  gboolean startup_profile = FALSE;
+  gchar *record_file = NULL;
+  gchar *replay_file = NULL;
+  gdouble replay_speed = 0;
   GpmSession *session = NULL;
   GpmManager *manager = NULL;
+  GpmTrace *trace = NULL;
+  GTimer *timer = NULL;
   GError *error = NULL;
   GOptionContext *context;
   gint ret;
@@ -159,6 +190,19 @@ int main(int argc, char *argv[]) {
        N_("Exit after a small delay (for debugging)"), NULL},
       {"immediate-exit", '\0', 0, G_OPTION_ARG_NONE, &immediate_exit,
        N_("Exit after the manager has loaded (for debugging)"), NULL},
+      {"record", '\0', 0, G_OPTION_ARG_FILENAME, &record_file,
+       N_("Record the events that are received to a file (for debugging)"),
+       NULL},
+      {"replay", '\0', 0, G_OPTION_ARG_FILENAME, &replay_file,
+       N_("Replay recorded events instead of the real ones, then exit (for "
+          "debugging)"),
+       NULL},
+      {"replay-speed", '\0', 0, G_OPTION_ARG_DOUBLE, &replay_speed,
+       N_("How many times faster than real time to replay, or 0 for as fast "
+          "as possible"),
+       NULL},
+      {"startup-profile", '\0', 0, G_OPTION_ARG_NONE, &startup_profile,
+       N_("Show how long each part of starting up took (for debugging)"), NULL},
       {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
 
   setlocale(LC_ALL, "");
@@ -174,6 +218,7 @@ int main(int argc, char *argv[]) {
   g_option_context_set_translation_domain(context, GETTEXT_PACKAGE);
   g_option_context_set_summary(context, _("MATE Power Manager"));
   g_option_context_parse(context, &argc, &argv, NULL);
+  if (startup_profile) gpm_profile_start();
 
   if (version) {
     g_print("Version %s\n", VERSION);
@@ -183,6 +228,7 @@ int main(int argc, char *argv[]) {
   dbus_g_thread_init();
 
   gtk_init(&argc, &argv);
+  gpm_profile_mark("gtk");
 
   g_debug("MATE %s %s", GPM_NAME, VERSION);
 
@@ -208,11 +254,28 @@ int main(int argc, char *argv[]) {
         "This is usually started automatically in X "
         "or mate startup when you start a new session.");
   }
+  gpm_profile_mark("dbus");
 
   /* add application specific icons to search path */
   gtk_icon_theme_append_search_path(gtk_icon_theme_get_default(),
                                     GPM_ICONS_DATA);
 
+  /* this has to be done before anything that is traced is created */
+  trace = gpm_trace_new();
+  if (replay_file != NULL) {
+    if (!gpm_trace_load(trace, replay_file, &error)) {
+      g_printerr("Failed to load trace: %s\n", error->message);
+      g_error_free(error);
+      goto unref_program;
+    }
+  } else if (record_file != NULL) {
+    if (!gpm_trace_record(trace, record_file, &error)) {
+      g_warning("not recording: %s", error->message);
+      g_clear_error(&error);
+    }
+  }
+  gpm_profile_mark("trace");
+
   loop = g_main_loop_new(NULL, FALSE);
 
   /* optionally register with the session */
@@ -222,12 +285,33 @@ int main(int argc, char *argv[]) {
                    G_CALLBACK(gpm_main_query_end_session_cb), loop);
   g_signal_connect(session, "end-session", G_CALLBACK(gpm_main_end_session_cb),
                    loop);
-  gpm_session_register_client(session, "mate-power-manager",
-                              getenv("DESKTOP_AUTOSTART_ID"));
+  if (replay_file == NULL)
+    gpm_session_register_client(session, "mate-power-manager",
+                                getenv("DESKTOP_AUTOSTART_ID"));
+  gpm_profile_mark("session");
 
   /* create a new gui object */
   manager = gpm_manager_new();
 
+  /* a replay runs alongside the real daemon, and exits when done */
+  if (replay_file != NULL) {
+    g_signal_connect(trace, "finished",
+                     G_CALLBACK(gpm_main_replay_finished_cb), loop);
+    timer = g_timer_new();
+    gpm_trace_replay(trace, replay_speed);
+    g_main_loop_run(loop);
+    g_print("replayed %u events covering %.1fs in %.3fs (%.0f/s), "
+            "%u decisions\n",
+            gpm_trace_get_length(trace),
+            gpm_trace_get_time(trace) / (gdouble)G_USEC_PER_SEC,
+            g_timer_elapsed(timer, NULL),
+            gpm_trace_get_length(trace) /
+                MAX(g_timer_elapsed(timer, NULL), 0.000001),
+            gpm_trace_get_decisions(trace));
+    g_timer_destroy(timer);
+    goto unref_manager;
+  }
+
   if (!gpm_object_register(session_connection, G_OBJECT(manager))) {
     g_error("%s is already running in this session.", GPM_NAME);
     goto unref_program;
@@ -247,6 +331,11 @@ int main(int argc, char *argv[]) {
     default:
       break;
   };
+  gpm_profile_mark("bus names");
+
+  /* queued behind what the manager deferred, so that is included */
+  if (startup_profile)
+    g_idle_add_full(G_PRIORITY_LOW, gpm_main_startup_profile_cb, NULL, NULL);
 
   /* Only timeout and close the mainloop if we have specified it
    * on the command line */
@@ -257,13 +346,20 @@ int main(int argc, char *argv[]) {
 
   if (immediate_exit == FALSE) {
     g_main_loop_run(loop);
+  } else {
+    /* still finish the profile */
+    while (gpm_profile_is_running()) g_main_context_iteration(NULL, TRUE);
   }
 
+unref_manager:
   g_main_loop_unref(loop);
 
   g_object_unref(session);
   g_object_unref(manager);
 unref_program:
+  if (trace != NULL) g_object_unref(trace);
+  g_free(record_file);
+  g_free(replay_file);
   g_option_context_free(context);
   return 0;
 }
@@ -42,6 +42,7 @@
 #include <dbus/dbus-glib.h>
 #include <gio/gunixfdlist.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <libnotify/notify.h>
 #include <libupower-glib/upower.h>
@@ -50,13 +51,20 @@
 #include "gpm-button.h"
 #include "gpm-common.h"
 #include "gpm-control.h"
+#include "gpm-cpu-policy.h"
 #include "gpm-dpms.h"
 #include "gpm-engine.h"
 #include "gpm-icon-names.h"
 #include "gpm-idle.h"
 #include "gpm-kbd-backlight.h"
 #include "gpm-manager.h"
+#include "gpm-metrics.h"
+#include "gpm-power-profiles.h"
+#include "gpm-profile.h"
 #include "gpm-session.h"
+#include "gpm-state-page.h"
+#include "gpm-timeline.h"
+#include "gpm-trace.h"
 #include "gpm-tray-icon.h"
 #include "gpm-upower.h"
 #include "org.mate.PowerManager.Backlight.h"
@@ -79,6 +87,16 @@ struct GpmManagerPrivate {
   GpmEngine *engine;
   GpmBacklight *backlight;
   GpmKbdBacklight *kbd_backlight;
+  GpmDpms *dpms;
+  GpmSession *session;
+  GpmTimeline *timeline;
+  GpmMetrics *metrics;
+  GpmCpuPolicy *cpu_policy;
+  GpmPowerProfiles *power_profiles;
+  GpmStatePage *state_page;
+  gchar *state_filename;
+  guint state_changed_id;
+  GpmTrace *trace;
   guint32 critical_alert_timeout_id;
   ca_proplist *critical_alert_loop_props;
   UpClient *client;
@@ -91,6 +109,7 @@ struct GpmManagerPrivate {
   NotifyNotification *notification_fully_charged;
   gint32 systemd_inhibit;
   GDBusProxy *systemd_inhibit_proxy;
+  guint deferred_id;
 };
 
 typedef enum {
@@ -107,6 +126,10 @@ typedef enum {
   GPM_MANAGER_SOUND_LAST
 } GpmManagerSound;
 
+enum { STATE_CHANGED, LAST_SIGNAL };
+
+static guint signals[LAST_SIGNAL] = {0};
+
 G_DEFINE_TYPE_WITH_PRIVATE(GpmManager, gpm_manager, G_TYPE_OBJECT)
 
 /**
@@ -392,6 +415,9 @@ static gboolean gpm_manager_notify(GpmManager *manager,
   NotifyNotification *notification;
   GtkWidget *dialog;
 
+  /* nothing is shown at startup, so only connect when first needed */
+  if (!notify_is_initted()) notify_init(GPM_NAME);
+
   /* close any existing notification of this class */
   gpm_manager_notify_close(manager, *notification_class);
 
@@ -680,6 +706,42 @@ static void gpm_manager_idle_do_sleep(GpmManager *manager) {
   }
 }
 
+/**
+ * gpm_manager_state_changed_cb:
+ *
+ * Wakes the clients of the state page once for a run of changes.
+ **/
+static gboolean gpm_manager_state_changed_cb(GpmManager *manager) {
+  manager->priv->state_changed_id = 0;
+  g_signal_emit(manager, signals[STATE_CHANGED], 0,
+                (guint)manager->priv->state_page->sequence);
+  return FALSE;
+}
+
+/**
+ * gpm_manager_state_set:
+ **/
+static void gpm_manager_state_set(GpmManager *manager, GpmStateField field,
+                                  guint value) {
+  if (manager->priv->state_page == NULL) return;
+  if (!gpm_state_page_set(manager->priv->state_page, field, value)) return;
+  if (manager->priv->state_changed_id == 0)
+    manager->priv->state_changed_id =
+        g_idle_add((GSourceFunc)gpm_manager_state_changed_cb, manager);
+}
+
+/**
+ * gpm_manager_idle_dim_avoided_cb:
+ * @idle: The idle class instance
+ * @manager: This class instance
+ *
+ * Counts a dim the user did not wait for as soon as it happens.
+ **/
+static void gpm_manager_idle_dim_avoided_cb(GpmIdle *idle,
+                                            GpmManager *manager) {
+  gpm_metrics_add_dim_avoided(manager->priv->metrics);
+}
+
 /**
  * gpm_manager_idle_changed_cb:
  * @idle: The idle class instance
@@ -693,6 +755,13 @@ static void gpm_manager_idle_do_sleep(GpmManager *manager) {
  **/
 static void gpm_manager_idle_changed_cb(GpmIdle *idle, GpmIdleMode mode,
                                         GpmManager *manager) {
+  gpm_timeline_add(manager->priv->timeline, GPM_TIMELINE_KIND_IDLE, mode);
+  gpm_metrics_set_gauge(manager->priv->metrics, GPM_METRICS_GAUGE_IDLE, mode);
+  gpm_manager_state_set(manager, GPM_STATE_FIELD_IDLE, mode);
+  if (manager->priv->power_profiles != NULL)
+    gpm_power_profiles_set_idle(manager->priv->power_profiles,
+                                mode >= GPM_IDLE_MODE_BLANK);
+
   /* systemd say we are not on active session */
   if (!LOGIND_RUNNING()) {
     g_debug("ignoring as not on active session");
@@ -728,6 +797,11 @@ static void gpm_manager_button_pressed_cb(GpmButton *button, const gchar *type,
   gchar *message;
   g_debug("Button press event type=%s", type);
 
+  if (g_strcmp0(type, GPM_BUTTON_LID_CLOSED) == 0)
+    gpm_timeline_add(manager->priv->timeline, GPM_TIMELINE_KIND_LID, TRUE);
+  else if (g_strcmp0(type, GPM_BUTTON_LID_OPEN) == 0)
+    gpm_timeline_add(manager->priv->timeline, GPM_TIMELINE_KIND_LID, FALSE);
+
   /* systemd say we are not on active session */
   if (!LOGIND_RUNNING()) {
     g_debug("ignoring as not on active session");
@@ -757,17 +831,13 @@ static void gpm_manager_button_pressed_cb(GpmButton *button, const gchar *type,
 }
 
 /**
- * gpm_manager_client_changed_cb:
+ * gpm_manager_client_changed:
  **/
-static void gpm_manager_client_changed_cb(UpClient *client, GParamSpec *pspec,
-                                          GpmManager *manager) {
+static void gpm_manager_client_changed(GpmManager *manager,
+                                       gboolean on_battery,
+                                       gboolean lid_is_closed) {
   gboolean event_when_closed;
-  gboolean on_battery;
-  gboolean lid_is_closed;
 
-  /* get the client state */
-  g_object_get(client, "on-battery", &on_battery, "lid-is-closed",
-               &lid_is_closed, NULL);
   if (on_battery == manager->priv->on_battery) {
     g_debug("same state as before, ignoring");
     return;
@@ -788,9 +858,15 @@ static void gpm_manager_client_changed_cb(UpClient *client, GParamSpec *pspec,
 
   /* save in local cache */
   manager->priv->on_battery = on_battery;
+  gpm_manager_state_set(manager, GPM_STATE_FIELD_ON_BATTERY, on_battery);
+  if (manager->priv->cpu_policy != NULL)
+    gpm_cpu_policy_set_on_battery(manager->priv->cpu_policy, on_battery);
+  if (manager->priv->power_profiles != NULL)
+    gpm_power_profiles_set_on_battery(manager->priv->power_profiles,
+                                      on_battery);
 
   /* systemd say we are not on active session */
-  if (!LOGIND_RUNNING()) {
+  if (!LOGIND_RUNNING() && !gpm_trace_is_replaying(manager->priv->trace)) {
     g_debug("ignoring as not on active session");
     return;
   }
@@ -819,6 +895,58 @@ static void gpm_manager_client_changed_cb(UpClient *client, GParamSpec *pspec,
   }
 }
 
+/**
+ * gpm_manager_client_get_trace_flags:
+ **/
+static guint32 gpm_manager_client_get_trace_flags(gboolean on_battery,
+                                                  gboolean lid_is_closed) {
+  guint32 flags = 0;
+
+  if (on_battery) flags |= GPM_TRACE_CLIENT_ON_BATTERY;
+  if (lid_is_closed) flags |= GPM_TRACE_CLIENT_LID_IS_CLOSED;
+  return flags;
+}
+
+/**
+ * gpm_manager_client_changed_cb:
+ **/
+static void gpm_manager_client_changed_cb(UpClient *client, GParamSpec *pspec,
+                                          GpmManager *manager) {
+  gboolean on_battery;
+  gboolean lid_is_closed;
+
+  if (gpm_trace_is_replaying(manager->priv->trace)) return;
+
+  /* get the client state */
+  g_object_get(client, "on-battery", &on_battery, "lid-is-closed",
+               &lid_is_closed, NULL);
+  gpm_trace_add(manager->priv->trace, GPM_TRACE_KIND_CLIENT,
+                gpm_manager_client_get_trace_flags(on_battery, lid_is_closed),
+                NULL, NULL);
+  gpm_manager_client_changed(manager, on_battery, lid_is_closed);
+}
+
+/**
+ * gpm_manager_trace_replay_cb:
+ **/
+static void gpm_manager_trace_replay_cb(GpmTrace *trace,
+                                        const GpmTraceEvent *event,
+                                        GpmManager *manager) {
+  gboolean on_battery;
+
+  if (event->kind != GPM_TRACE_KIND_CLIENT) return;
+  on_battery = (event->value & GPM_TRACE_CLIENT_ON_BATTERY) > 0;
+
+  /* as at startup, nothing is done about the state we start in */
+  if ((event->value & GPM_TRACE_CLIENT_COLDPLUG) > 0) {
+    manager->priv->on_battery = on_battery;
+    return;
+  }
+  gpm_manager_client_changed(
+      manager, on_battery,
+      (event->value & GPM_TRACE_CLIENT_LID_IS_CLOSED) > 0);
+}
+
 /**
  * manager_critical_action_do:
  * @manager: This class instance
@@ -838,6 +966,56 @@ static gboolean manager_critical_action_do(GpmManager *manager) {
   return FALSE;
 }
 
+/**
+ * gpm_manager_hold_performance:
+ * @reason: Why the caller wants the CPUs at full speed
+ *
+ * The hold is dropped when the caller releases it or leaves the bus.
+ **/
+void gpm_manager_hold_performance(GpmManager *manager, const gchar *reason,
+                                  DBusGMethodInvocation *context) {
+  GError *error;
+  gchar *sender;
+  guint cookie;
+
+  if (manager->priv->cpu_policy == NULL) {
+    error = g_error_new(GPM_MANAGER_ERROR, GPM_MANAGER_ERROR_NO_HW,
+                        "CPU policy is not available");
+    dbus_g_method_return_error(context, error);
+    g_error_free(error);
+    return;
+  }
+  sender = dbus_g_method_get_sender(context);
+  cookie = gpm_cpu_policy_hold(manager->priv->cpu_policy, sender, reason);
+  g_free(sender);
+  dbus_g_method_return(context, cookie);
+}
+
+/**
+ * gpm_manager_release_performance:
+ *
+ * Only the program that took the hold can release it.
+ **/
+void gpm_manager_release_performance(GpmManager *manager, guint cookie,
+                                     DBusGMethodInvocation *context) {
+  GError *error;
+  gchar *sender;
+  gboolean ret;
+
+  sender = dbus_g_method_get_sender(context);
+  ret = manager->priv->cpu_policy != NULL &&
+        gpm_cpu_policy_release(manager->priv->cpu_policy, cookie, sender);
+  g_free(sender);
+  if (!ret) {
+    error = g_error_new(GPM_MANAGER_ERROR, GPM_MANAGER_ERROR_DENIED,
+                        "No performance hold %u", cookie);
+    dbus_g_method_return_error(context, error);
+    g_error_free(error);
+    return;
+  }
+  dbus_g_method_return(context);
+}
+
 /**
  * gpm_manager_class_init:
  * @klass: The GpmManagerClass
@@ -845,6 +1023,25 @@ static gboolean manager_critical_action_do(GpmManager *manager) {
 static void gpm_manager_class_init(GpmManagerClass *klass) {
   GObjectClass *object_class = G_OBJECT_CLASS(klass);
   object_class->finalize = gpm_manager_finalize;
+
+  signals[STATE_CHANGED] = g_signal_new(
+      "state-changed", G_TYPE_FROM_CLASS(object_class), G_SIGNAL_RUN_LAST, 0,
+      NULL, NULL, g_cclosure_marshal_VOID__UINT, G_TYPE_NONE, 1, G_TYPE_UINT);
+}
+
+/**
+ * gpm_manager_sync_metrics_file:
+ **/
+static void gpm_manager_sync_metrics_file(GpmManager *manager) {
+  gchar *filename;
+
+  /* the real daemon may be exporting to the same file */
+  if (gpm_trace_is_replaying(manager->priv->trace)) return;
+
+  filename =
+      g_settings_get_string(manager->priv->settings, GPM_SETTINGS_METRICS_FILE);
+  gpm_metrics_set_filename(manager->priv->metrics, filename);
+  g_free(filename);
 }
 
 /**
@@ -860,6 +1057,8 @@ static void gpm_manager_settings_changed_cb(GSettings *settings,
       g_strcmp0(key, GPM_SETTINGS_SLEEP_DISPLAY_BATT) == 0 ||
       g_strcmp0(key, GPM_SETTINGS_SLEEP_DISPLAY_AC) == 0)
     gpm_manager_sync_policy_sleep(manager);
+  else if (g_strcmp0(key, GPM_SETTINGS_METRICS_FILE) == 0)
+    gpm_manager_sync_metrics_file(manager);
 }
 
 /**
@@ -867,6 +1066,7 @@ static void gpm_manager_settings_changed_cb(GSettings *settings,
  */
 static void gpm_manager_engine_icon_changed_cb(GpmEngine *engine, gchar *icon,
                                                GpmManager *manager) {
+  if (manager->priv->tray_icon == NULL) return;
   gpm_tray_icon_set_icon(manager->priv->tray_icon, icon);
 }
 
@@ -876,6 +1076,7 @@ static void gpm_manager_engine_icon_changed_cb(GpmEngine *engine, gchar *icon,
 static void gpm_manager_engine_summary_changed_cb(GpmEngine *engine,
                                                   gchar *summary,
                                                   GpmManager *manager) {
+  if (manager->priv->tray_icon == NULL) return;
   gpm_tray_icon_set_tooltip(manager->priv->tray_icon, summary);
 }
 
@@ -1504,15 +1705,156 @@ static gboolean gpm_manager_reset_just_resumed_cb(gpointer user_data) {
 
 /**
  * gpm_manager_control_resume_cb
+ *
+ * Puts the panel and the keyboard back first, and leaves everything that
+ * the user is not waiting on until the main loop is idle.
  **/
 static void gpm_manager_control_resume_cb(GpmControl *control,
                                           GpmControlAction action,
                                           GpmManager *manager) {
-  guint timer_id;
+  guint idle_id;
+  gint64 start;
+  gdouble elapsed;
+
+  start = g_get_monotonic_time();
+  if (manager->priv->backlight != NULL)
+    gpm_backlight_resume(manager->priv->backlight);
+  if (manager->priv->kbd_backlight != NULL)
+    gpm_kbd_backlight_resume(manager->priv->kbd_backlight);
+  elapsed = (gdouble)(g_get_monotonic_time() - start) / G_USEC_PER_SEC;
+  g_debug("screen usable %.3fs after resume", elapsed);
+
+  gpm_timeline_add(manager->priv->timeline, GPM_TIMELINE_KIND_RESUME, action);
+  gpm_metrics_add_resume(manager->priv->metrics, action);
+  gpm_metrics_set_resume_usable(manager->priv->metrics, elapsed);
   manager->priv->just_resumed = TRUE;
-  timer_id =
-      g_timeout_add_seconds(1, gpm_manager_reset_just_resumed_cb, manager);
-  g_source_set_name_by_id(timer_id, "[GpmManager] just-resumed");
+  idle_id = g_idle_add_full(G_PRIORITY_LOW, gpm_manager_reset_just_resumed_cb,
+                            manager, NULL);
+  g_source_set_name_by_id(idle_id, "[GpmManager] just-resumed");
+}
+
+/**
+ * gpm_manager_control_sleep_cb
+ **/
+static void gpm_manager_control_sleep_cb(GpmControl *control,
+                                         GpmControlAction action,
+                                         GpmManager *manager) {
+  gpm_timeline_add(manager->priv->timeline, GPM_TIMELINE_KIND_SLEEP, action);
+  gpm_metrics_add_sleep(manager->priv->metrics, action);
+  if (manager->priv->backlight != NULL)
+    gpm_backlight_sleep(manager->priv->backlight);
+  if (manager->priv->kbd_backlight != NULL)
+    gpm_kbd_backlight_sleep(manager->priv->kbd_backlight);
+}
+
+/**
+ * gpm_manager_brightness_changed_cb
+ **/
+static void gpm_manager_brightness_changed_cb(GpmBacklight *backlight,
+                                              guint percentage,
+                                              GpmManager *manager) {
+  gpm_timeline_add(manager->priv->timeline, GPM_TIMELINE_KIND_BRIGHTNESS,
+                   percentage);
+  gpm_metrics_set_gauge(manager->priv->metrics, GPM_METRICS_GAUGE_BRIGHTNESS,
+                        percentage);
+  gpm_manager_state_set(manager, GPM_STATE_FIELD_BRIGHTNESS, percentage);
+}
+
+/**
+ * gpm_manager_dpms_mode_changed_cb
+ **/
+static void gpm_manager_dpms_mode_changed_cb(GpmDpms *dpms, GpmDpmsMode mode,
+                                             GpmManager *manager) {
+  gpm_timeline_add(manager->priv->timeline, GPM_TIMELINE_KIND_DPMS, mode);
+  gpm_metrics_set_gauge(manager->priv->metrics, GPM_METRICS_GAUGE_DPMS, mode);
+  gpm_manager_state_set(manager, GPM_STATE_FIELD_DPMS, mode);
+}
+
+/**
+ * gpm_manager_session_inhibited_changed_cb
+ *
+ * The timeline value is a mask of GPM_TIMELINE_INHIBIT_IDLE and
+ * GPM_TIMELINE_INHIBIT_SUSPEND.
+ **/
+static void gpm_manager_session_inhibited_changed_cb(
+    GpmSession *session, gboolean is_idle_inhibited,
+    gboolean is_suspend_inhibited, GpmManager *manager) {
+  guint value = 0;
+
+  if (is_idle_inhibited) value |= GPM_TIMELINE_INHIBIT_IDLE;
+  if (is_suspend_inhibited) value |= GPM_TIMELINE_INHIBIT_SUSPEND;
+  gpm_timeline_add(manager->priv->timeline, GPM_TIMELINE_KIND_INHIBIT, value);
+}
+
+/**
+ * gpm_manager_session_inhibitors_changed_cb
+ **/
+static void gpm_manager_session_inhibitors_changed_cb(GpmSession *session,
+                                                      guint count,
+                                                      GpmManager *manager) {
+  gpm_metrics_set_gauge(manager->priv->metrics, GPM_METRICS_GAUGE_INHIBITORS,
+                        count);
+  gpm_manager_state_set(manager, GPM_STATE_FIELD_INHIBITORS, count);
+}
+
+/**
+ * gpm_manager_engine_devices_changed_cb
+ *
+ * Hands the metrics a copy of the device state; nothing is written unless
+ * something it exports has changed. The state page gets the charge of all
+ * the batteries together, weighted by their size where that is known.
+ **/
+static void gpm_manager_engine_devices_changed_cb(GpmEngine *engine,
+                                                  GpmManager *manager) {
+  GpmMetricsDevice *items;
+  GPtrArray *array;
+  UpDevice *device;
+  UpDeviceKind kind;
+  const gchar *object_path;
+  gchar **ids;
+  gdouble energy = 0.f;
+  gdouble energy_full = 0.f;
+  gdouble percentage = 0.f;
+  guint batteries = 0;
+  guint i;
+
+  array = gpm_engine_get_devices(engine);
+  items = g_new0(GpmMetricsDevice, array->len);
+  ids = g_new0(gchar *, array->len + 1);
+  for (i = 0; i < array->len; i++) {
+    device = g_ptr_array_index(array, i);
+    g_object_get(device, "kind", &kind, "percentage", &items[i].percentage,
+                 "energy", &items[i].energy, "energy-full",
+                 &items[i].energy_full, "energy-full-design",
+                 &items[i].energy_full_design, "energy-rate",
+                 &items[i].energy_rate, NULL);
+
+    /* phones are not on the bus */
+    object_path = up_device_get_object_path(device);
+    if (object_path != NULL)
+      ids[i] = g_path_get_basename(object_path);
+    else
+      ids[i] = g_strdup_printf("device_%u", i);
+    items[i].id = ids[i];
+    items[i].kind = up_device_kind_to_string(kind);
+
+    if (kind != UP_DEVICE_KIND_BATTERY) continue;
+    energy += items[i].energy;
+    energy_full += items[i].energy_full;
+    percentage += items[i].percentage;
+    batteries++;
+  }
+  gpm_metrics_set_devices(manager->priv->metrics, items, array->len);
+  if (energy_full > 0.f)
+    percentage = 100.f * energy / energy_full;
+  else if (batteries > 0)
+    percentage /= batteries;
+  gpm_manager_state_set(manager, GPM_STATE_FIELD_PERCENTAGE,
+                        batteries > 0 ? (guint)(percentage + 0.5f)
+                                      : GPM_STATE_PAGE_UNKNOWN);
+  g_strfreev(ids);
+  g_free(items);
+  g_ptr_array_unref(array);
 }
 
 /**
@@ -1585,12 +1927,97 @@ static void on_icon_theme_change(GtkSettings *settings, GParamSpec *pspec,
   g_free(icon);
 }
 
+/**
+ * gpm_manager_metrics_coldplug:
+ **/
+static void gpm_manager_metrics_coldplug(GpmManager *manager) {
+  GpmDpmsMode mode;
+  guint brightness;
+  guint inhibitors;
+
+  if (manager->priv->backlight != NULL &&
+      gpm_backlight_get_brightness(manager->priv->backlight, &brightness,
+                                   NULL)) {
+    gpm_metrics_set_gauge(manager->priv->metrics, GPM_METRICS_GAUGE_BRIGHTNESS,
+                          brightness);
+    gpm_manager_state_set(manager, GPM_STATE_FIELD_BRIGHTNESS, brightness);
+  }
+  if (gpm_dpms_get_mode(manager->priv->dpms, &mode, NULL)) {
+    gpm_metrics_set_gauge(manager->priv->metrics, GPM_METRICS_GAUGE_DPMS, mode);
+    gpm_manager_state_set(manager, GPM_STATE_FIELD_DPMS, mode);
+  }
+  inhibitors = gpm_session_get_inhibitors(manager->priv->session);
+  gpm_metrics_set_gauge(manager->priv->metrics, GPM_METRICS_GAUGE_IDLE,
+                        gpm_idle_get_mode(manager->priv->idle));
+  gpm_metrics_set_gauge(manager->priv->metrics, GPM_METRICS_GAUGE_INHIBITORS,
+                        inhibitors);
+  gpm_manager_state_set(manager, GPM_STATE_FIELD_IDLE,
+                        gpm_idle_get_mode(manager->priv->idle));
+  gpm_manager_state_set(manager, GPM_STATE_FIELD_INHIBITORS, inhibitors);
+  gpm_manager_engine_devices_changed_cb(manager->priv->engine, manager);
+}
+
+/**
+ * gpm_manager_deferred_cb:
+ *
+ * Sets up what is not needed to handle keys and policy, once everything
+ * more important has had a chance to run.
+ **/
+static gboolean gpm_manager_deferred_cb(GpmManager *manager) {
+  GError *error = NULL;
+  gchar *text;
+
+  manager->priv->deferred_id = 0;
+  gpm_profile_mark("main loop");
+
+  g_debug("creating new tray icon");
+  manager->priv->tray_icon = gpm_tray_icon_new();
+
+  /* keep a reference for the notifications */
+  manager->priv->status_icon =
+      gpm_tray_icon_get_status_icon(manager->priv->tray_icon);
+
+  /* the engine may already have changed before there was an icon */
+  text = gpm_engine_get_icon(manager->priv->engine);
+  if (text != NULL) gpm_tray_icon_set_icon(manager->priv->tray_icon, text);
+  g_free(text);
+  text = gpm_engine_get_summary(manager->priv->engine);
+  if (text != NULL) gpm_tray_icon_set_tooltip(manager->priv->tray_icon, text);
+  g_free(text);
+
+  g_signal_connect(gtk_settings_get_default(), "notify::gtk-icon-theme-name",
+                   G_CALLBACK(on_icon_theme_change), manager);
+  gpm_profile_mark("tray icon");
+
+  /* publish the state page now the bus name is ours, so that a second
+   * daemon that is about to exit never replaces it */
+  if (!gpm_trace_is_replaying(manager->priv->trace)) {
+    manager->priv->state_filename = gpm_state_page_get_filename();
+    manager->priv->state_page =
+        gpm_state_page_create(manager->priv->state_filename, &error);
+    if (manager->priv->state_page == NULL) {
+      g_warning("failed to publish state: %s", error->message);
+      g_clear_error(&error);
+    } else {
+      gpm_manager_state_set(manager, GPM_STATE_FIELD_ON_BATTERY,
+                            manager->priv->on_battery);
+    }
+  }
+
+  /* coldplug the metrics and state page, then start exporting if asked to */
+  gpm_manager_metrics_coldplug(manager);
+  gpm_manager_sync_metrics_file(manager);
+  gpm_profile_mark("metrics");
+  return FALSE;
+}
+
 /**
  * gpm_manager_init:
  * @manager: This class instance
  **/
 static void gpm_manager_init(GpmManager *manager) {
   gboolean check_type_cpu;
+  gboolean lid_is_closed;
   DBusGConnection *connection;
   GDBusConnection *g_connection;
   GError *error = NULL;
@@ -1599,12 +2026,17 @@ static void gpm_manager_init(GpmManager *manager) {
   connection = dbus_g_bus_get(DBUS_BUS_SESSION, &error);
   g_connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
 
+  manager->priv->trace = gpm_trace_new();
+  g_signal_connect(manager->priv->trace, "replay",
+                   G_CALLBACK(gpm_manager_trace_replay_cb), manager);
+
   /* We want to inhibit the systemd suspend options, and take care of them
-   * ourselves */
-  if (LOGIND_RUNNING()) {
+   * ourselves; a replay leaves that to the real daemon */
+  if (LOGIND_RUNNING() && !gpm_trace_is_replaying(manager->priv->trace)) {
     manager->priv->systemd_inhibit =
         gpm_manager_systemd_inhibit(manager->priv->systemd_inhibit_proxy);
   }
+  gpm_profile_mark("systemd inhibitor");
 
   manager->priv->critical_alert_timeout_id = 0;
   manager->priv->critical_alert_loop_props = NULL;
@@ -1625,16 +2057,37 @@ static void gpm_manager_init(GpmManager *manager) {
   g_signal_connect(manager->priv->client, "notify::on-battery",
                    G_CALLBACK(gpm_manager_client_changed_cb), manager);
 
-  /* use libmatenotify */
-  notify_init(GPM_NAME);
-
   /* coldplug so we are in the correct state at startup */
-  g_object_get(manager->priv->client, "on-battery", &manager->priv->on_battery,
-               NULL);
+  if (!gpm_trace_is_replaying(manager->priv->trace)) {
+    g_object_get(manager->priv->client, "on-battery",
+                 &manager->priv->on_battery, "lid-is-closed", &lid_is_closed,
+                 NULL);
+    gpm_trace_add(manager->priv->trace, GPM_TRACE_KIND_CLIENT,
+                  gpm_manager_client_get_trace_flags(manager->priv->on_battery,
+                                                     lid_is_closed) |
+                      GPM_TRACE_CLIENT_COLDPLUG,
+                  NULL, NULL);
+  }
+  gpm_profile_mark("upower client");
+
+  /* a replay must not touch the real CPUs or firmware */
+  if (!gpm_trace_is_replaying(manager->priv->trace)) {
+    manager->priv->cpu_policy = gpm_cpu_policy_new();
+    gpm_cpu_policy_set_on_battery(manager->priv->cpu_policy,
+                                  manager->priv->on_battery);
+    manager->priv->power_profiles = gpm_power_profiles_new();
+    gpm_power_profiles_set_on_battery(manager->priv->power_profiles,
+                                      manager->priv->on_battery);
+  }
+
+  /* record policy changes for the statistics */
+  manager->priv->timeline = gpm_timeline_new();
+  manager->priv->metrics = gpm_metrics_new();
 
   manager->priv->button = gpm_button_new();
   g_signal_connect(manager->priv->button, "button-pressed",
                    G_CALLBACK(gpm_manager_button_pressed_cb), manager);
+  gpm_profile_mark("key grabs");
 
   /* try an start an interactive service */
   manager->priv->backlight = gpm_backlight_new();
@@ -1644,7 +2097,23 @@ static void gpm_manager_init(GpmManager *manager) {
                                     &dbus_glib_gpm_backlight_object_info);
     dbus_g_connection_register_g_object(connection, GPM_DBUS_PATH_BACKLIGHT,
                                         G_OBJECT(manager->priv->backlight));
+    g_signal_connect(manager->priv->backlight, "brightness-changed",
+                     G_CALLBACK(gpm_manager_brightness_changed_cb), manager);
   }
+  gpm_profile_mark("backlight");
+
+  manager->priv->dpms = gpm_dpms_new();
+  g_signal_connect(manager->priv->dpms, "mode-changed",
+                   G_CALLBACK(gpm_manager_dpms_mode_changed_cb), manager);
+
+  manager->priv->session = gpm_session_new();
+  g_signal_connect(manager->priv->session, "inhibited-changed",
+                   G_CALLBACK(gpm_manager_session_inhibited_changed_cb),
+                   manager);
+  g_signal_connect(manager->priv->session, "inhibitors-changed",
+                   G_CALLBACK(gpm_manager_session_inhibitors_changed_cb),
+                   manager);
+  gpm_profile_mark("dpms and session");
 
   manager->priv->kbd_backlight = gpm_kbd_backlight_new();
   if (manager->priv->kbd_backlight != NULL) {
@@ -1653,30 +2122,30 @@ static void gpm_manager_init(GpmManager *manager) {
     dbus_g_connection_register_g_object(connection, GPM_DBUS_PATH_KBD_BACKLIGHT,
                                         G_OBJECT(manager->priv->kbd_backlight));
   }
+  gpm_profile_mark("keyboard backlight");
 
   manager->priv->idle = gpm_idle_new();
   g_signal_connect(manager->priv->idle, "idle-changed",
                    G_CALLBACK(gpm_manager_idle_changed_cb), manager);
+  g_signal_connect(manager->priv->idle, "dim-avoided",
+                   G_CALLBACK(gpm_manager_idle_dim_avoided_cb), manager);
 
   /* set up the check_type_cpu, so we can disable the CPU load check */
   check_type_cpu = g_settings_get_boolean(manager->priv->settings,
                                           GPM_SETTINGS_IDLE_CHECK_CPU);
   gpm_idle_set_check_cpu(manager->priv->idle, check_type_cpu);
+  gpm_profile_mark("idle");
 
   /* use the control object */
   g_debug("creating new control instance");
   manager->priv->control = gpm_control_new();
   g_signal_connect(manager->priv->control, "resume",
                    G_CALLBACK(gpm_manager_control_resume_cb), manager);
-
-  g_debug("creating new tray icon");
-  manager->priv->tray_icon = gpm_tray_icon_new();
-
-  /* keep a reference for the notifications */
-  manager->priv->status_icon =
-      gpm_tray_icon_get_status_icon(manager->priv->tray_icon);
+  g_signal_connect(manager->priv->control, "sleep",
+                   G_CALLBACK(gpm_manager_control_sleep_cb), manager);
 
   gpm_manager_sync_policy_sleep(manager);
+  gpm_profile_mark("control");
 
   manager->priv->engine = gpm_engine_new();
   g_signal_connect(manager->priv->engine, "low-capacity",
@@ -1695,9 +2164,16 @@ static void gpm_manager_init(GpmManager *manager) {
                    G_CALLBACK(gpm_manager_engine_charge_critical_cb), manager);
   g_signal_connect(manager->priv->engine, "charge-action",
                    G_CALLBACK(gpm_manager_engine_charge_action_cb), manager);
-
-  g_signal_connect(gtk_settings_get_default(), "notify::gtk-icon-theme-name",
-                   G_CALLBACK(on_icon_theme_change), manager);
+  g_signal_connect(manager->priv->engine, "devices-changed",
+                   G_CALLBACK(gpm_manager_engine_devices_changed_cb), manager);
+  gpm_profile_mark("engine");
+
+  /* the tray icon and the metrics can wait until we are up */
+  manager->priv->deferred_id =
+      g_idle_add_full(G_PRIORITY_LOW, (GSourceFunc)gpm_manager_deferred_cb,
+                      manager, NULL);
+  g_source_set_name_by_id(manager->priv->deferred_id,
+                          "[GpmManager] deferred");
 }
 
 /**
@@ -1732,19 +2208,40 @@ static void gpm_manager_finalize(GObject *object) {
     manager->priv->critical_alert_timeout_id = 0;
   }
 
+  if (manager->priv->deferred_id != 0)
+    g_source_remove(manager->priv->deferred_id);
+  if (manager->priv->state_changed_id != 0)
+    g_source_remove(manager->priv->state_changed_id);
+  if (manager->priv->state_page != NULL) {
+    gpm_state_page_retire(manager->priv->state_page);
+    gpm_state_page_close(manager->priv->state_page);
+    g_unlink(manager->priv->state_filename);
+  }
+  g_free(manager->priv->state_filename);
   g_signal_handlers_disconnect_by_func(gtk_settings_get_default(),
                                        on_icon_theme_change, manager);
 
   g_object_unref(manager->priv->settings);
   g_object_unref(manager->priv->idle);
   g_object_unref(manager->priv->engine);
-  g_object_unref(manager->priv->tray_icon);
+  if (manager->priv->tray_icon != NULL)
+    g_object_unref(manager->priv->tray_icon);
   g_object_unref(manager->priv->control);
   g_object_unref(manager->priv->button);
   g_object_unref(manager->priv->backlight);
   g_object_unref(manager->priv->kbd_backlight);
+  g_object_unref(manager->priv->dpms);
+  g_object_unref(manager->priv->session);
+  g_object_unref(manager->priv->timeline);
+  g_object_unref(manager->priv->metrics);
+  if (manager->priv->cpu_policy != NULL)
+    g_object_unref(manager->priv->cpu_policy);
+  if (manager->priv->power_profiles != NULL)
+    g_object_unref(manager->priv->power_profiles);
+  g_object_unref(manager->priv->trace);
   g_object_unref(manager->priv->client);
-  g_object_unref(manager->priv->status_icon);
+  if (manager->priv->status_icon != NULL)
+    g_object_unref(manager->priv->status_icon);
 
   if (LOGIND_RUNNING()) {
     /* Let systemd take over again ... */
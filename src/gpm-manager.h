@@ -69,6 +69,10 @@ gboolean gpm_manager_can_suspend(GpmManager *manager, gboolean *can_suspend,
                                  GError **error);
 gboolean gpm_manager_can_hibernate(GpmManager *manager, gboolean *can_hibernate,
                                    GError **error);
+void gpm_manager_hold_performance(GpmManager *manager, const gchar *reason,
+                                  DBusGMethodInvocation *context);
+void gpm_manager_release_performance(GpmManager *manager, guint cookie,
+                                     DBusGMethodInvocation *context);
 
 G_END_DECLS
 
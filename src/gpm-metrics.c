@@ -0,0 +1,897 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "gpm-control.h"
+#include "gpm-dpms.h"
+#include "gpm-idle.h"
+#include "gpm-metrics.h"
+
+/* scrapers poll every 15 s or more, so writing more often is wasted */
+#define GPM_METRICS_MIN_INTERVAL 10
+
+typedef struct {
+  gchar *id;
+  gchar *kind;
+  gdouble percentage;
+  gdouble energy;
+  gdouble energy_full;
+  gdouble energy_full_design;
+  gdouble energy_rate;
+} GpmMetricsDeviceItem;
+
+struct GpmMetricsPrivate {
+  gchar *filename; /* NULL if not exporting */
+  GArray *devices; /* of GpmMetricsDeviceItem */
+  guint gauges[GPM_METRICS_GAUGE_LAST];
+  gboolean gauges_set[GPM_METRICS_GAUGE_LAST];
+  guint64 sleep_count[GPM_CONTROL_ACTION_LAST];
+  guint64 dims_avoided;
+  gdouble sleep_seconds[GPM_CONTROL_ACTION_LAST];
+  gint64 sleep_time; /* wall clock, as the monotonic clock stops asleep */
+  gdouble resume_usable; /* seconds, or negative if not resumed yet */
+  gint64 write_time; /* monotonic */
+  guint write_id;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE(GpmMetrics, gpm_metrics, G_TYPE_OBJECT)
+
+static gpointer gpm_metrics_object = NULL;
+static GPollFunc gpm_metrics_poll_func = NULL;
+static guint64 gpm_metrics_wakeups = 0;
+
+/**
+ * gpm_metrics_poll:
+ *
+ * Wraps the main loop poll so every time the daemon is woken is counted.
+ * A poll that does not block is the loop dispatching, not a wakeup.
+ **/
+static gint gpm_metrics_poll(GPollFD *ufds, guint nfsd, gint timeout) {
+  if (timeout != 0) gpm_metrics_wakeups++;
+  return gpm_metrics_poll_func(ufds, nfsd, timeout);
+}
+
+/**
+ * gpm_metrics_write_cb:
+ **/
+static gboolean gpm_metrics_write_cb(GpmMetrics *metrics) {
+  GError *error = NULL;
+
+  metrics->priv->write_id = 0;
+  if (!gpm_metrics_write(metrics, &error)) {
+    g_warning("failed to write metrics: %s", error->message);
+    g_error_free(error);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gpm_metrics_changed:
+ *
+ * Schedules a write. Changes that arrive together are written together,
+ * and the file is never written more than once per interval.
+ **/
+static void gpm_metrics_changed(GpmMetrics *metrics) {
+  GpmMetricsPrivate *priv = metrics->priv;
+  gint64 elapsed;
+
+  if (priv->filename == NULL || priv->write_id != 0) return;
+
+  elapsed = g_get_monotonic_time() - priv->write_time;
+  if (priv->write_time == 0 ||
+      elapsed >= GPM_METRICS_MIN_INTERVAL * G_USEC_PER_SEC) {
+    priv->write_id = g_idle_add((GSourceFunc)gpm_metrics_write_cb, metrics);
+  } else {
+    priv->write_id = g_timeout_add(
+        (GPM_METRICS_MIN_INTERVAL * G_USEC_PER_SEC - elapsed) / 1000 + 1,
+        (GSourceFunc)gpm_metrics_write_cb, metrics);
+  }
+  g_source_set_name_by_id(priv->write_id, "[GpmMetrics] write");
+}
+
+/**
+ * gpm_metrics_set_filename:
+ * @metrics: This class instance
+ * @filename: Where to write, or %NULL or "" to stop exporting
+ *
+ * The file is in the OpenMetrics text format, e.g. for the textfile
+ * collector of node_exporter.
+ **/
+void gpm_metrics_set_filename(GpmMetrics *metrics, const gchar *filename) {
+  GpmMetricsPrivate *priv;
+
+  g_return_if_fail(GPM_IS_METRICS(metrics));
+
+  priv = metrics->priv;
+  if (filename != NULL && filename[0] == '\0') filename = NULL;
+  if (g_strcmp0(filename, priv->filename) == 0) return;
+  g_free(priv->filename);
+  priv->filename = g_strdup(filename);
+  if (priv->write_id != 0) {
+    g_source_remove(priv->write_id);
+    priv->write_id = 0;
+  }
+  priv->write_time = 0;
+  gpm_metrics_changed(metrics);
+}
+
+/**
+ * gpm_metrics_set_gauge:
+ * @metrics: This class instance
+ * @gauge: The gauge, e.g. %GPM_METRICS_GAUGE_BRIGHTNESS
+ * @value: The new value, the meaning depends on @gauge
+ **/
+void gpm_metrics_set_gauge(GpmMetrics *metrics, GpmMetricsGauge gauge,
+                           guint value) {
+  GpmMetricsPrivate *priv;
+
+  g_return_if_fail(GPM_IS_METRICS(metrics));
+  g_return_if_fail(gauge < GPM_METRICS_GAUGE_LAST);
+
+  priv = metrics->priv;
+  if (priv->gauges_set[gauge] && priv->gauges[gauge] == value) return;
+  priv->gauges[gauge] = value;
+  priv->gauges_set[gauge] = TRUE;
+  gpm_metrics_changed(metrics);
+}
+
+/**
+ * gpm_metrics_device_item_clear:
+ **/
+static void gpm_metrics_device_item_clear(GpmMetricsDeviceItem *item) {
+  g_free(item->id);
+  g_free(item->kind);
+}
+
+/**
+ * gpm_metrics_device_equal:
+ **/
+static gboolean gpm_metrics_device_equal(const GpmMetricsDeviceItem *item,
+                                         const GpmMetricsDevice *device) {
+  return g_strcmp0(item->id, device->id) == 0 &&
+         g_strcmp0(item->kind, device->kind) == 0 &&
+         item->percentage == device->percentage &&
+         item->energy == device->energy &&
+         item->energy_full == device->energy_full &&
+         item->energy_full_design == device->energy_full_design &&
+         item->energy_rate == device->energy_rate;
+}
+
+/**
+ * gpm_metrics_set_devices:
+ * @metrics: This class instance
+ * @devices: The power devices, the strings are copied
+ * @length: The number of @devices
+ *
+ * Replaces the devices; nothing is written if they have not changed.
+ **/
+void gpm_metrics_set_devices(GpmMetrics *metrics,
+                             const GpmMetricsDevice *devices, guint length) {
+  GpmMetricsDeviceItem *item;
+  GArray *array;
+  guint i;
+
+  g_return_if_fail(GPM_IS_METRICS(metrics));
+
+  /* UPower notifies for each property, most of them change nothing here */
+  array = metrics->priv->devices;
+  if (array->len == length) {
+    for (i = 0; i < length; i++) {
+      item = &g_array_index(array, GpmMetricsDeviceItem, i);
+      if (!gpm_metrics_device_equal(item, &devices[i])) break;
+    }
+    if (i == length) return;
+  }
+
+  g_array_set_size(array, length);
+  for (i = 0; i < length; i++) {
+    item = &g_array_index(array, GpmMetricsDeviceItem, i);
+    g_free(item->id);
+    g_free(item->kind);
+    item->id = g_strdup(devices[i].id);
+    item->kind = g_strdup(devices[i].kind);
+    item->percentage = devices[i].percentage;
+    item->energy = devices[i].energy;
+    item->energy_full = devices[i].energy_full;
+    item->energy_full_design = devices[i].energy_full_design;
+    item->energy_rate = devices[i].energy_rate;
+  }
+  gpm_metrics_changed(metrics);
+}
+
+/**
+ * gpm_metrics_add_sleep:
+ * @metrics: This class instance
+ * @action: The #GpmControlAction about to happen
+ **/
+void gpm_metrics_add_sleep(GpmMetrics *metrics, guint action) {
+  g_return_if_fail(GPM_IS_METRICS(metrics));
+  g_return_if_fail(action < GPM_CONTROL_ACTION_LAST);
+
+  metrics->priv->sleep_count[action]++;
+  metrics->priv->sleep_time = g_get_real_time();
+}
+
+/**
+ * gpm_metrics_add_dim_avoided:
+ * @metrics: This class instance
+ *
+ * Counts a dim the idle learner held back that the user did not wait for.
+ **/
+void gpm_metrics_add_dim_avoided(GpmMetrics *metrics) {
+  g_return_if_fail(GPM_IS_METRICS(metrics));
+  metrics->priv->dims_avoided++;
+  gpm_metrics_changed(metrics);
+}
+
+/**
+ * gpm_metrics_add_resume:
+ * @metrics: This class instance
+ * @action: The #GpmControlAction that has just finished
+ **/
+void gpm_metrics_add_resume(GpmMetrics *metrics, guint action) {
+  GpmMetricsPrivate *priv;
+  gint64 now;
+
+  g_return_if_fail(GPM_IS_METRICS(metrics));
+  g_return_if_fail(action < GPM_CONTROL_ACTION_LAST);
+
+  priv = metrics->priv;
+  now = g_get_real_time();
+  if (priv->sleep_time != 0 && now > priv->sleep_time)
+    priv->sleep_seconds[action] +=
+        (gdouble)(now - priv->sleep_time) / G_USEC_PER_SEC;
+  priv->sleep_time = 0;
+
+  /* the scheduled write may have been due while we were asleep */
+  priv->write_time = 0;
+  if (priv->write_id != 0) {
+    g_source_remove(priv->write_id);
+    priv->write_id = 0;
+  }
+  gpm_metrics_changed(metrics);
+}
+
+/**
+ * gpm_metrics_set_resume_usable:
+ * @metrics: This class instance
+ * @seconds: How long the last resume took to give back a usable screen
+ **/
+void gpm_metrics_set_resume_usable(GpmMetrics *metrics, gdouble seconds) {
+  g_return_if_fail(GPM_IS_METRICS(metrics));
+
+  metrics->priv->resume_usable = seconds;
+  gpm_metrics_changed(metrics);
+}
+
+/**
+ * gpm_metrics_append_family:
+ **/
+static void gpm_metrics_append_family(GString *string, const gchar *name,
+                                      const gchar *type, const gchar *help) {
+  g_string_append_printf(string, "# TYPE %s %s\n# HELP %s %s\n", name, type,
+                         name, help);
+}
+
+/**
+ * gpm_metrics_append_label:
+ *
+ * Quotes @value as the exposition format wants it.
+ **/
+static void gpm_metrics_append_label(GString *string, const gchar *name,
+                                     const gchar *value) {
+  const gchar *p;
+
+  g_string_append_printf(string, "%s=\"", name);
+  for (p = value != NULL ? value : ""; *p != '\0'; p++) {
+    if (*p == '\\')
+      g_string_append(string, "\\\\");
+    else if (*p == '"')
+      g_string_append(string, "\\\"");
+    else if (*p == '\n')
+      g_string_append(string, "\\n");
+    else
+      g_string_append_c(string, *p);
+  }
+  g_string_append_c(string, '"');
+}
+
+/**
+ * gpm_metrics_append_value:
+ *
+ * Ends a sample; the decimal point does not follow the locale.
+ **/
+static void gpm_metrics_append_value(GString *string, gdouble value) {
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append_c(string, ' ');
+  g_string_append(string, g_ascii_formatd(buf, sizeof(buf), "%.6g", value));
+  g_string_append_c(string, '\n');
+}
+
+/**
+ * gpm_metrics_append_devices:
+ **/
+static void gpm_metrics_append_devices(GString *string, GArray *devices,
+                                       const gchar *name, const gchar *help,
+                                       gsize offset, gboolean is_ratio) {
+  GpmMetricsDeviceItem *item;
+  gdouble value;
+  guint i;
+
+  gpm_metrics_append_family(string, name, "gauge", help);
+  for (i = 0; i < devices->len; i++) {
+    item = &g_array_index(devices, GpmMetricsDeviceItem, i);
+    value = G_STRUCT_MEMBER(gdouble, item, offset);
+
+    /* the health is the capacity left of what it was designed for */
+    if (is_ratio) {
+      if (item->energy_full_design <= 0.0f) continue;
+      value = item->energy_full / item->energy_full_design;
+    }
+    g_string_append_printf(string, "%s{", name);
+    gpm_metrics_append_label(string, "device", item->id);
+    g_string_append_c(string, ',');
+    gpm_metrics_append_label(string, "kind", item->kind);
+    g_string_append_c(string, '}');
+    gpm_metrics_append_value(string, value);
+  }
+}
+
+/**
+ * gpm_metrics_append_stateset:
+ **/
+static void gpm_metrics_append_stateset(GString *string, const gchar *name,
+                                        const gchar *help,
+                                        const gchar *const *states,
+                                        guint value) {
+  guint i;
+
+  gpm_metrics_append_family(string, name, "stateset", help);
+  for (i = 0; states[i] != NULL; i++) {
+    g_string_append_printf(string, "%s{", name);
+    gpm_metrics_append_label(string, name, states[i]);
+    g_string_append_printf(string, "} %i\n", i == value);
+  }
+}
+
+/**
+ * gpm_metrics_to_string:
+ * @metrics: This class instance
+ *
+ * Return value: the metrics in the OpenMetrics text format, free with
+ * g_free()
+ **/
+gchar *gpm_metrics_to_string(GpmMetrics *metrics) {
+  GpmMetricsPrivate *priv;
+  GString *string;
+  guint i;
+  const gchar *const dpms_states[] = {"on", "standby", "suspend", "off",
+                                      NULL};
+  const gchar *const idle_states[] = {"normal", "dim", "blank", "sleep", NULL};
+  const gchar *const actions[] = {"suspend", "hibernate"};
+
+  g_return_val_if_fail(GPM_IS_METRICS(metrics), NULL);
+
+  priv = metrics->priv;
+  string = g_string_sized_new(2048);
+
+  gpm_metrics_append_devices(
+      string, priv->devices, "mate_power_device_percentage",
+      "Charge of the device in percent",
+      G_STRUCT_OFFSET(GpmMetricsDeviceItem, percentage), FALSE);
+  gpm_metrics_append_devices(
+      string, priv->devices, "mate_power_device_energy_watthours",
+      "Energy left in the device",
+      G_STRUCT_OFFSET(GpmMetricsDeviceItem, energy), FALSE);
+  gpm_metrics_append_devices(
+      string, priv->devices, "mate_power_device_capacity_watthours",
+      "Energy the device holds when full",
+      G_STRUCT_OFFSET(GpmMetricsDeviceItem, energy_full), FALSE);
+  gpm_metrics_append_devices(
+      string, priv->devices, "mate_power_device_rate_watts",
+      "Rate the device is charging or discharging at",
+      G_STRUCT_OFFSET(GpmMetricsDeviceItem, energy_rate), FALSE);
+  gpm_metrics_append_devices(
+      string, priv->devices, "mate_power_device_health_ratio",
+      "Capacity of the device compared to its design capacity", 0, TRUE);
+
+  if (priv->gauges_set[GPM_METRICS_GAUGE_BRIGHTNESS]) {
+    gpm_metrics_append_family(string, "mate_power_brightness_percent", "gauge",
+                              "Brightness of the panel");
+    g_string_append_printf(string, "mate_power_brightness_percent %u\n",
+                           priv->gauges[GPM_METRICS_GAUGE_BRIGHTNESS]);
+  }
+  if (priv->gauges_set[GPM_METRICS_GAUGE_DPMS])
+    gpm_metrics_append_stateset(string, "mate_power_dpms_mode",
+                                "Power state of the displays", dpms_states,
+                                priv->gauges[GPM_METRICS_GAUGE_DPMS]);
+  gpm_metrics_append_stateset(string, "mate_power_idle_mode",
+                              "Idle state of the session", idle_states,
+                              priv->gauges[GPM_METRICS_GAUGE_IDLE]);
+  gpm_metrics_append_family(string, "mate_power_inhibitors", "gauge",
+                            "Session inhibitors currently held");
+  g_string_append_printf(string, "mate_power_inhibitors %u\n",
+                         priv->gauges[GPM_METRICS_GAUGE_INHIBITORS]);
+  gpm_metrics_append_family(string, "mate_power_dims_avoided", "counter",
+                            "Dims held back that the user did not wait for");
+  g_string_append_printf(string,
+                         "mate_power_dims_avoided_total %" G_GUINT64_FORMAT
+                         "\n",
+                         priv->dims_avoided);
+
+  gpm_metrics_append_family(string, "mate_power_sleep", "counter",
+                            "Times the computer was put to sleep");
+  for (i = 0; i < GPM_CONTROL_ACTION_LAST; i++) {
+    g_string_append(string, "mate_power_sleep_total{");
+    gpm_metrics_append_label(string, "action", actions[i]);
+    g_string_append_printf(string, "} %" G_GUINT64_FORMAT "\n",
+                           priv->sleep_count[i]);
+  }
+  gpm_metrics_append_family(string, "mate_power_sleep_seconds", "counter",
+                            "Time the computer has spent asleep");
+  for (i = 0; i < GPM_CONTROL_ACTION_LAST; i++) {
+    g_string_append(string, "mate_power_sleep_seconds_total{");
+    gpm_metrics_append_label(string, "action", actions[i]);
+    g_string_append_c(string, '}');
+    gpm_metrics_append_value(string, priv->sleep_seconds[i]);
+  }
+  if (priv->resume_usable >= 0) {
+    gpm_metrics_append_family(string, "mate_power_resume_usable_seconds",
+                              "gauge",
+                              "Time from the last resume to a usable screen");
+    g_string_append(string, "mate_power_resume_usable_seconds");
+    gpm_metrics_append_value(string, priv->resume_usable);
+  }
+  gpm_metrics_append_family(string, "mate_power_wakeups", "counter",
+                            "Times the daemon main loop has woken up");
+  g_string_append_printf(string, "mate_power_wakeups_total %" G_GUINT64_FORMAT
+                         "\n", gpm_metrics_wakeups);
+
+  g_string_append(string, "# EOF\n");
+  return g_string_free(string, FALSE);
+}
+
+/**
+ * gpm_metrics_write:
+ * @metrics: This class instance
+ * @error: a #GError, or %NULL
+ *
+ * Writes the file now. It is replaced with a rename, so a scraper never
+ * sees it half written.
+ *
+ * Return value: %TRUE if the file was written, or there is no file
+ **/
+gboolean gpm_metrics_write(GpmMetrics *metrics, GError **error) {
+  GpmMetricsPrivate *priv;
+  gchar *text;
+  gboolean ret;
+
+  g_return_val_if_fail(GPM_IS_METRICS(metrics), FALSE);
+
+  priv = metrics->priv;
+  if (priv->write_id != 0) {
+    g_source_remove(priv->write_id);
+    priv->write_id = 0;
+  }
+  if (priv->filename == NULL) return TRUE;
+
+  text = gpm_metrics_to_string(metrics);
+  ret = g_file_set_contents(priv->filename, text, -1, error);
+  priv->write_time = g_get_monotonic_time();
+  g_free(text);
+  return ret;
+}
+
+/**
+ * gpm_metrics_finalize:
+ **/
+static void gpm_metrics_finalize(GObject *object) {
+  GpmMetrics *metrics;
+
+  g_return_if_fail(object != NULL);
+  g_return_if_fail(GPM_IS_METRICS(object));
+
+  metrics = GPM_METRICS(object);
+  if (metrics->priv->write_id != 0) g_source_remove(metrics->priv->write_id);
+  g_array_unref(metrics->priv->devices);
+  g_free(metrics->priv->filename);
+
+  /* stop counting */
+  if (gpm_metrics_poll_func != NULL) {
+    g_main_context_set_poll_func(NULL, gpm_metrics_poll_func);
+    gpm_metrics_poll_func = NULL;
+  }
+
+  G_OBJECT_CLASS(gpm_metrics_parent_class)->finalize(object);
+}
+
+/**
+ * gpm_metrics_class_init:
+ **/
+static void gpm_metrics_class_init(GpmMetricsClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->finalize = gpm_metrics_finalize;
+}
+
+/**
+ * gpm_metrics_init:
+ **/
+static void gpm_metrics_init(GpmMetrics *metrics) {
+  metrics->priv = gpm_metrics_get_instance_private(metrics);
+  metrics->priv->devices =
+      g_array_new(FALSE, TRUE, sizeof(GpmMetricsDeviceItem));
+  g_array_set_clear_func(metrics->priv->devices,
+                         (GDestroyNotify)gpm_metrics_device_item_clear);
+  metrics->priv->gauges[GPM_METRICS_GAUGE_IDLE] = GPM_IDLE_MODE_NORMAL;
+  metrics->priv->resume_usable = -1;
+
+  if (gpm_metrics_poll_func == NULL) {
+    gpm_metrics_poll_func = g_main_context_get_poll_func(NULL);
+    g_main_context_set_poll_func(NULL, gpm_metrics_poll);
+  }
+}
+
+/**
+ * gpm_metrics_new:
+ * Return value: A new metrics class instance.
+ **/
+GpmMetrics *gpm_metrics_new(void) {
+  if (gpm_metrics_object != NULL) {
+    g_object_ref(gpm_metrics_object);
+  } else {
+    gpm_metrics_object = g_object_new(GPM_TYPE_METRICS, NULL);
+    g_object_add_weak_pointer(gpm_metrics_object, &gpm_metrics_object);
+  }
+  return GPM_METRICS(gpm_metrics_object);
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+/**
+ * gpm_metrics_test_parse:
+ *
+ * A strict reader for what we write: each family is declared once before
+ * its samples, counter samples end in _total, and the file ends in # EOF.
+ *
+ * Return value: the samples as "name{labels}" to a #gdouble, or %NULL
+ **/
+static GHashTable *gpm_metrics_test_parse(const gchar *text) {
+  GHashTable *samples;
+  GHashTable *families;
+  gchar **lines;
+  gchar **parts;
+  gchar *family = NULL;
+  gchar *type = NULL;
+  gchar *name;
+  gchar *end;
+  gchar *value;
+  gdouble *number;
+  guint length;
+  guint i;
+  gboolean ret = FALSE;
+
+  samples = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  families = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  lines = g_strsplit(text, "\n", -1);
+  length = g_strv_length(lines);
+  if (length < 2 || g_strcmp0(lines[length - 2], "# EOF") != 0 ||
+      lines[length - 1][0] != '\0')
+    goto out;
+
+  for (i = 0; i + 2 < length; i++) {
+    if (g_str_has_prefix(lines[i], "# TYPE ")) {
+      parts = g_strsplit(lines[i] + 7, " ", -1);
+      if (g_strv_length(parts) != 2 ||
+          g_hash_table_contains(families, parts[0])) {
+        g_strfreev(parts);
+        goto out;
+      }
+      g_free(family);
+      g_free(type);
+      family = g_strdup(parts[0]);
+      type = g_strdup(parts[1]);
+      g_hash_table_add(families, g_strdup(family));
+      g_strfreev(parts);
+      continue;
+    }
+    if (g_str_has_prefix(lines[i], "# HELP ")) {
+      if (family == NULL || !g_str_has_prefix(lines[i] + 7, family)) goto out;
+      continue;
+    }
+    if (lines[i][0] == '#' || family == NULL) goto out;
+
+    /* a sample */
+    value = strrchr(lines[i], ' ');
+    if (value == NULL) goto out;
+    number = g_new(gdouble, 1);
+    *number = g_ascii_strtod(value + 1, &end);
+    if (*end != '\0' || end == value + 1) {
+      g_free(number);
+      goto out;
+    }
+    name = g_strndup(lines[i], strcspn(lines[i], "{ "));
+    if (lines[i][strlen(name)] == '{' && value[-1] != '}') {
+      g_free(name);
+      g_free(number);
+      goto out;
+    }
+    if (!(g_strcmp0(name, family) == 0 && g_strcmp0(type, "counter") != 0) &&
+        !(g_strcmp0(type, "counter") == 0 && g_str_has_prefix(name, family) &&
+          g_strcmp0(name + strlen(family), "_total") == 0)) {
+      g_free(name);
+      g_free(number);
+      goto out;
+    }
+    g_free(name);
+    g_hash_table_insert(samples, g_strndup(lines[i], value - lines[i]),
+                        number);
+  }
+  ret = TRUE;
+out:
+  g_strfreev(lines);
+  g_hash_table_unref(families);
+  g_free(family);
+  g_free(type);
+  if (!ret) {
+    g_hash_table_unref(samples);
+    return NULL;
+  }
+  return samples;
+}
+
+/**
+ * gpm_metrics_test_get:
+ **/
+static gdouble gpm_metrics_test_get(GHashTable *samples, const gchar *key) {
+  gdouble *value;
+
+  value = g_hash_table_lookup(samples, key);
+  if (value == NULL) return -1.0f;
+  return *value;
+}
+
+/**
+ * gpm_metrics_test_timeout_cb:
+ **/
+static gboolean gpm_metrics_test_timeout_cb(gpointer user_data) {
+  return G_SOURCE_REMOVE;
+}
+
+void gpm_metrics_test(gpointer data) {
+  GpmMetrics *metrics;
+  GpmMetricsDevice devices[2];
+  GHashTable *samples;
+  GDir *dir;
+  gchar *directory;
+  gchar *filename;
+  gchar *contents = NULL;
+  gchar *text;
+  guint64 wakeups;
+  guint count;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmMetrics")) return;
+
+  directory = g_build_filename(g_get_tmp_dir(), "gpm-self-test-metrics", NULL);
+  g_mkdir_with_parents(directory, 0700);
+  filename = g_build_filename(directory, "mate-power-manager.prom", NULL);
+  g_unlink(filename);
+  metrics = g_object_new(GPM_TYPE_METRICS, NULL);
+
+  /************************************************************/
+  egg_test_title(test, "nothing is scheduled without a file");
+  gpm_metrics_set_gauge(metrics, GPM_METRICS_GAUGE_BRIGHTNESS, 50);
+  egg_test_assert(test, metrics->priv->write_id == 0);
+
+  /************************************************************/
+  egg_test_title(test, "output without devices parses");
+  text = gpm_metrics_to_string(metrics);
+  samples = gpm_metrics_test_parse(text);
+  if (samples != NULL &&
+      gpm_metrics_test_get(samples, "mate_power_brightness_percent") == 50 &&
+      gpm_metrics_test_get(
+          samples, "mate_power_idle_mode{mate_power_idle_mode=\"normal\"}") ==
+          1 &&
+      gpm_metrics_test_get(samples, "mate_power_wakeups_total") >= 0)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "invalid output:\n%s", text);
+  if (samples != NULL) g_hash_table_unref(samples);
+  g_free(text);
+
+  /************************************************************/
+  egg_test_title(test, "devices and states are exported");
+  devices[0].id = "battery_BAT0";
+  devices[0].kind = "battery";
+  devices[0].percentage = 87.5f;
+  devices[0].energy = 43.75f;
+  devices[0].energy_full = 50.0f;
+  devices[0].energy_full_design = 62.5f;
+  devices[0].energy_rate = 8.25f;
+  devices[1].id = "ups_\"hid\"";
+  devices[1].kind = "ups";
+  devices[1].percentage = 100.0f;
+  devices[1].energy = 0.0f;
+  devices[1].energy_full = 0.0f;
+  devices[1].energy_full_design = 0.0f;
+  devices[1].energy_rate = 0.0f;
+  gpm_metrics_set_devices(metrics, devices, 2);
+  gpm_metrics_set_gauge(metrics, GPM_METRICS_GAUGE_DPMS, GPM_DPMS_MODE_OFF);
+  gpm_metrics_set_gauge(metrics, GPM_METRICS_GAUGE_INHIBITORS, 3);
+  gpm_metrics_add_dim_avoided(metrics);
+  gpm_metrics_add_dim_avoided(metrics);
+  text = gpm_metrics_to_string(metrics);
+  samples = gpm_metrics_test_parse(text);
+  if (samples != NULL &&
+      gpm_metrics_test_get(samples,
+                           "mate_power_device_percentage{device=\"battery_"
+                           "BAT0\",kind=\"battery\"}") == 87.5f &&
+      gpm_metrics_test_get(samples,
+                           "mate_power_device_health_ratio{device=\"battery_"
+                           "BAT0\",kind=\"battery\"}") == 0.8 &&
+      gpm_metrics_test_get(samples,
+                           "mate_power_device_rate_watts{device=\"battery_"
+                           "BAT0\",kind=\"battery\"}") == 8.25f &&
+      gpm_metrics_test_get(samples,
+                           "mate_power_device_percentage{device=\"ups_"
+                           "\\\"hid\\\"\",kind=\"ups\"}") == 100.0f &&
+      gpm_metrics_test_get(
+          samples, "mate_power_dpms_mode{mate_power_dpms_mode=\"off\"}") ==
+          1 &&
+      gpm_metrics_test_get(
+          samples, "mate_power_dpms_mode{mate_power_dpms_mode=\"on\"}") == 0 &&
+      gpm_metrics_test_get(samples, "mate_power_inhibitors") == 3 &&
+      gpm_metrics_test_get(samples, "mate_power_dims_avoided_total") == 2)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "invalid output:\n%s", text);
+  g_free(text);
+
+  /************************************************************/
+  egg_test_title(test, "no health without a design capacity");
+  egg_test_assert(test,
+                  samples != NULL &&
+                      gpm_metrics_test_get(
+                          samples,
+                          "mate_power_device_health_ratio{device=\"ups_"
+                          "\\\"hid\\\"\",kind=\"ups\"}") < 0);
+  if (samples != NULL) g_hash_table_unref(samples);
+
+  /************************************************************/
+  egg_test_title(test, "a file schedules a write");
+  gpm_metrics_set_filename(metrics, filename);
+  egg_test_assert(test, metrics->priv->write_id != 0);
+
+  /************************************************************/
+  egg_test_title(test, "the file is replaced in one go");
+  gpm_metrics_write(metrics, NULL);
+  text = gpm_metrics_to_string(metrics);
+  g_file_get_contents(filename, &contents, NULL, NULL);
+  count = 0;
+  dir = g_dir_open(directory, 0, NULL);
+  while (dir != NULL && g_dir_read_name(dir) != NULL) count++;
+  if (dir != NULL) g_dir_close(dir);
+  if (g_strcmp0(text, contents) == 0 && count == 1)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "%i files, contents:\n%s", count, contents);
+  g_free(contents);
+  g_free(text);
+
+  /************************************************************/
+  egg_test_title(test, "unchanged devices do not schedule a write");
+  gpm_metrics_set_devices(metrics, devices, 2);
+  gpm_metrics_set_gauge(metrics, GPM_METRICS_GAUGE_INHIBITORS, 3);
+  egg_test_assert(test, metrics->priv->write_id == 0);
+
+  /************************************************************/
+  egg_test_title(test, "writes straight after a write are delayed");
+  devices[0].percentage = 87.0f;
+  gpm_metrics_set_devices(metrics, devices, 2);
+  gpm_metrics_set_gauge(metrics, GPM_METRICS_GAUGE_IDLE, GPM_IDLE_MODE_DIM);
+  g_main_context_iteration(NULL, FALSE);
+  g_file_get_contents(filename, &contents, NULL, NULL);
+  if (metrics->priv->write_id != 0 && strstr(contents, " 87.5\n") != NULL)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "written too soon");
+  g_free(contents);
+
+  /************************************************************/
+  egg_test_title(test, "sleep is counted and timed");
+  gpm_metrics_add_sleep(metrics, GPM_CONTROL_ACTION_SUSPEND);
+  metrics->priv->sleep_time -= 90 * G_USEC_PER_SEC;
+  gpm_metrics_add_resume(metrics, GPM_CONTROL_ACTION_SUSPEND);
+  text = gpm_metrics_to_string(metrics);
+  samples = gpm_metrics_test_parse(text);
+  if (samples != NULL &&
+      gpm_metrics_test_get(samples,
+                           "mate_power_sleep_total{action=\"suspend\"}") == 1 &&
+      gpm_metrics_test_get(samples,
+                           "mate_power_sleep_total{action=\"hibernate\"}") ==
+          0 &&
+      gpm_metrics_test_get(
+          samples, "mate_power_sleep_seconds_total{action=\"suspend\"}") >=
+          90)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "invalid output:\n%s", text);
+  if (samples != NULL) g_hash_table_unref(samples);
+  g_free(text);
+
+  /************************************************************/
+  egg_test_title(test, "resume writes straight away");
+  g_main_context_iteration(NULL, FALSE);
+  g_file_get_contents(filename, &contents, NULL, NULL);
+  egg_test_assert(test, contents != NULL &&
+                            strstr(contents, "action=\"suspend\"} 1\n") !=
+                                NULL);
+  g_free(contents);
+
+  /************************************************************/
+  egg_test_title(test, "time to a usable screen is exported");
+  gpm_metrics_set_resume_usable(metrics, 0.25);
+  text = gpm_metrics_to_string(metrics);
+  samples = gpm_metrics_test_parse(text);
+  if (samples != NULL &&
+      gpm_metrics_test_get(samples, "mate_power_resume_usable_seconds") == 0.25)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "invalid output:\n%s", text);
+  if (samples != NULL) g_hash_table_unref(samples);
+  g_free(text);
+
+  /************************************************************/
+  egg_test_title(test, "main loop wakeups are counted");
+  wakeups = gpm_metrics_wakeups;
+  g_timeout_add(1, gpm_metrics_test_timeout_cb, NULL);
+  g_main_context_iteration(NULL, TRUE);
+  egg_test_assert(test, gpm_metrics_wakeups > wakeups);
+
+  /************************************************************/
+  egg_test_title(test, "a damaged file does not parse");
+  egg_test_assert(test, gpm_metrics_test_parse("mate_power_x 1\n# EOF\n") ==
+                                NULL &&
+                            gpm_metrics_test_parse("# TYPE a gauge\na 1\n") ==
+                                NULL);
+
+  g_object_unref(metrics);
+  g_unlink(filename);
+  g_rmdir(directory);
+  g_free(filename);
+  g_free(directory);
+
+  egg_test_end(test);
+}
+
+#endif
@@ -0,0 +1,87 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_METRICS_H
+#define __GPM_METRICS_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GPM_TYPE_METRICS (gpm_metrics_get_type())
+#define GPM_METRICS(o) \
+  (G_TYPE_CHECK_INSTANCE_CAST((o), GPM_TYPE_METRICS, GpmMetrics))
+#define GPM_METRICS_CLASS(k) \
+  (G_TYPE_CHECK_CLASS_CAST((k), GPM_TYPE_METRICS, GpmMetricsClass))
+#define GPM_IS_METRICS(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), GPM_TYPE_METRICS))
+#define GPM_IS_METRICS_CLASS(k) (G_TYPE_CHECK_CLASS_TYPE((k), GPM_TYPE_METRICS))
+#define GPM_METRICS_GET_CLASS(o) \
+  (G_TYPE_INSTANCE_GET_CLASS((o), GPM_TYPE_METRICS, GpmMetricsClass))
+
+typedef enum {
+  GPM_METRICS_GAUGE_BRIGHTNESS, /* percentage */
+  GPM_METRICS_GAUGE_DPMS,       /* GpmDpmsMode */
+  GPM_METRICS_GAUGE_IDLE,       /* GpmIdleMode */
+  GPM_METRICS_GAUGE_INHIBITORS, /* number of session inhibitors */
+  GPM_METRICS_GAUGE_LAST
+} GpmMetricsGauge;
+
+typedef struct {
+  const gchar *id;   /* e.g. "battery_BAT0" */
+  const gchar *kind; /* e.g. "battery" */
+  gdouble percentage;
+  gdouble energy;             /* Wh */
+  gdouble energy_full;        /* Wh */
+  gdouble energy_full_design; /* Wh, or zero if unknown */
+  gdouble energy_rate;        /* W */
+} GpmMetricsDevice;
+
+typedef struct GpmMetricsPrivate GpmMetricsPrivate;
+
+typedef struct {
+  GObject parent;
+  GpmMetricsPrivate *priv;
+} GpmMetrics;
+
+typedef struct {
+  GObjectClass parent_class;
+} GpmMetricsClass;
+
+GType gpm_metrics_get_type(void);
+GpmMetrics *gpm_metrics_new(void);
+void gpm_metrics_set_filename(GpmMetrics *metrics, const gchar *filename);
+void gpm_metrics_set_gauge(GpmMetrics *metrics, GpmMetricsGauge gauge,
+                           guint value);
+void gpm_metrics_set_devices(GpmMetrics *metrics,
+                             const GpmMetricsDevice *devices, guint length);
+void gpm_metrics_add_sleep(GpmMetrics *metrics, guint action);
+void gpm_metrics_add_resume(GpmMetrics *metrics, guint action);
+void gpm_metrics_add_dim_avoided(GpmMetrics *metrics);
+void gpm_metrics_set_resume_usable(GpmMetrics *metrics, gdouble seconds);
+gchar *gpm_metrics_to_string(GpmMetrics *metrics);
+gboolean gpm_metrics_write(GpmMetrics *metrics, GError **error);
+#ifdef EGG_TEST
+void gpm_metrics_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_METRICS_H */
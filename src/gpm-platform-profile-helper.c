@@ -0,0 +1,88 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <locale.h>
+
+#include "gpm-helper.h"
+#include "gpm-platform-profile.h"
+
+/**
+ * main:
+ **/
+gint main(gint argc, gchar *argv[]) {
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar *profile = NULL;
+  gchar *filename = NULL;
+  gint retval = GPM_HELPER_EXIT_CODE_SUCCESS;
+
+  const GOptionEntry options[] = {
+      {"set-profile", '\0', 0, G_OPTION_ARG_STRING, &profile,
+       /* command line argument */
+       _("Set the platform profile"), NULL},
+      {"file", '\0', 0, G_OPTION_ARG_FILENAME, &filename,
+       /* command line argument */
+       _("Use a copy of the platform profile file, for testing"), NULL},
+      {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
+
+  /* setup translations */
+  setlocale(LC_ALL, "");
+  bindtextdomain(GETTEXT_PACKAGE, MATELOCALEDIR);
+  bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
+  textdomain(GETTEXT_PACKAGE);
+
+  context = g_option_context_new(NULL);
+  g_option_context_set_summary(context,
+                               _("MATE Power Manager Platform Profile Helper"));
+  g_option_context_add_main_entries(context, options, NULL);
+  g_option_context_parse(context, &argc, &argv, NULL);
+  g_option_context_free(context);
+
+  /* no input */
+  if (profile == NULL) {
+    /* TRANSLATORS: user did not specify valid options */
+    g_print("%s\n", _("No valid option was specified"));
+    retval = GPM_HELPER_EXIT_CODE_ARGUMENTS_INVALID;
+    goto out;
+  }
+
+  retval = gpm_helper_check_caller(filename != NULL);
+  if (retval != GPM_HELPER_EXIT_CODE_SUCCESS) goto out;
+  if (filename == NULL) filename = g_strdup(GPM_PLATFORM_PROFILE_FILE);
+
+  if (!gpm_platform_profile_set(filename, profile, &error)) {
+    /* TRANSLATORS: failed to change the platform profile */
+    g_print("%s: %s\n", _("Could not set the platform profile"),
+            error->message);
+    g_error_free(error);
+    retval = GPM_HELPER_EXIT_CODE_FAILED;
+  }
+out:
+  g_free(profile);
+  g_free(filename);
+  return retval;
+}
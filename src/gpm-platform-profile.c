@@ -0,0 +1,265 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gpm-platform-profile.h"
+
+/* the platform profiles that stand for each power profile, best first */
+static const struct {
+  const gchar *power_profile;
+  const gchar *profiles[4];
+} gpm_platform_profiles[] = {
+    {"power-saver", {"low-power", "quiet", "cool", NULL}},
+    {"balanced", {"balanced", NULL}},
+    {"performance", {"performance", "balanced-performance", "max-power", NULL}},
+};
+
+/**
+ * gpm_platform_profile_read:
+ *
+ * Return value: the first line of @filename, or %NULL
+ **/
+static gchar *gpm_platform_profile_read(const gchar *filename) {
+  gchar *contents = NULL;
+
+  if (!g_file_get_contents(filename, &contents, NULL, NULL)) return NULL;
+  return g_strstrip(contents);
+}
+
+/**
+ * gpm_platform_profile_get:
+ * @filename: %GPM_PLATFORM_PROFILE_FILE, or a copy of it
+ *
+ * Return value: the profile, or %NULL if the firmware has none
+ **/
+gchar *gpm_platform_profile_get(const gchar *filename) {
+  g_return_val_if_fail(filename != NULL, NULL);
+  return gpm_platform_profile_read(filename);
+}
+
+/**
+ * gpm_platform_profile_get_choices:
+ * @filename: %GPM_PLATFORM_PROFILE_FILE, or a copy of it
+ *
+ * Return value: the profiles the firmware offers, or %NULL if it has none
+ **/
+gchar **gpm_platform_profile_get_choices(const gchar *filename) {
+  gchar *choices_filename;
+  gchar *contents;
+  gchar **choices;
+
+  g_return_val_if_fail(filename != NULL, NULL);
+
+  choices_filename = g_strdup_printf("%s_choices", filename);
+  contents = gpm_platform_profile_read(choices_filename);
+  g_free(choices_filename);
+  if (contents == NULL) return NULL;
+  choices = g_strsplit_set(contents, " \t\n", -1);
+  g_free(contents);
+  return choices;
+}
+
+/**
+ * gpm_platform_profile_set:
+ * @filename: %GPM_PLATFORM_PROFILE_FILE, or a copy of it
+ * @profile: One of the choices the firmware offers
+ *
+ * The attribute is written in place, as sysfs does not allow the rename
+ * that g_file_set_contents() does.
+ *
+ * Return value: %TRUE for success
+ **/
+gboolean gpm_platform_profile_set(const gchar *filename, const gchar *profile,
+                                  GError **error) {
+  gchar **choices;
+  gboolean ret;
+  gssize len;
+  gint saved_errno;
+  gint fd;
+
+  g_return_val_if_fail(filename != NULL, FALSE);
+  g_return_val_if_fail(profile != NULL, FALSE);
+
+  choices = gpm_platform_profile_get_choices(filename);
+  ret = choices != NULL &&
+        g_strv_contains((const gchar *const *)choices, profile);
+  g_strfreev(choices);
+  if (!ret) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "the platform does not offer the %s profile", profile);
+    return FALSE;
+  }
+
+  len = strlen(profile);
+  fd = g_open(filename, O_WRONLY | O_TRUNC | O_CLOEXEC, 0);
+  if (fd >= 0 && write(fd, profile, len) == len) {
+    close(fd);
+    return TRUE;
+  }
+  saved_errno = errno;
+  if (fd >= 0) close(fd);
+  g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+              "failed to write %s to %s: %s", profile, filename,
+              g_strerror(saved_errno));
+  return FALSE;
+}
+
+/**
+ * gpm_platform_profile_from_power_profile:
+ * @power_profile: "power-saver", "balanced" or "performance"
+ * @choices: What gpm_platform_profile_get_choices() returned
+ *
+ * Return value: the profile the firmware offers for @power_profile, or
+ *               %NULL if it has none
+ **/
+const gchar *gpm_platform_profile_from_power_profile(const gchar *power_profile,
+                                                     gchar **choices) {
+  guint i;
+  guint j;
+
+  if (choices == NULL) return NULL;
+  for (i = 0; i < G_N_ELEMENTS(gpm_platform_profiles); i++) {
+    if (g_strcmp0(power_profile, gpm_platform_profiles[i].power_profile) != 0)
+      continue;
+    for (j = 0; gpm_platform_profiles[i].profiles[j] != NULL; j++) {
+      if (g_strv_contains((const gchar *const *)choices,
+                          gpm_platform_profiles[i].profiles[j]))
+        return gpm_platform_profiles[i].profiles[j];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * gpm_platform_profile_to_power_profile:
+ *
+ * Return value: "power-saver", "balanced" or "performance", or %NULL if
+ *               @profile is none of them, such as "custom"
+ **/
+const gchar *gpm_platform_profile_to_power_profile(const gchar *profile) {
+  guint i;
+
+  if (profile == NULL) return NULL;
+  for (i = 0; i < G_N_ELEMENTS(gpm_platform_profiles); i++) {
+    if (g_strv_contains(gpm_platform_profiles[i].profiles, profile))
+      return gpm_platform_profiles[i].power_profile;
+  }
+  return NULL;
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+void gpm_platform_profile_test(gpointer data) {
+  gchar *dirname;
+  gchar *filename;
+  gchar *choices_filename;
+  gchar **choices;
+  gchar *value;
+  gboolean ret;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmPlatformProfile")) return;
+
+  /* a laptop with the three usual profiles */
+  dirname = g_dir_make_tmp("gpm-platform-profile-XXXXXX", NULL);
+  filename = g_build_filename(dirname, "platform_profile", NULL);
+  choices_filename = g_strdup_printf("%s_choices", filename);
+  g_file_set_contents(filename, "balanced\n", -1, NULL);
+  g_file_set_contents(choices_filename, "low-power balanced performance\n",
+                      -1, NULL);
+
+  /************************************************************/
+  egg_test_title(test, "the profile is read without the newline");
+  value = gpm_platform_profile_get(filename);
+  egg_test_assert(test, g_strcmp0(value, "balanced") == 0);
+  g_free(value);
+
+  /************************************************************/
+  egg_test_title(test, "an offered profile is written");
+  ret = gpm_platform_profile_set(filename, "low-power", NULL);
+  value = gpm_platform_profile_get(filename);
+  egg_test_assert(test, ret && g_strcmp0(value, "low-power") == 0);
+  g_free(value);
+
+  /************************************************************/
+  egg_test_title(test, "a profile that is not offered is not written");
+  ret = gpm_platform_profile_set(filename, "quiet", NULL);
+  value = gpm_platform_profile_get(filename);
+  egg_test_assert(test, !ret && g_strcmp0(value, "low-power") == 0);
+  g_free(value);
+
+  /************************************************************/
+  egg_test_title(test, "power-saver is the first low profile offered");
+  g_file_set_contents(choices_filename, "cool quiet balanced performance\n",
+                      -1, NULL);
+  choices = gpm_platform_profile_get_choices(filename);
+  egg_test_assert(test, g_strcmp0(gpm_platform_profile_from_power_profile(
+                                      "power-saver", choices),
+                                  "quiet") == 0);
+
+  /************************************************************/
+  egg_test_title(test, "a profile missing from the firmware is not mapped");
+  g_strfreev(choices);
+  g_file_set_contents(choices_filename, "low-power balanced\n", -1, NULL);
+  choices = gpm_platform_profile_get_choices(filename);
+  egg_test_assert(test, gpm_platform_profile_from_power_profile(
+                            "performance", choices) == NULL);
+  g_strfreev(choices);
+
+  /************************************************************/
+  egg_test_title(test, "a custom profile is no power profile");
+  egg_test_assert(test, gpm_platform_profile_to_power_profile("custom") ==
+                                NULL &&
+                            g_strcmp0(gpm_platform_profile_to_power_profile(
+                                          "balanced-performance"),
+                                      "performance") == 0);
+
+  /************************************************************/
+  egg_test_title(test, "a machine without the firmware has no choices");
+  g_unlink(choices_filename);
+  choices = gpm_platform_profile_get_choices(filename);
+  ret = gpm_platform_profile_set(filename, "balanced", NULL);
+  egg_test_assert(test, choices == NULL && !ret);
+
+  g_unlink(filename);
+  g_rmdir(dirname);
+  g_free(choices_filename);
+  g_free(filename);
+  g_free(dirname);
+
+  egg_test_end(test);
+}
+
+#endif
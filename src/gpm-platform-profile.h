@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_PLATFORM_PROFILE_H
+#define __GPM_PLATFORM_PROFILE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* the tests and mate-power-platform-profile-helper --file use a copy */
+#define GPM_PLATFORM_PROFILE_FILE "/sys/firmware/acpi/platform_profile"
+
+gchar *gpm_platform_profile_get(const gchar *filename);
+gchar **gpm_platform_profile_get_choices(const gchar *filename);
+gboolean gpm_platform_profile_set(const gchar *filename, const gchar *profile,
+                                  GError **error);
+const gchar *gpm_platform_profile_from_power_profile(const gchar *power_profile,
+                                                     gchar **choices);
+const gchar *gpm_platform_profile_to_power_profile(const gchar *profile);
+#ifdef EGG_TEST
+void gpm_platform_profile_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_PLATFORM_PROFILE_H */
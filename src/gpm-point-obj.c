@@ -22,6 +22,9 @@
 #include "gpm-point-obj.h"
 
 #include <glib.h>
+#include <math.h>
+
+#include "egg-array-float.h"
 
 /**
  * gpm_point_obj_copy:
@@ -54,3 +57,294 @@ void gpm_point_obj_free(GpmPointObj *obj) {
   if (obj == NULL) return;
   g_free(obj);
 }
+
+/**
+ * gpm_point_obj_array_bisect:
+ * @array: An array of GpmPointObj's sorted by x
+ * @start: The first index to consider
+ * @x: The x value to look for
+ *
+ * Return value: the index of the first point at or after @x, or the
+ * length of the array if every point is before @x
+ **/
+guint gpm_point_obj_array_bisect(GPtrArray *array, guint start, gfloat x) {
+  const GpmPointObj *point;
+  guint low = start;
+  guint high = array->len;
+  guint mid;
+
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    point = g_ptr_array_index(array, mid);
+    if (point->x < x)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+/**
+ * gpm_point_obj_array_find_nearest:
+ * @array: An array of GpmPointObj's sorted by x
+ * @start: The first index to consider
+ * @x: The x value to look near
+ * @y: The y value to look near
+ * @width: How far from the nearest x a point with a closer y can be, which
+ *         is normally the width of one pixel
+ * @index: The returned index of the point
+ *
+ * Finds the point closest to @x, and then the point closest to @y of
+ * those that would be drawn in about the same place.
+ *
+ * Return value: %FALSE if there are no points to choose from
+ **/
+gboolean gpm_point_obj_array_find_nearest(GPtrArray *array, guint start,
+                                          gfloat x, gfloat y, gfloat width,
+                                          guint *index) {
+  const GpmPointObj *point;
+  gfloat best;
+  gfloat nearest_x;
+  guint i;
+
+  g_return_val_if_fail(array != NULL, FALSE);
+  g_return_val_if_fail(index != NULL, FALSE);
+
+  if (start >= array->len) return FALSE;
+
+  /* the nearest x is either side of where x would go */
+  i = gpm_point_obj_array_bisect(array, start, x);
+  if (i == array->len) {
+    i--;
+  } else if (i > start) {
+    point = g_ptr_array_index(array, i);
+    nearest_x = point->x;
+    point = g_ptr_array_index(array, i - 1);
+    if (x - point->x <= nearest_x - x) i--;
+  }
+  point = g_ptr_array_index(array, i);
+  nearest_x = point->x;
+
+  /* then the closest y within the bucket around it */
+  *index = i;
+  best = fabsf(point->y - y);
+  i = gpm_point_obj_array_bisect(array, start, nearest_x - width);
+  for (; i < array->len; i++) {
+    point = g_ptr_array_index(array, i);
+    if (point->x > nearest_x + width) break;
+    if (fabsf(point->y - y) < best) {
+      best = fabsf(point->y - y);
+      *index = i;
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * gpm_point_obj_array_smooth:
+ * @array: The points to smooth
+ * @sigma: The width of the gaussian to convolve with
+ *
+ * Removes any outliers from the y values and then convolves them with a
+ * gaussian, keeping the x values and colors of the original points.
+ *
+ * Return value: a new array of points, free with g_ptr_array_unref()
+ **/
+GPtrArray *gpm_point_obj_array_smooth(GPtrArray *array, gfloat sigma) {
+  guint i;
+  GpmPointObj *point;
+  GpmPointObj *point_new;
+  GPtrArray *new;
+  EggArrayFloat *raw;
+  EggArrayFloat *convolved;
+  EggArrayFloat *outliers;
+  EggArrayFloat *gaussian = NULL;
+
+  g_return_val_if_fail(array != NULL, NULL);
+
+  /* convert the y data to a EggArrayFloat array */
+  raw = egg_array_float_new(array->len);
+  for (i = 0; i < array->len; i++) {
+    point = (GpmPointObj *)g_ptr_array_index(array, i);
+    egg_array_float_set(raw, i, point->y);
+  }
+
+  /* remove any outliers */
+  outliers = egg_array_float_remove_outliers(raw, 3, 0.1);
+
+  /* convolve with gaussian */
+  gaussian = egg_array_float_compute_gaussian(15, sigma);
+  convolved = egg_array_float_convolve(outliers, gaussian);
+
+  /* add the smoothed data back into a new array */
+  new = g_ptr_array_new_with_free_func((GDestroyNotify)gpm_point_obj_free);
+  for (i = 0; i < array->len; i++) {
+    point = (GpmPointObj *)g_ptr_array_index(array, i);
+    point_new = g_new0(GpmPointObj, 1);
+    point_new->color = point->color;
+    point_new->x = point->x;
+    point_new->y = egg_array_float_get(convolved, i);
+    g_ptr_array_add(new, point_new);
+  }
+
+  /* free data */
+  egg_array_float_free(gaussian);
+  egg_array_float_free(raw);
+  egg_array_float_free(convolved);
+  egg_array_float_free(outliers);
+
+  return new;
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+/**
+ * gpm_point_obj_test_array_new:
+ **/
+static GPtrArray *gpm_point_obj_test_array_new(guint length) {
+  GpmPointObj *point;
+  GPtrArray *array;
+  guint i;
+
+  array = g_ptr_array_new_with_free_func((GDestroyNotify)gpm_point_obj_free);
+  for (i = 0; i < length; i++) {
+    point = gpm_point_obj_new();
+    point->x = i * 10;
+    point->y = i % 100;
+    g_ptr_array_add(array, point);
+  }
+  return array;
+}
+
+void gpm_point_obj_test(gpointer data) {
+  GpmPointObj *point;
+  GPtrArray *array;
+  GPtrArray *smoothed;
+  gboolean ret;
+  guint elapsed;
+  guint index;
+  guint length;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmPointObj")) return;
+
+  array = gpm_point_obj_test_array_new(100);
+
+  /************************************************************/
+  egg_test_title(test, "bisect to an exact point");
+  index = gpm_point_obj_array_bisect(array, 0, 250);
+  if (index == 25)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %i", index);
+
+  /************************************************************/
+  egg_test_title(test, "bisect past either end");
+  if (gpm_point_obj_array_bisect(array, 0, -5) == 0 &&
+      gpm_point_obj_array_bisect(array, 0, 5000) == 100)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "bisect out of range");
+
+  /************************************************************/
+  egg_test_title(test, "find nearest x");
+  ret = gpm_point_obj_array_find_nearest(array, 0, 246, 0, 0, &index);
+  if (ret && index == 25)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %i", index);
+
+  /************************************************************/
+  egg_test_title(test, "find nearest outside the data");
+  ret = gpm_point_obj_array_find_nearest(array, 0, 99999, 0, 0, &index);
+  if (ret && index == 99)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %i", index);
+
+  /************************************************************/
+  egg_test_title(test, "ignore points before the start");
+  ret = gpm_point_obj_array_find_nearest(array, 50, 10, 0, 0, &index);
+  if (ret && index == 50)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %i", index);
+
+  /************************************************************/
+  egg_test_title(test, "refine on y within the bucket");
+  ret = gpm_point_obj_array_find_nearest(array, 0, 500, 48, 20, &index);
+  if (ret && index == 48)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %i", index);
+
+  /************************************************************/
+  egg_test_title(test, "no points to find");
+  ret = gpm_point_obj_array_find_nearest(array, 100, 500, 48, 20, &index);
+  egg_test_assert(test, !ret);
+
+  g_ptr_array_unref(array);
+
+  /************************************************************/
+  egg_test_title(test, "smooth a flat line");
+  array = gpm_point_obj_test_array_new(100);
+  for (i = 0; i < array->len; i++) {
+    point = g_ptr_array_index(array, i);
+    point->y = 50.0f;
+    point->color = i;
+  }
+  smoothed = gpm_point_obj_array_smooth(array, 2.0f);
+  ret = (smoothed->len == array->len);
+  for (i = 0; ret && i < smoothed->len; i++) {
+    point = g_ptr_array_index(smoothed, i);
+    if (point->x != i * 10 || point->color != i ||
+        fabsf(point->y - 50.0f) > 0.01f)
+      ret = FALSE;
+  }
+  if (ret)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %f at %i", point->y, i);
+  g_ptr_array_unref(smoothed);
+
+  /************************************************************/
+  egg_test_title(test, "smooth away a spike");
+  point = g_ptr_array_index(array, 50);
+  point->y = 100.0f;
+  smoothed = gpm_point_obj_array_smooth(array, 2.0f);
+  point = g_ptr_array_index(smoothed, 50);
+  if (point->y < 60.0f)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %f", point->y);
+  g_ptr_array_unref(smoothed);
+  g_ptr_array_unref(array);
+
+  /************************************************************/
+  for (length = 1000; length <= 1000000; length *= 10) {
+    array = gpm_point_obj_test_array_new(length);
+    point = g_ptr_array_index(array, length - 1);
+    egg_test_title(test, "find nearest 10000 times in %i points", length);
+    ret = TRUE;
+    for (i = 0; i < 10000; i++) {
+      if (!gpm_point_obj_array_find_nearest(
+              array, 0, (i * 7919) % (guint)point->x, 50, 10, &index))
+        ret = FALSE;
+    }
+    elapsed = egg_test_elapsed(test);
+    if (ret)
+      egg_test_success(test, "%ims", elapsed);
+    else
+      egg_test_failed(test, "a point was not found");
+    g_ptr_array_unref(array);
+  }
+
+  egg_test_end(test);
+}
+
+#endif
@@ -35,6 +35,14 @@ typedef struct {
 GpmPointObj *gpm_point_obj_new(void);
 GpmPointObj *gpm_point_obj_copy(const GpmPointObj *cobj);
 void gpm_point_obj_free(GpmPointObj *obj);
+guint gpm_point_obj_array_bisect(GPtrArray *array, guint start, gfloat x);
+gboolean gpm_point_obj_array_find_nearest(GPtrArray *array, guint start,
+                                          gfloat x, gfloat y, gfloat width,
+                                          guint *index);
+GPtrArray *gpm_point_obj_array_smooth(GPtrArray *array, gfloat sigma);
+#ifdef EGG_TEST
+void gpm_point_obj_test(gpointer data);
+#endif
 
 G_END_DECLS
 
@@ -0,0 +1,361 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gpm-policy.h"
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "gpm-common.h"
+
+/**
+ * gpm_policy_hold_free:
+ **/
+static void gpm_policy_hold_free(GpmPolicyHold *hold) {
+  if (hold->watch_id != 0) g_bus_unwatch_name(hold->watch_id);
+  g_free(hold->profile);
+  g_free(hold->reason);
+  g_free(hold->application_id);
+  g_free(hold->sender);
+  g_free(hold);
+}
+
+/**
+ * gpm_policy_holds_init:
+ * @vanished: Called with the cookie when the program holding it goes away
+ **/
+void gpm_policy_holds_init(GpmPolicyHolds *holds,
+                           GpmPolicyVanishedFunc vanished,
+                           gpointer user_data) {
+  holds->table =
+      g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                            (GDestroyNotify)gpm_policy_hold_free);
+  holds->cookie_next = 0;
+  holds->vanished = vanished;
+  holds->user_data = user_data;
+}
+
+/**
+ * gpm_policy_holds_name_vanished_cb:
+ *
+ * A program that exits or crashes does not keep its hold.
+ **/
+static void gpm_policy_holds_name_vanished_cb(GDBusConnection *connection,
+                                              const gchar *name,
+                                              GpmPolicyHold *hold) {
+  g_debug("%s went away holding %s for %s", name,
+          hold->profile != NULL ? hold->profile : "the policy", hold->reason);
+  hold->holds->vanished(hold->cookie, hold->holds->user_data);
+}
+
+/**
+ * gpm_policy_holds_add:
+ * @connection: The bus @sender is on, or %NULL for the session bus
+ * @sender: The unique bus name of the program, or %NULL
+ * @profile: What it holds, or %NULL
+ *
+ * Return value: the hold, which belongs to @holds
+ **/
+GpmPolicyHold *gpm_policy_holds_add(GpmPolicyHolds *holds,
+                                    GDBusConnection *connection,
+                                    const gchar *sender, const gchar *profile,
+                                    const gchar *reason,
+                                    const gchar *application_id) {
+  GpmPolicyHold *hold;
+
+  hold = g_new0(GpmPolicyHold, 1);
+  hold->holds = holds;
+  hold->cookie = ++holds->cookie_next;
+  hold->profile = g_strdup(profile);
+  hold->reason = g_strdup(reason);
+  hold->application_id = g_strdup(application_id);
+  hold->sender = g_strdup(sender);
+  if (sender != NULL && connection != NULL) {
+    hold->watch_id = g_bus_watch_name_on_connection(
+        connection, sender, G_BUS_NAME_WATCHER_FLAGS_NONE, NULL,
+        (GBusNameVanishedCallback)gpm_policy_holds_name_vanished_cb, hold,
+        NULL);
+  } else if (sender != NULL) {
+    hold->watch_id = g_bus_watch_name(
+        G_BUS_TYPE_SESSION, sender, G_BUS_NAME_WATCHER_FLAGS_NONE, NULL,
+        (GBusNameVanishedCallback)gpm_policy_holds_name_vanished_cb, hold,
+        NULL);
+  }
+  g_hash_table_insert(holds->table, GUINT_TO_POINTER(hold->cookie), hold);
+  return hold;
+}
+
+/**
+ * gpm_policy_holds_lookup:
+ *
+ * Return value: the hold, or %NULL if there is no such cookie
+ **/
+GpmPolicyHold *gpm_policy_holds_lookup(GpmPolicyHolds *holds, guint cookie) {
+  return g_hash_table_lookup(holds->table, GUINT_TO_POINTER(cookie));
+}
+
+/**
+ * gpm_policy_holds_remove:
+ *
+ * Return value: %FALSE if there was no such hold
+ **/
+gboolean gpm_policy_holds_remove(GpmPolicyHolds *holds, guint cookie) {
+  return g_hash_table_remove(holds->table, GUINT_TO_POINTER(cookie));
+}
+
+/**
+ * gpm_policy_holds_size:
+ **/
+guint gpm_policy_holds_size(GpmPolicyHolds *holds) {
+  return g_hash_table_size(holds->table);
+}
+
+/**
+ * gpm_policy_holds_clear:
+ *
+ * Drops every hold without telling anyone, when the policy goes away.
+ **/
+void gpm_policy_holds_clear(GpmPolicyHolds *holds) {
+  g_clear_pointer(&holds->table, g_hash_table_unref);
+}
+
+/**
+ * gpm_policy_helper_session_changed_cb:
+ *
+ * Another session may have changed things while this one was in the
+ * background, so it starts again from what is there.
+ **/
+static void gpm_policy_helper_session_changed_cb(GDBusProxy *session,
+                                                 GVariant *changed,
+                                                 GStrv invalidated,
+                                                 GpmPolicyHelper *helper) {
+  gboolean active;
+
+  if (!g_variant_lookup(changed, "Active", "b", &active) || !active) return;
+  g_debug("the session is active again, checking the policy");
+  helper->failed(helper->user_data);
+  helper->evaluate(helper->user_data);
+}
+
+/**
+ * gpm_policy_helper_get_session:
+ *
+ * Return value: a proxy for the logind session we are in, or %NULL
+ **/
+static GDBusProxy *gpm_policy_helper_get_session(void) {
+  GDBusConnection *connection;
+  GDBusProxy *session = NULL;
+  GVariant *reply;
+  const gchar *id;
+  const gchar *path;
+
+  if (!LOGIND_RUNNING()) return NULL;
+  connection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL);
+  if (connection == NULL) return NULL;
+  id = g_getenv("XDG_SESSION_ID");
+  reply = g_dbus_connection_call_sync(
+      connection, "org.freedesktop.login1", "/org/freedesktop/login1",
+      "org.freedesktop.login1.Manager", "GetSession",
+      g_variant_new("(s)", id != NULL ? id : "auto"), G_VARIANT_TYPE("(o)"),
+      G_DBUS_CALL_FLAGS_NONE, 1000, NULL, NULL);
+  if (reply != NULL) {
+    g_variant_get(reply, "(&o)", &path);
+    session = g_dbus_proxy_new_sync(
+        connection, G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS, NULL,
+        "org.freedesktop.login1", path, "org.freedesktop.login1.Session",
+        NULL, NULL);
+    g_variant_unref(reply);
+  }
+  g_object_unref(connection);
+  return session;
+}
+
+/**
+ * gpm_policy_helper_init:
+ * @program: The helper in SBINDIR
+ * @env: What names a stand-in for @program when testing
+ * @evaluate: Called if the policy changed while the helper was running, or
+ * the session became active
+ * @failed: Called when the helper fails, or the session became active
+ **/
+void gpm_policy_helper_init(GpmPolicyHelper *helper, const gchar *program,
+                            const gchar *env, GpmPolicyHelperFunc evaluate,
+                            GpmPolicyHelperFunc failed, gpointer user_data) {
+  helper->program = program;
+  helper->env = env;
+  helper->process = NULL;
+  helper->pending = FALSE;
+  helper->cancellable = g_cancellable_new();
+  helper->evaluate = evaluate;
+  helper->failed = failed;
+  helper->user_data = user_data;
+  helper->session = gpm_policy_helper_get_session();
+  if (helper->session != NULL)
+    g_signal_connect(helper->session, "g-properties-changed",
+                     G_CALLBACK(gpm_policy_helper_session_changed_cb),
+                     helper);
+}
+
+/**
+ * gpm_policy_helper_get_argv:
+ *
+ * When built with --enable-test-hooks, the test harness can swap the helper
+ * for a stand-in named by the environment, which is then run without
+ * pkexec.
+ *
+ * Return value: the command line to add the arguments to
+ **/
+GPtrArray *gpm_policy_helper_get_argv(GpmPolicyHelper *helper) {
+  GPtrArray *argv;
+
+  argv = g_ptr_array_new_with_free_func(g_free);
+#if defined(EGG_TEST) || defined(GPM_TEST_HOOKS)
+  if (g_getenv(helper->env) != NULL) {
+    g_ptr_array_add(argv, g_strdup(g_getenv(helper->env)));
+    return argv;
+  }
+#endif
+  g_ptr_array_add(argv, g_strdup("pkexec"));
+  g_ptr_array_add(argv, g_build_filename(SBINDIR, helper->program, NULL));
+  return argv;
+}
+
+/**
+ * gpm_policy_helper_is_active:
+ *
+ * A session in the background must not change what the active one has,
+ * and pkexec would not let it without asking anyway. Without logind there
+ * is no other session to be in the way of.
+ *
+ * Return value: %TRUE if the helper may be run for this session
+ **/
+gboolean gpm_policy_helper_is_active(GpmPolicyHelper *helper) {
+  GVariant *value;
+  gboolean active = FALSE;
+
+  if (helper->session == NULL) return TRUE;
+  value = g_dbus_proxy_get_cached_property(helper->session, "Active");
+  if (value == NULL) return FALSE;
+  if (g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN))
+    active = g_variant_get_boolean(value);
+  g_variant_unref(value);
+  return active;
+}
+
+/**
+ * gpm_policy_helper_is_busy:
+ *
+ * Return value: %TRUE if a helper is still running, in which case the
+ * policy is evaluated again once it is done
+ **/
+gboolean gpm_policy_helper_is_busy(GpmPolicyHelper *helper) {
+  helper->pending = helper->process != NULL;
+  return helper->pending;
+}
+
+/**
+ * gpm_policy_helper_done_cb:
+ **/
+static void gpm_policy_helper_done_cb(GSubprocess *process, GAsyncResult *res,
+                                      GpmPolicyHelper *helper) {
+  GError *error = NULL;
+
+  if (!g_subprocess_wait_check_finish(process, res, &error)) {
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_error_free(error);
+      return;
+    }
+    g_warning("%s failed: %s", helper->program, error->message);
+    g_error_free(error);
+    helper->failed(helper->user_data);
+  }
+  g_clear_object(&helper->process);
+  if (helper->pending) helper->evaluate(helper->user_data);
+}
+
+/**
+ * gpm_policy_helper_run:
+ * @argv: From gpm_policy_helper_get_argv(), with the arguments added
+ **/
+void gpm_policy_helper_run(GpmPolicyHelper *helper, GPtrArray *argv) {
+  GError *error = NULL;
+
+  g_return_if_fail(helper->process == NULL);
+
+  g_ptr_array_add(argv, NULL);
+  helper->process = g_subprocess_newv((const gchar *const *)argv->pdata,
+                                      G_SUBPROCESS_FLAGS_NONE, &error);
+  if (helper->process == NULL) {
+    g_warning("failed to run %s: %s", helper->program, error->message);
+    g_error_free(error);
+    return;
+  }
+  g_subprocess_wait_check_async(
+      helper->process, helper->cancellable,
+      (GAsyncReadyCallback)gpm_policy_helper_done_cb, helper);
+}
+
+/**
+ * gpm_policy_helper_run_sync:
+ * @argv: From gpm_policy_helper_get_argv(), with the arguments added
+ *
+ * Waits for any helper that is still running, so that this one has the
+ * last word, and then for this one. Nothing else is run afterwards.
+ *
+ * Return value: %TRUE if the helper succeeded
+ **/
+gboolean gpm_policy_helper_run_sync(GpmPolicyHelper *helper, GPtrArray *argv,
+                                    GError **error) {
+  GSubprocess *process;
+  gboolean ret;
+
+  g_cancellable_cancel(helper->cancellable);
+  if (helper->process != NULL) {
+    g_subprocess_wait(helper->process, NULL, NULL);
+    g_clear_object(&helper->process);
+  }
+  g_ptr_array_add(argv, NULL);
+  process = g_subprocess_newv((const gchar *const *)argv->pdata,
+                              G_SUBPROCESS_FLAGS_NONE, error);
+  if (process == NULL) return FALSE;
+  ret = g_subprocess_wait_check(process, NULL, error);
+  g_object_unref(process);
+  return ret;
+}
+
+/**
+ * gpm_policy_helper_clear:
+ *
+ * Stops waiting for the helper, which is left to finish on its own.
+ **/
+void gpm_policy_helper_clear(GpmPolicyHelper *helper) {
+  if (helper->cancellable == NULL) return;
+  g_cancellable_cancel(helper->cancellable);
+  g_clear_object(&helper->cancellable);
+  g_clear_object(&helper->process);
+  if (helper->session != NULL)
+    g_signal_handlers_disconnect_by_data(helper->session, helper);
+  g_clear_object(&helper->session);
+}
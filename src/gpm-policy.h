@@ -0,0 +1,93 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_POLICY_H
+#define __GPM_POLICY_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct GpmPolicyHolds GpmPolicyHolds;
+
+/* a program keeping a policy in force until it lets go or leaves the bus */
+typedef struct {
+  GpmPolicyHolds *holds;
+  guint cookie;
+  gchar *profile; /* what is held, or NULL if there is only one choice */
+  gchar *reason;
+  gchar *application_id;
+  gchar *sender; /* the unique bus name, or NULL */
+  guint watch_id;
+} GpmPolicyHold;
+
+typedef void (*GpmPolicyVanishedFunc)(guint cookie, gpointer user_data);
+
+struct GpmPolicyHolds {
+  GHashTable *table; /* cookie → GpmPolicyHold */
+  guint cookie_next;
+  GpmPolicyVanishedFunc vanished;
+  gpointer user_data;
+};
+
+typedef void (*GpmPolicyHelperFunc)(gpointer user_data);
+
+/* runs a privileged helper, no more than one at a time so that they
+ * cannot finish out of order */
+typedef struct {
+  const gchar *program; /* in SBINDIR, run through pkexec */
+  const gchar *env;     /* names a stand-in, with --enable-test-hooks */
+  GSubprocess *process;
+  gboolean pending; /* the policy changed while the helper ran */
+  GCancellable *cancellable;
+  GDBusProxy *session;          /* the logind session, or NULL */
+  GpmPolicyHelperFunc evaluate; /* to catch up once the helper is done */
+  GpmPolicyHelperFunc failed;   /* to go with what is there instead */
+  gpointer user_data;
+} GpmPolicyHelper;
+
+void gpm_policy_holds_init(GpmPolicyHolds *holds,
+                           GpmPolicyVanishedFunc vanished,
+                           gpointer user_data);
+GpmPolicyHold *gpm_policy_holds_add(GpmPolicyHolds *holds,
+                                    GDBusConnection *connection,
+                                    const gchar *sender, const gchar *profile,
+                                    const gchar *reason,
+                                    const gchar *application_id);
+GpmPolicyHold *gpm_policy_holds_lookup(GpmPolicyHolds *holds, guint cookie);
+gboolean gpm_policy_holds_remove(GpmPolicyHolds *holds, guint cookie);
+guint gpm_policy_holds_size(GpmPolicyHolds *holds);
+void gpm_policy_holds_clear(GpmPolicyHolds *holds);
+
+void gpm_policy_helper_init(GpmPolicyHelper *helper, const gchar *program,
+                            const gchar *env, GpmPolicyHelperFunc evaluate,
+                            GpmPolicyHelperFunc failed, gpointer user_data);
+GPtrArray *gpm_policy_helper_get_argv(GpmPolicyHelper *helper);
+gboolean gpm_policy_helper_is_active(GpmPolicyHelper *helper);
+gboolean gpm_policy_helper_is_busy(GpmPolicyHelper *helper);
+void gpm_policy_helper_run(GpmPolicyHelper *helper, GPtrArray *argv);
+gboolean gpm_policy_helper_run_sync(GpmPolicyHelper *helper, GPtrArray *argv,
+                                    GError **error);
+void gpm_policy_helper_clear(GpmPolicyHelper *helper);
+
+G_END_DECLS
+
+#endif /* __GPM_POLICY_H */
@@ -0,0 +1,898 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gpm-power-profiles.h"
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gpm-common.h"
+#include "gpm-platform-profile.h"
+#include "gpm-policy.h"
+
+/* the same members as net.hadess.PowerProfiles, so that panel widgets
+ * written for power-profiles-daemon only need another name to talk to us */
+static const gchar gpm_power_profiles_introspection[] =
+    "<node>"
+    "<interface name='" GPM_DBUS_INTERFACE_POWER_PROFILES "'>"
+    "<method name='HoldProfile'>"
+    "<arg name='profile' type='s' direction='in'/>"
+    "<arg name='reason' type='s' direction='in'/>"
+    "<arg name='application_id' type='s' direction='in'/>"
+    "<arg name='cookie' type='u' direction='out'/></method>"
+    "<method name='ReleaseProfile'>"
+    "<arg name='cookie' type='u' direction='in'/></method>"
+    "<signal name='ProfileReleased'><arg name='cookie' type='u'/></signal>"
+    "<property name='ActiveProfile' type='s' access='readwrite'/>"
+    "<property name='PerformanceInhibited' type='s' access='read'/>"
+    "<property name='PerformanceDegraded' type='s' access='read'/>"
+    "<property name='Profiles' type='aa{sv}' access='read'/>"
+    "<property name='Actions' type='as' access='read'/>"
+    "<property name='ActiveProfileHolds' type='aa{sv}' access='read'/>"
+    "<property name='Version' type='s' access='read'/>"
+    "</interface>"
+    "</node>";
+
+static const gchar *gpm_power_profiles_names[] = {"power-saver", "balanced",
+                                                  "performance"};
+
+/* the system services that set the platform profile themselves */
+static const gchar *gpm_power_profiles_daemons[] = {
+    "net.hadess.PowerProfiles", "org.freedesktop.UPower.PowerProfiles",
+    NULL};
+
+struct GpmPowerProfilesPrivate {
+  GSettings *settings;
+  gchar *filename;
+  gchar **choices;
+  gchar *original; /* NULL if the firmware has no platform profile */
+  gchar *applied;
+  gboolean on_battery;
+  gboolean idle;
+  GpmPolicyHolds holds; /* of "power-saver" or "performance" */
+  GpmPolicyHelper helper;
+  GDBusNodeInfo *introspection;
+  GDBusConnection *connection;
+  guint owner_id;
+  guint registration_id;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE(GpmPowerProfiles, gpm_power_profiles,
+                           G_TYPE_OBJECT)
+
+/**
+ * gpm_power_profiles_is_offered:
+ *
+ * Return value: %TRUE if the firmware has a profile for @power_profile
+ **/
+static gboolean gpm_power_profiles_is_offered(GpmPowerProfiles *profiles,
+                                              const gchar *power_profile) {
+  return gpm_platform_profile_from_power_profile(
+             power_profile, profiles->priv->choices) != NULL;
+}
+
+/**
+ * gpm_power_profiles_get_wanted:
+ *
+ * A held performance profile wins over a held power-saver one, and any
+ * hold wins over the idle and power source settings.
+ *
+ * Return value: the power profile to have, or "" for what the session found
+ **/
+static gchar *gpm_power_profiles_get_wanted(GpmPowerProfiles *profiles) {
+  GpmPowerProfilesPrivate *priv = profiles->priv;
+  GpmPolicyHold *hold;
+  const gchar *held = NULL;
+  GHashTableIter iter;
+  gchar *wanted;
+
+  g_hash_table_iter_init(&iter, priv->holds.table);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&hold)) {
+    if (held == NULL || g_strcmp0(hold->profile, "performance") == 0)
+      held = hold->profile;
+  }
+  if (held != NULL) return g_strdup(held);
+
+  if (priv->idle) {
+    wanted = g_settings_get_string(priv->settings,
+                                   GPM_SETTINGS_PLATFORM_PROFILE_IDLE);
+    if (wanted[0] != '\0') return wanted;
+    g_free(wanted);
+  }
+  return g_settings_get_string(priv->settings,
+                               priv->on_battery
+                                   ? GPM_SETTINGS_PLATFORM_PROFILE_BATT
+                                   : GPM_SETTINGS_PLATFORM_PROFILE_AC);
+}
+
+/**
+ * gpm_power_profiles_get_property:
+ **/
+static GVariant *gpm_power_profiles_get_property(
+    GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+    const gchar *interface_name, const gchar *property_name, GError **error,
+    GpmPowerProfiles *profiles) {
+  GpmPowerProfilesPrivate *priv = profiles->priv;
+  GpmPolicyHold *hold;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  const gchar *active;
+  guint i;
+
+  if (g_strcmp0(property_name, "ActiveProfile") == 0) {
+    active = gpm_platform_profile_to_power_profile(priv->applied);
+    return g_variant_new_string(active != NULL ? active : "balanced");
+  }
+  if (g_strcmp0(property_name, "PerformanceInhibited") == 0 ||
+      g_strcmp0(property_name, "PerformanceDegraded") == 0)
+    return g_variant_new_string("");
+  if (g_strcmp0(property_name, "Profiles") == 0) {
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
+    for (i = 0; i < G_N_ELEMENTS(gpm_power_profiles_names); i++) {
+      if (!gpm_power_profiles_is_offered(profiles,
+                                         gpm_power_profiles_names[i]))
+        continue;
+      g_variant_builder_open(&builder, G_VARIANT_TYPE("a{sv}"));
+      g_variant_builder_add(&builder, "{sv}", "Profile",
+                            g_variant_new_string(gpm_power_profiles_names[i]));
+      g_variant_builder_add(&builder, "{sv}", "Driver",
+                            g_variant_new_string("platform_profile"));
+      g_variant_builder_add(&builder, "{sv}", "PlatformDriver",
+                            g_variant_new_string("platform_profile"));
+      g_variant_builder_close(&builder);
+    }
+    return g_variant_builder_end(&builder);
+  }
+  if (g_strcmp0(property_name, "Actions") == 0)
+    return g_variant_new_strv(NULL, 0);
+  if (g_strcmp0(property_name, "ActiveProfileHolds") == 0) {
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
+    g_hash_table_iter_init(&iter, priv->holds.table);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&hold)) {
+      g_variant_builder_open(&builder, G_VARIANT_TYPE("a{sv}"));
+      g_variant_builder_add(&builder, "{sv}", "ApplicationId",
+                            g_variant_new_string(hold->application_id));
+      g_variant_builder_add(&builder, "{sv}", "Profile",
+                            g_variant_new_string(hold->profile));
+      g_variant_builder_add(&builder, "{sv}", "Reason",
+                            g_variant_new_string(hold->reason));
+      g_variant_builder_close(&builder);
+    }
+    return g_variant_builder_end(&builder);
+  }
+  if (g_strcmp0(property_name, "Version") == 0)
+    return g_variant_new_string(PACKAGE_VERSION);
+
+  g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+              "no property %s", property_name);
+  return NULL;
+}
+
+/**
+ * gpm_power_profiles_emit_changed:
+ **/
+static void gpm_power_profiles_emit_changed(GpmPowerProfiles *profiles,
+                                            const gchar *property_name) {
+  GpmPowerProfilesPrivate *priv = profiles->priv;
+  GVariantBuilder builder;
+
+  if (priv->registration_id == 0) return;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&builder, "{sv}", property_name,
+                        gpm_power_profiles_get_property(
+                            priv->connection, NULL, NULL, NULL, property_name,
+                            NULL, profiles));
+  g_dbus_connection_emit_signal(
+      priv->connection, NULL, GPM_DBUS_PATH_POWER_PROFILES,
+      "org.freedesktop.DBus.Properties", "PropertiesChanged",
+      g_variant_new("(sa{sv}as)", GPM_DBUS_INTERFACE_POWER_PROFILES, &builder,
+                    NULL),
+      NULL);
+}
+
+/**
+ * gpm_power_profiles_helper_failed:
+ *
+ * Goes with what is there, so the next change tries again.
+ **/
+static void gpm_power_profiles_helper_failed(GpmPowerProfiles *profiles) {
+  g_free(profiles->priv->applied);
+  profiles->priv->applied = gpm_platform_profile_get(profiles->priv->filename);
+  gpm_power_profiles_emit_changed(profiles, "ActiveProfile");
+}
+
+/**
+ * gpm_power_profiles_get_argv:
+ *
+ * Points the helper at the file in use if it is a copy of the sysfs one.
+ **/
+static GPtrArray *gpm_power_profiles_get_argv(GpmPowerProfiles *profiles,
+                                              const gchar *profile) {
+  GPtrArray *argv;
+
+  argv = gpm_policy_helper_get_argv(&profiles->priv->helper);
+  g_ptr_array_add(argv, g_strdup_printf("--set-profile=%s", profile));
+  if (g_strcmp0(profiles->priv->filename, GPM_PLATFORM_PROFILE_FILE) != 0)
+    g_ptr_array_add(argv,
+                    g_strdup_printf("--file=%s", profiles->priv->filename));
+  return argv;
+}
+
+/**
+ * gpm_power_profiles_evaluate:
+ *
+ * Works out the profile to have now, and runs the helper if it is not the
+ * one last asked for. Nothing is done while the session is in the
+ * background, and it catches up once it is active.
+ **/
+static void gpm_power_profiles_evaluate(GpmPowerProfiles *profiles) {
+  GpmPowerProfilesPrivate *priv = profiles->priv;
+  const gchar *profile;
+  GPtrArray *argv;
+  gchar *wanted;
+
+  if (priv->original == NULL) return;
+  if (!gpm_policy_helper_is_active(&priv->helper)) return;
+  if (gpm_policy_helper_is_busy(&priv->helper)) return;
+
+  wanted = gpm_power_profiles_get_wanted(profiles);
+  profile = gpm_platform_profile_from_power_profile(wanted, priv->choices);
+  if (profile == NULL) profile = priv->original;
+  g_free(wanted);
+  if (g_strcmp0(profile, priv->applied) == 0) return;
+
+  g_debug("setting the platform profile to %s", profile);
+  g_free(priv->applied);
+  priv->applied = g_strdup(profile);
+  gpm_power_profiles_emit_changed(profiles, "ActiveProfile");
+
+  argv = gpm_power_profiles_get_argv(profiles, profile);
+  gpm_policy_helper_run(&priv->helper, argv);
+  g_ptr_array_unref(argv);
+}
+
+/**
+ * gpm_power_profiles_set_on_battery:
+ **/
+void gpm_power_profiles_set_on_battery(GpmPowerProfiles *profiles,
+                                       gboolean on_battery) {
+  g_return_if_fail(GPM_IS_POWER_PROFILES(profiles));
+
+  if (profiles->priv->on_battery == on_battery) return;
+  profiles->priv->on_battery = on_battery;
+  gpm_power_profiles_evaluate(profiles);
+}
+
+/**
+ * gpm_power_profiles_set_idle:
+ * @idle: If the screen has blanked for inactivity
+ **/
+void gpm_power_profiles_set_idle(GpmPowerProfiles *profiles, gboolean idle) {
+  g_return_if_fail(GPM_IS_POWER_PROFILES(profiles));
+
+  if (profiles->priv->idle == idle) return;
+  profiles->priv->idle = idle;
+  gpm_power_profiles_evaluate(profiles);
+}
+
+/**
+ * gpm_power_profiles_release:
+ **/
+static void gpm_power_profiles_release(GpmPowerProfiles *profiles,
+                                       guint cookie) {
+  gpm_policy_holds_remove(&profiles->priv->holds, cookie);
+  gpm_power_profiles_emit_changed(profiles, "ActiveProfileHolds");
+  gpm_power_profiles_evaluate(profiles);
+}
+
+/**
+ * gpm_power_profiles_vanished:
+ **/
+static void gpm_power_profiles_vanished(guint cookie,
+                                        GpmPowerProfiles *profiles) {
+  gpm_power_profiles_release(profiles, cookie);
+}
+
+/**
+ * gpm_power_profiles_hold:
+ **/
+static void gpm_power_profiles_hold(GpmPowerProfiles *profiles,
+                                    GVariant *parameters, const gchar *sender,
+                                    GDBusMethodInvocation *invocation) {
+  GpmPolicyHold *hold;
+  const gchar *application_id;
+  const gchar *profile;
+  const gchar *reason;
+
+  g_variant_get(parameters, "(&s&s&s)", &profile, &reason, &application_id);
+  if ((g_strcmp0(profile, "performance") != 0 &&
+       g_strcmp0(profile, "power-saver") != 0) ||
+      !gpm_power_profiles_is_offered(profiles, profile)) {
+    g_dbus_method_invocation_return_error(
+        invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+        "Only profiles 'performance' and 'power-saver' can be a hold, "
+        "and only if the platform has them");
+    return;
+  }
+
+  g_debug("%s (%s) holds %s for %s", application_id, sender, profile,
+          reason);
+  hold = gpm_policy_holds_add(&profiles->priv->holds,
+                              profiles->priv->connection, sender, profile,
+                              reason, application_id);
+  gpm_power_profiles_emit_changed(profiles, "ActiveProfileHolds");
+  gpm_power_profiles_evaluate(profiles);
+  g_dbus_method_invocation_return_value(invocation,
+                                        g_variant_new("(u)", hold->cookie));
+}
+
+/**
+ * gpm_power_profiles_method_call:
+ **/
+static void gpm_power_profiles_method_call(
+    GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+    const gchar *interface_name, const gchar *method_name,
+    GVariant *parameters, GDBusMethodInvocation *invocation,
+    GpmPowerProfiles *profiles) {
+  GpmPolicyHold *hold;
+  guint cookie;
+
+  if (g_strcmp0(method_name, "HoldProfile") == 0) {
+    gpm_power_profiles_hold(profiles, parameters, sender, invocation);
+    return;
+  }
+  if (g_strcmp0(method_name, "ReleaseProfile") == 0) {
+    g_variant_get(parameters, "(u)", &cookie);
+    hold = gpm_policy_holds_lookup(&profiles->priv->holds, cookie);
+    if (hold == NULL || g_strcmp0(hold->sender, sender) != 0) {
+      g_dbus_method_invocation_return_error(
+          invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+          "No hold with cookie %u", cookie);
+      return;
+    }
+    gpm_power_profiles_release(profiles, cookie);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+    return;
+  }
+  g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                        G_DBUS_ERROR_UNKNOWN_METHOD,
+                                        "no method %s", method_name);
+}
+
+/**
+ * gpm_power_profiles_set_property:
+ *
+ * Choosing a profile drops the holds, as power-profiles-daemon does, and
+ * keeps it for the power source the machine is on.
+ **/
+static gboolean gpm_power_profiles_set_property(
+    GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+    const gchar *interface_name, const gchar *property_name, GVariant *value,
+    GError **error, GpmPowerProfiles *profiles) {
+  GpmPowerProfilesPrivate *priv = profiles->priv;
+  GpmPolicyHold *hold;
+  GHashTableIter iter;
+  const gchar *profile;
+
+  if (g_strcmp0(property_name, "ActiveProfile") != 0) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_PROPERTY_READ_ONLY,
+                "%s cannot be set", property_name);
+    return FALSE;
+  }
+  profile = g_variant_get_string(value, NULL);
+  if (!gpm_power_profiles_is_offered(profiles, profile)) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                "The platform has no %s profile", profile);
+    return FALSE;
+  }
+
+  g_hash_table_iter_init(&iter, priv->holds.table);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&hold)) {
+    g_dbus_connection_emit_signal(
+        priv->connection, NULL, GPM_DBUS_PATH_POWER_PROFILES,
+        GPM_DBUS_INTERFACE_POWER_PROFILES, "ProfileReleased",
+        g_variant_new("(u)", hold->cookie), NULL);
+    g_hash_table_iter_remove(&iter);
+  }
+  gpm_power_profiles_emit_changed(profiles, "ActiveProfileHolds");
+  g_settings_set_string(priv->settings,
+                        priv->on_battery ? GPM_SETTINGS_PLATFORM_PROFILE_BATT
+                                         : GPM_SETTINGS_PLATFORM_PROFILE_AC,
+                        profile);
+  gpm_power_profiles_evaluate(profiles);
+  return TRUE;
+}
+
+static const GDBusInterfaceVTable gpm_power_profiles_vtable = {
+    (GDBusInterfaceMethodCallFunc)gpm_power_profiles_method_call,
+    (GDBusInterfaceGetPropertyFunc)gpm_power_profiles_get_property,
+    (GDBusInterfaceSetPropertyFunc)gpm_power_profiles_set_property};
+
+/**
+ * gpm_power_profiles_bus_acquired_cb:
+ **/
+static void gpm_power_profiles_bus_acquired_cb(GDBusConnection *connection,
+                                               const gchar *name,
+                                               GpmPowerProfiles *profiles) {
+  GError *error = NULL;
+
+  profiles->priv->connection = g_object_ref(connection);
+  profiles->priv->registration_id = g_dbus_connection_register_object(
+      connection, GPM_DBUS_PATH_POWER_PROFILES,
+      profiles->priv->introspection->interfaces[0],
+      &gpm_power_profiles_vtable, profiles, NULL, &error);
+  if (profiles->priv->registration_id == 0) {
+    g_warning("failed to export the power profiles: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+/**
+ * gpm_power_profiles_settings_changed_cb:
+ **/
+static void gpm_power_profiles_settings_changed_cb(
+    GSettings *settings, const gchar *key, GpmPowerProfiles *profiles) {
+  if (g_str_has_prefix(key, "platform-profile-"))
+    gpm_power_profiles_evaluate(profiles);
+}
+
+/**
+ * gpm_power_profiles_restore:
+ *
+ * Puts back the profile the session started with, waiting for the helper
+ * as the session is about to go. A session in the background leaves the
+ * profile to the one in front.
+ **/
+static void gpm_power_profiles_restore(GpmPowerProfiles *profiles) {
+  GpmPowerProfilesPrivate *priv = profiles->priv;
+  GPtrArray *argv;
+  GError *error = NULL;
+
+  if (priv->original == NULL) return;
+  if (g_strcmp0(priv->original, priv->applied) == 0) return;
+  if (!gpm_policy_helper_is_active(&priv->helper)) return;
+
+  g_debug("putting the platform profile back to %s", priv->original);
+  argv = gpm_power_profiles_get_argv(profiles, priv->original);
+  if (!gpm_policy_helper_run_sync(&priv->helper, argv, &error)) {
+    g_warning("failed to put the platform profile back: %s",
+              error->message);
+    g_error_free(error);
+  }
+  g_ptr_array_unref(argv);
+}
+
+/**
+ * gpm_power_profiles_finalize:
+ **/
+static void gpm_power_profiles_finalize(GObject *object) {
+  GpmPowerProfiles *profiles;
+
+  g_return_if_fail(GPM_IS_POWER_PROFILES(object));
+  profiles = GPM_POWER_PROFILES(object);
+
+  gpm_power_profiles_restore(profiles);
+  gpm_policy_helper_clear(&profiles->priv->helper);
+  gpm_policy_holds_clear(&profiles->priv->holds);
+  if (profiles->priv->registration_id != 0)
+    g_dbus_connection_unregister_object(profiles->priv->connection,
+                                        profiles->priv->registration_id);
+  if (profiles->priv->owner_id != 0)
+    g_bus_unown_name(profiles->priv->owner_id);
+  g_clear_object(&profiles->priv->connection);
+  g_dbus_node_info_unref(profiles->priv->introspection);
+  g_object_unref(profiles->priv->settings);
+  g_strfreev(profiles->priv->choices);
+  g_free(profiles->priv->original);
+  g_free(profiles->priv->applied);
+  g_free(profiles->priv->filename);
+
+  G_OBJECT_CLASS(gpm_power_profiles_parent_class)->finalize(object);
+}
+
+/**
+ * gpm_power_profiles_class_init:
+ **/
+static void gpm_power_profiles_class_init(GpmPowerProfilesClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->finalize = gpm_power_profiles_finalize;
+}
+
+/**
+ * gpm_power_profiles_has_daemon:
+ *
+ * Return value: %TRUE if a system service already sets the platform
+ * profile, which the session must then leave alone
+ **/
+static gboolean gpm_power_profiles_has_daemon(void) {
+  GDBusConnection *connection;
+  GVariant *reply;
+  gboolean ret = FALSE;
+  guint i;
+
+  connection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL);
+  if (connection == NULL) return FALSE;
+  for (i = 0; !ret && gpm_power_profiles_daemons[i] != NULL; i++) {
+    reply = g_dbus_connection_call_sync(
+        connection, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+        "org.freedesktop.DBus", "NameHasOwner",
+        g_variant_new("(s)", gpm_power_profiles_daemons[i]),
+        G_VARIANT_TYPE("(b)"), G_DBUS_CALL_FLAGS_NONE, 1000, NULL, NULL);
+    if (reply == NULL) continue;
+    g_variant_get(reply, "(b)", &ret);
+    g_variant_unref(reply);
+    if (ret)
+      g_debug("%s sets the platform profile", gpm_power_profiles_daemons[i]);
+  }
+  g_object_unref(connection);
+  return ret;
+}
+
+/**
+ * gpm_power_profiles_init:
+ *
+ * Remembers the profile the session started with, which is what an empty
+ * setting goes back to. Nothing is exported if the firmware has no
+ * platform profile, or power-profiles-daemon is running, so that panel
+ * widgets hide their switch or talk to the daemon.
+ *
+ * When built with --enable-test-hooks, the test harness can use a copy of
+ * the sysfs file named by GPM_PLATFORM_PROFILE_FILE.
+ **/
+static void gpm_power_profiles_init(GpmPowerProfiles *profiles) {
+  const gchar *filename = NULL;
+
+  profiles->priv = gpm_power_profiles_get_instance_private(profiles);
+#if defined(EGG_TEST) || defined(GPM_TEST_HOOKS)
+  filename = g_getenv("GPM_PLATFORM_PROFILE_FILE");
+#endif
+  profiles->priv->filename =
+      g_strdup(filename != NULL ? filename : GPM_PLATFORM_PROFILE_FILE);
+  profiles->priv->choices =
+      gpm_platform_profile_get_choices(profiles->priv->filename);
+  if (profiles->priv->choices != NULL && !gpm_power_profiles_has_daemon())
+    profiles->priv->original =
+        gpm_platform_profile_get(profiles->priv->filename);
+  profiles->priv->applied = g_strdup(profiles->priv->original);
+  gpm_policy_holds_init(&profiles->priv->holds,
+                        (GpmPolicyVanishedFunc)gpm_power_profiles_vanished,
+                        profiles);
+  gpm_policy_helper_init(
+      &profiles->priv->helper, "mate-power-platform-profile-helper",
+      "GPM_PLATFORM_PROFILE_HELPER",
+      (GpmPolicyHelperFunc)gpm_power_profiles_evaluate,
+      (GpmPolicyHelperFunc)gpm_power_profiles_helper_failed, profiles);
+  profiles->priv->introspection =
+      g_dbus_node_info_new_for_xml(gpm_power_profiles_introspection, NULL);
+  profiles->priv->settings = g_settings_new(GPM_SETTINGS_SCHEMA);
+  g_signal_connect(profiles->priv->settings, "changed",
+                   G_CALLBACK(gpm_power_profiles_settings_changed_cb),
+                   profiles);
+
+  if (profiles->priv->original == NULL) {
+    g_debug("not managing the platform profile in %s",
+            profiles->priv->filename);
+    return;
+  }
+  profiles->priv->owner_id = g_bus_own_name(
+      G_BUS_TYPE_SESSION, GPM_DBUS_SERVICE_POWER_PROFILES,
+      G_BUS_NAME_OWNER_FLAGS_NONE,
+      (GBusAcquiredCallback)gpm_power_profiles_bus_acquired_cb, NULL, NULL,
+      profiles, NULL);
+  gpm_power_profiles_evaluate(profiles);
+}
+
+/**
+ * gpm_power_profiles_new:
+ *
+ * Return value: A new GpmPowerProfiles, starting out on AC and active
+ **/
+GpmPowerProfiles *gpm_power_profiles_new(void) {
+  return g_object_new(GPM_TYPE_POWER_PROFILES, NULL);
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+/* what the test waits for, as egg_test_loop_quit() only has the test */
+static const gchar *gpm_power_profiles_test_filename = NULL;
+static const gchar *gpm_power_profiles_test_goal = NULL;
+static GVariant *gpm_power_profiles_test_reply = NULL;
+static guint gpm_power_profiles_test_poll_id = 0;
+
+/**
+ * gpm_power_profiles_test_poll_cb:
+ **/
+static gboolean gpm_power_profiles_test_poll_cb(EggTest *test) {
+  gchar *value;
+  gboolean ret;
+
+  value = gpm_platform_profile_get(gpm_power_profiles_test_filename);
+  ret = g_strcmp0(value, gpm_power_profiles_test_goal) == 0;
+  g_free(value);
+  if (!ret) return TRUE;
+  gpm_power_profiles_test_poll_id = 0;
+  egg_test_loop_quit(test);
+  return FALSE;
+}
+
+/**
+ * gpm_power_profiles_test_wait:
+ *
+ * Return value: %TRUE if the helper wrote @goal to the fake file in time
+ **/
+static gboolean gpm_power_profiles_test_wait(EggTest *test,
+                                             const gchar *goal) {
+  gpm_power_profiles_test_goal = goal;
+  gpm_power_profiles_test_poll_id = g_timeout_add(
+      20, (GSourceFunc)gpm_power_profiles_test_poll_cb, test);
+  egg_test_loop_wait(test, 5000);
+  if (gpm_power_profiles_test_poll_id == 0) return TRUE;
+  g_source_remove(gpm_power_profiles_test_poll_id);
+  gpm_power_profiles_test_poll_id = 0;
+  return FALSE;
+}
+
+/**
+ * gpm_power_profiles_test_call_cb:
+ **/
+static void gpm_power_profiles_test_call_cb(GDBusConnection *connection,
+                                            GAsyncResult *res,
+                                            EggTest *test) {
+  gpm_power_profiles_test_reply =
+      g_dbus_connection_call_finish(connection, res, NULL);
+  egg_test_loop_quit(test);
+}
+
+/**
+ * gpm_power_profiles_test_call:
+ *
+ * The service answers from this thread, so the call cannot block it.
+ *
+ * Return value: the reply, or %NULL for an error
+ **/
+static GVariant *gpm_power_profiles_test_call(EggTest *test,
+                                              GDBusConnection *connection,
+                                              const gchar *interface_name,
+                                              const gchar *method_name,
+                                              GVariant *parameters) {
+  gpm_power_profiles_test_reply = NULL;
+  g_dbus_connection_call(
+      connection, GPM_DBUS_SERVICE_POWER_PROFILES,
+      GPM_DBUS_PATH_POWER_PROFILES, interface_name, method_name, parameters,
+      NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+      (GAsyncReadyCallback)gpm_power_profiles_test_call_cb, test);
+  egg_test_loop_wait(test, 5000);
+  return gpm_power_profiles_test_reply;
+}
+
+/**
+ * gpm_power_profiles_test_get:
+ **/
+static GVariant *gpm_power_profiles_test_get(EggTest *test,
+                                             GDBusConnection *connection,
+                                             const gchar *property_name) {
+  GVariant *reply;
+  GVariant *value;
+
+  reply = gpm_power_profiles_test_call(
+      test, connection, "org.freedesktop.DBus.Properties", "Get",
+      g_variant_new("(ss)", GPM_DBUS_INTERFACE_POWER_PROFILES,
+                    property_name));
+  if (reply == NULL) return NULL;
+  g_variant_get(reply, "(v)", &value);
+  g_variant_unref(reply);
+  return value;
+}
+
+/**
+ * gpm_power_profiles_test_appeared_cb:
+ **/
+static void gpm_power_profiles_test_appeared_cb(GDBusConnection *connection,
+                                                const gchar *name,
+                                                const gchar *name_owner,
+                                                EggTest *test) {
+  egg_test_loop_quit(test);
+}
+
+void gpm_power_profiles_test(gpointer data) {
+  GpmPowerProfiles *profiles;
+  GDBusConnection *connection;
+  GSettingsSchema *schema;
+  GSettings *settings;
+  GTestDBus *bus;
+  GVariant *reply;
+  GVariant *value;
+  gchar *dirname;
+  gchar *filename;
+  gchar *choices_filename;
+  gchar *daemon;
+  gchar *saved;
+  guint watch_id;
+  guint cookie = 0;
+  gboolean ret;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmPowerProfiles")) return;
+
+  /* the check target sets these up, so other runs do without the test */
+  schema = g_settings_schema_source_lookup(
+      g_settings_schema_source_get_default(), GPM_SETTINGS_SCHEMA, TRUE);
+  daemon = g_find_program_in_path("dbus-daemon");
+  if (schema == NULL || daemon == NULL ||
+      g_getenv("GPM_PLATFORM_PROFILE_HELPER") == NULL) {
+    g_print("no schema, dbus-daemon or helper to test with...");
+    if (schema != NULL) g_settings_schema_unref(schema);
+    g_free(daemon);
+    egg_test_end(test);
+    return;
+  }
+  g_settings_schema_unref(schema);
+  g_free(daemon);
+
+  /* a laptop with the three usual profiles, on a bus of its own */
+  dirname = g_dir_make_tmp("gpm-power-profiles-XXXXXX", NULL);
+  filename = g_build_filename(dirname, "platform_profile", NULL);
+  choices_filename = g_strdup_printf("%s_choices", filename);
+  g_file_set_contents(filename, "balanced\n", -1, NULL);
+  g_file_set_contents(choices_filename, "low-power balanced performance\n",
+                      -1, NULL);
+  gpm_power_profiles_test_filename = filename;
+  g_setenv("GPM_PLATFORM_PROFILE_FILE", filename, TRUE);
+  bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(bus);
+  connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+  /* the private bus stands in for the system one too, so that a running
+   * power-profiles-daemon or logind does not change what is tested */
+  g_setenv("DBUS_SYSTEM_BUS_ADDRESS", g_test_dbus_get_bus_address(bus), TRUE);
+  settings = g_settings_new(GPM_SETTINGS_SCHEMA);
+  g_settings_set_string(settings, GPM_SETTINGS_PLATFORM_PROFILE_AC, "");
+  g_settings_set_string(settings, GPM_SETTINGS_PLATFORM_PROFILE_BATT,
+                        "power-saver");
+  g_settings_set_string(settings, GPM_SETTINGS_PLATFORM_PROFILE_IDLE,
+                        "power-saver");
+
+  /************************************************************/
+  egg_test_title(test, "the profiles are exported once the name is owned");
+  profiles = gpm_power_profiles_new();
+  watch_id = g_bus_watch_name_on_connection(
+      connection, GPM_DBUS_SERVICE_POWER_PROFILES,
+      G_BUS_NAME_WATCHER_FLAGS_NONE,
+      (GBusNameAppearedCallback)gpm_power_profiles_test_appeared_cb, NULL,
+      test, NULL);
+  egg_test_loop_wait(test, 5000);
+  g_bus_unwatch_name(watch_id);
+  egg_test_assert(test, profiles->priv->registration_id != 0);
+
+  /************************************************************/
+  egg_test_title(test, "the profile the firmware had is active");
+  value = gpm_power_profiles_test_get(test, connection, "ActiveProfile");
+  saved = value != NULL ? g_variant_dup_string(value, NULL) : NULL;
+  egg_test_assert(test, g_strcmp0(saved, "balanced") == 0);
+  if (value != NULL) g_variant_unref(value);
+  g_free(saved);
+
+  /************************************************************/
+  egg_test_title(test, "the battery profile is set when unplugged");
+  gpm_power_profiles_set_on_battery(profiles, TRUE);
+  egg_test_assert(test, gpm_power_profiles_test_wait(test, "low-power"));
+
+  /************************************************************/
+  egg_test_title(test, "a performance hold wins over the power source");
+  reply = gpm_power_profiles_test_call(
+      test, connection, GPM_DBUS_INTERFACE_POWER_PROFILES, "HoldProfile",
+      g_variant_new("(sss)", "performance", "testing", "org.mate.Test"));
+  if (reply != NULL) {
+    g_variant_get(reply, "(u)", &cookie);
+    g_variant_unref(reply);
+  }
+  ret = gpm_power_profiles_test_wait(test, "performance");
+  egg_test_assert(test, cookie != 0 && ret);
+
+  /************************************************************/
+  egg_test_title(test, "the hold is listed with its reason");
+  value = gpm_power_profiles_test_get(test, connection, "ActiveProfileHolds");
+  egg_test_assert(test, value != NULL && g_variant_n_children(value) == 1);
+  if (value != NULL) g_variant_unref(value);
+
+  /************************************************************/
+  egg_test_title(test, "releasing the hold goes back to the battery profile");
+  reply = gpm_power_profiles_test_call(
+      test, connection, GPM_DBUS_INTERFACE_POWER_PROFILES, "ReleaseProfile",
+      g_variant_new("(u)", cookie));
+  if (reply != NULL) g_variant_unref(reply);
+  egg_test_assert(test, reply != NULL &&
+                            gpm_power_profiles_test_wait(test, "low-power"));
+
+  /************************************************************/
+  egg_test_title(test, "the profile the session found is back on AC");
+  gpm_power_profiles_set_on_battery(profiles, FALSE);
+  egg_test_assert(test, gpm_power_profiles_test_wait(test, "balanced"));
+
+  /************************************************************/
+  egg_test_title(test, "the idle profile is set while idle");
+  gpm_power_profiles_set_idle(profiles, TRUE);
+  egg_test_assert(test, gpm_power_profiles_test_wait(test, "low-power"));
+
+  /************************************************************/
+  egg_test_title(test, "balanced cannot be held");
+  reply = gpm_power_profiles_test_call(
+      test, connection, GPM_DBUS_INTERFACE_POWER_PROFILES, "HoldProfile",
+      g_variant_new("(sss)", "balanced", "testing", "org.mate.Test"));
+  egg_test_assert(test, reply == NULL);
+  if (reply != NULL) g_variant_unref(reply);
+
+  /************************************************************/
+  egg_test_title(test, "a chosen profile is kept for the power source");
+  gpm_power_profiles_set_idle(profiles, FALSE);
+  reply = gpm_power_profiles_test_call(
+      test, connection, "org.freedesktop.DBus.Properties", "Set",
+      g_variant_new("(ssv)", GPM_DBUS_INTERFACE_POWER_PROFILES,
+                    "ActiveProfile", g_variant_new_string("performance")));
+  if (reply != NULL) g_variant_unref(reply);
+  ret = gpm_power_profiles_test_wait(test, "performance");
+  saved = g_settings_get_string(settings, GPM_SETTINGS_PLATFORM_PROFILE_AC);
+  egg_test_assert(test, reply != NULL && ret &&
+                            g_strcmp0(saved, "performance") == 0);
+  g_free(saved);
+  g_object_unref(profiles);
+
+  /************************************************************/
+  egg_test_title(test, "nothing is exported while power-profiles-daemon runs");
+  reply = g_dbus_connection_call_sync(
+      connection, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+      "org.freedesktop.DBus", "RequestName",
+      g_variant_new("(su)", "net.hadess.PowerProfiles", 0), NULL,
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+  if (reply != NULL) g_variant_unref(reply);
+  profiles = gpm_power_profiles_new();
+  egg_test_assert(test, reply != NULL && profiles->priv->owner_id == 0);
+  g_object_unref(profiles);
+
+  g_settings_reset(settings, GPM_SETTINGS_PLATFORM_PROFILE_AC);
+  g_settings_reset(settings, GPM_SETTINGS_PLATFORM_PROFILE_BATT);
+  g_settings_reset(settings, GPM_SETTINGS_PLATFORM_PROFILE_IDLE);
+  g_object_unref(settings);
+  g_object_unref(connection);
+  g_test_dbus_down(bus);
+  g_object_unref(bus);
+  g_unsetenv("DBUS_SYSTEM_BUS_ADDRESS");
+  g_unsetenv("GPM_PLATFORM_PROFILE_FILE");
+  g_unlink(choices_filename);
+  g_unlink(filename);
+  g_rmdir(dirname);
+  g_free(choices_filename);
+  g_free(filename);
+  g_free(dirname);
+
+  egg_test_end(test);
+}
+
+#endif
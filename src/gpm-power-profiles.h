@@ -0,0 +1,59 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_POWER_PROFILES_H
+#define __GPM_POWER_PROFILES_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GPM_TYPE_POWER_PROFILES (gpm_power_profiles_get_type())
+#define GPM_POWER_PROFILES(o) \
+  (G_TYPE_CHECK_INSTANCE_CAST((o), GPM_TYPE_POWER_PROFILES, GpmPowerProfiles))
+#define GPM_POWER_PROFILES_CLASS(k) \
+  (G_TYPE_CHECK_CLASS_CAST((k), GPM_TYPE_POWER_PROFILES, GpmPowerProfilesClass))
+#define GPM_IS_POWER_PROFILES(o) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((o), GPM_TYPE_POWER_PROFILES))
+
+typedef struct GpmPowerProfilesPrivate GpmPowerProfilesPrivate;
+
+typedef struct {
+  GObject parent;
+  GpmPowerProfilesPrivate *priv;
+} GpmPowerProfiles;
+
+typedef struct {
+  GObjectClass parent_class;
+} GpmPowerProfilesClass;
+
+GType gpm_power_profiles_get_type(void);
+GpmPowerProfiles *gpm_power_profiles_new(void);
+void gpm_power_profiles_set_on_battery(GpmPowerProfiles *profiles,
+                                       gboolean on_battery);
+void gpm_power_profiles_set_idle(GpmPowerProfiles *profiles, gboolean idle);
+#ifdef EGG_TEST
+void gpm_power_profiles_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_POWER_PROFILES_H */
@@ -48,6 +48,9 @@
 #define GET_WINDOW(x) \
   (GTK_WINDOW(gtk_builder_get_object(prefs->priv->builder, (x))))
 
+/* how long the slider has to rest before the new value is saved */
+#define GPM_PREFS_BRIGHTNESS_COMMIT_DELAY 500 /* ms */
+
 static void gpm_prefs_finalize(GObject *object);
 
 struct GpmPrefsPrivate {
@@ -62,6 +65,12 @@ struct GpmPrefsPrivate {
   gboolean can_suspend;
   gboolean can_hibernate;
   GSettings *settings;
+  GDBusProxy *backlight_proxy;
+  gdouble brightness_value;      /* the slider position not yet saved */
+  gboolean brightness_in_flight; /* a preview call is outstanding */
+  gboolean brightness_queued;    /* and the slider moved again since */
+  gboolean brightness_syncing;    /* the key is moving the slider */
+  guint brightness_commit_id;
 };
 
 enum { ACTION_HELP, ACTION_CLOSE, LAST_SIGNAL };
@@ -131,6 +140,142 @@ static gchar *gpm_prefs_format_percentage_cb(GtkScale *scale, gdouble value) {
   return g_strdup_printf("%.0f%%", value);
 }
 
+/**
+ * gpm_prefs_brightness_commit:
+ *
+ * Saves the slider value, which the daemon then applies as the policy.
+ **/
+static void gpm_prefs_brightness_commit(GpmPrefs *prefs) {
+  gdouble value;
+
+  if (prefs->priv->brightness_commit_id != 0) {
+    g_source_remove(prefs->priv->brightness_commit_id);
+    prefs->priv->brightness_commit_id = 0;
+  }
+  value = prefs->priv->brightness_value;
+  if (value == g_settings_get_double(prefs->priv->settings,
+                                     GPM_SETTINGS_BRIGHTNESS_AC))
+    return;
+  g_debug("saving brightness %.0f%%", value);
+  g_settings_set_double(prefs->priv->settings, GPM_SETTINGS_BRIGHTNESS_AC,
+                        value);
+}
+
+/**
+ * gpm_prefs_brightness_commit_cb:
+ **/
+static gboolean gpm_prefs_brightness_commit_cb(GpmPrefs *prefs) {
+  prefs->priv->brightness_commit_id = 0;
+  gpm_prefs_brightness_commit(prefs);
+  return FALSE;
+}
+
+static void gpm_prefs_brightness_preview(GpmPrefs *prefs);
+
+/**
+ * gpm_prefs_brightness_preview_cb:
+ **/
+static void gpm_prefs_brightness_preview_cb(GObject *source,
+                                            GAsyncResult *result,
+                                            GpmPrefs *prefs) {
+  GVariant *ret;
+  GError *error = NULL;
+
+  ret = g_dbus_proxy_call_finish(G_DBUS_PROXY(source), result, &error);
+  if (ret == NULL) {
+    g_debug("failed to preview brightness: %s", error->message);
+    g_error_free(error);
+  } else {
+    g_variant_unref(ret);
+  }
+
+  /* only the latest position is worth showing */
+  prefs->priv->brightness_in_flight = FALSE;
+  if (prefs->priv->brightness_queued) {
+    prefs->priv->brightness_queued = FALSE;
+    gpm_prefs_brightness_preview(prefs);
+  }
+  g_object_unref(prefs);
+}
+
+/**
+ * gpm_prefs_brightness_preview:
+ *
+ * Shows the slider value on the panel without saving it, keeping no more
+ * than one call to the daemon outstanding.
+ **/
+static void gpm_prefs_brightness_preview(GpmPrefs *prefs) {
+  gdouble value;
+
+  if (prefs->priv->backlight_proxy == NULL) return;
+  if (prefs->priv->brightness_in_flight) {
+    prefs->priv->brightness_queued = TRUE;
+    return;
+  }
+  value = prefs->priv->brightness_value;
+  prefs->priv->brightness_in_flight = TRUE;
+  g_dbus_proxy_call(prefs->priv->backlight_proxy, "SetBrightness",
+                    g_variant_new("(u)", (guint)(value + 0.5)),
+                    G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL,
+                    (GAsyncReadyCallback)gpm_prefs_brightness_preview_cb,
+                    g_object_ref(prefs));
+}
+
+/**
+ * gpm_prefs_brightness_changed_cb:
+ *
+ * Dragging the slider previews each position, and the key is written once
+ * the slider is let go or has rested for a moment.
+ **/
+static void gpm_prefs_brightness_changed_cb(GtkRange *range, GpmPrefs *prefs) {
+  /* the key changed, not the user */
+  if (prefs->priv->brightness_syncing) return;
+
+  prefs->priv->brightness_value = gtk_range_get_value(range);
+  gpm_prefs_brightness_preview(prefs);
+  if (prefs->priv->brightness_commit_id != 0)
+    g_source_remove(prefs->priv->brightness_commit_id);
+  prefs->priv->brightness_commit_id =
+      g_timeout_add(GPM_PREFS_BRIGHTNESS_COMMIT_DELAY,
+                    (GSourceFunc)gpm_prefs_brightness_commit_cb, prefs);
+}
+
+/**
+ * gpm_prefs_brightness_sync:
+ *
+ * Moves the slider to the saved value without previewing or saving it.
+ **/
+static void gpm_prefs_brightness_sync(GpmPrefs *prefs) {
+  prefs->priv->brightness_syncing = TRUE;
+  gtk_range_set_value(
+      GTK_RANGE(GET_WIDGET("hscale_ac_brightness")),
+      g_settings_get_double(prefs->priv->settings, GPM_SETTINGS_BRIGHTNESS_AC));
+  prefs->priv->brightness_syncing = FALSE;
+}
+
+/**
+ * gpm_prefs_brightness_key_changed_cb:
+ **/
+static void gpm_prefs_brightness_key_changed_cb(GSettings *settings,
+                                                const gchar *key,
+                                                GpmPrefs *prefs) {
+  if (g_strcmp0(key, GPM_SETTINGS_BRIGHTNESS_AC) != 0) return;
+
+  /* don't pull the slider back while the user is still moving it */
+  if (prefs->priv->brightness_commit_id != 0) return;
+  gpm_prefs_brightness_sync(prefs);
+}
+
+/**
+ * gpm_prefs_brightness_released_cb:
+ **/
+static gboolean gpm_prefs_brightness_released_cb(GtkWidget *widget,
+                                                 GdkEvent *event,
+                                                 GpmPrefs *prefs) {
+  gpm_prefs_brightness_commit(prefs);
+  return FALSE;
+}
+
 /**
  * gpm_prefs_action_combo_changed_cb:
  **/
@@ -357,13 +502,17 @@ static void prefs_setup_ac(GpmPrefs *prefs) {
   gpm_prefs_setup_action_combo(prefs, "combobox_ac_lid",
                                GPM_SETTINGS_BUTTON_LID_AC, button_lid_actions);
 
-  /* setup brightness slider */
+  /* setup brightness slider, which is only saved when it comes to rest */
   widget = GET_WIDGET("hscale_ac_brightness");
-  g_settings_bind(prefs->priv->settings, GPM_SETTINGS_BRIGHTNESS_AC,
-                  gtk_range_get_adjustment(GTK_RANGE(widget)), "value",
-                  G_SETTINGS_BIND_DEFAULT);
+  gpm_prefs_brightness_sync(prefs);
+  g_signal_connect(prefs->priv->settings, "changed",
+                   G_CALLBACK(gpm_prefs_brightness_key_changed_cb), prefs);
   g_signal_connect(widget, "format-value",
                    G_CALLBACK(gpm_prefs_format_percentage_cb), NULL);
+  g_signal_connect(widget, "value-changed",
+                   G_CALLBACK(gpm_prefs_brightness_changed_cb), prefs);
+  g_signal_connect_after(widget, "button-release-event",
+                         G_CALLBACK(gpm_prefs_brightness_released_cb), prefs);
 
   /* set up the checkboxes */
   g_settings_bind(prefs->priv->settings, GPM_SETTINGS_IDLE_DIM_AC,
@@ -601,6 +750,21 @@ static void gpm_prefs_init(GpmPrefs *prefs) {
   brightness = gpm_brightness_new();
   prefs->priv->has_lcd = gpm_brightness_has_hw(brightness);
   g_object_unref(brightness);
+
+  /* the daemon previews the slider for us */
+  if (prefs->priv->has_lcd) {
+    prefs->priv->backlight_proxy = g_dbus_proxy_new_for_bus_sync(
+        G_BUS_TYPE_SESSION,
+        G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+            G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS |
+            G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START,
+        NULL, GPM_DBUS_SERVICE, GPM_DBUS_PATH_BACKLIGHT,
+        GPM_DBUS_INTERFACE_BACKLIGHT, NULL, &error);
+    if (prefs->priv->backlight_proxy == NULL) {
+      g_warning("Cannot connect to the backlight: %s", error->message);
+      g_clear_error(&error);
+    }
+  }
   devices = up_client_get_devices2(prefs->priv->client);
   for (i = 0; i < devices->len; i++) {
     device = g_ptr_array_index(devices, i);
@@ -715,6 +879,13 @@ static void gpm_prefs_finalize(GObject *object) {
   prefs = GPM_PREFS(object);
   prefs->priv = gpm_prefs_get_instance_private(prefs);
 
+  /* do not lose a value that had not come to rest yet */
+  if (prefs->priv->brightness_commit_id != 0) {
+    gpm_prefs_brightness_commit(prefs);
+    g_settings_sync();
+  }
+  if (prefs->priv->backlight_proxy != NULL)
+    g_object_unref(prefs->priv->backlight_proxy);
   g_object_unref(prefs->priv->settings);
   g_object_unref(prefs->priv->client);
   g_object_unref(prefs->priv->builder);
@@ -0,0 +1,810 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gpm-proc-sampler.h"
+
+/* one slot for each process that has been seen, they are recycled when the
+ * process goes away so a steady system never allocates */
+typedef struct {
+  GpmProcSamplerItem item; /* pid is 0 for a free slot */
+  guint64 ticks;           /* utime + stime */
+  guint64 start;           /* starttime, so a reused pid is noticed */
+  guint64 io_bytes;
+  guint generation; /* the sample it was last seen in */
+  guint history_head;
+  guint history_length;
+  gfloat history[GPM_PROC_SAMPLER_HISTORY];
+} GpmProcSamplerEntry;
+
+struct GpmProcSampler {
+  DIR *dir;
+  gboolean use_io;
+  GArray *entries;    /* of GpmProcSamplerEntry */
+  GArray *free;       /* of guint, the free slots in entries */
+  GHashTable *pids;   /* pid -> slot + 1 */
+  guint generation;   /* incremented for each sample */
+  gboolean primed;    /* if ticks and time are from the last sample */
+  guint length;       /* processes alive in the last sample */
+  guint64 ticks;      /* all the CPU time from /proc/stat */
+  gint64 time;        /* of the last sample, in us */
+  gdouble rate;       /* W, in the last interval */
+  gdouble attributed; /* W, of rate given to processes */
+};
+
+/**
+ * gpm_proc_sampler_read:
+ *
+ * Reads a small file relative to the proc directory into @buffer, without
+ * allocating anything.
+ *
+ * Return value: the number of bytes read, or -1
+ **/
+static gssize gpm_proc_sampler_read(GpmProcSampler *sampler,
+                                    const gchar *filename, gchar *buffer,
+                                    gsize size) {
+  gssize len;
+  gint fd;
+
+  fd = openat(dirfd(sampler->dir), filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return -1;
+  do {
+    len = read(fd, buffer, size - 1);
+  } while (len < 0 && errno == EINTR);
+  close(fd);
+  if (len < 0) return -1;
+  buffer[len] = '\0';
+  return len;
+}
+
+/**
+ * gpm_proc_sampler_parse_stat:
+ *
+ * Picks the name, CPU time and start time out of /proc/[pid]/stat. The
+ * name is in brackets and may itself contain spaces and brackets.
+ **/
+static gboolean gpm_proc_sampler_parse_stat(const gchar *buffer, gchar *name,
+                                            guint64 *ticks, guint64 *start) {
+  const gchar *open;
+  const gchar *close;
+  gchar *end;
+  guint64 value;
+  gsize len;
+  guint field;
+
+  open = strchr(buffer, '(');
+  close = strrchr(buffer, ')');
+  if (open == NULL || close == NULL || close < open || close[1] != ' ')
+    return FALSE;
+  len = MIN((gsize)(close - open - 1), GPM_PROC_SAMPLER_NAME_LENGTH - 1);
+  memcpy(name, open + 1, len);
+  name[len] = '\0';
+
+  /* field 3 is the single character state */
+  end = (gchar *)close + 3;
+  *ticks = 0;
+  for (field = 4; field <= 22; field++) {
+    value = g_ascii_strtoull(end, &end, 10);
+    if (*end != ' ' && *end != '\n' && *end != '\0') return FALSE;
+    if (field == 14 || field == 15)
+      *ticks += value;
+    else if (field == 22)
+      *start = value;
+  }
+  return TRUE;
+}
+
+/**
+ * gpm_proc_sampler_parse_io:
+ *
+ * Return value: the bytes read and written to storage by the process
+ **/
+static guint64 gpm_proc_sampler_parse_io(const gchar *buffer) {
+  const gchar *found;
+  guint64 bytes = 0;
+
+  found = strstr(buffer, "read_bytes: ");
+  if (found != NULL) bytes += g_ascii_strtoull(found + 12, NULL, 10);
+  found = strstr(buffer, "\nwrite_bytes: ");
+  if (found != NULL) bytes += g_ascii_strtoull(found + 14, NULL, 10);
+  return bytes;
+}
+
+/**
+ * gpm_proc_sampler_read_ticks:
+ *
+ * Return value: the time spent by all the processors in any state, which
+ * is what the processes get a share of
+ **/
+static gboolean gpm_proc_sampler_read_ticks(GpmProcSampler *sampler,
+                                            guint64 *ticks) {
+  gchar buffer[256];
+  gchar *end;
+  guint i;
+
+  if (gpm_proc_sampler_read(sampler, "stat", buffer, sizeof(buffer)) < 0)
+    return FALSE;
+  if (!g_str_has_prefix(buffer, "cpu ")) return FALSE;
+
+  /* user nice system idle iowait irq softirq steal, guest time is already
+   * counted as user time */
+  end = buffer + 4;
+  *ticks = 0;
+  for (i = 0; i < 8; i++) *ticks += g_ascii_strtoull(end, &end, 10);
+  return TRUE;
+}
+
+/**
+ * gpm_proc_sampler_new:
+ * @path: the proc filesystem, or %NULL for /proc
+ *
+ * Return value: a new sampler, free with gpm_proc_sampler_free()
+ **/
+GpmProcSampler *gpm_proc_sampler_new(const gchar *path, GError **error) {
+  GpmProcSampler *sampler;
+  DIR *dir;
+
+  if (path == NULL) path = "/proc";
+  dir = opendir(path);
+  if (dir == NULL) {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "cannot open %s: %s", path, g_strerror(errno));
+    return NULL;
+  }
+
+  sampler = g_new0(GpmProcSampler, 1);
+  sampler->dir = dir;
+  sampler->entries = g_array_new(FALSE, FALSE, sizeof(GpmProcSamplerEntry));
+  sampler->free = g_array_new(FALSE, FALSE, sizeof(guint));
+  sampler->pids = g_hash_table_new(g_direct_hash, g_direct_equal);
+  return sampler;
+}
+
+/**
+ * gpm_proc_sampler_free:
+ **/
+void gpm_proc_sampler_free(GpmProcSampler *sampler) {
+  if (sampler == NULL) return;
+  closedir(sampler->dir);
+  g_array_unref(sampler->entries);
+  g_array_unref(sampler->free);
+  g_hash_table_unref(sampler->pids);
+  g_free(sampler);
+}
+
+/**
+ * gpm_proc_sampler_set_use_io:
+ *
+ * Also read /proc/[pid]/io, which costs a second file for each process and
+ * is only readable for our own processes unless we are privileged.
+ **/
+void gpm_proc_sampler_set_use_io(GpmProcSampler *sampler, gboolean use_io) {
+  g_return_if_fail(sampler != NULL);
+  sampler->use_io = use_io;
+}
+
+/**
+ * gpm_proc_sampler_restart:
+ *
+ * Makes the next sample only prime the counters, as if it were the first,
+ * so a gap in sampling is not counted as one long interval. The energy and
+ * history of each process are kept.
+ **/
+void gpm_proc_sampler_restart(GpmProcSampler *sampler) {
+  g_return_if_fail(sampler != NULL);
+  sampler->primed = FALSE;
+}
+
+/**
+ * gpm_proc_sampler_get_entry:
+ *
+ * Return value: the slot for @pid, which is reset if the process is new
+ **/
+static GpmProcSamplerEntry *gpm_proc_sampler_get_entry(GpmProcSampler *sampler,
+                                                       guint pid,
+                                                       guint64 start,
+                                                       gboolean *is_new) {
+  GpmProcSamplerEntry *entry;
+  gpointer value;
+  guint slot;
+
+  value = g_hash_table_lookup(sampler->pids, GUINT_TO_POINTER(pid));
+  if (value != NULL) {
+    entry = &g_array_index(sampler->entries, GpmProcSamplerEntry,
+                           GPOINTER_TO_UINT(value) - 1);
+    /* the same process, and not just the same pid */
+    *is_new = entry->start != start;
+    if (!*is_new) return entry;
+  } else {
+    if (sampler->free->len > 0) {
+      slot = g_array_index(sampler->free, guint, sampler->free->len - 1);
+      g_array_set_size(sampler->free, sampler->free->len - 1);
+    } else {
+      slot = sampler->entries->len;
+      g_array_set_size(sampler->entries, slot + 1);
+    }
+    g_hash_table_insert(sampler->pids, GUINT_TO_POINTER(pid),
+                        GUINT_TO_POINTER(slot + 1));
+    entry = &g_array_index(sampler->entries, GpmProcSamplerEntry, slot);
+    *is_new = TRUE;
+  }
+
+  memset(&entry->item, 0, sizeof(entry->item));
+  entry->item.pid = pid;
+  entry->start = start;
+  entry->history_head = 0;
+  entry->history_length = 0;
+  return entry;
+}
+
+/**
+ * gpm_proc_sampler_sample:
+ * @sampler: a #GpmProcSampler
+ * @time: the monotonic time now, in us
+ * @rate: the power being drawn from the battery in W, or 0
+ *
+ * Diffs the CPU time of every process against the last sample, and gives
+ * each a share of @rate in proportion. Time the processors spent idle is
+ * not given to anybody, and is reported by
+ * gpm_proc_sampler_get_unattributed().
+ *
+ * Return value: %FALSE if the CPU times could not be read
+ **/
+gboolean gpm_proc_sampler_sample(GpmProcSampler *sampler, gint64 time,
+                                 gdouble rate, GError **error) {
+  GpmProcSamplerEntry *entry;
+  struct dirent *dirent;
+  gchar filename[64];
+  gchar buffer[1024];
+  gchar name[GPM_PROC_SAMPLER_NAME_LENGTH];
+  gboolean is_new;
+  gboolean first;
+  gdouble seconds;
+  guint64 total;
+  guint64 ticks;
+  guint64 start;
+  guint64 io_bytes;
+  gchar *end;
+  guint pid;
+  guint i;
+
+  g_return_val_if_fail(sampler != NULL, FALSE);
+
+  if (!gpm_proc_sampler_read_ticks(sampler, &ticks)) {
+    g_set_error_literal(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                        "cannot read the CPU times");
+    return FALSE;
+  }
+  first = !sampler->primed;
+  total = first ? 0 : ticks - sampler->ticks;
+  seconds = first ? 0.0f : (time - sampler->time) / (gdouble)G_USEC_PER_SEC;
+  sampler->ticks = ticks;
+  sampler->time = time;
+  sampler->rate = rate;
+  sampler->attributed = 0.0f;
+  sampler->primed = TRUE;
+  sampler->generation++;
+  sampler->length = 0;
+
+  rewinddir(sampler->dir);
+  while ((dirent = readdir(sampler->dir)) != NULL) {
+    if (!g_ascii_isdigit(dirent->d_name[0])) continue;
+    pid = g_ascii_strtoull(dirent->d_name, &end, 10);
+    if (*end != '\0' || pid == 0) continue;
+
+    /* the process may exit at any point */
+    g_snprintf(filename, sizeof(filename), "%u/stat", pid);
+    if (gpm_proc_sampler_read(sampler, filename, buffer, sizeof(buffer)) < 0)
+      continue;
+    if (!gpm_proc_sampler_parse_stat(buffer, name, &ticks, &start)) continue;
+    io_bytes = 0;
+    if (sampler->use_io) {
+      g_snprintf(filename, sizeof(filename), "%u/io", pid);
+      if (gpm_proc_sampler_read(sampler, filename, buffer, sizeof(buffer)) > 0)
+        io_bytes = gpm_proc_sampler_parse_io(buffer);
+    }
+
+    entry = gpm_proc_sampler_get_entry(sampler, pid, start, &is_new);
+    entry->generation = sampler->generation;
+    sampler->length++;
+    memcpy(entry->item.name, name, sizeof(name));
+    if (first) {
+      entry->item.cpu = 0.0f;
+      entry->item.power = 0.0f;
+      entry->item.io = 0.0f;
+    } else if (!is_new) {
+      entry->item.cpu = 0.0f;
+      if (total > 0 && ticks >= entry->ticks)
+        entry->item.cpu = (gdouble)(ticks - entry->ticks) / total;
+      entry->item.power = rate * entry->item.cpu;
+      entry->item.energy += entry->item.power * seconds / 3600.0f;
+      entry->item.io = 0.0f;
+      if (seconds > 0.0f && io_bytes >= entry->io_bytes)
+        entry->item.io = (io_bytes - entry->io_bytes) / seconds;
+      sampler->attributed += entry->item.power;
+
+      /* a ring, with history_head the next to be written */
+      entry->history[entry->history_head] = entry->item.power;
+      entry->history_head =
+          (entry->history_head + 1) % GPM_PROC_SAMPLER_HISTORY;
+      if (entry->history_length < GPM_PROC_SAMPLER_HISTORY)
+        entry->history_length++;
+    }
+    entry->ticks = ticks;
+    entry->io_bytes = io_bytes;
+  }
+
+  /* anything not seen this time has exited */
+  for (i = 0; i < sampler->entries->len; i++) {
+    entry = &g_array_index(sampler->entries, GpmProcSamplerEntry, i);
+    if (entry->item.pid == 0 || entry->generation == sampler->generation)
+      continue;
+    g_hash_table_remove(sampler->pids, GUINT_TO_POINTER(entry->item.pid));
+    entry->item.pid = 0;
+    g_array_append_val(sampler->free, i);
+  }
+  return TRUE;
+}
+
+/**
+ * gpm_proc_sampler_get_length:
+ *
+ * Return value: the number of processes seen in the last sample
+ **/
+guint gpm_proc_sampler_get_length(GpmProcSampler *sampler) {
+  g_return_val_if_fail(sampler != NULL, 0);
+  return sampler->length;
+}
+
+/**
+ * gpm_proc_sampler_get_unattributed:
+ *
+ * Return value: the W in the last interval not given to any process, i.e.
+ * the screen, the idle processors and everything else
+ **/
+gdouble gpm_proc_sampler_get_unattributed(GpmProcSampler *sampler) {
+  g_return_val_if_fail(sampler != NULL, 0.0f);
+  return MAX(sampler->rate - sampler->attributed, 0.0f);
+}
+
+/**
+ * gpm_proc_sampler_lookup:
+ *
+ * Return value: the process, valid until the next sample, or %NULL
+ **/
+const GpmProcSamplerItem *gpm_proc_sampler_lookup(GpmProcSampler *sampler,
+                                                  guint pid) {
+  gpointer value;
+
+  g_return_val_if_fail(sampler != NULL, NULL);
+
+  value = g_hash_table_lookup(sampler->pids, GUINT_TO_POINTER(pid));
+  if (value == NULL) return NULL;
+  return &g_array_index(sampler->entries, GpmProcSamplerEntry,
+                        GPOINTER_TO_UINT(value) - 1)
+              .item;
+}
+
+/**
+ * gpm_proc_sampler_sift_down:
+ *
+ * Restores the min-heap on the CPU share, starting at @i.
+ **/
+static void gpm_proc_sampler_sift_down(const GpmProcSamplerItem **heap,
+                                       guint length, guint i) {
+  const GpmProcSamplerItem *tmp;
+  guint smallest;
+  guint child;
+
+  for (;;) {
+    smallest = i;
+    child = 2 * i + 1;
+    if (child < length && heap[child]->cpu < heap[smallest]->cpu)
+      smallest = child;
+    if (child + 1 < length && heap[child + 1]->cpu < heap[smallest]->cpu)
+      smallest = child + 1;
+    if (smallest == i) return;
+    tmp = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = tmp;
+    i = smallest;
+  }
+}
+
+/**
+ * gpm_proc_sampler_heapify:
+ **/
+static void gpm_proc_sampler_heapify(const GpmProcSamplerItem **heap,
+                                     guint length) {
+  guint i;
+  for (i = length / 2; i > 0; i--)
+    gpm_proc_sampler_sift_down(heap, length, i - 1);
+}
+
+/**
+ * gpm_proc_sampler_get_top:
+ * @items: the array to fill, of at least @length
+ * @length: how many processes are wanted
+ *
+ * Finds the processes using the most CPU, and so power, in the last
+ * interval without sorting everything.
+ *
+ * Return value: the number of @items filled in, the busiest first
+ **/
+guint gpm_proc_sampler_get_top(GpmProcSampler *sampler,
+                               const GpmProcSamplerItem **items,
+                               guint length) {
+  const GpmProcSamplerItem *item;
+  const GpmProcSamplerItem *tmp;
+  guint filled = 0;
+  guint i;
+
+  g_return_val_if_fail(sampler != NULL, 0);
+  g_return_val_if_fail(items != NULL || length == 0, 0);
+
+  if (length == 0) return 0;
+
+  /* keep the busiest seen so far in a min-heap, so the least busy of them
+   * is the one to compare against */
+  for (i = 0; i < sampler->entries->len; i++) {
+    item = &g_array_index(sampler->entries, GpmProcSamplerEntry, i).item;
+    if (item->pid == 0) continue;
+    if (filled < length) {
+      items[filled++] = item;
+      if (filled == length) gpm_proc_sampler_heapify(items, length);
+      continue;
+    }
+    if (item->cpu <= items[0]->cpu) continue;
+    items[0] = item;
+    gpm_proc_sampler_sift_down(items, length, 0);
+  }
+  if (filled < length) gpm_proc_sampler_heapify(items, filled);
+
+  /* heap sort, the least busy goes to the end each time */
+  for (i = filled; i > 1; i--) {
+    tmp = items[0];
+    items[0] = items[i - 1];
+    items[i - 1] = tmp;
+    gpm_proc_sampler_sift_down(items, i - 1, 0);
+  }
+  return filled;
+}
+
+/**
+ * gpm_proc_sampler_get_history:
+ * @power: the array to fill, of at least @length
+ * @length: the most samples wanted
+ *
+ * Return value: the number of samples of power in W copied for @pid,
+ * oldest first and ending with the last sample
+ **/
+guint gpm_proc_sampler_get_history(GpmProcSampler *sampler, guint pid,
+                                   gfloat *power, guint length) {
+  GpmProcSamplerEntry *entry;
+  gpointer value;
+  guint count;
+  guint i;
+
+  g_return_val_if_fail(sampler != NULL, 0);
+
+  value = g_hash_table_lookup(sampler->pids, GUINT_TO_POINTER(pid));
+  if (value == NULL) return 0;
+  entry = &g_array_index(sampler->entries, GpmProcSamplerEntry,
+                         GPOINTER_TO_UINT(value) - 1);
+  count = MIN(length, entry->history_length);
+  for (i = 0; i < count; i++)
+    power[i] = entry->history[(entry->history_head + GPM_PROC_SAMPLER_HISTORY -
+                               count + i) %
+                              GPM_PROC_SAMPLER_HISTORY];
+  return count;
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+static void gpm_proc_sampler_test_set_total(const gchar *path, guint64 ticks) {
+  gchar *filename;
+  gchar *contents;
+
+  filename = g_build_filename(path, "stat", NULL);
+  contents = g_strdup_printf(
+      "cpu  %" G_GUINT64_FORMAT " 0 0 0 0 0 0 0 0 0\ncpu0 0 0 0 0\n", ticks);
+  g_file_set_contents(filename, contents, -1, NULL);
+  g_free(contents);
+  g_free(filename);
+}
+
+static void gpm_proc_sampler_test_set_process(const gchar *path, guint pid,
+                                              const gchar *name, guint utime,
+                                              guint stime, guint start) {
+  gchar *directory;
+  gchar *filename;
+  gchar *contents;
+
+  directory = g_strdup_printf("%s/%u", path, pid);
+  g_mkdir_with_parents(directory, 0700);
+  filename = g_build_filename(directory, "stat", NULL);
+  contents = g_strdup_printf(
+      "%u (%s) S 1 %u %u 0 -1 4194560 120 0 0 0 %u %u 0 0 20 0 1 0 %u "
+      "1000000 100 18446744073709551615 0 0 0 0 0 0 0 0 0 0 0 0 17 3 0 0\n",
+      pid, name, pid, pid, utime, stime, start);
+  g_file_set_contents(filename, contents, -1, NULL);
+  g_free(contents);
+  g_free(filename);
+  g_free(directory);
+}
+
+static void gpm_proc_sampler_test_set_io(const gchar *path, guint pid,
+                                         guint64 read, guint64 written) {
+  gchar *filename;
+  gchar *contents;
+
+  filename = g_strdup_printf("%s/%u/io", path, pid);
+  contents = g_strdup_printf(
+      "rchar: 1\nwchar: 2\nsyscr: 3\nsyscw: 4\nread_bytes: %" G_GUINT64_FORMAT
+      "\nwrite_bytes: %" G_GUINT64_FORMAT "\ncancelled_write_bytes: 0\n",
+      read, written);
+  g_file_set_contents(filename, contents, -1, NULL);
+  g_free(contents);
+  g_free(filename);
+}
+
+static void gpm_proc_sampler_test_remove(const gchar *path) {
+  const gchar *name;
+  gchar *filename;
+  GDir *dir;
+
+  dir = g_dir_open(path, 0, NULL);
+  if (dir == NULL) return;
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    filename = g_build_filename(path, name, NULL);
+    if (g_file_test(filename, G_FILE_TEST_IS_DIR))
+      gpm_proc_sampler_test_remove(filename);
+    else
+      g_unlink(filename);
+    g_free(filename);
+  }
+  g_dir_close(dir);
+  g_rmdir(path);
+}
+
+void gpm_proc_sampler_test(gpointer data) {
+  GpmProcSampler *sampler;
+  const GpmProcSamplerItem *item;
+  const GpmProcSamplerItem *top[8];
+  gfloat history[GPM_PROC_SAMPLER_HISTORY + 10];
+  gchar *path;
+  gchar *filename;
+  gboolean ret;
+  gdouble overhead;
+  guint64 ticks;
+  guint elapsed;
+  guint length;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmProcSampler")) return;
+
+  path = g_build_filename(g_get_tmp_dir(), "gpm-self-test-proc", NULL);
+  gpm_proc_sampler_test_remove(path);
+
+  /************************************************************/
+  egg_test_title(test, "fails without a proc directory");
+  sampler = gpm_proc_sampler_new(path, NULL);
+  egg_test_assert(test, sampler == NULL);
+
+  /************************************************************/
+  egg_test_title(test, "first sample finds processes");
+  g_mkdir_with_parents(path, 0700);
+  gpm_proc_sampler_test_set_total(path, 10000);
+  gpm_proc_sampler_test_set_process(path, 1, "init", 10, 10, 1);
+  gpm_proc_sampler_test_set_process(path, 42, "busy", 100, 0, 5);
+  gpm_proc_sampler_test_set_process(path, 99, "a (weird) name", 0, 0, 7);
+  gpm_proc_sampler_test_set_process(path, 1000, "quiet", 5, 5, 9);
+  filename = g_build_filename(path, "self", NULL);
+  g_mkdir_with_parents(filename, 0700);
+  g_free(filename);
+  sampler = gpm_proc_sampler_new(path, NULL);
+  ret = gpm_proc_sampler_sample(sampler, 0, 10.0f, NULL);
+  item = gpm_proc_sampler_lookup(sampler, 42);
+  egg_test_assert(test, ret && gpm_proc_sampler_get_length(sampler) == 4 &&
+                            item != NULL && item->cpu == 0.0f &&
+                            g_strcmp0(item->name, "busy") == 0);
+
+  /************************************************************/
+  egg_test_title(test, "name with brackets and spaces");
+  item = gpm_proc_sampler_lookup(sampler, 99);
+  if (item != NULL && g_strcmp0(item->name, "a (weird) name") == 0)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got '%s'", item != NULL ? item->name : NULL);
+
+  /************************************************************/
+  egg_test_title(test, "power apportioned by CPU share");
+  gpm_proc_sampler_test_set_total(path, 11000);
+  gpm_proc_sampler_test_set_process(path, 42, "busy", 300, 200, 5);
+  gpm_proc_sampler_test_set_process(path, 1000, "quiet", 10, 10, 9);
+  gpm_proc_sampler_sample(sampler, 10 * G_USEC_PER_SEC, 10.0f, NULL);
+  item = gpm_proc_sampler_lookup(sampler, 42);
+  if (item != NULL && fabs(item->cpu - 0.4f) < 0.0001f &&
+      fabs(item->power - 4.0f) < 0.0001f &&
+      fabs(gpm_proc_sampler_get_unattributed(sampler) - 5.9f) < 0.0001f)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %f, %fW", item != NULL ? item->cpu : 0.0f,
+                    item != NULL ? item->power : 0.0f);
+
+  /************************************************************/
+  egg_test_title(test, "energy integrated over the interval");
+  if (item != NULL && fabs(item->energy - 4.0f * 10.0f / 3600.0f) < 0.00001f)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %fWh", item != NULL ? item->energy : 0.0f);
+
+  /************************************************************/
+  egg_test_title(test, "busiest processes first");
+  length = gpm_proc_sampler_get_top(sampler, top, 3);
+  if (length == 3 && top[0]->pid == 42 && top[1]->pid == 1000 &&
+      top[2]->cpu == 0.0f)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %i items", length);
+
+  /************************************************************/
+  egg_test_title(test, "asking for more than there are");
+  length = gpm_proc_sampler_get_top(sampler, top, 8);
+  egg_test_assert(test, length == 4 && top[0]->pid == 42 &&
+                            top[1]->pid == 1000 && top[3]->cpu == 0.0f);
+
+  /************************************************************/
+  egg_test_title(test, "exited process forgotten and slot reused");
+  filename = g_strdup_printf("%s/1000", path);
+  gpm_proc_sampler_test_remove(filename);
+  g_free(filename);
+  gpm_proc_sampler_sample(sampler, 20 * G_USEC_PER_SEC, 10.0f, NULL);
+  ret = gpm_proc_sampler_lookup(sampler, 1000) == NULL &&
+        gpm_proc_sampler_get_length(sampler) == 3;
+  gpm_proc_sampler_test_set_process(path, 1001, "new", 50, 50, 30);
+  gpm_proc_sampler_sample(sampler, 30 * G_USEC_PER_SEC, 10.0f, NULL);
+  item = gpm_proc_sampler_lookup(sampler, 1001);
+  egg_test_assert(test, ret && item != NULL && item->cpu == 0.0f &&
+                            gpm_proc_sampler_get_length(sampler) == 4);
+
+  /************************************************************/
+  egg_test_title(test, "reused pid is a new process");
+  gpm_proc_sampler_test_set_process(path, 42, "other", 600, 200, 50);
+  gpm_proc_sampler_sample(sampler, 40 * G_USEC_PER_SEC, 10.0f, NULL);
+  item = gpm_proc_sampler_lookup(sampler, 42);
+  egg_test_assert(test, item != NULL && item->cpu == 0.0f &&
+                            item->energy == 0.0f &&
+                            g_strcmp0(item->name, "other") == 0);
+
+  /************************************************************/
+  egg_test_title(test, "restart only primes the counters");
+  gpm_proc_sampler_restart(sampler);
+  gpm_proc_sampler_test_set_total(path, 11050);
+  gpm_proc_sampler_test_set_process(path, 42, "other", 650, 200, 50);
+  gpm_proc_sampler_sample(sampler, 45 * G_USEC_PER_SEC, 10.0f, NULL);
+  item = gpm_proc_sampler_lookup(sampler, 42);
+  length = gpm_proc_sampler_get_history(sampler, 42, history,
+                                        G_N_ELEMENTS(history));
+  egg_test_assert(test, item != NULL && item->cpu == 0.0f &&
+                            item->energy == 0.0f && length == 0);
+
+  /************************************************************/
+  egg_test_title(test, "history is a ring of the power");
+  ticks = 11000;
+  for (i = 0; i < GPM_PROC_SAMPLER_HISTORY + 5; i++) {
+    ticks += 100;
+    gpm_proc_sampler_test_set_total(path, ticks);
+    gpm_proc_sampler_test_set_process(path, 1001, "new", 50 + i, 50, 30);
+    gpm_proc_sampler_sample(sampler, (50 + i) * G_USEC_PER_SEC, i, NULL);
+  }
+  length = gpm_proc_sampler_get_history(sampler, 1001, history,
+                                        G_N_ELEMENTS(history));
+  ret = length == GPM_PROC_SAMPLER_HISTORY;
+
+  /* a 1% share of i W in sample i, and the first five have been dropped */
+  for (i = 0; i < length && ret; i++) {
+    if (fabs(history[i] - (i + 5) / 100.0f) > 0.0001f) ret = FALSE;
+  }
+  if (ret)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %i samples ending %f", length,
+                    history[length - 1]);
+
+  /************************************************************/
+  egg_test_title(test, "storage i/o when asked for");
+  gpm_proc_sampler_set_use_io(sampler, TRUE);
+  gpm_proc_sampler_test_set_io(path, 1, 4096, 4096);
+  gpm_proc_sampler_sample(sampler, 1000 * G_USEC_PER_SEC, 0.0f, NULL);
+  gpm_proc_sampler_test_set_io(path, 1, 4096 + 10000, 4096 + 30000);
+  gpm_proc_sampler_sample(sampler, 1010 * G_USEC_PER_SEC, 0.0f, NULL);
+  item = gpm_proc_sampler_lookup(sampler, 1);
+  if (item != NULL && fabs(item->io - 4000.0f) < 0.001f)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %f bytes/s", item != NULL ? item->io : 0.0f);
+  gpm_proc_sampler_free(sampler);
+
+  /************************************************************/
+  length = 4000;
+  for (i = 0; i < length; i++)
+    gpm_proc_sampler_test_set_process(path, 2000 + i, "worker", i, i, 100);
+  sampler = gpm_proc_sampler_new(path, NULL);
+  gpm_proc_sampler_sample(sampler, 0, 10.0f, NULL);
+  egg_test_title(test, "sample %i processes", length);
+  for (i = 1; i <= 10; i++)
+    gpm_proc_sampler_sample(sampler, i * 5 * G_USEC_PER_SEC, 10.0f, NULL);
+  elapsed = egg_test_elapsed(test);
+
+  /* the page samples every 5 seconds */
+  overhead = elapsed / 10.0f / (5.0f * 1000.0f) * 100.0f;
+  if (gpm_proc_sampler_get_length(sampler) >= length)
+    egg_test_success(test, "%.1fms for each sample, %.2f%% of one core",
+                     elapsed / 10.0f, overhead);
+  else
+    egg_test_failed(test, "found %i processes",
+                    gpm_proc_sampler_get_length(sampler));
+  gpm_proc_sampler_free(sampler);
+  gpm_proc_sampler_test_remove(path);
+
+  /************************************************************/
+  egg_test_title(test, "finds ourselves in /proc");
+  sampler = gpm_proc_sampler_new(NULL, NULL);
+  if (sampler == NULL) {
+    egg_test_success(test, "no /proc, ignoring");
+  } else {
+    gpm_proc_sampler_sample(sampler, g_get_monotonic_time(), 10.0f, NULL);
+    ret = gpm_proc_sampler_sample(sampler, g_get_monotonic_time(), 10.0f,
+                                  NULL);
+    item = gpm_proc_sampler_lookup(sampler, getpid());
+    if (ret && item != NULL)
+      egg_test_success(test, "%i processes, %.1f%% cpu",
+                       gpm_proc_sampler_get_length(sampler),
+                       item->cpu * 100.0f);
+    else
+      egg_test_failed(test, "did not find %i", getpid());
+    gpm_proc_sampler_free(sampler);
+  }
+
+  g_free(path);
+
+  egg_test_end(test);
+}
+
+#endif
@@ -0,0 +1,65 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_PROC_SAMPLER_H
+#define __GPM_PROC_SAMPLER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* the kernel truncates process names to 15 characters */
+#define GPM_PROC_SAMPLER_NAME_LENGTH 16
+/* how many samples of power are kept for each process */
+#define GPM_PROC_SAMPLER_HISTORY 120
+
+typedef struct {
+  guint pid;
+  gchar name[GPM_PROC_SAMPLER_NAME_LENGTH];
+  gdouble cpu;    /* share of all the CPU time in the last interval */
+  gdouble power;  /* W apportioned to the process in the last interval */
+  gdouble energy; /* Wh apportioned to the process since it was first seen */
+  gdouble io;     /* bytes per second read and written to storage */
+} GpmProcSamplerItem;
+
+typedef struct GpmProcSampler GpmProcSampler;
+
+GpmProcSampler *gpm_proc_sampler_new(const gchar *path, GError **error);
+void gpm_proc_sampler_free(GpmProcSampler *sampler);
+void gpm_proc_sampler_set_use_io(GpmProcSampler *sampler, gboolean use_io);
+void gpm_proc_sampler_restart(GpmProcSampler *sampler);
+gboolean gpm_proc_sampler_sample(GpmProcSampler *sampler, gint64 time,
+                                 gdouble rate, GError **error);
+guint gpm_proc_sampler_get_length(GpmProcSampler *sampler);
+gdouble gpm_proc_sampler_get_unattributed(GpmProcSampler *sampler);
+const GpmProcSamplerItem *gpm_proc_sampler_lookup(GpmProcSampler *sampler,
+                                                  guint pid);
+guint gpm_proc_sampler_get_top(GpmProcSampler *sampler,
+                               const GpmProcSamplerItem **items, guint length);
+guint gpm_proc_sampler_get_history(GpmProcSampler *sampler, guint pid,
+                                   gfloat *power, guint length);
+#ifdef EGG_TEST
+void gpm_proc_sampler_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_PROC_SAMPLER_H */
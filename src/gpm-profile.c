@@ -0,0 +1,192 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gpm-profile.h"
+
+typedef struct {
+  const gchar *stage;
+  gint64 wall; /* us */
+  gint64 cpu;  /* us */
+} GpmProfileItem;
+
+/* NULL unless profiling, so a mark costs nothing normally */
+static GArray *gpm_profile_items = NULL; /* of GpmProfileItem */
+static gint64 gpm_profile_wall = 0;
+static gint64 gpm_profile_cpu = 0;
+
+/**
+ * gpm_profile_get_cpu:
+ *
+ * Return value: CPU time used by all the threads of the process, in us
+ **/
+static gint64 gpm_profile_get_cpu(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) return 0;
+  return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+/**
+ * gpm_profile_start:
+ *
+ * Starts timing, from now until the first gpm_profile_mark() is the first
+ * stage. Any stages from an earlier run are discarded.
+ **/
+void gpm_profile_start(void) {
+  if (gpm_profile_items == NULL)
+    gpm_profile_items = g_array_new(FALSE, FALSE, sizeof(GpmProfileItem));
+  g_array_set_size(gpm_profile_items, 0);
+  gpm_profile_wall = g_get_monotonic_time();
+  gpm_profile_cpu = gpm_profile_get_cpu();
+}
+
+/**
+ * gpm_profile_stop:
+ **/
+void gpm_profile_stop(void) {
+  if (gpm_profile_items == NULL) return;
+  g_array_unref(gpm_profile_items);
+  gpm_profile_items = NULL;
+}
+
+/**
+ * gpm_profile_is_running:
+ **/
+gboolean gpm_profile_is_running(void) { return gpm_profile_items != NULL; }
+
+/**
+ * gpm_profile_mark:
+ * @stage: The name of the stage that has just finished, which must be static
+ *
+ * Records the wall and CPU time since the last mark against @stage.
+ **/
+void gpm_profile_mark(const gchar *stage) {
+  GpmProfileItem item;
+  gint64 wall;
+  gint64 cpu;
+
+  if (gpm_profile_items == NULL) return;
+
+  wall = g_get_monotonic_time();
+  cpu = gpm_profile_get_cpu();
+  item.stage = stage;
+  item.wall = wall - gpm_profile_wall;
+  item.cpu = MAX(cpu - gpm_profile_cpu, 0);
+  g_array_append_val(gpm_profile_items, item);
+  gpm_profile_wall = wall;
+  gpm_profile_cpu = cpu;
+}
+
+/**
+ * gpm_profile_get_length:
+ * Return value: the number of stages recorded
+ **/
+guint gpm_profile_get_length(void) {
+  if (gpm_profile_items == NULL) return 0;
+  return gpm_profile_items->len;
+}
+
+/**
+ * gpm_profile_to_string:
+ * Return value: a table of the stages and a total, free with g_free()
+ **/
+gchar *gpm_profile_to_string(void) {
+  GpmProfileItem *item;
+  GString *string;
+  gint64 wall = 0;
+  gint64 cpu = 0;
+  guint i;
+
+  string = g_string_new(NULL);
+  g_string_append_printf(string, "%-24s %10s %10s\n", "stage", "wall ms",
+                         "cpu ms");
+  for (i = 0; i < gpm_profile_get_length(); i++) {
+    item = &g_array_index(gpm_profile_items, GpmProfileItem, i);
+    g_string_append_printf(string, "%-24s %10.2f %10.2f\n", item->stage,
+                           item->wall / 1000.0, item->cpu / 1000.0);
+    wall += item->wall;
+    cpu += item->cpu;
+  }
+  g_string_append_printf(string, "%-24s %10.2f %10.2f\n", "total",
+                         wall / 1000.0, cpu / 1000.0);
+  return g_string_free(string, FALSE);
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+void gpm_profile_test(gpointer data) {
+  GpmProfileItem *item;
+  gchar *text;
+  gint64 start;
+  volatile guint spin = 0;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmProfile")) return;
+
+  /************************************************************/
+  egg_test_title(test, "marks do nothing when not running");
+  gpm_profile_mark("ignored");
+  egg_test_assert(test, !gpm_profile_is_running() &&
+                            gpm_profile_get_length() == 0);
+
+  /************************************************************/
+  egg_test_title(test, "stages are recorded in order");
+  gpm_profile_start();
+  gpm_profile_mark("first");
+  start = g_get_monotonic_time();
+  while (g_get_monotonic_time() - start < 20000) spin++;
+  gpm_profile_mark("second");
+  text = gpm_profile_to_string();
+  if (gpm_profile_get_length() == 2 && strstr(text, "first") != NULL &&
+      strstr(text, "second") > strstr(text, "first") &&
+      strstr(text, "total") != NULL)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "invalid output:\n%s", text);
+  g_free(text);
+
+  /************************************************************/
+  egg_test_title(test, "busy stages use CPU time");
+  item = &g_array_index(gpm_profile_items, GpmProfileItem, 1);
+  egg_test_assert(test, item->wall >= 20000 && item->cpu > 0);
+
+  /************************************************************/
+  egg_test_title(test, "starting again discards the old stages");
+  gpm_profile_start();
+  egg_test_assert(test, gpm_profile_get_length() == 0);
+
+  gpm_profile_stop();
+  egg_test_end(test);
+}
+
+#endif
@@ -0,0 +1,41 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_PROFILE_H
+#define __GPM_PROFILE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void gpm_profile_start(void);
+void gpm_profile_stop(void);
+gboolean gpm_profile_is_running(void);
+void gpm_profile_mark(const gchar *stage);
+guint gpm_profile_get_length(void);
+gchar *gpm_profile_to_string(void);
+#ifdef EGG_TEST
+void gpm_profile_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_PROFILE_H */
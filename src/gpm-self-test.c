@@ -38,6 +38,25 @@ void egg_array_float_test(EggTest *test);
 void egg_idletime_test(EggTest *test);
 
 void gpm_common_test(EggTest *test);
+void gpm_history_cache_test(EggTest *test);
+void gpm_history_pyramid_test(EggTest *test);
+void gpm_point_obj_test(EggTest *test);
+void gpm_timeline_test(EggTest *test);
+void gpm_trace_test(EggTest *test);
+void gpm_metrics_test(EggTest *test);
+void gpm_profile_test(EggTest *test);
+void gpm_state_page_test(EggTest *test);
+void gpm_broker_page_test(EggTest *test);
+void gpm_cpu_sysfs_test(EggTest *test);
+void gpm_cpu_policy_test(EggTest *test);
+void gpm_platform_profile_test(EggTest *test);
+void gpm_power_profiles_test(EggTest *test);
+void gpm_series_test(EggTest *test);
+void gpm_energy_test(EggTest *test);
+void gpm_estimator_test(EggTest *test);
+void gpm_engine_test(EggTest *test);
+void gpm_proc_sampler_test(EggTest *test);
+void gpm_dim_learner_test(EggTest *test);
 void gpm_idle_test(EggTest *test);
 void gpm_phone_test(EggTest *test);
 void gpm_dpms_test(EggTest *test);
@@ -63,6 +82,25 @@ int main(int argc, char **argv) {
   //	egg_idletime_test (test);
 
   gpm_common_test(test);
+  gpm_history_cache_test(test);
+  gpm_history_pyramid_test(test);
+  gpm_point_obj_test(test);
+  gpm_timeline_test(test);
+  gpm_trace_test(test);
+  gpm_metrics_test(test);
+  gpm_profile_test(test);
+  gpm_state_page_test(test);
+  gpm_broker_page_test(test);
+  gpm_cpu_sysfs_test(test);
+  gpm_cpu_policy_test(test);
+  gpm_platform_profile_test(test);
+  gpm_power_profiles_test(test);
+  gpm_series_test(test);
+  gpm_energy_test(test);
+  gpm_estimator_test(test);
+  gpm_engine_test(test);
+  gpm_proc_sampler_test(test);
+  gpm_dim_learner_test(test);
   //	gpm_idle_test (test);
   gpm_phone_test(test);
   //	gpm_dpms_test (test);
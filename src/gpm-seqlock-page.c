@@ -0,0 +1,279 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gpm-seqlock-page.h"
+
+/* the writer only holds the sequence odd for a few stores */
+#define GPM_SEQLOCK_PAGE_RETRIES 1000
+
+/**
+ * gpm_seqlock_page_set_error:
+ **/
+static void gpm_seqlock_page_set_error(GError **error, const gchar *filename,
+                                       const gchar *what) {
+  gint saved_errno = errno;
+  g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+              "failed to %s %s: %s", what, filename, g_strerror(saved_errno));
+}
+
+/**
+ * gpm_seqlock_page_begin:
+ * @page: A page from gpm_seqlock_page_create()
+ *
+ * The stores to the page are plain ones, so the fences keep them after the
+ * odd sequence here and before the even one in gpm_seqlock_page_end(), as
+ * smp_wmb() does for the kernel's seqcounts.
+ **/
+void gpm_seqlock_page_begin(gpointer page) {
+  g_atomic_int_inc(&((GpmSeqlockPage *)page)->sequence);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * gpm_seqlock_page_end:
+ * @page: A page from gpm_seqlock_page_create()
+ **/
+void gpm_seqlock_page_end(gpointer page) {
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  g_atomic_int_inc(&((GpmSeqlockPage *)page)->sequence);
+}
+
+/**
+ * gpm_seqlock_page_retire:
+ * @page: A page from gpm_seqlock_page_create()
+ *
+ * Tells the readers still mapping @page that it will not change again, so
+ * that they open the file afresh.
+ **/
+void gpm_seqlock_page_retire(gpointer page) {
+  g_return_if_fail(page != NULL);
+  gpm_seqlock_page_begin(page);
+  ((GpmSeqlockPage *)page)->magic = 0;
+  gpm_seqlock_page_end(page);
+}
+
+/**
+ * gpm_seqlock_page_retire_file:
+ *
+ * Retires what an earlier writer left behind, which matters if it crashed.
+ **/
+static void gpm_seqlock_page_retire_file(const gchar *filename, gsize size,
+                                         guint32 magic) {
+  gpointer map;
+  gint fd;
+
+  fd = g_open(filename, O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0) return;
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return;
+  if (((GpmSeqlockPage *)map)->magic == magic) gpm_seqlock_page_retire(map);
+  munmap(map, size);
+}
+
+/**
+ * gpm_seqlock_page_create:
+ * @filename: Where to publish the page
+ * @size: How much to map
+ * @header: What the page starts with, including the magic and version
+ * @header_size: How much of @header to copy, the rest being zero
+ *
+ * Creates a page that every user can read. It is built under another name
+ * and renamed into place, so a reader never maps a half made page, and any
+ * page that was there before is retired.
+ *
+ * Return value: the writable page, or %NULL
+ **/
+gpointer gpm_seqlock_page_create(const gchar *filename, gsize size,
+                                 gconstpointer header, gsize header_size,
+                                 GError **error) {
+  GpmSeqlockPage *page = NULL;
+  gchar *tmp;
+  gpointer map;
+  gint fd;
+
+  g_return_val_if_fail(header_size >= sizeof(GpmSeqlockPage), NULL);
+  g_return_val_if_fail(header_size <= size, NULL);
+
+  tmp = g_strdup_printf("%s.XXXXXX", filename);
+  fd = g_mkstemp_full(tmp, O_RDWR | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    gpm_seqlock_page_set_error(error, tmp, "create");
+    goto out;
+  }
+  if (ftruncate(fd, size) < 0) {
+    gpm_seqlock_page_set_error(error, tmp, "size");
+    goto out;
+  }
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    gpm_seqlock_page_set_error(error, tmp, "map");
+    goto out;
+  }
+  page = map;
+  memcpy(page, header, header_size);
+  page->sequence = 0;
+  gpm_seqlock_page_retire_file(filename, size, page->magic);
+  if (g_rename(tmp, filename) < 0) {
+    gpm_seqlock_page_set_error(error, filename, "rename to");
+    munmap(page, size);
+    page = NULL;
+  }
+out:
+  if (fd >= 0) {
+    if (page == NULL) g_unlink(tmp);
+    close(fd);
+  }
+  g_free(tmp);
+  return page;
+}
+
+/**
+ * gpm_seqlock_page_map:
+ * @fd: The opened page, which is closed
+ * @filename: What @fd is, for the error
+ * @size: How much to map
+ * @magic: What the page has to start with
+ * @version: And the version it has to be
+ * @what: What kind of page it is, for the error
+ *
+ * Maps a page read-only, for callers that want to check the file before
+ * trusting it.
+ *
+ * Return value: the page, or %NULL if it is not one we know
+ **/
+gconstpointer gpm_seqlock_page_map(gint fd, const gchar *filename, gsize size,
+                                   guint32 magic, guint32 version,
+                                   const gchar *what, GError **error) {
+  const GpmSeqlockPage *page;
+  struct stat buf;
+  gpointer map;
+
+  if (fstat(fd, &buf) < 0) {
+    gpm_seqlock_page_set_error(error, filename, "stat");
+    close(fd);
+    return NULL;
+  }
+  if (buf.st_size < (goffset)size) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "%s is too small to be a %s page", filename, what);
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    gpm_seqlock_page_set_error(error, filename, "map");
+    return NULL;
+  }
+  page = map;
+  if (page->magic != magic || page->version != version) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "%s is not a version %u %s page", filename, version, what);
+    munmap(map, size);
+    return NULL;
+  }
+  return page;
+}
+
+/**
+ * gpm_seqlock_page_open:
+ * @filename: Where the page is published
+ * @size: How much to map
+ * @magic: What the page has to start with
+ * @version: And the version it has to be
+ * @what: What kind of page it is, for the error
+ *
+ * Maps a page read-only, which is all a reader has to do; reading it
+ * afterwards needs no system calls at all.
+ *
+ * Return value: the page, or %NULL if it is missing or not one we know
+ **/
+gconstpointer gpm_seqlock_page_open(const gchar *filename, gsize size,
+                                    guint32 magic, guint32 version,
+                                    const gchar *what, GError **error) {
+  gint fd;
+
+  fd = g_open(filename, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    gpm_seqlock_page_set_error(error, filename, "open");
+    return NULL;
+  }
+  return gpm_seqlock_page_map(fd, filename, size, magic, version, what, error);
+}
+
+/**
+ * gpm_seqlock_page_read:
+ * @page: A mapped page
+ * @snapshot: Where to copy it
+ * @size: How much to copy
+ *
+ * Takes a consistent copy of the page, retrying if the writer was part way
+ * through a change.
+ *
+ * Return value: %FALSE if no consistent copy could be had, or the page was
+ * retired and should be opened again
+ **/
+gboolean gpm_seqlock_page_read(gconstpointer page, gpointer snapshot,
+                               gsize size) {
+  const GpmSeqlockPage *header = page;
+  gint sequence;
+  guint i;
+
+  g_return_val_if_fail(page != NULL, FALSE);
+  g_return_val_if_fail(snapshot != NULL, FALSE);
+
+  for (i = 0; i < GPM_SEQLOCK_PAGE_RETRIES; i++) {
+    sequence = g_atomic_int_get(&header->sequence);
+    if (sequence % 2 != 0) continue;
+    memcpy(snapshot, page, size);
+    /* the copy must not be read after the sequence is checked again */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (g_atomic_int_get(&header->sequence) != sequence) continue;
+    if (((GpmSeqlockPage *)snapshot)->magic == 0) return FALSE;
+    ((GpmSeqlockPage *)snapshot)->sequence = sequence;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * gpm_seqlock_page_close:
+ * @page: A page from gpm_seqlock_page_create() or gpm_seqlock_page_open()
+ * @size: What was mapped
+ **/
+void gpm_seqlock_page_close(gconstpointer page, gsize size) {
+  if (page == NULL) return;
+  munmap((gpointer)page, size);
+}
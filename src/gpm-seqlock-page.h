@@ -0,0 +1,55 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_SEQLOCK_PAGE_H
+#define __GPM_SEQLOCK_PAGE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* how every published page starts, one process writing and the rest only
+ * mapping it read-only */
+typedef struct {
+  guint32 magic; /* zero once the page is retired */
+  guint32 version;
+  gint32 sequence; /* odd while the writer is part way through a change */
+} GpmSeqlockPage;
+
+gpointer gpm_seqlock_page_create(const gchar *filename, gsize size,
+                                 gconstpointer header, gsize header_size,
+                                 GError **error);
+void gpm_seqlock_page_begin(gpointer page);
+void gpm_seqlock_page_end(gpointer page);
+void gpm_seqlock_page_retire(gpointer page);
+gconstpointer gpm_seqlock_page_map(gint fd, const gchar *filename, gsize size,
+                                   guint32 magic, guint32 version,
+                                   const gchar *what, GError **error);
+gconstpointer gpm_seqlock_page_open(const gchar *filename, gsize size,
+                                    guint32 magic, guint32 version,
+                                    const gchar *what, GError **error);
+gboolean gpm_seqlock_page_read(gconstpointer page, gpointer snapshot,
+                               gsize size);
+void gpm_seqlock_page_close(gconstpointer page, gsize size);
+
+G_END_DECLS
+
+#endif /* __GPM_SEQLOCK_PAGE_H */
@@ -0,0 +1,1098 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <math.h>
+#include <string.h>
+
+#include "gpm-series.h"
+
+/* "GPMS" stored little endian */
+#define GPM_SERIES_MAGIC 0x534d5047
+/* each block can be decoded on its own, so this is the seek granularity */
+#define GPM_SERIES_BLOCK_SIZE 256
+#define GPM_SERIES_WINDOW_NONE 0xff
+
+/*
+ * The encoding follows the Gorilla paper:
+ *
+ * - times are stored as the change in the time delta, which is zero for
+ *   regular samples and so costs a single bit
+ * - values are XOR'ed with the previous value, and only the bits that
+ *   changed are stored, reusing the previous window where possible
+ * - states rarely change, so are stored as runs at the start of the block
+ *
+ * Every number in the header and index is little endian.
+ */
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  guint32 length;
+  guint32 blocks;
+} GpmSeriesHeader;
+
+typedef struct {
+  guint32 first_time;
+  guint32 first_index;
+  guint32 offset; /* from the end of the index */
+} GpmSeriesBlock;
+
+struct GpmSeriesWriter {
+  GByteArray *data;   /* finished blocks */
+  GArray *index;      /* of GpmSeriesBlock */
+  GByteArray *stream; /* bits of the current block */
+  guint64 acc;        /* bits not yet in the stream */
+  guint acc_bits;
+  GByteArray *runs; /* of the current block */
+  guint runs_count;
+  guint32 run_state;
+  guint32 run_length;
+  guint count; /* in the current block */
+  guint length;
+  guint32 first_time;
+  guint32 first_value;
+  guint32 time;
+  guint32 delta;
+  guint32 value;
+  guint leading;
+  guint trailing;
+};
+
+struct GpmSeriesReader {
+  GBytes *bytes;
+  const guint8 *data;
+  gsize size;
+  GpmSeriesBlock *index;
+  guint blocks;
+  guint length;
+  /* the position of the next item */
+  guint block;
+  guint left;
+  gboolean first;
+  const guint8 *stream;
+  gsize stream_size;
+  gsize stream_pos; /* in bits */
+  const guint8 *runs;
+  gsize runs_size;
+  gsize runs_pos;
+  guint32 run_left;
+  guint32 state;
+  guint32 time;
+  guint32 delta;
+  guint32 value;
+  guint leading;
+  guint trailing;
+  gboolean corrupt;
+  gboolean has_peek;
+  GpmSeriesItem peek;
+};
+
+/**
+ * gpm_series_put_varint:
+ **/
+static void gpm_series_put_varint(GByteArray *data, guint32 value) {
+  guint8 byte;
+
+  do {
+    byte = value & 0x7f;
+    value >>= 7;
+    if (value != 0) byte |= 0x80;
+    g_byte_array_append(data, &byte, 1);
+  } while (value != 0);
+}
+
+/**
+ * gpm_series_get_varint:
+ **/
+static gboolean gpm_series_get_varint(const guint8 *data, gsize size,
+                                      gsize *offset, guint32 *value) {
+  guint shift;
+
+  *value = 0;
+  for (shift = 0; shift < 35; shift += 7) {
+    if (*offset >= size) return FALSE;
+    *value |= (guint32)(data[*offset] & 0x7f) << shift;
+    if ((data[(*offset)++] & 0x80) == 0) return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * gpm_series_put_le32:
+ **/
+static void gpm_series_put_le32(GByteArray *data, guint32 value) {
+  value = GUINT32_TO_LE(value);
+  g_byte_array_append(data, (const guint8 *)&value, 4);
+}
+
+/**
+ * gpm_series_get_le32:
+ **/
+static guint32 gpm_series_get_le32(const guint8 *data) {
+  guint32 value;
+  memcpy(&value, data, 4);
+  return GUINT32_FROM_LE(value);
+}
+
+/**
+ * gpm_series_float_to_bits:
+ **/
+static guint32 gpm_series_float_to_bits(gfloat value) {
+  guint32 bits;
+  memcpy(&bits, &value, 4);
+  return bits;
+}
+
+/**
+ * gpm_series_bits_to_float:
+ **/
+static gfloat gpm_series_bits_to_float(guint32 bits) {
+  gfloat value;
+  memcpy(&value, &bits, 4);
+  return value;
+}
+
+/**
+ * gpm_series_writer_put_bits:
+ *
+ * Adds the low @bits bits of @value to the stream, most significant first.
+ **/
+static void gpm_series_writer_put_bits(GpmSeriesWriter *writer, guint32 value,
+                                       guint bits) {
+  guint8 byte;
+
+  if (bits == 0) return;
+  if (bits < 32) value &= (1u << bits) - 1;
+  writer->acc = (writer->acc << bits) | value;
+  writer->acc_bits += bits;
+  while (writer->acc_bits >= 8) {
+    writer->acc_bits -= 8;
+    byte = writer->acc >> writer->acc_bits;
+    g_byte_array_append(writer->stream, &byte, 1);
+  }
+  writer->acc &= (1u << writer->acc_bits) - 1;
+}
+
+/**
+ * gpm_series_writer_put_time:
+ **/
+static void gpm_series_writer_put_time(GpmSeriesWriter *writer,
+                                       guint32 time) {
+  guint32 delta;
+  gint32 dod;
+
+  /* all the arithmetic wraps, so any delta can be stored */
+  delta = time - writer->time;
+  dod = (gint32)(delta - writer->delta);
+  if (dod == 0) {
+    gpm_series_writer_put_bits(writer, 0x0, 1);
+  } else if (dod >= -63 && dod <= 64) {
+    gpm_series_writer_put_bits(writer, 0x2, 2);
+    gpm_series_writer_put_bits(writer, dod + 63, 7);
+  } else if (dod >= -255 && dod <= 256) {
+    gpm_series_writer_put_bits(writer, 0x6, 3);
+    gpm_series_writer_put_bits(writer, dod + 255, 9);
+  } else if (dod >= -2047 && dod <= 2048) {
+    gpm_series_writer_put_bits(writer, 0xe, 4);
+    gpm_series_writer_put_bits(writer, dod + 2047, 12);
+  } else {
+    gpm_series_writer_put_bits(writer, 0xf, 4);
+    gpm_series_writer_put_bits(writer, (guint32)dod, 32);
+  }
+  writer->time = time;
+  writer->delta = delta;
+}
+
+/**
+ * gpm_series_writer_put_value:
+ **/
+static void gpm_series_writer_put_value(GpmSeriesWriter *writer,
+                                        guint32 value) {
+  guint32 xor;
+  guint leading;
+  guint trailing;
+  guint bits;
+
+  xor = value ^ writer->value;
+  writer->value = value;
+  if (xor == 0) {
+    gpm_series_writer_put_bits(writer, 0x0, 1);
+    return;
+  }
+
+  leading = 31 - g_bit_nth_msf(xor, -1);
+  trailing = g_bit_nth_lsf(xor, -1);
+
+  /* the changed bits fit in the last window */
+  if (writer->leading != GPM_SERIES_WINDOW_NONE &&
+      leading >= writer->leading && trailing >= writer->trailing) {
+    gpm_series_writer_put_bits(writer, 0x2, 2);
+    gpm_series_writer_put_bits(writer, xor >> writer->trailing,
+                               32 - writer->leading - writer->trailing);
+    return;
+  }
+
+  bits = 32 - leading - trailing;
+  gpm_series_writer_put_bits(writer, 0x3, 2);
+  gpm_series_writer_put_bits(writer, leading, 5);
+  gpm_series_writer_put_bits(writer, bits - 1, 5);
+  gpm_series_writer_put_bits(writer, xor >> trailing, bits);
+  writer->leading = leading;
+  writer->trailing = trailing;
+}
+
+/**
+ * gpm_series_writer_put_run:
+ **/
+static void gpm_series_writer_put_run(GpmSeriesWriter *writer) {
+  gpm_series_put_varint(writer->runs, writer->run_length);
+  gpm_series_put_varint(writer->runs, writer->run_state);
+  writer->runs_count++;
+}
+
+/**
+ * gpm_series_writer_end_block:
+ **/
+static void gpm_series_writer_end_block(GpmSeriesWriter *writer) {
+  guint8 byte;
+
+  if (writer->count == 0) return;
+
+  gpm_series_writer_put_run(writer);
+  if (writer->acc_bits > 0) {
+    byte = writer->acc << (8 - writer->acc_bits);
+    g_byte_array_append(writer->stream, &byte, 1);
+  }
+
+  gpm_series_put_varint(writer->data, writer->count);
+  gpm_series_put_le32(writer->data, writer->first_time);
+  gpm_series_put_le32(writer->data, writer->first_value);
+  gpm_series_put_varint(writer->data, writer->runs_count);
+  g_byte_array_append(writer->data, writer->runs->data, writer->runs->len);
+  gpm_series_put_varint(writer->data, writer->stream->len);
+  g_byte_array_append(writer->data, writer->stream->data, writer->stream->len);
+
+  g_byte_array_set_size(writer->runs, 0);
+  g_byte_array_set_size(writer->stream, 0);
+  writer->runs_count = 0;
+  writer->acc = 0;
+  writer->acc_bits = 0;
+  writer->count = 0;
+}
+
+/**
+ * gpm_series_writer_new:
+ *
+ * Return value: a new encoder, finish with gpm_series_writer_free_to_bytes()
+ **/
+GpmSeriesWriter *gpm_series_writer_new(void) {
+  GpmSeriesWriter *writer;
+
+  writer = g_new0(GpmSeriesWriter, 1);
+  writer->data = g_byte_array_new();
+  writer->index = g_array_new(FALSE, FALSE, sizeof(GpmSeriesBlock));
+  writer->stream = g_byte_array_new();
+  writer->runs = g_byte_array_new();
+  return writer;
+}
+
+/**
+ * gpm_series_writer_append:
+ * @writer: a #GpmSeriesWriter
+ * @time: the time of the sample, which must not be before the last
+ * @value: the sample, any float is stored exactly
+ * @state: e.g. the battery state at the time of the sample
+ *
+ * Return value: %FALSE if @time is before the last sample
+ **/
+gboolean gpm_series_writer_append(GpmSeriesWriter *writer, guint32 time,
+                                  gfloat value, guint32 state) {
+  GpmSeriesBlock block;
+  guint32 bits;
+
+  g_return_val_if_fail(writer != NULL, FALSE);
+
+  if (writer->length > 0 && time < writer->time) return FALSE;
+
+  bits = gpm_series_float_to_bits(value);
+  if (writer->count == 0) {
+    block.first_time = time;
+    block.first_index = writer->length;
+    block.offset = writer->data->len;
+    g_array_append_val(writer->index, block);
+    writer->first_time = time;
+    writer->first_value = bits;
+    writer->time = time;
+    writer->delta = 0;
+    writer->value = bits;
+    writer->leading = GPM_SERIES_WINDOW_NONE;
+    writer->run_state = state;
+    writer->run_length = 1;
+  } else {
+    gpm_series_writer_put_time(writer, time);
+    gpm_series_writer_put_value(writer, bits);
+    if (state == writer->run_state) {
+      writer->run_length++;
+    } else {
+      gpm_series_writer_put_run(writer);
+      writer->run_state = state;
+      writer->run_length = 1;
+    }
+  }
+
+  writer->length++;
+  if (++writer->count == GPM_SERIES_BLOCK_SIZE)
+    gpm_series_writer_end_block(writer);
+  return TRUE;
+}
+
+/**
+ * gpm_series_writer_get_length:
+ **/
+guint gpm_series_writer_get_length(GpmSeriesWriter *writer) {
+  g_return_val_if_fail(writer != NULL, 0);
+  return writer->length;
+}
+
+/**
+ * gpm_series_writer_free:
+ **/
+void gpm_series_writer_free(GpmSeriesWriter *writer) {
+  if (writer == NULL) return;
+  g_byte_array_unref(writer->data);
+  g_array_unref(writer->index);
+  g_byte_array_unref(writer->stream);
+  g_byte_array_unref(writer->runs);
+  g_free(writer);
+}
+
+/**
+ * gpm_series_writer_free_to_bytes:
+ * @writer: a #GpmSeriesWriter, which is freed
+ *
+ * Return value: the encoded series, free with g_bytes_unref()
+ **/
+GBytes *gpm_series_writer_free_to_bytes(GpmSeriesWriter *writer) {
+  GpmSeriesBlock *block;
+  GByteArray *data;
+  guint i;
+
+  g_return_val_if_fail(writer != NULL, NULL);
+
+  gpm_series_writer_end_block(writer);
+
+  data = g_byte_array_sized_new(sizeof(GpmSeriesHeader) +
+                                writer->index->len * sizeof(GpmSeriesBlock) +
+                                writer->data->len);
+  gpm_series_put_le32(data, GPM_SERIES_MAGIC);
+  gpm_series_put_le32(data, GPM_SERIES_VERSION);
+  gpm_series_put_le32(data, writer->length);
+  gpm_series_put_le32(data, writer->index->len);
+  for (i = 0; i < writer->index->len; i++) {
+    block = &g_array_index(writer->index, GpmSeriesBlock, i);
+    gpm_series_put_le32(data, block->first_time);
+    gpm_series_put_le32(data, block->first_index);
+    gpm_series_put_le32(data, block->offset);
+  }
+  g_byte_array_append(data, writer->data->data, writer->data->len);
+  gpm_series_writer_free(writer);
+  return g_byte_array_free_to_bytes(data);
+}
+
+/**
+ * gpm_series_reader_get_bits:
+ **/
+static guint32 gpm_series_reader_get_bits(GpmSeriesReader *reader,
+                                          guint bits) {
+  gsize byte;
+  guint offset;
+  guint take;
+  guint32 value = 0;
+
+  while (bits > 0) {
+    byte = reader->stream_pos >> 3;
+    if (byte >= reader->stream_size) {
+      reader->corrupt = TRUE;
+      return 0;
+    }
+    offset = reader->stream_pos & 7;
+    take = MIN(bits, 8 - offset);
+    value = (value << take) | ((reader->stream[byte] >> (8 - offset - take)) &
+                               ((1u << take) - 1));
+    reader->stream_pos += take;
+    bits -= take;
+  }
+  return value;
+}
+
+/**
+ * gpm_series_reader_get_time:
+ **/
+static void gpm_series_reader_get_time(GpmSeriesReader *reader) {
+  gint32 dod;
+
+  if (gpm_series_reader_get_bits(reader, 1) == 0) {
+    dod = 0;
+  } else if (gpm_series_reader_get_bits(reader, 1) == 0) {
+    dod = (gint32)gpm_series_reader_get_bits(reader, 7) - 63;
+  } else if (gpm_series_reader_get_bits(reader, 1) == 0) {
+    dod = (gint32)gpm_series_reader_get_bits(reader, 9) - 255;
+  } else if (gpm_series_reader_get_bits(reader, 1) == 0) {
+    dod = (gint32)gpm_series_reader_get_bits(reader, 12) - 2047;
+  } else {
+    dod = (gint32)gpm_series_reader_get_bits(reader, 32);
+  }
+  reader->delta += (guint32)dod;
+  reader->time += reader->delta;
+}
+
+/**
+ * gpm_series_reader_get_value:
+ **/
+static void gpm_series_reader_get_value(GpmSeriesReader *reader) {
+  guint bits;
+
+  if (gpm_series_reader_get_bits(reader, 1) == 0) return;
+  if (gpm_series_reader_get_bits(reader, 1) == 1) {
+    reader->leading = gpm_series_reader_get_bits(reader, 5);
+    bits = gpm_series_reader_get_bits(reader, 5) + 1;
+    if (reader->leading + bits > 32) {
+      reader->corrupt = TRUE;
+      return;
+    }
+    reader->trailing = 32 - reader->leading - bits;
+  } else if (reader->leading == GPM_SERIES_WINDOW_NONE) {
+    reader->corrupt = TRUE;
+    return;
+  }
+  bits = 32 - reader->leading - reader->trailing;
+  reader->value ^= gpm_series_reader_get_bits(reader, bits) << reader->trailing;
+}
+
+/**
+ * gpm_series_reader_get_state:
+ **/
+static void gpm_series_reader_get_state(GpmSeriesReader *reader) {
+  if (reader->run_left == 0) {
+    if (!gpm_series_get_varint(reader->runs, reader->runs_size,
+                               &reader->runs_pos, &reader->run_left) ||
+        !gpm_series_get_varint(reader->runs, reader->runs_size,
+                               &reader->runs_pos, &reader->state) ||
+        reader->run_left == 0) {
+      reader->corrupt = TRUE;
+      return;
+    }
+  }
+  reader->run_left--;
+}
+
+/**
+ * gpm_series_reader_load_block:
+ **/
+static gboolean gpm_series_reader_load_block(GpmSeriesReader *reader,
+                                             guint block) {
+  const guint8 *data = reader->data;
+  gsize offset = reader->index[block].offset;
+  gsize size = reader->size;
+  guint32 count;
+  guint32 runs_count;
+  guint32 stream_size;
+  guint32 expected;
+  guint32 tmp;
+  guint i;
+
+  expected = (block + 1 < reader->blocks ? reader->index[block + 1].first_index
+                                         : reader->length) -
+             reader->index[block].first_index;
+  if (!gpm_series_get_varint(data, size, &offset, &count)) return FALSE;
+  if (count != expected || count == 0 || offset + 8 > size) return FALSE;
+  reader->time = gpm_series_get_le32(data + offset);
+  reader->value = gpm_series_get_le32(data + offset + 4);
+  offset += 8;
+
+  /* skip over the runs to find the stream */
+  if (!gpm_series_get_varint(data, size, &offset, &runs_count)) return FALSE;
+  reader->runs = data + offset;
+  for (i = 0; i < runs_count * 2; i++) {
+    if (!gpm_series_get_varint(data, size, &offset, &tmp)) return FALSE;
+  }
+  reader->runs_size = data + offset - reader->runs;
+  reader->runs_pos = 0;
+  if (!gpm_series_get_varint(data, size, &offset, &stream_size)) return FALSE;
+  if (stream_size > size - offset) return FALSE;
+  reader->stream = data + offset;
+  reader->stream_size = stream_size;
+  reader->stream_pos = 0;
+
+  reader->block = block + 1;
+  reader->left = count;
+  reader->first = TRUE;
+  reader->run_left = 0;
+  reader->delta = 0;
+  reader->leading = GPM_SERIES_WINDOW_NONE;
+  reader->trailing = 0;
+  return TRUE;
+}
+
+/**
+ * gpm_series_reader_decode:
+ **/
+static gboolean gpm_series_reader_decode(GpmSeriesReader *reader,
+                                         GpmSeriesItem *item) {
+  if (reader->corrupt) return FALSE;
+  if (reader->left == 0) {
+    if (reader->block >= reader->blocks) return FALSE;
+    if (!gpm_series_reader_load_block(reader, reader->block)) {
+      reader->corrupt = TRUE;
+      return FALSE;
+    }
+  }
+  if (reader->first) {
+    reader->first = FALSE;
+  } else {
+    gpm_series_reader_get_time(reader);
+    gpm_series_reader_get_value(reader);
+  }
+  gpm_series_reader_get_state(reader);
+  if (reader->corrupt) {
+    g_warning("series is corrupt in block %i", reader->block - 1);
+    return FALSE;
+  }
+  reader->left--;
+
+  item->time = reader->time;
+  item->value = gpm_series_bits_to_float(reader->value);
+  item->state = reader->state;
+  return TRUE;
+}
+
+/**
+ * gpm_series_reader_new:
+ * @bytes: data from gpm_series_writer_free_to_bytes()
+ * @error: a #GError, or %NULL
+ *
+ * Checks the header and block index; the blocks themselves are only checked
+ * as they are decoded.
+ *
+ * Return value: a new decoder positioned at the start, or %NULL
+ **/
+GpmSeriesReader *gpm_series_reader_new(GBytes *bytes, GError **error) {
+  GpmSeriesReader *reader;
+  const guint8 *data;
+  gsize size;
+  gsize index_size;
+  guint32 blocks;
+  guint i;
+
+  g_return_val_if_fail(bytes != NULL, NULL);
+
+  data = g_bytes_get_data(bytes, &size);
+  if (size < sizeof(GpmSeriesHeader) ||
+      gpm_series_get_le32(data) != GPM_SERIES_MAGIC ||
+      gpm_series_get_le32(data + 4) != GPM_SERIES_VERSION) {
+    g_set_error_literal(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                        "not a series, or an unknown version");
+    return NULL;
+  }
+  blocks = gpm_series_get_le32(data + 12);
+  index_size = (gsize)blocks * sizeof(GpmSeriesBlock);
+  if (index_size > size - sizeof(GpmSeriesHeader)) {
+    g_set_error_literal(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                        "series index is truncated");
+    return NULL;
+  }
+
+  reader = g_new0(GpmSeriesReader, 1);
+  reader->bytes = g_bytes_ref(bytes);
+  reader->length = gpm_series_get_le32(data + 8);
+  reader->blocks = blocks;
+  reader->index = g_new(GpmSeriesBlock, blocks);
+  data += sizeof(GpmSeriesHeader);
+  for (i = 0; i < blocks; i++) {
+    reader->index[i].first_time = gpm_series_get_le32(data);
+    reader->index[i].first_index = gpm_series_get_le32(data + 4);
+    reader->index[i].offset = gpm_series_get_le32(data + 8);
+    data += sizeof(GpmSeriesBlock);
+  }
+  reader->data = data;
+  reader->size = size - sizeof(GpmSeriesHeader) - index_size;
+
+  /* the index has to be in order for seeking to work */
+  for (i = 0; i < blocks; i++) {
+    if (reader->index[i].offset >= reader->size ||
+        reader->index[i].first_index >= reader->length ||
+        (i > 0 && (reader->index[i].first_index <=
+                       reader->index[i - 1].first_index ||
+                   reader->index[i].first_time <
+                       reader->index[i - 1].first_time))) {
+      g_set_error_literal(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                          "series index is invalid");
+      gpm_series_reader_free(reader);
+      return NULL;
+    }
+  }
+  if ((blocks == 0) != (reader->length == 0)) {
+    g_set_error_literal(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                        "series index is invalid");
+    gpm_series_reader_free(reader);
+    return NULL;
+  }
+  return reader;
+}
+
+/**
+ * gpm_series_reader_free:
+ **/
+void gpm_series_reader_free(GpmSeriesReader *reader) {
+  if (reader == NULL) return;
+  g_bytes_unref(reader->bytes);
+  g_free(reader->index);
+  g_free(reader);
+}
+
+/**
+ * gpm_series_reader_get_length:
+ **/
+guint gpm_series_reader_get_length(GpmSeriesReader *reader) {
+  g_return_val_if_fail(reader != NULL, 0);
+  return reader->length;
+}
+
+/**
+ * gpm_series_reader_next:
+ * @reader: a #GpmSeriesReader
+ * @item: the returned sample
+ *
+ * Return value: %FALSE at the end of the series, or if it is corrupt
+ **/
+gboolean gpm_series_reader_next(GpmSeriesReader *reader, GpmSeriesItem *item) {
+  g_return_val_if_fail(reader != NULL, FALSE);
+  g_return_val_if_fail(item != NULL, FALSE);
+
+  if (reader->has_peek) {
+    *item = reader->peek;
+    reader->has_peek = FALSE;
+    return TRUE;
+  }
+  return gpm_series_reader_decode(reader, item);
+}
+
+/**
+ * gpm_series_reader_seek:
+ * @reader: a #GpmSeriesReader
+ * @time: the time to seek to
+ *
+ * Moves to the first sample at or after @time, only decoding the block it
+ * is in.
+ *
+ * Return value: %FALSE if there is no such sample
+ **/
+gboolean gpm_series_reader_seek(GpmSeriesReader *reader, guint32 time) {
+  guint lo = 0;
+  guint hi;
+  guint mid;
+
+  g_return_val_if_fail(reader != NULL, FALSE);
+
+  /* the first block that may hold @time, samples at exactly @time can
+   * start in the block before the one whose first time is @time */
+  hi = reader->blocks;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (reader->index[mid].first_time < time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  reader->block = lo > 0 ? lo - 1 : 0;
+  reader->left = 0;
+  reader->corrupt = FALSE;
+  reader->has_peek = FALSE;
+  while (gpm_series_reader_decode(reader, &reader->peek)) {
+    if (reader->peek.time >= time) {
+      reader->has_peek = TRUE;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+ * gpm_series_reader_read:
+ * @reader: a #GpmSeriesReader
+ * @times: where to put the times, or %NULL
+ * @values: where to put the values, or %NULL
+ * @states: where to put the states, or %NULL
+ * @length: the size of the arrays
+ *
+ * Decodes the next @length samples into separate columns, for callers that
+ * keep times, values and states apart.
+ *
+ * Return value: the number of samples decoded
+ **/
+guint gpm_series_reader_read(GpmSeriesReader *reader, guint32 *times,
+                             gfloat *values, guint32 *states, guint length) {
+  GpmSeriesItem item;
+  guint i;
+
+  g_return_val_if_fail(reader != NULL, 0);
+
+  for (i = 0; i < length; i++) {
+    if (!gpm_series_reader_next(reader, &item)) break;
+    if (times != NULL) times[i] = item.time;
+    if (values != NULL) values[i] = item.value;
+    if (states != NULL) states[i] = item.state;
+  }
+  return i;
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+/**
+ * gpm_series_test_trace:
+ *
+ * Makes something that looks like the UPower history of a laptop: samples
+ * every 30 seconds with a little jitter, the odd suspend, and the battery
+ * charging and discharging in turn.
+ **/
+static void gpm_series_test_trace(GRand *rand, guint length, gboolean rate,
+                                  guint32 *times, gfloat *values,
+                                  guint32 *states) {
+  gdouble percentage = 100.0f;
+  gdouble rate_now;
+  guint32 time = 1600000000;
+  guint32 state = 2;
+  guint i;
+
+  for (i = 0; i < length; i++) {
+    if (g_rand_int_range(rand, 0, 1000) == 0)
+      time += g_rand_int_range(rand, 3600, 8 * 3600);
+    else if (g_rand_int_range(rand, 0, 10) == 0)
+      time += g_rand_int_range(rand, 29, 32);
+    else
+      time += 30;
+
+    if (state == 2 && percentage < 10.0f) state = 1;
+    if (state == 1 && percentage > 99.0f) state = 4;
+    if (state == 4 && g_rand_int_range(rand, 0, 100) == 0) state = 2;
+    if (state == 2) percentage -= 0.05f;
+    if (state == 1) percentage += 0.1f;
+
+    times[i] = time;
+    states[i] = state;
+    /* UPower reports the rate to the mW, and the charge to 0.1% */
+    rate_now = 8.0f + g_rand_double_range(rand, -0.5, 0.5);
+    if (rate)
+      values[i] = state == 4 ? 0.0f : floor(rate_now * 1000.0f) / 1000.0f;
+    else
+      values[i] = floor(percentage * 10.0f) / 10.0f;
+  }
+}
+
+/**
+ * gpm_series_test_encode:
+ **/
+static GBytes *gpm_series_test_encode(guint length, const guint32 *times,
+                                      const gfloat *values,
+                                      const guint32 *states) {
+  GpmSeriesWriter *writer;
+  guint i;
+
+  writer = gpm_series_writer_new();
+  for (i = 0; i < length; i++)
+    gpm_series_writer_append(writer, times[i], values[i], states[i]);
+  return gpm_series_writer_free_to_bytes(writer);
+}
+
+/**
+ * gpm_series_test_check:
+ *
+ * Return value: %TRUE if @bytes decodes to exactly the samples given
+ **/
+static gboolean gpm_series_test_check(GBytes *bytes, guint length,
+                                      const guint32 *times,
+                                      const gfloat *values,
+                                      const guint32 *states) {
+  GpmSeriesReader *reader;
+  GpmSeriesItem item;
+  gboolean ret = TRUE;
+  guint i;
+
+  reader = gpm_series_reader_new(bytes, NULL);
+  if (reader == NULL) return FALSE;
+  if (gpm_series_reader_get_length(reader) != length) ret = FALSE;
+  for (i = 0; ret && i < length; i++) {
+    if (!gpm_series_reader_next(reader, &item) || item.time != times[i] ||
+        memcmp(&item.value, &values[i], sizeof(gfloat)) != 0 ||
+        item.state != states[i])
+      ret = FALSE;
+  }
+  if (ret && gpm_series_reader_next(reader, &item)) ret = FALSE;
+  gpm_series_reader_free(reader);
+  return ret;
+}
+
+void gpm_series_test(gpointer data) {
+  GpmSeriesWriter *writer;
+  GpmSeriesReader *reader;
+  GpmSeriesItem item;
+  GBytes *bytes;
+  GError *error = NULL;
+  GRand *rand;
+  guint32 *times;
+  gfloat *values;
+  guint32 *states;
+  guint32 step;
+  gboolean ret;
+  guint elapsed;
+  guint length;
+  guint seed;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmSeries")) return;
+
+  length = 1000000;
+  times = g_new(guint32, length);
+  values = g_new(gfloat, length);
+  states = g_new(guint32, length);
+  rand = g_rand_new_with_seed(0);
+
+  /************************************************************/
+  egg_test_title(test, "encode an empty series");
+  bytes = gpm_series_test_encode(0, times, values, states);
+  egg_test_assert(test, gpm_series_test_check(bytes, 0, times, values, states));
+  g_bytes_unref(bytes);
+
+  /************************************************************/
+  egg_test_title(test, "refuse a sample from the past");
+  writer = gpm_series_writer_new();
+  gpm_series_writer_append(writer, 100, 1.0f, 1);
+  ret = gpm_series_writer_append(writer, 99, 1.0f, 1);
+  egg_test_assert(test, !ret && gpm_series_writer_get_length(writer) == 1);
+  gpm_series_writer_free(writer);
+
+  /************************************************************/
+  egg_test_title(test, "round trip the extremes");
+  times[0] = 0;
+  times[1] = 0;
+  times[2] = G_MAXUINT32;
+  times[3] = G_MAXUINT32;
+  values[0] = NAN;
+  values[1] = -0.0f;
+  values[2] = INFINITY;
+  values[3] = G_MAXFLOAT;
+  states[0] = 0;
+  states[1] = G_MAXUINT32;
+  states[2] = G_MAXUINT32;
+  states[3] = 7;
+  bytes = gpm_series_test_encode(4, times, values, states);
+  egg_test_assert(test, gpm_series_test_check(bytes, 4, times, values, states));
+  g_bytes_unref(bytes);
+
+  /************************************************************/
+  egg_test_title(test, "round trip random series");
+  ret = TRUE;
+  for (seed = 1; ret && seed <= 200; seed++) {
+    g_rand_set_seed(rand, seed);
+    length = g_rand_int_range(rand, 1, 3 * GPM_SERIES_BLOCK_SIZE);
+    times[0] = g_rand_int(rand) / 2;
+    for (i = 0; i < length; i++) {
+      if (i > 0) {
+        switch (g_rand_int_range(rand, 0, 4)) {
+          case 0:
+            step = 0;
+            break;
+          case 1:
+            step = 30;
+            break;
+          case 2:
+            step = g_rand_int_range(rand, 0, 5000);
+            break;
+          default:
+            step = g_rand_int_range(rand, 0,
+                                    (G_MAXUINT32 - times[i - 1]) / 4 + 1);
+        }
+        times[i] = times[i - 1] + MIN(step, G_MAXUINT32 - times[i - 1]);
+      }
+      if (g_rand_boolean(rand))
+        values[i] = g_rand_int_range(rand, 0, 100);
+      else
+        values[i] = gpm_series_bits_to_float(g_rand_int(rand));
+      if (i == 0 || g_rand_int_range(rand, 0, 20) == 0)
+        states[i] = g_rand_int_range(rand, 0, 1000);
+      else
+        states[i] = states[i - 1];
+    }
+    bytes = gpm_series_test_encode(length, times, values, states);
+    ret = gpm_series_test_check(bytes, length, times, values, states);
+    g_bytes_unref(bytes);
+  }
+  if (ret)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "seed %i failed", seed - 1);
+
+  /************************************************************/
+  length = 10 * GPM_SERIES_BLOCK_SIZE;
+  for (i = 0; i < length; i++) {
+    times[i] = 1000 + ((i + 1) / 2) * 10;
+    values[i] = i;
+    states[i] = i / 100;
+  }
+  bytes = gpm_series_test_encode(length, times, values, states);
+  reader = gpm_series_reader_new(bytes, NULL);
+
+  /************************************************************/
+  egg_test_title(test, "seek to a time");
+  ret = gpm_series_reader_seek(reader, 1000 + 1000 * 10);
+  gpm_series_reader_next(reader, &item);
+  egg_test_assert(test, ret && item.value == 1999.0f);
+
+  /************************************************************/
+  egg_test_title(test, "seek to a time between samples");
+  ret = gpm_series_reader_seek(reader, 1000 + 1000 * 10 - 5);
+  gpm_series_reader_next(reader, &item);
+  egg_test_assert(test, ret && item.value == 1999.0f);
+
+  /************************************************************/
+  egg_test_title(test, "seek to a time split over blocks");
+  ret = gpm_series_reader_seek(reader, times[GPM_SERIES_BLOCK_SIZE]);
+  gpm_series_reader_next(reader, &item);
+  if (ret && item.value == GPM_SERIES_BLOCK_SIZE - 1)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %f", item.value);
+
+  /************************************************************/
+  egg_test_title(test, "seek before and after the series");
+  ret = gpm_series_reader_seek(reader, 0);
+  gpm_series_reader_next(reader, &item);
+  egg_test_assert(test, ret && item.value == 0.0f &&
+                            !gpm_series_reader_seek(reader, G_MAXUINT32));
+
+  /************************************************************/
+  egg_test_title(test, "read into columns");
+  {
+    guint32 times_tmp[300];
+    gfloat values_tmp[300];
+    gpm_series_reader_seek(reader, times[length - 201]);
+    i = gpm_series_reader_read(reader, times_tmp, values_tmp, NULL, 300);
+    if (i == 201 && times_tmp[0] == times[length - 201] &&
+        values_tmp[200] == length - 1)
+      egg_test_success(test, NULL);
+    else
+      egg_test_failed(test, "read %i", i);
+  }
+  gpm_series_reader_free(reader);
+
+  /************************************************************/
+  egg_test_title(test, "refuse something that is not a series");
+  {
+    GBytes *tmp;
+    tmp = g_bytes_new_static("GPMXxxxxxxxxxxxxxxx", 16);
+    reader = gpm_series_reader_new(tmp, &error);
+    if (reader == NULL && error != NULL)
+      egg_test_success(test, NULL);
+    else
+      egg_test_failed(test, "opened a bad series");
+    g_clear_error(&error);
+    g_bytes_unref(tmp);
+  }
+
+  /************************************************************/
+  egg_test_title(test, "survive truncated data");
+  ret = TRUE;
+  for (i = 0; ret && i < g_bytes_get_size(bytes); i += 7) {
+    GBytes *tmp;
+    guint count = 0;
+    tmp = g_bytes_new_from_bytes(bytes, 0, i);
+    reader = gpm_series_reader_new(tmp, NULL);
+    if (reader != NULL) {
+      while (gpm_series_reader_next(reader, &item)) count++;
+      if (count > length) ret = FALSE;
+      gpm_series_reader_free(reader);
+    }
+    g_bytes_unref(tmp);
+  }
+  egg_test_assert(test, ret);
+  g_bytes_unref(bytes);
+
+  /************************************************************/
+  for (seed = 0; seed < 2; seed++) {
+    length = 2 * 24 * 120;
+    g_rand_set_seed(rand, seed);
+    gpm_series_test_trace(rand, length, seed == 1, times, values, states);
+    bytes = gpm_series_test_encode(length, times, values, states);
+    egg_test_title(test, "compress two days of %s",
+                   seed == 1 ? "rate" : "charge");
+    ret = gpm_series_test_check(bytes, length, times, values, states);
+    if (ret && g_bytes_get_size(bytes) * (seed == 1 ? 2 : 4) < length * 12)
+      egg_test_success(test, "%.1f bytes per sample",
+                       (gdouble)g_bytes_get_size(bytes) / length);
+    else
+      egg_test_failed(test, "%.1f bytes per sample",
+                      (gdouble)g_bytes_get_size(bytes) / length);
+    g_bytes_unref(bytes);
+  }
+
+  /************************************************************/
+  length = 1000000;
+  g_rand_set_seed(rand, 0);
+  gpm_series_test_trace(rand, length, TRUE, times, values, states);
+  egg_test_title(test, "encode %i samples", length);
+  bytes = gpm_series_test_encode(length, times, values, states);
+  elapsed = egg_test_elapsed(test);
+  if (bytes != NULL)
+    egg_test_success(test, "%ims", elapsed);
+  else
+    egg_test_failed(test, "nothing encoded");
+
+  /************************************************************/
+  egg_test_title(test, "decode %i samples", length);
+  reader = gpm_series_reader_new(bytes, NULL);
+  i = gpm_series_reader_read(reader, times, values, states, length);
+  elapsed = egg_test_elapsed(test);
+  if (i == length)
+    egg_test_success(test, "%ims", elapsed);
+  else
+    egg_test_failed(test, "decoded %i in %ims", i, elapsed);
+  gpm_series_reader_free(reader);
+  g_bytes_unref(bytes);
+
+  g_rand_free(rand);
+  g_free(times);
+  g_free(values);
+  g_free(states);
+
+  egg_test_end(test);
+}
+
+#endif
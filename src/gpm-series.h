@@ -0,0 +1,61 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_SERIES_H
+#define __GPM_SERIES_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* bump this if the encoding changes */
+#define GPM_SERIES_VERSION 1
+
+typedef struct {
+  guint32 time;
+  gfloat value;
+  guint32 state;
+} GpmSeriesItem;
+
+typedef struct GpmSeriesWriter GpmSeriesWriter;
+typedef struct GpmSeriesReader GpmSeriesReader;
+
+GpmSeriesWriter *gpm_series_writer_new(void);
+gboolean gpm_series_writer_append(GpmSeriesWriter *writer, guint32 time,
+                                  gfloat value, guint32 state);
+guint gpm_series_writer_get_length(GpmSeriesWriter *writer);
+GBytes *gpm_series_writer_free_to_bytes(GpmSeriesWriter *writer);
+void gpm_series_writer_free(GpmSeriesWriter *writer);
+
+GpmSeriesReader *gpm_series_reader_new(GBytes *bytes, GError **error);
+void gpm_series_reader_free(GpmSeriesReader *reader);
+guint gpm_series_reader_get_length(GpmSeriesReader *reader);
+gboolean gpm_series_reader_next(GpmSeriesReader *reader, GpmSeriesItem *item);
+gboolean gpm_series_reader_seek(GpmSeriesReader *reader, guint32 time);
+guint gpm_series_reader_read(GpmSeriesReader *reader, guint32 *times,
+                             gfloat *values, guint32 *states, guint length);
+#ifdef EGG_TEST
+void gpm_series_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_SERIES_H */
@@ -33,6 +33,7 @@
 
 #include "gpm-common.h"
 #include "gpm-marshal.h"
+#include "gpm-trace.h"
 
 static void gpm_session_finalize(GObject *object);
 
@@ -69,11 +70,14 @@ struct GpmSessionPrivate {
   gboolean is_idle_old;
   gboolean is_idle_inhibited_old;
   gboolean is_suspend_inhibited_old;
+  GHashTable *inhibitors; /* object paths */
+  GpmTrace *trace;
 };
 
 enum {
   IDLE_CHANGED,
   INHIBITED_CHANGED,
+  INHIBITORS_CHANGED,
   STOP,
   QUERY_END_SESSION,
   END_SESSION,
@@ -120,6 +124,16 @@ gboolean gpm_session_get_idle_inhibited(GpmSession *session) {
   return session->priv->is_idle_inhibited_old;
 }
 
+/**
+ * gpm_session_get_inhibitors:
+ *
+ * Return value: the number of inhibitors held on the session, of any kind
+ **/
+guint gpm_session_get_inhibitors(GpmSession *session) {
+  g_return_val_if_fail(GPM_IS_SESSION(session), 0);
+  return g_hash_table_size(session->priv->inhibitors);
+}
+
 /**
  * gpm_session_get_suspend_inhibited:
  **/
@@ -128,6 +142,17 @@ gboolean gpm_session_get_suspend_inhibited(GpmSession *session) {
   return session->priv->is_suspend_inhibited_old;
 }
 
+/**
+ * gpm_session_set_idle:
+ **/
+static void gpm_session_set_idle(GpmSession *session, gboolean is_idle) {
+  if (is_idle != session->priv->is_idle_old) {
+    g_debug("emitting idle-changed : (%i)", is_idle);
+    session->priv->is_idle_old = is_idle;
+    g_signal_emit(session, signals[IDLE_CHANGED], 0, is_idle);
+  }
+}
+
 /**
  * gpm_session_presence_status_changed_cb:
  **/
@@ -135,12 +160,13 @@ static void gpm_session_presence_status_changed_cb(DBusGProxy *proxy,
                                                    guint status,
                                                    GpmSession *session) {
   gboolean is_idle;
+
+  if (gpm_trace_is_replaying(session->priv->trace)) return;
   is_idle = (status == GPM_SESSION_STATUS_ENUM_IDLE);
-  if (is_idle != session->priv->is_idle_old) {
-    g_debug("emitting idle-changed : (%i)", is_idle);
-    session->priv->is_idle_old = is_idle;
-    g_signal_emit(session, signals[IDLE_CHANGED], 0, is_idle);
-  }
+  if (is_idle != session->priv->is_idle_old)
+    gpm_trace_add(session->priv->trace, GPM_TRACE_KIND_SESSION_IDLE, is_idle,
+                  NULL, NULL);
+  gpm_session_set_idle(session, is_idle);
 }
 
 /**
@@ -358,15 +384,11 @@ out:
 }
 
 /**
- * gpm_session_inhibit_changed_cb:
+ * gpm_session_set_inhibited:
  **/
-static void gpm_session_inhibit_changed_cb(DBusGProxy *proxy, const gchar *id,
-                                           GpmSession *session) {
-  gboolean is_idle_inhibited;
-  gboolean is_suspend_inhibited;
-
-  is_idle_inhibited = gpm_session_is_idle_inhibited(session);
-  is_suspend_inhibited = gpm_session_is_suspend_inhibited(session);
+static void gpm_session_set_inhibited(GpmSession *session,
+                                      gboolean is_idle_inhibited,
+                                      gboolean is_suspend_inhibited) {
   if (is_idle_inhibited != session->priv->is_idle_inhibited_old ||
       is_suspend_inhibited != session->priv->is_suspend_inhibited_old) {
     g_debug("emitting inhibited-changed : idle=(%i), suspend=(%i)",
@@ -378,6 +400,115 @@ static void gpm_session_inhibit_changed_cb(DBusGProxy *proxy, const gchar *id,
   }
 }
 
+/**
+ * gpm_session_inhibit_changed_cb:
+ **/
+static void gpm_session_inhibit_changed_cb(DBusGProxy *proxy, const gchar *id,
+                                           GpmSession *session) {
+  gpm_session_set_inhibited(session, gpm_session_is_idle_inhibited(session),
+                            gpm_session_is_suspend_inhibited(session));
+}
+
+/**
+ * gpm_session_get_trace_flags:
+ *
+ * Return value: what is inhibited, as %GPM_TRACE_INHIBIT_IDLE and friends
+ **/
+static guint32 gpm_session_get_trace_flags(GpmSession *session) {
+  guint32 flags = 0;
+
+  if (session->priv->is_idle_inhibited_old) flags |= GPM_TRACE_INHIBIT_IDLE;
+  if (session->priv->is_suspend_inhibited_old)
+    flags |= GPM_TRACE_INHIBIT_SUSPEND;
+  return flags;
+}
+
+/**
+ * gpm_session_inhibitor_added_cb:
+ **/
+static void gpm_session_inhibitor_added_cb(DBusGProxy *proxy, const gchar *id,
+                                           GpmSession *session) {
+  if (gpm_trace_is_replaying(session->priv->trace)) return;
+  g_hash_table_add(session->priv->inhibitors, g_strdup(id));
+  g_signal_emit(session, signals[INHIBITORS_CHANGED], 0,
+                g_hash_table_size(session->priv->inhibitors));
+  gpm_session_inhibit_changed_cb(proxy, id, session);
+  gpm_trace_add(session->priv->trace, GPM_TRACE_KIND_INHIBITOR_ADDED,
+                gpm_session_get_trace_flags(session), id, NULL);
+}
+
+/**
+ * gpm_session_inhibitor_removed_cb:
+ **/
+static void gpm_session_inhibitor_removed_cb(DBusGProxy *proxy,
+                                             const gchar *id,
+                                             GpmSession *session) {
+  if (gpm_trace_is_replaying(session->priv->trace)) return;
+  if (g_hash_table_remove(session->priv->inhibitors, id))
+    g_signal_emit(session, signals[INHIBITORS_CHANGED], 0,
+                  g_hash_table_size(session->priv->inhibitors));
+  gpm_session_inhibit_changed_cb(proxy, id, session);
+  gpm_trace_add(session->priv->trace, GPM_TRACE_KIND_INHIBITOR_REMOVED,
+                gpm_session_get_trace_flags(session), id, NULL);
+}
+
+/**
+ * gpm_session_trace_replay_cb:
+ *
+ * The inhibit state is taken from the trace rather than asked for again
+ **/
+static void gpm_session_trace_replay_cb(GpmTrace *trace,
+                                        const GpmTraceEvent *event,
+                                        GpmSession *session) {
+  gboolean changed = FALSE;
+
+  switch (event->kind) {
+    case GPM_TRACE_KIND_SESSION_IDLE:
+      gpm_session_set_idle(session, event->value != 0);
+      return;
+    case GPM_TRACE_KIND_INHIBITOR_ADDED:
+      if (event->name != NULL)
+        changed =
+            g_hash_table_add(session->priv->inhibitors, g_strdup(event->name));
+      break;
+    case GPM_TRACE_KIND_INHIBITOR_REMOVED:
+      if (event->name != NULL)
+        changed = g_hash_table_remove(session->priv->inhibitors, event->name);
+      break;
+    default:
+      return;
+  }
+  if (changed)
+    g_signal_emit(session, signals[INHIBITORS_CHANGED], 0,
+                  g_hash_table_size(session->priv->inhibitors));
+  gpm_session_set_inhibited(
+      session, (event->value & GPM_TRACE_INHIBIT_IDLE) > 0,
+      (event->value & GPM_TRACE_INHIBIT_SUSPEND) > 0);
+}
+
+/**
+ * gpm_session_coldplug_inhibitors:
+ **/
+static void gpm_session_coldplug_inhibitors(GpmSession *session) {
+  GPtrArray *array = NULL;
+  GError *error = NULL;
+  gboolean ret;
+  guint i;
+
+  ret = dbus_g_proxy_call(
+      session->priv->proxy, "GetInhibitors", &error, G_TYPE_INVALID,
+      dbus_g_type_get_collection("GPtrArray", DBUS_TYPE_G_OBJECT_PATH), &array,
+      G_TYPE_INVALID);
+  if (!ret) {
+    g_warning("failed to get inhibitors: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+  for (i = 0; i < array->len; i++)
+    g_hash_table_add(session->priv->inhibitors, g_ptr_array_index(array, i));
+  g_ptr_array_free(array, TRUE);
+}
+
 /**
  * gpm_session_class_init:
  * @klass: This class instance
@@ -395,6 +526,10 @@ static void gpm_session_class_init(GpmSessionClass *klass) {
       G_STRUCT_OFFSET(GpmSessionClass, inhibited_changed), NULL, NULL,
       gpm_marshal_VOID__BOOLEAN_BOOLEAN, G_TYPE_NONE, 2, G_TYPE_BOOLEAN,
       G_TYPE_BOOLEAN);
+  signals[INHIBITORS_CHANGED] = g_signal_new(
+      "inhibitors-changed", G_TYPE_FROM_CLASS(object_class), G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET(GpmSessionClass, inhibitors_changed), NULL, NULL,
+      g_cclosure_marshal_VOID__UINT, G_TYPE_NONE, 1, G_TYPE_UINT);
   signals[STOP] =
       g_signal_new("stop", G_TYPE_FROM_CLASS(object_class), G_SIGNAL_RUN_LAST,
                    G_STRUCT_OFFSET(GpmSessionClass, stop), NULL, NULL,
@@ -420,12 +555,19 @@ static void gpm_session_class_init(GpmSessionClass *klass) {
 static void gpm_session_init(GpmSession *session) {
   DBusGConnection *connection;
   GError *error = NULL;
+  GHashTableIter iter;
+  const gchar *id;
 
   session->priv = gpm_session_get_instance_private(session);
   session->priv->is_idle_old = FALSE;
   session->priv->is_idle_inhibited_old = FALSE;
   session->priv->is_suspend_inhibited_old = FALSE;
   session->priv->proxy_client_private = NULL;
+  session->priv->inhibitors =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  session->priv->trace = gpm_trace_new();
+  g_signal_connect(session->priv->trace, "replay",
+                   G_CALLBACK(gpm_session_trace_replay_cb), session);
 
   connection = dbus_g_bus_get(DBUS_BUS_SESSION, NULL);
 
@@ -471,24 +613,37 @@ static void gpm_session_init(GpmSession *session) {
   dbus_g_proxy_add_signal(session->priv->proxy, "InhibitorAdded",
                           DBUS_TYPE_G_OBJECT_PATH, G_TYPE_INVALID);
   dbus_g_proxy_connect_signal(session->priv->proxy, "InhibitorAdded",
-                              G_CALLBACK(gpm_session_inhibit_changed_cb),
+                              G_CALLBACK(gpm_session_inhibitor_added_cb),
                               session, NULL);
 
   /* get InhibitorRemoved */
   dbus_g_proxy_add_signal(session->priv->proxy, "InhibitorRemoved",
                           DBUS_TYPE_G_OBJECT_PATH, G_TYPE_INVALID);
   dbus_g_proxy_connect_signal(session->priv->proxy, "InhibitorRemoved",
-                              G_CALLBACK(gpm_session_inhibit_changed_cb),
+                              G_CALLBACK(gpm_session_inhibitor_removed_cb),
                               session, NULL);
 
+  /* a replay starts from nothing, like the trace does */
+  if (gpm_trace_is_replaying(session->priv->trace)) return;
+
   /* coldplug */
   session->priv->is_idle_inhibited_old = gpm_session_is_idle_inhibited(session);
   session->priv->is_suspend_inhibited_old =
       gpm_session_is_suspend_inhibited(session);
   session->priv->is_idle_old = gpm_session_is_idle(session);
+  gpm_session_coldplug_inhibitors(session);
   g_debug("idle: %i, idle_inhibited: %i, suspend_inhibited: %i",
           session->priv->is_idle_old, session->priv->is_idle_inhibited_old,
           session->priv->is_suspend_inhibited_old);
+
+  /* so the trace starts from the same place */
+  if (session->priv->is_idle_old)
+    gpm_trace_add(session->priv->trace, GPM_TRACE_KIND_SESSION_IDLE, TRUE,
+                  NULL, NULL);
+  g_hash_table_iter_init(&iter, session->priv->inhibitors);
+  while (g_hash_table_iter_next(&iter, (gpointer *)&id, NULL))
+    gpm_trace_add(session->priv->trace, GPM_TRACE_KIND_INHIBITOR_ADDED,
+                  gpm_session_get_trace_flags(session), id, NULL);
 }
 
 /**
@@ -508,6 +663,8 @@ static void gpm_session_finalize(GObject *object) {
   if (session->priv->proxy_client_private != NULL)
     g_object_unref(session->priv->proxy_client_private);
   g_object_unref(session->priv->proxy_prop);
+  g_hash_table_unref(session->priv->inhibitors);
+  g_object_unref(session->priv->trace);
 
   G_OBJECT_CLASS(gpm_session_parent_class)->finalize(object);
 }
@@ -49,6 +49,7 @@ typedef struct {
   void (*idle_changed)(GpmSession *session, gboolean is_idle);
   void (*inhibited_changed)(GpmSession *session, gboolean is_idle_inhibited,
                             gboolean is_suspend_inhibited);
+  void (*inhibitors_changed)(GpmSession *session, guint count);
   /* just exit */
   void (*stop)(GpmSession *session);
   /* reply with EndSessionResponse */
@@ -65,6 +66,7 @@ gboolean gpm_session_logout(GpmSession *session);
 gboolean gpm_session_get_idle(GpmSession *session);
 gboolean gpm_session_get_idle_inhibited(GpmSession *session);
 gboolean gpm_session_get_suspend_inhibited(GpmSession *session);
+guint gpm_session_get_inhibitors(GpmSession *session);
 gboolean gpm_session_register_client(GpmSession *session, const gchar *app_id,
                                      const gchar *client_startup_id);
 gboolean gpm_session_end_session_response(GpmSession *session, gboolean is_okay,
@@ -0,0 +1,251 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gpm-seqlock-page.h"
+#include "gpm-state-page.h"
+
+/* what is created and mapped, with room to add fields without a resize */
+#define GPM_STATE_PAGE_SIZE 4096
+
+G_STATIC_ASSERT(sizeof(GpmStatePage) <= GPM_STATE_PAGE_SIZE);
+G_STATIC_ASSERT(G_STRUCT_OFFSET(GpmStatePage, sequence) ==
+                G_STRUCT_OFFSET(GpmSeqlockPage, sequence));
+
+/**
+ * gpm_state_page_get_filename:
+ *
+ * Return value: where the daemon publishes its page, free with g_free()
+ **/
+gchar *gpm_state_page_get_filename(void) {
+  return g_build_filename(g_get_user_runtime_dir(), GPM_STATE_PAGE_NAME, NULL);
+}
+
+/**
+ * gpm_state_page_retire:
+ * @page: A page from gpm_state_page_create()
+ *
+ * Tells the readers still mapping @page that it will not change again, so
+ * that they open the file afresh.
+ **/
+void gpm_state_page_retire(GpmStatePage *page) {
+  gpm_seqlock_page_retire(page);
+}
+
+/**
+ * gpm_state_page_create:
+ * @filename: Where to publish the page
+ *
+ * Creates a page with every field unknown, retiring any page that was
+ * there before.
+ *
+ * Return value: the writable page, or %NULL
+ **/
+GpmStatePage *gpm_state_page_create(const gchar *filename, GError **error) {
+  GpmStatePage header = {0};
+  guint i;
+
+  header.magic = GPM_STATE_PAGE_MAGIC;
+  header.version = GPM_STATE_PAGE_VERSION;
+  header.n_fields = GPM_STATE_FIELD_LAST;
+  header.updated = g_get_monotonic_time();
+  for (i = 0; i < GPM_STATE_FIELD_LAST; i++)
+    header.fields[i] = GPM_STATE_PAGE_UNKNOWN;
+  return gpm_seqlock_page_create(filename, GPM_STATE_PAGE_SIZE, &header,
+                                 sizeof(header), error);
+}
+
+/**
+ * gpm_state_page_set:
+ * @page: A page from gpm_state_page_create()
+ *
+ * Return value: %TRUE if the value was different
+ **/
+gboolean gpm_state_page_set(GpmStatePage *page, GpmStateField field,
+                            guint32 value) {
+  g_return_val_if_fail(page != NULL, FALSE);
+  g_return_val_if_fail(field < GPM_STATE_FIELD_LAST, FALSE);
+
+  if (page->fields[field] == value) return FALSE;
+
+  gpm_seqlock_page_begin(page);
+  page->fields[field] = value;
+  page->updated = g_get_monotonic_time();
+  gpm_seqlock_page_end(page);
+  return TRUE;
+}
+
+/**
+ * gpm_state_page_open:
+ * @filename: The file from gpm_state_page_get_filename()
+ *
+ * Maps a page read-only, which is all a client has to do; reading it
+ * afterwards needs no system calls at all.
+ *
+ * Return value: the page, or %NULL if it is missing or not one we know
+ **/
+const GpmStatePage *gpm_state_page_open(const gchar *filename,
+                                        GError **error) {
+  return gpm_seqlock_page_open(filename, GPM_STATE_PAGE_SIZE,
+                               GPM_STATE_PAGE_MAGIC, GPM_STATE_PAGE_VERSION,
+                               "state", error);
+}
+
+/**
+ * gpm_state_page_read:
+ * @page: A mapped page
+ * @snapshot: Where to copy it
+ *
+ * Takes a consistent copy of the page, retrying if the daemon was part
+ * way through a change. Fields the daemon does not fill in are unknown.
+ *
+ * Return value: %FALSE if no consistent copy could be had, or the page was
+ * retired and should be opened again
+ **/
+gboolean gpm_state_page_read(const GpmStatePage *page,
+                             GpmStatePage *snapshot) {
+  guint i;
+
+  if (!gpm_seqlock_page_read(page, snapshot, sizeof(GpmStatePage)))
+    return FALSE;
+  for (i = MIN(snapshot->n_fields, GPM_STATE_FIELD_LAST);
+       i < GPM_STATE_FIELD_LAST; i++)
+    snapshot->fields[i] = GPM_STATE_PAGE_UNKNOWN;
+  return TRUE;
+}
+
+/**
+ * gpm_state_page_close:
+ * @page: A page from gpm_state_page_create() or gpm_state_page_open()
+ **/
+void gpm_state_page_close(const GpmStatePage *page) {
+  gpm_seqlock_page_close(page, GPM_STATE_PAGE_SIZE);
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+void gpm_state_page_test(gpointer data) {
+  GpmStatePage *page;
+  GpmStatePage *page2;
+  const GpmStatePage *reader;
+  GpmStatePage snapshot;
+  GError *error = NULL;
+  gchar *dirname;
+  gchar *filename;
+  gchar *junk;
+  gchar *contents;
+  gboolean ret;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmStatePage")) return;
+
+  dirname = g_dir_make_tmp("gpm-state-page-XXXXXX", NULL);
+  filename = g_build_filename(dirname, GPM_STATE_PAGE_NAME, NULL);
+  junk = g_build_filename(dirname, "junk", NULL);
+
+  /************************************************************/
+  egg_test_title(test, "create a page");
+  page = gpm_state_page_create(filename, &error);
+  if (page != NULL)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "failed: %s", error->message);
+
+  /************************************************************/
+  egg_test_title(test, "a new page knows nothing yet");
+  reader = gpm_state_page_open(filename, NULL);
+  ret = reader != NULL && gpm_state_page_read(reader, &snapshot);
+  for (i = 0; ret && i < GPM_STATE_FIELD_LAST; i++)
+    ret = snapshot.fields[i] == GPM_STATE_PAGE_UNKNOWN;
+  egg_test_assert(test, ret && snapshot.sequence == 0);
+
+  /************************************************************/
+  egg_test_title(test, "changes are seen by a reader");
+  gpm_state_page_set(page, GPM_STATE_FIELD_BRIGHTNESS, 40);
+  gpm_state_page_set(page, GPM_STATE_FIELD_ON_BATTERY, TRUE);
+  ret = gpm_state_page_read(reader, &snapshot);
+  egg_test_assert(test, ret && snapshot.sequence == 4 &&
+                            snapshot.fields[GPM_STATE_FIELD_BRIGHTNESS] == 40 &&
+                            snapshot.fields[GPM_STATE_FIELD_ON_BATTERY] == 1);
+
+  /************************************************************/
+  egg_test_title(test, "setting the same value changes nothing");
+  ret = gpm_state_page_set(page, GPM_STATE_FIELD_BRIGHTNESS, 40);
+  egg_test_assert(test, !ret && page->sequence == 4);
+
+  /************************************************************/
+  egg_test_title(test, "a page being written is not read");
+  page->sequence++;
+  ret = gpm_state_page_read(reader, &snapshot);
+  page->sequence++;
+  egg_test_assert(test, !ret);
+
+  /************************************************************/
+  egg_test_title(test, "fields the daemon does not know are unknown");
+  page->n_fields = GPM_STATE_FIELD_PERCENTAGE;
+  gpm_state_page_set(page, GPM_STATE_FIELD_PERCENTAGE, 80);
+  ret = gpm_state_page_read(reader, &snapshot);
+  page->n_fields = GPM_STATE_FIELD_LAST;
+  egg_test_assert(test, ret && snapshot.fields[GPM_STATE_FIELD_PERCENTAGE] ==
+                                   GPM_STATE_PAGE_UNKNOWN);
+
+  /************************************************************/
+  egg_test_title(test, "a new daemon retires the old page");
+  page2 = gpm_state_page_create(filename, NULL);
+  ret = gpm_state_page_read(reader, &snapshot);
+  gpm_state_page_close(reader);
+  reader = gpm_state_page_open(filename, NULL);
+  egg_test_assert(test, page2 != NULL && !ret && reader != NULL &&
+                            gpm_state_page_read(reader, &snapshot));
+
+  /************************************************************/
+  egg_test_title(test, "a file that is not a page is refused");
+  contents = g_strnfill(GPM_STATE_PAGE_SIZE, 'x');
+  g_file_set_contents(junk, contents, GPM_STATE_PAGE_SIZE, NULL);
+  g_free(contents);
+  egg_test_assert(test, gpm_state_page_open(junk, NULL) == NULL);
+
+  gpm_state_page_close(reader);
+  gpm_state_page_close(page2);
+  gpm_state_page_close(page);
+  g_clear_error(&error);
+  g_unlink(junk);
+  g_unlink(filename);
+  g_rmdir(dirname);
+  g_free(junk);
+  g_free(filename);
+  g_free(dirname);
+
+  egg_test_end(test);
+}
+
+#endif
@@ -0,0 +1,72 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_STATE_PAGE_H
+#define __GPM_STATE_PAGE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* the page lives in $XDG_RUNTIME_DIR under this name */
+#define GPM_STATE_PAGE_NAME "mate-power-manager.state"
+#define GPM_STATE_PAGE_MAGIC 0x5350474d /* "MGPS" */
+/* only bumped if the meaning of an existing field changes; new fields are
+ * appended and readers just check n_fields */
+#define GPM_STATE_PAGE_VERSION 1
+#define GPM_STATE_PAGE_UNKNOWN G_MAXUINT32
+
+typedef enum {
+  GPM_STATE_FIELD_BRIGHTNESS, /* panel percentage */
+  GPM_STATE_FIELD_ON_BATTERY, /* boolean */
+  GPM_STATE_FIELD_PERCENTAGE, /* charge of all the batteries together */
+  GPM_STATE_FIELD_INHIBITORS, /* number of session inhibitors */
+  GPM_STATE_FIELD_IDLE,       /* GpmIdleMode */
+  GPM_STATE_FIELD_DPMS,       /* GpmDpmsMode */
+  GPM_STATE_FIELD_LAST
+} GpmStateField;
+
+/* what is mapped, the daemon writing and everyone else only reading */
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  gint32 sequence;  /* odd while the daemon is writing */
+  guint32 n_fields; /* how many fields the daemon fills in */
+  gint64 updated;   /* monotonic time of the last change, in us */
+  guint32 fields[GPM_STATE_FIELD_LAST]; /* or GPM_STATE_PAGE_UNKNOWN */
+} GpmStatePage;
+
+gchar *gpm_state_page_get_filename(void);
+GpmStatePage *gpm_state_page_create(const gchar *filename, GError **error);
+gboolean gpm_state_page_set(GpmStatePage *page, GpmStateField field,
+                            guint32 value);
+void gpm_state_page_retire(GpmStatePage *page);
+const GpmStatePage *gpm_state_page_open(const gchar *filename, GError **error);
+gboolean gpm_state_page_read(const GpmStatePage *page,
+                             GpmStatePage *snapshot);
+void gpm_state_page_close(const GpmStatePage *page);
+#ifdef EGG_TEST
+void gpm_state_page_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_STATE_PAGE_H */
@@ -31,22 +31,54 @@
 #include <libupower-glib/upower.h>
 #include <locale.h>
 
-#include "egg-array-float.h"
 #include "egg-color.h"
 #include "gpm-common.h"
+#include "gpm-energy.h"
 #include "gpm-graph-widget.h"
+#include "gpm-history-cache.h"
+#include "gpm-history-pyramid.h"
 #include "gpm-icon-names.h"
+#include "gpm-proc-sampler.h"
 #include "gpm-upower.h"
 
 static GtkBuilder *builder = NULL;
 static GtkListStore *list_store_info = NULL;
 static GtkListStore *list_store_devices = NULL;
+static GHashTable *info_rows = NULL;
+static guint info_generation = 0;
+static GtkTreeIter info_last_iter;
+static gboolean info_last_iter_valid = FALSE;
+static UpDevice *device_changed = NULL;
+static guint device_changed_id = 0;
+static guint64 history_update_time = 0;
 gchar *current_device = NULL;
 static guint history_time;
 static GSettings *settings;
 static gfloat sigma_smoothing = 0.0f;
 static GtkWidget *graph_history = NULL;
 static GtkWidget *graph_statistics = NULL;
+static GpmHistoryCache *history_cache = NULL;
+static gchar *history_cache_filename = NULL;
+static GCancellable *history_cancellable = NULL;
+static GpmHistoryPyramid *history_pyramid = NULL;
+static gint32 history_view_stop = 0;
+static guint history_view_span = 0;
+static gboolean history_live = FALSE;
+static gint32 history_live_origin = 0;
+static GPtrArray *history_live_tail = NULL;
+static gboolean history_compare = FALSE;
+static GCancellable *history_compare_cancellable = NULL;
+static gchar *energy_used_device = NULL;
+static gdouble energy_used_today = 0.0f;
+static gint64 energy_used_time = 0;
+static GCancellable *energy_used_cancellable = NULL;
+static guint energy_used_id = 0;
+static GtkListStore *list_store_processes = NULL;
+static GtkWidget *graph_processes = NULL;
+static GpmProcSampler *processes_sampler = NULL;
+static UpDevice *processes_device = NULL;
+static guint processes_id = 0;
+static guint processes_selected = 0;
 
 enum { GPM_INFO_COLUMN_TEXT, GPM_INFO_COLUMN_VALUE, GPM_INFO_COLUMN_LAST };
 
@@ -57,6 +89,16 @@ enum {
   GPM_DEVICES_COLUMN_LAST
 };
 
+enum {
+  GPM_PROCESSES_COLUMN_PID,
+  GPM_PROCESSES_COLUMN_NAME,
+  GPM_PROCESSES_COLUMN_CPU,
+  GPM_PROCESSES_COLUMN_POWER,
+  GPM_PROCESSES_COLUMN_ENERGY,
+  GPM_PROCESSES_COLUMN_IO,
+  GPM_PROCESSES_COLUMN_LAST
+};
+
 #define GPM_STATS_CHARGE_DATA_VALUE "charge-data"
 #define GPM_STATS_CHARGE_ACCURACY_VALUE "charge-accuracy"
 #define GPM_STATS_DISCHARGE_DATA_VALUE "discharge-data"
@@ -93,6 +135,31 @@ enum {
 #define GPM_HISTORY_DAY_VALUE 24 * 60 * 60
 #define GPM_HISTORY_WEEK_VALUE 7 * 24 * 60 * 60
 
+/* enough for a week of samples at the UPower poll interval */
+#define GPM_STATS_HISTORY_CACHE_SIZE 32768
+/* the most points asked from UPower when bringing the cache up to date */
+#define GPM_STATS_HISTORY_RESOLUTION 4096
+/* pyramid levels of 30s, 2m, 8m, 32m, 2h8m and 8h32m buckets */
+#define GPM_STATS_HISTORY_PYRAMID_INTERVAL 30
+#define GPM_STATS_HISTORY_PYRAMID_FACTOR 4
+#define GPM_STATS_HISTORY_PYRAMID_LEVELS 6
+/* the shortest timespan that can be zoomed into, in seconds */
+#define GPM_STATS_HISTORY_ZOOM_MIN 60
+/* the raw points kept to smooth the end of the live graph, and how many
+ * smoothed points at the end can move when another is added */
+#define GPM_STATS_HISTORY_TAIL_LENGTH 32
+#define GPM_STATS_HISTORY_TAIL_CHANGED 9
+/* points asked for each device when comparing them */
+#define GPM_STATS_HISTORY_COMPARE_RESOLUTION 400
+/* how often the energy used today is worked out again, in seconds */
+#define GPM_STATS_ENERGY_USED_REFRESH 5 * 60
+
+/* the processes page samples /proc this often, in seconds, only while shown */
+#define GPM_STATS_PROCESSES_INTERVAL 5
+/* how many of the busiest processes are listed */
+#define GPM_STATS_PROCESSES_TOP 25
+#define GPM_STATS_PROCESSES_PAGE 3
+
 enum stats_type_enum {
   GPM_STATS_CHARGE_TYPE = 0,
   GPM_STATS_DISCHARGE_TYPE,
@@ -111,6 +178,41 @@ enum history_type_enum {
   GPM_HISTORY_LAST_TYPE
 };
 static enum history_type_enum history_type;
+
+/* one row of the details page, kept so only changed values are set */
+typedef struct {
+  GtkTreeIter iter;
+  gchar *text;
+  guint generation;
+} GpmStatsInfoRow;
+
+/* the line colors for the devices being compared */
+static const guint32 history_compare_colors[] = {
+    0x0000ff, 0xff0000, 0x00a000, 0xff8000, 0x8000c0, 0x00a0a0};
+
+typedef struct {
+  UpDevice *device;
+  gchar *filename;
+  enum history_type_enum type;
+  guint timespan;
+  guint resolution;
+} GpmStatsHistoryHelper;
+
+typedef struct {
+  gchar *object_path;
+  enum history_type_enum type;
+  guint timespan;
+  guint index;
+} GpmStatsCompareItem;
+
+typedef struct {
+  GPtrArray *results; /* one history array per device, or %NULL */
+  GPtrArray *descs;
+  GCancellable *cancellable;
+  guint pending;
+  gint32 offset;
+} GpmStatsCompareHelper;
+
 static const char *history_types[GPM_HISTORY_LAST_TYPE] = {
     [GPM_HISTORY_RATE_TYPE] = GPM_HISTORY_RATE_VALUE,
     [GPM_HISTORY_CHARGE_TYPE] = GPM_HISTORY_CHARGE_VALUE,
@@ -170,60 +272,83 @@ static void gpm_stats_add_devices_columns(GtkTreeView *treeview) {
 }
 
 /**
- * gpm_stats_add_info_data:
+ * gpm_stats_info_row_free:
  **/
-static void gpm_stats_add_info_data(const gchar *attr, const gchar *text) {
-  GtkTreeIter iter;
-  gtk_list_store_append(list_store_info, &iter);
-  gtk_list_store_set(list_store_info, &iter, GPM_INFO_COLUMN_TEXT, attr,
-                     GPM_INFO_COLUMN_VALUE, text, -1);
+static void gpm_stats_info_row_free(GpmStatsInfoRow *row) {
+  g_free(row->text);
+  g_free(row);
 }
 
 /**
- * gpm_stats_update_smooth_data:
+ * gpm_stats_info_data_clear:
  **/
-static GPtrArray *gpm_stats_update_smooth_data(GPtrArray *list) {
-  guint i;
-  GpmPointObj *point;
-  GpmPointObj *point_new;
-  GPtrArray *new;
-  EggArrayFloat *raw;
-  EggArrayFloat *convolved;
-  EggArrayFloat *outliers;
-  EggArrayFloat *gaussian = NULL;
-
-  /* convert the y data to a EggArrayFloat array */
-  raw = egg_array_float_new(list->len);
-  for (i = 0; i < list->len; i++) {
-    point = (GpmPointObj *)g_ptr_array_index(list, i);
-    egg_array_float_set(raw, i, point->y);
-  }
-
-  /* remove any outliers */
-  outliers = egg_array_float_remove_outliers(raw, 3, 0.1);
+static void gpm_stats_info_data_clear(void) {
+  g_hash_table_remove_all(info_rows);
+  gtk_list_store_clear(list_store_info);
+  info_last_iter_valid = FALSE;
+}
 
-  /* convolve with gaussian */
-  gaussian = egg_array_float_compute_gaussian(15, sigma_smoothing);
-  convolved = egg_array_float_convolve(outliers, gaussian);
+/**
+ * gpm_stats_info_data_begin:
+ *
+ * Starts a pass over the details; rows not added again before
+ * gpm_stats_info_data_end() are removed.
+ **/
+static void gpm_stats_info_data_begin(void) {
+  info_generation++;
+  info_last_iter_valid = FALSE;
+}
 
-  /* add the smoothed data back into a new array */
-  new = g_ptr_array_new_with_free_func((GDestroyNotify)gpm_point_obj_free);
-  for (i = 0; i < list->len; i++) {
-    point = (GpmPointObj *)g_ptr_array_index(list, i);
-    point_new = g_new0(GpmPointObj, 1);
-    point_new->color = point->color;
-    point_new->x = point->x;
-    point_new->y = egg_array_float_get(convolved, i);
-    g_ptr_array_add(new, point_new);
+/**
+ * gpm_stats_info_data_end:
+ **/
+static void gpm_stats_info_data_end(void) {
+  GHashTableIter iter;
+  GpmStatsInfoRow *row;
+
+  g_hash_table_iter_init(&iter, info_rows);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&row)) {
+    if (row->generation == info_generation) continue;
+    gtk_list_store_remove(list_store_info, &row->iter);
+    g_hash_table_iter_remove(&iter);
   }
+}
 
-  /* free data */
-  egg_array_float_free(gaussian);
-  egg_array_float_free(raw);
-  egg_array_float_free(convolved);
-  egg_array_float_free(outliers);
+/**
+ * gpm_stats_add_info_data:
+ *
+ * Adds or updates the row for @attr, only touching the store if the
+ * value is new or has changed.
+ **/
+static void gpm_stats_add_info_data(const gchar *attr, const gchar *text) {
+  GpmStatsInfoRow *row;
+
+  row = g_hash_table_lookup(info_rows, attr);
+  if (row == NULL) {
+    /* keep the order the rows are added in */
+    row = g_new0(GpmStatsInfoRow, 1);
+    gtk_list_store_insert_after(list_store_info, &row->iter,
+                                info_last_iter_valid ? &info_last_iter : NULL);
+    gtk_list_store_set(list_store_info, &row->iter, GPM_INFO_COLUMN_TEXT, attr,
+                       GPM_INFO_COLUMN_VALUE, text, -1);
+    row->text = g_strdup(text);
+    g_hash_table_insert(info_rows, g_strdup(attr), row);
+  } else if (g_strcmp0(row->text, text) != 0) {
+    gtk_list_store_set(list_store_info, &row->iter, GPM_INFO_COLUMN_VALUE, text,
+                       -1);
+    g_free(row->text);
+    row->text = g_strdup(text);
+  }
+  row->generation = info_generation;
+  info_last_iter = row->iter;
+  info_last_iter_valid = TRUE;
+}
 
-  return new;
+/**
+ * gpm_stats_update_smooth_data:
+ **/
+static GPtrArray *gpm_stats_update_smooth_data(GPtrArray *list) {
+  return gpm_point_obj_array_smooth(list, sigma_smoothing);
 }
 
 /**
@@ -279,6 +404,188 @@ static gchar *gpm_stats_get_printable_device_path(UpDevice *device) {
   return device_path;
 }
 
+static void gpm_stats_update_info_page_details(UpDevice *device);
+
+/**
+ * gpm_stats_history_item_sort_cb:
+ **/
+static gint gpm_stats_history_item_sort_cb(gconstpointer a, gconstpointer b) {
+  guint time_a = up_history_item_get_time(*((UpHistoryItem **)a));
+  guint time_b = up_history_item_get_time(*((UpHistoryItem **)b));
+  if (time_a < time_b) return -1;
+  if (time_a > time_b) return 1;
+  return 0;
+}
+
+/**
+ * gpm_stats_energy_used_get_midnight:
+ **/
+static guint32 gpm_stats_energy_used_get_midnight(void) {
+  GDateTime *now;
+  GDateTime *midnight;
+  guint32 time;
+
+  now = g_date_time_new_now_local();
+  midnight = g_date_time_new_local(g_date_time_get_year(now),
+                                   g_date_time_get_month(now),
+                                   g_date_time_get_day_of_month(now), 0, 0, 0);
+  time = g_date_time_to_unix(midnight);
+  g_date_time_unref(midnight);
+  g_date_time_unref(now);
+  return time;
+}
+
+/**
+ * gpm_stats_energy_used_thread:
+ *
+ * Integrates the rate history since midnight, counting only the time the
+ * battery was discharging.
+ **/
+static void gpm_stats_energy_used_thread(GTask *task, gpointer object,
+                                         gpointer task_data,
+                                         GCancellable *cancellable) {
+  UpDevice *device = UP_DEVICE(task_data);
+  UpHistoryItem *item;
+  GpmEnergy *energy;
+  GPtrArray *array;
+  GError *error = NULL;
+  gdouble *used;
+  gdouble rate;
+  guint32 midnight;
+  guint32 now;
+  guint i;
+
+  midnight = gpm_stats_energy_used_get_midnight();
+  now = g_get_real_time() / G_USEC_PER_SEC;
+
+  /* ask for a little more so the first segment can be interpolated */
+  array = up_device_get_history_sync(device, GPM_HISTORY_RATE_VALUE,
+                                     now - midnight + 10 * 60,
+                                     GPM_STATS_HISTORY_RESOLUTION, cancellable,
+                                     &error);
+  if (array == NULL) {
+    g_task_return_error(task, error);
+    return;
+  }
+  g_ptr_array_sort(array, gpm_stats_history_item_sort_cb);
+
+  energy = gpm_energy_new();
+  for (i = 0; i < array->len; i++) {
+    item = (UpHistoryItem *)g_ptr_array_index(array, i);
+    rate = up_history_item_get_value(item);
+    if (up_history_item_get_state(item) != UP_DEVICE_STATE_DISCHARGING)
+      rate = 0.0f;
+    gpm_energy_add(energy, up_history_item_get_time(item), rate);
+  }
+  used = g_new(gdouble, 1);
+  *used = gpm_energy_get_used(energy, midnight, now);
+  gpm_energy_free(energy);
+  g_ptr_array_unref(array);
+  g_task_return_pointer(task, used, g_free);
+}
+
+/**
+ * gpm_stats_energy_used_cb:
+ **/
+static void gpm_stats_energy_used_cb(GObject *source, GAsyncResult *res,
+                                     gpointer user_data) {
+  UpDevice *device;
+  GtkNotebook *notebook;
+  GError *error = NULL;
+  gdouble *used;
+
+  if (g_task_get_cancellable(G_TASK(res)) == energy_used_cancellable)
+    g_clear_object(&energy_used_cancellable);
+
+  used = g_task_propagate_pointer(G_TASK(res), &error);
+  if (used == NULL &&
+      g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    g_error_free(error);
+    return;
+  }
+
+  /* a failure is remembered too, so it isn't retried on every update */
+  device = UP_DEVICE(g_task_get_task_data(G_TASK(res)));
+  g_free(energy_used_device);
+  energy_used_device = g_strdup(up_device_get_object_path(device));
+  energy_used_time = g_get_monotonic_time();
+  if (used == NULL) {
+    g_debug("failed to get rate history: %s", error->message);
+    g_error_free(error);
+    energy_used_today = -1.0f;
+    return;
+  }
+  energy_used_today = *used;
+  g_free(used);
+
+  /* show it if the details are still being looked at */
+  notebook = GTK_NOTEBOOK(gtk_builder_get_object(builder, "notebook1"));
+  if (g_strcmp0(current_device, energy_used_device) == 0 &&
+      gtk_notebook_get_current_page(notebook) == 0)
+    gpm_stats_update_info_page_details(device);
+}
+
+/**
+ * gpm_stats_energy_used_refresh:
+ *
+ * Works out the energy used today in a thread, unless it is already known
+ * or being worked out for @device.
+ **/
+static void gpm_stats_energy_used_refresh(UpDevice *device) {
+  GTask *task;
+
+  if (g_strcmp0(energy_used_device, up_device_get_object_path(device)) == 0 &&
+      g_get_monotonic_time() - energy_used_time <
+          GPM_STATS_ENERGY_USED_REFRESH * G_USEC_PER_SEC)
+    return;
+  if (energy_used_cancellable != NULL) {
+    if (g_strcmp0(g_object_get_data(G_OBJECT(energy_used_cancellable),
+                                    "object-path"),
+                  up_device_get_object_path(device)) == 0)
+      return;
+    g_cancellable_cancel(energy_used_cancellable);
+    g_object_unref(energy_used_cancellable);
+  }
+  energy_used_cancellable = g_cancellable_new();
+  g_object_set_data_full(G_OBJECT(energy_used_cancellable), "object-path",
+                         g_strdup(up_device_get_object_path(device)), g_free);
+
+  task = g_task_new(NULL, energy_used_cancellable, gpm_stats_energy_used_cb,
+                    NULL);
+  g_task_set_task_data(task, g_object_ref(device), g_object_unref);
+  g_task_run_in_thread(task, gpm_stats_energy_used_thread);
+  g_object_unref(task);
+}
+
+/**
+ * gpm_stats_energy_used_timeout_cb:
+ *
+ * Works out the energy used today again while the details are shown, as
+ * UPower may not send a change for a battery that is discharging slowly.
+ * The device the client already has is used, so UPower isn't asked again.
+ **/
+static gboolean gpm_stats_energy_used_timeout_cb(GPtrArray *devices) {
+  UpDevice *device;
+  GtkNotebook *notebook;
+  guint i;
+
+  notebook = GTK_NOTEBOOK(gtk_builder_get_object(builder, "notebook1"));
+  if (current_device == NULL || gtk_notebook_get_current_page(notebook) != 0)
+    return G_SOURCE_CONTINUE;
+
+  for (i = 0; i < devices->len; i++) {
+    device = g_ptr_array_index(devices, i);
+    if (g_strcmp0(up_device_get_object_path(device), current_device) != 0)
+      continue;
+
+    /* make the figure stale, the details only refresh batteries */
+    energy_used_time = 0;
+    gpm_stats_update_info_page_details(device);
+    break;
+  }
+  return G_SOURCE_CONTINUE;
+}
+
 /**
  * gpm_stats_update_info_page_details:
  **/
@@ -311,7 +618,7 @@ static void gpm_stats_update_info_page_details(UpDevice *device) {
   gchar *model = NULL;
   gchar *device_path = NULL;
 
-  gtk_list_store_clear(list_store_info);
+  gpm_stats_info_data_begin();
 
   /* get device properties */
   g_object_get(device, "kind", &kind, "state", &state, "percentage",
@@ -393,6 +700,14 @@ static void gpm_stats_update_info_page_details(UpDevice *device) {
     text = g_strdup_printf("%.1f Wh", energy_full_design);
     gpm_stats_add_info_data(_("Energy (design)"), text);
     g_free(text);
+    if (energy_used_today >= 0.0f &&
+        g_strcmp0(energy_used_device, up_device_get_object_path(device)) == 0) {
+      text = g_strdup_printf("%.1f Wh", energy_used_today);
+      /* TRANSLATORS: the energy taken from the battery since midnight */
+      gpm_stats_add_info_data(_("Energy used today"), text);
+      g_free(text);
+    }
+    gpm_stats_energy_used_refresh(device);
   }
   if (kind == UP_DEVICE_KIND_BATTERY || kind == UP_DEVICE_KIND_MONITOR) {
     text = g_strdup_printf("%.1f W", energy_rate);
@@ -438,140 +753,885 @@ static void gpm_stats_update_info_page_details(UpDevice *device) {
     gpm_stats_add_info_data(
         _("Technology"), gpm_device_technology_to_localised_string(technology));
   }
-  if (kind == UP_DEVICE_KIND_LINE_POWER) {
-    /* TRANSLATORS: this is when the device is plugged in, typically
-     * only shown for the ac adaptor device */
-    gpm_stats_add_info_data(_("Online"), gpm_stats_bool_to_string(online));
+  if (kind == UP_DEVICE_KIND_LINE_POWER) {
+    /* TRANSLATORS: this is when the device is plugged in, typically
+     * only shown for the ac adaptor device */
+    gpm_stats_add_info_data(_("Online"), gpm_stats_bool_to_string(online));
+  }
+
+  gpm_stats_info_data_end();
+
+  g_free(vendor);
+  g_free(serial);
+  g_free(model);
+}
+
+/**
+ * gpm_stats_set_graph_data:
+ **/
+static void gpm_stats_set_graph_data(GtkWidget *widget, GPtrArray *data,
+                                     gboolean use_smoothed,
+                                     gboolean use_points) {
+  GPtrArray *smoothed;
+
+  gpm_graph_widget_data_clear(GPM_GRAPH_WIDGET(widget));
+
+  /* add correct data */
+  if (!use_smoothed) {
+    if (use_points)
+      gpm_graph_widget_data_assign(GPM_GRAPH_WIDGET(widget),
+                                   GPM_GRAPH_WIDGET_PLOT_BOTH, data);
+    else
+      gpm_graph_widget_data_assign(GPM_GRAPH_WIDGET(widget),
+                                   GPM_GRAPH_WIDGET_PLOT_LINE, data);
+  } else {
+    smoothed = gpm_stats_update_smooth_data(data);
+    if (use_points)
+      gpm_graph_widget_data_assign(GPM_GRAPH_WIDGET(widget),
+                                   GPM_GRAPH_WIDGET_PLOT_POINTS, data);
+    gpm_graph_widget_data_assign(GPM_GRAPH_WIDGET(widget),
+                                 GPM_GRAPH_WIDGET_PLOT_LINE, smoothed);
+    g_ptr_array_unref(smoothed);
+  }
+
+  /* show */
+  gtk_widget_show(widget);
+}
+
+/**
+ * gpm_stats_history_point_new:
+ *
+ * Return value: a new point coloured by the device state, or %NULL if the
+ * state is unknown and the point should be abandoned
+ **/
+static GpmPointObj *gpm_stats_history_point_new(guint32 time, gfloat value,
+                                                UpDeviceState state,
+                                                gint32 offset) {
+  GpmPointObj *point;
+
+  /* abandon this point */
+  if (state == UP_DEVICE_STATE_UNKNOWN) return NULL;
+
+  point = gpm_point_obj_new();
+  point->x = ((gint32)time) - offset;
+  point->y = value;
+  if (state == UP_DEVICE_STATE_CHARGING)
+    point->color = egg_color_from_rgb(255, 0, 0);
+  else if (state == UP_DEVICE_STATE_DISCHARGING)
+    point->color = egg_color_from_rgb(0, 0, 255);
+  else if (state == UP_DEVICE_STATE_PENDING_CHARGE)
+    point->color = egg_color_from_rgb(200, 0, 0);
+  else if (state == UP_DEVICE_STATE_PENDING_DISCHARGE)
+    point->color = egg_color_from_rgb(0, 0, 200);
+  else {
+    if (history_type == GPM_HISTORY_RATE_TYPE)
+      point->color = egg_color_from_rgb(255, 255, 255);
+    else
+      point->color = egg_color_from_rgb(0, 255, 0);
+  }
+  return point;
+}
+
+/**
+ * gpm_stats_history_add_state_keys:
+ *
+ * Names the colors used by gpm_stats_history_point_new() so the hover
+ * read-out can show the state of a point.
+ **/
+static void gpm_stats_history_add_state_keys(void) {
+  GpmGraphWidget *graph = GPM_GRAPH_WIDGET(graph_history);
+
+  gpm_graph_widget_key_data_clear(graph);
+  gpm_graph_widget_key_data_add(
+      graph, egg_color_from_rgb(255, 0, 0),
+      gpm_device_state_to_localised_string(UP_DEVICE_STATE_CHARGING));
+  gpm_graph_widget_key_data_add(
+      graph, egg_color_from_rgb(0, 0, 255),
+      gpm_device_state_to_localised_string(UP_DEVICE_STATE_DISCHARGING));
+  gpm_graph_widget_key_data_add(
+      graph, egg_color_from_rgb(200, 0, 0),
+      gpm_device_state_to_localised_string(UP_DEVICE_STATE_PENDING_CHARGE));
+  gpm_graph_widget_key_data_add(
+      graph, egg_color_from_rgb(0, 0, 200),
+      gpm_device_state_to_localised_string(UP_DEVICE_STATE_PENDING_DISCHARGE));
+  gpm_graph_widget_key_data_add(
+      graph, egg_color_from_rgb(0, 255, 0),
+      gpm_device_state_to_localised_string(UP_DEVICE_STATE_FULLY_CHARGED));
+}
+
+/**
+ * gpm_stats_history_live_seed:
+ *
+ * Remembers the end of the data just drawn so that new samples can be
+ * added to the graph without drawing it again.
+ **/
+static void gpm_stats_history_live_seed(GPtrArray *data, gint32 offset) {
+  guint i = 0;
+
+  g_ptr_array_set_size(history_live_tail, 0);
+  if (data->len > GPM_STATS_HISTORY_TAIL_LENGTH)
+    i = data->len - GPM_STATS_HISTORY_TAIL_LENGTH;
+  for (; i < data->len; i++)
+    g_ptr_array_add(history_live_tail,
+                    gpm_point_obj_copy(g_ptr_array_index(data, i)));
+  history_live_origin = offset;
+
+  /* only follow new samples when looking at the present */
+  history_live = (history_view_stop == 0);
+}
+
+/**
+ * gpm_stats_history_render:
+ * @data: The points to show, or %NULL if there is no data
+ * @offset: The time the x values of @data are relative to
+ **/
+static void gpm_stats_history_render(GPtrArray *data, gint32 offset) {
+  GtkWidget *widget;
+  gboolean checked;
+  gboolean points;
+
+  widget = GTK_WIDGET(gtk_builder_get_object(builder, "label_history_nodata"));
+  if (data == NULL || data->len == 0) {
+    /* show no data label and hide graph */
+    history_live = FALSE;
+    gtk_widget_hide(graph_history);
+    gtk_widget_show(widget);
+    return;
+  }
+
+  /* hide no data and show graph */
+  gtk_widget_hide(widget);
+  gtk_widget_show(graph_history);
+
+  /* render */
+  sigma_smoothing = 2.0;
+  widget =
+      GTK_WIDGET(gtk_builder_get_object(builder, "checkbutton_smooth_history"));
+  checked = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+  widget =
+      GTK_WIDGET(gtk_builder_get_object(builder, "checkbutton_points_history"));
+  points = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+
+  /* present data to graph */
+  g_object_set(graph_history, "origin-x", 0, NULL);
+  gpm_stats_history_add_state_keys();
+  gpm_stats_set_graph_data(graph_history, data, checked, points);
+  gpm_stats_history_live_seed(data, offset);
+}
+
+/**
+ * gpm_stats_history_live_append:
+ *
+ * Adds one point to the end of the drawn lines and slides the graph along,
+ * smoothing only the end of the line again.
+ **/
+static void gpm_stats_history_live_append(const GpmPointObj *point) {
+  GpmGraphWidget *graph = GPM_GRAPH_WIDGET(graph_history);
+  GtkWidget *widget;
+  GPtrArray *smoothed;
+  GpmPointObj *last;
+  gboolean checked;
+  gboolean points;
+  gint32 origin;
+  guint changed;
+  guint length;
+  guint line = 0;
+  guint i;
+
+  /* the graph can't go backwards */
+  if (history_live_tail->len > 0) {
+    last = g_ptr_array_index(history_live_tail, history_live_tail->len - 1);
+    if (point->x <= last->x) return;
+  }
+  g_ptr_array_add(history_live_tail, gpm_point_obj_copy(point));
+  if (history_live_tail->len > 2 * GPM_STATS_HISTORY_TAIL_LENGTH)
+    g_ptr_array_remove_range(
+        history_live_tail, 0,
+        history_live_tail->len - GPM_STATS_HISTORY_TAIL_LENGTH);
+
+  widget =
+      GTK_WIDGET(gtk_builder_get_object(builder, "checkbutton_smooth_history"));
+  checked = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+  widget =
+      GTK_WIDGET(gtk_builder_get_object(builder, "checkbutton_points_history"));
+  points = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+
+  /* the lines are in the order gpm_stats_set_graph_data() added them */
+  if (!checked || points) gpm_graph_widget_data_append(graph, line++, point);
+  if (checked) {
+    smoothed = gpm_stats_update_smooth_data(history_live_tail);
+    length = gpm_graph_widget_data_get_length(graph, line);
+    changed = MIN(GPM_STATS_HISTORY_TAIL_CHANGED, smoothed->len) - 1;
+    changed = MIN(changed, length);
+    for (i = 0; i < changed; i++) {
+      last = g_ptr_array_index(smoothed, smoothed->len - 1 - changed + i);
+      gpm_graph_widget_data_set_y(graph, line, length - changed + i, last->y);
+    }
+    last = g_ptr_array_index(smoothed, smoothed->len - 1);
+    gpm_graph_widget_data_append(graph, line, last);
+    g_ptr_array_unref(smoothed);
+  }
+
+  /* move the window up to now and forget what fell off the left */
+  origin = (gint32)(g_get_real_time() / G_USEC_PER_SEC) - history_live_origin;
+  g_object_set(graph_history, "origin-x", origin, NULL);
+  gpm_graph_widget_data_trim(graph, origin - (gint32)history_view_span);
+}
+
+/**
+ * gpm_stats_history_add_bucket_points:
+ *
+ * Adds the extremes of the bucket in the order they happened, so spikes
+ * and state changes survive the downsampling.
+ **/
+static void gpm_stats_history_add_bucket_points(GPtrArray *array,
+                                                const GpmHistoryBucket *bucket,
+                                                gint32 offset) {
+  GpmPointObj *point;
+  guint32 time_first = bucket->min_time;
+  guint32 time_last = bucket->max_time;
+  gfloat value_first = bucket->min;
+  gfloat value_last = bucket->max;
+
+  if (bucket->max_time < bucket->min_time) {
+    time_first = bucket->max_time;
+    time_last = bucket->min_time;
+    value_first = bucket->max;
+    value_last = bucket->min;
+  }
+
+  if (time_first != time_last) {
+    point = gpm_stats_history_point_new(time_first, value_first,
+                                        bucket->state_first, offset);
+    if (point != NULL) g_ptr_array_add(array, point);
+  }
+  point = gpm_stats_history_point_new(time_last, value_last,
+                                      bucket->state_last, offset);
+  if (point != NULL) g_ptr_array_add(array, point);
+}
+
+/**
+ * gpm_stats_history_set_axis:
+ **/
+static void gpm_stats_history_set_axis(void) {
+  gint start_x = history_view_stop - (gint32)history_view_span;
+
+  if (history_type == GPM_HISTORY_CHARGE_TYPE) {
+    g_object_set(graph_history, "type-x", GPM_GRAPH_WIDGET_TYPE_TIME, "type-y",
+                 GPM_GRAPH_WIDGET_TYPE_PERCENTAGE, "autorange-x", FALSE,
+                 "start-x", start_x, "stop-x", history_view_stop,
+                 "autorange-y", FALSE, "start-y", 0, "stop-y", 100, NULL);
+  } else if (history_type == GPM_HISTORY_RATE_TYPE) {
+    g_object_set(graph_history, "type-x", GPM_GRAPH_WIDGET_TYPE_TIME, "type-y",
+                 GPM_GRAPH_WIDGET_TYPE_POWER, "autorange-x", FALSE, "start-x",
+                 start_x, "stop-x", history_view_stop, "autorange-y", TRUE,
+                 NULL);
+  } else {
+    g_object_set(graph_history, "type-x", GPM_GRAPH_WIDGET_TYPE_TIME, "type-y",
+                 GPM_GRAPH_WIDGET_TYPE_TIME, "autorange-x", FALSE, "start-x",
+                 start_x, "stop-x", history_view_stop, "autorange-y", TRUE,
+                 NULL);
+  }
+}
+
+/**
+ * gpm_stats_history_render_pyramid:
+ *
+ * Draws the visible timespan from the nearest pyramid level, which costs
+ * about one bucket per pixel whatever the timespan.
+ **/
+static void gpm_stats_history_render_pyramid(void) {
+  const GpmHistoryBucket *buckets;
+  GPtrArray *new;
+  gint32 offset;
+  guint32 start;
+  guint32 stop;
+  guint length;
+  guint level;
+  guint pixels;
+  guint i;
+
+  new = g_ptr_array_new_with_free_func((GDestroyNotify)gpm_point_obj_free);
+  offset = (gint32)(g_get_real_time() / G_USEC_PER_SEC);
+  stop = (guint32)(offset + history_view_stop);
+  start = stop - history_view_span;
+
+  pixels = gtk_widget_get_allocated_width(graph_history);
+  if (pixels < 100) pixels = 400;
+
+  level = gpm_history_pyramid_select_level(history_pyramid, start, stop,
+                                           pixels);
+  buckets = gpm_history_pyramid_query(history_pyramid, level, start, stop,
+                                      &length);
+  g_debug("drawing %i buckets of %is", length,
+          gpm_history_pyramid_get_interval(history_pyramid, level));
+  for (i = 0; i < length; i++)
+    gpm_stats_history_add_bucket_points(new, &buckets[i], offset);
+  gpm_stats_history_render(new, offset);
+  g_ptr_array_unref(new);
+}
+
+/**
+ * gpm_stats_history_scroll_event_cb:
+ *
+ * Scrolling zooms the history graph around the pointer, and scrolling
+ * sideways or with shift held pans it. Only the pyramid is queried.
+ **/
+static gboolean gpm_stats_history_scroll_event_cb(GtkWidget *widget,
+                                                  GdkEventScroll *event,
+                                                  gpointer user_data) {
+  GdkScrollDirection direction = event->direction;
+  gfloat pointer_x;
+  gdouble fraction = 0.5;
+  gint32 start;
+  gint32 stop;
+  guint span;
+
+  if (history_pyramid == NULL || history_compare) return FALSE;
+
+  /* treat smooth scrolling like a single click of the wheel */
+  if (direction == GDK_SCROLL_SMOOTH) {
+    if (ABS(event->delta_x) > ABS(event->delta_y))
+      direction = event->delta_x < 0 ? GDK_SCROLL_LEFT : GDK_SCROLL_RIGHT;
+    else if (event->delta_y != 0)
+      direction = event->delta_y < 0 ? GDK_SCROLL_UP : GDK_SCROLL_DOWN;
+    else
+      return FALSE;
+  }
+  if (event->state & GDK_SHIFT_MASK) {
+    if (direction == GDK_SCROLL_UP) direction = GDK_SCROLL_LEFT;
+    if (direction == GDK_SCROLL_DOWN) direction = GDK_SCROLL_RIGHT;
+  }
+
+  span = history_view_span;
+  stop = history_view_stop;
+  start = stop - (gint32)span;
+
+  if (gpm_graph_widget_get_data_x(GPM_GRAPH_WIDGET(widget), event->x,
+                                  &pointer_x))
+    fraction = CLAMP((pointer_x - start) / span, 0.0, 1.0);
+
+  if (direction == GDK_SCROLL_UP)
+    span = MAX(span / 2, GPM_STATS_HISTORY_ZOOM_MIN);
+  else if (direction == GDK_SCROLL_DOWN)
+    span = MIN(span * 2, GPM_HISTORY_WEEK_VALUE);
+
+  if (direction == GDK_SCROLL_LEFT) {
+    stop -= span / 10;
+  } else if (direction == GDK_SCROLL_RIGHT) {
+    stop += span / 10;
+  } else {
+    /* keep the time under the pointer where it is */
+    start += (gint32)(fraction * history_view_span) - (gint32)(fraction * span);
+    stop = start + (gint32)span;
+  }
+
+  /* never scroll into the future or past the oldest history */
+  stop = CLAMP(stop, -GPM_HISTORY_WEEK_VALUE + (gint32)span, 0);
+  if (stop == history_view_stop && span == history_view_span) return TRUE;
+
+  history_view_stop = stop;
+  history_view_span = span;
+  gpm_stats_history_set_axis();
+  gpm_stats_history_render_pyramid();
+  return TRUE;
+}
+
+/**
+ * gpm_stats_history_helper_free:
+ **/
+static void gpm_stats_history_helper_free(GpmStatsHistoryHelper *helper) {
+  g_object_unref(helper->device);
+  g_free(helper->filename);
+  g_free(helper);
+}
+
+/**
+ * gpm_stats_history_reconcile_thread:
+ *
+ * Runs the blocking UPower query away from the UI thread.
+ **/
+static void gpm_stats_history_reconcile_thread(GTask *task, gpointer object,
+                                               gpointer task_data,
+                                               GCancellable *cancellable) {
+  GpmStatsHistoryHelper *helper = (GpmStatsHistoryHelper *)task_data;
+  GPtrArray *array;
+  GError *error = NULL;
+
+  array = up_device_get_history_sync(helper->device,
+                                     history_types[helper->type],
+                                     helper->timespan, helper->resolution,
+                                     cancellable, &error);
+  if (array == NULL) {
+    g_task_return_error(task, error);
+    return;
+  }
+  g_task_return_pointer(task, array, (GDestroyNotify)g_ptr_array_unref);
+}
+
+/**
+ * gpm_stats_history_reconcile_cb:
+ *
+ * Appends the points newer than the cache and redraws.
+ **/
+static void gpm_stats_history_reconcile_cb(GObject *source, GAsyncResult *res,
+                                           gpointer user_data) {
+  GpmStatsHistoryHelper *helper;
+  UpHistoryItem *item;
+  GpmPointObj *point;
+  GPtrArray *array;
+  GPtrArray *new;
+  GError *error = NULL;
+  gint32 offset;
+  guint added = 0;
+  guint i;
+
+  array = g_task_propagate_pointer(G_TASK(res), &error);
+  if (array == NULL) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_debug("failed to get history: %s", error->message);
+      if (history_cache == NULL ||
+          gpm_history_cache_get_length(history_cache) == 0)
+        gpm_stats_history_render(NULL, 0);
+    }
+    g_error_free(error);
+    return;
+  }
+
+  helper = g_task_get_task_data(G_TASK(res));
+  g_ptr_array_sort(array, gpm_stats_history_item_sort_cb);
+
+  /* no cache, so just show what we got like we used to */
+  if (helper->filename == NULL) {
+    new = g_ptr_array_new_with_free_func((GDestroyNotify)gpm_point_obj_free);
+    offset = (gint32)(g_get_real_time() / G_USEC_PER_SEC);
+    for (i = 0; i < array->len; i++) {
+      item = (UpHistoryItem *)g_ptr_array_index(array, i);
+      point = gpm_stats_history_point_new(
+          up_history_item_get_time(item), up_history_item_get_value(item),
+          up_history_item_get_state(item), offset);
+      if (point != NULL) g_ptr_array_add(new, point);
+    }
+    gpm_stats_history_render(new, offset);
+    g_ptr_array_unref(new);
+    goto out;
+  }
+
+  /* the user moved on to another device or type */
+  if (history_cache == NULL ||
+      g_strcmp0(helper->filename, history_cache_filename) != 0)
+    goto out;
+
+  for (i = 0; i < array->len; i++) {
+    item = (UpHistoryItem *)g_ptr_array_index(array, i);
+    if (!gpm_history_cache_append(history_cache,
+                                  up_history_item_get_time(item),
+                                  up_history_item_get_value(item),
+                                  up_history_item_get_state(item)))
+      continue;
+    gpm_history_pyramid_add(history_pyramid, up_history_item_get_time(item),
+                            up_history_item_get_value(item),
+                            up_history_item_get_state(item));
+    added++;
+  }
+  g_debug("added %i of %i history points to %s", added, array->len,
+          helper->filename);
+  if (added > 0 || gpm_history_cache_get_length(history_cache) == 0)
+    gpm_stats_history_render_pyramid();
+out:
+  g_ptr_array_unref(array);
+}
+
+/**
+ * gpm_stats_history_reconcile:
+ * @cache: The open cache, or %NULL to fetch the whole timespan
+ *
+ * Asks UPower only for the history newer than the last cached point.
+ **/
+static void gpm_stats_history_reconcile(UpDevice *device,
+                                        GpmHistoryCache *cache) {
+  GpmStatsHistoryHelper *helper;
+  GTask *task;
+  guint32 last_time;
+  guint32 now;
+
+  /* abandon any query for the previous device or type */
+  if (history_cancellable != NULL) {
+    g_cancellable_cancel(history_cancellable);
+    g_object_unref(history_cancellable);
+  }
+  history_cancellable = g_cancellable_new();
+
+  helper = g_new0(GpmStatsHistoryHelper, 1);
+  helper->device = g_object_ref(device);
+  helper->type = history_type;
+  if (cache == NULL) {
+    helper->timespan = history_time;
+    helper->resolution = 150;
+  } else {
+    now = (guint32)(g_get_real_time() / G_USEC_PER_SEC);
+    last_time = gpm_history_cache_get_last_time(cache);
+    if (last_time == 0 || now - last_time > GPM_HISTORY_WEEK_VALUE)
+      helper->timespan = GPM_HISTORY_WEEK_VALUE;
+    else
+      helper->timespan = MAX(now - last_time, 1);
+    helper->resolution = GPM_STATS_HISTORY_RESOLUTION;
+    helper->filename = g_strdup(history_cache_filename);
+  }
+
+  task = g_task_new(NULL, history_cancellable, gpm_stats_history_reconcile_cb,
+                    NULL);
+  g_task_set_task_data(task, helper,
+                       (GDestroyNotify)gpm_stats_history_helper_free);
+  g_task_run_in_thread(task, gpm_stats_history_reconcile_thread);
+  g_object_unref(task);
+}
+
+/**
+ * gpm_stats_history_compare_item_free:
+ **/
+static void gpm_stats_history_compare_item_free(GpmStatsCompareItem *item) {
+  g_free(item->object_path);
+  g_free(item);
+}
+
+/**
+ * gpm_stats_history_compare_helper_free:
+ **/
+static void gpm_stats_history_compare_helper_free(
+    GpmStatsCompareHelper *compare) {
+  GPtrArray *array;
+  guint i;
+
+  for (i = 0; i < compare->results->len; i++) {
+    array = g_ptr_array_index(compare->results, i);
+    if (array != NULL) g_ptr_array_unref(array);
+  }
+  g_ptr_array_unref(compare->results);
+  g_ptr_array_unref(compare->descs);
+  g_object_unref(compare->cancellable);
+  g_free(compare);
+}
+
+/**
+ * gpm_stats_history_compare_thread:
+ *
+ * Connects to one of the devices and gets its history, so that all the
+ * devices are queried at the same time without blocking the UI.
+ **/
+static void gpm_stats_history_compare_thread(GTask *task, gpointer object,
+                                             gpointer task_data,
+                                             GCancellable *cancellable) {
+  GpmStatsCompareItem *item = (GpmStatsCompareItem *)task_data;
+  UpDevice *device;
+  GPtrArray *array = NULL;
+  GError *error = NULL;
+
+  device = up_device_new();
+  if (up_device_set_object_path_sync(device, item->object_path, cancellable,
+                                     &error))
+    array = up_device_get_history_sync(device, history_types[item->type],
+                                       item->timespan,
+                                       GPM_STATS_HISTORY_COMPARE_RESOLUTION,
+                                       cancellable, &error);
+  g_object_unref(device);
+  if (array == NULL) {
+    g_task_return_error(task, error);
+    return;
+  }
+  g_ptr_array_sort(array, gpm_stats_history_item_sort_cb);
+  g_task_return_pointer(task, array, (GDestroyNotify)g_ptr_array_unref);
+}
+
+/**
+ * gpm_stats_history_compare_render:
+ *
+ * Draws one line per device, all against the same time base.
+ **/
+static void gpm_stats_history_compare_render(GpmStatsCompareHelper *compare) {
+  GpmGraphWidget *graph = GPM_GRAPH_WIDGET(graph_history);
+  UpHistoryItem *item;
+  GpmPointObj *point;
+  GtkWidget *widget;
+  GPtrArray *array;
+  GPtrArray *new;
+  GPtrArray *smoothed;
+  gboolean checked;
+  guint32 color;
+  guint drawn = 0;
+  guint i, j;
+
+  widget =
+      GTK_WIDGET(gtk_builder_get_object(builder, "checkbutton_smooth_history"));
+  checked = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+  sigma_smoothing = 2.0;
+
+  gpm_graph_widget_data_clear(graph);
+  gpm_graph_widget_key_data_clear(graph);
+  g_object_set(graph_history, "origin-x", 0, NULL);
+  for (i = 0; i < compare->results->len; i++) {
+    array = g_ptr_array_index(compare->results, i);
+    if (array == NULL) continue;
+    color =
+        history_compare_colors[drawn % G_N_ELEMENTS(history_compare_colors)];
+
+    new = g_ptr_array_new_with_free_func((GDestroyNotify)gpm_point_obj_free);
+    for (j = 0; j < array->len; j++) {
+      item = (UpHistoryItem *)g_ptr_array_index(array, j);
+      if (up_history_item_get_state(item) == UP_DEVICE_STATE_UNKNOWN) continue;
+      point = gpm_point_obj_new();
+      point->x = (gint32)up_history_item_get_time(item) - compare->offset;
+      point->y = up_history_item_get_value(item);
+      point->color = color;
+      g_ptr_array_add(new, point);
+    }
+    if (new->len > 0) {
+      if (checked) {
+        smoothed = gpm_stats_update_smooth_data(new);
+        gpm_graph_widget_data_assign(graph, GPM_GRAPH_WIDGET_PLOT_LINE,
+                                     smoothed);
+        g_ptr_array_unref(smoothed);
+      } else {
+        gpm_graph_widget_data_assign(graph, GPM_GRAPH_WIDGET_PLOT_LINE, new);
+      }
+      gpm_graph_widget_key_data_add(graph, color,
+                                    g_ptr_array_index(compare->descs, i));
+      drawn++;
+    }
+    g_ptr_array_unref(new);
+  }
+
+  widget = GTK_WIDGET(gtk_builder_get_object(builder, "label_history_nodata"));
+  if (drawn == 0) {
+    gtk_widget_hide(graph_history);
+    gtk_widget_show(widget);
+    return;
+  }
+  gtk_widget_hide(widget);
+  gtk_widget_show(graph_history);
+}
+
+/**
+ * gpm_stats_history_compare_cb:
+ **/
+static void gpm_stats_history_compare_cb(GObject *source, GAsyncResult *res,
+                                         gpointer user_data) {
+  GpmStatsCompareHelper *compare = (GpmStatsCompareHelper *)user_data;
+  GpmStatsCompareItem *item;
+  GPtrArray *array;
+  GError *error = NULL;
+
+  item = g_task_get_task_data(G_TASK(res));
+  array = g_task_propagate_pointer(G_TASK(res), &error);
+  if (array == NULL) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_debug("failed to get history for %s: %s", item->object_path,
+              error->message);
+    g_error_free(error);
+  } else {
+    g_ptr_array_index(compare->results, item->index) = array;
+  }
+
+  /* wait for the slowest device */
+  if (--compare->pending > 0) return;
+  if (!g_cancellable_is_cancelled(compare->cancellable))
+    gpm_stats_history_compare_render(compare);
+  gpm_stats_history_compare_helper_free(compare);
+}
+
+/**
+ * gpm_stats_history_compare:
+ *
+ * Asks for the history of all the selected devices at once, and draws
+ * them together when the last one arrives.
+ **/
+static void gpm_stats_history_compare(void) {
+  GpmStatsCompareHelper *compare;
+  GpmStatsCompareItem *item;
+  GtkTreeSelection *selection;
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  GtkWidget *widget;
+  GList *rows;
+  GList *l;
+  GTask *task;
+  gchar *desc;
+  gchar *id;
+
+  /* abandon the previous comparison */
+  if (history_compare_cancellable != NULL) {
+    g_cancellable_cancel(history_compare_cancellable);
+    g_object_unref(history_compare_cancellable);
   }
+  history_compare_cancellable = g_cancellable_new();
 
-  g_free(vendor);
-  g_free(serial);
-  g_free(model);
+  widget = GTK_WIDGET(gtk_builder_get_object(builder, "treeview_devices"));
+  selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(widget));
+  rows = gtk_tree_selection_get_selected_rows(selection, &model);
+  if (rows == NULL) return;
+
+  compare = g_new0(GpmStatsCompareHelper, 1);
+  compare->results = g_ptr_array_new();
+  compare->descs = g_ptr_array_new_with_free_func(g_free);
+  compare->cancellable = g_object_ref(history_compare_cancellable);
+  compare->offset = (gint32)(g_get_real_time() / G_USEC_PER_SEC);
+  for (l = rows; l != NULL; l = l->next) {
+    if (!gtk_tree_model_get_iter(model, &iter, l->data)) continue;
+    gtk_tree_model_get(model, &iter, GPM_DEVICES_COLUMN_ID, &id,
+                       GPM_DEVICES_COLUMN_TEXT, &desc, -1);
+
+    item = g_new0(GpmStatsCompareItem, 1);
+    item->object_path = id;
+    item->type = history_type;
+    item->timespan = history_view_span - history_view_stop;
+    item->index = compare->results->len;
+    g_ptr_array_add(compare->results, NULL);
+    g_ptr_array_add(compare->descs, desc);
+
+    task = g_task_new(NULL, history_compare_cancellable,
+                      gpm_stats_history_compare_cb, compare);
+    g_task_set_task_data(task, item,
+                         (GDestroyNotify)gpm_stats_history_compare_item_free);
+    g_task_run_in_thread(task, gpm_stats_history_compare_thread);
+    g_object_unref(task);
+    compare->pending++;
+  }
+  g_list_free_full(rows, (GDestroyNotify)gtk_tree_path_free);
+
+  if (compare->pending == 0) gpm_stats_history_compare_helper_free(compare);
 }
 
 /**
- * gpm_stats_set_graph_data:
+ * gpm_stats_history_cache_open:
+ *
+ * Return value: the cache for the device and current history type, or %NULL
  **/
-static void gpm_stats_set_graph_data(GtkWidget *widget, GPtrArray *data,
-                                     gboolean use_smoothed,
-                                     gboolean use_points) {
-  GPtrArray *smoothed;
+static GpmHistoryCache *gpm_stats_history_cache_open(UpDevice *device) {
+  const GpmHistoryCacheItem *item;
+  const gchar *object_path;
+  gchar *filename;
+  GError *error = NULL;
+  guint length;
+  guint i;
 
-  gpm_graph_widget_data_clear(GPM_GRAPH_WIDGET(widget));
+  object_path = up_device_get_object_path(device);
+  if (object_path == NULL) return NULL;
+
+  filename = gpm_history_cache_get_filename(object_path,
+                                            history_types[history_type]);
+  if (history_cache != NULL &&
+      g_strcmp0(filename, history_cache_filename) == 0) {
+    g_free(filename);
+    return history_cache;
+  }
 
-  /* add correct data */
-  if (!use_smoothed) {
-    if (use_points)
-      gpm_graph_widget_data_assign(GPM_GRAPH_WIDGET(widget),
-                                   GPM_GRAPH_WIDGET_PLOT_BOTH, data);
-    else
-      gpm_graph_widget_data_assign(GPM_GRAPH_WIDGET(widget),
-                                   GPM_GRAPH_WIDGET_PLOT_LINE, data);
-  } else {
-    smoothed = gpm_stats_update_smooth_data(data);
-    if (use_points)
-      gpm_graph_widget_data_assign(GPM_GRAPH_WIDGET(widget),
-                                   GPM_GRAPH_WIDGET_PLOT_POINTS, data);
-    gpm_graph_widget_data_assign(GPM_GRAPH_WIDGET(widget),
-                                 GPM_GRAPH_WIDGET_PLOT_LINE, smoothed);
-    g_ptr_array_unref(smoothed);
+  gpm_history_cache_free(history_cache);
+  g_free(history_cache_filename);
+  history_cache_filename = filename;
+  history_update_time = 0;
+  history_cache = gpm_history_cache_open(filename, GPM_STATS_HISTORY_CACHE_SIZE,
+                                         &error);
+  if (history_cache == NULL) {
+    g_warning("failed to open history cache: %s", error->message);
+    g_error_free(error);
+    /* don't draw the previous device as this one */
+    gpm_history_pyramid_clear(history_pyramid);
+    g_clear_pointer(&history_cache_filename, g_free);
+    return NULL;
   }
 
-  /* show */
-  gtk_widget_show(widget);
+  /* build the pyramid once, new points are folded in as they arrive */
+  gpm_history_pyramid_clear(history_pyramid);
+  length = gpm_history_cache_get_length(history_cache);
+  for (i = 0; i < length; i++) {
+    item = gpm_history_cache_index(history_cache, i);
+    gpm_history_pyramid_add(history_pyramid, item->time, item->value,
+                            item->state);
+  }
+  return history_cache;
 }
 
 /**
  * gpm_stats_update_info_page_history:
+ *
+ * Renders from the on-disk cache straight away and then brings the cache
+ * up to date in the background.
  **/
 static void gpm_stats_update_info_page_history(UpDevice *device) {
-  GPtrArray *array;
-  guint i;
-  UpHistoryItem *item;
-  GtkWidget *widget;
-  gboolean checked;
-  gboolean points;
-  GpmPointObj *point;
-  GPtrArray *new;
-  gint32 offset;
+  GpmHistoryCache *cache;
+  guint64 update_time;
 
-  new = g_ptr_array_new_with_free_func((GDestroyNotify)gpm_point_obj_free);
-  if (history_type == GPM_HISTORY_CHARGE_TYPE) {
-    g_object_set(graph_history, "type-x", GPM_GRAPH_WIDGET_TYPE_TIME, "type-y",
-                 GPM_GRAPH_WIDGET_TYPE_PERCENTAGE, "autorange-x", FALSE,
-                 "start-x", -history_time, "stop-x", 0, "autorange-y", FALSE,
-                 "start-y", 0, "stop-y", 100, NULL);
-  } else if (history_type == GPM_HISTORY_RATE_TYPE) {
-    g_object_set(graph_history, "type-x", GPM_GRAPH_WIDGET_TYPE_TIME, "type-y",
-                 GPM_GRAPH_WIDGET_TYPE_POWER, "autorange-x", FALSE, "start-x",
-                 -history_time, "stop-x", 0, "autorange-y", TRUE, NULL);
-  } else {
-    g_object_set(graph_history, "type-x", GPM_GRAPH_WIDGET_TYPE_TIME, "type-y",
-                 GPM_GRAPH_WIDGET_TYPE_TIME, "autorange-x", FALSE, "start-x",
-                 -history_time, "stop-x", 0, "autorange-y", TRUE, NULL);
-  }
+  /* drawn again from scratch below */
+  history_live = FALSE;
+  gpm_stats_history_set_axis();
 
-  widget = GTK_WIDGET(gtk_builder_get_object(builder, "label_history_nodata"));
-  /* The type of history, history_types [history_type], known values are "rate"
-   * and "charge". */
-  array = up_device_get_history_sync(device, history_types[history_type],
-                                     history_time, 150, NULL, NULL);
-  if (array == NULL) {
-    /* show no data label and hide graph */
-    gtk_widget_hide(graph_history);
-    gtk_widget_show(widget);
-    goto out;
+  if (history_compare) {
+    gpm_stats_history_compare();
+    return;
   }
 
-  /* hide no data and show graph */
-  gtk_widget_hide(widget);
-  gtk_widget_show(graph_history);
+  cache = gpm_stats_history_cache_open(device);
+  if (cache != NULL && gpm_history_cache_get_length(cache) > 0)
+    gpm_stats_history_render_pyramid();
 
-  offset = (gint32)(g_get_real_time() / G_USEC_PER_SEC);
+  /* UPower has nothing new for us until the device is refreshed */
+  g_object_get(device, "update-time", &update_time, NULL);
+  if (cache != NULL && update_time == history_update_time) return;
+  history_update_time = update_time;
 
-  for (i = 0; i < array->len; i++) {
-    item = (UpHistoryItem *)g_ptr_array_index(array, i);
+  gpm_stats_history_reconcile(device, cache);
+}
 
-    /* abandon this point */
-    if (up_history_item_get_state(item) == UP_DEVICE_STATE_UNKNOWN) continue;
+/**
+ * gpm_stats_history_live_update:
+ *
+ * Adds the current value of the device to the history graph, without
+ * asking UPower for the history again.
+ *
+ * Return value: %TRUE if the history page is up to date
+ **/
+static gboolean gpm_stats_history_live_update(UpDevice *device) {
+  GtkNotebook *notebook;
+  GpmPointObj *point;
+  UpDeviceState state;
+  guint64 update_time;
+  gdouble value_double;
+  gint64 value_int;
+  gfloat value;
 
-    point = gpm_point_obj_new();
-    point->x = ((gint32)up_history_item_get_time(item)) - offset;
-    point->y = up_history_item_get_value(item);
-    if (up_history_item_get_state(item) == UP_DEVICE_STATE_CHARGING)
-      point->color = egg_color_from_rgb(255, 0, 0);
-    else if (up_history_item_get_state(item) == UP_DEVICE_STATE_DISCHARGING)
-      point->color = egg_color_from_rgb(0, 0, 255);
-    else if (up_history_item_get_state(item) == UP_DEVICE_STATE_PENDING_CHARGE)
-      point->color = egg_color_from_rgb(200, 0, 0);
-    else if (up_history_item_get_state(item) ==
-             UP_DEVICE_STATE_PENDING_DISCHARGE)
-      point->color = egg_color_from_rgb(0, 0, 200);
-    else {
-      if (history_type == GPM_HISTORY_RATE_TYPE)
-        point->color = egg_color_from_rgb(255, 255, 255);
-      else
-        point->color = egg_color_from_rgb(0, 255, 0);
-    }
-    g_ptr_array_add(new, point);
+  notebook = GTK_NOTEBOOK(gtk_builder_get_object(builder, "notebook1"));
+  if (gtk_notebook_get_current_page(notebook) != 1) return FALSE;
+
+  /* the comparison is only fetched again when the selection changes */
+  if (history_compare) return TRUE;
+  if (!history_live) return FALSE;
+
+  g_object_get(device, "update-time", &update_time, "state", &state, NULL);
+
+  if (history_type == GPM_HISTORY_RATE_TYPE) {
+    g_object_get(device, "energy-rate", &value_double, NULL);
+    value = value_double;
+  } else if (history_type == GPM_HISTORY_CHARGE_TYPE) {
+    g_object_get(device, "percentage", &value_double, NULL);
+    value = value_double;
+  } else if (history_type == GPM_HISTORY_TIME_FULL_TYPE) {
+    g_object_get(device, "time-to-full", &value_int, NULL);
+    value = value_int;
+  } else if (history_type == GPM_HISTORY_TIME_EMPTY_TYPE) {
+    g_object_get(device, "time-to-empty", &value_int, NULL);
+    value = value_int;
+  } else {
+    return FALSE;
   }
 
-  /* render */
-  sigma_smoothing = 2.0;
-  widget =
-      GTK_WIDGET(gtk_builder_get_object(builder, "checkbutton_smooth_history"));
-  checked = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
-  widget =
-      GTK_WIDGET(gtk_builder_get_object(builder, "checkbutton_points_history"));
-  points = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
-
-  /* present data to graph */
-  gpm_stats_set_graph_data(graph_history, new, checked, points);
-
-  g_ptr_array_unref(array);
-  g_ptr_array_unref(new);
-out:
-  return;
+  /* only drawn, the cache is left to what UPower itself records */
+  point = gpm_stats_history_point_new(update_time, value, state,
+                                      history_live_origin);
+  if (point != NULL) {
+    gpm_stats_history_live_append(point);
+    gpm_point_obj_free(point);
+  }
+  return TRUE;
 }
 
 /**
@@ -659,6 +1719,274 @@ out:
   return;
 }
 
+/**
+ * gpm_stats_processes_cell_data_func:
+ **/
+static void gpm_stats_processes_cell_data_func(GtkTreeViewColumn *column,
+                                               GtkCellRenderer *renderer,
+                                               GtkTreeModel *model,
+                                               GtkTreeIter *iter,
+                                               gpointer data) {
+  gint id = GPOINTER_TO_INT(data);
+  gdouble value;
+  gchar *text;
+
+  gtk_tree_model_get(model, iter, id, &value, -1);
+  if (id == GPM_PROCESSES_COLUMN_CPU)
+    text = g_strdup_printf("%.1f%%", value * 100.0f);
+  else if (id == GPM_PROCESSES_COLUMN_POWER)
+    /* TRANSLATORS: this is the power apportioned to the process in watts */
+    text = g_strdup_printf(_("%.2f W"), value);
+  else if (id == GPM_PROCESSES_COLUMN_ENERGY)
+    /* TRANSLATORS: this is the energy the process used in watt hours */
+    text = g_strdup_printf(_("%.3f Wh"), value);
+  else
+    text = g_format_size((guint64)value);
+  g_object_set(renderer, "text", text, NULL);
+  g_free(text);
+}
+
+/**
+ * gpm_stats_add_processes_column:
+ **/
+static void gpm_stats_add_processes_column(GtkTreeView *treeview,
+                                           const gchar *title, gint id) {
+  GtkCellRenderer *renderer;
+  GtkTreeViewColumn *column;
+
+  renderer = gtk_cell_renderer_text_new();
+  g_object_set(renderer, "xalign", 1.0f, NULL);
+  column = gtk_tree_view_column_new();
+  gtk_tree_view_column_set_title(column, title);
+  gtk_tree_view_column_pack_start(column, renderer, TRUE);
+  gtk_tree_view_column_set_cell_data_func(
+      column, renderer, gpm_stats_processes_cell_data_func,
+      GINT_TO_POINTER(id), NULL);
+  gtk_tree_view_column_set_sort_column_id(column, id);
+  gtk_tree_view_append_column(treeview, column);
+}
+
+/**
+ * gpm_stats_add_processes_columns:
+ **/
+static void gpm_stats_add_processes_columns(GtkTreeView *treeview) {
+  GtkCellRenderer *renderer;
+  GtkTreeViewColumn *column;
+
+  /* TRANSLATORS: the process ID */
+  renderer = gtk_cell_renderer_text_new();
+  column = gtk_tree_view_column_new_with_attributes(
+      _("PID"), renderer, "text", GPM_PROCESSES_COLUMN_PID, NULL);
+  gtk_tree_view_column_set_sort_column_id(column, GPM_PROCESSES_COLUMN_PID);
+  gtk_tree_view_append_column(treeview, column);
+
+  /* TRANSLATORS: the process name */
+  renderer = gtk_cell_renderer_text_new();
+  column = gtk_tree_view_column_new_with_attributes(
+      _("Process"), renderer, "text", GPM_PROCESSES_COLUMN_NAME, NULL);
+  gtk_tree_view_column_set_sort_column_id(column, GPM_PROCESSES_COLUMN_NAME);
+  gtk_tree_view_column_set_expand(column, TRUE);
+  gtk_tree_view_append_column(treeview, column);
+
+  /* TRANSLATORS: the share of all the processor time */
+  gpm_stats_add_processes_column(treeview, _("CPU"),
+                                 GPM_PROCESSES_COLUMN_CPU);
+  /* TRANSLATORS: the power apportioned to the process right now */
+  gpm_stats_add_processes_column(treeview, _("Power"),
+                                 GPM_PROCESSES_COLUMN_POWER);
+  /* TRANSLATORS: the energy apportioned to the process while shown */
+  gpm_stats_add_processes_column(treeview, _("Energy"),
+                                 GPM_PROCESSES_COLUMN_ENERGY);
+  /* TRANSLATORS: bytes per second read and written to disk */
+  gpm_stats_add_processes_column(treeview, _("Disk"),
+                                 GPM_PROCESSES_COLUMN_IO);
+}
+
+/**
+ * gpm_stats_processes_update_graph:
+ *
+ * Plots the power history of the selected process, newest on the right.
+ **/
+static void gpm_stats_processes_update_graph(void) {
+  gfloat power[GPM_PROC_SAMPLER_HISTORY];
+  GpmPointObj *point;
+  GPtrArray *data;
+  GtkWidget *widget;
+  guint count = 0;
+  guint i;
+
+  if (processes_sampler != NULL && processes_selected != 0)
+    count = gpm_proc_sampler_get_history(processes_sampler, processes_selected,
+                                         power, GPM_PROC_SAMPLER_HISTORY);
+
+  widget =
+      GTK_WIDGET(gtk_builder_get_object(builder, "label_processes_nodata"));
+  if (count < 2) {
+    gtk_widget_hide(graph_processes);
+    gtk_widget_show(widget);
+    return;
+  }
+  gtk_widget_hide(widget);
+
+  data = g_ptr_array_new_with_free_func((GDestroyNotify)gpm_point_obj_free);
+  for (i = 0; i < count; i++) {
+    point = gpm_point_obj_new();
+    point->x = -((gint)(count - 1 - i) * GPM_STATS_PROCESSES_INTERVAL);
+    point->y = power[i];
+    point->color = egg_color_from_rgb(0, 0, 255);
+    g_ptr_array_add(data, point);
+  }
+  gpm_stats_set_graph_data(graph_processes, data, FALSE, FALSE);
+  g_ptr_array_unref(data);
+}
+
+/**
+ * gpm_stats_processes_update:
+ *
+ * Takes a sample and replaces the list with the busiest processes.
+ **/
+static gboolean gpm_stats_processes_update(gpointer user_data) {
+  const GpmProcSamplerItem *items[GPM_STATS_PROCESSES_TOP];
+  const GpmProcSamplerItem *item;
+  UpDeviceState state = UP_DEVICE_STATE_UNKNOWN;
+  GtkTreeSelection *selection;
+  GtkWidget *widget;
+  GtkTreeIter iter;
+  GError *error = NULL;
+  gdouble rate = 0.0f;
+  gchar *text;
+  guint selected;
+  guint len;
+  guint i;
+
+  /* the share of a battery discharge rate is the only honest number */
+  if (processes_device != NULL)
+    g_object_get(processes_device, "state", &state, "energy-rate", &rate,
+                 NULL);
+  if (state != UP_DEVICE_STATE_DISCHARGING) rate = 0.0f;
+
+  if (!gpm_proc_sampler_sample(processes_sampler, g_get_monotonic_time(),
+                               rate, &error)) {
+    g_warning("failed to sample processes: %s", error->message);
+    g_error_free(error);
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* clearing the list drops the selection, so remember it */
+  selected = processes_selected;
+  len = gpm_proc_sampler_get_top(processes_sampler, items,
+                                 GPM_STATS_PROCESSES_TOP);
+  gtk_list_store_clear(list_store_processes);
+  widget = GTK_WIDGET(gtk_builder_get_object(builder, "treeview_processes"));
+  selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(widget));
+  for (i = 0; i < len; i++) {
+    gtk_list_store_insert_with_values(
+        list_store_processes, &iter, -1, GPM_PROCESSES_COLUMN_PID,
+        items[i]->pid, GPM_PROCESSES_COLUMN_NAME, items[i]->name,
+        GPM_PROCESSES_COLUMN_CPU, items[i]->cpu, GPM_PROCESSES_COLUMN_POWER,
+        items[i]->power, GPM_PROCESSES_COLUMN_ENERGY, items[i]->energy,
+        GPM_PROCESSES_COLUMN_IO, items[i]->io, -1);
+    if (items[i]->pid == selected)
+      gtk_tree_selection_select_iter(selection, &iter);
+  }
+
+  /* keep graphing a quiet process even when it drops out of the list */
+  item = gpm_proc_sampler_lookup(processes_sampler, selected);
+  processes_selected = item != NULL ? selected : 0;
+
+  widget = GTK_WIDGET(gtk_builder_get_object(builder, "label_processes_other"));
+  if (rate > 0.0f) {
+    /* TRANSLATORS: idle, screen and other hardware power, in watts */
+    text = g_strdup_printf(
+        _("Not attributed to a process: %.2f W"),
+        gpm_proc_sampler_get_unattributed(processes_sampler));
+    gtk_label_set_label(GTK_LABEL(widget), text);
+    g_free(text);
+  } else {
+    gtk_label_set_label(GTK_LABEL(widget),
+                        _("Power is only measured when on battery power"));
+  }
+
+  gpm_stats_processes_update_graph();
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * gpm_stats_processes_start:
+ *
+ * Sampling /proc is not free, so it is only done while the page is shown.
+ **/
+static void gpm_stats_processes_start(void) {
+  GError *error = NULL;
+  GtkWidget *widget;
+
+  if (processes_id != 0) return;
+  if (processes_sampler == NULL) {
+    processes_sampler = gpm_proc_sampler_new(NULL, &error);
+    if (processes_sampler == NULL) {
+      g_warning("failed to open processes: %s", error->message);
+      g_error_free(error);
+      return;
+    }
+    widget =
+        GTK_WIDGET(gtk_builder_get_object(builder, "checkbutton_processes_io"));
+    gpm_proc_sampler_set_use_io(
+        processes_sampler,
+        gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)));
+  }
+
+  /* the first sample only primes the counters, also after being hidden */
+  gpm_proc_sampler_restart(processes_sampler);
+  gpm_stats_processes_update(NULL);
+  processes_id = g_timeout_add_seconds(GPM_STATS_PROCESSES_INTERVAL,
+                                       gpm_stats_processes_update, NULL);
+  g_source_set_name_by_id(processes_id, "[GpmStatistics] processes");
+}
+
+/**
+ * gpm_stats_processes_stop:
+ **/
+static void gpm_stats_processes_stop(void) {
+  if (processes_id == 0) return;
+  g_source_remove(processes_id);
+  processes_id = 0;
+}
+
+/**
+ * gpm_stats_processes_treeview_clicked_cb:
+ **/
+static void gpm_stats_processes_treeview_clicked_cb(GtkTreeSelection *selection,
+                                                    gpointer data) {
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  guint pid;
+
+  /* an empty selection while the list is rebuilt is not a user action */
+  if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+  gtk_tree_model_get(model, &iter, GPM_PROCESSES_COLUMN_PID, &pid, -1);
+  if (pid == processes_selected) return;
+  processes_selected = pid;
+  gpm_stats_processes_update_graph();
+}
+
+/**
+ * gpm_stats_processes_io_checkbox_cb:
+ **/
+static void gpm_stats_processes_io_checkbox_cb(GtkWidget *widget,
+                                               gpointer data) {
+  GtkTreeViewColumn *column;
+  GtkWidget *treeview;
+  gboolean checked;
+
+  checked = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+  if (processes_sampler != NULL)
+    gpm_proc_sampler_set_use_io(processes_sampler, checked);
+  treeview = GTK_WIDGET(gtk_builder_get_object(builder, "treeview_processes"));
+  column = gtk_tree_view_get_column(GTK_TREE_VIEW(treeview),
+                                    GPM_PROCESSES_COLUMN_IO);
+  gtk_tree_view_column_set_visible(column, checked);
+}
+
 /**
  * gpm_stats_update_info_data_page:
  **/
@@ -720,6 +2048,8 @@ static void gpm_stats_set_title(GtkWindow *window, gint page_num) {
       N_("Device History"),
       /* TRANSLATORS: shown on the titlebar */
       N_("Device Profile"),
+      /* TRANSLATORS: shown on the titlebar */
+      N_("Process Power Usage"),
   };
 
   /* TRANSLATORS: shown on the titlebar */
@@ -744,6 +2074,12 @@ static void gpm_stats_notebook_changed_cb(GtkNotebook *notebook, gpointer page,
   /* save page in gsettings */
   g_settings_set_int(settings, GPM_SETTINGS_INFO_PAGE_NUMBER, page_num);
 
+  /* the processes page does not depend on the selected device */
+  if (page_num == GPM_STATS_PROCESSES_PAGE)
+    gpm_stats_processes_start();
+  else
+    gpm_stats_processes_stop();
+
   if (current_device == NULL) return;
 
   device = up_device_new();
@@ -775,9 +2111,20 @@ static void gpm_stats_devices_treeview_clicked_cb(GtkTreeSelection *selection,
   GtkTreeModel *model;
   GtkTreeIter iter;
   UpDevice *device;
+  GList *rows;
+  gboolean selected;
+
+  /* when comparing, the other pages show the first selected device */
+  if (gtk_tree_selection_get_mode(selection) == GTK_SELECTION_MULTIPLE) {
+    rows = gtk_tree_selection_get_selected_rows(selection, &model);
+    selected =
+        rows != NULL && gtk_tree_model_get_iter(model, &iter, rows->data);
+    g_list_free_full(rows, (GDestroyNotify)gtk_tree_path_free);
+  } else {
+    selected = gtk_tree_selection_get_selected(selection, &model, &iter);
+  }
 
-  /* This will only work in single or browse selection mode! */
-  if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+  if (selected) {
     g_free(current_device);
     gtk_tree_model_get(model, &iter, GPM_DEVICES_COLUMN_ID, &current_device,
                        -1);
@@ -810,17 +2157,42 @@ static void gpm_stats_window_activated_cb(GtkApplication *app, gpointer data) {
   gtk_window_present(GTK_WINDOW(widget));
 }
 
+/**
+ * gpm_stats_device_changed_tick_cb:
+ *
+ * Does the update for all the notifies received since the last frame.
+ **/
+static gboolean gpm_stats_device_changed_tick_cb(GtkWidget *widget,
+                                                 GdkFrameClock *frame_clock,
+                                                 gpointer user_data) {
+  device_changed_id = 0;
+  if (device_changed == NULL) return G_SOURCE_REMOVE;
+  if (g_strcmp0(current_device, up_device_get_object_path(device_changed)) ==
+          0 &&
+      !gpm_stats_history_live_update(device_changed))
+    gpm_stats_update_info_data(device_changed);
+  g_clear_object(&device_changed);
+  return G_SOURCE_REMOVE;
+}
+
 /**
  * gpm_stats_device_changed_cb:
  **/
 static void gpm_stats_device_changed_cb(UpDevice *device, GParamSpec *pspec,
                                         gpointer user_data) {
   const gchar *object_path;
+  GtkWidget *widget;
   object_path = up_device_get_object_path(device);
   if (object_path == NULL || current_device == NULL) return;
   g_debug("changed:   %s", object_path);
-  if (g_strcmp0(current_device, object_path) == 0)
-    gpm_stats_update_info_data(device);
+  if (g_strcmp0(current_device, object_path) != 0) return;
+
+  /* UPower sends a burst of notifies for each refresh */
+  g_set_object(&device_changed, device);
+  if (device_changed_id != 0) return;
+  widget = GTK_WIDGET(gtk_builder_get_object(builder, "dialog_stats"));
+  device_changed_id = gtk_widget_add_tick_callback(
+      widget, gpm_stats_device_changed_tick_cb, NULL, NULL);
 }
 
 /**
@@ -897,7 +2269,7 @@ static void gpm_stats_device_removed_cb(UpClient *client,
   }
   g_debug("removed:   %s", object_path);
   if (g_strcmp0(current_device, object_path) == 0) {
-    gtk_list_store_clear(list_store_info);
+    gpm_stats_info_data_clear();
   }
 
   /* search the list and remove the object path entry */
@@ -1049,6 +2421,10 @@ static void gpm_stats_range_combo_changed(GtkWidget *widget, gpointer data) {
   else
     g_assert(FALSE);
 
+  /* show the whole timespan again */
+  history_view_stop = 0;
+  history_view_span = history_time;
+
   /* save to gsettings */
   g_settings_set_int(settings, GPM_SETTINGS_INFO_HISTORY_TIME, history_time);
 
@@ -1094,6 +2470,30 @@ static void gpm_stats_points_checkbox_history_cb(GtkWidget *widget,
   gpm_stats_button_update_ui();
 }
 
+/**
+ * gpm_stats_compare_checkbox_history_cb:
+ * @widget: The GtkWidget object
+ **/
+static void gpm_stats_compare_checkbox_history_cb(GtkWidget *widget,
+                                                  gpointer data) {
+  GtkTreeSelection *selection;
+  GtkWidget *treeview;
+
+  history_compare = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+  treeview = GTK_WIDGET(gtk_builder_get_object(builder, "treeview_devices"));
+  selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(treeview));
+  gtk_tree_selection_set_mode(selection, history_compare
+                                             ? GTK_SELECTION_MULTIPLE
+                                             : GTK_SELECTION_SINGLE);
+  if (!history_compare) {
+    if (history_compare_cancellable != NULL)
+      g_cancellable_cancel(history_compare_cancellable);
+    gpm_graph_widget_key_data_clear(GPM_GRAPH_WIDGET(graph_history));
+  }
+  g_object_set(graph_history, "use-legend", history_compare, NULL);
+  gpm_stats_button_update_ui();
+}
+
 /**
  * gpm_stats_points_checkbox_stats_cb:
  * @widget: The GtkWidget object
@@ -1205,7 +2605,15 @@ int main(int argc, char *argv[]) {
   graph_history = gpm_graph_widget_new();
   gtk_box_pack_start(box, graph_history, TRUE, TRUE, 0);
   gtk_widget_set_size_request(graph_history, 400, 250);
+  gtk_widget_add_events(graph_history, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK);
+  g_signal_connect(graph_history, "scroll-event",
+                   G_CALLBACK(gpm_stats_history_scroll_event_cb), NULL);
   gtk_widget_show(graph_history);
+  history_pyramid = gpm_history_pyramid_new(
+      GPM_STATS_HISTORY_PYRAMID_INTERVAL, GPM_STATS_HISTORY_PYRAMID_FACTOR,
+      GPM_STATS_HISTORY_PYRAMID_LEVELS);
+  history_live_tail =
+      g_ptr_array_new_with_free_func((GDestroyNotify)gpm_point_obj_free);
 
   /* add statistics graph */
   box = GTK_BOX(gtk_builder_get_object(builder, "hbox_statistics"));
@@ -1214,6 +2622,16 @@ int main(int argc, char *argv[]) {
   gtk_widget_set_size_request(graph_statistics, 400, 250);
   gtk_widget_show(graph_statistics);
 
+  /* add processes graph */
+  box = GTK_BOX(gtk_builder_get_object(builder, "hbox_processes"));
+  graph_processes = gpm_graph_widget_new();
+  gtk_box_pack_start(box, graph_processes, TRUE, TRUE, 0);
+  gtk_widget_set_size_request(graph_processes, 400, 150);
+  g_object_set(graph_processes, "type-x", GPM_GRAPH_WIDGET_TYPE_TIME, "type-y",
+               GPM_GRAPH_WIDGET_TYPE_POWER, "autorange-x", FALSE, "start-x",
+               -(GPM_PROC_SAMPLER_HISTORY - 1) * GPM_STATS_PROCESSES_INTERVAL,
+               "stop-x", 0, "autorange-y", TRUE, NULL);
+
   window = GTK_WIDGET(gtk_builder_get_object(builder, "dialog_stats"));
   gtk_window_set_default_size(GTK_WINDOW(window), 800, 500);
   gtk_window_set_default_icon_name(GPM_ICON_APP_ICON);
@@ -1254,6 +2672,11 @@ int main(int argc, char *argv[]) {
   g_signal_connect(widget, "clicked",
                    G_CALLBACK(gpm_stats_points_checkbox_history_cb), NULL);
 
+  widget = GTK_WIDGET(
+      gtk_builder_get_object(builder, "checkbutton_compare_history"));
+  g_signal_connect(widget, "clicked",
+                   G_CALLBACK(gpm_stats_compare_checkbox_history_cb), NULL);
+
   widget =
       GTK_WIDGET(gtk_builder_get_object(builder, "checkbutton_points_stats"));
   checked =
@@ -1262,6 +2685,11 @@ int main(int argc, char *argv[]) {
   g_signal_connect(widget, "clicked",
                    G_CALLBACK(gpm_stats_points_checkbox_stats_cb), NULL);
 
+  widget =
+      GTK_WIDGET(gtk_builder_get_object(builder, "checkbutton_processes_io"));
+  g_signal_connect(widget, "clicked",
+                   G_CALLBACK(gpm_stats_processes_io_checkbox_cb), NULL);
+
   widget = GTK_WIDGET(gtk_builder_get_object(builder, "notebook1"));
 
   gtk_widget_add_events(widget, GDK_SCROLL_MASK);
@@ -1276,8 +2704,16 @@ int main(int argc, char *argv[]) {
   /* create list stores */
   list_store_info =
       gtk_list_store_new(GPM_INFO_COLUMN_LAST, G_TYPE_STRING, G_TYPE_STRING);
+  info_rows = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                    (GDestroyNotify)gpm_stats_info_row_free);
   list_store_devices = gtk_list_store_new(
       GPM_DEVICES_COLUMN_LAST, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+  list_store_processes = gtk_list_store_new(
+      GPM_PROCESSES_COLUMN_LAST, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_DOUBLE,
+      G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_DOUBLE);
+  gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(list_store_processes),
+                                       GPM_PROCESSES_COLUMN_CPU,
+                                       GTK_SORT_DESCENDING);
 
   /* create transaction_id tree view */
   widget = GTK_WIDGET(gtk_builder_get_object(builder, "treeview_info"));
@@ -1300,6 +2736,18 @@ int main(int argc, char *argv[]) {
   gpm_stats_add_devices_columns(GTK_TREE_VIEW(widget));
   gtk_tree_view_columns_autosize(GTK_TREE_VIEW(widget)); /* show */
 
+  /* create processes tree view */
+  widget = GTK_WIDGET(gtk_builder_get_object(builder, "treeview_processes"));
+  gtk_tree_view_set_model(GTK_TREE_VIEW(widget),
+                          GTK_TREE_MODEL(list_store_processes));
+  selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(widget));
+  g_signal_connect(selection, "changed",
+                   G_CALLBACK(gpm_stats_processes_treeview_clicked_cb), NULL);
+  gpm_stats_add_processes_columns(GTK_TREE_VIEW(widget));
+  widget =
+      GTK_WIDGET(gtk_builder_get_object(builder, "checkbutton_processes_io"));
+  gpm_stats_processes_io_checkbox_cb(widget, NULL);
+
   char *history_type_str =
       g_settings_get_string(settings, GPM_SETTINGS_INFO_HISTORY_TYPE);
   if ((history_type_str == NULL) ||
@@ -1320,6 +2768,7 @@ int main(int argc, char *argv[]) {
 
   history_time = g_settings_get_int(settings, GPM_SETTINGS_INFO_HISTORY_TIME);
   if (history_time == 0) history_time = GPM_HISTORY_HOUR_VALUE;
+  history_view_span = history_time;
 
   char *stats_type_str =
       g_settings_get_string(settings, GPM_SETTINGS_INFO_STATS_TYPE);
@@ -1397,6 +2846,7 @@ int main(int argc, char *argv[]) {
   client = up_client_new();
 
   devices = up_client_get_devices2(client);
+  processes_device = up_client_get_display_device(client);
 
   /* add devices in visually pleasing order */
   for (j = 0; j < UP_DEVICE_KIND_LAST; j++) {
@@ -1434,15 +2884,48 @@ int main(int argc, char *argv[]) {
   widget = GTK_WIDGET(gtk_builder_get_object(builder, "combobox_stats_type"));
   gpm_stats_type_combo_changed_cb(widget, NULL);
 
+  /* switch-page is not emitted for the page restored at startup */
+  if (page == GPM_STATS_PROCESSES_PAGE) gpm_stats_processes_start();
+
+  energy_used_id = g_timeout_add_seconds(
+      GPM_STATS_ENERGY_USED_REFRESH,
+      (GSourceFunc)gpm_stats_energy_used_timeout_cb, devices);
+  g_source_set_name_by_id(energy_used_id, "[GpmStatistics] energy used");
+
   widget = GTK_WIDGET(gtk_builder_get_object(builder, "dialog_stats"));
 
   status = g_application_run(G_APPLICATION(app), argc, argv);
   if (devices != NULL) g_ptr_array_unref(devices);
 
+  if (history_cancellable != NULL) {
+    g_cancellable_cancel(history_cancellable);
+    g_object_unref(history_cancellable);
+  }
+  if (history_compare_cancellable != NULL) {
+    g_cancellable_cancel(history_compare_cancellable);
+    g_object_unref(history_compare_cancellable);
+  }
+  if (energy_used_id != 0) g_source_remove(energy_used_id);
+  if (energy_used_cancellable != NULL) {
+    g_cancellable_cancel(energy_used_cancellable);
+    g_object_unref(energy_used_cancellable);
+  }
+  g_free(energy_used_device);
+  gpm_history_cache_free(history_cache);
+  gpm_history_pyramid_free(history_pyramid);
+  g_free(history_cache_filename);
+  g_ptr_array_unref(history_live_tail);
+  gpm_stats_processes_stop();
+  gpm_proc_sampler_free(processes_sampler);
+  g_clear_object(&processes_device);
+  g_object_unref(list_store_processes);
+
   g_object_unref(settings);
   g_object_unref(client);
   g_object_unref(builder);
   g_object_unref(list_store_info);
+  g_hash_table_unref(info_rows);
+  g_clear_object(&device_changed);
   g_object_unref(app);
   g_free(last_device);
   return status;
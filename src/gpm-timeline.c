@@ -0,0 +1,720 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "gpm-timeline.h"
+#include "gpm-trace.h"
+
+/* "GPMT" in host byte order */
+#define GPM_TIMELINE_MAGIC 0x544d5047
+#define GPM_TIMELINE_DAY (24 * 60 * 60)
+/* a normal day is a few hundred events, a few bytes each */
+#define GPM_TIMELINE_MAX_FILE_SIZE (64 * 1024)
+#define GPM_TIMELINE_MAX_DAYS 28
+/* write when this much is waiting, or after the timeout, whichever is first */
+#define GPM_TIMELINE_FLUSH_SIZE 4096
+#define GPM_TIMELINE_FLUSH_TIMEOUT (15 * 60)
+#define GPM_TIMELINE_NO_DAY G_MAXUINT32
+
+/* each record is a varint of the seconds since the previous record, or the
+ * start of the day for the first, the kind as a byte, and a varint value */
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  guint32 day_start;
+  guint32 reserved;
+} GpmTimelineHeader;
+
+struct GpmTimelinePrivate {
+  gchar *directory;
+  GByteArray *buffer; /* records not written yet */
+  guint32 day;        /* the file being appended to */
+  guint32 last_time;  /* of the last record, written or not */
+  gsize file_size;    /* including what is buffered */
+  guint dropped;
+  guint flush_id;
+  GpmTrace *trace;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE(GpmTimeline, gpm_timeline, G_TYPE_OBJECT)
+
+static gpointer gpm_timeline_object = NULL;
+
+/**
+ * gpm_timeline_put_varint:
+ **/
+static void gpm_timeline_put_varint(GByteArray *buffer, guint32 value) {
+  guint8 byte;
+
+  do {
+    byte = value & 0x7f;
+    value >>= 7;
+    if (value != 0) byte |= 0x80;
+    g_byte_array_append(buffer, &byte, 1);
+  } while (value != 0);
+}
+
+/**
+ * gpm_timeline_get_varint:
+ *
+ * Return value: %FALSE if the data ends before the value does
+ **/
+static gboolean gpm_timeline_get_varint(const guint8 *data, gsize length,
+                                        gsize *offset, guint32 *value) {
+  guint shift;
+
+  *value = 0;
+  for (shift = 0; shift < 35; shift += 7) {
+    if (*offset >= length) return FALSE;
+    *value |= (guint32)(data[*offset] & 0x7f) << shift;
+    if ((data[(*offset)++] & 0x80) == 0) return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * gpm_timeline_get_filename:
+ **/
+static gchar *gpm_timeline_get_filename(const gchar *directory, guint32 day) {
+  GDateTime *datetime;
+  gchar *basename;
+  gchar *filename;
+
+  datetime = g_date_time_new_from_unix_utc((gint64)day * GPM_TIMELINE_DAY);
+  basename = g_date_time_format(datetime, "%Y-%m-%d.timeline");
+  filename = g_build_filename(directory, basename, NULL);
+  g_date_time_unref(datetime);
+  g_free(basename);
+  return filename;
+}
+
+/**
+ * gpm_timeline_read_file:
+ * @array: Where to add the items between @start and @stop, or %NULL
+ * @last_time: The returned time of the last record, or %NULL
+ *
+ * A file with a bad header is ignored, and a record cut short by a crash
+ * ends the file.
+ *
+ * Return value: %FALSE if the file exists but is not a timeline
+ **/
+static gboolean gpm_timeline_read_file(const gchar *filename, GArray *array,
+                                       guint32 start, guint32 stop,
+                                       guint32 *last_time) {
+  GpmTimelineHeader header;
+  GpmTimelineItem item;
+  guint8 *data = NULL;
+  gsize length = 0;
+  gsize offset;
+  guint32 delta;
+  guint32 time;
+  gboolean ret = FALSE;
+
+  if (!g_file_get_contents(filename, (gchar **)&data, &length, NULL))
+    return TRUE;
+  if (length < sizeof(GpmTimelineHeader)) goto out;
+  memcpy(&header, data, sizeof(GpmTimelineHeader));
+  if (header.magic != GPM_TIMELINE_MAGIC ||
+      header.version != GPM_TIMELINE_VERSION)
+    goto out;
+
+  time = header.day_start;
+  offset = sizeof(GpmTimelineHeader);
+  while (offset < length) {
+    if (!gpm_timeline_get_varint(data, length, &offset, &delta)) break;
+    if (offset >= length) break;
+    item.kind = data[offset++];
+    if (!gpm_timeline_get_varint(data, length, &offset, &item.value)) break;
+    time += delta;
+    item.time = time;
+    if (array != NULL && time >= start && time <= stop)
+      g_array_append_val(array, item);
+  }
+  if (last_time != NULL) *last_time = time;
+  ret = TRUE;
+out:
+  g_free(data);
+  return ret;
+}
+
+/**
+ * gpm_timeline_sort_cb:
+ **/
+static gint gpm_timeline_sort_cb(gconstpointer a, gconstpointer b) {
+  return g_strcmp0(*(const gchar **)a, *(const gchar **)b);
+}
+
+/**
+ * gpm_timeline_list_files:
+ *
+ * Return value: the timeline files in @directory, oldest first
+ **/
+static GPtrArray *gpm_timeline_list_files(const gchar *directory) {
+  GPtrArray *files;
+  const gchar *name;
+  GDir *dir;
+
+  files = g_ptr_array_new_with_free_func(g_free);
+  dir = g_dir_open(directory, 0, NULL);
+  if (dir == NULL) return files;
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    if (g_str_has_suffix(name, ".timeline"))
+      g_ptr_array_add(files, g_build_filename(directory, name, NULL));
+  }
+  g_dir_close(dir);
+
+  /* the names are dates, so sort in date order */
+  g_ptr_array_sort(files, gpm_timeline_sort_cb);
+  return files;
+}
+
+/**
+ * gpm_timeline_prune:
+ *
+ * Removes the oldest days so the timeline never grows without bound,
+ * called each time a new day is started.
+ **/
+static void gpm_timeline_prune(GpmTimeline *timeline) {
+  GPtrArray *files;
+  const gchar *filename;
+  guint i;
+
+  files = gpm_timeline_list_files(timeline->priv->directory);
+  for (i = 0; i + GPM_TIMELINE_MAX_DAYS < files->len; i++) {
+    filename = g_ptr_array_index(files, i);
+    g_debug("removing old timeline %s", filename);
+    g_unlink(filename);
+  }
+  g_ptr_array_unref(files);
+}
+
+/**
+ * gpm_timeline_open_day:
+ *
+ * Switches to the file for @day, carrying on from where it ends if the
+ * daemon was restarted.
+ **/
+static void gpm_timeline_open_day(GpmTimeline *timeline, guint32 day) {
+  GpmTimelinePrivate *priv = timeline->priv;
+  GStatBuf buf;
+  gchar *filename;
+
+  filename = gpm_timeline_get_filename(priv->directory, day);
+  priv->day = day;
+  priv->dropped = 0;
+  priv->last_time = day * GPM_TIMELINE_DAY;
+  priv->file_size = sizeof(GpmTimelineHeader);
+  if (g_stat(filename, &buf) == 0 && buf.st_size > 0) {
+    if (gpm_timeline_read_file(filename, NULL, 0, 0, &priv->last_time)) {
+      priv->file_size = buf.st_size;
+    } else {
+      g_debug("replacing invalid timeline %s", filename);
+      g_unlink(filename);
+    }
+  }
+  g_free(filename);
+}
+
+/**
+ * gpm_timeline_flush_cb:
+ **/
+static gboolean gpm_timeline_flush_cb(GpmTimeline *timeline) {
+  GError *error = NULL;
+
+  timeline->priv->flush_id = 0;
+  if (!gpm_timeline_flush(timeline, &error)) {
+    g_warning("failed to write timeline: %s", error->message);
+    g_error_free(error);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gpm_timeline_flush:
+ * @timeline: This class instance
+ * @error: a #GError, or %NULL
+ *
+ * Writes out the buffered records. This normally happens on its own every
+ * few minutes so the disk isn't woken for every event.
+ *
+ * Return value: %FALSE if the records could not be written, they are then
+ * kept to try again
+ **/
+gboolean gpm_timeline_flush(GpmTimeline *timeline, GError **error) {
+  GpmTimelinePrivate *priv;
+  GpmTimelineHeader header;
+  GStatBuf buf;
+  gchar *filename;
+  gsize offset = 0;
+  gssize wrote;
+  gboolean created = FALSE;
+  gboolean ret = FALSE;
+  gint fd;
+
+  g_return_val_if_fail(GPM_IS_TIMELINE(timeline), FALSE);
+
+  priv = timeline->priv;
+  if (priv->flush_id != 0) {
+    g_source_remove(priv->flush_id);
+    priv->flush_id = 0;
+  }
+  if (priv->buffer->len == 0) return TRUE;
+
+  filename = gpm_timeline_get_filename(priv->directory, priv->day);
+  if (g_mkdir_with_parents(priv->directory, 0700) < 0) goto out_errno;
+  fd = g_open(filename, O_WRONLY | O_CREAT | O_APPEND, 0600);
+  if (fd < 0) goto out_errno;
+
+  /* a new file starts with the header */
+  if (fstat(fd, &buf) == 0 && buf.st_size == 0) {
+    memset(&header, 0, sizeof(GpmTimelineHeader));
+    header.magic = GPM_TIMELINE_MAGIC;
+    header.version = GPM_TIMELINE_VERSION;
+    header.day_start = priv->day * GPM_TIMELINE_DAY;
+    if (write(fd, &header, sizeof(GpmTimelineHeader)) !=
+        sizeof(GpmTimelineHeader)) {
+      close(fd);
+      goto out_errno;
+    }
+    created = TRUE;
+  }
+  while (offset < priv->buffer->len) {
+    wrote = write(fd, priv->buffer->data + offset, priv->buffer->len - offset);
+    if (wrote < 0 && errno == EINTR) continue;
+    if (wrote < 0) {
+      close(fd);
+      goto out_errno;
+    }
+    offset += wrote;
+  }
+  close(fd);
+  g_byte_array_set_size(priv->buffer, 0);
+  if (created) gpm_timeline_prune(timeline);
+  ret = TRUE;
+  goto out;
+out_errno:
+  g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+              "failed to write %s: %s", filename, g_strerror(errno));
+out:
+  g_free(filename);
+  return ret;
+}
+
+/**
+ * gpm_timeline_add_at:
+ * @timeline: This class instance
+ * @time: The time of the event, in seconds since the epoch
+ * @kind: The kind of event, e.g. %GPM_TIMELINE_KIND_DPMS
+ * @value: The new state, the meaning depends on @kind
+ *
+ * Buffers an event to be written to the file for its day.
+ **/
+void gpm_timeline_add_at(GpmTimeline *timeline, guint32 time,
+                         GpmTimelineKind kind, guint32 value) {
+  GpmTimelinePrivate *priv;
+  GError *error = NULL;
+  guint8 byte = kind;
+  guint length;
+  guint32 day;
+
+  g_return_if_fail(GPM_IS_TIMELINE(timeline));
+  g_return_if_fail(kind < GPM_TIMELINE_KIND_LAST);
+
+  priv = timeline->priv;
+
+  /* the log only goes forwards, even if the clock doesn't */
+  if (priv->day != GPM_TIMELINE_NO_DAY && time < priv->last_time)
+    time = priv->last_time;
+  day = time / GPM_TIMELINE_DAY;
+  if (day != priv->day) {
+    if (!gpm_timeline_flush(timeline, &error)) {
+      g_warning("failed to write timeline: %s", error->message);
+      g_clear_error(&error);
+      g_byte_array_set_size(priv->buffer, 0);
+    }
+    gpm_timeline_open_day(timeline, day);
+  }
+
+  /* stop recording a day that is far busier than it should be */
+  if (priv->file_size + 11 > GPM_TIMELINE_MAX_FILE_SIZE) {
+    if (priv->dropped++ == 0) g_debug("timeline for today is full");
+    return;
+  }
+
+  length = priv->buffer->len;
+  gpm_timeline_put_varint(priv->buffer, time - priv->last_time);
+  g_byte_array_append(priv->buffer, &byte, 1);
+  gpm_timeline_put_varint(priv->buffer, value);
+  priv->file_size += priv->buffer->len - length;
+  priv->last_time = time;
+
+  /* write before sleeping, in case we never wake up */
+  if (kind == GPM_TIMELINE_KIND_SLEEP ||
+      priv->buffer->len >= GPM_TIMELINE_FLUSH_SIZE) {
+    if (!gpm_timeline_flush(timeline, &error)) {
+      g_warning("failed to write timeline: %s", error->message);
+      g_error_free(error);
+    }
+    return;
+  }
+  if (priv->flush_id == 0) {
+    priv->flush_id = g_timeout_add_seconds(
+        GPM_TIMELINE_FLUSH_TIMEOUT, (GSourceFunc)gpm_timeline_flush_cb,
+        timeline);
+    g_source_set_name_by_id(priv->flush_id, "[GpmTimeline] flush");
+  }
+}
+
+/**
+ * gpm_timeline_add:
+ * @timeline: This class instance
+ * @kind: The kind of event, e.g. %GPM_TIMELINE_KIND_DPMS
+ * @value: The new state, the meaning depends on @kind
+ *
+ * Records an event that happened just now. When replaying a trace this is
+ * printed as a decision instead, so the real history is left alone.
+ **/
+void gpm_timeline_add(GpmTimeline *timeline, GpmTimelineKind kind,
+                      guint32 value) {
+  g_return_if_fail(GPM_IS_TIMELINE(timeline));
+
+  if (gpm_trace_is_replaying(timeline->priv->trace)) {
+    gpm_trace_decision(timeline->priv->trace, "%s %u",
+                       gpm_timeline_kind_to_string(kind), value);
+    return;
+  }
+  gpm_timeline_add_at(timeline, g_get_real_time() / G_USEC_PER_SEC, kind,
+                      value);
+}
+
+/**
+ * gpm_timeline_set_directory:
+ * @timeline: This class instance
+ * @directory: Where to keep the files
+ **/
+void gpm_timeline_set_directory(GpmTimeline *timeline, const gchar *directory) {
+  GError *error = NULL;
+
+  g_return_if_fail(GPM_IS_TIMELINE(timeline));
+  g_return_if_fail(directory != NULL);
+
+  if (!gpm_timeline_flush(timeline, &error)) {
+    g_warning("failed to write timeline: %s", error->message);
+    g_error_free(error);
+    g_byte_array_set_size(timeline->priv->buffer, 0);
+  }
+  g_free(timeline->priv->directory);
+  timeline->priv->directory = g_strdup(directory);
+  timeline->priv->day = GPM_TIMELINE_NO_DAY;
+}
+
+/**
+ * gpm_timeline_get_default_directory:
+ *
+ * Return value: where the daemon keeps the timeline, free with g_free()
+ **/
+gchar *gpm_timeline_get_default_directory(void) {
+  return g_build_filename(g_get_user_cache_dir(), "mate-power-manager",
+                          "timeline", NULL);
+}
+
+/**
+ * gpm_timeline_read:
+ * @directory: Where the files are kept, or %NULL for the default
+ * @start: The first time to include
+ * @stop: The last time to include
+ * @error: a #GError, or %NULL
+ *
+ * Reads back what the daemon has written; the last few minutes may still
+ * be waiting to be written.
+ *
+ * Return value: a #GArray of #GpmTimelineItem's in time order
+ **/
+GArray *gpm_timeline_read(const gchar *directory, guint32 start, guint32 stop,
+                          GError **error) {
+  GpmTimelineHeader header;
+  GPtrArray *files;
+  GArray *array;
+  const gchar *filename;
+  gchar *directory_default = NULL;
+  gchar buf[sizeof(GpmTimelineHeader)];
+  FILE *file;
+  guint i;
+
+  if (directory == NULL) {
+    directory_default = gpm_timeline_get_default_directory();
+    directory = directory_default;
+  }
+
+  array = g_array_new(FALSE, FALSE, sizeof(GpmTimelineItem));
+  files = gpm_timeline_list_files(directory);
+  for (i = 0; i < files->len; i++) {
+    filename = g_ptr_array_index(files, i);
+
+    /* only read the days that overlap */
+    file = g_fopen(filename, "rb");
+    if (file == NULL) continue;
+    if (fread(buf, sizeof(buf), 1, file) != 1) {
+      fclose(file);
+      continue;
+    }
+    fclose(file);
+    memcpy(&header, buf, sizeof(GpmTimelineHeader));
+    if (header.day_start > stop ||
+        (guint64)header.day_start + GPM_TIMELINE_DAY <= start)
+      continue;
+
+    if (!gpm_timeline_read_file(filename, array, start, stop, NULL))
+      g_debug("ignoring invalid timeline %s", filename);
+  }
+  g_ptr_array_unref(files);
+  g_free(directory_default);
+  return array;
+}
+
+/**
+ * gpm_timeline_kind_to_string:
+ **/
+const gchar *gpm_timeline_kind_to_string(GpmTimelineKind kind) {
+  if (kind == GPM_TIMELINE_KIND_BRIGHTNESS) return "brightness";
+  if (kind == GPM_TIMELINE_KIND_DPMS) return "dpms";
+  if (kind == GPM_TIMELINE_KIND_IDLE) return "idle";
+  if (kind == GPM_TIMELINE_KIND_LID) return "lid";
+  if (kind == GPM_TIMELINE_KIND_INHIBIT) return "inhibit";
+  if (kind == GPM_TIMELINE_KIND_SLEEP) return "sleep";
+  if (kind == GPM_TIMELINE_KIND_RESUME) return "resume";
+  return "unknown";
+}
+
+/**
+ * gpm_timeline_finalize:
+ **/
+static void gpm_timeline_finalize(GObject *object) {
+  GpmTimeline *timeline;
+  GError *error = NULL;
+
+  g_return_if_fail(object != NULL);
+  g_return_if_fail(GPM_IS_TIMELINE(object));
+
+  timeline = GPM_TIMELINE(object);
+  if (!gpm_timeline_flush(timeline, &error)) {
+    g_warning("failed to write timeline: %s", error->message);
+    g_error_free(error);
+  }
+  g_byte_array_unref(timeline->priv->buffer);
+  g_free(timeline->priv->directory);
+  g_object_unref(timeline->priv->trace);
+
+  G_OBJECT_CLASS(gpm_timeline_parent_class)->finalize(object);
+}
+
+/**
+ * gpm_timeline_class_init:
+ **/
+static void gpm_timeline_class_init(GpmTimelineClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->finalize = gpm_timeline_finalize;
+}
+
+/**
+ * gpm_timeline_init:
+ **/
+static void gpm_timeline_init(GpmTimeline *timeline) {
+  timeline->priv = gpm_timeline_get_instance_private(timeline);
+  timeline->priv->directory = gpm_timeline_get_default_directory();
+  timeline->priv->buffer = g_byte_array_new();
+  timeline->priv->day = GPM_TIMELINE_NO_DAY;
+  timeline->priv->trace = gpm_trace_new();
+}
+
+/**
+ * gpm_timeline_new:
+ * Return value: A new timeline class instance.
+ **/
+GpmTimeline *gpm_timeline_new(void) {
+  if (gpm_timeline_object != NULL) {
+    g_object_ref(gpm_timeline_object);
+  } else {
+    gpm_timeline_object = g_object_new(GPM_TYPE_TIMELINE, NULL);
+    g_object_add_weak_pointer(gpm_timeline_object, &gpm_timeline_object);
+  }
+  return GPM_TIMELINE(gpm_timeline_object);
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+static void gpm_timeline_test_clear(const gchar *directory) {
+  GPtrArray *files;
+  guint i;
+
+  files = gpm_timeline_list_files(directory);
+  for (i = 0; i < files->len; i++) g_unlink(g_ptr_array_index(files, i));
+  g_ptr_array_unref(files);
+}
+
+void gpm_timeline_test(gpointer data) {
+  GpmTimeline *timeline;
+  GpmTimelineItem *item;
+  GPtrArray *files;
+  GArray *array;
+  GStatBuf buf;
+  gchar *directory;
+  gchar *filename;
+  guint32 day = 20000 * GPM_TIMELINE_DAY;
+  guint i;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmTimeline")) return;
+
+  directory = g_build_filename(g_get_tmp_dir(), "gpm-self-test-timeline", NULL);
+  gpm_timeline_test_clear(directory);
+  timeline = g_object_new(GPM_TYPE_TIMELINE, NULL);
+  gpm_timeline_set_directory(timeline, directory);
+
+  /************************************************************/
+  egg_test_title(test, "events are kept in memory");
+  gpm_timeline_add_at(timeline, day + 10, GPM_TIMELINE_KIND_BRIGHTNESS, 50);
+  gpm_timeline_add_at(timeline, day + 300, GPM_TIMELINE_KIND_DPMS, 3);
+  array = gpm_timeline_read(directory, 0, G_MAXUINT32, NULL);
+  egg_test_assert(test, array->len == 0);
+  g_array_unref(array);
+
+  /************************************************************/
+  egg_test_title(test, "flush and read back");
+  gpm_timeline_flush(timeline, NULL);
+  array = gpm_timeline_read(directory, 0, G_MAXUINT32, NULL);
+  item = &g_array_index(array, GpmTimelineItem, 1);
+  if (array->len == 2 && item->time == day + 300 &&
+      item->kind == GPM_TIMELINE_KIND_DPMS && item->value == 3)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %i items", array->len);
+  g_array_unref(array);
+
+  /************************************************************/
+  egg_test_title(test, "sleep is written straight away");
+  gpm_timeline_add_at(timeline, day + 400, GPM_TIMELINE_KIND_SLEEP, 1);
+  array = gpm_timeline_read(directory, 0, G_MAXUINT32, NULL);
+  egg_test_assert(test, array->len == 3);
+  g_array_unref(array);
+
+  /************************************************************/
+  egg_test_title(test, "records are a few bytes each");
+  filename = gpm_timeline_get_filename(directory, day / GPM_TIMELINE_DAY);
+  g_stat(filename, &buf);
+  if (buf.st_size == sizeof(GpmTimelineHeader) + 3 + 4 + 3)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "file is %i bytes", (gint)buf.st_size);
+  g_free(filename);
+
+  /************************************************************/
+  egg_test_title(test, "time never goes backwards");
+  gpm_timeline_add_at(timeline, day + 200, GPM_TIMELINE_KIND_RESUME, 0);
+  gpm_timeline_flush(timeline, NULL);
+  array = gpm_timeline_read(directory, 0, G_MAXUINT32, NULL);
+  item = &g_array_index(array, GpmTimelineItem, array->len - 1);
+  egg_test_assert(test, array->len == 4 && item->time == day + 400);
+  g_array_unref(array);
+
+  /************************************************************/
+  egg_test_title(test, "start a new file each day");
+  gpm_timeline_add_at(timeline, day + GPM_TIMELINE_DAY + 5,
+                      GPM_TIMELINE_KIND_IDLE, 2);
+  gpm_timeline_flush(timeline, NULL);
+  files = gpm_timeline_list_files(directory);
+  egg_test_assert(test, files->len == 2);
+  g_ptr_array_unref(files);
+
+  /************************************************************/
+  egg_test_title(test, "read a range");
+  array = gpm_timeline_read(directory, day + 300, day + GPM_TIMELINE_DAY, NULL);
+  egg_test_assert(test, array->len == 3);
+  g_array_unref(array);
+
+  /************************************************************/
+  egg_test_title(test, "carry on the file after a restart");
+  g_object_unref(timeline);
+  timeline = g_object_new(GPM_TYPE_TIMELINE, NULL);
+  gpm_timeline_set_directory(timeline, directory);
+  gpm_timeline_add_at(timeline, day + GPM_TIMELINE_DAY + 100,
+                      GPM_TIMELINE_KIND_LID, 1);
+  gpm_timeline_flush(timeline, NULL);
+  array = gpm_timeline_read(directory, day + GPM_TIMELINE_DAY, G_MAXUINT32,
+                            NULL);
+  item = &g_array_index(array, GpmTimelineItem, 1);
+  if (array->len == 2 && item->time == day + GPM_TIMELINE_DAY + 100 &&
+      item->kind == GPM_TIMELINE_KIND_LID)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %i items", array->len);
+  g_array_unref(array);
+
+  /************************************************************/
+  egg_test_title(test, "a busy day is capped");
+  for (i = 0; i < 100000; i++)
+    gpm_timeline_add_at(timeline, day + GPM_TIMELINE_DAY + 200 + i / 10,
+                        GPM_TIMELINE_KIND_BRIGHTNESS, i % 100);
+  gpm_timeline_flush(timeline, NULL);
+  filename = gpm_timeline_get_filename(directory, day / GPM_TIMELINE_DAY + 1);
+  g_stat(filename, &buf);
+  if (buf.st_size <= GPM_TIMELINE_MAX_FILE_SIZE &&
+      buf.st_size > GPM_TIMELINE_MAX_FILE_SIZE - 16)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "file is %i bytes", (gint)buf.st_size);
+  g_free(filename);
+
+  /************************************************************/
+  egg_test_title(test, "old days are removed");
+  for (i = 2; i < GPM_TIMELINE_MAX_DAYS + 10; i++)
+    gpm_timeline_add_at(timeline, day + i * GPM_TIMELINE_DAY,
+                        GPM_TIMELINE_KIND_IDLE, 1);
+  gpm_timeline_flush(timeline, NULL);
+  files = gpm_timeline_list_files(directory);
+  egg_test_assert(test, files->len == GPM_TIMELINE_MAX_DAYS);
+  g_ptr_array_unref(files);
+
+  g_object_unref(timeline);
+  gpm_timeline_test_clear(directory);
+  g_rmdir(directory);
+  g_free(directory);
+
+  egg_test_end(test);
+}
+
+#endif
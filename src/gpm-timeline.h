@@ -0,0 +1,95 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_TIMELINE_H
+#define __GPM_TIMELINE_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GPM_TYPE_TIMELINE (gpm_timeline_get_type())
+#define GPM_TIMELINE(o) \
+  (G_TYPE_CHECK_INSTANCE_CAST((o), GPM_TYPE_TIMELINE, GpmTimeline))
+#define GPM_TIMELINE_CLASS(k) \
+  (G_TYPE_CHECK_CLASS_CAST((k), GPM_TYPE_TIMELINE, GpmTimelineClass))
+#define GPM_IS_TIMELINE(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), GPM_TYPE_TIMELINE))
+#define GPM_IS_TIMELINE_CLASS(k) \
+  (G_TYPE_CHECK_CLASS_TYPE((k), GPM_TYPE_TIMELINE))
+#define GPM_TIMELINE_GET_CLASS(o) \
+  (G_TYPE_INSTANCE_GET_CLASS((o), GPM_TYPE_TIMELINE, GpmTimelineClass))
+
+/* bump this if the on-disk layout changes, old files are then skipped */
+#define GPM_TIMELINE_VERSION 1
+
+/* never renumber these, they are stored on disk */
+typedef enum {
+  GPM_TIMELINE_KIND_BRIGHTNESS, /* percentage */
+  GPM_TIMELINE_KIND_DPMS,       /* GpmDpmsMode */
+  GPM_TIMELINE_KIND_IDLE,       /* GpmIdleMode */
+  GPM_TIMELINE_KIND_LID,        /* 1 if closed */
+  GPM_TIMELINE_KIND_INHIBIT,    /* GPM_TIMELINE_INHIBIT_IDLE|SUSPEND */
+  GPM_TIMELINE_KIND_SLEEP,      /* GpmControlAction */
+  GPM_TIMELINE_KIND_RESUME,     /* GpmControlAction */
+  GPM_TIMELINE_KIND_LAST
+} GpmTimelineKind;
+
+/* the bits of a GPM_TIMELINE_KIND_INHIBIT value */
+#define GPM_TIMELINE_INHIBIT_IDLE (1 << 0)
+#define GPM_TIMELINE_INHIBIT_SUSPEND (1 << 1)
+
+typedef struct {
+  guint32 time;
+  guint32 kind;
+  guint32 value;
+} GpmTimelineItem;
+
+typedef struct GpmTimelinePrivate GpmTimelinePrivate;
+
+typedef struct {
+  GObject parent;
+  GpmTimelinePrivate *priv;
+} GpmTimeline;
+
+typedef struct {
+  GObjectClass parent_class;
+} GpmTimelineClass;
+
+GType gpm_timeline_get_type(void);
+GpmTimeline *gpm_timeline_new(void);
+void gpm_timeline_set_directory(GpmTimeline *timeline, const gchar *directory);
+void gpm_timeline_add(GpmTimeline *timeline, GpmTimelineKind kind,
+                      guint32 value);
+void gpm_timeline_add_at(GpmTimeline *timeline, guint32 time,
+                         GpmTimelineKind kind, guint32 value);
+gboolean gpm_timeline_flush(GpmTimeline *timeline, GError **error);
+
+gchar *gpm_timeline_get_default_directory(void);
+GArray *gpm_timeline_read(const gchar *directory, guint32 start, guint32 stop,
+                          GError **error);
+const gchar *gpm_timeline_kind_to_string(GpmTimelineKind kind);
+#ifdef EGG_TEST
+void gpm_timeline_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_TIMELINE_H */
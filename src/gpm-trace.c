@@ -0,0 +1,1036 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gpm-trace.h"
+
+/* "GPMR" in host byte order */
+#define GPM_TRACE_MAGIC 0x524d5047
+/* write when this much is waiting, or after the timeout, whichever is first */
+#define GPM_TRACE_FLUSH_SIZE 4096
+#define GPM_TRACE_FLUSH_TIMEOUT 60 /* s */
+
+/* each record is a varint of the microseconds since the previous record,
+ * the kind as a byte, a varint value, then the name and the serialized
+ * data, each as a varint length followed by that many bytes */
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  gint64 start; /* real time, in microseconds */
+} GpmTraceHeader;
+
+struct GpmTracePrivate {
+  GpmTraceMode mode;
+  /* recording */
+  gchar *filename;
+  GByteArray *buffer; /* records not written yet */
+  gint fd;
+  gint64 record_start; /* monotonic */
+  gint64 last_time;    /* of the last record, written or not */
+  guint flush_id;
+  /* replaying */
+  GArray *events; /* of GpmTraceEvent */
+  GPtrArray *timeouts;
+  gint64 start; /* real time the trace was started */
+  gint64 time;  /* the virtual clock */
+  gint64 replay_start;
+  gdouble speed;
+  guint replay_index;
+  guint replay_id;
+  guint decisions;
+};
+
+/* a timeout that is run by the virtual clock rather than the real one */
+typedef struct {
+  GSource source;
+  GpmTrace *trace;
+  gint64 deadline;
+  gint64 interval;
+} GpmTraceTimeout;
+
+enum { REPLAY, FINISHED, LAST_SIGNAL };
+
+static guint signals[LAST_SIGNAL] = {0};
+static gpointer gpm_trace_object = NULL;
+
+G_DEFINE_TYPE_WITH_PRIVATE(GpmTrace, gpm_trace, G_TYPE_OBJECT)
+
+/**
+ * gpm_trace_put_varint:
+ **/
+static void gpm_trace_put_varint(GByteArray *buffer, guint64 value) {
+  guint8 byte;
+
+  do {
+    byte = value & 0x7f;
+    value >>= 7;
+    if (value != 0) byte |= 0x80;
+    g_byte_array_append(buffer, &byte, 1);
+  } while (value != 0);
+}
+
+/**
+ * gpm_trace_get_varint:
+ *
+ * Return value: %FALSE if the data ends before the value does
+ **/
+static gboolean gpm_trace_get_varint(const guint8 *data, gsize length,
+                                     gsize *offset, guint64 *value) {
+  guint shift;
+
+  *value = 0;
+  for (shift = 0; shift < 64; shift += 7) {
+    if (*offset >= length) return FALSE;
+    *value |= (guint64)(data[*offset] & 0x7f) << shift;
+    if ((data[(*offset)++] & 0x80) == 0) return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * gpm_trace_put_bytes:
+ **/
+static void gpm_trace_put_bytes(GByteArray *buffer, gconstpointer data,
+                                gsize length) {
+  gpm_trace_put_varint(buffer, length);
+  if (length > 0) g_byte_array_append(buffer, data, length);
+}
+
+/**
+ * gpm_trace_get_bytes:
+ *
+ * Return value: %FALSE if the data ends before the bytes do
+ **/
+static gboolean gpm_trace_get_bytes(const guint8 *data, gsize length,
+                                    gsize *offset, const guint8 **bytes,
+                                    gsize *size) {
+  guint64 value;
+
+  if (!gpm_trace_get_varint(data, length, offset, &value)) return FALSE;
+  if (value > length - *offset) return FALSE;
+  *bytes = data + *offset;
+  *size = value;
+  *offset += value;
+  return TRUE;
+}
+
+/**
+ * gpm_trace_event_clear:
+ **/
+static void gpm_trace_event_clear(GpmTraceEvent *event) {
+  g_free(event->name);
+  if (event->data != NULL) g_variant_unref(event->data);
+}
+
+/**
+ * gpm_trace_get_mode:
+ * @trace: This class instance
+ **/
+GpmTraceMode gpm_trace_get_mode(GpmTrace *trace) {
+  g_return_val_if_fail(GPM_IS_TRACE(trace), GPM_TRACE_MODE_NONE);
+  return trace->priv->mode;
+}
+
+/**
+ * gpm_trace_is_replaying:
+ * @trace: This class instance
+ *
+ * Return value: %TRUE if the handlers should ignore the real inputs, as a
+ * trace is being fed to them instead
+ **/
+gboolean gpm_trace_is_replaying(GpmTrace *trace) {
+  g_return_val_if_fail(GPM_IS_TRACE(trace), FALSE);
+  return trace->priv->mode == GPM_TRACE_MODE_REPLAY;
+}
+
+/**
+ * gpm_trace_get_length:
+ * @trace: This class instance
+ *
+ * Return value: the number of events loaded for replay
+ **/
+guint gpm_trace_get_length(GpmTrace *trace) {
+  g_return_val_if_fail(GPM_IS_TRACE(trace), 0);
+  return trace->priv->events->len;
+}
+
+/**
+ * gpm_trace_get_decisions:
+ * @trace: This class instance
+ *
+ * Return value: the number of decisions made during the replay
+ **/
+guint gpm_trace_get_decisions(GpmTrace *trace) {
+  g_return_val_if_fail(GPM_IS_TRACE(trace), 0);
+  return trace->priv->decisions;
+}
+
+/**
+ * gpm_trace_flush_cb:
+ **/
+static gboolean gpm_trace_flush_cb(GpmTrace *trace) {
+  GError *error = NULL;
+
+  trace->priv->flush_id = 0;
+  if (!gpm_trace_flush(trace, &error)) {
+    g_warning("failed to write trace: %s", error->message);
+    g_error_free(error);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gpm_trace_flush:
+ * @trace: This class instance
+ * @error: a #GError, or %NULL
+ *
+ * Writes out the buffered records, which otherwise happens every minute.
+ *
+ * Return value: %FALSE if the records could not be written, they are then
+ * kept to try again
+ **/
+gboolean gpm_trace_flush(GpmTrace *trace, GError **error) {
+  GpmTracePrivate *priv;
+  gsize offset = 0;
+  gssize wrote;
+
+  g_return_val_if_fail(GPM_IS_TRACE(trace), FALSE);
+
+  priv = trace->priv;
+  if (priv->flush_id != 0) {
+    g_source_remove(priv->flush_id);
+    priv->flush_id = 0;
+  }
+  if (priv->fd < 0 || priv->buffer->len == 0) return TRUE;
+
+  while (offset < priv->buffer->len) {
+    wrote = write(priv->fd, priv->buffer->data + offset,
+                  priv->buffer->len - offset);
+    if (wrote < 0 && errno == EINTR) continue;
+    if (wrote < 0) {
+      g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                  "failed to write %s: %s", priv->filename, g_strerror(errno));
+      g_byte_array_remove_range(priv->buffer, 0, offset);
+      return FALSE;
+    }
+    offset += wrote;
+  }
+  g_byte_array_set_size(priv->buffer, 0);
+  return TRUE;
+}
+
+/**
+ * gpm_trace_record:
+ * @trace: This class instance
+ * @filename: Where to write the trace, which is replaced
+ * @error: a #GError, or %NULL
+ *
+ * Starts recording the inputs of the handlers, which call gpm_trace_add()
+ * whenever they are told something.
+ **/
+gboolean gpm_trace_record(GpmTrace *trace, const gchar *filename,
+                          GError **error) {
+  GpmTracePrivate *priv;
+  GpmTraceHeader header;
+
+  g_return_val_if_fail(GPM_IS_TRACE(trace), FALSE);
+  g_return_val_if_fail(trace->priv->mode == GPM_TRACE_MODE_NONE, FALSE);
+
+  priv = trace->priv;
+  priv->fd = g_open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (priv->fd < 0) {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "failed to open %s: %s", filename, g_strerror(errno));
+    return FALSE;
+  }
+
+  memset(&header, 0, sizeof(GpmTraceHeader));
+  header.magic = GPM_TRACE_MAGIC;
+  header.version = GPM_TRACE_VERSION;
+  header.start = g_get_real_time();
+  g_byte_array_append(priv->buffer, (const guint8 *)&header,
+                      sizeof(GpmTraceHeader));
+  priv->filename = g_strdup(filename);
+  priv->record_start = g_get_monotonic_time();
+  priv->mode = GPM_TRACE_MODE_RECORD;
+  return gpm_trace_flush(trace, error);
+}
+
+/**
+ * gpm_trace_add:
+ * @trace: This class instance
+ * @kind: The kind of input, e.g. %GPM_TRACE_KIND_BUTTON
+ * @value: The value, the meaning depends on @kind
+ * @name: The name, the meaning depends on @kind, or %NULL
+ * @data: Object properties from gpm_trace_get_properties(), or %NULL
+ *
+ * Buffers an input that has just been received, if recording. A floating
+ * @data is sunk, so this can be called without checking the mode first.
+ **/
+void gpm_trace_add(GpmTrace *trace, GpmTraceKind kind, guint32 value,
+                   const gchar *name, GVariant *data) {
+  GpmTracePrivate *priv;
+  GError *error = NULL;
+  guint8 byte = kind;
+  gint64 now;
+
+  g_return_if_fail(GPM_IS_TRACE(trace));
+  g_return_if_fail(kind < GPM_TRACE_KIND_LAST);
+
+  priv = trace->priv;
+  if (data != NULL) g_variant_ref_sink(data);
+  if (priv->mode != GPM_TRACE_MODE_RECORD) goto out;
+
+  now = g_get_monotonic_time() - priv->record_start;
+  gpm_trace_put_varint(priv->buffer, now - priv->last_time);
+  g_byte_array_append(priv->buffer, &byte, 1);
+  gpm_trace_put_varint(priv->buffer, value);
+  gpm_trace_put_bytes(priv->buffer, name, name != NULL ? strlen(name) : 0);
+  if (data != NULL)
+    gpm_trace_put_bytes(priv->buffer, g_variant_get_data(data),
+                        g_variant_get_size(data));
+  else
+    gpm_trace_put_varint(priv->buffer, 0);
+  priv->last_time = now;
+
+  if (priv->buffer->len >= GPM_TRACE_FLUSH_SIZE) {
+    if (!gpm_trace_flush(trace, &error)) {
+      g_warning("failed to write trace: %s", error->message);
+      g_error_free(error);
+    }
+  } else if (priv->flush_id == 0) {
+    priv->flush_id = g_timeout_add_seconds(
+        GPM_TRACE_FLUSH_TIMEOUT, (GSourceFunc)gpm_trace_flush_cb, trace);
+    g_source_set_name_by_id(priv->flush_id, "[GpmTrace] flush");
+  }
+out:
+  if (data != NULL) g_variant_unref(data);
+}
+
+/**
+ * gpm_trace_load:
+ * @trace: This class instance
+ * @filename: A trace written by gpm_trace_record()
+ * @error: a #GError, or %NULL
+ *
+ * Loads a trace to be replayed, after which the handlers ignore the real
+ * inputs. A record cut short by a crash ends the trace.
+ **/
+gboolean gpm_trace_load(GpmTrace *trace, const gchar *filename,
+                        GError **error) {
+  GpmTracePrivate *priv;
+  GpmTraceHeader header;
+  GpmTraceEvent event;
+  const guint8 *bytes;
+  GBytes *blob;
+  guint8 *data = NULL;
+  gsize length = 0;
+  gsize offset;
+  gsize size;
+  guint64 delta;
+  guint64 value;
+  gint64 time = 0;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail(GPM_IS_TRACE(trace), FALSE);
+  g_return_val_if_fail(trace->priv->mode == GPM_TRACE_MODE_NONE, FALSE);
+
+  priv = trace->priv;
+  if (!g_file_get_contents(filename, (gchar **)&data, &length, error))
+    return FALSE;
+  if (length >= sizeof(GpmTraceHeader))
+    memcpy(&header, data, sizeof(GpmTraceHeader));
+  if (length < sizeof(GpmTraceHeader) || header.magic != GPM_TRACE_MAGIC ||
+      header.version != GPM_TRACE_VERSION) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "%s is not a version %i trace", filename, GPM_TRACE_VERSION);
+    goto out;
+  }
+
+  offset = sizeof(GpmTraceHeader);
+  while (offset < length) {
+    memset(&event, 0, sizeof(GpmTraceEvent));
+    if (!gpm_trace_get_varint(data, length, &offset, &delta)) break;
+    if (offset >= length) break;
+    event.kind = data[offset++];
+    if (!gpm_trace_get_varint(data, length, &offset, &value)) break;
+    event.value = value;
+    if (!gpm_trace_get_bytes(data, length, &offset, &bytes, &size)) break;
+    if (size > 0) event.name = g_strndup((const gchar *)bytes, size);
+    if (!gpm_trace_get_bytes(data, length, &offset, &bytes, &size)) {
+      g_free(event.name);
+      break;
+    }
+    if (size > 0) {
+      blob = g_bytes_new(bytes, size);
+      event.data = g_variant_ref_sink(
+          g_variant_new_from_bytes(G_VARIANT_TYPE_VARDICT, blob, FALSE));
+      g_bytes_unref(blob);
+    }
+    time += delta;
+    event.time = time;
+
+    /* from a newer version, which is harmless to skip */
+    if (event.kind >= GPM_TRACE_KIND_LAST) {
+      gpm_trace_event_clear(&event);
+      continue;
+    }
+    g_array_append_val(priv->events, event);
+  }
+  g_debug("loaded %u events covering %.1fs from %s", priv->events->len,
+          time / (gdouble)G_USEC_PER_SEC, filename);
+  priv->start = header.start;
+  priv->mode = GPM_TRACE_MODE_REPLAY;
+  ret = TRUE;
+out:
+  g_free(data);
+  return ret;
+}
+
+/**
+ * gpm_trace_get_time:
+ * @trace: This class instance
+ *
+ * Return value: the monotonic time in microseconds, which comes from the
+ * virtual clock when replaying
+ **/
+gint64 gpm_trace_get_time(GpmTrace *trace) {
+  g_return_val_if_fail(GPM_IS_TRACE(trace), 0);
+  if (trace->priv->mode == GPM_TRACE_MODE_REPLAY) return trace->priv->time;
+  return g_get_monotonic_time();
+}
+
+/**
+ * gpm_trace_get_real_time:
+ * @trace: This class instance
+ *
+ * Return value: the wall clock time in microseconds, which is when the
+ * replayed event happened when replaying
+ **/
+gint64 gpm_trace_get_real_time(GpmTrace *trace) {
+  g_return_val_if_fail(GPM_IS_TRACE(trace), 0);
+  if (trace->priv->mode == GPM_TRACE_MODE_REPLAY)
+    return trace->priv->start + trace->priv->time;
+  return g_get_real_time();
+}
+
+/**
+ * gpm_trace_timeout_prepare:
+ **/
+static gboolean gpm_trace_timeout_prepare(GSource *source, gint *timeout) {
+  GpmTraceTimeout *tt = (GpmTraceTimeout *)source;
+
+  /* the replay wakes the context whenever the clock moves */
+  *timeout = -1;
+  return tt->trace->priv->time >= tt->deadline;
+}
+
+/**
+ * gpm_trace_timeout_check:
+ **/
+static gboolean gpm_trace_timeout_check(GSource *source) {
+  GpmTraceTimeout *tt = (GpmTraceTimeout *)source;
+  return tt->trace->priv->time >= tt->deadline;
+}
+
+/**
+ * gpm_trace_timeout_dispatch:
+ **/
+static gboolean gpm_trace_timeout_dispatch(GSource *source,
+                                           GSourceFunc callback,
+                                           gpointer user_data) {
+  GpmTraceTimeout *tt = (GpmTraceTimeout *)source;
+
+  if (callback == NULL) return G_SOURCE_REMOVE;
+  if (!callback(user_data)) return G_SOURCE_REMOVE;
+  tt->deadline += tt->interval;
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * gpm_trace_timeout_finalize:
+ **/
+static void gpm_trace_timeout_finalize(GSource *source) {
+  GpmTraceTimeout *tt = (GpmTraceTimeout *)source;
+  g_ptr_array_remove_fast(tt->trace->priv->timeouts, tt);
+  g_object_unref(tt->trace);
+}
+
+static GSourceFuncs gpm_trace_timeout_funcs = {
+    gpm_trace_timeout_prepare, gpm_trace_timeout_check,
+    gpm_trace_timeout_dispatch, gpm_trace_timeout_finalize, NULL, NULL};
+
+/**
+ * gpm_trace_timeout_add_seconds:
+ * @trace: This class instance
+ * @interval: The time between calls to @function, in seconds
+ * @function: The function to call
+ * @data: The data to pass to @function
+ *
+ * Like g_timeout_add_seconds(), but run by the virtual clock when
+ * replaying so that a day of timeouts takes no time at all. The returned
+ * ID can be used with g_source_remove() in the same way.
+ **/
+guint gpm_trace_timeout_add_seconds(GpmTrace *trace, guint interval,
+                                    GSourceFunc function, gpointer data) {
+  GpmTraceTimeout *tt;
+  GSource *source;
+  guint id;
+
+  g_return_val_if_fail(GPM_IS_TRACE(trace), 0);
+
+  if (trace->priv->mode != GPM_TRACE_MODE_REPLAY)
+    return g_timeout_add_seconds(interval, function, data);
+
+  source = g_source_new(&gpm_trace_timeout_funcs, sizeof(GpmTraceTimeout));
+  tt = (GpmTraceTimeout *)source;
+  tt->trace = g_object_ref(trace);
+  tt->interval = (gint64)interval * G_USEC_PER_SEC;
+  tt->deadline = trace->priv->time + tt->interval;
+  g_source_set_callback(source, function, data, NULL);
+  g_ptr_array_add(trace->priv->timeouts, tt);
+  id = g_source_attach(source, NULL);
+  g_source_unref(source);
+  return id;
+}
+
+/**
+ * gpm_trace_get_next_deadline:
+ *
+ * Return value: when the next virtual timeout is due, or %G_MAXINT64
+ **/
+static gint64 gpm_trace_get_next_deadline(GpmTrace *trace) {
+  GpmTraceTimeout *tt;
+  gint64 deadline = G_MAXINT64;
+  guint i;
+
+  for (i = 0; i < trace->priv->timeouts->len; i++) {
+    tt = g_ptr_array_index(trace->priv->timeouts, i);
+    if (g_source_is_destroyed((GSource *)tt)) continue;
+    deadline = MIN(deadline, tt->deadline);
+  }
+  return deadline;
+}
+
+static gboolean gpm_trace_replay_cb(GpmTrace *trace);
+
+/**
+ * gpm_trace_replay_schedule:
+ * @delay: How long to wait in real time, in milliseconds
+ **/
+static void gpm_trace_replay_schedule(GpmTrace *trace, guint delay) {
+  GpmTracePrivate *priv = trace->priv;
+
+  /* run after everything the last event caused */
+  if (delay == 0)
+    priv->replay_id = g_idle_add_full(
+        G_PRIORITY_LOW, (GSourceFunc)gpm_trace_replay_cb, trace, NULL);
+  else
+    priv->replay_id = g_timeout_add_full(
+        G_PRIORITY_LOW, delay, (GSourceFunc)gpm_trace_replay_cb, trace, NULL);
+  g_source_set_name_by_id(priv->replay_id, "[GpmTrace] replay");
+}
+
+/**
+ * gpm_trace_replay_cb:
+ *
+ * Moves the virtual clock on to whichever comes first, the next event or
+ * the next timeout, and hands the event to the handlers.
+ **/
+static gboolean gpm_trace_replay_cb(GpmTrace *trace) {
+  GpmTracePrivate *priv = trace->priv;
+  GpmTraceEvent *event;
+  gint64 deadline;
+  gint64 next;
+  gint64 wall;
+
+  priv->replay_id = 0;
+  if (priv->replay_index >= priv->events->len) {
+    g_debug("replay finished after %.1fs",
+            priv->time / (gdouble)G_USEC_PER_SEC);
+    g_signal_emit(trace, signals[FINISHED], 0);
+    return G_SOURCE_REMOVE;
+  }
+  event = &g_array_index(priv->events, GpmTraceEvent, priv->replay_index);
+  deadline = gpm_trace_get_next_deadline(trace);
+  next = MIN(event->time, deadline);
+
+  /* wait for the real clock to catch up */
+  if (priv->speed > 0) {
+    wall = (g_get_monotonic_time() - priv->replay_start) * priv->speed;
+    if (wall < next) {
+      gpm_trace_replay_schedule(
+          trace, MAX((next - wall) / priv->speed / 1000, 1));
+      return G_SOURCE_REMOVE;
+    }
+  }
+
+  /* let the timeout run first, the event is handled next time */
+  if (deadline <= event->time) {
+    priv->time = MAX(priv->time, deadline);
+    gpm_trace_replay_schedule(trace, 0);
+    return G_SOURCE_REMOVE;
+  }
+
+  priv->time = event->time;
+  priv->replay_index++;
+  g_signal_emit(trace, signals[REPLAY], 0, event);
+  gpm_trace_replay_schedule(trace, 0);
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gpm_trace_replay:
+ * @trace: This class instance
+ * @speed: How many times faster than real time, or 0 for as fast as possible
+ *
+ * Starts feeding the loaded trace to the handlers, emitting ::finished
+ * once it has all been replayed.
+ **/
+void gpm_trace_replay(GpmTrace *trace, gdouble speed) {
+  g_return_if_fail(GPM_IS_TRACE(trace));
+  g_return_if_fail(trace->priv->mode == GPM_TRACE_MODE_REPLAY);
+  g_return_if_fail(trace->priv->replay_id == 0);
+
+  trace->priv->speed = MAX(speed, 0);
+  trace->priv->replay_start = g_get_monotonic_time() - trace->priv->time;
+  gpm_trace_replay_schedule(trace, 0);
+}
+
+/**
+ * gpm_trace_decision:
+ * @trace: This class instance
+ * @format: A printf style description of the decision
+ *
+ * Prints a decision made by the policy when replaying, so the output of
+ * two versions can be compared. This does nothing otherwise.
+ **/
+void gpm_trace_decision(GpmTrace *trace, const gchar *format, ...) {
+  va_list args;
+  gchar *text;
+
+  g_return_if_fail(GPM_IS_TRACE(trace));
+
+  if (trace->priv->mode != GPM_TRACE_MODE_REPLAY) return;
+  va_start(args, format);
+  text = g_strdup_vprintf(format, args);
+  va_end(args);
+  g_print("%10.3f %s\n", trace->priv->time / (gdouble)G_USEC_PER_SEC, text);
+  trace->priv->decisions++;
+  g_free(text);
+}
+
+/**
+ * gpm_trace_value_to_variant:
+ *
+ * Return value: a floating #GVariant, or %NULL if the type is not stored
+ **/
+static GVariant *gpm_trace_value_to_variant(const GValue *value) {
+  switch (G_TYPE_FUNDAMENTAL(G_VALUE_TYPE(value))) {
+    case G_TYPE_BOOLEAN:
+      return g_variant_new_boolean(g_value_get_boolean(value));
+    case G_TYPE_INT:
+      return g_variant_new_int32(g_value_get_int(value));
+    case G_TYPE_UINT:
+      return g_variant_new_uint32(g_value_get_uint(value));
+    case G_TYPE_INT64:
+      return g_variant_new_int64(g_value_get_int64(value));
+    case G_TYPE_UINT64:
+      return g_variant_new_uint64(g_value_get_uint64(value));
+    case G_TYPE_DOUBLE:
+      return g_variant_new_double(g_value_get_double(value));
+    case G_TYPE_ENUM:
+      return g_variant_new_int32(g_value_get_enum(value));
+    case G_TYPE_FLAGS:
+      return g_variant_new_uint32(g_value_get_flags(value));
+    case G_TYPE_STRING:
+      return g_variant_new_string(
+          g_value_get_string(value) != NULL ? g_value_get_string(value) : "");
+    default:
+      return NULL;
+  }
+}
+
+/**
+ * gpm_trace_variant_to_value:
+ * @value: A #GValue already set to the type of the property
+ *
+ * Return value: %FALSE if the stored type does not match the property
+ **/
+static gboolean gpm_trace_variant_to_value(GVariant *variant, GValue *value) {
+  GType type = G_TYPE_FUNDAMENTAL(G_VALUE_TYPE(value));
+
+  if (type == G_TYPE_BOOLEAN &&
+      g_variant_is_of_type(variant, G_VARIANT_TYPE_BOOLEAN))
+    g_value_set_boolean(value, g_variant_get_boolean(variant));
+  else if (type == G_TYPE_INT &&
+           g_variant_is_of_type(variant, G_VARIANT_TYPE_INT32))
+    g_value_set_int(value, g_variant_get_int32(variant));
+  else if (type == G_TYPE_UINT &&
+           g_variant_is_of_type(variant, G_VARIANT_TYPE_UINT32))
+    g_value_set_uint(value, g_variant_get_uint32(variant));
+  else if (type == G_TYPE_INT64 &&
+           g_variant_is_of_type(variant, G_VARIANT_TYPE_INT64))
+    g_value_set_int64(value, g_variant_get_int64(variant));
+  else if (type == G_TYPE_UINT64 &&
+           g_variant_is_of_type(variant, G_VARIANT_TYPE_UINT64))
+    g_value_set_uint64(value, g_variant_get_uint64(variant));
+  else if (type == G_TYPE_DOUBLE &&
+           g_variant_is_of_type(variant, G_VARIANT_TYPE_DOUBLE))
+    g_value_set_double(value, g_variant_get_double(variant));
+  else if (type == G_TYPE_ENUM &&
+           g_variant_is_of_type(variant, G_VARIANT_TYPE_INT32))
+    g_value_set_enum(value, g_variant_get_int32(variant));
+  else if (type == G_TYPE_FLAGS &&
+           g_variant_is_of_type(variant, G_VARIANT_TYPE_UINT32))
+    g_value_set_flags(value, g_variant_get_uint32(variant));
+  else if (type == G_TYPE_STRING &&
+           g_variant_is_of_type(variant, G_VARIANT_TYPE_STRING))
+    g_value_set_string(value, g_variant_get_string(variant, NULL));
+  else
+    return FALSE;
+  return TRUE;
+}
+
+/**
+ * gpm_trace_get_properties:
+ * @object: The object to save, e.g. an #UpDevice
+ * @name: The property to save, or %NULL for all of them
+ *
+ * Return value: a floating a{sv} #GVariant for gpm_trace_add()
+ **/
+GVariant *gpm_trace_get_properties(GObject *object, const gchar *name) {
+  GVariantBuilder builder;
+  GParamSpec **pspecs;
+  GParamSpec *pspec;
+  GVariant *variant;
+  GValue value = G_VALUE_INIT;
+  guint n_pspecs = 1;
+  guint i;
+
+  g_return_val_if_fail(G_IS_OBJECT(object), NULL);
+
+  if (name != NULL) {
+    pspecs = g_new0(GParamSpec *, 1);
+    pspecs[0] = g_object_class_find_property(G_OBJECT_GET_CLASS(object), name);
+    if (pspecs[0] == NULL) n_pspecs = 0;
+  } else {
+    pspecs = g_object_class_list_properties(G_OBJECT_GET_CLASS(object),
+                                            &n_pspecs);
+  }
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+  for (i = 0; i < n_pspecs; i++) {
+    pspec = pspecs[i];
+    if ((pspec->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE ||
+        (pspec->flags & G_PARAM_CONSTRUCT_ONLY) != 0)
+      continue;
+    g_value_init(&value, pspec->value_type);
+    g_object_get_property(object, pspec->name, &value);
+    variant = gpm_trace_value_to_variant(&value);
+    if (variant != NULL)
+      g_variant_builder_add(&builder, "{sv}", pspec->name, variant);
+    g_value_unset(&value);
+  }
+  g_free(pspecs);
+  return g_variant_builder_end(&builder);
+}
+
+/**
+ * gpm_trace_set_properties:
+ * @object: The object to change, e.g. an #UpDevice
+ * @data: Properties from gpm_trace_get_properties()
+ *
+ * Sets all the properties at once, so there is one notify for each.
+ **/
+void gpm_trace_set_properties(GObject *object, GVariant *data) {
+  GParamSpec *pspec;
+  GVariantIter iter;
+  GVariant *variant;
+  GValue value = G_VALUE_INIT;
+  const gchar *name;
+
+  g_return_if_fail(G_IS_OBJECT(object));
+  if (data == NULL) return;
+
+  g_object_freeze_notify(object);
+  g_variant_iter_init(&iter, data);
+  while (g_variant_iter_next(&iter, "{&sv}", &name, &variant)) {
+    pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(object), name);
+    if (pspec != NULL) {
+      g_value_init(&value, pspec->value_type);
+      if (gpm_trace_variant_to_value(variant, &value))
+        g_object_set_property(object, name, &value);
+      else
+        g_debug("ignoring %s of the wrong type", name);
+      g_value_unset(&value);
+    }
+    g_variant_unref(variant);
+  }
+  g_object_thaw_notify(object);
+}
+
+/**
+ * gpm_trace_kind_to_string:
+ **/
+const gchar *gpm_trace_kind_to_string(GpmTraceKind kind) {
+  if (kind == GPM_TRACE_KIND_DEVICE_ADDED) return "device-added";
+  if (kind == GPM_TRACE_KIND_DEVICE_REMOVED) return "device-removed";
+  if (kind == GPM_TRACE_KIND_DEVICE_CHANGED) return "device-changed";
+  if (kind == GPM_TRACE_KIND_CLIENT) return "client";
+  if (kind == GPM_TRACE_KIND_IDLE_ALARM) return "idle-alarm";
+  if (kind == GPM_TRACE_KIND_IDLE_RESET) return "idle-reset";
+  if (kind == GPM_TRACE_KIND_BUTTON) return "button";
+  if (kind == GPM_TRACE_KIND_SESSION_IDLE) return "session-idle";
+  if (kind == GPM_TRACE_KIND_INHIBITOR_ADDED) return "inhibitor-added";
+  if (kind == GPM_TRACE_KIND_INHIBITOR_REMOVED) return "inhibitor-removed";
+  return "unknown";
+}
+
+/**
+ * gpm_trace_finalize:
+ **/
+static void gpm_trace_finalize(GObject *object) {
+  GpmTrace *trace;
+  GError *error = NULL;
+
+  g_return_if_fail(object != NULL);
+  g_return_if_fail(GPM_IS_TRACE(object));
+
+  trace = GPM_TRACE(object);
+  if (!gpm_trace_flush(trace, &error)) {
+    g_warning("failed to write trace: %s", error->message);
+    g_error_free(error);
+  }
+  if (trace->priv->fd >= 0) close(trace->priv->fd);
+  if (trace->priv->replay_id != 0) g_source_remove(trace->priv->replay_id);
+  g_byte_array_unref(trace->priv->buffer);
+  g_array_unref(trace->priv->events);
+  g_ptr_array_unref(trace->priv->timeouts);
+  g_free(trace->priv->filename);
+
+  G_OBJECT_CLASS(gpm_trace_parent_class)->finalize(object);
+}
+
+/**
+ * gpm_trace_class_init:
+ **/
+static void gpm_trace_class_init(GpmTraceClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->finalize = gpm_trace_finalize;
+
+  signals[REPLAY] = g_signal_new(
+      "replay", G_TYPE_FROM_CLASS(object_class), G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET(GpmTraceClass, replay), NULL, NULL,
+      g_cclosure_marshal_VOID__POINTER, G_TYPE_NONE, 1, G_TYPE_POINTER);
+  signals[FINISHED] = g_signal_new(
+      "finished", G_TYPE_FROM_CLASS(object_class), G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET(GpmTraceClass, finished), NULL, NULL,
+      g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+}
+
+/**
+ * gpm_trace_init:
+ **/
+static void gpm_trace_init(GpmTrace *trace) {
+  trace->priv = gpm_trace_get_instance_private(trace);
+  trace->priv->buffer = g_byte_array_new();
+  trace->priv->fd = -1;
+  trace->priv->events = g_array_new(FALSE, FALSE, sizeof(GpmTraceEvent));
+  g_array_set_clear_func(trace->priv->events,
+                         (GDestroyNotify)gpm_trace_event_clear);
+  trace->priv->timeouts = g_ptr_array_new();
+}
+
+/**
+ * gpm_trace_new:
+ * Return value: A new trace class instance.
+ **/
+GpmTrace *gpm_trace_new(void) {
+  if (gpm_trace_object != NULL) {
+    g_object_ref(gpm_trace_object);
+  } else {
+    gpm_trace_object = g_object_new(GPM_TYPE_TRACE, NULL);
+    g_object_add_weak_pointer(gpm_trace_object, &gpm_trace_object);
+  }
+  return GPM_TRACE(gpm_trace_object);
+}
+
+/***************************************************************************
+ ***                          MAKE CHECK TESTS                           ***
+ ***************************************************************************/
+#ifdef EGG_TEST
+#include "egg-test.h"
+
+static void gpm_trace_test_replay_cb(GpmTrace *trace,
+                                     const GpmTraceEvent *event,
+                                     GString *order) {
+  g_string_append_printf(order, "e%" G_GINT64_FORMAT " ",
+                         trace->priv->time / G_USEC_PER_SEC);
+}
+
+static gboolean gpm_trace_test_timeout_cb(GString *order) {
+  GpmTrace *trace = gpm_trace_object;
+  g_string_append_printf(order, "t%" G_GINT64_FORMAT " ",
+                         trace->priv->time / G_USEC_PER_SEC);
+  return G_SOURCE_CONTINUE;
+}
+
+static void gpm_trace_test_add_event(GpmTrace *trace, gint64 seconds) {
+  GpmTraceEvent event;
+
+  memset(&event, 0, sizeof(GpmTraceEvent));
+  event.time = seconds * G_USEC_PER_SEC;
+  event.kind = GPM_TRACE_KIND_BUTTON;
+  g_array_append_val(trace->priv->events, event);
+}
+
+void gpm_trace_test(gpointer data) {
+  GpmTrace *trace;
+  GpmTraceEvent *event;
+  GVariantBuilder builder;
+  GMainLoop *loop;
+  GString *order;
+  gchar *filename;
+  gdouble percentage = 0;
+  guint id;
+  EggTest *test = (EggTest *)data;
+
+  if (!egg_test_start(test, "GpmTrace")) return;
+
+  filename = g_build_filename(g_get_tmp_dir(), "gpm-self-test.trace", NULL);
+
+  /************************************************************/
+  egg_test_title(test, "record a trace");
+  trace = g_object_new(GPM_TYPE_TRACE, NULL);
+  egg_test_assert(test, gpm_trace_record(trace, filename, NULL));
+
+  /************************************************************/
+  egg_test_title(test, "nothing is written until flushed");
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&builder, "{sv}", "percentage",
+                        g_variant_new_double(42.5));
+  gpm_trace_add(trace, GPM_TRACE_KIND_DEVICE_ADDED, 0, "/bat0",
+                g_variant_builder_end(&builder));
+  gpm_trace_add(trace, GPM_TRACE_KIND_BUTTON, 0, "lid-close", NULL);
+  gpm_trace_add(trace, GPM_TRACE_KIND_CLIENT, GPM_TRACE_CLIENT_ON_BATTERY,
+                NULL, NULL);
+  egg_test_assert(test, trace->priv->buffer->len > sizeof(GpmTraceHeader));
+
+  /************************************************************/
+  egg_test_title(test, "flush the trace");
+  gpm_trace_flush(trace, NULL);
+  egg_test_assert(test, trace->priv->buffer->len == 0);
+  g_object_unref(trace);
+
+  /************************************************************/
+  egg_test_title(test, "load it back");
+  trace = g_object_new(GPM_TYPE_TRACE, NULL);
+  egg_test_assert(test, gpm_trace_load(trace, filename, NULL) &&
+                            gpm_trace_get_length(trace) == 3 &&
+                            gpm_trace_is_replaying(trace));
+
+  /************************************************************/
+  egg_test_title(test, "the device is restored");
+  event = &g_array_index(trace->priv->events, GpmTraceEvent, 0);
+  if (event->data != NULL)
+    g_variant_lookup(event->data, "percentage", "d", &percentage);
+  if (event->kind == GPM_TRACE_KIND_DEVICE_ADDED &&
+      g_strcmp0(event->name, "/bat0") == 0 && percentage == 42.5)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %s %s %.1f",
+                    gpm_trace_kind_to_string(event->kind), event->name,
+                    percentage);
+
+  /************************************************************/
+  egg_test_title(test, "the order is kept");
+  event = &g_array_index(trace->priv->events, GpmTraceEvent, 2);
+  egg_test_assert(
+      test, event->kind == GPM_TRACE_KIND_CLIENT &&
+                event->value == GPM_TRACE_CLIENT_ON_BATTERY &&
+                event->name == NULL && event->data == NULL &&
+                event->time >=
+                    g_array_index(trace->priv->events, GpmTraceEvent, 1).time);
+  g_object_unref(trace);
+
+  /************************************************************/
+  egg_test_title(test, "a truncated trace is still loaded");
+  trace = g_object_new(GPM_TYPE_TRACE, NULL);
+  egg_test_assert(test, truncate(filename, 30) == 0 &&
+                            gpm_trace_load(trace, filename, NULL) &&
+                            gpm_trace_get_length(trace) == 0);
+  g_object_unref(trace);
+
+  /************************************************************/
+  egg_test_title(test, "something else is refused");
+  g_file_set_contents(filename, "not a trace at all", -1, NULL);
+  trace = g_object_new(GPM_TYPE_TRACE, NULL);
+  egg_test_assert(test, !gpm_trace_load(trace, filename, NULL));
+  g_object_unref(trace);
+
+  /************************************************************/
+  egg_test_title(test, "timeouts run on the virtual clock");
+  trace = gpm_trace_new();
+  trace->priv->mode = GPM_TRACE_MODE_REPLAY;
+  gpm_trace_test_add_event(trace, 5);
+  gpm_trace_test_add_event(trace, 25);
+  order = g_string_new("");
+  loop = g_main_loop_new(NULL, FALSE);
+  g_signal_connect(trace, "replay", G_CALLBACK(gpm_trace_test_replay_cb),
+                   order);
+  g_signal_connect_swapped(trace, "finished", G_CALLBACK(g_main_loop_quit),
+                           loop);
+  id = gpm_trace_timeout_add_seconds(
+      trace, 10, (GSourceFunc)gpm_trace_test_timeout_cb, order);
+  gpm_trace_replay(trace, 0);
+  g_main_loop_run(loop);
+  if (g_strcmp0(order->str, "e5 t10 t20 e25 ") == 0)
+    egg_test_success(test, NULL);
+  else
+    egg_test_failed(test, "got %s", order->str);
+
+  /************************************************************/
+  egg_test_title(test, "the wall clock follows the trace");
+  egg_test_assert(test, gpm_trace_get_real_time(trace) ==
+                            trace->priv->start + 25 * G_USEC_PER_SEC);
+  g_source_remove(id);
+  g_main_loop_unref(loop);
+  g_string_free(order, TRUE);
+  g_object_unref(trace);
+
+  g_unlink(filename);
+  g_free(filename);
+
+  egg_test_end(test);
+}
+
+#endif
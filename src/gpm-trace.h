@@ -0,0 +1,122 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2012-2021 MATE Developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GPM_TRACE_H
+#define __GPM_TRACE_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GPM_TYPE_TRACE (gpm_trace_get_type())
+#define GPM_TRACE(o) (G_TYPE_CHECK_INSTANCE_CAST((o), GPM_TYPE_TRACE, GpmTrace))
+#define GPM_TRACE_CLASS(k) \
+  (G_TYPE_CHECK_CLASS_CAST((k), GPM_TYPE_TRACE, GpmTraceClass))
+#define GPM_IS_TRACE(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), GPM_TYPE_TRACE))
+#define GPM_IS_TRACE_CLASS(k) (G_TYPE_CHECK_CLASS_TYPE((k), GPM_TYPE_TRACE))
+#define GPM_TRACE_GET_CLASS(o) \
+  (G_TYPE_INSTANCE_GET_CLASS((o), GPM_TYPE_TRACE, GpmTraceClass))
+
+/* bump this if the on-disk layout changes, old traces are then refused */
+#define GPM_TRACE_VERSION 1
+
+typedef enum {
+  GPM_TRACE_MODE_NONE,
+  GPM_TRACE_MODE_RECORD,
+  GPM_TRACE_MODE_REPLAY
+} GpmTraceMode;
+
+/* never renumber these, they are stored on disk */
+/* a device with no path is the composite battery */
+typedef enum {
+  GPM_TRACE_KIND_DEVICE_ADDED,      /* name is the path, data all props */
+  GPM_TRACE_KIND_DEVICE_REMOVED,    /* name is the path */
+  GPM_TRACE_KIND_DEVICE_CHANGED,    /* name is the path, data the prop */
+  GPM_TRACE_KIND_CLIENT,            /* GPM_TRACE_CLIENT_* flags */
+  GPM_TRACE_KIND_IDLE_ALARM,        /* alarm id */
+  GPM_TRACE_KIND_IDLE_RESET,        /* nothing */
+  GPM_TRACE_KIND_BUTTON,            /* name is the button type */
+  GPM_TRACE_KIND_SESSION_IDLE,      /* 1 if idle */
+  GPM_TRACE_KIND_INHIBITOR_ADDED,   /* name is the id, GPM_TRACE_INHIBIT_* */
+  GPM_TRACE_KIND_INHIBITOR_REMOVED, /* name is the id, GPM_TRACE_INHIBIT_* */
+  GPM_TRACE_KIND_LAST
+} GpmTraceKind;
+
+#define GPM_TRACE_CLIENT_ON_BATTERY (1 << 0)
+#define GPM_TRACE_CLIENT_LID_IS_CLOSED (1 << 1)
+#define GPM_TRACE_CLIENT_COLDPLUG (1 << 2) /* the state at startup */
+
+/* what the session reported once the inhibitor had been changed */
+#define GPM_TRACE_INHIBIT_IDLE (1 << 0)
+#define GPM_TRACE_INHIBIT_SUSPEND (1 << 1)
+
+typedef struct {
+  gint64 time; /* microseconds since the trace was started */
+  GpmTraceKind kind;
+  guint32 value;
+  gchar *name;
+  GVariant *data; /* a{sv} of object properties, or %NULL */
+} GpmTraceEvent;
+
+typedef struct GpmTracePrivate GpmTracePrivate;
+
+typedef struct {
+  GObject parent;
+  GpmTracePrivate *priv;
+} GpmTrace;
+
+typedef struct {
+  GObjectClass parent_class;
+  void (*replay)(GpmTrace *trace, const GpmTraceEvent *event);
+  void (*finished)(GpmTrace *trace);
+} GpmTraceClass;
+
+GType gpm_trace_get_type(void);
+GpmTrace *gpm_trace_new(void);
+GpmTraceMode gpm_trace_get_mode(GpmTrace *trace);
+gboolean gpm_trace_is_replaying(GpmTrace *trace);
+gboolean gpm_trace_record(GpmTrace *trace, const gchar *filename,
+                          GError **error);
+gboolean gpm_trace_load(GpmTrace *trace, const gchar *filename,
+                        GError **error);
+void gpm_trace_replay(GpmTrace *trace, gdouble speed);
+gboolean gpm_trace_flush(GpmTrace *trace, GError **error);
+void gpm_trace_add(GpmTrace *trace, GpmTraceKind kind, guint32 value,
+                   const gchar *name, GVariant *data);
+guint gpm_trace_get_length(GpmTrace *trace);
+gint64 gpm_trace_get_time(GpmTrace *trace);
+gint64 gpm_trace_get_real_time(GpmTrace *trace);
+guint gpm_trace_timeout_add_seconds(GpmTrace *trace, guint interval,
+                                    GSourceFunc function, gpointer data);
+void gpm_trace_decision(GpmTrace *trace, const gchar *format, ...)
+    G_GNUC_PRINTF(2, 3);
+guint gpm_trace_get_decisions(GpmTrace *trace);
+
+GVariant *gpm_trace_get_properties(GObject *object, const gchar *name);
+void gpm_trace_set_properties(GObject *object, GVariant *data);
+const gchar *gpm_trace_kind_to_string(GpmTraceKind kind);
+#ifdef EGG_TEST
+void gpm_trace_test(gpointer data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GPM_TRACE_H */